@@ -63,6 +63,7 @@
 #include "units.h"
 #include "language.h"
 #include "gimp-debug.h"
+#include "gimp-trace.h"
 
 #include "gimp-intl.h"
 
@@ -129,6 +130,9 @@ app_run (const gchar         *full_prog_name,
          const gchar         *session_name,
          const gchar         *batch_interpreter,
          const gchar        **batch_commands,
+         const gchar         *batch_file,
+         gint                 batch_jobs,
+         gint                 batch_timeout,
          gboolean             as_new,
          gboolean             no_interface,
          gboolean             no_data,
@@ -167,9 +171,15 @@ app_run (const gchar         *full_prog_name,
       filenames = NULL;
     }
 
+  /*  Needs to happen before any operation class picks its
+   *  processing function
+   */
+  gimp_cpu_accel_set_use (use_cpu_accel);
+
   /*  Create an instance of the "Gimp" object which is the root of the
    *  core object system
    */
+  gimp_trace_begin ("gimp_new");
   gimp = gimp_new (full_prog_name,
                    session_name,
                    default_folder,
@@ -181,6 +191,7 @@ app_run (const gchar         *full_prog_name,
                    console_messages,
                    stack_trace_mode,
                    pdb_compat_mode);
+  gimp_trace_end ();
 
   errors_init (gimp, full_prog_name, use_debug_handler, stack_trace_mode);
 
@@ -204,17 +215,25 @@ app_run (const gchar         *full_prog_name,
       gimp_user_install_free (install);
     }
 
+  gimp_trace_begin ("gimp_load_config");
   gimp_load_config (gimp, alternate_system_gimprc, alternate_gimprc);
+  gimp_trace_end ();
 
   /*  change the locale if a language if specified  */
   language_init (gimp->config->language);
 
   /*  initialize lowlevel stuff  */
+  gimp_trace_begin ("gimp_gegl_init");
   gimp_gegl_init (gimp);
+  gimp_trace_end ();
 
 #ifndef GIMP_CONSOLE_COMPILATION
   if (! no_interface)
-    update_status_func = gui_init (gimp, no_splash);
+    {
+      gimp_trace_begin ("gui_init");
+      update_status_func = gui_init (gimp, no_splash);
+      gimp_trace_end ();
+    }
 #endif
 
   if (! update_status_func)
@@ -227,7 +246,9 @@ app_run (const gchar         *full_prog_name,
 
   /*  Load all data files
    */
+  gimp_trace_begin ("gimp_restore");
   gimp_restore (gimp, update_status_func);
+  gimp_trace_end ();
 
   /*  enable autosave late so we don't autosave when the
    *  monitor resolution is set in gui_init()
@@ -240,11 +261,19 @@ app_run (const gchar         *full_prog_name,
     {
       gint i;
 
+      gimp_trace_begin ("open files");
+
       for (i = 0; filenames[i] != NULL; i++)
         file_open_from_command_line (gimp, filenames[i], as_new);
+
+      gimp_trace_end ();
     }
 
-  batch_run (gimp, batch_interpreter, batch_commands);
+  /*  startup is over, the batch commands may well exit  */
+  gimp_trace_exit ();
+
+  batch_run (gimp, batch_interpreter, batch_commands,
+             batch_file, batch_jobs, batch_timeout);
 
   loop = g_main_loop_new (NULL, FALSE);
 
@@ -25,8 +25,10 @@
 #include "libgimpbase/gimpbase.h"
 
 #include "core/core-types.h"
+#include "plug-in/plug-in-types.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 #include "core/gimpparamspecs.h"
 
 #include "batch.h"
@@ -34,29 +36,62 @@
 #include "pdb/gimppdb.h"
 #include "pdb/gimpprocedure.h"
 
+#include "plug-in/gimppluginmanager.h"
+#include "plug-in/gimppluginmanager-batch.h"
+#include "plug-in/gimppluginprocedure.h"
+
 #include "gimp-intl.h"
 
 
 #define BATCH_DEFAULT_EVAL_PROC   "plug-in-script-fu-eval"
 
 
-static void  batch_exit_after_callback (Gimp          *gimp) G_GNUC_NORETURN;
+typedef struct
+{
+  gchar  **jobs;
+  gint     n_failed;
+} BatchJobList;
+
+
+static void             batch_exit_after_callback (Gimp           *gimp) G_GNUC_NORETURN;
 
-static void  batch_run_cmd             (Gimp          *gimp,
-                                        const gchar   *proc_name,
-                                        GimpProcedure *procedure,
-                                        GimpRunMode    run_mode,
-                                        const gchar   *cmd);
+static GimpValueArray * batch_get_arguments       (GimpProcedure  *procedure,
+                                                   GimpRunMode     run_mode,
+                                                   const gchar    *cmd);
+static void             batch_run_cmd             (Gimp           *gimp,
+                                                   const gchar    *proc_name,
+                                                   GimpProcedure  *procedure,
+                                                   GimpRunMode     run_mode,
+                                                   const gchar    *cmd);
+
+static gchar         ** batch_read_jobs           (const gchar    *batch_file,
+                                                   GError        **error);
+static void             batch_run_jobs            (Gimp           *gimp,
+                                                   const gchar    *proc_name,
+                                                   GimpProcedure  *procedure,
+                                                   const gchar    *batch_file,
+                                                   gint            batch_jobs,
+                                                   gint            batch_timeout);
+static void             batch_job_done            (gint            job,
+                                                   GimpValueArray *return_vals,
+                                                   gdouble         seconds,
+                                                   BatchJobList   *list);
+
+
+static gboolean  batch_failed = FALSE;
 
 
 void
 batch_run (Gimp         *gimp,
            const gchar  *batch_interpreter,
-           const gchar **batch_commands)
+           const gchar **batch_commands,
+           const gchar  *batch_file,
+           gint          batch_jobs,
+           gint          batch_timeout)
 {
   gulong  exit_id;
 
-  if (! batch_commands || ! batch_commands[0])
+  if ((! batch_commands || ! batch_commands[0]) && ! batch_file)
     return;
 
   exit_id = g_signal_connect_after (gimp, "exit",
@@ -77,10 +112,29 @@ batch_run (Gimp         *gimp,
         }
     }
 
+  /*  the job list runs first, one interpreter process per job  */
+
+  if (batch_file)
+    {
+      GimpProcedure *eval_proc = gimp_pdb_lookup_procedure (gimp->pdb,
+                                                            batch_interpreter);
+
+      if (eval_proc)
+        batch_run_jobs (gimp, batch_interpreter, eval_proc,
+                        batch_file, batch_jobs, batch_timeout);
+      else
+        g_message (_("The batch interpreter '%s' is not available. "
+                     "Batch mode disabled."), batch_interpreter);
+    }
+
   /*  script-fu text console, hardcoded for backward compatibility  */
 
-  if (strcmp (batch_interpreter, "plug-in-script-fu-eval") == 0 &&
-      strcmp (batch_commands[0], "-") == 0)
+  if (! batch_commands || ! batch_commands[0])
+    {
+      /*  only a job list  */
+    }
+  else if (strcmp (batch_interpreter, "plug-in-script-fu-eval") == 0 &&
+           strcmp (batch_commands[0], "-") == 0)
     {
       const gchar   *proc_name = "plug-in-script-fu-text-console";
       GimpProcedure *procedure = gimp_pdb_lookup_procedure (gimp->pdb,
@@ -131,20 +185,16 @@ batch_exit_after_callback (Gimp *gimp)
 
   gegl_exit ();
 
-  exit (EXIT_SUCCESS);
+  exit (batch_failed ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
-static void
-batch_run_cmd (Gimp          *gimp,
-               const gchar   *proc_name,
-               GimpProcedure *procedure,
-               GimpRunMode    run_mode,
-               const gchar   *cmd)
+static GimpValueArray *
+batch_get_arguments (GimpProcedure *procedure,
+                     GimpRunMode    run_mode,
+                     const gchar   *cmd)
 {
   GimpValueArray *args;
-  GimpValueArray *return_vals;
-  GError         *error = NULL;
-  gint            i     = 0;
+  gint            i = 0;
 
   args = gimp_procedure_get_arguments (procedure);
 
@@ -156,6 +206,22 @@ batch_run_cmd (Gimp          *gimp,
       GIMP_IS_PARAM_SPEC_STRING (procedure->args[i]))
     g_value_set_static_string (gimp_value_array_index (args, i++), cmd);
 
+  return args;
+}
+
+static void
+batch_run_cmd (Gimp          *gimp,
+               const gchar   *proc_name,
+               GimpProcedure *procedure,
+               GimpRunMode    run_mode,
+               const gchar   *cmd)
+{
+  GimpValueArray *args;
+  GimpValueArray *return_vals;
+  GError         *error = NULL;
+
+  args = batch_get_arguments (procedure, run_mode, cmd);
+
   return_vals =
     gimp_pdb_execute_procedure_by_name_args (gimp->pdb,
                                              gimp_get_user_context (gimp),
@@ -201,3 +267,192 @@ batch_run_cmd (Gimp          *gimp,
 
   return;
 }
+
+static gchar **
+batch_read_jobs (const gchar  *batch_file,
+                 GError      **error)
+{
+  GPtrArray *jobs;
+  gchar     *contents;
+  gchar    **lines;
+  gint       i;
+
+  if (strcmp (batch_file, "-") == 0)
+    {
+      GString *string = g_string_new (NULL);
+      gchar    buffer[4096];
+      gsize    len;
+
+      while ((len = fread (buffer, 1, sizeof (buffer), stdin)) > 0)
+        g_string_append_len (string, buffer, len);
+
+      contents = g_string_free (string, FALSE);
+    }
+  else if (! g_file_get_contents (batch_file, &contents, NULL, error))
+    {
+      return NULL;
+    }
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  jobs = g_ptr_array_new ();
+
+  /*  one command per line, blank lines are skipped  */
+  for (i = 0; lines[i]; i++)
+    {
+      gchar *line = g_strstrip (lines[i]);
+
+      if (*line)
+        g_ptr_array_add (jobs, g_strdup (line));
+    }
+
+  g_strfreev (lines);
+
+  g_ptr_array_add (jobs, NULL);
+
+  return (gchar **) g_ptr_array_free (jobs, FALSE);
+}
+
+static void
+batch_run_jobs (Gimp          *gimp,
+                const gchar   *proc_name,
+                GimpProcedure *procedure,
+                const gchar   *batch_file,
+                gint           batch_jobs,
+                gint           batch_timeout)
+{
+  BatchJobList     list  = { NULL, 0 };
+  GimpValueArray **args;
+  GError          *error = NULL;
+  gint64           start_time;
+  gdouble          elapsed;
+  gint             n_jobs;
+  gint             i;
+
+  list.jobs = batch_read_jobs (batch_file, &error);
+
+  if (! list.jobs)
+    {
+      g_printerr ("Could not read batch jobs from '%s': %s\n",
+                  batch_file, error->message);
+      g_clear_error (&error);
+
+      batch_failed = TRUE;
+
+      return;
+    }
+
+  n_jobs = g_strv_length (list.jobs);
+
+  if (batch_jobs <= 0)
+    batch_jobs = gimp_parallel_get_n_threads (gimp);
+
+  args = g_new (GimpValueArray *, n_jobs);
+
+  for (i = 0; i < n_jobs; i++)
+    args[i] = batch_get_arguments (procedure, GIMP_RUN_NONINTERACTIVE,
+                                   list.jobs[i]);
+
+  if (gimp->be_verbose)
+    g_printerr ("running %d batch jobs, %d at a time\n",
+                n_jobs, batch_jobs);
+
+  start_time = g_get_monotonic_time ();
+
+  if (GIMP_IS_PLUG_IN_PROCEDURE (procedure) &&
+      procedure->proc_type == GIMP_PLUGIN)
+    {
+      /*  each job gets its own interpreter process, up to batch_jobs
+       *  of them run at the same time
+       */
+      gimp_plug_in_manager_batch_run (gimp->plug_in_manager,
+                                      gimp_get_user_context (gimp),
+                                      GIMP_PLUG_IN_PROCEDURE (procedure),
+                                      args, n_jobs,
+                                      batch_jobs, batch_timeout,
+                                      (GimpPlugInBatchFunc) batch_job_done,
+                                      &list);
+    }
+  else
+    {
+      /*  extensions and internal procedures can only run one job at
+       *  a time
+       */
+      for (i = 0; i < n_jobs; i++)
+        {
+          GimpValueArray *return_vals;
+          gint64          job_start = g_get_monotonic_time ();
+
+          return_vals =
+            gimp_pdb_execute_procedure_by_name_args (gimp->pdb,
+                                                     gimp_get_user_context (gimp),
+                                                     NULL, &error,
+                                                     proc_name, args[i]);
+
+          /*  the error message is also passed with the return values  */
+          g_clear_error (&error);
+
+          batch_job_done (i, return_vals,
+                          (g_get_monotonic_time () - job_start) /
+                          (gdouble) G_USEC_PER_SEC,
+                          &list);
+
+          gimp_value_array_unref (return_vals);
+        }
+    }
+
+  elapsed = (g_get_monotonic_time () - start_time) / (gdouble) G_USEC_PER_SEC;
+
+  g_printerr ("batch jobs: %d run, %d failed, %.2f seconds, "
+              "%.2f jobs per second\n",
+              n_jobs, list.n_failed, elapsed,
+              elapsed > 0.0 ? n_jobs / elapsed : 0.0);
+
+  if (list.n_failed > 0)
+    batch_failed = TRUE;
+
+  for (i = 0; i < n_jobs; i++)
+    gimp_value_array_unref (args[i]);
+
+  g_free (args);
+  g_strfreev (list.jobs);
+}
+
+static void
+batch_job_done (gint            job,
+                GimpValueArray *return_vals,
+                gdouble         seconds,
+                BatchJobList   *list)
+{
+  GimpPDBStatusType  status;
+  const gchar       *message = NULL;
+
+  status = g_value_get_enum (gimp_value_array_index (return_vals, 0));
+
+  if (gimp_value_array_length (return_vals) > 1 &&
+      G_VALUE_HOLDS_STRING (gimp_value_array_index (return_vals, 1)))
+    message = g_value_get_string (gimp_value_array_index (return_vals, 1));
+
+  switch (status)
+    {
+    case GIMP_PDB_SUCCESS:
+      g_print ("batch job %d: success (%.2f seconds)\n", job + 1, seconds);
+      return;
+
+    case GIMP_PDB_CALLING_ERROR:
+      g_print ("batch job %d: calling error (%.2f seconds)\n",
+               job + 1, seconds);
+      break;
+
+    default:
+      g_print ("batch job %d: execution error (%.2f seconds)\n",
+               job + 1, seconds);
+      break;
+    }
+
+  if (message && *message)
+    g_print ("  %s\n", message);
+
+  list->n_failed++;
+}
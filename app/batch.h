@@ -25,7 +25,10 @@
 
 void   batch_run (Gimp         *gimp,
                   const gchar  *batch_interpreter,
-                  const gchar **batch_commands);
+                  const gchar **batch_commands,
+                  const gchar  *batch_file,
+                  gint          batch_jobs,
+                  gint          batch_timeout);
 
 
 #endif /* __BATCH_H__ */
@@ -92,6 +92,7 @@ enum
   PROP_DEFAULT_GRID,
   PROP_UNDO_LEVELS,
   PROP_UNDO_SIZE,
+  PROP_UNDO_COMPRESSED_SIZE,
   PROP_UNDO_PREVIEW_SIZE,
   PROP_PLUG_IN_HISTORY_SIZE,
   PROP_PLUGINRC_PATH,
@@ -103,6 +104,8 @@ enum
   PROP_COLOR_PROFILE_POLICY,
   PROP_SAVE_DOCUMENT_HISTORY,
   PROP_QUICK_MASK_COLOR,
+  PROP_BRUSH_CACHE_SIZE,
+  PROP_XCF_ZLIB_COMPRESSION,
 
   /* ignored, only for backward compatibility: */
   PROP_INSTALL_COLORMAP,
@@ -390,6 +393,11 @@ gimp_core_config_class_init (GimpCoreConfigClass *klass)
                                     0, GIMP_MAX_MEMSIZE, undo_size,
                                     GIMP_PARAM_STATIC_STRINGS |
                                     GIMP_CONFIG_PARAM_CONFIRM);
+  GIMP_CONFIG_INSTALL_PROP_MEMSIZE (object_class, PROP_UNDO_COMPRESSED_SIZE,
+                                    "undo-compressed-size",
+                                    UNDO_COMPRESSED_SIZE_BLURB,
+                                    0, GIMP_MAX_MEMSIZE, undo_size / 4,
+                                    GIMP_PARAM_STATIC_STRINGS);
   GIMP_CONFIG_INSTALL_PROP_ENUM (object_class, PROP_UNDO_PREVIEW_SIZE,
                                  "undo-preview-size", UNDO_PREVIEW_SIZE_BLURB,
                                  GIMP_TYPE_VIEW_SIZE,
@@ -448,6 +456,15 @@ gimp_core_config_class_init (GimpCoreConfigClass *klass)
                                 "quick-mask-color", QUICK_MASK_COLOR_BLURB,
                                 TRUE, &red,
                                 GIMP_PARAM_STATIC_STRINGS);
+  GIMP_CONFIG_INSTALL_PROP_MEMSIZE (object_class, PROP_BRUSH_CACHE_SIZE,
+                                    "brush-cache-size", BRUSH_CACHE_SIZE_BLURB,
+                                    0, GIMP_MAX_MEMSIZE, 1 << 25,
+                                    GIMP_PARAM_STATIC_STRINGS);
+  GIMP_CONFIG_INSTALL_PROP_BOOLEAN (object_class, PROP_XCF_ZLIB_COMPRESSION,
+                                    "xcf-zlib-compression",
+                                    XCF_ZLIB_COMPRESSION_BLURB,
+                                    TRUE,
+                                    GIMP_PARAM_STATIC_STRINGS);
 
   /*  only for backward compatibility:  */
   GIMP_CONFIG_INSTALL_PROP_BOOLEAN (object_class, PROP_INSTALL_COLORMAP,
@@ -688,6 +705,9 @@ gimp_core_config_set_property (GObject      *object,
     case PROP_UNDO_SIZE:
       core_config->undo_size = g_value_get_uint64 (value);
       break;
+    case PROP_UNDO_COMPRESSED_SIZE:
+      core_config->undo_compressed_size = g_value_get_uint64 (value);
+      break;
     case PROP_UNDO_PREVIEW_SIZE:
       core_config->undo_preview_size = g_value_get_enum (value);
       break;
@@ -721,6 +741,12 @@ gimp_core_config_set_property (GObject      *object,
     case PROP_QUICK_MASK_COLOR:
       gimp_value_get_rgb (value, &core_config->quick_mask_color);
       break;
+    case PROP_BRUSH_CACHE_SIZE:
+      core_config->brush_cache_size = g_value_get_uint64 (value);
+      break;
+    case PROP_XCF_ZLIB_COMPRESSION:
+      core_config->xcf_zlib_compression = g_value_get_boolean (value);
+      break;
 
     case PROP_INSTALL_COLORMAP:
     case PROP_MIN_COLORS:
@@ -860,6 +886,9 @@ gimp_core_config_get_property (GObject    *object,
     case PROP_UNDO_SIZE:
       g_value_set_uint64 (value, core_config->undo_size);
       break;
+    case PROP_UNDO_COMPRESSED_SIZE:
+      g_value_set_uint64 (value, core_config->undo_compressed_size);
+      break;
     case PROP_UNDO_PREVIEW_SIZE:
       g_value_set_enum (value, core_config->undo_preview_size);
       break;
@@ -890,6 +919,12 @@ gimp_core_config_get_property (GObject    *object,
     case PROP_QUICK_MASK_COLOR:
       gimp_value_set_rgb (value, &core_config->quick_mask_color);
       break;
+    case PROP_BRUSH_CACHE_SIZE:
+      g_value_set_uint64 (value, core_config->brush_cache_size);
+      break;
+    case PROP_XCF_ZLIB_COMPRESSION:
+      g_value_set_boolean (value, core_config->xcf_zlib_compression);
+      break;
 
     case PROP_INSTALL_COLORMAP:
     case PROP_MIN_COLORS:
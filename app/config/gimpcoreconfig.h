@@ -77,6 +77,7 @@ struct _GimpCoreConfig
   GimpGrid               *default_grid;
   gint                    levels_of_undo;
   guint64                 undo_size;
+  guint64                 undo_compressed_size;
   GimpViewSize            undo_preview_size;
   gint                    plug_in_history_size;
   gchar                  *plug_in_rc_path;
@@ -88,6 +89,8 @@ struct _GimpCoreConfig
   GimpColorProfilePolicy  color_profile_policy;
   gboolean                save_document_history;
   GimpRGB                 quick_mask_color;
+  guint64                 brush_cache_size;
+  gboolean                xcf_zlib_compression;
 };
 
 struct _GimpCoreConfigClass
@@ -14,6 +14,10 @@ N_("When enabled, an image will become the active image when its image " \
    "window receives the focus. This is useful for window managers using " \
    "\"click to focus\".")
 
+#define BRUSH_CACHE_SIZE_BLURB \
+N_("Sets the amount of memory all brushes in use may take together for " \
+   "remembering their scaled and rotated versions while painting.")
+
 #define BRUSH_PATH_BLURB \
 "Sets the brush search path."
 
@@ -450,6 +454,10 @@ N_("Sets an upper limit to the memory that is used per image to keep " \
    "operations on the undo stack. Regardless of this setting, at least " \
    "as many undo-levels as configured can be undone.")
 
+#define UNDO_COMPRESSED_SIZE_BLURB \
+N_("Older undo steps are kept compressed in memory. Sets the amount of " \
+   "memory they may use, beyond that they are moved to the swap file.")
+
 #define UNDO_PREVIEW_SIZE_BLURB \
 N_("Sets the size of the previews in the Undo History.")
 
@@ -464,6 +472,11 @@ N_("When enabled, pressing F1 will open the help browser.")
 "The location of the online user manual. This is used if " \
 "'user-manual-online' is enabled."
 
+#define XCF_ZLIB_COMPRESSION_BLURB \
+N_("Save images of higher bit depth with zlib compression, which makes " \
+   "smaller files than RLE but needs GIMP 2.10 or newer to open them. " \
+   "8-bit images are always saved with RLE.")
+
 #define ZOOM_QUALITY_BLURB \
 "There's a tradeoff between speed and quality of the zoomed-out display."
 
@@ -81,6 +81,7 @@ gimp_convert_dither_type_get_type (void)
     { GIMP_FS_DITHER, "GIMP_FS_DITHER", "fs-dither" },
     { GIMP_FSLOWBLEED_DITHER, "GIMP_FSLOWBLEED_DITHER", "fslowbleed-dither" },
     { GIMP_FIXED_DITHER, "GIMP_FIXED_DITHER", "fixed-dither" },
+    { GIMP_BLUE_NOISE_DITHER, "GIMP_BLUE_NOISE_DITHER", "blue-noise-dither" },
     { 0, NULL, NULL }
   };
 
@@ -90,6 +91,7 @@ gimp_convert_dither_type_get_type (void)
     { GIMP_FS_DITHER, NC_("convert-dither-type", "Floyd-Steinberg (normal)"), NULL },
     { GIMP_FSLOWBLEED_DITHER, NC_("convert-dither-type", "Floyd-Steinberg (reduced color bleeding)"), NULL },
     { GIMP_FIXED_DITHER, NC_("convert-dither-type", "Positioned"), NULL },
+    { GIMP_BLUE_NOISE_DITHER, NC_("convert-dither-type", "Positioned (blue noise)"), NULL },
     { 0, NULL, NULL }
   };
 
@@ -994,6 +996,7 @@ gimp_undo_event_get_type (void)
     { GIMP_UNDO_EVENT_UNDO_FREE, "GIMP_UNDO_EVENT_UNDO_FREE", "undo-free" },
     { GIMP_UNDO_EVENT_UNDO_FREEZE, "GIMP_UNDO_EVENT_UNDO_FREEZE", "undo-freeze" },
     { GIMP_UNDO_EVENT_UNDO_THAW, "GIMP_UNDO_EVENT_UNDO_THAW", "undo-thaw" },
+    { GIMP_UNDO_EVENT_UNDO_STORED, "GIMP_UNDO_EVENT_UNDO_STORED", "undo-stored" },
     { 0, NULL, NULL }
   };
 
@@ -1007,6 +1010,7 @@ gimp_undo_event_get_type (void)
     { GIMP_UNDO_EVENT_UNDO_FREE, "GIMP_UNDO_EVENT_UNDO_FREE", NULL },
     { GIMP_UNDO_EVENT_UNDO_FREEZE, "GIMP_UNDO_EVENT_UNDO_FREEZE", NULL },
     { GIMP_UNDO_EVENT_UNDO_THAW, "GIMP_UNDO_EVENT_UNDO_THAW", NULL },
+    { GIMP_UNDO_EVENT_UNDO_STORED, "GIMP_UNDO_EVENT_UNDO_STORED", NULL },
     { 0, NULL, NULL }
   };
 
@@ -75,7 +75,8 @@ typedef enum
   GIMP_FS_DITHER,         /*< desc="Floyd-Steinberg (normal)"                 >*/
   GIMP_FSLOWBLEED_DITHER, /*< desc="Floyd-Steinberg (reduced color bleeding)" >*/
   GIMP_FIXED_DITHER,      /*< desc="Positioned"                               >*/
-  GIMP_NODESTRUCT_DITHER  /*< pdb-skip, skip >*/
+  GIMP_NODESTRUCT_DITHER, /*< pdb-skip, skip >*/
+  GIMP_BLUE_NOISE_DITHER  /*< desc="Positioned (blue noise)"                  >*/
 } GimpConvertDitherType;
 
 
@@ -447,7 +448,8 @@ typedef enum  /*< pdb-skip >*/
   GIMP_UNDO_EVENT_REDO,         /* a redo has been executed                    */
   GIMP_UNDO_EVENT_UNDO_FREE,    /* all undo and redo info has been cleared     */
   GIMP_UNDO_EVENT_UNDO_FREEZE,  /* undo has been frozen                        */
-  GIMP_UNDO_EVENT_UNDO_THAW     /* undo has been thawn                         */
+  GIMP_UNDO_EVENT_UNDO_THAW,    /* undo has been thawn                         */
+  GIMP_UNDO_EVENT_UNDO_STORED   /* an undo's pixels were compressed or swapped */
 } GimpUndoEvent;
 
 
@@ -205,6 +205,8 @@ typedef struct _GimpPaletteEntry    GimpPaletteEntry;
 typedef struct _GimpSamplePoint     GimpSamplePoint;
 typedef struct _GimpScanConvert     GimpScanConvert;
 typedef struct _GimpTempBuf         GimpTempBuf;
+typedef struct _GimpUndoStore       GimpUndoStore;
+typedef struct _GimpUndoStoreItem   GimpUndoStoreItem;
 typedef         guint32             GimpTattoo;
 
 /* The following hack is made so that we can reuse the definition
@@ -237,6 +239,8 @@ typedef gboolean (* GimpObjectFilterFunc)  (const GimpObject *object,
 typedef gint64   (* GimpMemsizeFunc)       (gpointer          instance,
                                             gint64           *gui_size);
 
+typedef void     (* GimpUndoStoreNotify)   (gpointer          data);
+
 
 /*  structs  */
 
@@ -0,0 +1,206 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-parallel.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "core-types.h"
+
+#include "config/gimpcoreconfig.h"
+
+#include "gimp.h"
+#include "gimp-parallel.h"
+
+
+/*  gimp_parallel_run() spreads a number of independent jobs over a
+ *  shared pool of worker threads, sized by the num-processors
+ *  preference, and returns when all of them are done.  The calling
+ *  thread takes part in the work, so with a single processor no
+ *  threads are involved at all.
+ */
+
+typedef struct _GimpParallelTask GimpParallelTask;
+
+struct _GimpParallelTask
+{
+  GimpParallelFunc  func;
+  gpointer          user_data;
+  gint              n_jobs;
+
+  gint              next_job;
+  gint              n_running;
+  GMutex            mutex;
+  GCond             cond;
+};
+
+
+static void   gimp_parallel_process (GimpParallelTask *task);
+static void   gimp_parallel_worker  (GimpParallelTask *task,
+                                     gpointer          data);
+
+
+static GThreadPool *parallel_pool = NULL;
+
+
+gint
+gimp_parallel_get_n_threads (Gimp *gimp)
+{
+  g_return_val_if_fail (GIMP_IS_GIMP (gimp), 1);
+
+  return MAX (1, GIMP_GEGL_CONFIG (gimp->config)->num_processors);
+}
+
+void
+gimp_parallel_run (Gimp             *gimp,
+                   gint              n_jobs,
+                   GimpParallelFunc  func,
+                   gpointer          user_data)
+{
+  GimpParallelTask task;
+  gint             n_workers;
+  gint             i;
+
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+  g_return_if_fail (func != NULL);
+
+  if (n_jobs <= 0)
+    return;
+
+  task.func      = func;
+  task.user_data = user_data;
+  task.n_jobs    = n_jobs;
+  task.next_job  = 0;
+  task.n_running = 0;
+
+  n_workers = MIN (gimp_parallel_get_n_threads (gimp), n_jobs) - 1;
+
+  if (n_workers > 0)
+    {
+      if (! parallel_pool)
+        parallel_pool = g_thread_pool_new ((GFunc) gimp_parallel_worker, NULL,
+                                           n_workers, FALSE, NULL);
+      else if (g_thread_pool_get_max_threads (parallel_pool) < n_workers)
+        g_thread_pool_set_max_threads (parallel_pool, n_workers, NULL);
+
+      if (! parallel_pool)
+        n_workers = 0;
+    }
+
+  g_mutex_init (&task.mutex);
+  g_cond_init (&task.cond);
+
+  task.n_running = n_workers;
+
+  for (i = 0; i < n_workers; i++)
+    g_thread_pool_push (parallel_pool, &task, NULL);
+
+  gimp_parallel_process (&task);
+
+  g_mutex_lock (&task.mutex);
+
+  while (task.n_running > 0)
+    g_cond_wait (&task.cond, &task.mutex);
+
+  g_mutex_unlock (&task.mutex);
+
+  g_cond_clear (&task.cond);
+  g_mutex_clear (&task.mutex);
+}
+
+/**
+ * gimp_parallel_split_rect:
+ * @rect:      the area to split
+ * @n_bands:   the number of bands
+ * @band:      the band to return
+ * @alignment: the row alignment of band boundaries, usually the tile height
+ * @band_rect: return location for the band
+ *
+ * Splits @rect into @n_bands horizontal bands of roughly equal
+ * height whose inner boundaries are multiples of @alignment, so that
+ * bands processed in parallel never share a tile.  Bands at the end
+ * may be empty.
+ **/
+void
+gimp_parallel_split_rect (const GeglRectangle *rect,
+                          gint                 n_bands,
+                          gint                 band,
+                          gint                 alignment,
+                          GeglRectangle       *band_rect)
+{
+  gint n_units;
+  gint y1, y2;
+
+  g_return_if_fail (rect != NULL);
+  g_return_if_fail (n_bands > 0);
+  g_return_if_fail (band >= 0 && band < n_bands);
+  g_return_if_fail (band_rect != NULL);
+
+  alignment = MAX (alignment, 1);
+  n_units   = (rect->height + alignment - 1) / alignment;
+
+  y1 = (gint) ((gint64) n_units * band       / n_bands) * alignment;
+  y2 = (gint) ((gint64) n_units * (band + 1) / n_bands) * alignment;
+
+  y1 = MIN (y1, rect->height);
+  y2 = MIN (y2, rect->height);
+
+  band_rect->x      = rect->x;
+  band_rect->y      = rect->y + y1;
+  band_rect->width  = rect->width;
+  band_rect->height = y2 - y1;
+}
+
+void
+gimp_parallel_exit (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  if (parallel_pool)
+    {
+      g_thread_pool_free (parallel_pool, TRUE, TRUE);
+      parallel_pool = NULL;
+    }
+}
+
+
+/*  private functions  */
+
+static void
+gimp_parallel_process (GimpParallelTask *task)
+{
+  gint i;
+
+  while ((i = g_atomic_int_add (&task->next_job, 1)) < task->n_jobs)
+    task->func (i, task->user_data);
+}
+
+static void
+gimp_parallel_worker (GimpParallelTask *task,
+                      gpointer          data)
+{
+  gimp_parallel_process (task);
+
+  g_mutex_lock (&task->mutex);
+
+  if (--task->n_running == 0)
+    g_cond_signal (&task->cond);
+
+  g_mutex_unlock (&task->mutex);
+}
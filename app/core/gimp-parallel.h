@@ -0,0 +1,42 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-parallel.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_PARALLEL_H__
+#define __GIMP_PARALLEL_H__
+
+
+typedef void (* GimpParallelFunc) (gint     job,
+                                   gpointer user_data);
+
+
+gint   gimp_parallel_get_n_threads (Gimp                *gimp);
+void   gimp_parallel_run           (Gimp                *gimp,
+                                    gint                 n_jobs,
+                                    GimpParallelFunc     func,
+                                    gpointer             user_data);
+void   gimp_parallel_split_rect    (const GeglRectangle *rect,
+                                    gint                 n_bands,
+                                    gint                 band,
+                                    gint                 alignment,
+                                    GeglRectangle       *band_rect);
+
+void   gimp_parallel_exit          (Gimp                *gimp);
+
+
+#endif /* __GIMP_PARALLEL_H__ */
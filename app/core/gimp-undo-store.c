@@ -0,0 +1,751 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-undo-store.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <gio/gio.h>
+#include <gegl.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpconfig/gimpconfig.h"
+
+#include "core-types.h"
+
+#include "config/gimpcoreconfig.h"
+
+#include "gimp.h"
+#include "gimp-undo-store.h"
+#include "gimp-utils.h"
+#include "gimperror.h"
+
+#include "gimp-log.h"
+
+#include "gimp-intl.h"
+
+
+/*  Pixel data of undo steps which are no longer likely to be undone
+ *  soon is kept here, compressed with zlib in bands of rows, so that
+ *  each band can be compressed and expanded without holding a second
+ *  full copy of the pixels. The bands are compressed in an idle
+ *  handler, a few at a time, so pushing an undo step doesn't wait for
+ *  it. Once the compressed data of all items exceeds the
+ *  "undo-compressed-size" budget, the oldest items are moved to a swap
+ *  file in the swap directory.
+ */
+
+#define BAND_SIZE (256 * 1024)
+
+/*  how long one run of the idle handler may compress, in microseconds  */
+#define IDLE_TIME 5000
+
+
+typedef struct _GimpUndoStoreHole GimpUndoStoreHole;
+
+struct _GimpUndoStore
+{
+  Gimp          *gimp;        /* NULL after gimp_undo_store_exit()       */
+  gint           n_items;
+
+  /*  items waiting to be compressed, oldest first  */
+  GQueue         pending_items;
+  guint          idle_id;
+
+  /*  items kept in memory, oldest first  */
+  GQueue         memory_items;
+  gsize          memory_size;
+
+  GFile         *swap_file;
+  GFileIOStream *swap_stream;
+  gboolean       swap_failed;
+  goffset        swap_end;
+  GList         *swap_holes;
+  gint           n_swapped;
+};
+
+struct _GimpUndoStoreItem
+{
+  GimpUndoStore       *store;
+  GeglRectangle        extent;
+  const Babl          *format;
+  gint                 band_height;
+  GArray              *band_sizes;  /* compressed size of each band, guint32 */
+
+  GeglBuffer          *buffer;      /* the pixels, until they are compressed   */
+  GByteArray          *pending;     /* the bands compressed so far             */
+  gint                 y;           /* the next row to compress                */
+
+  guchar              *data;        /* compressed bands, NULL when swapped out */
+  gsize                size;        /* total compressed size                   */
+  goffset              offset;      /* position in the swap file               */
+
+  GList               *link;        /* link in pending_items or memory_items   */
+
+  GimpUndoStoreNotify  notify;      /* called when the memsize has changed     */
+  gpointer             notify_data;
+};
+
+struct _GimpUndoStoreHole
+{
+  goffset offset;
+  gsize   size;
+};
+
+
+#ifdef HAVE_ZLIB
+static gboolean   gimp_undo_store_idle           (gpointer           data);
+static gboolean   gimp_undo_store_compress_band  (GimpUndoStoreItem *item);
+static void       gimp_undo_store_finish         (GimpUndoStoreItem *item);
+static gboolean   gimp_undo_store_spill          (GimpUndoStore     *store,
+                                                  GimpUndoStoreItem *item);
+static gboolean   gimp_undo_store_open_swap      (GimpUndoStore     *store);
+static goffset    gimp_undo_store_alloc          (GimpUndoStore     *store,
+                                                  gsize              size);
+#endif
+static void       gimp_undo_store_release        (GimpUndoStore     *store,
+                                                  goffset            offset,
+                                                  gsize              size);
+
+
+/*  public functions  */
+
+/**
+ * gimp_undo_store_freeze:
+ * @gimp:   a #Gimp
+ * @buffer: the pixels of an undo step
+ * @notify: function to call when the item's memsize has changed
+ *          in the background, or %NULL
+ * @data:   data to pass to @notify
+ *
+ * Takes over @buffer to be compressed in the background. The caller
+ * can drop its own reference right away.
+ *
+ * Return value: the item to pass to gimp_undo_store_thaw() or
+ *               gimp_undo_store_item_free(), or %NULL if GIMP was
+ *               built without zlib.
+ **/
+GimpUndoStoreItem *
+gimp_undo_store_freeze (Gimp                *gimp,
+                        GeglBuffer          *buffer,
+                        GimpUndoStoreNotify  notify,
+                        gpointer             data)
+{
+#ifdef HAVE_ZLIB
+  GimpUndoStore     *store;
+  GimpUndoStoreItem *item;
+  gsize              rowstride;
+
+  g_return_val_if_fail (GIMP_IS_GIMP (gimp), NULL);
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+
+  if (! gimp->undo_store)
+    {
+      gimp->undo_store = g_slice_new0 (GimpUndoStore);
+
+      gimp->undo_store->gimp = gimp;
+    }
+
+  store = gimp->undo_store;
+
+  item = g_slice_new0 (GimpUndoStoreItem);
+
+  item->store       = store;
+  item->extent      = *gegl_buffer_get_extent (buffer);
+  item->format      = gegl_buffer_get_format (buffer);
+  item->band_sizes  = g_array_new (FALSE, FALSE, sizeof (guint32));
+  item->buffer      = g_object_ref (buffer);
+  item->pending     = g_byte_array_new ();
+  item->notify      = notify;
+  item->notify_data = data;
+
+  store->n_items++;
+
+  rowstride = (gsize) item->extent.width *
+              babl_format_get_bytes_per_pixel (item->format);
+
+  item->band_height = CLAMP (BAND_SIZE / MAX (rowstride, 1),
+                             1, MAX (item->extent.height, 1));
+
+  g_queue_push_tail (&store->pending_items, item);
+  item->link = g_queue_peek_tail_link (&store->pending_items);
+
+  if (! store->idle_id)
+    store->idle_id = g_idle_add_full (G_PRIORITY_LOW,
+                                      gimp_undo_store_idle, store,
+                                      NULL);
+
+  return item;
+#else
+  return NULL;
+#endif
+}
+
+/**
+ * gimp_undo_store_thaw:
+ * @item:  an item returned by gimp_undo_store_freeze()
+ * @error: return location for an error
+ *
+ * Restores the pixels of @item and frees @item, whether that works
+ * or not.
+ *
+ * Return value: the pixels, or %NULL if they could not be read back.
+ **/
+GeglBuffer *
+gimp_undo_store_thaw (GimpUndoStoreItem  *item,
+                      GError            **error)
+{
+#ifdef HAVE_ZLIB
+  GimpUndoStore *store;
+  GeglBuffer    *buffer;
+  guchar        *data;
+  guchar        *band;
+  gsize          rowstride;
+  gsize          pos = 0;
+  gint           y;
+  gint           i;
+
+  g_return_val_if_fail (item != NULL, NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  store = item->store;
+
+  /*  not compressed yet, or compressing failed  */
+  if (item->buffer)
+    {
+      buffer = g_object_ref (item->buffer);
+
+      gimp_undo_store_item_free (item);
+
+      return buffer;
+    }
+
+  if (item->data)
+    {
+      data = item->data;
+    }
+  else
+    {
+      GError *my_error = NULL;
+
+      data = g_malloc (item->size);
+
+      if (! store->swap_stream ||
+          ! g_seekable_seek (G_SEEKABLE (store->swap_stream), item->offset,
+                             G_SEEK_SET, NULL, &my_error) ||
+          ! g_input_stream_read_all (g_io_stream_get_input_stream (G_IO_STREAM (store->swap_stream)),
+                                     data, item->size, NULL, NULL, &my_error))
+        {
+          g_set_error (error, GIMP_ERROR, GIMP_FAILED,
+                       _("Reading undo data from the swap file failed: %s"),
+                       my_error ? my_error->message : _("no swap file"));
+          g_clear_error (&my_error);
+          g_free (data);
+
+          gimp_undo_store_item_free (item);
+
+          return NULL;
+        }
+    }
+
+  buffer = gegl_buffer_new (&item->extent, item->format);
+
+  rowstride = (gsize) item->extent.width *
+              babl_format_get_bytes_per_pixel (item->format);
+
+  band = g_malloc (rowstride * item->band_height);
+
+  for (y = 0, i = 0; y < item->extent.height; y += item->band_height, i++)
+    {
+      gint    height = MIN (item->band_height, item->extent.height - y);
+      guint32 size   = g_array_index (item->band_sizes, guint32, i);
+      uLongf  length = rowstride * height;
+
+      if (uncompress (band, &length, data + pos, size) != Z_OK ||
+          length != rowstride * height)
+        {
+          g_set_error_literal (error, GIMP_ERROR, GIMP_FAILED,
+                               _("Decompressing undo data failed"));
+          g_object_unref (buffer);
+          buffer = NULL;
+          break;
+        }
+
+      gegl_buffer_set (buffer,
+                       GEGL_RECTANGLE (item->extent.x, item->extent.y + y,
+                                       item->extent.width, height),
+                       0, item->format, band, GEGL_AUTO_ROWSTRIDE);
+
+      pos += size;
+    }
+
+  g_free (band);
+
+  if (data != item->data)
+    g_free (data);
+
+  gimp_undo_store_item_free (item);
+
+  return buffer;
+#else
+  g_return_val_if_reached (NULL);
+#endif
+}
+
+gint64
+gimp_undo_store_item_get_memsize (GimpUndoStoreItem *item)
+{
+  gint64 memsize;
+
+  g_return_val_if_fail (item != NULL, 0);
+
+  memsize = (sizeof (GimpUndoStoreItem) +
+             item->band_sizes->len * sizeof (guint32) +
+             (item->data ? item->size : 0));
+
+  if (item->buffer)
+    memsize += gimp_gegl_buffer_get_memsize (item->buffer);
+
+  if (item->pending)
+    memsize += item->pending->len;
+
+  return memsize;
+}
+
+void
+gimp_undo_store_item_free (GimpUndoStoreItem *item)
+{
+  GimpUndoStore *store;
+
+  g_return_if_fail (item != NULL);
+
+  store = item->store;
+
+  if (item->pending)
+    {
+      g_queue_delete_link (&store->pending_items, item->link);
+
+      g_byte_array_free (item->pending, TRUE);
+    }
+  else if (item->data)
+    {
+      g_queue_delete_link (&store->memory_items, item->link);
+      store->memory_size -= item->size;
+
+      g_free (item->data);
+    }
+  else if (! item->buffer && store->swap_stream)
+    {
+      gimp_undo_store_release (store, item->offset, item->size);
+    }
+
+  if (item->buffer)
+    g_object_unref (item->buffer);
+
+  g_array_free (item->band_sizes, TRUE);
+
+  g_slice_free (GimpUndoStoreItem, item);
+
+  store->n_items--;
+
+  if (! store->gimp && store->n_items == 0)
+    g_slice_free (GimpUndoStore, store);
+}
+
+void
+gimp_undo_store_exit (Gimp *gimp)
+{
+  GimpUndoStore *store;
+
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  store = gimp->undo_store;
+
+  if (! store)
+    return;
+
+  gimp->undo_store = NULL;
+  store->gimp      = NULL;
+
+  if (store->idle_id)
+    {
+      g_source_remove (store->idle_id);
+      store->idle_id = 0;
+    }
+
+  if (store->swap_stream)
+    {
+      g_io_stream_close (G_IO_STREAM (store->swap_stream), NULL, NULL);
+      g_object_unref (store->swap_stream);
+      store->swap_stream = NULL;
+    }
+
+  if (store->swap_file)
+    {
+      g_file_delete (store->swap_file, NULL, NULL);
+      g_object_unref (store->swap_file);
+      store->swap_file = NULL;
+    }
+
+  g_list_free_full (store->swap_holes, (GDestroyNotify) g_free);
+  store->swap_holes = NULL;
+
+  /*  items which outlive us keep the store until they are freed  */
+  if (store->n_items == 0)
+    g_slice_free (GimpUndoStore, store);
+}
+
+
+/*  private functions  */
+
+#ifdef HAVE_ZLIB
+
+static gboolean
+gimp_undo_store_idle (gpointer data)
+{
+  GimpUndoStore *store = data;
+  gint64         end   = g_get_monotonic_time () + IDLE_TIME;
+
+  while (! g_queue_is_empty (&store->pending_items))
+    {
+      GimpUndoStoreItem *item = g_queue_peek_head (&store->pending_items);
+
+      if (item->y < item->extent.height &&
+          ! gimp_undo_store_compress_band (item))
+        {
+          /*  keep this one uncompressed  */
+          g_queue_delete_link (&store->pending_items, item->link);
+          item->link = NULL;
+
+          g_byte_array_free (item->pending, TRUE);
+          item->pending = NULL;
+        }
+      else if (item->y >= item->extent.height)
+        {
+          gimp_undo_store_finish (item);
+        }
+
+      if (g_get_monotonic_time () >= end)
+        return TRUE;
+    }
+
+  store->idle_id = 0;
+
+  return FALSE;
+}
+
+static gboolean
+gimp_undo_store_compress_band (GimpUndoStoreItem *item)
+{
+  gsize    rowstride;
+  gint     height;
+  guchar  *band;
+  guchar  *compressed;
+  uLongf   length;
+  guint32  size;
+  gboolean success;
+
+  rowstride = (gsize) item->extent.width *
+              babl_format_get_bytes_per_pixel (item->format);
+  height    = MIN (item->band_height, item->extent.height - item->y);
+  length    = compressBound (rowstride * height);
+
+  band       = g_malloc (rowstride * height);
+  compressed = g_malloc (length);
+
+  gegl_buffer_get (item->buffer,
+                   GEGL_RECTANGLE (item->extent.x, item->extent.y + item->y,
+                                   item->extent.width, height),
+                   1.0, item->format, band,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  success = (compress2 (compressed, &length,
+                        band, rowstride * height, 1) == Z_OK);
+
+  if (success)
+    {
+      size = length;
+
+      g_byte_array_append (item->pending, compressed, length);
+      g_array_append_val (item->band_sizes, size);
+
+      item->y += height;
+    }
+
+  g_free (compressed);
+  g_free (band);
+
+  return success;
+}
+
+/*  replaces the buffer of a completely compressed item by its bands
+ *  and moves it to memory_items
+ */
+static void
+gimp_undo_store_finish (GimpUndoStoreItem *item)
+{
+  GimpUndoStore *store = item->store;
+  Gimp          *gimp  = store->gimp;
+
+  g_queue_delete_link (&store->pending_items, item->link);
+
+  GIMP_LOG (UNDO, "froze %dx%d undo buffer: %" G_GINT64_FORMAT
+            " -> %u bytes",
+            item->extent.width, item->extent.height,
+            gimp_gegl_buffer_get_memsize (item->buffer),
+            item->pending->len);
+
+  item->size    = item->pending->len;
+  item->data    = g_byte_array_free (item->pending, FALSE);
+  item->pending = NULL;
+
+  g_object_unref (item->buffer);
+  item->buffer = NULL;
+
+  g_queue_push_tail (&store->memory_items, item);
+  item->link = g_queue_peek_tail_link (&store->memory_items);
+  store->memory_size += item->size;
+
+  if (item->notify)
+    item->notify (item->notify_data);
+
+  /*  move the oldest items to disk until we are within budget  */
+  while (store->memory_size > gimp->config->undo_compressed_size &&
+         ! g_queue_is_empty (&store->memory_items))
+    {
+      if (! gimp_undo_store_spill (store,
+                                   g_queue_peek_head (&store->memory_items)))
+        break;
+    }
+}
+
+static gboolean
+gimp_undo_store_spill (GimpUndoStore     *store,
+                       GimpUndoStoreItem *item)
+{
+  GError  *error = NULL;
+  goffset  offset;
+
+  if (! gimp_undo_store_open_swap (store))
+    return FALSE;
+
+  offset = gimp_undo_store_alloc (store, item->size);
+
+  if (! g_seekable_seek (G_SEEKABLE (store->swap_stream), offset,
+                         G_SEEK_SET, NULL, &error) ||
+      ! g_output_stream_write_all (g_io_stream_get_output_stream (G_IO_STREAM (store->swap_stream)),
+                                   item->data, item->size,
+                                   NULL, NULL, &error))
+    {
+      gimp_message (store->gimp, NULL, GIMP_MESSAGE_WARNING,
+                    _("Writing undo data to the swap file failed, "
+                      "keeping it in memory instead: %s"),
+                    error->message);
+      g_clear_error (&error);
+
+      /*  the space at offset stays allocated, it is never read
+       *  and the file is dropped on exit
+       */
+
+      /*  keep everything in memory from now on  */
+      store->swap_failed = TRUE;
+
+      return FALSE;
+    }
+
+  GIMP_LOG (UNDO, "swapped out %" G_GSIZE_FORMAT " bytes of undo data",
+            item->size);
+
+  g_queue_delete_link (&store->memory_items, item->link);
+  item->link = NULL;
+  store->memory_size -= item->size;
+
+  g_free (item->data);
+  item->data   = NULL;
+  item->offset = offset;
+
+  store->n_swapped++;
+
+  if (item->notify)
+    item->notify (item->notify_data);
+
+  return TRUE;
+}
+
+static gboolean
+gimp_undo_store_open_swap (GimpUndoStore *store)
+{
+  Gimp   *gimp  = store->gimp;
+  gchar  *path;
+  gchar  *basename;
+  gchar  *filename;
+  GError *error = NULL;
+
+  if (store->swap_stream)
+    return TRUE;
+
+  if (store->swap_failed)
+    return FALSE;
+
+  path = gimp_config_path_expand (GIMP_GEGL_CONFIG (gimp->config)->swap_path,
+                                  TRUE, NULL);
+
+  basename = g_strdup_printf ("gimp-undo-%d.swap", gimp_get_pid ());
+  filename = g_build_filename (path, basename, NULL);
+
+  g_free (basename);
+  g_free (path);
+
+  store->swap_file = g_file_new_for_path (filename);
+  g_free (filename);
+
+  store->swap_stream = g_file_replace_readwrite (store->swap_file, NULL, FALSE,
+                                                 G_FILE_CREATE_PRIVATE,
+                                                 NULL, &error);
+
+  if (! store->swap_stream)
+    {
+      gimp_message (gimp, NULL, GIMP_MESSAGE_WARNING,
+                    _("Could not create the undo swap file, "
+                      "keeping undo data in memory instead: %s"),
+                    error->message);
+      g_clear_error (&error);
+
+      g_object_unref (store->swap_file);
+      store->swap_file   = NULL;
+      store->swap_failed = TRUE;
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static goffset
+gimp_undo_store_alloc (GimpUndoStore *store,
+                       gsize          size)
+{
+  GList   *list;
+  goffset  offset;
+
+  /*  first fit  */
+  for (list = store->swap_holes; list; list = g_list_next (list))
+    {
+      GimpUndoStoreHole *hole = list->data;
+
+      if (hole->size >= size)
+        {
+          offset = hole->offset;
+
+          hole->offset += size;
+          hole->size   -= size;
+
+          if (hole->size == 0)
+            {
+              store->swap_holes = g_list_delete_link (store->swap_holes,
+                                                      list);
+              g_free (hole);
+            }
+
+          return offset;
+        }
+    }
+
+  offset           = store->swap_end;
+  store->swap_end += size;
+
+  return offset;
+}
+
+#endif /* HAVE_ZLIB */
+
+static void
+gimp_undo_store_release (GimpUndoStore *store,
+                         goffset        offset,
+                         gsize          size)
+{
+  GimpUndoStoreHole *hole;
+  GList             *list;
+
+  store->n_swapped--;
+
+  if (store->n_swapped <= 0)
+    {
+      /*  nothing is left in the swap file, start over and give the
+       *  disk space back
+       */
+      g_list_free_full (store->swap_holes, (GDestroyNotify) g_free);
+      store->swap_holes = NULL;
+      store->swap_end   = 0;
+      store->n_swapped  = 0;
+
+      if (store->swap_stream)
+        g_seekable_truncate (G_SEEKABLE (store->swap_stream), 0, NULL, NULL);
+
+      return;
+    }
+
+  /*  keep the holes sorted by offset and merge adjacent ones  */
+  for (list = store->swap_holes; list; list = g_list_next (list))
+    {
+      hole = list->data;
+
+      if (hole->offset + hole->size == offset)
+        {
+          GList *next = g_list_next (list);
+
+          hole->size += size;
+
+          if (next)
+            {
+              GimpUndoStoreHole *next_hole = next->data;
+
+              if (hole->offset + hole->size == next_hole->offset)
+                {
+                  hole->size += next_hole->size;
+                  store->swap_holes = g_list_delete_link (store->swap_holes,
+                                                          next);
+                  g_free (next_hole);
+                }
+            }
+
+          return;
+        }
+      else if (offset + size == hole->offset)
+        {
+          hole->offset  = offset;
+          hole->size   += size;
+
+          return;
+        }
+      else if (offset < hole->offset)
+        {
+          break;
+        }
+    }
+
+  hole = g_new (GimpUndoStoreHole, 1);
+
+  hole->offset = offset;
+  hole->size   = size;
+
+  store->swap_holes = g_list_insert_before (store->swap_holes, list, hole);
+}
@@ -0,0 +1,37 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimp-undo-store.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_UNDO_STORE_H__
+#define __GIMP_UNDO_STORE_H__
+
+
+GimpUndoStoreItem * gimp_undo_store_freeze           (Gimp                 *gimp,
+                                                      GeglBuffer           *buffer,
+                                                      GimpUndoStoreNotify   notify,
+                                                      gpointer              data);
+GeglBuffer        * gimp_undo_store_thaw             (GimpUndoStoreItem    *item,
+                                                      GError              **error);
+
+gint64              gimp_undo_store_item_get_memsize (GimpUndoStoreItem    *item);
+void                gimp_undo_store_item_free        (GimpUndoStoreItem    *item);
+
+void                gimp_undo_store_exit             (Gimp                 *gimp);
+
+
+#endif /* __GIMP_UNDO_STORE_H__ */
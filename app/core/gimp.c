@@ -45,12 +45,15 @@
 #include "gimp-contexts.h"
 #include "gimp-gradients.h"
 #include "gimp-modules.h"
+#include "gimp-parallel.h"
 #include "gimp-parasites.h"
 #include "gimp-templates.h"
+#include "gimp-undo-store.h"
 #include "gimp-units.h"
 #include "gimp-utils.h"
 #include "gimpbrush-load.h"
 #include "gimpbrush.h"
+#include "gimpbrushcache.h"
 #include "gimpbrushclipboard.h"
 #include "gimpbrushgenerated-load.h"
 #include "gimpbrushpipe-load.h"
@@ -79,6 +82,8 @@
 #include "gimptoolpreset.h"
 #include "gimptoolpreset-load.h"
 
+#include "gimp-trace.h"
+
 #include "gimp-intl.h"
 
 
@@ -113,6 +118,8 @@ static void      gimp_edit_config_notify   (GObject           *edit_config,
                                             GParamSpec        *param_spec,
                                             GObject           *global_config);
 
+static void      gimp_brush_cache_size_notify (GimpCoreConfig *config);
+
 
 G_DEFINE_TYPE (Gimp, gimp, GIMP_TYPE_OBJECT)
 
@@ -433,6 +440,10 @@ gimp_finalize (GObject *object)
       gimp->images = NULL;
     }
 
+  gimp_undo_store_exit (gimp);
+
+  gimp_parallel_exit (gimp);
+
   if (gimp->plug_in_manager)
     {
       g_object_unref (gimp->plug_in_manager);
@@ -556,41 +567,42 @@ gimp_real_initialize (Gimp               *gimp,
 {
   static const GimpDataFactoryLoaderEntry brush_loader_entries[] =
   {
-    { gimp_brush_load,           GIMP_BRUSH_FILE_EXTENSION,           FALSE },
-    { gimp_brush_load,           GIMP_BRUSH_PIXMAP_FILE_EXTENSION,    FALSE },
-    { gimp_brush_load_abr,       GIMP_BRUSH_PS_FILE_EXTENSION,        FALSE },
-    { gimp_brush_load_abr,       GIMP_BRUSH_PSP_FILE_EXTENSION,       FALSE },
-    { gimp_brush_generated_load, GIMP_BRUSH_GENERATED_FILE_EXTENSION, TRUE  },
-    { gimp_brush_pipe_load,      GIMP_BRUSH_PIPE_FILE_EXTENSION,      FALSE }
+    { gimp_brush_load,           GIMP_BRUSH_FILE_EXTENSION,           FALSE, TRUE  },
+    { gimp_brush_load,           GIMP_BRUSH_PIXMAP_FILE_EXTENSION,    FALSE, TRUE  },
+    { gimp_brush_load_abr,       GIMP_BRUSH_PS_FILE_EXTENSION,        FALSE, TRUE  },
+    { gimp_brush_load_abr,       GIMP_BRUSH_PSP_FILE_EXTENSION,       FALSE, TRUE  },
+    { gimp_brush_generated_load, GIMP_BRUSH_GENERATED_FILE_EXTENSION, TRUE,  TRUE  },
+    { gimp_brush_pipe_load,      GIMP_BRUSH_PIPE_FILE_EXTENSION,      FALSE, TRUE  }
   };
 
   static const GimpDataFactoryLoaderEntry dynamics_loader_entries[] =
   {
-    { gimp_dynamics_load,        GIMP_DYNAMICS_FILE_EXTENSION,        TRUE  }
+    { gimp_dynamics_load,        GIMP_DYNAMICS_FILE_EXTENSION,        TRUE,  TRUE  }
   };
 
   static const GimpDataFactoryLoaderEntry pattern_loader_entries[] =
   {
-    { gimp_pattern_load,         GIMP_PATTERN_FILE_EXTENSION,         FALSE },
-    { gimp_pattern_load_pixbuf,  NULL,                                FALSE }
+    { gimp_pattern_load,         GIMP_PATTERN_FILE_EXTENSION,         FALSE, TRUE  },
+    /*  gdk-pixbuf doesn't initialize its loaders thread-safely  */
+    { gimp_pattern_load_pixbuf,  NULL,                                FALSE, FALSE }
   };
 
   static const GimpDataFactoryLoaderEntry gradient_loader_entries[] =
   {
-    { gimp_gradient_load,        GIMP_GRADIENT_FILE_EXTENSION,        TRUE  },
-    { gimp_gradient_load_svg,    GIMP_GRADIENT_SVG_FILE_EXTENSION,    FALSE },
-    { gimp_gradient_load,        NULL /* legacy loader */,            TRUE  }
+    { gimp_gradient_load,        GIMP_GRADIENT_FILE_EXTENSION,        TRUE,  TRUE  },
+    { gimp_gradient_load_svg,    GIMP_GRADIENT_SVG_FILE_EXTENSION,    FALSE, TRUE  },
+    { gimp_gradient_load,        NULL /* legacy loader */,            TRUE,  TRUE  }
   };
 
   static const GimpDataFactoryLoaderEntry palette_loader_entries[] =
   {
-    { gimp_palette_load,         GIMP_PALETTE_FILE_EXTENSION,         TRUE  },
-    { gimp_palette_load,         NULL /* legacy loader */,            TRUE  }
+    { gimp_palette_load,         GIMP_PALETTE_FILE_EXTENSION,         TRUE,  FALSE },
+    { gimp_palette_load,         NULL /* legacy loader */,            TRUE,  FALSE }
   };
 
   static const GimpDataFactoryLoaderEntry tool_preset_loader_entries[] =
   {
-    { gimp_tool_preset_load,     GIMP_TOOL_PRESET_FILE_EXTENSION,     TRUE  }
+    { gimp_tool_preset_load,     GIMP_TOOL_PRESET_FILE_EXTENSION,     TRUE,  FALSE }
   };
 
   GimpData *clipboard_brush;
@@ -716,8 +728,10 @@ gimp_real_restore (Gimp               *gimp,
   if (gimp->be_verbose)
     g_print ("INIT: %s\n", G_STRFUNC);
 
+  gimp_trace_begin ("plug-ins");
   gimp_plug_in_manager_restore (gimp->plug_in_manager,
                                 gimp_get_user_context (gimp), status_callback);
+  gimp_trace_end ();
 
   gimp->restored = TRUE;
 }
@@ -893,6 +907,12 @@ gimp_edit_config_notify (GObject    *edit_config,
   g_value_unset (&global_value);
 }
 
+static void
+gimp_brush_cache_size_notify (GimpCoreConfig *config)
+{
+  gimp_brush_cache_set_max_size (config->brush_cache_size);
+}
+
 void
 gimp_load_config (Gimp        *gimp,
                   const gchar *alternate_system_gimprc,
@@ -926,6 +946,13 @@ gimp_load_config (Gimp        *gimp,
   g_signal_connect_object (gimp->edit_config, "notify",
                            G_CALLBACK (gimp_edit_config_notify),
                            gimp->config, 0);
+
+  /*  brushes don't know about gimp, so their cache size is global  */
+  gimp_brush_cache_size_notify (gimp->config);
+
+  g_signal_connect (gimp->config, "notify::brush-cache-size",
+                    G_CALLBACK (gimp_brush_cache_size_notify),
+                    NULL);
 }
 
 void
@@ -939,7 +966,11 @@ gimp_initialize (Gimp               *gimp,
   if (gimp->be_verbose)
     g_print ("INIT: %s\n", G_STRFUNC);
 
+  gimp_trace_begin ("gimp_initialize");
+
   g_signal_emit (gimp, gimp_signals[INITIALIZE], 0, status_callback);
+
+  gimp_trace_end ();
 }
 
 void
@@ -954,7 +985,9 @@ gimp_restore (Gimp               *gimp,
 
   /*  initialize  the global parasite table  */
   status_callback (_("Looking for data files"), _("Parasites"), 0.0);
+  gimp_trace_begin ("parasiterc");
   gimp_parasiterc_load (gimp);
+  gimp_trace_end ();
 
   /*  initialize the list of gimp brushes    */
   status_callback (NULL, _("Brushes"), 0.1);
@@ -984,7 +1017,11 @@ gimp_restore (Gimp               *gimp,
   /*  initialize the list of fonts  */
   status_callback (NULL, _("Fonts (this may take a while)"), 0.6);
   if (! gimp->no_fonts)
-    gimp_fonts_load (gimp);
+    {
+      gimp_trace_begin ("fonts");
+      gimp_fonts_load (gimp);
+      gimp_trace_end ();
+    }
 
   /*  initialize the list of gimp tool presets if we have a GUI  */
   if (! gimp->no_interface)
@@ -996,14 +1033,19 @@ gimp_restore (Gimp               *gimp,
 
   /*  initialize the template list  */
   status_callback (NULL, _("Templates"), 0.7);
+  gimp_trace_begin ("templates");
   gimp_templates_load (gimp);
+  gimp_trace_end ();
 
   /*  initialize the module list  */
   status_callback (NULL, _("Modules"), 0.8);
+  gimp_trace_begin ("modules");
   gimp_modules_load (gimp);
+  gimp_trace_end ();
 
   /* update tag cache */
   status_callback (NULL, _("Updating tag cache"), 0.9);
+  gimp_trace_begin ("tag cache");
   gimp_tag_cache_load (gimp->tag_cache);
   gimp_tag_cache_add_container (gimp->tag_cache,
                                 gimp_data_factory_get_container (gimp->brush_factory));
@@ -1017,8 +1059,11 @@ gimp_restore (Gimp               *gimp,
                                 gimp_data_factory_get_container (gimp->palette_factory));
   gimp_tag_cache_add_container (gimp->tag_cache,
                                 gimp_data_factory_get_container (gimp->tool_preset_factory));
+  gimp_trace_end ();
 
+  gimp_trace_begin ("restore");
   g_signal_emit (gimp, gimp_signals[RESTORE], 0, status_callback);
+  gimp_trace_end ();
 }
 
 /**
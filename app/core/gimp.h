@@ -100,6 +100,8 @@ struct _Gimp
 
   GimpTagCache           *tag_cache;
 
+  GimpUndoStore          *undo_store;
+
   GimpPDB                *pdb;
 
   GimpContainer          *tool_info_list;
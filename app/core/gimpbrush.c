@@ -39,6 +39,17 @@
 #include "gimp-intl.h"
 
 
+/*  the transform parameters are rounded to these steps before a brush
+ *  is transformed, so that the small changes dynamics make from dab to
+ *  dab map to a limited set of cached brushes.  the identity transform
+ *  is kept exact.
+ */
+#define SCALE_STEPS_PER_OCTAVE 128   /*  0.5% of the size        */
+#define ASPECT_RATIO_STEPS      64   /*  per unit of -20 .. 20   */
+#define ANGLE_STEPS           1024   /*  per full turn           */
+#define HARDNESS_STEPS         255
+
+
 enum
 {
   SPACING_CHANGED,
@@ -91,6 +102,13 @@ static gboolean      gimp_brush_real_want_null_motion (GimpBrush            *bru
 
 static gchar       * gimp_brush_get_checksum          (GimpTagged           *tagged);
 
+static gint64        gimp_brush_temp_buf_get_memsize  (gconstpointer         data);
+static gint64        gimp_brush_boundary_get_memsize  (gconstpointer         data);
+static void          gimp_brush_quantize_transform    (gdouble              *scale,
+                                                       gdouble              *aspect_ratio,
+                                                       gdouble              *angle,
+                                                       gdouble              *hardness);
+
 
 G_DEFINE_TYPE_WITH_CODE (GimpBrush, gimp_brush, GIMP_TYPE_DATA,
                          G_IMPLEMENT_INTERFACE (GIMP_TYPE_TAGGED,
@@ -416,13 +434,16 @@ static void
 gimp_brush_real_begin_use (GimpBrush *brush)
 {
   brush->mask_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref, 'M', 'm');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref,
+                          gimp_brush_temp_buf_get_memsize, 'M', 'm');
 
   brush->pixmap_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref, 'P', 'p');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_temp_buf_unref,
+                          gimp_brush_temp_buf_get_memsize, 'P', 'p');
 
   brush->boundary_cache =
-    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free, 'B', 'b');
+    gimp_brush_cache_new ((GDestroyNotify) gimp_bezier_desc_free,
+                          gimp_brush_boundary_get_memsize, 'B', 'b');
 }
 
 static void
@@ -577,6 +598,8 @@ gimp_brush_transform_size (GimpBrush     *brush,
   g_return_if_fail (width != NULL);
   g_return_if_fail (height != NULL);
 
+  gimp_brush_quantize_transform (&scale, &aspect_ratio, &angle, NULL);
+
   if (scale        == 1.0 &&
       aspect_ratio == 0.0 &&
       ((angle == 0.0) || (angle == 0.5) || (angle == 1.0)))
@@ -606,6 +629,8 @@ gimp_brush_transform_mask (GimpBrush *brush,
   g_return_val_if_fail (GIMP_IS_BRUSH (brush), NULL);
   g_return_val_if_fail (scale > 0.0, NULL);
 
+  gimp_brush_quantize_transform (&scale, &aspect_ratio, &angle, &hardness);
+
   gimp_brush_transform_size (brush,
                              scale, aspect_ratio, angle,
                              &width, &height);
@@ -656,6 +681,8 @@ gimp_brush_transform_pixmap (GimpBrush *brush,
   g_return_val_if_fail (brush->pixmap != NULL, NULL);
   g_return_val_if_fail (scale > 0.0, NULL);
 
+  gimp_brush_quantize_transform (&scale, &aspect_ratio, &angle, &hardness);
+
   gimp_brush_transform_size (brush,
                              scale, aspect_ratio, angle,
                              &width, &height);
@@ -707,6 +734,8 @@ gimp_brush_transform_boundary (GimpBrush *brush,
   g_return_val_if_fail (width != NULL, NULL);
   g_return_val_if_fail (height != NULL, NULL);
 
+  gimp_brush_quantize_transform (&scale, &aspect_ratio, &angle, &hardness);
+
   gimp_brush_transform_size (brush,
                              scale, aspect_ratio, angle,
                              width, height);
@@ -781,3 +810,39 @@ gimp_brush_set_spacing (GimpBrush *brush,
       g_object_notify (G_OBJECT (brush), "spacing");
     }
 }
+
+
+/*  private functions  */
+
+static gint64
+gimp_brush_temp_buf_get_memsize (gconstpointer data)
+{
+  return gimp_temp_buf_get_memsize ((GimpTempBuf *) data);
+}
+
+static gint64
+gimp_brush_boundary_get_memsize (gconstpointer data)
+{
+  const GimpBezierDesc *desc = data;
+
+  return sizeof (GimpBezierDesc) + desc->num_data * sizeof (cairo_path_data_t);
+}
+
+static void
+gimp_brush_quantize_transform (gdouble *scale,
+                               gdouble *aspect_ratio,
+                               gdouble *angle,
+                               gdouble *hardness)
+{
+  /*  scale is rounded in the log domain, so that the steps are the
+   *  same fraction of the size for small and large brushes
+   */
+  *scale = pow (2.0, RINT (log (*scale) / G_LN2 * SCALE_STEPS_PER_OCTAVE) /
+                SCALE_STEPS_PER_OCTAVE);
+
+  *aspect_ratio = RINT (*aspect_ratio * ASPECT_RATIO_STEPS) / ASPECT_RATIO_STEPS;
+  *angle        = RINT (*angle        * ANGLE_STEPS)        / ANGLE_STEPS;
+
+  if (hardness)
+    *hardness = RINT (*hardness * HARDNESS_STEPS) / HARDNESS_STEPS;
+}
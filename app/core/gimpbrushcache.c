@@ -30,6 +30,18 @@
 #include "gimp-intl.h"
 
 
+/*  each cache keeps transformed brushes for a set of transform
+ *  parameters.  all caches share one memory budget and one list of
+ *  entries, and the least recently used entries of any brush are
+ *  dropped when the budget is exceeded.  the parameters are compared
+ *  exactly, callers are expected to quantize them (see
+ *  gimp_brush_transform_size()) so painting with dynamics keeps
+ *  hitting the same entries.
+ */
+
+#define DEFAULT_MAX_SIZE ((gint64) 32 * 1024 * 1024)
+
+
 enum
 {
   PROP_0,
@@ -37,16 +49,47 @@ enum
 };
 
 
-static void   gimp_brush_cache_constructed  (GObject      *object);
-static void   gimp_brush_cache_finalize     (GObject      *object);
-static void   gimp_brush_cache_set_property (GObject      *object,
-                                             guint         property_id,
-                                             const GValue *value,
-                                             GParamSpec   *pspec);
-static void   gimp_brush_cache_get_property (GObject      *object,
-                                             guint         property_id,
-                                             GValue       *value,
-                                             GParamSpec   *pspec);
+typedef struct _GimpBrushCacheEntry GimpBrushCacheEntry;
+
+struct _GimpBrushCacheEntry
+{
+  GimpBrushCache *cache;
+
+  gint            width;
+  gint            height;
+  gdouble         scale;
+  gdouble         aspect_ratio;
+  gdouble         angle;
+  gdouble         hardness;
+
+  gpointer        data;
+  gint64          memsize;
+  GList          *link;     /*  in gimp_brush_cache_lru  */
+};
+
+
+static void     gimp_brush_cache_constructed  (GObject             *object);
+static void     gimp_brush_cache_finalize     (GObject             *object);
+static void     gimp_brush_cache_set_property (GObject             *object,
+                                               guint                property_id,
+                                               const GValue        *value,
+                                               GParamSpec          *pspec);
+static void     gimp_brush_cache_get_property (GObject             *object,
+                                               guint                property_id,
+                                               GValue              *value,
+                                               GParamSpec          *pspec);
+
+static gint64   gimp_brush_cache_get_memsize  (GimpObject          *object,
+                                               gint64              *gui_size);
+
+static guint    gimp_brush_cache_entry_hash   (gconstpointer        key);
+static gboolean gimp_brush_cache_entry_equal  (gconstpointer        a,
+                                               gconstpointer        b);
+static void     gimp_brush_cache_remove       (GimpBrushCacheEntry *entry);
+static void     gimp_brush_cache_remove_all   (GimpBrushCache      *cache);
+static void     gimp_brush_cache_trim         (void);
+static void     gimp_brush_cache_log_stats    (GimpBrushCache      *cache,
+                                               const gchar         *reason);
 
 
 G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
@@ -54,15 +97,25 @@ G_DEFINE_TYPE (GimpBrushCache, gimp_brush_cache, GIMP_TYPE_OBJECT)
 #define parent_class gimp_brush_cache_parent_class
 
 
+static gint64 gimp_brush_cache_max_size = DEFAULT_MAX_SIZE;
+static gint64 gimp_brush_cache_memsize  = 0;
+
+/*  the entries of all caches, most recently used first  */
+static GQueue gimp_brush_cache_lru      = G_QUEUE_INIT;
+
+
 static void
 gimp_brush_cache_class_init (GimpBrushCacheClass *klass)
 {
-  GObjectClass  *object_class = G_OBJECT_CLASS (klass);
+  GObjectClass    *object_class      = G_OBJECT_CLASS (klass);
+  GimpObjectClass *gimp_object_class = GIMP_OBJECT_CLASS (klass);
 
-  object_class->constructed  = gimp_brush_cache_constructed;
-  object_class->finalize     = gimp_brush_cache_finalize;
-  object_class->set_property = gimp_brush_cache_set_property;
-  object_class->get_property = gimp_brush_cache_get_property;
+  object_class->constructed      = gimp_brush_cache_constructed;
+  object_class->finalize         = gimp_brush_cache_finalize;
+  object_class->set_property     = gimp_brush_cache_set_property;
+  object_class->get_property     = gimp_brush_cache_get_property;
+
+  gimp_object_class->get_memsize = gimp_brush_cache_get_memsize;
 
   g_object_class_install_property (object_class, PROP_DATA_DESTROY,
                                    g_param_spec_pointer ("data-destroy",
@@ -72,8 +125,10 @@ gimp_brush_cache_class_init (GimpBrushCacheClass *klass)
 }
 
 static void
-gimp_brush_cache_init (GimpBrushCache *brush)
+gimp_brush_cache_init (GimpBrushCache *cache)
 {
+  cache->entries = g_hash_table_new (gimp_brush_cache_entry_hash,
+                                     gimp_brush_cache_entry_equal);
 }
 
 static void
@@ -91,10 +146,14 @@ gimp_brush_cache_finalize (GObject *object)
 {
   GimpBrushCache *cache = GIMP_BRUSH_CACHE (object);
 
-  if (cache->last_data)
+  if (cache->entries)
     {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
+      gimp_brush_cache_log_stats (cache, "finalize");
+
+      gimp_brush_cache_remove_all (cache);
+
+      g_hash_table_unref (cache->entries);
+      cache->entries = NULL;
     }
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -141,23 +200,37 @@ gimp_brush_cache_get_property (GObject    *object,
 }
 
 
+static gint64
+gimp_brush_cache_get_memsize (GimpObject *object,
+                              gint64     *gui_size)
+{
+  GimpBrushCache *cache = GIMP_BRUSH_CACHE (object);
+
+  return cache->memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
+                                                                         gui_size);
+}
+
+
 /*  public functions  */
 
 GimpBrushCache *
-gimp_brush_cache_new (GDestroyNotify  data_destroy,
-                      gchar           debug_hit,
-                      gchar           debug_miss)
+gimp_brush_cache_new (GDestroyNotify             data_destroy,
+                      GimpBrushCacheMemsizeFunc  data_memsize,
+                      gchar                      debug_hit,
+                      gchar                      debug_miss)
 {
   GimpBrushCache *cache;
 
   g_return_val_if_fail (data_destroy != NULL, NULL);
+  g_return_val_if_fail (data_memsize != NULL, NULL);
 
   cache =  g_object_new (GIMP_TYPE_BRUSH_CACHE,
                          "data-destroy", data_destroy,
                          NULL);
 
-  cache->debug_hit  = debug_hit;
-  cache->debug_miss = debug_miss;
+  cache->data_memsize = data_memsize;
+  cache->debug_hit    = debug_hit;
+  cache->debug_miss   = debug_miss;
 
   return cache;
 }
@@ -167,11 +240,9 @@ gimp_brush_cache_clear (GimpBrushCache *cache)
 {
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
 
-  if (cache->last_data)
-    {
-      cache->data_destroy (cache->last_data);
-      cache->last_data = NULL;
-    }
+  gimp_brush_cache_log_stats (cache, "clear");
+
+  gimp_brush_cache_remove_all (cache);
 }
 
 gconstpointer
@@ -183,25 +254,43 @@ gimp_brush_cache_get (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GimpBrushCacheEntry  key;
+  GimpBrushCacheEntry *entry;
+
   g_return_val_if_fail (GIMP_IS_BRUSH_CACHE (cache), NULL);
 
-  if (cache->last_data                         &&
-      cache->last_width        == width        &&
-      cache->last_height       == height       &&
-      cache->last_scale        == scale        &&
-      cache->last_aspect_ratio == aspect_ratio &&
-      cache->last_angle        == angle        &&
-      cache->last_hardness     == hardness)
+  key.width        = width;
+  key.height       = height;
+  key.scale        = scale;
+  key.aspect_ratio = aspect_ratio;
+  key.angle        = angle;
+  key.hardness     = hardness;
+
+  entry = g_hash_table_lookup (cache->entries, &key);
+
+  if (entry)
     {
       if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
         g_printerr ("%c", cache->debug_hit);
 
-      return (gconstpointer) cache->last_data;
+      cache->n_hits++;
+
+      if (entry->link != gimp_brush_cache_lru.head)
+        {
+          g_queue_unlink (&gimp_brush_cache_lru, entry->link);
+          g_queue_push_head_link (&gimp_brush_cache_lru, entry->link);
+        }
+
+      cache->last_used = entry;
+
+      return (gconstpointer) entry->data;
     }
 
   if (gimp_log_flags & GIMP_LOG_BRUSH_CACHE)
     g_printerr ("%c", cache->debug_miss);
 
+  cache->n_misses++;
+
   return NULL;
 }
 
@@ -215,20 +304,184 @@ gimp_brush_cache_add (GimpBrushCache *cache,
                       gdouble         angle,
                       gdouble         hardness)
 {
+  GimpBrushCacheEntry *entry;
+  GimpBrushCacheEntry *old;
+
   g_return_if_fail (GIMP_IS_BRUSH_CACHE (cache));
   g_return_if_fail (data != NULL);
 
-  if (data == cache->last_data)
-    return;
+  entry = g_slice_new (GimpBrushCacheEntry);
+
+  entry->cache        = cache;
+  entry->width        = width;
+  entry->height       = height;
+  entry->scale        = scale;
+  entry->aspect_ratio = aspect_ratio;
+  entry->angle        = angle;
+  entry->hardness     = hardness;
+
+  /*  replace an entry for the same parameters, unless it is the very
+   *  same data
+   */
+  old = g_hash_table_lookup (cache->entries, entry);
+
+  if (old)
+    {
+      if (old->data == data)
+        {
+          g_slice_free (GimpBrushCacheEntry, entry);
+          return;
+        }
+
+      gimp_brush_cache_remove (old);
+    }
+
+  entry->data    = data;
+  entry->memsize = cache->data_memsize (data) + sizeof (GimpBrushCacheEntry);
+
+  g_queue_push_head (&gimp_brush_cache_lru, entry);
+  entry->link = gimp_brush_cache_lru.head;
+
+  g_hash_table_insert (cache->entries, entry, entry);
+
+  cache->last_used = entry;
+
+  cache->memsize           += entry->memsize;
+  gimp_brush_cache_memsize += entry->memsize;
+
+  gimp_brush_cache_trim ();
+}
+
+void
+gimp_brush_cache_set_max_size (gint64 max_size)
+{
+  g_return_if_fail (max_size >= 0);
+
+  gimp_brush_cache_max_size = max_size;
+
+  gimp_brush_cache_trim ();
+}
+
+gint64
+gimp_brush_cache_get_max_size (void)
+{
+  return gimp_brush_cache_max_size;
+}
+
+gint64
+gimp_brush_cache_get_total_size (void)
+{
+  return gimp_brush_cache_memsize;
+}
+
+
+/*  private functions  */
+
+static guint
+gimp_brush_cache_entry_hash (gconstpointer key)
+{
+  const GimpBrushCacheEntry *entry = key;
+  guint                      hash;
+
+  hash = entry->width * 31 + entry->height;
+
+  hash = hash * 31 + g_double_hash (&entry->scale);
+  hash = hash * 31 + g_double_hash (&entry->aspect_ratio);
+  hash = hash * 31 + g_double_hash (&entry->angle);
+  hash = hash * 31 + g_double_hash (&entry->hardness);
+
+  return hash;
+}
+
+static gboolean
+gimp_brush_cache_entry_equal (gconstpointer a,
+                              gconstpointer b)
+{
+  const GimpBrushCacheEntry *entry_a = a;
+  const GimpBrushCacheEntry *entry_b = b;
+
+  return (entry_a->width        == entry_b->width        &&
+          entry_a->height       == entry_b->height       &&
+          entry_a->scale        == entry_b->scale        &&
+          entry_a->aspect_ratio == entry_b->aspect_ratio &&
+          entry_a->angle        == entry_b->angle        &&
+          entry_a->hardness     == entry_b->hardness);
+}
+
+static void
+gimp_brush_cache_remove (GimpBrushCacheEntry *entry)
+{
+  GimpBrushCache *cache = entry->cache;
+
+  g_hash_table_remove (cache->entries, entry);
+  g_queue_delete_link (&gimp_brush_cache_lru, entry->link);
 
-  if (cache->last_data)
-    cache->data_destroy (cache->last_data);
+  if (cache->last_used == entry)
+    cache->last_used = NULL;
+
+  cache->memsize           -= entry->memsize;
+  gimp_brush_cache_memsize -= entry->memsize;
+
+  cache->data_destroy (entry->data);
+
+  g_slice_free (GimpBrushCacheEntry, entry);
+}
+
+static void
+gimp_brush_cache_remove_all (GimpBrushCache *cache)
+{
+  GList *entries = g_hash_table_get_values (cache->entries);
+  GList *list;
+
+  for (list = entries; list; list = g_list_next (list))
+    gimp_brush_cache_remove (list->data);
+
+  g_list_free (entries);
+}
+
+static void
+gimp_brush_cache_trim (void)
+{
+  GList *list = gimp_brush_cache_lru.tail;
+
+  while (gimp_brush_cache_memsize > gimp_brush_cache_max_size && list)
+    {
+      GimpBrushCacheEntry *entry = list->data;
+
+      list = g_list_previous (list);
+
+      /*  never drop the entry a cache handed out last, its data is
+       *  still in use by the caller
+       */
+      if (entry == entry->cache->last_used)
+        continue;
+
+      entry->cache->n_evictions++;
+
+      gimp_brush_cache_remove (entry);
+    }
+}
+
+static void
+gimp_brush_cache_log_stats (GimpBrushCache *cache,
+                            const gchar    *reason)
+{
+  gint n_lookups = cache->n_hits + cache->n_misses;
+
+  if (n_lookups == 0)
+    return;
 
-  cache->last_data         = data;
-  cache->last_width        = width;
-  cache->last_height       = height;
-  cache->last_scale        = scale;
-  cache->last_aspect_ratio = aspect_ratio;
-  cache->last_angle        = angle;
-  cache->last_hardness     = hardness;
+  GIMP_LOG (BRUSH_CACHE,
+            "'%c' cache %s: %d hits, %d misses (%.1f%% hits), "
+            "%d evictions, %d entries, %" G_GINT64_FORMAT " bytes",
+            cache->debug_hit, reason,
+            cache->n_hits, cache->n_misses,
+            100.0 * cache->n_hits / n_lookups,
+            cache->n_evictions,
+            g_hash_table_size (cache->entries),
+            cache->memsize);
+
+  cache->n_hits      = 0;
+  cache->n_misses    = 0;
+  cache->n_evictions = 0;
 }
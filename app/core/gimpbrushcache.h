@@ -33,24 +33,27 @@
 #define GIMP_BRUSH_CACHE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GIMP_TYPE_BRUSH_CACHE, GimpBrushCacheClass))
 
 
+typedef gint64 (* GimpBrushCacheMemsizeFunc) (gconstpointer data);
+
 typedef struct _GimpBrushCacheClass GimpBrushCacheClass;
 
 struct _GimpBrushCache
 {
-  GimpObject      parent_instance;
+  GimpObject                 parent_instance;
+
+  GDestroyNotify             data_destroy;
+  GimpBrushCacheMemsizeFunc  data_memsize;
 
-  GDestroyNotify  data_destroy;
+  GHashTable                *entries;
+  gpointer                   last_used; /*  the entry handed out last  */
+  gint64                     memsize;
 
-  gpointer        last_data;
-  gint            last_width;
-  gint            last_height;
-  gdouble         last_scale;
-  gdouble         last_aspect_ratio;
-  gdouble         last_angle;
-  gdouble         last_hardness;
+  gint                       n_hits;
+  gint                       n_misses;
+  gint                       n_evictions;
 
-  gchar           debug_hit;
-  gchar           debug_miss;
+  gchar                      debug_hit;
+  gchar                      debug_miss;
 };
 
 struct _GimpBrushCacheClass
@@ -59,29 +62,34 @@ struct _GimpBrushCacheClass
 };
 
 
-GType            gimp_brush_cache_get_type (void) G_GNUC_CONST;
-
-GimpBrushCache * gimp_brush_cache_new      (GDestroyNotify  data_destory,
-                                            gchar           debug_hit,
-                                            gchar           debug_miss);
-
-void             gimp_brush_cache_clear    (GimpBrushCache *cache);
-
-gconstpointer    gimp_brush_cache_get      (GimpBrushCache *cache,
-                                            gint            width,
-                                            gint            height,
-                                            gdouble         scale,
-                                            gdouble         aspect_ratio,
-                                            gdouble         angle,
-                                            gdouble         hardness);
-void             gimp_brush_cache_add      (GimpBrushCache *cache,
-                                            gpointer        data,
-                                            gint            width,
-                                            gint            height,
-                                            gdouble         scale,
-                                            gdouble         aspect_ratio,
-                                            gdouble         angle,
-                                            gdouble         hardness);
+GType            gimp_brush_cache_get_type       (void) G_GNUC_CONST;
+
+GimpBrushCache * gimp_brush_cache_new            (GDestroyNotify             data_destroy,
+                                                  GimpBrushCacheMemsizeFunc  data_memsize,
+                                                  gchar                      debug_hit,
+                                                  gchar                      debug_miss);
+
+void             gimp_brush_cache_clear          (GimpBrushCache *cache);
+
+gconstpointer    gimp_brush_cache_get            (GimpBrushCache *cache,
+                                                  gint            width,
+                                                  gint            height,
+                                                  gdouble         scale,
+                                                  gdouble         aspect_ratio,
+                                                  gdouble         angle,
+                                                  gdouble         hardness);
+void             gimp_brush_cache_add            (GimpBrushCache *cache,
+                                                  gpointer        data,
+                                                  gint            width,
+                                                  gint            height,
+                                                  gdouble         scale,
+                                                  gdouble         aspect_ratio,
+                                                  gdouble         angle,
+                                                  gdouble         hardness);
+
+void             gimp_brush_cache_set_max_size   (gint64          max_size);
+gint64           gimp_brush_cache_get_max_size   (void);
+gint64           gimp_brush_cache_get_total_size (void);
 
 
 #endif  /*  __GIMP_BRUSH_CACHE_H__  */
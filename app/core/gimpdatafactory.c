@@ -32,11 +32,14 @@
 #include "core-types.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimpcontext.h"
 #include "gimpdata.h"
 #include "gimpdatafactory.h"
 #include "gimplist.h"
 
+#include "gimp-trace.h"
+
 #include "gimp-intl.h"
 
 
@@ -53,6 +56,30 @@ typedef void (* GimpDataForeachFunc) (GimpDataFactory *factory,
                                       gpointer         user_data);
 
 
+typedef struct _GimpDataLoadFile GimpDataLoadFile;
+
+struct _GimpDataLoadFile
+{
+  gchar                            *filename;
+  gchar                            *dirname;
+  gchar                            *top_directory;
+  time_t                            mtime;
+  const GimpDataFactoryLoaderEntry *loader;
+
+  GList                            *data_list;  /*  the loader's results  */
+  GError                           *error;
+};
+
+typedef struct
+{
+  GimpDataFactory *factory;
+  GimpContext     *context;
+  GHashTable      *cache;
+  const gchar     *top_directory;
+  GPtrArray       *files;  /*  the GimpDataLoadFiles found so far  */
+} GimpDataLoadContext;
+
+
 struct _GimpDataFactoryPriv
 {
   Gimp                             *gimp;
@@ -85,6 +112,12 @@ static gchar * gimp_data_factory_get_save_dir (GimpDataFactory      *factory,
 
 static void    gimp_data_factory_load_data  (const GimpDatafileData *file_data,
                                              gpointer                data);
+static void    gimp_data_factory_load_file  (GimpDataLoadContext    *context,
+                                             GimpDataLoadFile       *file);
+static void    gimp_data_factory_load_job   (gint                    job,
+                                             gpointer                data);
+static void    gimp_data_factory_add_data   (GimpDataFactory        *factory,
+                                             GimpDataLoadFile       *file);
 
 static void    gimp_data_factory_load_data_recursive (const GimpDatafileData *file_data,
                                                       gpointer                data);
@@ -225,6 +258,9 @@ gimp_data_factory_data_init (GimpDataFactory *factory,
   /*  Freeze and thaw the container even if no_data,
    *  this creates the standard data that serves as fallback.
    */
+  gimp_trace_begin ("%s",
+                    g_type_name (gimp_data_factory_get_data_type (factory)));
+
   gimp_container_freeze (factory->priv->container);
 
   if (! no_data)
@@ -240,6 +276,7 @@ gimp_data_factory_data_init (GimpDataFactory *factory,
     }
 
   gimp_container_thaw (factory->priv->container);
+  gimp_trace_end ();
 }
 
 static void
@@ -304,14 +341,6 @@ gimp_data_factory_data_foreach (GimpDataFactory     *factory,
     }
 }
 
-typedef struct
-{
-  GimpDataFactory *factory;
-  GimpContext     *context;
-  GHashTable      *cache;
-  const gchar     *top_directory;
-} GimpDataLoadContext;
-
 static void
 gimp_data_factory_data_load (GimpDataFactory *factory,
                              GimpContext     *context,
@@ -330,10 +359,12 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
       GList               *writable_list = NULL;
       gchar               *tmp;
       GimpDataLoadContext  load_context = { 0, };
+      gint                 i;
 
       load_context.factory = factory;
       load_context.context = context;
       load_context.cache   = cache;
+      load_context.files   = g_ptr_array_new ();
 
       tmp = gimp_config_path_expand (path, TRUE, NULL);
       g_free (path);
@@ -359,6 +390,30 @@ gimp_data_factory_data_load (GimpDataFactory *factory,
                                        gimp_data_factory_load_data_recursive,
                                        &load_context);
 
+      /*  parse the files on all processors, and add the results to
+       *  the container here, in the order the files were found
+       */
+      gimp_parallel_run (factory->priv->gimp, load_context.files->len,
+                         gimp_data_factory_load_job, &load_context);
+
+      for (i = 0; i < load_context.files->len; i++)
+        {
+          GimpDataLoadFile *file = g_ptr_array_index (load_context.files, i);
+
+          if (! file->loader->thread_safe)
+            gimp_data_factory_load_file (&load_context, file);
+
+          gimp_data_factory_add_data (factory, file);
+
+          g_free (file->filename);
+          g_free (file->dirname);
+          g_free (file->top_directory);
+
+          g_slice_free (GimpDataLoadFile, file);
+        }
+
+      g_ptr_array_free (load_context.files, TRUE);
+
       if (writable_path)
         {
           gimp_path_free (writable_list);
@@ -843,8 +898,7 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
   GimpDataFactory                  *factory = context->factory;
   GHashTable                       *cache   = context->cache;
   const GimpDataFactoryLoaderEntry *loader  = NULL;
-  GError                           *error   = NULL;
-  GList                            *data_list;
+  GimpDataLoadFile                 *file;
   gint                              i;
 
   for (i = 0; i < factory->priv->n_loader_entries; i++)
@@ -883,16 +937,50 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
         }
     }
 
-  data_list = loader->load_func (context->context, file_data->filename, &error);
+  file = g_slice_new0 (GimpDataLoadFile);
+
+  file->filename      = g_strdup (file_data->filename);
+  file->dirname       = g_strdup (file_data->dirname);
+  file->top_directory = g_strdup (context->top_directory);
+  file->mtime         = file_data->mtime;
+  file->loader        = loader;
 
-  if (G_LIKELY (data_list))
+  g_ptr_array_add (context->files, file);
+}
+
+static void
+gimp_data_factory_load_file (GimpDataLoadContext *context,
+                             GimpDataLoadFile    *file)
+{
+  file->data_list = file->loader->load_func (context->context,
+                                             file->filename,
+                                             &file->error);
+}
+
+/*  runs in any thread, the other loaders run in the main thread  */
+static void
+gimp_data_factory_load_job (gint     job,
+                            gpointer data)
+{
+  GimpDataLoadContext *context = data;
+  GimpDataLoadFile    *file    = g_ptr_array_index (context->files, job);
+
+  if (file->loader->thread_safe)
+    gimp_data_factory_load_file (context, file);
+}
+
+static void
+gimp_data_factory_add_data (GimpDataFactory  *factory,
+                            GimpDataLoadFile *file)
+{
+  if (G_LIKELY (file->data_list))
     {
       GList    *list;
       gboolean  obsolete;
       gboolean  writable  = FALSE;
       gboolean  deletable = FALSE;
 
-      obsolete = (strstr (file_data->dirname,
+      obsolete = (strstr (file->dirname,
                           GIMP_OBSOLETE_DATA_DIR_NAME) != 0);
 
       /* obsolete files are immutable, don't check their writability */
@@ -903,20 +991,20 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
           writable_list = g_object_get_data (G_OBJECT (factory),
                                              WRITABLE_PATH_KEY);
 
-          deletable = (g_list_length (data_list) == 1 &&
-                       gimp_data_factory_is_dir_writable (file_data->dirname,
+          deletable = (g_list_length (file->data_list) == 1 &&
+                       gimp_data_factory_is_dir_writable (file->dirname,
                                                           writable_list));
 
-          writable = (deletable && loader->writable);
+          writable = (deletable && file->loader->writable);
         }
 
-      for (list = data_list; list; list = g_list_next (list))
+      for (list = file->data_list; list; list = g_list_next (list))
         {
           GimpData *data = list->data;
 
-          gimp_data_set_filename (data, file_data->filename,
+          gimp_data_set_filename (data, file->filename,
                                   writable, deletable);
-          gimp_data_set_mtime (data, file_data->mtime);
+          gimp_data_set_mtime (data, file->mtime);
 
           gimp_data_clean (data);
 
@@ -927,7 +1015,7 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
             }
           else
             {
-              gimp_data_set_folder_tags (data, context->top_directory);
+              gimp_data_set_folder_tags (data, file->top_directory);
 
               gimp_container_add (factory->priv->container,
                                   GIMP_OBJECT (data));
@@ -936,13 +1024,13 @@ gimp_data_factory_load_data (const GimpDatafileData *file_data,
           g_object_unref (data);
         }
 
-      g_list_free (data_list);
+      g_list_free (file->data_list);
     }
 
-  if (G_UNLIKELY (error))
+  if (G_UNLIKELY (file->error))
     {
       gimp_message (factory->priv->gimp, NULL, GIMP_MESSAGE_ERROR,
-                    _("Failed to load data:\n\n%s"), error->message);
-      g_clear_error (&error);
+                    _("Failed to load data:\n\n%s"), file->error->message);
+      g_clear_error (&file->error);
     }
 }
@@ -40,6 +40,7 @@ struct _GimpDataFactoryLoaderEntry
   GimpDataLoadFunc  load_func;
   const gchar      *extension;
   gboolean          writable;
+  gboolean          thread_safe;  /*  load_func may run in any thread  */
 };
 
 
@@ -104,7 +104,7 @@ gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
 
           gimp_item_get_offset (GIMP_ITEM (drawable), &off_x, &off_y);
 
-          gimp_histogram_calculate (histogram,
+          gimp_histogram_calculate (histogram, image->gimp,
                                     gimp_drawable_get_buffer (drawable),
                                     GEGL_RECTANGLE (x, y, width, height),
                                     gimp_drawable_get_buffer (GIMP_DRAWABLE (mask)),
@@ -113,7 +113,7 @@ gimp_drawable_calculate_histogram (GimpDrawable  *drawable,
         }
       else
         {
-          gimp_histogram_calculate (histogram,
+          gimp_histogram_calculate (histogram, image->gimp,
                                     gimp_drawable_get_buffer (drawable),
                                     GEGL_RECTANGLE (x, y, width, height),
                                     NULL, NULL);
@@ -24,8 +24,12 @@
 
 #include "core-types.h"
 
+#include "operations/gimpoperationfusedlayers.h"
+
 #include "gimpdrawable.h"
 #include "gimpdrawablestack.h"
+#include "gimpgrouplayer.h"
+#include "gimplayer.h"
 #include "gimpmarshal.h"
 
 
@@ -39,6 +43,7 @@ enum
 /*  local function prototypes  */
 
 static void   gimp_drawable_stack_constructed      (GObject           *object);
+static void   gimp_drawable_stack_finalize         (GObject           *object);
 
 static void   gimp_drawable_stack_add              (GimpContainer     *container,
                                                     GimpObject        *object);
@@ -48,6 +53,14 @@ static void   gimp_drawable_stack_reorder          (GimpContainer     *container
                                                     GimpObject        *object,
                                                     gint               new_index);
 
+static void   gimp_drawable_stack_graph_changed    (GimpFilterStack   *filter_stack);
+static void   gimp_drawable_stack_fused_update     (GimpDrawableStack *stack,
+                                                    GimpDrawable      *drawable,
+                                                    gint               x,
+                                                    gint               y,
+                                                    gint               width,
+                                                    gint               height);
+
 static void   gimp_drawable_stack_update           (GimpDrawableStack *stack,
                                                     gint               x,
                                                     gint               y,
@@ -61,6 +74,8 @@ static void   gimp_drawable_stack_drawable_update  (GimpItem          *item,
                                                     GimpDrawableStack *stack);
 static void   gimp_drawable_stack_drawable_visible (GimpItem          *item,
                                                     GimpDrawableStack *stack);
+static void   gimp_drawable_stack_layer_changed    (GimpLayer         *layer,
+                                                    GimpDrawableStack *stack);
 
 
 G_DEFINE_TYPE (GimpDrawableStack, gimp_drawable_stack, GIMP_TYPE_ITEM_STACK)
@@ -73,8 +88,9 @@ static guint stack_signals[LAST_SIGNAL] = { 0 };
 static void
 gimp_drawable_stack_class_init (GimpDrawableStackClass *klass)
 {
-  GObjectClass       *object_class    = G_OBJECT_CLASS (klass);
-  GimpContainerClass *container_class = GIMP_CONTAINER_CLASS (klass);
+  GObjectClass         *object_class       = G_OBJECT_CLASS (klass);
+  GimpContainerClass   *container_class    = GIMP_CONTAINER_CLASS (klass);
+  GimpFilterStackClass *filter_stack_class = GIMP_FILTER_STACK_CLASS (klass);
 
   stack_signals[UPDATE] =
     g_signal_new ("update",
@@ -89,11 +105,14 @@ gimp_drawable_stack_class_init (GimpDrawableStackClass *klass)
                   G_TYPE_INT,
                   G_TYPE_INT);
 
-  object_class->constructed = gimp_drawable_stack_constructed;
+  object_class->constructed         = gimp_drawable_stack_constructed;
+  object_class->finalize            = gimp_drawable_stack_finalize;
+
+  container_class->add              = gimp_drawable_stack_add;
+  container_class->remove           = gimp_drawable_stack_remove;
+  container_class->reorder          = gimp_drawable_stack_reorder;
 
-  container_class->add      = gimp_drawable_stack_add;
-  container_class->remove   = gimp_drawable_stack_remove;
-  container_class->reorder  = gimp_drawable_stack_reorder;
+  filter_stack_class->graph_changed = gimp_drawable_stack_graph_changed;
 }
 
 static void
@@ -117,6 +136,29 @@ gimp_drawable_stack_constructed (GObject *object)
   gimp_container_add_handler (container, "visibility-changed",
                               G_CALLBACK (gimp_drawable_stack_drawable_visible),
                               container);
+
+  if (g_type_is_a (gimp_container_get_children_type (container),
+                   GIMP_TYPE_LAYER))
+    {
+      gimp_container_add_handler (container, "visibility-changed",
+                                  G_CALLBACK (gimp_drawable_stack_layer_changed),
+                                  container);
+      gimp_container_add_handler (container, "mask-changed",
+                                  G_CALLBACK (gimp_drawable_stack_layer_changed),
+                                  container);
+    }
+}
+
+static void
+gimp_drawable_stack_finalize (GObject *object)
+{
+  GimpDrawableStack *stack = GIMP_DRAWABLE_STACK (object);
+
+  /*  the nodes are owned by the graph  */
+  g_list_free (stack->fused_nodes);
+  stack->fused_nodes = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 static void
@@ -174,6 +216,203 @@ gimp_drawable_stack_new (GType drawable_type)
 
 /*  private functions  */
 
+static gboolean
+gimp_drawable_stack_layer_is_fusable (GimpLayer *layer)
+{
+  /*  a mask is an additional input of the mode node, and a floating
+   *  selection's pixels are composited by the drawable it is attached
+   *  to, so keep both in the chain; so are groups, which render a
+   *  whole stack of their own, and modes the fused node can't run
+   */
+  return (layer->layer_offset_node            &&
+          ! gimp_layer_get_mask (layer)        &&
+          ! gimp_layer_is_floating_sel (layer) &&
+          ! GIMP_IS_GROUP_LAYER (layer)        &&
+          gimp_operation_fused_layers_can_fuse (gimp_drawable_get_mode_node (GIMP_DRAWABLE (layer))));
+}
+
+/*  Links the layers' nodes bottom to top like the filter stack does,
+ *  but replaces each run of at least two fusable layers by a single
+ *  gimp:fused-layers node, which composites them in one pass and
+ *  gets the same result. Invisible layers pass their input through
+ *  and may sit anywhere in a run.
+ */
+static void
+gimp_drawable_stack_graph_changed (GimpFilterStack *filter_stack)
+{
+  GimpDrawableStack *stack = GIMP_DRAWABLE_STACK (filter_stack);
+  GList             *filters;
+  GList             *fused;
+  GList             *list;
+  GeglNode          *below;
+  GeglNode          *output;
+
+  if (! g_type_is_a (gimp_container_get_children_type (GIMP_CONTAINER (stack)),
+                     GIMP_TYPE_LAYER))
+    return;
+
+  filters = g_list_reverse (g_list_copy (GIMP_LIST (stack)->list));
+  fused   = stack->fused_nodes;
+  below   = gegl_node_get_input_proxy (filter_stack->graph, "input");
+
+  list = filters;
+
+  while (list)
+    {
+      GList *end      = list;
+      GList *iter;
+      gint   n_layers = 0;
+
+      for (iter = list; iter; iter = g_list_next (iter))
+        {
+          if (! gimp_item_get_visible (iter->data))
+            continue;
+
+          if (n_layers == GIMP_FUSED_LAYERS_MAX_LAYERS ||
+              ! gimp_drawable_stack_layer_is_fusable (iter->data))
+            break;
+
+          n_layers++;
+          end = g_list_next (iter);
+        }
+
+      if (n_layers >= 2)
+        {
+          GeglNode *node;
+          gint      i = 0;
+
+          if (! fused)
+            {
+              node = gegl_node_new_child (filter_stack->graph,
+                                          "operation", "gimp:fused-layers",
+                                          NULL);
+
+              stack->fused_nodes = g_list_append (stack->fused_nodes, node);
+              fused = g_list_last (stack->fused_nodes);
+            }
+
+          node  = fused->data;
+          fused = g_list_next (fused);
+
+          gegl_node_connect_to (below, "output",
+                                node,  "input");
+
+          for (iter = list; iter != end; iter = g_list_next (iter))
+            {
+              GimpLayer *layer = iter->data;
+              gchar      aux[16];
+              gchar      mode[16];
+
+              gegl_node_disconnect (gimp_filter_get_node (iter->data), "input");
+
+              if (! gimp_item_get_visible (iter->data))
+                continue;
+
+              g_snprintf (aux,  sizeof (aux),  "aux%d",  i + 1);
+              g_snprintf (mode, sizeof (mode), "mode%d", i + 1);
+
+              gegl_node_connect_to (layer->layer_offset_node, "output",
+                                    node,                     aux);
+              gegl_node_set (node,
+                             mode, gimp_drawable_get_mode_node (iter->data),
+                             NULL);
+              i++;
+            }
+
+          for (; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+            {
+              gchar aux[16];
+              gchar mode[16];
+
+              g_snprintf (aux,  sizeof (aux),  "aux%d",  i + 1);
+              g_snprintf (mode, sizeof (mode), "mode%d", i + 1);
+
+              gegl_node_disconnect (node, aux);
+              gegl_node_set (node,
+                             mode, NULL,
+                             NULL);
+            }
+
+          below = node;
+          list  = end;
+        }
+      else
+        {
+          GeglNode *node = gimp_filter_get_node (list->data);
+
+          gegl_node_connect_to (below, "output",
+                                node,  "input");
+
+          below = node;
+          list  = g_list_next (list);
+        }
+    }
+
+  output = gegl_node_get_output_proxy (filter_stack->graph, "output");
+
+  gegl_node_connect_to (below,  "output",
+                        output, "input");
+
+  /*  drop the nodes of runs that no longer exist  */
+  while (fused)
+    {
+      GList *next = g_list_next (fused);
+
+      gegl_node_remove_child (filter_stack->graph, fused->data);
+      stack->fused_nodes = g_list_delete_link (stack->fused_nodes, fused);
+
+      fused = next;
+    }
+
+  g_list_free (filters);
+}
+
+/*  The mode nodes of fused layers are not linked into the graph, so
+ *  changing their mode or opacity doesn't invalidate anything. Every
+ *  such change is followed by an update of the layer, so invalidate
+ *  the fused node there, or put the layer back into the chain if its
+ *  new mode can't be fused.
+ */
+static void
+gimp_drawable_stack_fused_update (GimpDrawableStack *stack,
+                                  GimpDrawable      *drawable,
+                                  gint               x,
+                                  gint               y,
+                                  gint               width,
+                                  gint               height)
+{
+  GeglNode *mode_node;
+  GList    *list;
+
+  if (! stack->fused_nodes)
+    return;
+
+  mode_node = gimp_drawable_get_mode_node (drawable);
+
+  for (list = stack->fused_nodes; list; list = g_list_next (list))
+    {
+      GimpOperationFusedLayers *fused;
+      gint                      i;
+
+      fused = GIMP_OPERATION_FUSED_LAYERS (gegl_node_get_gegl_operation (list->data));
+
+      for (i = 0; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+        {
+          if (fused->modes[i] != mode_node)
+            continue;
+
+          if (gimp_operation_fused_layers_can_fuse (mode_node))
+            gegl_operation_invalidate (GEGL_OPERATION (fused),
+                                       GEGL_RECTANGLE (x, y, width, height),
+                                       TRUE);
+          else
+            gimp_drawable_stack_graph_changed (GIMP_FILTER_STACK (stack));
+
+          return;
+        }
+    }
+}
+
 static void
 gimp_drawable_stack_update (GimpDrawableStack *stack,
                             gint               x,
@@ -200,6 +439,10 @@ gimp_drawable_stack_drawable_update (GimpItem          *item,
 
       gimp_item_get_offset (item, &offset_x, &offset_y);
 
+      gimp_drawable_stack_fused_update (stack, GIMP_DRAWABLE (item),
+                                        x + offset_x, y + offset_y,
+                                        width, height);
+
       gimp_drawable_stack_update (stack,
                                   x + offset_x, y + offset_y,
                                   width, height);
@@ -220,3 +463,13 @@ gimp_drawable_stack_drawable_visible (GimpItem          *item,
                               gimp_item_get_width  (item),
                               gimp_item_get_height (item));
 }
+
+static void
+gimp_drawable_stack_layer_changed (GimpLayer         *layer,
+                                   GimpDrawableStack *stack)
+{
+  GimpFilterStack *filter_stack = GIMP_FILTER_STACK (stack);
+
+  if (filter_stack->graph)
+    gimp_drawable_stack_graph_changed (filter_stack);
+}
@@ -36,6 +36,8 @@ typedef struct _GimpDrawableStackClass GimpDrawableStackClass;
 struct _GimpDrawableStack
 {
   GimpItemStack  parent_instance;
+
+  GList         *fused_nodes;
 };
 
 struct _GimpDrawableStackClass
@@ -17,17 +17,24 @@
 
 #include "config.h"
 
+#include <cairo.h>
 #include <gegl.h>
 
 #include "libgimpbase/gimpbase.h"
 
 #include "core-types.h"
 
+#include "gegl/gimptilehandlersnapshot.h"
+
+#include "gimp.h"
+#include "gimp-undo-store.h"
 #include "gimp-utils.h"
 #include "gimpimage.h"
 #include "gimpdrawable.h"
 #include "gimpdrawableundo.h"
 
+#include "gimp-intl.h"
+
 
 enum
 {
@@ -57,6 +64,9 @@ static void     gimp_drawable_undo_pop          (GimpUndo            *undo,
 static void     gimp_drawable_undo_free         (GimpUndo            *undo,
                                                  GimpUndoMode         undo_mode);
 
+static void     gimp_drawable_undo_swap_region  (GimpDrawableUndo    *drawable_undo);
+static void     gimp_drawable_undo_stored       (gpointer             data);
+
 
 G_DEFINE_TYPE (GimpDrawableUndo, gimp_drawable_undo, GIMP_TYPE_ITEM_UNDO)
 
@@ -173,7 +183,43 @@ gimp_drawable_undo_get_memsize (GimpObject *object,
   GimpDrawableUndo *drawable_undo = GIMP_DRAWABLE_UNDO (object);
   gint64            memsize       = 0;
 
-  memsize += gimp_gegl_buffer_get_memsize (drawable_undo->buffer);
+  if (drawable_undo->stored)
+    {
+      memsize += gimp_undo_store_item_get_memsize (drawable_undo->stored);
+    }
+  else if (drawable_undo->buffer &&
+           gimp_gegl_buffer_is_snapshot (drawable_undo->buffer))
+    {
+      /*  only the captured tiles hold pixels  */
+      cairo_region_t *region;
+      gint            bpp;
+      gint            n_rects;
+      gint            i;
+
+      region  = gimp_gegl_buffer_snapshot_get_captured_region (drawable_undo->buffer);
+      bpp     = babl_format_get_bytes_per_pixel (gegl_buffer_get_format (drawable_undo->buffer));
+      n_rects = cairo_region_num_rectangles (region);
+
+      for (i = 0; i < n_rects; i++)
+        {
+          cairo_rectangle_int_t rect;
+          GeglRectangle         area;
+
+          cairo_region_get_rectangle (region, i, &rect);
+
+          if (gegl_rectangle_intersect (&area,
+                                        GEGL_RECTANGLE (rect.x, rect.y,
+                                                        rect.width, rect.height),
+                                        gegl_buffer_get_extent (drawable_undo->buffer)))
+            memsize += (gint64) area.width * area.height * bpp;
+        }
+
+      memsize += gimp_g_object_get_memsize (G_OBJECT (drawable_undo->buffer));
+    }
+  else
+    {
+      memsize += gimp_gegl_buffer_get_memsize (drawable_undo->buffer);
+    }
 
   return memsize + GIMP_OBJECT_CLASS (parent_class)->get_memsize (object,
                                                                   gui_size);
@@ -188,10 +234,35 @@ gimp_drawable_undo_pop (GimpUndo            *undo,
 
   GIMP_UNDO_CLASS (parent_class)->pop (undo, undo_mode, accum);
 
-  gimp_drawable_swap_pixels (GIMP_DRAWABLE (GIMP_ITEM_UNDO (undo)->item),
-                             drawable_undo->buffer,
-                             drawable_undo->x,
-                             drawable_undo->y);
+  if (drawable_undo->stored)
+    {
+      GError *error = NULL;
+
+      drawable_undo->buffer = gimp_undo_store_thaw (drawable_undo->stored,
+                                                    &error);
+      drawable_undo->stored = NULL;
+
+      if (! drawable_undo->buffer)
+        {
+          gimp_message (undo->image->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        _("Could not restore the pixels of \"%s\", "
+                          "skipping this part of the undo step: %s"),
+                        gimp_object_get_name (undo), error->message);
+          g_clear_error (&error);
+        }
+    }
+
+  /*  the pixels were lost, see above  */
+  if (! drawable_undo->buffer)
+    return;
+
+  if (gimp_gegl_buffer_is_snapshot (drawable_undo->buffer))
+    gimp_drawable_undo_swap_region (drawable_undo);
+  else
+    gimp_drawable_swap_pixels (GIMP_DRAWABLE (GIMP_ITEM_UNDO (undo)->item),
+                               drawable_undo->buffer,
+                               drawable_undo->x,
+                               drawable_undo->y);
 }
 
 static void
@@ -206,6 +277,12 @@ gimp_drawable_undo_free (GimpUndo     *undo,
       drawable_undo->buffer = NULL;
     }
 
+  if (drawable_undo->stored)
+    {
+      gimp_undo_store_item_free (drawable_undo->stored);
+      drawable_undo->stored = NULL;
+    }
+
   if (drawable_undo->applied_buffer)
     {
       g_object_unref (drawable_undo->applied_buffer);
@@ -214,3 +291,87 @@ gimp_drawable_undo_free (GimpUndo     *undo,
 
   GIMP_UNDO_CLASS (parent_class)->free (undo, undo_mode);
 }
+
+/*  swaps only the captured tiles of a snapshot, one rectangle of them
+ *  at a time
+ */
+static void
+gimp_drawable_undo_swap_region (GimpDrawableUndo *drawable_undo)
+{
+  GimpDrawable   *drawable = GIMP_DRAWABLE (GIMP_ITEM_UNDO (drawable_undo)->item);
+  GeglBuffer     *buffer   = drawable_undo->buffer;
+  cairo_region_t *region;
+  gint            n_rects;
+  gint            i;
+
+  region  = gimp_gegl_buffer_snapshot_get_captured_region (buffer);
+  n_rects = cairo_region_num_rectangles (region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t  rect;
+      GeglRectangle          area;
+      GeglBuffer            *part;
+
+      cairo_region_get_rectangle (region, i, &rect);
+
+      if (! gegl_rectangle_intersect (&area,
+                                      GEGL_RECTANGLE (rect.x, rect.y,
+                                                      rect.width, rect.height),
+                                      gegl_buffer_get_extent (buffer)))
+        continue;
+
+      part = gegl_buffer_new (GEGL_RECTANGLE (0, 0, area.width, area.height),
+                              gegl_buffer_get_format (buffer));
+
+      gegl_buffer_copy (buffer, &area,
+                        part,   GEGL_RECTANGLE (0, 0, 0, 0));
+
+      gimp_drawable_swap_pixels (drawable, part,
+                                 drawable_undo->x + area.x,
+                                 drawable_undo->y + area.y);
+
+      gegl_buffer_copy (part,   GEGL_RECTANGLE (0, 0, area.width, area.height),
+                        buffer, &area);
+
+      g_object_unref (part);
+    }
+}
+
+/*  the memsize has changed behind the image's back  */
+static void
+gimp_drawable_undo_stored (gpointer data)
+{
+  GimpUndo *undo = data;
+
+  gimp_image_undo_event (undo->image, GIMP_UNDO_EVENT_UNDO_STORED, undo);
+}
+
+
+/*  public functions  */
+
+void
+gimp_drawable_undo_compress (GimpDrawableUndo *undo)
+{
+  GimpImage *image;
+
+  g_return_if_fail (GIMP_IS_DRAWABLE_UNDO (undo));
+
+  /*  a snapshot's pixels are already just the tiles that were
+   *  changed, and the store would lose which ones they are
+   */
+  if (! undo->buffer || undo->applied_buffer ||
+      gimp_gegl_buffer_is_snapshot (undo->buffer))
+    return;
+
+  image = GIMP_UNDO (undo)->image;
+
+  undo->stored = gimp_undo_store_freeze (image->gimp, undo->buffer,
+                                         gimp_drawable_undo_stored, undo);
+
+  if (undo->stored)
+    {
+      g_object_unref (undo->buffer);
+      undo->buffer = NULL;
+    }
+}
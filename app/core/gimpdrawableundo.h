@@ -36,9 +36,10 @@ struct _GimpDrawableUndo
 {
   GimpItemUndo  parent_instance;
 
-  GeglBuffer   *buffer;
-  gint          x;
-  gint          y;
+  GeglBuffer        *buffer;
+  GimpUndoStoreItem *stored;  /* buffer's pixels, when compressed */
+  gint               x;
+  gint               y;
 
   /* stuff for "Fade" */
   GeglBuffer           *applied_buffer;
@@ -54,5 +55,7 @@ struct _GimpDrawableUndoClass
 
 GType   gimp_drawable_undo_get_type (void) G_GNUC_CONST;
 
+void    gimp_drawable_undo_compress (GimpDrawableUndo *undo);
+
 
 #endif /* __GIMP_DRAWABLE_UNDO_H__ */
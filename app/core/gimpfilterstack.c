@@ -30,21 +30,22 @@
 
 /*  local function prototypes  */
 
-static void   gimp_filter_stack_constructed (GObject         *object);
-static void   gimp_filter_stack_finalize    (GObject         *object);
+static void   gimp_filter_stack_constructed   (GObject         *object);
+static void   gimp_filter_stack_finalize      (GObject         *object);
 
-static void   gimp_filter_stack_add         (GimpContainer   *container,
-                                             GimpObject      *object);
-static void   gimp_filter_stack_remove      (GimpContainer   *container,
-                                             GimpObject      *object);
-static void   gimp_filter_stack_reorder     (GimpContainer   *container,
-                                             GimpObject      *object,
-                                             gint             new_index);
+static void   gimp_filter_stack_add           (GimpContainer   *container,
+                                               GimpObject      *object);
+static void   gimp_filter_stack_remove        (GimpContainer   *container,
+                                               GimpObject      *object);
+static void   gimp_filter_stack_reorder       (GimpContainer   *container,
+                                               GimpObject      *object,
+                                               gint             new_index);
 
-static void   gimp_filter_stack_add_node    (GimpFilterStack *stack,
-                                             GimpFilter      *filter);
-static void   gimp_filter_stack_remove_node (GimpFilterStack *stack,
-                                             GimpFilter      *filter);
+static void   gimp_filter_stack_add_node      (GimpFilterStack *stack,
+                                               GimpFilter      *filter);
+static void   gimp_filter_stack_remove_node   (GimpFilterStack *stack,
+                                               GimpFilter      *filter);
+static void   gimp_filter_stack_graph_changed (GimpFilterStack *stack);
 
 
 G_DEFINE_TYPE (GimpFilterStack, gimp_filter_stack, GIMP_TYPE_LIST);
@@ -110,6 +111,7 @@ gimp_filter_stack_add (GimpContainer *container,
 
       gegl_node_add_child (stack->graph, gimp_filter_get_node (filter));
       gimp_filter_stack_add_node (stack, filter);
+      gimp_filter_stack_graph_changed (stack);
     }
 }
 
@@ -128,6 +130,9 @@ gimp_filter_stack_remove (GimpContainer *container,
     }
 
   GIMP_CONTAINER_CLASS (parent_class)->remove (container, object);
+
+  if (stack->graph)
+    gimp_filter_stack_graph_changed (stack);
 }
 
 static void
@@ -144,7 +149,10 @@ gimp_filter_stack_reorder (GimpContainer *container,
   GIMP_CONTAINER_CLASS (parent_class)->reorder (container, object, new_index);
 
   if (stack->graph)
-    gimp_filter_stack_add_node (stack, filter);
+    {
+      gimp_filter_stack_add_node (stack, filter);
+      gimp_filter_stack_graph_changed (stack);
+    }
 }
 
 
@@ -226,6 +234,8 @@ gimp_filter_stack_get_graph (GimpFilterStack *stack)
                             output, "input");
     }
 
+  gimp_filter_stack_graph_changed (stack);
+
   return stack->graph;
 }
 
@@ -334,3 +344,12 @@ gimp_filter_stack_remove_node (GimpFilterStack *stack,
   gegl_node_connect_to (node_below, "output",
                         node_above, "input");
 }
+
+static void
+gimp_filter_stack_graph_changed (GimpFilterStack *stack)
+{
+  GimpFilterStackClass *klass = GIMP_FILTER_STACK_GET_CLASS (stack);
+
+  if (klass->graph_changed)
+    klass->graph_changed (stack);
+}
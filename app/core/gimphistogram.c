@@ -29,31 +29,111 @@
 
 #include "gegl/gimp-babl.h"
 
+#include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimphistogram.h"
 
 
+/*  The histogram is calculated in square blocks of the region, each
+ *  into its own partial histogram, so that the blocks can be binned in
+ *  parallel.  The partial histograms are summed up afterwards.  An
+ *  incremental histogram keeps them around, and only re-bins the
+ *  blocks that were invalidated since the last calculation.
+ */
+
+#define N_BINS_HIGH_PRECISION 1024
+#define MIN_BLOCK_SIZE        256  /*  a multiple of the tile size  */
+#define MAX_BLOCKS            256
+
+
 struct _GimpHistogram
 {
-  gint     ref_count;
-  gint     n_channels;
-  gdouble *values;
+  gint            ref_count;
+  gboolean        high_precision;
+  gboolean        incremental;
+
+  gint            n_channels;
+  gint            n_bins;
+  gdouble        *values;
+
+  /*  what the blocks were calculated from  */
+  GeglBuffer     *buffer;
+  const Babl     *format;
+  GeglRectangle   rect;
+  gboolean        has_mask;
+  gint            mask_offset_x;
+  gint            mask_offset_y;
+
+  gint            block_size;
+  gint            n_blocks_x;
+  gint            n_blocks_y;
+  gdouble       **blocks;
+  gboolean       *dirty;
 };
 
+typedef struct
+{
+  GimpHistogram *histogram;
+  GeglBuffer    *buffer;
+  GeglBuffer    *mask;
+  gint          *jobs;
+} HistogramTask;
+
 
 /*  local function prototypes  */
 
-static void   gimp_histogram_alloc_values (GimpHistogram *histogram,
-                                           gint           bytes);
+static void   gimp_histogram_alloc_values     (GimpHistogram       *histogram,
+                                               gint                 bytes,
+                                               gint                 n_bins);
+static void   gimp_histogram_free_blocks      (GimpHistogram       *histogram);
+static void   gimp_histogram_alloc_blocks     (GimpHistogram       *histogram,
+                                               const GeglRectangle *rect);
+static void   gimp_histogram_calculate_block  (gint                 job,
+                                               HistogramTask       *task);
+static void   gimp_histogram_calculate_u8     (GimpHistogram       *histogram,
+                                               gdouble             *values,
+                                               GeglBufferIterator  *iter,
+                                               gboolean             has_mask);
+static void   gimp_histogram_calculate_float  (GimpHistogram       *histogram,
+                                               gdouble             *values,
+                                               GeglBufferIterator  *iter,
+                                               gboolean             has_mask);
 
 
 /*  public functions  */
 
 GimpHistogram *
 gimp_histogram_new (void)
+{
+  return gimp_histogram_new_full (FALSE, FALSE);
+}
+
+/**
+ * gimp_histogram_new_full:
+ * @high_precision: whether to use more than 256 bins for high bit depths
+ * @incremental:    whether to keep what is needed for incremental updates
+ *
+ * Creates a new histogram.  If @high_precision is %TRUE, buffers of
+ * more than 8 bits per channel are binned into 1024 instead of 256
+ * bins, see gimp_histogram_n_bins().
+ *
+ * If @incremental is %TRUE, gimp_histogram_calculate() re-bins only
+ * the parts of the region that were passed to
+ * gimp_histogram_invalidate() since the last calculation, as long as
+ * it is called for the same buffer, region and mask.
+ *
+ * Return value: a new %GimpHistogram
+ **/
+GimpHistogram *
+gimp_histogram_new_full (gboolean high_precision,
+                         gboolean incremental)
 {
   GimpHistogram *histogram = g_slice_new0 (GimpHistogram);
 
-  histogram->ref_count = 1;
+  histogram->ref_count      = 1;
+  histogram->high_precision = high_precision;
+  histogram->incremental    = incremental;
+  histogram->n_bins         = 256;
 
   return histogram;
 }
@@ -98,196 +178,177 @@ gimp_histogram_duplicate (GimpHistogram *histogram)
 
   g_return_val_if_fail (histogram != NULL, NULL);
 
-  dup = gimp_histogram_new ();
+  dup = gimp_histogram_new_full (histogram->high_precision, FALSE);
 
   dup->n_channels = histogram->n_channels;
+  dup->n_bins     = histogram->n_bins;
   dup->values     = g_memdup (histogram->values,
-                              sizeof (gdouble) * dup->n_channels * 256);
+                              sizeof (gdouble) * dup->n_channels * dup->n_bins);
 
   return dup;
 }
 
 void
 gimp_histogram_calculate (GimpHistogram       *histogram,
+                          Gimp                *gimp,
                           GeglBuffer          *buffer,
                           const GeglRectangle *buffer_rect,
                           GeglBuffer          *mask,
                           const GeglRectangle *mask_rect)
 {
-  GeglBufferIterator *iter;
-  const Babl         *format;
-  gint                n_components;
+  HistogramTask  task;
+  const Babl    *format;
+  gint           n_components;
+  gint           n_bins;
+  gint           n_blocks;
+  gint           n_jobs = 0;
+  gint           i;
 
   g_return_if_fail (histogram != NULL);
+  g_return_if_fail (gimp == NULL || GIMP_IS_GIMP (gimp));
   g_return_if_fail (GEGL_IS_BUFFER (buffer));
   g_return_if_fail (buffer_rect != NULL);
 
   format = gegl_buffer_get_format (buffer);
 
-  if (babl_format_is_palette (format))
-    format = gimp_babl_format (GIMP_RGB, GIMP_PRECISION_U8,
-                               babl_format_has_alpha (format));
-  else
-    format = gimp_babl_format (gimp_babl_format_get_base_type (format),
-                               GIMP_PRECISION_U8,
-                               babl_format_has_alpha (format));
-
-  n_components = babl_format_get_n_components (format);
-
-  gimp_histogram_alloc_values (histogram, n_components);
-
-  iter = gegl_buffer_iterator_new (buffer, buffer_rect, 0, format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+  if (histogram->high_precision &&
+      ! babl_format_is_palette (format) &&
+      gimp_babl_format_get_precision (format) != GIMP_PRECISION_U8)
+    {
+      static const gchar *float_formats[] =
+      {
+        "Y' float", "Y'A float", "R'G'B' float", "R'G'B'A float"
+      };
 
-  if (mask)
-    gegl_buffer_iterator_add (iter, mask, mask_rect, 0,
-                              babl_format ("Y float"),
-                              GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+      n_components = babl_format_get_n_components (format);
+      format       = babl_format (float_formats[n_components - 1]);
+      n_bins       = N_BINS_HIGH_PRECISION;
+    }
+  else
+    {
+      if (babl_format_is_palette (format))
+        format = gimp_babl_format (GIMP_RGB, GIMP_PRECISION_U8,
+                                   babl_format_has_alpha (format));
+      else
+        format = gimp_babl_format (gimp_babl_format_get_base_type (format),
+                                   GIMP_PRECISION_U8,
+                                   babl_format_has_alpha (format));
 
-#define VALUE(c,i) (histogram->values[(c) * 256 + (i)])
+      n_components = babl_format_get_n_components (format);
+      n_bins       = 256;
+    }
 
-  while (gegl_buffer_iterator_next (iter))
+  /*  start over unless the blocks are from the same calculation  */
+  if (! histogram->blocks                                          ||
+      histogram->buffer   != buffer                                ||
+      histogram->format   != format                                ||
+      histogram->has_mask != (mask != NULL)                        ||
+      ! gegl_rectangle_equal (&histogram->rect, buffer_rect)       ||
+      (mask && (histogram->mask_offset_x != mask_rect->x - buffer_rect->x ||
+                histogram->mask_offset_y != mask_rect->y - buffer_rect->y)))
     {
-      const guchar *data = iter->data[0];
-      gint          max;
+      gimp_histogram_free_blocks (histogram);
+      gimp_histogram_alloc_values (histogram, n_components, n_bins);
+      gimp_histogram_alloc_blocks (histogram, buffer_rect);
+
+      histogram->buffer   = buffer;
+      histogram->format   = format;
+      histogram->has_mask = (mask != NULL);
 
       if (mask)
         {
-          const gfloat *mask_data = iter->data[1];
-
-          switch (n_components)
-            {
-            case 1:
-              while (iter->length--)
-                {
-                  const gdouble masked = *mask_data;
-
-                  VALUE (0, data[0]) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 2:
-              while (iter->length--)
-                {
-                  const gdouble masked = *mask_data;
-                  const gdouble weight = data[1] / 255.0;
-
-                  VALUE (0, data[0]) += weight * masked;
-                  VALUE (1, data[1]) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 3: /* calculate separate value values */
-              while (iter->length--)
-                {
-                  const gdouble masked = *mask_data;
-
-                  VALUE (1, data[0]) += masked;
-                  VALUE (2, data[1]) += masked;
-                  VALUE (3, data[2]) += masked;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
-
-                  VALUE (0, max) += masked;
-
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-
-            case 4: /* calculate separate value values */
-              while (iter->length--)
-                {
-                  const gdouble masked = *mask_data;
-                  const gdouble weight = data[3] / 255.0;
+          histogram->mask_offset_x = mask_rect->x - buffer_rect->x;
+          histogram->mask_offset_y = mask_rect->y - buffer_rect->y;
+        }
 
-                  VALUE (1, data[0]) += weight * masked;
-                  VALUE (2, data[1]) += weight * masked;
-                  VALUE (3, data[2]) += weight * masked;
-                  VALUE (4, data[3]) += masked;
+      g_object_add_weak_pointer (G_OBJECT (buffer),
+                                 (gpointer) &histogram->buffer);
+    }
 
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
+  n_blocks = histogram->n_blocks_x * histogram->n_blocks_y;
 
-                  VALUE (0, max) += weight * masked;
+  task.histogram = histogram;
+  task.buffer    = buffer;
+  task.mask      = mask;
+  task.jobs      = g_new (gint, n_blocks);
 
-                  data += n_components;
-                  mask_data += 1;
-                }
-              break;
-            }
-        }
-      else /* no mask */
-        {
-          switch (n_components)
-            {
-            case 1:
-              while (iter->length--)
-                {
-                  VALUE (0, data[0]) += 1.0;
+  for (i = 0; i < n_blocks; i++)
+    {
+      if (histogram->dirty[i])
+        task.jobs[n_jobs++] = i;
+    }
 
-                  data += n_components;
-                }
-              break;
+  if (n_jobs > 1 && gimp)
+    {
+      gimp_parallel_run (gimp, n_jobs,
+                         (GimpParallelFunc) gimp_histogram_calculate_block,
+                         &task);
+    }
+  else
+    {
+      for (i = 0; i < n_jobs; i++)
+        gimp_histogram_calculate_block (i, &task);
+    }
 
-            case 2:
-              while (iter->length--)
-                {
-                  const gdouble weight = data[1] / 255.0;
+  g_free (task.jobs);
 
-                  VALUE (0, data[0]) += weight;
-                  VALUE (1, data[1]) += 1.0;
+  /*  sum up the blocks  */
+  memset (histogram->values, 0,
+          histogram->n_channels * histogram->n_bins * sizeof (gdouble));
 
-                  data += n_components;
-                }
-              break;
+  for (i = 0; i < n_blocks; i++)
+    {
+      const gdouble *block = histogram->blocks[i];
+      gint           j;
 
-            case 3: /* calculate separate value values */
-              while (iter->length--)
-                {
-                  VALUE (1, data[0]) += 1.0;
-                  VALUE (2, data[1]) += 1.0;
-                  VALUE (3, data[2]) += 1.0;
+      for (j = 0; j < histogram->n_channels * histogram->n_bins; j++)
+        histogram->values[j] += block[j];
+    }
 
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
+  if (! histogram->incremental)
+    gimp_histogram_free_blocks (histogram);
+}
 
-                  VALUE (0, max) += 1.0;
+/**
+ * gimp_histogram_invalidate:
+ * @histogram: a %GimpHistogram
+ * @area:      the changed area, or %NULL if everything changed
+ *
+ * Tells an incremental @histogram that the pixels in @area, in the
+ * coordinates of the buffer it was calculated from, have changed and
+ * need to be binned again by the next gimp_histogram_calculate().
+ * The values of @histogram are not changed until then.
+ **/
+void
+gimp_histogram_invalidate (GimpHistogram       *histogram,
+                           const GeglRectangle *area)
+{
+  GeglRectangle rect;
+  gint          x1, y1, x2, y2;
+  gint          x, y;
 
-                  data += n_components;
-                }
-              break;
+  g_return_if_fail (histogram != NULL);
 
-            case 4: /* calculate separate value values */
-              while (iter->length--)
-                {
-                  const gdouble weight = data[3] / 255.0;
+  if (! histogram->blocks)
+    return;
 
-                  VALUE (1, data[0]) += weight;
-                  VALUE (2, data[1]) += weight;
-                  VALUE (3, data[2]) += weight;
-                  VALUE (4, data[3]) += 1.0;
-
-                  max = MAX (data[0], data[1]);
-                  max = MAX (data[2], max);
+  if (! area)
+    {
+      gimp_histogram_free_blocks (histogram);
+      return;
+    }
 
-                  VALUE (0, max) += weight;
+  if (! gegl_rectangle_intersect (&rect, &histogram->rect, area))
+    return;
 
-                  data += n_components;
-                }
-              break;
-            }
-        }
-    }
+  x1 = (rect.x - histogram->rect.x) / histogram->block_size;
+  y1 = (rect.y - histogram->rect.y) / histogram->block_size;
+  x2 = (rect.x + rect.width  - 1 - histogram->rect.x) / histogram->block_size;
+  y2 = (rect.y + rect.height - 1 - histogram->rect.y) / histogram->block_size;
 
-#undef VALUE
+  for (y = y1; y <= y2; y++)
+    for (x = x1; x <= x2; x++)
+      histogram->dirty[y * histogram->n_blocks_x + x] = TRUE;
 }
 
 void
@@ -295,6 +356,8 @@ gimp_histogram_clear_values (GimpHistogram *histogram)
 {
   g_return_if_fail (histogram != NULL);
 
+  gimp_histogram_free_blocks (histogram);
+
   if (histogram->values)
     {
       g_free (histogram->values);
@@ -305,7 +368,7 @@ gimp_histogram_clear_values (GimpHistogram *histogram)
 }
 
 
-#define HISTOGRAM_VALUE(c,i) (histogram->values[(c) * 256 + (i)])
+#define HISTOGRAM_VALUE(c,i) (histogram->values[(c) * histogram->n_bins + (i)])
 
 
 gdouble
@@ -326,14 +389,14 @@ gimp_histogram_get_maximum (GimpHistogram        *histogram,
     return 0.0;
 
   if (channel == GIMP_HISTOGRAM_RGB)
-    for (x = 0; x < 256; x++)
+    for (x = 0; x < histogram->n_bins; x++)
       {
         max = MAX (max, HISTOGRAM_VALUE (GIMP_HISTOGRAM_RED,   x));
         max = MAX (max, HISTOGRAM_VALUE (GIMP_HISTOGRAM_GREEN, x));
         max = MAX (max, HISTOGRAM_VALUE (GIMP_HISTOGRAM_BLUE,  x));
       }
   else
-    for (x = 0; x < 256; x++)
+    for (x = 0; x < histogram->n_bins; x++)
       {
         max = MAX (max, HISTOGRAM_VALUE (channel, x));
       }
@@ -353,7 +416,7 @@ gimp_histogram_get_value (GimpHistogram        *histogram,
     channel = 1;
 
   if (! histogram->values ||
-      bin < 0 || bin >= 256 ||
+      bin < 0 || bin >= histogram->n_bins ||
       (channel == GIMP_HISTOGRAM_RGB && histogram->n_channels < 4) ||
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0.0;
@@ -393,6 +456,25 @@ gimp_histogram_n_channels (GimpHistogram *histogram)
   return histogram->n_channels - 1;
 }
 
+/**
+ * gimp_histogram_n_bins:
+ * @histogram: a %GimpHistogram
+ *
+ * Returns the number of bins per channel, 256 unless @histogram was
+ * created with high precision and calculated from a buffer of more
+ * than 8 bits per channel.  Bin @i of @n_bins covers the values
+ * around @i / (@n_bins - 1).
+ *
+ * Return value: the number of bins
+ **/
+gint
+gimp_histogram_n_bins (GimpHistogram *histogram)
+{
+  g_return_val_if_fail (histogram != NULL, 256);
+
+  return histogram->n_bins;
+}
+
 gdouble
 gimp_histogram_get_count (GimpHistogram        *histogram,
                           GimpHistogramChannel  channel,
@@ -421,8 +503,8 @@ gimp_histogram_get_count (GimpHistogram        *histogram,
       channel >= histogram->n_channels)
     return 0.0;
 
-  start = CLAMP (start, 0, 255);
-  end   = CLAMP (end, 0, 255);
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end   = CLAMP (end, 0, histogram->n_bins - 1);
 
   for (i = start; i <= end; i++)
     count += HISTOGRAM_VALUE (channel, i);
@@ -452,8 +534,8 @@ gimp_histogram_get_mean (GimpHistogram        *histogram,
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0.0;
 
-  start = CLAMP (start, 0, 255);
-  end = CLAMP (end, 0, 255);
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end = CLAMP (end, 0, histogram->n_bins - 1);
 
   if (channel == GIMP_HISTOGRAM_RGB)
     {
@@ -498,8 +580,8 @@ gimp_histogram_get_median (GimpHistogram         *histogram,
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0;
 
-  start = CLAMP (start, 0, 255);
-  end = CLAMP (end, 0, 255);
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end = CLAMP (end, 0, histogram->n_bins - 1);
 
   count = gimp_histogram_get_count (histogram, channel, start, end);
 
@@ -546,7 +628,7 @@ gimp_histogram_get_threshold (GimpHistogram        *histogram,
   gdouble  chist_max = 0.0;
   gdouble  cmom_max  = 0.0;
   gdouble  bvar_max  = 0.0;
-  gint     threshold = 127;
+  gint     threshold;
 
   g_return_val_if_fail (histogram != NULL, -1);
 
@@ -560,10 +642,11 @@ gimp_histogram_get_threshold (GimpHistogram        *histogram,
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0;
 
-  start = CLAMP (start, 0, 255);
-  end = CLAMP (end, 0, 255);
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end = CLAMP (end, 0, histogram->n_bins - 1);
 
-  maxval = end - start;
+  maxval    = end - start;
+  threshold = histogram->n_bins / 2 - 1;
 
   hist  = g_newa (gdouble, maxval + 1);
   chist = g_newa (gdouble, maxval + 1);
@@ -643,6 +726,9 @@ gimp_histogram_get_std_dev (GimpHistogram        *histogram,
       (channel != GIMP_HISTOGRAM_RGB && channel >= histogram->n_channels))
     return 0.0;
 
+  start = CLAMP (start, 0, histogram->n_bins - 1);
+  end   = CLAMP (end,   0, histogram->n_bins - 1);
+
   mean  = gimp_histogram_get_mean  (histogram, channel, start, end);
   count = gimp_histogram_get_count (histogram, channel, start, end);
 
@@ -675,19 +761,364 @@ gimp_histogram_get_std_dev (GimpHistogram        *histogram,
 
 static void
 gimp_histogram_alloc_values (GimpHistogram *histogram,
-                             gint           bytes)
+                             gint           bytes,
+                             gint           n_bins)
 {
-  if (bytes + 1 != histogram->n_channels)
+  if (bytes + 1 != histogram->n_channels || n_bins != histogram->n_bins)
     {
       gimp_histogram_clear_values (histogram);
 
       histogram->n_channels = bytes + 1;
+      histogram->n_bins     = n_bins;
 
-      histogram->values = g_new0 (gdouble, histogram->n_channels * 256);
+      histogram->values = g_new0 (gdouble, histogram->n_channels * n_bins);
     }
   else
     {
       memset (histogram->values,
-              0, histogram->n_channels * 256 * sizeof (gdouble));
+              0, histogram->n_channels * n_bins * sizeof (gdouble));
+    }
+}
+
+static void
+gimp_histogram_free_blocks (GimpHistogram *histogram)
+{
+  if (histogram->blocks)
+    {
+      gint n_blocks = histogram->n_blocks_x * histogram->n_blocks_y;
+      gint i;
+
+      for (i = 0; i < n_blocks; i++)
+        g_free (histogram->blocks[i]);
+
+      g_free (histogram->blocks);
+      g_free (histogram->dirty);
+
+      histogram->blocks = NULL;
+      histogram->dirty  = NULL;
+    }
+
+  if (histogram->buffer)
+    {
+      g_object_remove_weak_pointer (G_OBJECT (histogram->buffer),
+                                    (gpointer) &histogram->buffer);
+      histogram->buffer = NULL;
+    }
+}
+
+static void
+gimp_histogram_alloc_blocks (GimpHistogram       *histogram,
+                             const GeglRectangle *rect)
+{
+  gint n_blocks;
+  gint i;
+
+  histogram->rect       = *rect;
+  histogram->block_size = MIN_BLOCK_SIZE;
+
+  /*  keep the number of blocks, and so their memory, bounded  */
+  while (TRUE)
+    {
+      histogram->n_blocks_x = MAX (1, (rect->width  + histogram->block_size - 1) /
+                                      histogram->block_size);
+      histogram->n_blocks_y = MAX (1, (rect->height + histogram->block_size - 1) /
+                                      histogram->block_size);
+
+      if (histogram->n_blocks_x * histogram->n_blocks_y <= MAX_BLOCKS)
+        break;
+
+      histogram->block_size *= 2;
+    }
+
+  n_blocks = histogram->n_blocks_x * histogram->n_blocks_y;
+
+  histogram->blocks = g_new (gdouble *, n_blocks);
+  histogram->dirty  = g_new (gboolean, n_blocks);
+
+  for (i = 0; i < n_blocks; i++)
+    {
+      histogram->blocks[i] = g_new0 (gdouble,
+                                     histogram->n_channels * histogram->n_bins);
+      histogram->dirty[i]  = TRUE;
     }
 }
+
+static void
+gimp_histogram_calculate_block (gint           job,
+                                HistogramTask *task)
+{
+  GimpHistogram      *histogram = task->histogram;
+  gint                block     = task->jobs[job];
+  gdouble            *values    = histogram->blocks[block];
+  GeglRectangle       rect;
+  GeglBufferIterator *iter;
+
+  rect.x      = (histogram->rect.x +
+                 (block % histogram->n_blocks_x) * histogram->block_size);
+  rect.y      = (histogram->rect.y +
+                 (block / histogram->n_blocks_x) * histogram->block_size);
+  rect.width  = MIN (histogram->block_size,
+                     histogram->rect.x + histogram->rect.width  - rect.x);
+  rect.height = MIN (histogram->block_size,
+                     histogram->rect.y + histogram->rect.height - rect.y);
+
+  memset (values, 0,
+          histogram->n_channels * histogram->n_bins * sizeof (gdouble));
+
+  histogram->dirty[block] = FALSE;
+
+  if (rect.width < 1 || rect.height < 1)
+    return;
+
+  iter = gegl_buffer_iterator_new (task->buffer, &rect, 0, histogram->format,
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  if (task->mask)
+    gegl_buffer_iterator_add (iter, task->mask,
+                              GEGL_RECTANGLE (rect.x + histogram->mask_offset_x,
+                                              rect.y + histogram->mask_offset_y,
+                                              rect.width, rect.height),
+                              0, babl_format ("Y float"),
+                              GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  if (histogram->n_bins == 256)
+    gimp_histogram_calculate_u8 (histogram, values, iter, task->mask != NULL);
+  else
+    gimp_histogram_calculate_float (histogram, values, iter, task->mask != NULL);
+}
+
+static void
+gimp_histogram_calculate_u8 (GimpHistogram      *histogram,
+                             gdouble            *values,
+                             GeglBufferIterator *iter,
+                             gboolean            has_mask)
+{
+  const gint n_components = histogram->n_channels - 1;
+
+#define VALUE(c,i) (values[(c) * 256 + (i)])
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const guchar *data = iter->data[0];
+      gint          max;
+
+      if (has_mask)
+        {
+          const gfloat *mask_data = iter->data[1];
+
+          switch (n_components)
+            {
+            case 1:
+              while (iter->length--)
+                {
+                  const gdouble masked = *mask_data;
+
+                  VALUE (0, data[0]) += masked;
+
+                  data += n_components;
+                  mask_data += 1;
+                }
+              break;
+
+            case 2:
+              while (iter->length--)
+                {
+                  const gdouble masked = *mask_data;
+                  const gdouble weight = data[1] / 255.0;
+
+                  VALUE (0, data[0]) += weight * masked;
+                  VALUE (1, data[1]) += masked;
+
+                  data += n_components;
+                  mask_data += 1;
+                }
+              break;
+
+            case 3: /* calculate separate value values */
+              while (iter->length--)
+                {
+                  const gdouble masked = *mask_data;
+
+                  VALUE (1, data[0]) += masked;
+                  VALUE (2, data[1]) += masked;
+                  VALUE (3, data[2]) += masked;
+
+                  max = MAX (data[0], data[1]);
+                  max = MAX (data[2], max);
+
+                  VALUE (0, max) += masked;
+
+                  data += n_components;
+                  mask_data += 1;
+                }
+              break;
+
+            case 4: /* calculate separate value values */
+              while (iter->length--)
+                {
+                  const gdouble masked = *mask_data;
+                  const gdouble weight = data[3] / 255.0;
+
+                  VALUE (1, data[0]) += weight * masked;
+                  VALUE (2, data[1]) += weight * masked;
+                  VALUE (3, data[2]) += weight * masked;
+                  VALUE (4, data[3]) += masked;
+
+                  max = MAX (data[0], data[1]);
+                  max = MAX (data[2], max);
+
+                  VALUE (0, max) += weight * masked;
+
+                  data += n_components;
+                  mask_data += 1;
+                }
+              break;
+            }
+        }
+      else /* no mask */
+        {
+          switch (n_components)
+            {
+            case 1:
+              while (iter->length--)
+                {
+                  VALUE (0, data[0]) += 1.0;
+
+                  data += n_components;
+                }
+              break;
+
+            case 2:
+              while (iter->length--)
+                {
+                  const gdouble weight = data[1] / 255.0;
+
+                  VALUE (0, data[0]) += weight;
+                  VALUE (1, data[1]) += 1.0;
+
+                  data += n_components;
+                }
+              break;
+
+            case 3: /* calculate separate value values */
+              while (iter->length--)
+                {
+                  VALUE (1, data[0]) += 1.0;
+                  VALUE (2, data[1]) += 1.0;
+                  VALUE (3, data[2]) += 1.0;
+
+                  max = MAX (data[0], data[1]);
+                  max = MAX (data[2], max);
+
+                  VALUE (0, max) += 1.0;
+
+                  data += n_components;
+                }
+              break;
+
+            case 4: /* calculate separate value values */
+              while (iter->length--)
+                {
+                  const gdouble weight = data[3] / 255.0;
+
+                  VALUE (1, data[0]) += weight;
+                  VALUE (2, data[1]) += weight;
+                  VALUE (3, data[2]) += weight;
+                  VALUE (4, data[3]) += 1.0;
+
+                  max = MAX (data[0], data[1]);
+                  max = MAX (data[2], max);
+
+                  VALUE (0, max) += weight;
+
+                  data += n_components;
+                }
+              break;
+            }
+        }
+    }
+
+#undef VALUE
+}
+
+static inline gint
+gimp_histogram_float_bin (gfloat value,
+                          gint   n_bins)
+{
+  gfloat bin = value * (n_bins - 1) + 0.5f;
+
+  /*  written so that NaN ends up in bin 0  */
+  if (bin > 0.0f)
+    return bin < n_bins ? (gint) bin : n_bins - 1;
+
+  return 0;
+}
+
+static void
+gimp_histogram_calculate_float (GimpHistogram      *histogram,
+                                gdouble            *values,
+                                GeglBufferIterator *iter,
+                                gboolean            has_mask)
+{
+  const gint n_components = histogram->n_channels - 1;
+  const gint n_bins       = histogram->n_bins;
+
+#define VALUE(c,v) (values[(c) * n_bins + gimp_histogram_float_bin ((v), n_bins)])
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat *data      = iter->data[0];
+      const gfloat *mask_data = has_mask ? iter->data[1] : NULL;
+      gint          length    = iter->length;
+
+      while (length--)
+        {
+          const gdouble masked = mask_data ? *mask_data++ : 1.0;
+          gdouble       weight;
+          gfloat        max;
+
+          switch (n_components)
+            {
+            case 1:
+              VALUE (0, data[0]) += masked;
+              break;
+
+            case 2:
+              weight = data[1];
+
+              VALUE (0, data[0]) += weight * masked;
+              VALUE (1, data[1]) += masked;
+              break;
+
+            case 3: /* calculate separate value values */
+              VALUE (1, data[0]) += masked;
+              VALUE (2, data[1]) += masked;
+              VALUE (3, data[2]) += masked;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += masked;
+              break;
+
+            case 4: /* calculate separate value values */
+              weight = data[3];
+
+              VALUE (1, data[0]) += weight * masked;
+              VALUE (2, data[1]) += weight * masked;
+              VALUE (3, data[2]) += weight * masked;
+              VALUE (4, data[3]) += masked;
+
+              max = MAX (data[0], data[1]);
+              max = MAX (data[2], max);
+
+              VALUE (0, max) += weight * masked;
+              break;
+            }
+
+          data += n_components;
+        }
+    }
+
+#undef VALUE
+}
@@ -22,6 +22,8 @@
 
 
 GimpHistogram * gimp_histogram_new           (void);
+GimpHistogram * gimp_histogram_new_full      (gboolean              high_precision,
+                                              gboolean              incremental);
 
 GimpHistogram * gimp_histogram_ref           (GimpHistogram        *histogram);
 void            gimp_histogram_unref         (GimpHistogram        *histogram);
@@ -29,10 +31,13 @@ void            gimp_histogram_unref         (GimpHistogram        *histogram);
 GimpHistogram * gimp_histogram_duplicate     (GimpHistogram        *histogram);
 
 void            gimp_histogram_calculate     (GimpHistogram        *histogram,
+                                              Gimp                 *gimp,
                                               GeglBuffer           *buffer,
                                               const GeglRectangle  *buffer_rect,
                                               GeglBuffer           *mask,
                                               const GeglRectangle  *mask_rect);
+void            gimp_histogram_invalidate    (GimpHistogram        *histogram,
+                                              const GeglRectangle  *area);
 
 void            gimp_histogram_clear_values  (GimpHistogram        *histogram);
 
@@ -65,6 +70,7 @@ gdouble         gimp_histogram_get_channel   (GimpHistogram        *histogram,
                                               GimpHistogramChannel  channel,
                                               gint                  bin);
 gint            gimp_histogram_n_channels    (GimpHistogram        *histogram);
+gint            gimp_histogram_n_bins        (GimpHistogram        *histogram);
 
 
 #endif /* __GIMP_HISTOGRAM_H__ */
@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <cairo.h>
 #include <gegl.h>
@@ -30,53 +31,104 @@
 
 #include "gegl/gimp-babl.h"
 
+#include "gimp-parallel.h"
 #include "gimpdrawable.h"
 #include "gimpimage.h"
 #include "gimpimage-contiguous-region.h"
 #include "gimppickable.h"
 
 
+/*  the smallest area worth its own job in select by color  */
+#define BY_COLOR_BAND_AREA (256 * 256)
+
+
+typedef struct
+{
+  gint y;
+  gint start;
+  gint end;
+} ContiguousSegment;
+
+/*  The seed fill works on bands of full rows one tile high, each with
+ *  its own stack of segments still to be looked at.  Only the band
+ *  being filled is in memory: it is fetched with one gegl_buffer_get()
+ *  and its differences computed in one go.  Once its stack is empty,
+ *  the band is written to the mask and let go of.  If the fill comes
+ *  back to it later, the filled pixels are read back from the mask.
+ */
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  GeglBuffer          *mask_buffer;
+  const Babl          *format;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gboolean             select_transparent;
+  GimpSelectCriterion  select_criterion;
+  gboolean             antialias;
+  gfloat               threshold;
+  const gfloat        *col;
+
+  gint                 width;
+  gint                 height;
+  gint                 band_height;
+  gint                 n_bands;
+  GArray             **segments;  /*  the stack of each band          */
+  gboolean            *written;   /*  whether a band is in the mask   */
+
+  gint                 band;      /*  the band in memory, or -1       */
+  gfloat              *diff;
+  guchar              *filled;
+  gfloat              *src_data;
+} ContiguousRegion;
+
+typedef struct
+{
+  GeglBuffer          *src_buffer;
+  GeglBuffer          *mask_buffer;
+  const Babl          *format;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gboolean             select_transparent;
+  GimpSelectCriterion  select_criterion;
+  gboolean             antialias;
+  gfloat               threshold;
+  const gfloat        *col;
+
+  GeglRectangle        extent;
+  gint                 tile_height;
+  gint                 n_bands;
+} ContiguousColorTask;
+
+
 /*  local function prototypes  */
 
 static const Babl * choose_format         (GeglBuffer          *buffer,
                                            GimpSelectCriterion  select_criterion,
                                            gint                *n_components,
                                            gboolean            *has_alpha);
-static gfloat   pixel_difference          (const gfloat        *col1,
-                                           const gfloat        *col2,
+static void     pixel_difference          (const gfloat        *col,
+                                           const gfloat        *src,
+                                           gfloat              *dest,
+                                           gint                 n_pixels,
                                            gboolean             antialias,
                                            gfloat               threshold,
                                            gint                 n_components,
                                            gboolean             has_alpha,
                                            gboolean             select_transparent,
                                            GimpSelectCriterion  select_criterion);
-static gboolean find_contiguous_segment   (const gfloat        *col,
-                                           GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *src_format,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gint                 width,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 initial_x,
-                                           gint                 initial_y,
-                                           gint                *start,
-                                           gint                *end);
-static void find_contiguous_region_helper (GeglBuffer          *src_buffer,
-                                           GeglBuffer          *mask_buffer,
-                                           const Babl          *format,
-                                           gint                 n_components,
-                                           gboolean             has_alpha,
-                                           gboolean             select_transparent,
-                                           GimpSelectCriterion  select_criterion,
-                                           gboolean             antialias,
-                                           gfloat               threshold,
-                                           gint                 x,
+static void     load_region_band          (ContiguousRegion    *region,
+                                           gint                 band);
+static void     store_region_band         (ContiguousRegion    *region);
+static void     push_region_segment       (ContiguousRegion    *region,
                                            gint                 y,
-                                           const gfloat        *col);
+                                           gint                 start,
+                                           gint                 end);
+static void find_contiguous_region_helper (ContiguousRegion    *region,
+                                           gint                 x,
+                                           gint                 y);
+static void     find_color_region_band    (gint                 band,
+                                           ContiguousColorTask *task);
 
 
 /*  public functions  */
@@ -92,13 +144,15 @@ gimp_image_contiguous_region_by_seed (GimpImage           *image,
                                       gint                 x,
                                       gint                 y)
 {
-  GimpPickable *pickable;
-  GeglBuffer   *src_buffer;
-  GeglBuffer   *mask_buffer;
-  const Babl   *format;
-  gint          n_components;
-  gboolean      has_alpha;
-  gfloat        start_col[MAX_CHANNELS];
+  ContiguousRegion  region;
+  GimpPickable     *pickable;
+  GeglBuffer       *src_buffer;
+  GeglBuffer       *mask_buffer;
+  const Babl       *format;
+  gint              n_components;
+  gboolean          has_alpha;
+  gfloat            start_col[MAX_CHANNELS];
+  gint              band;
 
   g_return_val_if_fail (GIMP_IS_IMAGE (image), NULL);
   g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
@@ -137,11 +191,49 @@ gimp_image_contiguous_region_by_seed (GimpImage           *image,
   mask_buffer = gegl_buffer_new (gegl_buffer_get_extent (src_buffer),
                                  babl_format ("Y float"));
 
-  find_contiguous_region_helper (src_buffer, mask_buffer,
-                                 format, n_components, has_alpha,
-                                 select_transparent, select_criterion,
-                                 antialias, threshold,
-                                 x, y, start_col);
+  region.src_buffer         = src_buffer;
+  region.mask_buffer        = mask_buffer;
+  region.format             = format;
+  region.n_components       = n_components;
+  region.has_alpha          = has_alpha;
+  region.select_transparent = select_transparent;
+  region.select_criterion   = select_criterion;
+  region.antialias          = antialias;
+  region.threshold          = threshold;
+  region.col                = start_col;
+  region.width              = gegl_buffer_get_width (src_buffer);
+  region.height             = gegl_buffer_get_height (src_buffer);
+
+  g_object_get (src_buffer, "tile-height", &region.band_height, NULL);
+
+  region.n_bands  = (region.height + region.band_height - 1) /
+                    region.band_height;
+  region.segments = g_new0 (GArray *, region.n_bands);
+  region.written  = g_new0 (gboolean, region.n_bands);
+  region.band     = -1;
+  region.diff     = g_new (gfloat, (gsize) region.width * region.band_height);
+  region.filled   = g_new (guchar, (gsize) region.width * region.band_height);
+  region.src_data = g_new (gfloat, (gsize) region.width * region.band_height *
+                                   region.n_components);
+
+  /*  the bands the fill doesn't reach stay empty in the mask  */
+  if (x >= 0 && x < region.width &&
+      y >= 0 && y < region.height)
+    {
+      find_contiguous_region_helper (&region, x, y);
+    }
+
+  for (band = 0; band < region.n_bands; band++)
+    {
+      if (region.segments[band])
+        g_array_free (region.segments[band], TRUE);
+    }
+
+  g_free (region.segments);
+  g_free (region.written);
+  g_free (region.diff);
+  g_free (region.filled);
+  g_free (region.src_data);
 
   return mask_buffer;
 }
@@ -162,14 +254,14 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
    *  fuzzy_select.  Modify the image's mask to reflect the
    *  additional selection
    */
-  GeglBufferIterator *iter;
-  GimpPickable       *pickable;
-  GeglBuffer         *src_buffer;
-  GeglBuffer         *mask_buffer;
-  const Babl         *format;
-  gint                n_components;
-  gboolean            has_alpha;
-  gfloat              start_col[MAX_CHANNELS];
+  ContiguousColorTask  task;
+  GimpPickable        *pickable;
+  GeglBuffer          *src_buffer;
+  GeglBuffer          *mask_buffer;
+  const Babl          *format;
+  gint                 n_components;
+  gboolean             has_alpha;
+  gfloat               start_col[MAX_CHANNELS];
 
   g_return_val_if_fail (GIMP_IS_IMAGE (image), NULL);
   g_return_val_if_fail (GIMP_IS_DRAWABLE (drawable), NULL);
@@ -204,36 +296,52 @@ gimp_image_contiguous_region_by_color (GimpImage            *image,
       select_transparent = FALSE;
     }
 
+  /*  the projection renders its tiles when they are first read,
+   *  which must not happen in the worker threads
+   */
+  if (sample_merged)
+    {
+      GeglBufferIterator *iter;
+
+      iter = gegl_buffer_iterator_new (src_buffer, NULL, 0, NULL,
+                                       GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+      while (gegl_buffer_iterator_next (iter));
+    }
+
   mask_buffer = gegl_buffer_new (gegl_buffer_get_extent (src_buffer),
                                  babl_format ("Y float"));
 
-  iter = gegl_buffer_iterator_new (src_buffer,
-                                   NULL, 0, format,
-                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+  task.src_buffer         = src_buffer;
+  task.mask_buffer        = mask_buffer;
+  task.format             = format;
+  task.n_components       = n_components;
+  task.has_alpha          = has_alpha;
+  task.select_transparent = select_transparent;
+  task.select_criterion   = select_criterion;
+  task.antialias          = antialias;
+  task.threshold          = threshold;
+  task.col                = start_col;
+  task.extent             = *gegl_buffer_get_extent (src_buffer);
+
+  /*  align the bands to the mask's tiles, so no two jobs write
+   *  to the same tile
+   */
+  g_object_get (mask_buffer, "tile-height", &task.tile_height, NULL);
 
-  gegl_buffer_iterator_add (iter, mask_buffer,
-                            NULL, 0, babl_format ("Y float"),
-                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+  task.n_bands = CLAMP (task.extent.width * task.extent.height /
+                        BY_COLOR_BAND_AREA,
+                        1, gimp_parallel_get_n_threads (image->gimp));
 
-  while (gegl_buffer_iterator_next (iter))
+  if (task.n_bands > 1)
     {
-      const gfloat *src  = iter->data[0];
-      gfloat       *dest = iter->data[1];
-
-      while (iter->length--)
-        {
-          /*  Find how closely the colors match  */
-          *dest = pixel_difference (start_col, src,
-                                    antialias,
-                                    threshold,
-                                    n_components,
-                                    has_alpha,
-                                    select_transparent,
-                                    select_criterion);
-
-          src  += n_components;
-          dest += 1;
-        }
+      gimp_parallel_run (image->gimp, task.n_bands,
+                         (GimpParallelFunc) find_color_region_band,
+                         &task);
+    }
+  else
+    {
+      find_color_region_band (0, &task);
     }
 
   return mask_buffer;
@@ -285,9 +393,15 @@ choose_format (GeglBuffer          *buffer,
   return format;
 }
 
-static gfloat
-pixel_difference (const gfloat        *col1,
-                  const gfloat        *col2,
+/*  Computes the mask values of @n_pixels pixels of @src against @col.
+ *  The criterion is picked once per call, so each of the loops below
+ *  is simple enough for the compiler to vectorize.
+ */
+static void
+pixel_difference (const gfloat        *col,
+                  const gfloat        *src,
+                  gfloat              *dest,
+                  gint                 n_pixels,
                   gboolean             antialias,
                   gfloat               threshold,
                   gint                 n_components,
@@ -295,238 +409,335 @@ pixel_difference (const gfloat        *col1,
                   gboolean             select_transparent,
                   GimpSelectCriterion  select_criterion)
 {
-  gfloat max = 0.0;
-
-  /*  if there is an alpha channel, never select transparent regions  */
-  if (! select_transparent && has_alpha && col2[n_components - 1] == 0.0)
-    return 0.0;
+  const gint alpha = n_components - 1;
+  gint       channel;
+  gint       i;
 
   if (select_transparent && has_alpha)
     {
-      max = fabs (col1[n_components - 1] - col2[n_components - 1]);
+      for (i = 0; i < n_pixels; i++)
+        dest[i] = fabsf (col[alpha] - src[i * n_components + alpha]);
     }
   else
     {
-      gfloat diff;
-      gint   b;
-
-      if (has_alpha)
-        n_components--;
-
       switch (select_criterion)
         {
         case GIMP_SELECT_CRITERION_COMPOSITE:
-          for (b = 0; b < n_components; b++)
-            {
-              diff = fabs (col1[b] - col2[b]);
-              if (diff > max)
-                max = diff;
-            }
-          break;
+          {
+            gint n_colors = has_alpha ? n_components - 1 : n_components;
 
-        case GIMP_SELECT_CRITERION_R:
-          max = fabs (col1[0] - col2[0]);
-          break;
+            for (i = 0; i < n_pixels; i++)
+              {
+                const gfloat *s   = src + i * n_components;
+                gfloat        max = 0.0;
+                gint          b;
 
-        case GIMP_SELECT_CRITERION_G:
-          max = fabs (col1[1] - col2[1]);
-          break;
+                for (b = 0; b < n_colors; b++)
+                  {
+                    gfloat diff = fabsf (col[b] - s[b]);
 
-        case GIMP_SELECT_CRITERION_B:
-          max = fabs (col1[2] - col2[2]);
-          break;
+                    if (diff > max)
+                      max = diff;
+                  }
 
-        case GIMP_SELECT_CRITERION_H:
-          {
-            /* wrap around candidates for the actual distance */
-            gfloat dist1 = fabs (col1[0] - col2[0]);
-            gfloat dist2 = fabs (col1[0] - 1.0 - col2[0]);
-            gfloat dist3 = fabs (col1[0] - col2[0] + 1.0);
-
-            max = MIN (dist1, dist2);
-            if (max > dist3)
-              max = dist3;
+                dest[i] = max;
+              }
           }
           break;
 
-        case GIMP_SELECT_CRITERION_S:
-          max = fabs (col1[1] - col2[1]);
+        case GIMP_SELECT_CRITERION_H:
+          for (i = 0; i < n_pixels; i++)
+            {
+              /* wrap around candidates for the actual distance */
+              gfloat diff  = col[0] - src[i * n_components];
+              gfloat dist1 = fabsf (diff);
+              gfloat dist2 = fabsf (diff - 1.0);
+              gfloat dist3 = fabsf (diff + 1.0);
+              gfloat max   = MIN (dist1, dist2);
+
+              dest[i] = MIN (max, dist3);
+            }
           break;
 
+        case GIMP_SELECT_CRITERION_R:
+        case GIMP_SELECT_CRITERION_G:
+        case GIMP_SELECT_CRITERION_B:
+        case GIMP_SELECT_CRITERION_S:
         case GIMP_SELECT_CRITERION_V:
-          max = fabs (col1[2] - col2[2]);
+          if (select_criterion == GIMP_SELECT_CRITERION_R)
+            channel = 0;
+          else if (select_criterion == GIMP_SELECT_CRITERION_G ||
+                   select_criterion == GIMP_SELECT_CRITERION_S)
+            channel = 1;
+          else
+            channel = 2;
+
+          for (i = 0; i < n_pixels; i++)
+            dest[i] = fabsf (col[channel] - src[i * n_components + channel]);
           break;
         }
     }
 
   if (antialias && threshold > 0.0)
     {
-      gfloat aa = 1.5 - (max / threshold);
+      /*  1.0 up to half the threshold, falling to 0.0 at 1.5 times it  */
+      for (i = 0; i < n_pixels; i++)
+        {
+          gfloat aa = 2.0 * (1.5 - dest[i] / threshold);
 
-      if (aa <= 0.0)
-        return 0.0;
-      else if (aa < 0.5)
-        return aa * 2.0;
-      else
-        return 1.0;
+          dest[i] = CLAMP (aa, 0.0, 1.0);
+        }
     }
   else
     {
-      if (max > threshold)
-        return 0.0;
-      else
-        return 1.0;
+      for (i = 0; i < n_pixels; i++)
+        dest[i] = (dest[i] > threshold) ? 0.0 : 1.0;
+    }
+
+  /*  if there is an alpha channel, never select transparent regions  */
+  if (! select_transparent && has_alpha)
+    {
+      for (i = 0; i < n_pixels; i++)
+        {
+          if (src[i * n_components + alpha] == 0.0)
+            dest[i] = 0.0;
+        }
     }
 }
 
-static gboolean
-find_contiguous_segment (const gfloat        *col,
-                         GeglBuffer          *src_buffer,
-                         GeglBuffer          *mask_buffer,
-                         const Babl          *format,
-                         gint                 n_components,
-                         gboolean             has_alpha,
-                         gint                 width,
-                         gboolean             select_transparent,
-                         GimpSelectCriterion  select_criterion,
-                         gboolean             antialias,
-                         gfloat               threshold,
-                         gint                 initial_x,
-                         gint                 initial_y,
-                         gint                *start,
-                         gint                *end)
+/*  fetches @band and computes its differences, and if the band was
+ *  filled before, reads back which of its pixels are filled
+ */
+static void
+load_region_band (ContiguousRegion *region,
+                  gint              band)
 {
-  gfloat s[MAX_CHANNELS];
-  gfloat mask_row[width];
-  gfloat diff;
-
-  gegl_buffer_sample (src_buffer, initial_x, initial_y, NULL, s, format,
-                      GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  gint y1   = band * region->band_height;
+  gint rows = MIN (region->band_height, region->height - y1);
+
+  gegl_buffer_get (region->src_buffer,
+                   GEGL_RECTANGLE (0, y1, region->width, rows), 1.0,
+                   region->format, region->src_data,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  pixel_difference (region->col, region->src_data, region->diff,
+                    region->width * rows,
+                    region->antialias,
+                    region->threshold,
+                    region->n_components,
+                    region->has_alpha,
+                    region->select_transparent,
+                    region->select_criterion);
+
+  memset (region->filled, 0, (gsize) region->width * rows);
+
+  /*  only pixels with a difference are ever filled, so the mask
+   *  tells which ones are
+   */
+  if (region->written[band])
+    {
+      GeglBufferIterator *iter;
 
-  diff = pixel_difference (col, s, antialias, threshold,
-                           n_components, has_alpha, select_transparent,
-                           select_criterion);
+      iter = gegl_buffer_iterator_new (region->mask_buffer,
+                                       GEGL_RECTANGLE (0, y1,
+                                                       region->width, rows),
+                                       0, babl_format ("Y float"),
+                                       GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
 
-  /* check the starting pixel */
-  if (! diff)
-    return FALSE;
+      while (gegl_buffer_iterator_next (iter))
+        {
+          const GeglRectangle *roi  = &iter->roi[0];
+          const gfloat        *mask = iter->data[0];
+          gint                 row;
 
-  mask_row[initial_x] = diff;
+          for (row = 0; row < roi->height; row++)
+            {
+              guchar *filled = (region->filled +
+                                (roi->y + row - y1) * region->width + roi->x);
+              gint    i;
 
-  *start = initial_x - 1;
+              for (i = 0; i < roi->width; i++)
+                filled[i] = (*mask++ > 0.0);
+            }
+        }
+    }
 
-  while (*start >= 0 && diff)
-    {
-      gegl_buffer_sample (src_buffer, *start, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+  region->band = band;
+}
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+/*  writes the band in memory to the mask  */
+static void
+store_region_band (ContiguousRegion *region)
+{
+  GeglBufferIterator *iter;
+  gint                y1   = region->band * region->band_height;
+  gint                rows = MIN (region->band_height, region->height - y1);
 
-      mask_row[*start] = diff;
+  iter = gegl_buffer_iterator_new (region->mask_buffer,
+                                   GEGL_RECTANGLE (0, y1, region->width, rows),
+                                   0, babl_format ("Y float"),
+                                   GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
-      if (diff)
-        (*start)--;
-    }
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const GeglRectangle *roi  = &iter->roi[0];
+      gfloat              *mask = iter->data[0];
+      gint                 row;
 
-  diff = 1;
-  *end = initial_x + 1;
+      for (row = 0; row < roi->height; row++)
+        {
+          gint          offset = (roi->y + row - y1) * region->width + roi->x;
+          const gfloat *diff   = region->diff   + offset;
+          const guchar *filled = region->filled + offset;
+          gint          i;
 
-  while (*end < width && diff)
-    {
-      gegl_buffer_sample (src_buffer, *end, initial_y, NULL, s, format,
-                          GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
+          for (i = 0; i < roi->width; i++)
+            *mask++ = filled[i] ? diff[i] : 0.0;
+        }
+    }
 
-      diff = pixel_difference (col, s, antialias, threshold,
-                               n_components, has_alpha, select_transparent,
-                               select_criterion);
+  region->written[region->band] = TRUE;
+  region->band                  = -1;
+}
 
-      mask_row[*end] = diff;
+/*  a segment is a row and the pixels between start and end,
+ *  exclusive, that still need to be looked at
+ */
+static void
+push_region_segment (ContiguousRegion *region,
+                     gint              y,
+                     gint              start,
+                     gint              end)
+{
+  gint              band = y / region->band_height;
+  ContiguousSegment segment;
 
-      if (diff)
-        (*end)++;
-    }
+  if (! region->segments[band])
+    region->segments[band] = g_array_new (FALSE, FALSE,
+                                          sizeof (ContiguousSegment));
 
-  gegl_buffer_set (mask_buffer, GEGL_RECTANGLE (*start, initial_y,
-                                                *end - *start, 1),
-                   0, babl_format ("Y float"), &mask_row[*start],
-                   GEGL_AUTO_ROWSTRIDE);
+  segment.y     = y;
+  segment.start = start;
+  segment.end   = end;
 
-  return TRUE;
+  g_array_append_val (region->segments[band], segment);
 }
 
 static void
-find_contiguous_region_helper (GeglBuffer          *src_buffer,
-                               GeglBuffer          *mask_buffer,
-                               const Babl          *format,
-                               gint                 n_components,
-                               gboolean             has_alpha,
-                               gboolean             select_transparent,
-                               GimpSelectCriterion  select_criterion,
-                               gboolean             antialias,
-                               gfloat               threshold,
-                               gint                 x,
-                               gint                 y,
-                               const gfloat        *col)
+find_contiguous_region_helper (ContiguousRegion *region,
+                               gint              x,
+                               gint              y)
 {
-  gint    start, end;
-  gint    new_start, new_end;
-  GQueue *coord_stack;
+  gint band = y / region->band_height;
 
-  coord_stack = g_queue_new ();
+  push_region_segment (region, y, x - 1, x + 1);
 
-  /* To avoid excessive memory allocation (y, start, end) tuples are
-   * stored in interleaved format:
-   *
-   * [y1] [start1] [end1] [y2] [start2] [end2]
-   */
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (y));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x - 1));
-  g_queue_push_tail (coord_stack, GINT_TO_POINTER (x + 1));
-
-  do
+  while (band >= 0)
     {
-      y     = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      start = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
-      end   = GPOINTER_TO_INT (g_queue_pop_head (coord_stack));
+      GArray *stack = region->segments[band];
+      gint    y1    = band * region->band_height;
+      gint    next_band;
+      gint    d;
+
+      load_region_band (region, band);
 
-      for (x = start + 1; x < end; x++)
+      while (stack->len > 0)
         {
-          gfloat val;
-
-          gegl_buffer_sample (mask_buffer, x, y, NULL, &val,
-                              babl_format ("Y float"),
-                              GEGL_SAMPLER_NEAREST, GEGL_ABYSS_NONE);
-          if (val != 0.0)
-            continue;
-
-          if (! find_contiguous_segment (col, src_buffer, mask_buffer,
-                                         format,
-                                         n_components,
-                                         has_alpha,
-                                         gegl_buffer_get_width (src_buffer),
-                                         select_transparent, select_criterion,
-                                         antialias, threshold, x, y,
-                                         &new_start, &new_end))
-            continue;
-
-          if (y + 1 < gegl_buffer_get_height (src_buffer))
+          ContiguousSegment  segment;
+          const gfloat      *diff;
+          guchar            *filled;
+
+          segment = g_array_index (stack, ContiguousSegment, stack->len - 1);
+          g_array_set_size (stack, stack->len - 1);
+
+          diff   = region->diff   + (segment.y - y1) * region->width;
+          filled = region->filled + (segment.y - y1) * region->width;
+
+          for (x = segment.start + 1; x < segment.end; x++)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y + 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              gint start;
+              gint end;
+
+              if (filled[x] || ! diff[x])
+                continue;
+
+              /*  extend to the whole run of selected pixels on this row  */
+              start = x;
+              while (start > 0 && diff[start - 1])
+                start--;
+
+              end = x + 1;
+              while (end < region->width && diff[end])
+                end++;
+
+              memset (filled + start, 1, end - start);
+
+              if (segment.y + 1 < region->height)
+                push_region_segment (region, segment.y + 1, start - 1, end);
+
+              if (segment.y - 1 >= 0)
+                push_region_segment (region, segment.y - 1, start - 1, end);
+
+              x = end;
             }
+        }
+
+      store_region_band (region);
+
+      /*  continue with the nearest band that has work left  */
+      next_band = -1;
 
-          if (y - 1 >= 0)
+      for (d = 1; d < region->n_bands && next_band < 0; d++)
+        {
+          if (band - d >= 0 &&
+              region->segments[band - d] &&
+              region->segments[band - d]->len > 0)
+            {
+              next_band = band - d;
+            }
+          else if (band + d < region->n_bands &&
+                   region->segments[band + d] &&
+                   region->segments[band + d]->len > 0)
             {
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (y - 1));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_start));
-              g_queue_push_tail (coord_stack, GINT_TO_POINTER (new_end));
+              next_band = band + d;
             }
         }
+
+      band = next_band;
     }
-  while (! g_queue_is_empty (coord_stack));
+}
+
+static void
+find_color_region_band (gint                 band,
+                        ContiguousColorTask *task)
+{
+  GeglBufferIterator *iter;
+  GeglRectangle       rect;
 
-  g_queue_free (coord_stack);
+  gimp_parallel_split_rect (&task->extent, task->n_bands, band,
+                            task->tile_height, &rect);
+
+  if (rect.height == 0)
+    return;
+
+  iter = gegl_buffer_iterator_new (task->src_buffer,
+                                   &rect, 0, task->format,
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  gegl_buffer_iterator_add (iter, task->mask_buffer,
+                            &rect, 0, babl_format ("Y float"),
+                            GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      /*  Find how closely the colors match  */
+      pixel_difference (task->col, iter->data[0], iter->data[1],
+                        iter->length,
+                        task->antialias,
+                        task->threshold,
+                        task->n_components,
+                        task->has_alpha,
+                        task->select_transparent,
+                        task->select_criterion);
+    }
 }
@@ -144,6 +144,7 @@
 #include "gegl/gimp-gegl-utils.h"
 
 #include "gimp.h"
+#include "gimp-parallel.h"
 #include "gimpcontainer.h"
 #include "gimpdrawable.h"
 #include "gimperror.h"
@@ -466,12 +467,18 @@ struct _QuantizeObj
   int actual_number_of_colors;      /* Number of colors actually needed  */
   Color cmap[256];                  /* colormap created by quantization  */
   Color clin[256];                  /* .. converted back to linear space */
+  int   clin_red[256];              /* .. and again as separate arrays,  */
+  int   clin_green[256];            /*    for find_nearest_color_rgb()   */
+  int   clin_blue[256];
   gulong index_used_count[256];     /* how many times an index was used */
   CFHistogram histogram;            /* holds the histogram               */
+  gboolean    has_histogram;        /* histogram holds pass 1 counts     */
 
   gboolean want_alpha_dither;
   int      error_freedom;           /* 0=much bleed, 1=controlled bleed */
+  guchar (*dither_matrix)[DM_HEIGHT]; /* thresholds for positioned dither */
 
+  Gimp         *gimp;
   GimpProgress *progress;
   gint          nth_layer;
   gint          n_layers;
@@ -516,7 +523,8 @@ static void generate_histogram_rgb  (CFHistogram   histogram,
                                      gint          nth_layer,
                                      gint          n_layers);
 
-static QuantizeObj * initialize_median_cut (GimpImageBaseType      old_type,
+static QuantizeObj * initialize_median_cut (Gimp                  *gimp,
+                                            GimpImageBaseType      old_type,
                                             gint                   num_cols,
                                             GimpConvertDitherType  dither_type,
                                             GimpConvertPaletteType palette_type,
@@ -837,7 +845,8 @@ gimp_image_convert_type (GimpImage               *image,
           dither = GIMP_NO_DITHER;
         }
 
-      quantobj = initialize_median_cut (old_type, num_cols, dither,
+      quantobj = initialize_median_cut (image->gimp,
+                                        old_type, num_cols, dither,
                                         palette_type, alpha_dither,
                                         progress);
 
@@ -875,6 +884,8 @@ gimp_image_convert_type (GimpImage               *image,
                *  by the user.
                */
             }
+
+          quantobj->has_histogram = TRUE;
         }
 
       if (progress)
@@ -896,7 +907,8 @@ gimp_image_convert_type (GimpImage               *image,
            */
 
           quantobj->delete_func (quantobj);
-          quantobj = initialize_median_cut (old_type, num_cols,
+          quantobj = initialize_median_cut (image->gimp,
+                                            old_type, num_cols,
                                             GIMP_NODESTRUCT_DITHER,
                                             palette_type,
                                             alpha_dither,
@@ -1177,208 +1189,274 @@ generate_histogram_gray (CFHistogram  histogram,
 }
 
 
+/*  The histogram of a layer is built in horizontal bands, in
+ *  parallel.  The first band counts into the shared histogram, the
+ *  others into private ones which are added up afterwards.  While we
+ *  still hope to get away without quantizing, each band also collects
+ *  the distinct colors it sees, and these are merged into found_cols.
+ */
+
+#define HISTOGRAM_BAND_AREA (512 * 512)
+
+typedef struct
+{
+  CFHistogram histogram;
+  guchar      colors[MAXNUMCOLORS + 1][3];
+  gint        n_colors;
+  gboolean    overflow;
+} HistogramBand;
+
+typedef struct
+{
+  GeglBuffer    *buffer;
+  const Babl    *format;
+  GeglRectangle  extent;
+  gint           tile_height;
+  gint           offsetx;
+  gint           offsety;
+  gint           col_limit;
+  gboolean       alpha_dither;
+  gboolean       track_colors;
+  CFHistogram    histogram;
+  HistogramBand *bands;
+  gint           n_bands;
+} HistogramTask;
+
+
 static void
-generate_histogram_rgb (CFHistogram   histogram,
-                        GimpLayer    *layer,
-                        gint          col_limit,
-                        gboolean      alpha_dither,
-                        GimpProgress *progress,
-                        gint          nth_layer,
-                        gint          n_layers)
+generate_histogram_rgb_band (gint           band,
+                             HistogramTask *task)
 {
+  HistogramBand      *hb = &task->bands[band];
   GeglBufferIterator *iter;
-  const Babl         *format;
+  GeglRectangle       rect;
   GeglRectangle      *roi;
-  ColorFreq          *colfreq;
-  gint                nfc_iter;
-  gint                row, col, coledge;
-  gint                offsetx, offsety;
-  glong               layer_size;
-  glong               total_size = 0;
-  gint                count      = 0;
   gint                bpp;
   gboolean            has_alpha;
 
-  format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-
-  g_return_if_fail (format == babl_format ("R'G'B' u8") ||
-                    format == babl_format ("R'G'B'A u8"));
-
-  bpp       = babl_format_get_bytes_per_pixel (format);
-  has_alpha = babl_format_has_alpha (format);
+  gimp_parallel_split_rect (&task->extent, task->n_bands, band,
+                            task->tile_height, &rect);
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  if (rect.height == 0)
+    return;
 
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
+  if (band == 0)
+    hb->histogram = task->histogram;
+  else
+    hb->histogram = g_new0 (ColorFreq,
+                            HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS);
 
-  /*  g_printerr ("col_limit = %d, nfc = %d\n", col_limit, num_found_cols); */
+  bpp       = babl_format_get_bytes_per_pixel (task->format);
+  has_alpha = babl_format_has_alpha (task->format);
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, format,
+  iter = gegl_buffer_iterator_new (task->buffer, &rect, 0, task->format,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   roi = &iter->roi[0];
 
-  if (progress)
-    gimp_progress_set_value (progress, 0.0);
-
   while (gegl_buffer_iterator_next (iter))
     {
-      const guchar *data = iter->data[0];
+      const guchar *data    = iter->data[0];
+      gint          col     = roi->x + task->offsetx;
+      gint          coledge = col + roi->width;
+      gint          row     = roi->y + task->offsety;
 
-      total_size += iter->length;
-
-      /* g_printerr (" [%d,%d - %d,%d]", srcPR.x, src_roi->y, offsetx, offsety); */
-
-      if (needs_quantize)
+      while (iter->length--)
         {
-          if (alpha_dither)
+          gboolean transparent = FALSE;
+
+          /* if alpha-dithering, we need to be deterministic w.r.t. offsets */
+          if (has_alpha)
             {
-              /* if alpha-dithering,
-                 we need to be deterministic w.r.t. offsets */
+              if (task->alpha_dither)
+                transparent = (data[ALPHA] <
+                               DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK]);
+              else
+                transparent = (data[ALPHA] <= 127);
+            }
 
-              col = roi->x + offsetx;
-              coledge = col + roi->width;
-              row = roi->y + offsety;
+          if (! transparent)
+            {
+              ColorFreq *colfreq = HIST_RGB (hb->histogram,
+                                             data[RED],
+                                             data[GREEN],
+                                             data[BLUE]);
+              (*colfreq)++;
 
-              while (iter->length--)
+              if (task->track_colors && ! hb->overflow)
                 {
-                  gboolean transparent = FALSE;
-
-                  if (has_alpha &&
-                      data[ALPHA] <
-                      DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK])
-                    transparent = TRUE;
+                  gint i;
 
-                  if (! transparent)
+                  for (i = 0; i < hb->n_colors; i++)
                     {
-                      colfreq = HIST_RGB (histogram,
-                                          data[RED],
-                                          data[GREEN],
-                                          data[BLUE]);
-                      (*colfreq)++;
+                      if (data[RED]   == hb->colors[i][0] &&
+                          data[GREEN] == hb->colors[i][1] &&
+                          data[BLUE]  == hb->colors[i][2])
+                        break;
                     }
 
-                  col++;
-                  if (col == coledge)
+                  if (i == hb->n_colors)
                     {
-                      col = roi->x + offsetx;
-                      row++;
+                      if (hb->n_colors == task->col_limit)
+                        {
+                          /* There are more colours in this band than
+                           * were allowed, so there are in the image too.
+                           */
+                          hb->overflow = TRUE;
+                        }
+                      else
+                        {
+                          hb->colors[i][0] = data[RED];
+                          hb->colors[i][1] = data[GREEN];
+                          hb->colors[i][2] = data[BLUE];
+                          hb->n_colors++;
+                        }
                     }
-
-                  data += bpp;
                 }
             }
-          else
-            {
-              while (iter->length--)
-                {
-                  if ((has_alpha && ((data[ALPHA] > 127)))
-                      || (!has_alpha))
-                    {
-                      colfreq = HIST_RGB (histogram,
-                                          data[RED],
-                                          data[GREEN],
-                                          data[BLUE]);
-                      (*colfreq)++;
-                    }
 
-                  data += bpp;
-                }
+          col++;
+          if (col == coledge)
+            {
+              col = roi->x + task->offsetx;
+              row++;
             }
+
+          data += bpp;
         }
-      else
-        {
-          /* if alpha-dithering, we need to be deterministic w.r.t. offsets */
-          col = roi->x + offsetx;
-          coledge = col + roi->width;
-          row = roi->y + offsety;
+    }
+}
 
-          while (iter->length--)
-            {
-	      gboolean transparent = FALSE;
-
-	      if (has_alpha)
-	        {
-		  if (alpha_dither)
-		    {
-		      if (data[ALPHA] <
-                          DM[col & DM_WIDTHMASK][row & DM_HEIGHTMASK])
-		  	transparent = TRUE;
-		    }
-		  else
-		    {
-		      if (data[ALPHA] <= 127)
-			transparent = TRUE;
-		    }
-		}
-
-	      if (! transparent)
-                {
-                  colfreq = HIST_RGB (histogram,
-                                      data[RED],
-                                      data[GREEN],
-                                      data[BLUE]);
-                  (*colfreq)++;
+static void
+generate_histogram_rgb_merge (gint           chunk,
+                              HistogramTask *task)
+{
+  gint size  = HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS;
+  gint start = (gint64) size * chunk       / task->n_bands;
+  gint end   = (gint64) size * (chunk + 1) / task->n_bands;
+  gint band;
 
-                  if (!needs_quantize)
-                    {
-                      for (nfc_iter = 0;
-                           nfc_iter < num_found_cols;
-                           nfc_iter++)
-                        {
-                          if ((data[RED]   == found_cols[nfc_iter][0]) &&
-                              (data[GREEN] == found_cols[nfc_iter][1]) &&
-                              (data[BLUE]  == found_cols[nfc_iter][2]))
-                            goto already_found;
-                        }
+  for (band = 1; band < task->n_bands; band++)
+    {
+      const ColorFreq *src = task->bands[band].histogram;
+      gint             i;
 
-                      /* Colour was not in the table of
-                       * existing colours
-                       */
+      if (! src)
+        continue;
 
-                      num_found_cols++;
+      for (i = start; i < end; i++)
+        task->histogram[i] += src[i];
+    }
+}
 
-                      if (num_found_cols > col_limit)
-                        {
-                          /* There are more colours in the image
-                           *  than were allowed.  We switch to plain
-                           *  histogram calculation with a view to
-                           *  quantizing at a later stage.
-                           */
-                          needs_quantize = TRUE;
-                          /* g_print ("\nmax colours exceeded - needs quantize.\n");*/
-                          goto already_found;
-                        }
-                      else
-                        {
-                          /* Remember the new colour we just found.
-                           */
-                          found_cols[num_found_cols-1][0] = data[RED];
-                          found_cols[num_found_cols-1][1] = data[GREEN];
-                          found_cols[num_found_cols-1][2] = data[BLUE];
-                        }
-                    }
-                }
-            already_found:
+static void
+generate_histogram_rgb (CFHistogram   histogram,
+                        GimpLayer    *layer,
+                        gint          col_limit,
+                        gboolean      alpha_dither,
+                        GimpProgress *progress,
+                        gint          nth_layer,
+                        gint          n_layers)
+{
+  HistogramTask  task;
+  GimpImage     *image = gimp_item_get_image (GIMP_ITEM (layer));
+  gint           band;
 
-              col++;
-              if (col == coledge)
-                {
-                  col = roi->x + offsetx;
-                  row++;
-                }
+  task.format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
 
-              data += bpp;
-            }
+  g_return_if_fail (task.format == babl_format ("R'G'B' u8") ||
+                    task.format == babl_format ("R'G'B'A u8"));
+
+  task.buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  task.extent = *gegl_buffer_get_extent (task.buffer);
+
+  g_object_get (task.buffer, "tile-height", &task.tile_height, NULL);
+
+  gimp_item_get_offset (GIMP_ITEM (layer), &task.offsetx, &task.offsety);
+
+  task.col_limit    = col_limit;
+  task.alpha_dither = alpha_dither;
+  task.track_colors = ! needs_quantize;
+  task.histogram    = histogram;
+
+  /*  every extra band costs a histogram, only split large layers  */
+  task.n_bands = CLAMP (task.extent.width * task.extent.height /
+                        HISTOGRAM_BAND_AREA,
+                        1, gimp_parallel_get_n_threads (image->gimp));
+
+  task.bands = g_new0 (HistogramBand, task.n_bands);
+
+  /*  g_printerr ("col_limit = %d, nfc = %d\n", col_limit, num_found_cols); */
+
+  if (progress)
+    gimp_progress_set_value (progress, (gdouble) nth_layer / n_layers);
+
+  gimp_parallel_run (image->gimp, task.n_bands,
+                     (GimpParallelFunc) generate_histogram_rgb_band,
+                     &task);
+
+  if (task.n_bands > 1)
+    gimp_parallel_run (image->gimp, task.n_bands,
+                       (GimpParallelFunc) generate_histogram_rgb_merge,
+                       &task);
+
+  for (band = 0; band < task.n_bands; band++)
+    {
+      HistogramBand *hb = &task.bands[band];
+      gint           i;
+
+      if (band > 0)
+        g_free (hb->histogram);
+
+      if (needs_quantize)
+        continue;
+
+      if (hb->overflow)
+        {
+          needs_quantize = TRUE;
+          continue;
         }
 
-      if (progress && (count % 16 == 0))
-        gimp_progress_set_value (progress,
-                                 (nth_layer + ((gdouble) total_size)/
-                                  layer_size) / (gdouble) n_layers);
+      for (i = 0; i < hb->n_colors && ! needs_quantize; i++)
+        {
+          gint nfc_iter;
+
+          for (nfc_iter = 0; nfc_iter < num_found_cols; nfc_iter++)
+            {
+              if (hb->colors[i][0] == found_cols[nfc_iter][0] &&
+                  hb->colors[i][1] == found_cols[nfc_iter][1] &&
+                  hb->colors[i][2] == found_cols[nfc_iter][2])
+                break;
+            }
+
+          if (nfc_iter < num_found_cols)
+            continue;
+
+          /* Colour was not in the table of existing colours */
+          num_found_cols++;
+
+          if (num_found_cols > col_limit)
+            {
+              /* There are more colours in the image than were
+               *  allowed.  We switch to plain histogram calculation
+               *  with a view to quantizing at a later stage.
+               */
+              needs_quantize = TRUE;
+            }
+          else
+            {
+              /* Remember the new colour we just found. */
+              found_cols[num_found_cols - 1][0] = hb->colors[i][0];
+              found_cols[num_found_cols - 1][1] = hb->colors[i][1];
+              found_cols[num_found_cols - 1][2] = hb->colors[i][2];
+            }
+        }
     }
 
+  g_free (task.bands);
+
+  if (progress)
+    gimp_progress_set_value (progress, (gdouble) (nth_layer + 1) / n_layers);
+
 /*  g_print ("O: col_limit = %d, nfc = %d\n", col_limit, num_found_cols);*/
 }
 
@@ -2749,6 +2827,78 @@ fill_inverse_cmap_rgb (QuantizeObj *quantobj,
 }
 
 
+static inline int
+find_nearest_color_rgb (const QuantizeObj *quantobj,
+                        int                R,
+                        int                G,
+                        int                B)
+/* Find the colormap entry nearest to the center of histogram cell
+ * R/G/B.  This gives the same answer as fill_inverse_cmap_rgb(), but
+ * needs no locality search: the distances to all entries are computed
+ * in one branch-free loop over separate arrays, which the compiler
+ * turns into SIMD code, and only then is the minimum picked.
+ */
+{
+  const int numcolors = quantobj->actual_number_of_colors;
+  const int cR        = (R << R_SHIFT) + ((1 << R_SHIFT) >> 1);
+  const int cG        = (G << G_SHIFT) + ((1 << G_SHIFT) >> 1);
+  const int cB        = (B << B_SHIFT) + ((1 << B_SHIFT) >> 1);
+  int       dist[MAXNUMCOLORS];
+  int       best;
+  int       i;
+
+  for (i = 0; i < numcolors; i++)
+    {
+      const int dR = (cR - quantobj->clin_red[i])   * R_SCALE;
+      const int dG = (cG - quantobj->clin_green[i]) * G_SCALE;
+      const int dB = (cB - quantobj->clin_blue[i])  * B_SCALE;
+
+      dist[i] = dR * dR + dG * dG + dB * dB;
+    }
+
+  for (i = 1, best = 0; i < numcolors; i++)
+    {
+      if (dist[i] < dist[best])
+        best = i;
+    }
+
+  return best;
+}
+
+
+/*  Filling the inverse colormap for all cells which pass 1 found in
+ *  the image is done up front, in parallel, so that the remapping
+ *  passes below can use it read-only from several threads.
+ */
+
+typedef struct
+{
+  QuantizeObj *quantobj;
+  gint         n_chunks;
+} InverseCmapTask;
+
+static void
+fill_inverse_cmap_rgb_chunk (gint             chunk,
+                             InverseCmapTask *task)
+{
+  QuantizeObj *quantobj = task->quantobj;
+  CFHistogram  histogram = quantobj->histogram;
+  gint         R1 = HIST_R_ELEMS * chunk       / task->n_chunks;
+  gint         R2 = HIST_R_ELEMS * (chunk + 1) / task->n_chunks;
+  gint         R, G, B;
+
+  for (R = R1; R < R2; R++)
+    for (G = 0; G < HIST_G_ELEMS; G++)
+      for (B = 0; B < HIST_B_ELEMS; B++)
+        {
+          ColorFreq *cachep = HIST_LIN (histogram, R, G, B);
+
+          if (*cachep)
+            *cachep = find_nearest_color_rgb (quantobj, R, G, B) + 1;
+        }
+}
+
+
 /*  This is pass 1  */
 
 static void
@@ -2981,8 +3131,8 @@ median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
             {
               gint      pixel;
               const int dmval =
-                DM[(col + offsetx + src_roi->x) & DM_WIDTHMASK]
-                [(row + offsety + src_roi->y) & DM_HEIGHTMASK];
+                quantobj->dither_matrix[(col + offsetx + src_roi->x) & DM_WIDTHMASK]
+                                       [(row + offsety + src_roi->y) & DM_HEIGHTMASK];
 
               /* get pixel value and index into the cache */
               pixel = src[GRAY];
@@ -3088,87 +3238,199 @@ median_cut_pass2_fixed_dither_gray (QuantizeObj *quantobj,
     }
 }
 
+/*  The no-dither and positioned-dither passes treat every pixel on
+ *  its own, so they remap the layer in horizontal bands, in parallel.
+ *  The shared inverse colormap is only read here; colors which are
+ *  not in it yet are looked up into a small cache private to the
+ *  band instead.
+ */
+
+#define PASS2_CACHE_SIZE 16384
+
+typedef struct _Pass2Task Pass2Task;
+typedef struct _Pass2Band Pass2Band;
+
+typedef void (* Pass2BandFunc) (Pass2Task           *task,
+                                Pass2Band           *band,
+                                const GeglRectangle *rect);
+
+struct _Pass2Band
+{
+  gulong  index_used_count[256];
+  gint    cache_keys[PASS2_CACHE_SIZE];
+  guchar  cache_values[PASS2_CACHE_SIZE];
+};
+
+struct _Pass2Task
+{
+  QuantizeObj   *quantobj;
+  Pass2BandFunc  func;
+  GeglBuffer    *src_buffer;
+  GeglBuffer    *dest_buffer;
+  GeglRectangle  extent;
+  gint           tile_height;
+  gint           src_bpp;
+  gint           dest_bpp;
+  gboolean       has_alpha;
+  gint           red_pix;
+  gint           green_pix;
+  gint           blue_pix;
+  gint           alpha_pix;
+  gint           offsetx;
+  gint           offsety;
+  Pass2Band     *bands;
+  gint           n_bands;
+};
+
+
+static inline gint
+pass2_lookup_rgb (const QuantizeObj *quantobj,
+                  Pass2Band         *band,
+                  gint               R,
+                  gint               G,
+                  gint               B)
+{
+  ColorFreq cached = *HIST_LIN (quantobj->histogram, R, G, B);
+  gint      key;
+  gint      slot;
+
+  if (cached)
+    return cached - 1;
+
+  key  = REF_FUNC (R, G, B);
+  slot = (key ^ (key >> 14)) & (PASS2_CACHE_SIZE - 1);
+
+  if (band->cache_keys[slot] != key)
+    {
+      band->cache_keys[slot]   = key;
+      band->cache_values[slot] = find_nearest_color_rgb (quantobj, R, G, B);
+    }
+
+  return band->cache_values[slot];
+}
+
 static void
-median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
-                                GimpLayer   *layer,
-                                GeglBuffer  *new_buffer)
+median_cut_pass2_rgb_band (gint       n,
+                           Pass2Task *task)
 {
-  GeglBufferIterator *iter;
-  CFHistogram         histogram = quantobj->histogram;
-  ColorFreq          *cachep;
-  const Babl         *src_format;
-  const Babl         *dest_format;
-  GeglRectangle      *src_roi;
-  gint                src_bpp;
-  gint                dest_bpp;
-  gint                has_alpha;
-  gint                R, G, B;
-  gint                red_pix          = RED;
-  gint                green_pix        = GREEN;
-  gint                blue_pix         = BLUE;
-  gint                alpha_pix        = ALPHA;
-  gboolean            alpha_dither     = quantobj->want_alpha_dither;
-  gint                offsetx, offsety;
-  gulong             *index_used_count = quantobj->index_used_count;
-  glong               total_size       = 0;
-  glong               layer_size;
-  gint                count            = 0;
-  gint                nth_layer        = quantobj->nth_layer;
-  gint                n_layers         = quantobj->n_layers;
+  Pass2Band     *band = &task->bands[n];
+  GeglRectangle  rect;
+  gint           i;
 
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
+  gimp_parallel_split_rect (&task->extent, task->n_bands, n,
+                            task->tile_height, &rect);
 
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  if (rect.height == 0)
+    return;
 
-  src_bpp  = babl_format_get_bytes_per_pixel (src_format);
-  dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
+  memset (band->index_used_count, 0, sizeof (band->index_used_count));
 
-  has_alpha = babl_format_has_alpha (src_format);
+  for (i = 0; i < PASS2_CACHE_SIZE; i++)
+    band->cache_keys[i] = -1;
+
+  task->func (task, band, &rect);
+}
+
+static void
+median_cut_pass2_rgb_parallel (QuantizeObj   *quantobj,
+                               GimpLayer     *layer,
+                               GeglBuffer    *new_buffer,
+                               Pass2BandFunc  func)
+{
+  Pass2Task   task;
+  const Babl *src_format;
+  gint        n, i;
+
+  src_format = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
+
+  task.quantobj    = quantobj;
+  task.func        = func;
+  task.src_buffer  = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  task.dest_buffer = new_buffer;
+  task.extent      = *gegl_buffer_get_extent (new_buffer);
+  task.src_bpp     = babl_format_get_bytes_per_pixel (src_format);
+  task.dest_bpp    = babl_format_get_bytes_per_pixel (gegl_buffer_get_format (new_buffer));
+  task.has_alpha   = babl_format_has_alpha (src_format);
+  task.red_pix     = RED;
+  task.green_pix   = GREEN;
+  task.blue_pix    = BLUE;
+  task.alpha_pix   = ALPHA;
+
+  g_object_get (new_buffer, "tile-height", &task.tile_height, NULL);
+
+  gimp_item_get_offset (GIMP_ITEM (layer), &task.offsetx, &task.offsety);
 
   /*  In the case of web/mono palettes, we actually force
    *   grayscale drawables through the rgb pass2 functions
    */
   if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
     {
-      red_pix = green_pix = blue_pix = GRAY;
-      alpha_pix = ALPHA_G;
+      task.red_pix = task.green_pix = task.blue_pix = GRAY;
+      task.alpha_pix = ALPHA_G;
     }
 
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
+  task.n_bands = 2 * gimp_parallel_get_n_threads (quantobj->gimp);
+  task.bands   = g_new0 (Pass2Band, task.n_bands);
+
+  gimp_parallel_run (quantobj->gimp, task.n_bands,
+                     (GimpParallelFunc) median_cut_pass2_rgb_band,
+                     &task);
+
+  for (n = 0; n < task.n_bands; n++)
+    for (i = 0; i < 256; i++)
+      quantobj->index_used_count[i] += task.bands[n].index_used_count[i];
+
+  g_free (task.bands);
+
+  if (quantobj->progress)
+    gimp_progress_set_value (quantobj->progress,
+                             (quantobj->nth_layer + 1) /
+                             (gdouble) quantobj->n_layers);
+}
+
+static void
+median_cut_pass2_no_dither_rgb_band (Pass2Task           *task,
+                                     Pass2Band           *band,
+                                     const GeglRectangle *rect)
+{
+  GeglBufferIterator *iter;
+  QuantizeObj        *quantobj         = task->quantobj;
+  GeglRectangle      *src_roi;
+  gint                R, G, B;
+  gint                red_pix          = task->red_pix;
+  gint                green_pix        = task->green_pix;
+  gint                blue_pix         = task->blue_pix;
+  gint                alpha_pix        = task->alpha_pix;
+  gboolean            alpha_dither     = quantobj->want_alpha_dither;
+  gulong             *index_used_count = band->index_used_count;
+
+  iter = gegl_buffer_iterator_new (task->src_buffer, rect, 0, NULL,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   src_roi = &iter->roi[0];
 
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
+  gegl_buffer_iterator_add (iter, task->dest_buffer, rect, 0, NULL,
                             GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
-
   while (gegl_buffer_iterator_next (iter))
     {
       const guchar *src  = iter->data[0];
       guchar       *dest = iter->data[1];
       gint          row;
 
-      total_size += src_roi->height * src_roi->width;
-
       for (row = 0; row < src_roi->height; row++)
         {
           gint col;
 
           for (col = 0; col < src_roi->width; col++)
             {
-              if (has_alpha)
+              if (task->has_alpha)
                 {
                   gboolean transparent = FALSE;
 
                   if (alpha_dither)
                     {
-                      gint dither_x = (col + offsetx + src_roi->x) & DM_WIDTHMASK;
-                      gint dither_y = (row + offsety + src_roi->y) & DM_HEIGHTMASK;
+                      gint dither_x = (col + task->offsetx + src_roi->x) & DM_WIDTHMASK;
+                      gint dither_y = (row + task->offsety + src_roi->y) & DM_HEIGHTMASK;
                       if ((src[alpha_pix]) < DM[dither_x][dither_y])
                         transparent = TRUE;
                     }
@@ -3189,46 +3451,40 @@ median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
                     }
                 }
 
-              /* get pixel value and index into the cache */
+              /* get pixel value and look it up in the inverse colormap */
               rgb_to_lin (src[red_pix], src[green_pix], src[blue_pix],
                           &R, &G, &B);
-              cachep = HIST_LIN(histogram,R,G,B);
-              /* If we have not seen this color before, find nearest
-                 colormap entry and update the cache */
-              if (*cachep == 0)
-                fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
 
               /* Now emit the colormap index for this cell, barfbarf */
-              index_used_count[dest[INDEXED] = *cachep - 1]++;
+              index_used_count[dest[INDEXED] =
+                               pass2_lookup_rgb (quantobj, band, R, G, B)]++;
 
             next_pixel:
 
-              src  += src_bpp;
-              dest += dest_bpp;
+              src  += task->src_bpp;
+              dest += task->dest_bpp;
             }
         }
-
-      if (quantobj->progress && (count % 16 == 0))
-         gimp_progress_set_value (quantobj->progress,
-                                  (nth_layer + ((gdouble) total_size)/
-                                   layer_size) / (gdouble) n_layers);
     }
 }
 
 static void
-median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
-                                   GimpLayer   *layer,
-                                   GeglBuffer  *new_buffer)
+median_cut_pass2_no_dither_rgb (QuantizeObj *quantobj,
+                                GimpLayer   *layer,
+                                GeglBuffer  *new_buffer)
+{
+  median_cut_pass2_rgb_parallel (quantobj, layer, new_buffer,
+                                 median_cut_pass2_no_dither_rgb_band);
+}
+
+static void
+median_cut_pass2_fixed_dither_rgb_band (Pass2Task           *task,
+                                        Pass2Band           *band,
+                                        const GeglRectangle *rect)
 {
   GeglBufferIterator *iter;
-  CFHistogram         histogram = quantobj->histogram;
-  ColorFreq          *cachep;
-  const Babl         *src_format;
-  const Babl         *dest_format;
+  QuantizeObj        *quantobj         = task->quantobj;
   GeglRectangle      *src_roi;
-  gint                src_bpp;
-  gint                dest_bpp;
-  gint                has_alpha;
   gint                pixval1 = 0;
   gint                pixval2 = 0;
   Color              *color1;
@@ -3236,58 +3492,26 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
   gint                R, G, B;
   gint                err1;
   gint                err2;
-  gint                red_pix          = RED;
-  gint                green_pix        = GREEN;
-  gint                blue_pix         = BLUE;
-  gint                alpha_pix        = ALPHA;
+  gint                red_pix          = task->red_pix;
+  gint                green_pix        = task->green_pix;
+  gint                blue_pix         = task->blue_pix;
+  gint                alpha_pix        = task->alpha_pix;
   gboolean            alpha_dither     = quantobj->want_alpha_dither;
-  gint                offsetx, offsety;
-  gulong             *index_used_count = quantobj->index_used_count;
-  glong               total_size       = 0;
-  glong               layer_size;
-  gint                count            = 0;
-  gint                nth_layer        = quantobj->nth_layer;
-  gint                n_layers         = quantobj->n_layers;
-
-  gimp_item_get_offset (GIMP_ITEM (layer), &offsetx, &offsety);
-
-  src_format  = gimp_drawable_get_format (GIMP_DRAWABLE (layer));
-  dest_format = gegl_buffer_get_format (new_buffer);
+  gulong             *index_used_count = band->index_used_count;
 
-  src_bpp  = babl_format_get_bytes_per_pixel (src_format);
-  dest_bpp = babl_format_get_bytes_per_pixel (dest_format);
-
-  has_alpha = babl_format_has_alpha (src_format);
-
-  /*  In the case of web/mono palettes, we actually force
-   *   grayscale drawables through the rgb pass2 functions
-   */
-  if (gimp_drawable_is_gray (GIMP_DRAWABLE (layer)))
-    {
-      red_pix = green_pix = blue_pix = GRAY;
-      alpha_pix = ALPHA_G;
-    }
-
-  iter = gegl_buffer_iterator_new (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
-                                   NULL, 0, NULL,
+  iter = gegl_buffer_iterator_new (task->src_buffer, rect, 0, NULL,
                                    GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
   src_roi = &iter->roi[0];
 
-  gegl_buffer_iterator_add (iter, new_buffer,
-                            NULL, 0, NULL,
+  gegl_buffer_iterator_add (iter, task->dest_buffer, rect, 0, NULL,
                             GEGL_BUFFER_WRITE, GEGL_ABYSS_NONE);
 
-  layer_size = (gimp_item_get_width  (GIMP_ITEM (layer)) *
-                gimp_item_get_height (GIMP_ITEM (layer)));
-
   while (gegl_buffer_iterator_next (iter))
     {
       const guchar *src  = iter->data[0];
       guchar       *dest = iter->data[1];
       gint          row;
 
-      total_size += src_roi->height * src_roi->width;
-
       for (row = 0; row < src_roi->height; row++)
         {
           gint col;
@@ -3295,10 +3519,10 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
           for (col = 0; col < src_roi->width; col++)
             {
               const int dmval =
-                DM[(col + offsetx + src_roi->x) & DM_WIDTHMASK]
-                [(row + offsety + src_roi->y) & DM_HEIGHTMASK];
+                quantobj->dither_matrix[(col + task->offsetx + src_roi->x) & DM_WIDTHMASK]
+                                       [(row + task->offsety + src_roi->y) & DM_HEIGHTMASK];
 
-              if (has_alpha)
+              if (task->has_alpha)
                 {
                   gboolean transparent = FALSE;
 
@@ -3324,14 +3548,9 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
                     }
                 }
 
-              /* get pixel value and index into the cache */
+              /* get pixel value and look it up in the inverse colormap */
               rgb_to_lin(src[red_pix], src[green_pix], src[blue_pix],
                          &R, &G, &B);
-              cachep = HIST_LIN(histogram,R,G,B);
-              /* If we have not seen this color before, find nearest
-                 colormap entry and update the cache */
-              if (*cachep == 0)
-                fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
 
               /* We now try to find a colour which, when mixed in some fashion
                  with the closest match, yields something closer to the
@@ -3340,7 +3559,7 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
                  colour cell.  Then we assess the distance of both mixer
                  colours from the intended colour to determine their relative
                  probabilities of being chosen. */
-              pixval1 = *cachep - 1;
+              pixval1 = pass2_lookup_rgb (quantobj, band, R, G, B);
               color1 = &quantobj->cmap[pixval1];
 
               if (quantobj->actual_number_of_colors > 2)
@@ -3358,15 +3577,8 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
                                   (CLAMP0255(GV)),
                                   (CLAMP0255(BV)),
                                   &R, &G, &B);
-                      cachep = HIST_LIN(histogram,R,G,B);
 
-                      /* If we have not seen this color before, find nearest
-                         colormap entry and update the cache */
-                      if (*cachep == 0)
-                        {
-                          fill_inverse_cmap_rgb (quantobj, histogram, R, G, B);
-                        }
-                      pixval2 = *cachep - 1;
+                      pixval2 = pass2_lookup_rgb (quantobj, band, R, G, B);
                       RV += re;  GV += ge;  BV += be;
                     }
                   while ((pixval1 == pixval2) &&
@@ -3434,18 +3646,22 @@ median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
 
             next_pixel:
 
-              src  += src_bpp;
-              dest += dest_bpp;
+              src  += task->src_bpp;
+              dest += task->dest_bpp;
             }
         }
-
-      if (quantobj->progress && (count % 16 == 0))
-        gimp_progress_set_value (quantobj->progress,
-                                 (nth_layer + ((gdouble) total_size)/
-                                  layer_size) / (gdouble) n_layers);
     }
 }
 
+static void
+median_cut_pass2_fixed_dither_rgb (QuantizeObj *quantobj,
+                                   GimpLayer   *layer,
+                                   GeglBuffer  *new_buffer)
+{
+  median_cut_pass2_rgb_parallel (quantobj, layer, new_buffer,
+                                 median_cut_pass2_fixed_dither_rgb_band);
+}
+
 static void
 median_cut_pass2_nodestruct_dither_rgb (QuantizeObj *quantobj,
                                         GimpLayer   *layer,
@@ -3885,8 +4101,6 @@ median_cut_pass2_rgb_init (QuantizeObj *quantobj)
 {
   int i;
 
-  zero_histogram_rgb (quantobj->histogram);
-
   /* Mark all indices as currently unused */
   memset (quantobj->index_used_count, 0, 256 * sizeof (unsigned long));
 
@@ -3899,6 +4113,31 @@ median_cut_pass2_rgb_init (QuantizeObj *quantobj)
                             &quantobj->clin[i].red,
                             &quantobj->clin[i].green,
                             &quantobj->clin[i].blue);
+
+      quantobj->clin_red[i]   = quantobj->clin[i].red;
+      quantobj->clin_green[i] = quantobj->clin[i].green;
+      quantobj->clin_blue[i]  = quantobj->clin[i].blue;
+    }
+
+  if (quantobj->has_histogram)
+    {
+      /* Turn the histogram into the inverse colormap of all colors
+       * in the image right away, every other cell becomes empty.
+       */
+      InverseCmapTask task;
+
+      task.quantobj = quantobj;
+      task.n_chunks = 4 * gimp_parallel_get_n_threads (quantobj->gimp);
+
+      gimp_parallel_run (quantobj->gimp, task.n_chunks,
+                         (GimpParallelFunc) fill_inverse_cmap_rgb_chunk,
+                         &task);
+
+      quantobj->has_histogram = FALSE;
+    }
+  else
+    {
+      zero_histogram_rgb (quantobj->histogram);
     }
 }
 
@@ -4295,6 +4534,180 @@ delete_median_cut (QuantizeObj *quantobj)
 }
 
 
+/*  A blue noise threshold matrix for positioned dithering, made with
+ *  Ulichney's void-and-cluster method.  Unlike the Bayer-like matrix
+ *  in DM it has no visible grid structure, while every pixel still
+ *  only depends on its own position.
+ */
+
+#define BLUE_NOISE_SIGMA 1.5
+
+static guchar   blue_noise_matrix[DM_WIDTH][DM_HEIGHT];
+static gboolean blue_noise_initialized = FALSE;
+
+static void
+blue_noise_toggle (gboolean      *pattern,
+                   gdouble       *energy,
+                   const gdouble *kernel,
+                   gint           pos,
+                   gboolean       value)
+{
+  gint px = pos / DM_HEIGHT;
+  gint py = pos % DM_HEIGHT;
+  gint x, y;
+
+  pattern[pos] = value;
+
+  for (x = 0; x < DM_WIDTH; x++)
+    for (y = 0; y < DM_HEIGHT; y++)
+      {
+        gdouble e = kernel[((x - px) & DM_WIDTHMASK) * DM_HEIGHT +
+                           ((y - py) & DM_HEIGHTMASK)];
+
+        energy[x * DM_HEIGHT + y] += value ? e : -e;
+      }
+}
+
+static gint
+blue_noise_find (const gboolean *pattern,
+                 const gdouble  *energy,
+                 gboolean        cluster)
+{
+  gint best = -1;
+  gint i;
+
+  /*  the tightest cluster is the set pixel with the most energy,
+   *  the largest void the unset pixel with the least
+   */
+  for (i = 0; i < DM_WIDTH * DM_HEIGHT; i++)
+    {
+      if (pattern[i] != cluster)
+        continue;
+
+      if (best < 0                                  ||
+          (  cluster && energy[i] > energy[best]) ||
+          (! cluster && energy[i] < energy[best]))
+        best = i;
+    }
+
+  return best;
+}
+
+static void
+init_blue_noise_matrix (void)
+{
+  const gint  size = DM_WIDTH * DM_HEIGHT;
+  gdouble    *kernel;
+  gdouble    *energy;
+  gboolean   *initial;
+  gboolean   *pattern;
+  gint       *rank;
+  GRand      *rand;
+  gint        n_initial;
+  gint        x, y;
+  gint        i;
+
+  if (blue_noise_initialized)
+    return;
+
+  kernel  = g_new  (gdouble,  size);
+  energy  = g_new0 (gdouble,  size);
+  initial = g_new0 (gboolean, size);
+  pattern = g_new0 (gboolean, size);
+  rank    = g_new  (gint,     size);
+
+  /*  a gaussian on the torus, so that the matrix tiles seamlessly  */
+  for (x = 0; x < DM_WIDTH; x++)
+    for (y = 0; y < DM_HEIGHT; y++)
+      {
+        gint dx = MIN (x, DM_WIDTH  - x);
+        gint dy = MIN (y, DM_HEIGHT - y);
+
+        kernel[x * DM_HEIGHT + y] =
+          exp (- (dx * dx + dy * dy) /
+               (2.0 * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+      }
+
+  /*  a fixed seed keeps the matrix, and the dithered images, the
+   *  same from one session to the next
+   */
+  rand      = g_rand_new_with_seed (0x474d5000);
+  n_initial = size / 10;
+
+  for (i = 0; i < n_initial; i++)
+    {
+      gint pos;
+
+      do
+        pos = g_rand_int_range (rand, 0, size);
+      while (initial[pos]);
+
+      blue_noise_toggle (initial, energy, kernel, pos, TRUE);
+    }
+
+  g_rand_free (rand);
+
+  /*  move pixels from the tightest cluster to the largest void
+   *  until that doesn't change anything any more
+   */
+  for (i = 0; i < size; i++)
+    {
+      gint cluster = blue_noise_find (initial, energy, TRUE);
+      gint hole;
+
+      blue_noise_toggle (initial, energy, kernel, cluster, FALSE);
+
+      hole = blue_noise_find (initial, energy, FALSE);
+
+      blue_noise_toggle (initial, energy, kernel, hole, TRUE);
+
+      if (hole == cluster)
+        break;
+    }
+
+  /*  rank the initial pixels by removing the tightest clusters  */
+  memcpy (pattern, initial, size * sizeof (gboolean));
+
+  for (i = n_initial - 1; i >= 0; i--)
+    {
+      gint cluster = blue_noise_find (pattern, energy, TRUE);
+
+      blue_noise_toggle (pattern, energy, kernel, cluster, FALSE);
+      rank[cluster] = i;
+    }
+
+  /*  rank the rest by filling the largest voids  */
+  memset (energy, 0, size * sizeof (gdouble));
+
+  for (i = 0; i < size; i++)
+    {
+      pattern[i] = FALSE;
+
+      if (initial[i])
+        blue_noise_toggle (pattern, energy, kernel, i, TRUE);
+    }
+
+  for (i = n_initial; i < size; i++)
+    {
+      gint hole = blue_noise_find (pattern, energy, FALSE);
+
+      blue_noise_toggle (pattern, energy, kernel, hole, TRUE);
+      rank[hole] = i;
+    }
+
+  for (i = 0; i < size; i++)
+    blue_noise_matrix[i / DM_HEIGHT][i % DM_HEIGHT] = rank[i] * 256 / size;
+
+  g_free (rank);
+  g_free (pattern);
+  g_free (initial);
+  g_free (energy);
+  g_free (kernel);
+
+  blue_noise_initialized = TRUE;
+}
+
+
 void
 gimp_image_convert_type_set_dither_matrix (const guchar *matrix,
                                            gint          width,
@@ -4326,7 +4739,8 @@ gimp_image_convert_type_set_dither_matrix (const guchar *matrix,
 
 /**************************************************************/
 static QuantizeObj *
-initialize_median_cut (GimpImageBaseType       type,
+initialize_median_cut (Gimp                   *gimp,
+                       GimpImageBaseType       type,
                        gint                    num_colors,
                        GimpConvertDitherType   dither_type,
                        GimpConvertPaletteType  palette_type,
@@ -4345,9 +4759,18 @@ initialize_median_cut (GimpImageBaseType       type,
                                  HIST_R_ELEMS * HIST_G_ELEMS * HIST_B_ELEMS);
 
   quantobj->desired_number_of_colors = num_colors;
+  quantobj->has_histogram            = FALSE;
   quantobj->want_alpha_dither        = want_alpha_dither;
+  quantobj->dither_matrix            = DM;
+  quantobj->gimp                     = gimp;
   quantobj->progress                 = progress;
 
+  if (dither_type == GIMP_BLUE_NOISE_DITHER)
+    {
+      init_blue_noise_matrix ();
+      quantobj->dither_matrix = blue_noise_matrix;
+    }
+
   switch (type)
     {
     case GIMP_GRAY:
@@ -4391,6 +4814,7 @@ initialize_median_cut (GimpImageBaseType       type,
               quantobj->second_pass = median_cut_pass2_fs_dither_rgb;
               break;
             case GIMP_FIXED_DITHER:
+            case GIMP_BLUE_NOISE_DITHER:
               quantobj->second_pass_init = median_cut_pass2_rgb_init;
               quantobj->second_pass = median_cut_pass2_fixed_dither_rgb;
               break;
@@ -4418,6 +4842,7 @@ initialize_median_cut (GimpImageBaseType       type,
               quantobj->second_pass = median_cut_pass2_fs_dither_gray;
               break;
             case GIMP_FIXED_DITHER:
+            case GIMP_BLUE_NOISE_DITHER:
               quantobj->second_pass_init = median_cut_pass2_gray_init;
               quantobj->second_pass = median_cut_pass2_fixed_dither_gray;
               break;
@@ -4464,6 +4889,7 @@ initialize_median_cut (GimpImageBaseType       type,
           quantobj->second_pass = median_cut_pass2_nodestruct_dither_rgb;
           break;
         case GIMP_FIXED_DITHER:
+        case GIMP_BLUE_NOISE_DITHER:
           quantobj->second_pass_init = median_cut_pass2_rgb_init;
           quantobj->second_pass = median_cut_pass2_fixed_dither_rgb;
           break;
@@ -34,6 +34,10 @@
 #include "gimpundostack.h"
 
 
+/*  the number of most recent undo steps which are kept uncompressed  */
+#define GIMP_IMAGE_UNDO_HOT_LEVELS 2
+
+
 /*  local function prototypes  */
 
 static void          gimp_image_undo_pop_stack       (GimpImage     *image,
@@ -41,6 +45,8 @@ static void          gimp_image_undo_pop_stack       (GimpImage     *image,
                                                       GimpUndoStack *redo_stack,
                                                       GimpUndoMode   undo_mode);
 static void          gimp_image_undo_free_space      (GimpImage     *image);
+static void          gimp_image_undo_compress        (GimpContainer *undos,
+                                                      gint           keep);
 static void          gimp_image_undo_free_redo       (GimpImage     *image);
 
 static GimpDirtyMask gimp_image_undo_dirty_from_type (GimpUndoType   undo_type);
@@ -548,6 +554,11 @@ gimp_image_undo_free_space (GimpImage *image)
   max_undo_levels = 1024; /* FIXME */
   undo_size       = image->gimp->config->undo_size;
 
+  /*  compress the pixels of all but the most recent steps first, so
+   *  the undo size pays for more levels of undo
+   */
+  gimp_image_undo_compress (container, GIMP_IMAGE_UNDO_HOT_LEVELS);
+
 #ifdef DEBUG_IMAGE_UNDO
   g_printerr ("undo_steps: %d    undo_bytes: %ld\n",
               gimp_container_get_n_children (container),
@@ -580,6 +591,34 @@ gimp_image_undo_free_space (GimpImage *image)
     }
 }
 
+static void
+gimp_image_undo_compress (GimpContainer *undos,
+                          gint           keep)
+{
+  GList *list;
+  gint   i;
+
+  for (list = GIMP_LIST (undos)->list, i = 0;
+       list;
+       list = g_list_next (list), i++)
+    {
+      if (i < keep)
+        continue;
+
+      if (GIMP_IS_UNDO_STACK (list->data))
+        {
+          gimp_image_undo_compress (GIMP_UNDO_STACK (list->data)->undos, 0);
+        }
+      else if (GIMP_IS_DRAWABLE_UNDO (list->data))
+        {
+          GimpDrawableUndo *undo = list->data;
+
+          if (undo->buffer && ! undo->stored)
+            gimp_drawable_undo_compress (undo);
+        }
+    }
+}
+
 static void
 gimp_image_undo_free_redo (GimpImage *image)
 {
@@ -40,6 +40,15 @@
 #define GIMP_PROJECTION_IDLE_PRIORITY \
         ((G_PRIORITY_HIGH_IDLE + G_PRIORITY_DEFAULT_IDLE) / 2)
 
+/*  the initial chunk size, and the limits it is adapted within  */
+#define GIMP_PROJECTION_CHUNK_WIDTH      256
+#define GIMP_PROJECTION_CHUNK_HEIGHT     128
+#define GIMP_PROJECTION_CHUNK_MAX_WIDTH  1024
+#define GIMP_PROJECTION_CHUNK_MAX_HEIGHT 1024
+
+/*  the time one chunk should take to render, in microseconds  */
+#define GIMP_PROJECTION_CHUNK_TIME       20000
+
 
 enum
 {
@@ -80,13 +89,29 @@ static void        gimp_projection_flush_whenever        (GimpProjection  *proj,
                                                           gboolean         now);
 static void        gimp_projection_idle_render_init      (GimpProjection  *proj);
 static gboolean    gimp_projection_idle_render_callback  (gpointer         data);
+static GimpArea  * gimp_projection_idle_render_take_area (GimpProjection  *proj);
 static gboolean    gimp_projection_idle_render_next_area (GimpProjection  *proj);
+static gboolean    gimp_projection_idle_render_next_chunk(GimpProjection  *proj,
+                                                          GeglRectangle   *chunk);
+static void        gimp_projection_idle_render_requeue   (GimpProjection  *proj);
+static void        gimp_projection_idle_render_finished  (GimpProjection  *proj);
+static void        gimp_projection_chunk_render          (GimpProjection  *proj,
+                                                          const GeglRectangle *rect);
+static void        gimp_projection_chunk_adapt_size      (GimpProjection  *proj,
+                                                          const GeglRectangle *rect,
+                                                          gint64           time);
 static void        gimp_projection_paint_area            (GimpProjection  *proj,
                                                           gboolean         now,
                                                           gint             x,
                                                           gint             y,
                                                           gint             w,
                                                           gint             h);
+static void        gimp_projection_emit_update           (GimpProjection  *proj,
+                                                          gboolean         now,
+                                                          gint             x,
+                                                          gint             y,
+                                                          gint             w,
+                                                          gint             h);
 static void        gimp_projection_invalidate            (GimpProjection  *proj,
                                                           guint            x,
                                                           guint            y,
@@ -143,6 +168,8 @@ gimp_projection_class_init (GimpProjectionClass *klass)
 static void
 gimp_projection_init (GimpProjection *proj)
 {
+  proj->idle_render.chunk_width  = GIMP_PROJECTION_CHUNK_WIDTH;
+  proj->idle_render.chunk_height = GIMP_PROJECTION_CHUNK_HEIGHT;
 }
 
 static void
@@ -376,15 +403,93 @@ gimp_projection_finish_draw (GimpProjection *proj)
 {
   g_return_if_fail (GIMP_IS_PROJECTION (proj));
 
-  if (proj->idle_render.idle_id)
+  if (proj->idle_render.active)
     {
-      g_source_remove (proj->idle_render.idle_id);
-      proj->idle_render.idle_id = 0;
+      GeglRectangle rect;
+
+      if (proj->idle_render.idle_id)
+        {
+          g_source_remove (proj->idle_render.idle_id);
+          proj->idle_render.idle_id = 0;
+        }
+
+      while (gimp_projection_idle_render_next_chunk (proj, &rect))
+        gimp_projection_paint_area (proj, TRUE /* sic! */,
+                                    rect.x, rect.y, rect.width, rect.height);
 
-      while (gimp_projection_idle_render_callback (proj));
+      gimp_projection_idle_render_finished (proj);
     }
 }
 
+/**
+ * gimp_projection_set_priority_rect:
+ * @proj:   a #GimpProjection
+ * @x:      x coordinate of the visible area, in image coordinates
+ * @y:      y coordinate of the visible area
+ * @width:  width of the visible area
+ * @height: height of the visible area
+ *
+ * Tells the idle renderer which part of the projection is currently
+ * visible, so that dirty areas inside it are rendered first.
+ **/
+void
+gimp_projection_set_priority_rect (GimpProjection *proj,
+                                   gint            x,
+                                   gint            y,
+                                   gint            width,
+                                   gint            height)
+{
+  GimpProjectionIdleRender *render;
+  gint                      off_x, off_y;
+
+  g_return_if_fail (GIMP_IS_PROJECTION (proj));
+
+  render = &proj->idle_render;
+
+  gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
+
+  if (render->priority_rect.x      == x - off_x &&
+      render->priority_rect.y      == y - off_y &&
+      render->priority_rect.width  == width     &&
+      render->priority_rect.height == height)
+    return;
+
+  render->priority_rect.x      = x - off_x;
+  render->priority_rect.y      = y - off_y;
+  render->priority_rect.width  = MAX (width,  0);
+  render->priority_rect.height = MAX (height, 0);
+
+  /*  stop walking the current area if it isn't the most urgent one
+   *  any longer
+   */
+  if (render->active)
+    gimp_projection_idle_render_requeue (proj);
+}
+
+/**
+ * gimp_projection_set_priority_point:
+ * @proj: a #GimpProjection
+ * @x:    x coordinate of the pointer, in image coordinates
+ * @y:    y coordinate of the pointer
+ *
+ * Tells the idle renderer where the pointer is, dirty areas closer
+ * to it are rendered first.
+ **/
+void
+gimp_projection_set_priority_point (GimpProjection *proj,
+                                    gint            x,
+                                    gint            y)
+{
+  gint off_x, off_y;
+
+  g_return_if_fail (GIMP_IS_PROJECTION (proj));
+
+  gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
+
+  proj->idle_render.priority_x = x - off_x;
+  proj->idle_render.priority_y = y - off_y;
+}
+
 
 /*  private functions  */
 
@@ -505,20 +610,9 @@ gimp_projection_idle_render_init (GimpProjection *proj)
    * unrendered area with the update_areas list, and make it start work
    * on the next unrendered area in the list.
    */
-  if (proj->idle_render.idle_id)
+  if (proj->idle_render.active)
     {
-      GimpArea *area =
-        gimp_area_new (proj->idle_render.base_x,
-                       proj->idle_render.y,
-                       proj->idle_render.base_x + proj->idle_render.width,
-                       proj->idle_render.y + (proj->idle_render.height -
-                                               (proj->idle_render.y -
-                                                proj->idle_render.base_y)));
-
-      proj->idle_render.update_areas =
-        gimp_area_list_process (proj->idle_render.update_areas, area);
-
-      gimp_projection_idle_render_next_area (proj);
+      gimp_projection_idle_render_requeue (proj);
     }
   else
     {
@@ -530,7 +624,10 @@ gimp_projection_idle_render_init (GimpProjection *proj)
         }
 
       gimp_projection_idle_render_next_area (proj);
+    }
 
+  if (! proj->idle_render.idle_id)
+    {
       proj->idle_render.idle_id =
         g_idle_add_full (GIMP_PROJECTION_IDLE_PRIORITY,
                          gimp_projection_idle_render_callback, proj,
@@ -538,73 +635,162 @@ gimp_projection_idle_render_init (GimpProjection *proj)
     }
 }
 
+static void
+gimp_projection_idle_render_requeue (GimpProjection *proj)
+{
+  GimpProjectionIdleRender *render = &proj->idle_render;
+
+  if (render->y < render->base_y + render->height)
+    {
+      GimpArea *area = gimp_area_new (render->base_x,
+                                      render->y,
+                                      render->base_x + render->width,
+                                      render->base_y + render->height);
+
+      render->update_areas = gimp_area_list_process (render->update_areas,
+                                                     area);
+    }
+
+  render->active = FALSE;
+
+  gimp_projection_idle_render_next_area (proj);
+}
+
 /* Unless specified otherwise, projection re-rendering is organised by
  * IdleRender, which amalgamates areas to be re-rendered and breaks
  * them into bite-sized chunks which are chewed on in a low- priority
  * idle thread.  This greatly improves responsiveness for many GIMP
  * operations.  -- Adam
+ *
+ * The chunks are rendered right away, the most urgent ones first, and
+ * sized so that each takes about GIMP_PROJECTION_CHUNK_TIME. They are
+ * rendered here in the main thread because the graph is modified and
+ * rendered from the main thread too, and must not be used by two
+ * threads at once.
  */
 static gboolean
 gimp_projection_idle_render_callback (gpointer data)
 {
   GimpProjection *proj = data;
-  gint            workx, worky;
-  gint            workw, workh;
+  GeglRectangle   rect;
 
-#define CHUNK_WIDTH  256
-#define CHUNK_HEIGHT 128
+  if (! gimp_projection_idle_render_next_chunk (proj, &rect))
+    {
+      /* FINISHED */
+      proj->idle_render.idle_id = 0;
 
-  workw = CHUNK_WIDTH;
-  workh = CHUNK_HEIGHT;
-  workx = proj->idle_render.x;
-  worky = proj->idle_render.y;
+      gimp_projection_idle_render_finished (proj);
 
-  if (workx + workw > proj->idle_render.base_x + proj->idle_render.width)
-    {
-      workw = proj->idle_render.base_x + proj->idle_render.width - workx;
+      return FALSE;
     }
 
-  if (worky + workh > proj->idle_render.base_y + proj->idle_render.height)
-    {
-      workh = proj->idle_render.base_y + proj->idle_render.height - worky;
-    }
+  if (proj->validate_handler)
+    gimp_projection_chunk_render (proj, &rect);
+  else
+    gimp_projection_paint_area (proj, TRUE /* sic! */,
+                                rect.x, rect.y, rect.width, rect.height);
 
-  gimp_projection_paint_area (proj, TRUE /* sic! */,
-                              workx, worky, workw, workh);
+  /* Still work to do. */
+  return TRUE;
+}
 
-  proj->idle_render.x += CHUNK_WIDTH;
+static void
+gimp_projection_idle_render_finished (GimpProjection *proj)
+{
+  if (proj->idle_render.active)
+    return;
 
-  if (proj->idle_render.x >=
-      proj->idle_render.base_x + proj->idle_render.width)
+  if (proj->invalidate_preview)
     {
-      proj->idle_render.x = proj->idle_render.base_x;
-      proj->idle_render.y += CHUNK_HEIGHT;
+      /* invalidate the preview here since it is constructed from
+       * the projection
+       */
+      proj->invalidate_preview = FALSE;
 
-      if (proj->idle_render.y >=
-          proj->idle_render.base_y + proj->idle_render.height)
-        {
-          if (! gimp_projection_idle_render_next_area (proj))
-            {
-              /* FINISHED */
-              proj->idle_render.idle_id = 0;
+      gimp_projectable_invalidate_preview (proj->projectable);
+    }
+}
 
-              if (proj->invalidate_preview)
-                {
-                  /* invalidate the preview here since it is constructed from
-                   * the projection
-                   */
-                  proj->invalidate_preview = FALSE;
+/*  picks the most urgent area: one that is visible, preferably the
+ *  one closest to the pointer, or else simply the one closest to the
+ *  pointer.  A visible area which sticks out of the viewport is split
+ *  and only its visible part is returned.
+ */
+static GimpArea *
+gimp_projection_idle_render_take_area (GimpProjection *proj)
+{
+  GimpProjectionIdleRender *render   = &proj->idle_render;
+  GeglRectangle            *viewport = &render->priority_rect;
+  GimpArea                 *best     = NULL;
+  gboolean                  best_visible = FALSE;
+  gint64                    best_dist    = G_MAXINT64;
+  GSList                   *list;
+
+  for (list = render->update_areas; list; list = g_slist_next (list))
+    {
+      GimpArea *area = list->data;
+      gboolean  visible;
+      gint64    dx, dy;
+      gint64    dist;
 
-                  gimp_projectable_invalidate_preview (proj->projectable);
-                }
+      visible = (viewport->width > 0 && viewport->height > 0   &&
+                 area->x1 < viewport->x + viewport->width       &&
+                 area->x2 > viewport->x                         &&
+                 area->y1 < viewport->y + viewport->height      &&
+                 area->y2 > viewport->y);
 
-              return FALSE;
-            }
+      if (best_visible && ! visible)
+        continue;
+
+      dx = CLAMP (render->priority_x, area->x1, area->x2) - render->priority_x;
+      dy = CLAMP (render->priority_y, area->y1, area->y2) - render->priority_y;
+
+      dist = dx * dx + dy * dy;
+
+      if ((visible && ! best_visible) || dist < best_dist)
+        {
+          best         = area;
+          best_visible = visible;
+          best_dist    = dist;
         }
     }
 
-  /* Still work to do. */
-  return TRUE;
+  render->update_areas = g_slist_remove (render->update_areas, best);
+
+  if (best_visible)
+    {
+      gint x1 = MAX (best->x1, viewport->x);
+      gint y1 = MAX (best->y1, viewport->y);
+      gint x2 = MIN (best->x2, viewport->x + viewport->width);
+      gint y2 = MIN (best->y2, viewport->y + viewport->height);
+
+      if (y1 > best->y1)
+        render->update_areas =
+          g_slist_prepend (render->update_areas,
+                           gimp_area_new (best->x1, best->y1, best->x2, y1));
+
+      if (y2 < best->y2)
+        render->update_areas =
+          g_slist_prepend (render->update_areas,
+                           gimp_area_new (best->x1, y2, best->x2, best->y2));
+
+      if (x1 > best->x1)
+        render->update_areas =
+          g_slist_prepend (render->update_areas,
+                           gimp_area_new (best->x1, y1, x1, y2));
+
+      if (x2 < best->x2)
+        render->update_areas =
+          g_slist_prepend (render->update_areas,
+                           gimp_area_new (x2, y1, best->x2, y2));
+
+      best->x1 = x1;
+      best->y1 = y1;
+      best->x2 = x2;
+      best->y2 = y2;
+    }
+
+  return best;
 }
 
 static gboolean
@@ -615,21 +801,180 @@ gimp_projection_idle_render_next_area (GimpProjection *proj)
   if (! proj->idle_render.update_areas)
     return FALSE;
 
-  area = proj->idle_render.update_areas->data;
-
-  proj->idle_render.update_areas =
-    g_slist_remove (proj->idle_render.update_areas, area);
+  area = gimp_projection_idle_render_take_area (proj);
 
   proj->idle_render.x      = proj->idle_render.base_x = area->x1;
   proj->idle_render.y      = proj->idle_render.base_y = area->y1;
   proj->idle_render.width  = area->x2 - area->x1;
   proj->idle_render.height = area->y2 - area->y1;
 
+  proj->idle_render.row_height = 0;
+  proj->idle_render.active     = TRUE;
+
   gimp_area_free (area);
 
   return TRUE;
 }
 
+/*  walks the current area in rows of chunks, moving on to the next
+ *  area when it is done.  Chunk boundaries are kept on a grid of the
+ *  current chunk size, so that they line up with the buffer's tiles.
+ */
+static gboolean
+gimp_projection_idle_render_next_chunk (GimpProjection *proj,
+                                        GeglRectangle  *chunk)
+{
+  GimpProjectionIdleRender *render = &proj->idle_render;
+  gint                      x2, y2;
+
+  if (! render->active)
+    return FALSE;
+
+  while (render->width  <= 0 ||
+         render->height <= 0 ||
+         render->y >= render->base_y + render->height)
+    {
+      if (! gimp_projection_idle_render_next_area (proj))
+        {
+          render->active = FALSE;
+
+          return FALSE;
+        }
+    }
+
+  x2 = render->base_x + render->width;
+  y2 = render->base_y + render->height;
+
+  if (render->row_height == 0)
+    {
+      render->row_height = MIN (y2, (render->y / render->chunk_height + 1) *
+                                    render->chunk_height) - render->y;
+    }
+
+  chunk->x      = render->x;
+  chunk->y      = render->y;
+  chunk->width  = MIN (x2, (render->x / render->chunk_width + 1) *
+                           render->chunk_width) - render->x;
+  chunk->height = render->row_height;
+
+  render->x += chunk->width;
+
+  if (render->x >= x2)
+    {
+      render->x          = render->base_x;
+      render->y         += render->row_height;
+      render->row_height = 0;
+    }
+
+  return TRUE;
+}
+
+/*  renders a chunk of the projection into its buffer and emits
+ *  "update" for it
+ */
+static void
+gimp_projection_chunk_render (GimpProjection      *proj,
+                              const GeglRectangle *rect)
+{
+  GimpTileHandlerProjection *handler = proj->validate_handler;
+  GeglRectangle              tiles;
+  gint                       width, height;
+  gint                       x1, y1, x2, y2;
+  gint                       x, y;
+  gint64                     start;
+
+  gimp_projectable_get_size (proj->projectable, &width, &height);
+
+  /*  Bounds check  */
+  x1 = CLAMP (rect->x,                0, width);
+  y1 = CLAMP (rect->y,                0, height);
+  x2 = CLAMP (rect->x + rect->width,  0, width);
+  y2 = CLAMP (rect->y + rect->height, 0, height);
+
+  if (x1 >= x2 || y1 >= y2)
+    return;
+
+  gimp_projection_invalidate (proj, x1, y1, x2 - x1, y2 - y1);
+
+  tiles.x      = x1 / handler->tile_width  * handler->tile_width;
+  tiles.y      = y1 / handler->tile_height * handler->tile_height;
+  tiles.width  = MIN (width,
+                      (x2 + handler->tile_width  - 1) / handler->tile_width *
+                      handler->tile_width) - tiles.x;
+  tiles.height = MIN (height,
+                      (y2 + handler->tile_height - 1) / handler->tile_height *
+                      handler->tile_height) - tiles.y;
+
+  start = g_get_monotonic_time ();
+
+  /*  fetching the tiles makes the validate handler render the graph
+   *  right into them
+   */
+  for (y = tiles.y; y < tiles.y + tiles.height; y += handler->tile_height)
+    for (x = tiles.x; x < tiles.x + tiles.width; x += handler->tile_width)
+      {
+        GeglTile *tile;
+
+        tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (proj->buffer),
+                                          x / handler->tile_width,
+                                          y / handler->tile_height,
+                                          0);
+        if (tile)
+          gegl_tile_unref (tile);
+      }
+
+  gimp_projection_chunk_adapt_size (proj, &tiles,
+                                    g_get_monotonic_time () - start);
+
+  gimp_projection_emit_update (proj, TRUE, x1, y1, x2 - x1, y2 - y1);
+}
+
+/*  doubles or halves the chunk size, one side at a time, so that a
+ *  chunk takes roughly GIMP_PROJECTION_CHUNK_TIME to render
+ */
+static void
+gimp_projection_chunk_adapt_size (GimpProjection      *proj,
+                                  const GeglRectangle *rect,
+                                  gint64               time)
+{
+  GimpProjectionIdleRender  *render  = &proj->idle_render;
+  GimpTileHandlerProjection *handler = proj->validate_handler;
+  gint64                     n_pixels;
+
+  n_pixels = (gint64) rect->width * rect->height;
+
+  if (n_pixels == 0)
+    return;
+
+  /*  the time a chunk of the current size would take  */
+  time = time * render->chunk_width * render->chunk_height / n_pixels;
+
+  if (time < GIMP_PROJECTION_CHUNK_TIME / 2)
+    {
+      if (render->chunk_width <= render->chunk_height &&
+          render->chunk_width <  GIMP_PROJECTION_CHUNK_MAX_WIDTH)
+        {
+          render->chunk_width *= 2;
+        }
+      else if (render->chunk_height < GIMP_PROJECTION_CHUNK_MAX_HEIGHT)
+        {
+          render->chunk_height *= 2;
+        }
+    }
+  else if (time > GIMP_PROJECTION_CHUNK_TIME * 2)
+    {
+      if (render->chunk_width >= render->chunk_height &&
+          render->chunk_width >  handler->tile_width)
+        {
+          render->chunk_width /= 2;
+        }
+      else if (render->chunk_height > handler->tile_height)
+        {
+          render->chunk_height /= 2;
+        }
+    }
+}
+
 static void
 gimp_projection_paint_area (GimpProjection *proj,
                             gboolean        now,
@@ -638,12 +983,10 @@ gimp_projection_paint_area (GimpProjection *proj,
                             gint            w,
                             gint            h)
 {
-  gint off_x, off_y;
   gint width, height;
   gint x1, y1, x2, y2;
 
-  gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
-  gimp_projectable_get_size   (proj->projectable, &width, &height);
+  gimp_projectable_get_size (proj->projectable, &width, &height);
 
   /*  Bounds check  */
   x1 = CLAMP (x,     0, width);
@@ -653,16 +996,31 @@ gimp_projection_paint_area (GimpProjection *proj,
 
   gimp_projection_invalidate (proj, x1, y1, x2 - x1, y2 - y1);
 
+  gimp_projection_emit_update (proj, now, x1, y1, x2 - x1, y2 - y1);
+}
+
+static void
+gimp_projection_emit_update (GimpProjection *proj,
+                             gboolean        now,
+                             gint            x,
+                             gint            y,
+                             gint            w,
+                             gint            h)
+{
+  gint off_x, off_y;
+
+  gimp_projectable_get_offset (proj->projectable, &off_x, &off_y);
+
   /*  add the projectable's offsets because the list of update areas
    *  is in tile-pyramid coordinates, but our external API is always
    *  in terms of image coordinates.
    */
   g_signal_emit (proj, projection_signals[UPDATE], 0,
                  now,
-                 x1 + off_x,
-                 y1 + off_y,
-                 x2 - x1,
-                 y2 - y1);
+                 x + off_x,
+                 y + off_y,
+                 w,
+                 h);
 }
 
 static void
@@ -715,6 +1073,8 @@ gimp_projection_projectable_changed (GimpProjectable *projectable,
       proj->idle_render.idle_id = 0;
     }
 
+  proj->idle_render.active = FALSE;
+
   gimp_area_list_free (proj->update_areas);
   proj->update_areas = NULL;
 
@@ -26,14 +26,23 @@ typedef struct _GimpProjectionIdleRender GimpProjectionIdleRender;
 
 struct _GimpProjectionIdleRender
 {
-  gint    width;
-  gint    height;
-  gint    x;
-  gint    y;
-  gint    base_x;
-  gint    base_y;
-  guint   idle_id;
-  GSList *update_areas;   /*  flushed update areas */
+  gint          width;
+  gint          height;
+  gint          x;
+  gint          y;
+  gint          base_x;
+  gint          base_y;
+  gint          row_height;
+  gboolean      active;         /*  an area is being walked            */
+  guint         idle_id;
+  GSList       *update_areas;   /*  flushed update areas               */
+
+  gint          chunk_width;    /*  adapted to the measured chunk cost */
+  gint          chunk_height;
+
+  GeglRectangle priority_rect;  /*  the visible viewport               */
+  gint          priority_x;     /*  the pointer                        */
+  gint          priority_y;
 };
 
 
@@ -84,6 +93,17 @@ void             gimp_projection_flush            (GimpProjection    *proj);
 void             gimp_projection_flush_now        (GimpProjection    *proj);
 void             gimp_projection_finish_draw      (GimpProjection    *proj);
 
+void             gimp_projection_set_priority_rect
+                                                  (GimpProjection    *proj,
+                                                   gint               x,
+                                                   gint               y,
+                                                   gint               width,
+                                                   gint               height);
+void             gimp_projection_set_priority_point
+                                                  (GimpProjection    *proj,
+                                                   gint               x,
+                                                   gint               y);
+
 gint64           gimp_projection_estimate_memsize (GimpImageBaseType  type,
                                                    GimpPrecision      precision,
                                                    gint               width,
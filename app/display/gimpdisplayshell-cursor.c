@@ -25,6 +25,7 @@
 #include "config/gimpguiconfig.h"
 
 #include "core/gimpimage.h"
+#include "core/gimpprojection.h"
 
 #include "widgets/gimpcursor.h"
 #include "widgets/gimpdialogfactory.h"
@@ -151,6 +152,11 @@ gimp_display_shell_update_software_cursor (GimpDisplayShell    *shell,
       gimp_canvas_item_set_visible (shell->cursor, FALSE);
     }
 
+  /*  render the projection around the pointer first  */
+  if (image)
+    gimp_projection_set_priority_point (gimp_image_get_projection (image),
+                                        image_x, image_y);
+
   /*  use the passed image_coords for the statusbar because they are
    *  possibly snapped...
    */
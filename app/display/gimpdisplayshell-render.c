@@ -17,6 +17,8 @@
 
 #include "config.h"
 
+#include <math.h>
+
 #include <gegl.h>
 #include <gtk/gtk.h>
 
@@ -37,12 +39,40 @@
 
 #include "gimpdisplay.h"
 #include "gimpdisplayshell.h"
+#include "gimpdisplayshell-expose.h"
 #include "gimpdisplayshell-transform.h"
 #include "gimpdisplayshell-filter.h"
 #include "gimpdisplayshell-render.h"
 #include "gimpdisplayshell-scroll.h"
 #include "gimpdisplayxfer.h"
 
+#include "gimp-log.h"
+
+
+/*  while the user pans or zooms, downsampled exposes are served from
+ *  a coarser pyramid level, by as many levels as the zoom is below 1:1
+ *  but at most MAX_COARSE_LEVELS, and refined once navigation has
+ *  paused for REFINE_DELAY ms
+ */
+#define GIMP_DISPLAY_RENDER_MAX_COARSE_LEVELS 2
+#define GIMP_DISPLAY_RENDER_REFINE_DELAY      150
+
+
+static gint     gimp_display_shell_render_coarse_levels
+                                                 (gdouble           scale);
+static void     gimp_display_shell_render_coarse (GimpDisplayShell *shell,
+                                                  cairo_t          *cr,
+                                                  GeglBuffer       *buffer,
+                                                  gint              levels,
+                                                  gdouble           window_scale,
+                                                  gint              viewport_offset_x,
+                                                  gint              viewport_offset_y,
+                                                  gint              x,
+                                                  gint              y,
+                                                  gint              w,
+                                                  gint              h);
+static gboolean gimp_display_shell_render_refine (gpointer          data);
+
 
 void
 gimp_display_shell_render (GimpDisplayShell *shell,
@@ -64,6 +94,8 @@ gimp_display_shell_render (GimpDisplayShell *shell,
   gint             src_x, src_y;
   gint             stride;
   guchar          *data;
+  gint64           start_time;
+  gint             coarse_levels;
 
   g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
   g_return_if_fail (cr != NULL);
@@ -73,6 +105,8 @@ gimp_display_shell_render (GimpDisplayShell *shell,
   projection = gimp_image_get_projection (image);
   buffer     = gimp_pickable_get_buffer (GIMP_PICKABLE (projection));
 
+  start_time = g_get_monotonic_time ();
+
 #ifdef GIMP_DISPLAY_RENDER_ENABLE_SCALING
   /* if we had this future API, things would look pretty on hires (retina) */
   window_scale = gdk_window_get_scale_factor (gtk_widget_get_window (gtk_widget_get_toplevel (GTK_WIDGET (shell))));
@@ -85,6 +119,27 @@ gimp_display_shell_render (GimpDisplayShell *shell,
                                                  &viewport_offset_y,
                                                  &viewport_width,
                                                  &viewport_height);
+
+  /*  only downsampled exposes profit from a coarser level  */
+  coarse_levels =
+    gimp_display_shell_render_coarse_levels (shell->scale_x * window_scale);
+
+  if (shell->render_progressive  &&
+      ! shell->rotate_transform  &&
+      coarse_levels > 0)
+    {
+      gimp_display_shell_render_coarse (shell, cr, buffer, coarse_levels,
+                                        window_scale,
+                                        viewport_offset_x, viewport_offset_y,
+                                        x, y, w, h);
+
+      GIMP_LOG (RENDER, "coarse expose %d,%d %dx%d at scale %.4f, "
+                "%d levels up: %.2f ms",
+                x, y, w, h, shell->scale_x, coarse_levels,
+                (g_get_monotonic_time () - start_time) / 1000.0);
+      return;
+    }
+
   if (shell->rotate_transform)
     {
       xfer = cairo_surface_create_similar_image (cairo_get_target (cr),
@@ -194,4 +249,137 @@ gimp_display_shell_render (GimpDisplayShell *shell,
 #endif
 
   cairo_restore (cr);
+
+  GIMP_LOG (RENDER, "expose %d,%d %dx%d at scale %.4f: %.2f ms",
+            x, y, w, h, shell->scale_x,
+            (g_get_monotonic_time () - start_time) / 1000.0);
+}
+
+/**
+ * gimp_display_shell_render_navigate:
+ * @shell: a #GimpDisplayShell
+ *
+ * Called when @shell is scrolled or zoomed. Until navigation pauses,
+ * exposes are rendered from a coarser level of the projection's tile
+ * pyramid and scaled up, afterwards everything that was rendered that
+ * way is exposed again at the exact level.
+ **/
+void
+gimp_display_shell_render_navigate (GimpDisplayShell *shell)
+{
+  g_return_if_fail (GIMP_IS_DISPLAY_SHELL (shell));
+
+  shell->render_progressive = TRUE;
+
+  if (shell->render_refine_id)
+    g_source_remove (shell->render_refine_id);
+
+  shell->render_refine_id =
+    g_timeout_add_full (G_PRIORITY_LOW, GIMP_DISPLAY_RENDER_REFINE_DELAY,
+                        gimp_display_shell_render_refine, shell,
+                        NULL);
+}
+
+
+/*  private functions  */
+
+/*  the number of levels the pyramid level matching @scale is above
+ *  level 0, that is floor (log2 (1 / scale)), capped at
+ *  GIMP_DISPLAY_RENDER_MAX_COARSE_LEVELS
+ */
+static gint
+gimp_display_shell_render_coarse_levels (gdouble scale)
+{
+  gint levels = 0;
+
+  while (scale <= 0.5 && levels < GIMP_DISPLAY_RENDER_MAX_COARSE_LEVELS)
+    {
+      scale *= 2.0;
+      levels++;
+    }
+
+  return levels;
+}
+
+static void
+gimp_display_shell_render_coarse (GimpDisplayShell *shell,
+                                  cairo_t          *cr,
+                                  GeglBuffer       *buffer,
+                                  gint              levels,
+                                  gdouble           window_scale,
+                                  gint              viewport_offset_x,
+                                  gint              viewport_offset_y,
+                                  gint              x,
+                                  gint              y,
+                                  gint              w,
+                                  gint              h)
+{
+  cairo_surface_t *surface;
+  gdouble          factor = 1 << levels;
+  gdouble          scale  = shell->scale_x * window_scale / factor;
+  gint             x1, y1;
+  gint             x2, y2;
+
+  /*  the exposed area in the coarse level's coordinates  */
+  x1 = floor ((x + viewport_offset_x) * window_scale / factor);
+  y1 = floor ((y + viewport_offset_y) * window_scale / factor);
+  x2 = ceil  ((x + w + viewport_offset_x) * window_scale / factor);
+  y2 = ceil  ((y + h + viewport_offset_y) * window_scale / factor);
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                        x2 - x1, y2 - y1);
+  cairo_surface_flush (surface);
+
+  gegl_buffer_get (buffer,
+                   GEGL_RECTANGLE (x1, y1, x2 - x1, y2 - y1),
+                   scale,
+                   babl_format ("cairo-ARGB32"),
+                   cairo_image_surface_get_data (surface),
+                   cairo_image_surface_get_stride (surface),
+                   GEGL_ABYSS_NONE);
+
+  if (shell->filter_stack)
+    gimp_color_display_stack_convert_surface (shell->filter_stack, surface);
+
+  cairo_surface_mark_dirty (surface);
+
+  cairo_save (cr);
+
+  cairo_rectangle (cr, x, y, w, h);
+  cairo_clip (cr);
+
+  cairo_scale (cr, factor / window_scale, factor / window_scale);
+
+  cairo_set_source_surface (cr, surface,
+                            x1 - viewport_offset_x * window_scale / factor,
+                            y1 - viewport_offset_y * window_scale / factor);
+  cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_BILINEAR);
+
+  cairo_paint (cr);
+
+  cairo_restore (cr);
+
+  cairo_surface_destroy (surface);
+
+  shell->render_coarse = TRUE;
+}
+
+static gboolean
+gimp_display_shell_render_refine (gpointer data)
+{
+  GimpDisplayShell *shell = data;
+
+  shell->render_refine_id   = 0;
+  shell->render_progressive = FALSE;
+
+  if (shell->render_coarse)
+    {
+      GIMP_LOG (RENDER, "navigation paused, refining");
+
+      shell->render_coarse = FALSE;
+
+      gimp_display_shell_expose_full (shell);
+    }
+
+  return FALSE;
 }
@@ -25,4 +25,6 @@ void  gimp_display_shell_render (GimpDisplayShell *shell,
                                  gint              w,
                                  gint              h);
 
+void  gimp_display_shell_render_navigate (GimpDisplayShell *shell);
+
 #endif  /*  __GIMP_DISPLAY_SHELL_RENDER_H__  */
@@ -170,6 +170,8 @@ static void   gimp_display_shell_transform_overlay (GimpDisplayShell *shell,
                                                     GtkWidget        *child,
                                                     gdouble          *x,
                                                     gdouble          *y);
+static void   gimp_display_shell_update_priority_rect
+                                                   (GimpDisplayShell *shell);
 
 
 G_DEFINE_TYPE_WITH_CODE (GimpDisplayShell, gimp_display_shell,
@@ -787,6 +789,12 @@ gimp_display_shell_dispose (GObject *object)
       shell->filter_idle_id = 0;
     }
 
+  if (shell->render_refine_id)
+    {
+      g_source_remove (shell->render_refine_id);
+      shell->render_refine_id = 0;
+    }
+
   if (shell->mask_surface)
     {
       cairo_surface_destroy (shell->mask_surface);
@@ -1183,6 +1191,25 @@ gimp_display_shell_transform_overlay (GimpDisplayShell *shell,
     }
 }
 
+/*  lets the projection render what is visible in this shell first  */
+static void
+gimp_display_shell_update_priority_rect (GimpDisplayShell *shell)
+{
+  GimpImage *image = gimp_display_get_image (shell->display);
+
+  if (image)
+    {
+      gint x, y;
+      gint width, height;
+
+      gimp_display_shell_untransform_viewport (shell,
+                                               &x, &y, &width, &height);
+
+      gimp_projection_set_priority_rect (gimp_image_get_projection (image),
+                                         x, y, width, height);
+    }
+}
+
 
 /*  public functions  */
 
@@ -1473,6 +1500,9 @@ gimp_display_shell_scaled (GimpDisplayShell *shell)
                                            child, x, y);
     }
 
+  gimp_display_shell_update_priority_rect (shell);
+  gimp_display_shell_render_navigate (shell);
+
   g_signal_emit (shell, display_shell_signals[SCALED], 0);
 }
 
@@ -1496,6 +1526,9 @@ gimp_display_shell_scrolled (GimpDisplayShell *shell)
                                            child, x, y);
     }
 
+  gimp_display_shell_update_priority_rect (shell);
+  gimp_display_shell_render_navigate (shell);
+
   g_signal_emit (shell, display_shell_signals[SCROLLED], 0);
 }
 
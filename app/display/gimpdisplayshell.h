@@ -139,6 +139,10 @@ struct _GimpDisplayShell
 
   guint              fill_idle_id;     /*  display_shell_fill() idle ID       */
 
+  gboolean           render_progressive;/* serve exposes from coarse levels  */
+  gboolean           render_coarse;    /*  coarse pixels are on screen        */
+  guint              render_refine_id; /*  refinement timeout ID              */
+
   GimpHandedness     cursor_handedness;/*  Handedness for cursor display      */
   GimpCursorType     current_cursor;   /*  Currently installed main cursor    */
   GimpToolCursorType tool_cursor;      /*  Current Tool cursor                */
@@ -59,6 +59,8 @@
 
 #include "plug-in/gimppluginprocedure.h"
 
+#include "text/gimptextlayer.h"
+
 #include "file-save.h"
 #include "file-utils.h"
 #include "gimp-file.h"
@@ -104,6 +106,9 @@ file_save (Gimp                *gimp,
   if (! drawable)
     return GIMP_PDB_EXECUTION_ERROR;
 
+  /*  save the text that text layers show  */
+  gimp_text_layer_flush_all ();
+
   filename = file_utils_filename_from_uri (uri);
 
   if (filename)
@@ -0,0 +1,428 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <cairo.h>
+#include <gegl.h>
+
+#include "gimp-gegl-types.h"
+
+#include "gimptilehandlersnapshot.h"
+
+
+#define TILE_KEY(x,y) GUINT_TO_POINTER (((guint) (y) << 16) | (guint) (x))
+
+
+enum
+{
+  PROP_0,
+  PROP_FORMAT,
+  PROP_TILE_WIDTH,
+  PROP_TILE_HEIGHT
+};
+
+
+static void     gimp_tile_handler_snapshot_finalize     (GObject         *object);
+static void     gimp_tile_handler_snapshot_set_property (GObject         *object,
+                                                         guint            property_id,
+                                                         const GValue    *value,
+                                                         GParamSpec      *pspec);
+static void     gimp_tile_handler_snapshot_get_property (GObject         *object,
+                                                         guint            property_id,
+                                                         GValue          *value,
+                                                         GParamSpec      *pspec);
+
+static gpointer gimp_tile_handler_snapshot_command      (GeglTileSource  *source,
+                                                         GeglTileCommand  command,
+                                                         gint             x,
+                                                         gint             y,
+                                                         gint             z,
+                                                         gpointer         data);
+
+
+G_DEFINE_TYPE (GimpTileHandlerSnapshot, gimp_tile_handler_snapshot,
+               GEGL_TYPE_TILE_HANDLER)
+
+#define parent_class gimp_tile_handler_snapshot_parent_class
+
+
+static void
+gimp_tile_handler_snapshot_class_init (GimpTileHandlerSnapshotClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize     = gimp_tile_handler_snapshot_finalize;
+  object_class->set_property = gimp_tile_handler_snapshot_set_property;
+  object_class->get_property = gimp_tile_handler_snapshot_get_property;
+
+  g_object_class_install_property (object_class, PROP_FORMAT,
+                                   g_param_spec_pointer ("format", NULL, NULL,
+                                                         GIMP_PARAM_READWRITE));
+
+  g_object_class_install_property (object_class, PROP_TILE_WIDTH,
+                                   g_param_spec_int ("tile-width", NULL, NULL,
+                                                     1, G_MAXINT, 1,
+                                                     GIMP_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+
+  g_object_class_install_property (object_class, PROP_TILE_HEIGHT,
+                                   g_param_spec_int ("tile-height", NULL, NULL,
+                                                     1, G_MAXINT, 1,
+                                                     GIMP_PARAM_READWRITE |
+                                                     G_PARAM_CONSTRUCT));
+}
+
+static void
+gimp_tile_handler_snapshot_init (GimpTileHandlerSnapshot *snapshot)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (snapshot);
+
+  source->command = gimp_tile_handler_snapshot_command;
+
+  snapshot->present         = g_hash_table_new (g_direct_hash,
+                                                g_direct_equal);
+  snapshot->captured_region = cairo_region_create ();
+}
+
+static void
+gimp_tile_handler_snapshot_finalize (GObject *object)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (object);
+
+  if (snapshot->source)
+    {
+      g_object_unref (snapshot->source);
+      snapshot->source = NULL;
+    }
+
+  g_hash_table_unref (snapshot->present);
+  snapshot->present = NULL;
+
+  cairo_region_destroy (snapshot->captured_region);
+  snapshot->captured_region = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gimp_tile_handler_snapshot_set_property (GObject      *object,
+                                         guint         property_id,
+                                         const GValue *value,
+                                         GParamSpec   *pspec)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (object);
+
+  switch (property_id)
+    {
+    case PROP_FORMAT:
+      snapshot->format = g_value_get_pointer (value);
+      break;
+    case PROP_TILE_WIDTH:
+      snapshot->tile_width = g_value_get_int (value);
+      break;
+    case PROP_TILE_HEIGHT:
+      snapshot->tile_height = g_value_get_int (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+static void
+gimp_tile_handler_snapshot_get_property (GObject    *object,
+                                         guint       property_id,
+                                         GValue     *value,
+                                         GParamSpec *pspec)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (object);
+
+  switch (property_id)
+    {
+    case PROP_FORMAT:
+      g_value_set_pointer (value, (gpointer) snapshot->format);
+      break;
+    case PROP_TILE_WIDTH:
+      g_value_set_int (value, snapshot->tile_width);
+      break;
+    case PROP_TILE_HEIGHT:
+      g_value_set_int (value, snapshot->tile_height);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+    }
+}
+
+/*  copies a tile from the source buffer, which must not have been
+ *  modified in that tile yet, and stores it below us
+ */
+static GeglTile *
+gimp_tile_handler_snapshot_copy (GeglTileSource *source,
+                                 GeglTile       *tile,
+                                 gint            x,
+                                 gint            y)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (source);
+  gint                     tile_bpp;
+
+  if (tile)
+    gegl_tile_unref (tile);
+
+  tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (source), x, y, 0);
+
+  tile_bpp = babl_format_get_bytes_per_pixel (snapshot->format);
+
+  gegl_tile_lock (tile);
+
+  gegl_buffer_get (snapshot->source,
+                   GEGL_RECTANGLE (x * snapshot->tile_width,
+                                   y * snapshot->tile_height,
+                                   snapshot->tile_width,
+                                   snapshot->tile_height),
+                   1.0, snapshot->format,
+                   gegl_tile_get_data (tile),
+                   tile_bpp * snapshot->tile_width,
+                   GEGL_ABYSS_NONE);
+
+  gegl_tile_unlock (tile);
+
+  gegl_tile_handler_source_command (source, GEGL_TILE_SET, x, y, 0, tile);
+
+  g_hash_table_add (snapshot->present, TILE_KEY (x, y));
+
+  return tile;
+}
+
+static gpointer
+gimp_tile_handler_snapshot_command (GeglTileSource  *source,
+                                    GeglTileCommand  command,
+                                    gint             x,
+                                    gint             y,
+                                    gint             z,
+                                    gpointer         data)
+{
+  GimpTileHandlerSnapshot *snapshot = GIMP_TILE_HANDLER_SNAPSHOT (source);
+  gpointer                 retval;
+
+  retval = gegl_tile_handler_source_command (source, command, x, y, z, data);
+
+  if (command == GEGL_TILE_GET && z == 0 && snapshot->source &&
+      ! g_hash_table_contains (snapshot->present, TILE_KEY (x, y)))
+    {
+      retval = gimp_tile_handler_snapshot_copy (source, retval, x, y);
+    }
+
+  return retval;
+}
+
+GeglTileHandler *
+gimp_tile_handler_snapshot_new (GeglBuffer *source)
+{
+  GimpTileHandlerSnapshot *snapshot;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (source), NULL);
+
+  snapshot = g_object_new (GIMP_TYPE_TILE_HANDLER_SNAPSHOT, NULL);
+
+  snapshot->source = g_object_ref (source);
+
+  return GEGL_TILE_HANDLER (snapshot);
+}
+
+/**
+ * gimp_gegl_buffer_snapshot_new:
+ * @source: a #GeglBuffer
+ *
+ * Creates a buffer which reads like a copy of @source, without
+ * copying anything up front.  Call gimp_gegl_buffer_snapshot_capture()
+ * before every modification of @source.
+ *
+ * Return value: the snapshot buffer.
+ **/
+GeglBuffer *
+gimp_gegl_buffer_snapshot_new (GeglBuffer *source)
+{
+  GeglBuffer      *snapshot;
+  GeglTileHandler *handler;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (source), NULL);
+
+  snapshot = gegl_buffer_new (gegl_buffer_get_extent (source),
+                              gegl_buffer_get_format (source));
+
+  handler = gimp_tile_handler_snapshot_new (source);
+
+  gegl_buffer_add_handler (snapshot, handler);
+
+  g_object_set_data_full (G_OBJECT (snapshot), "gimp-snapshot-handler",
+                          handler,
+                          (GDestroyNotify) g_object_unref);
+
+  return snapshot;
+}
+
+/**
+ * gimp_gegl_buffer_snapshot_capture:
+ * @snapshot: a buffer returned by gimp_gegl_buffer_snapshot_new()
+ * @rect:     the area of the source that is about to be modified
+ *
+ * Copies the tiles of the source intersecting @rect into @snapshot,
+ * unless that happened before, and records them as captured.
+ **/
+void
+gimp_gegl_buffer_snapshot_capture (GeglBuffer          *snapshot,
+                                   const GeglRectangle *rect)
+{
+  GimpTileHandlerSnapshot *handler;
+  GeglRectangle            area;
+  cairo_rectangle_int_t    tiles;
+  gint                     x, y;
+
+  g_return_if_fail (GEGL_IS_BUFFER (snapshot));
+  g_return_if_fail (rect != NULL);
+
+  handler = g_object_get_data (G_OBJECT (snapshot), "gimp-snapshot-handler");
+
+  g_return_if_fail (GIMP_IS_TILE_HANDLER_SNAPSHOT (handler));
+
+  if (! gegl_rectangle_intersect (&area, rect,
+                                  gegl_buffer_get_extent (snapshot)))
+    return;
+
+  tiles.x      = area.x / handler->tile_width;
+  tiles.y      = area.y / handler->tile_height;
+  tiles.width  = (area.x + area.width  - 1) / handler->tile_width  + 1 - tiles.x;
+  tiles.height = (area.y + area.height - 1) / handler->tile_height + 1 - tiles.y;
+
+  for (y = tiles.y; y < tiles.y + tiles.height; y++)
+    {
+      for (x = tiles.x; x < tiles.x + tiles.width; x++)
+        {
+          if (! g_hash_table_contains (handler->present, TILE_KEY (x, y)))
+            {
+              GeglTile *tile;
+
+              tile = gegl_tile_source_get_tile (GEGL_TILE_SOURCE (handler),
+                                                x, y, 0);
+              if (tile)
+                gegl_tile_unref (tile);
+            }
+        }
+    }
+
+  tiles.x      *= handler->tile_width;
+  tiles.y      *= handler->tile_height;
+  tiles.width  *= handler->tile_width;
+  tiles.height *= handler->tile_height;
+
+  cairo_region_union_rectangle (handler->captured_region, &tiles);
+}
+
+/**
+ * gimp_gegl_buffer_snapshot_detach:
+ * @snapshot: a buffer returned by gimp_gegl_buffer_snapshot_new()
+ *
+ * Lets go of the source, when it is not going to be modified any
+ * more. Only the captured tiles are kept, the rest of @snapshot
+ * reads as empty from now on.
+ **/
+void
+gimp_gegl_buffer_snapshot_detach (GeglBuffer *snapshot)
+{
+  GimpTileHandlerSnapshot *handler;
+  GHashTableIter           iter;
+  gpointer                 key;
+
+  g_return_if_fail (GEGL_IS_BUFFER (snapshot));
+
+  handler = g_object_get_data (G_OBJECT (snapshot), "gimp-snapshot-handler");
+
+  g_return_if_fail (GIMP_IS_TILE_HANDLER_SNAPSHOT (handler));
+
+  if (! handler->source)
+    return;
+
+  /*  drop the tiles which were only read  */
+  g_hash_table_iter_init (&iter, handler->present);
+
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      guint                 tile = GPOINTER_TO_UINT (key);
+      cairo_rectangle_int_t rect;
+
+      rect.x      = (tile & 0xffff) * handler->tile_width;
+      rect.y      = (tile >> 16)    * handler->tile_height;
+      rect.width  = handler->tile_width;
+      rect.height = handler->tile_height;
+
+      if (cairo_region_contains_rectangle (handler->captured_region,
+                                           &rect) != CAIRO_REGION_OVERLAP_IN)
+        {
+          gegl_tile_handler_source_command (GEGL_TILE_SOURCE (handler),
+                                            GEGL_TILE_VOID,
+                                            tile & 0xffff, tile >> 16, 0,
+                                            NULL);
+        }
+    }
+
+  g_hash_table_remove_all (handler->present);
+
+  g_object_unref (handler->source);
+  handler->source = NULL;
+}
+
+/**
+ * gimp_gegl_buffer_is_snapshot:
+ * @buffer: a #GeglBuffer
+ *
+ * Return value: whether @buffer was returned by
+ *               gimp_gegl_buffer_snapshot_new().
+ **/
+gboolean
+gimp_gegl_buffer_is_snapshot (GeglBuffer *buffer)
+{
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), FALSE);
+
+  return g_object_get_data (G_OBJECT (buffer),
+                            "gimp-snapshot-handler") != NULL;
+}
+
+/**
+ * gimp_gegl_buffer_snapshot_get_captured_region:
+ * @snapshot: a buffer returned by gimp_gegl_buffer_snapshot_new()
+ *
+ * Return value: the tile-aligned area which has been passed to
+ *               gimp_gegl_buffer_snapshot_capture(), owned by
+ *               @snapshot.
+ **/
+cairo_region_t *
+gimp_gegl_buffer_snapshot_get_captured_region (GeglBuffer *snapshot)
+{
+  GimpTileHandlerSnapshot *handler;
+
+  g_return_val_if_fail (GEGL_IS_BUFFER (snapshot), NULL);
+
+  handler = g_object_get_data (G_OBJECT (snapshot), "gimp-snapshot-handler");
+
+  g_return_val_if_fail (GIMP_IS_TILE_HANDLER_SNAPSHOT (handler), NULL);
+
+  return handler->captured_region;
+}
@@ -31,6 +31,11 @@
 
 static GHashTable *class_hash = NULL;
 
+/*  objects are also created by worker threads, for example by the
+ *  data factories' loaders
+ */
+G_LOCK_DEFINE_STATIC (class_hash);
+
 
 void
 gimp_debug_enable_instances (void)
@@ -54,6 +59,8 @@ gimp_debug_add_instance (GObject      *instance,
 
       type_name = g_type_name (G_TYPE_FROM_CLASS (klass));
 
+      G_LOCK (class_hash);
+
       instance_hash = g_hash_table_lookup (class_hash, type_name);
 
       if (! instance_hash)
@@ -64,6 +71,8 @@ gimp_debug_add_instance (GObject      *instance,
         }
 
       g_hash_table_insert (instance_hash, instance, instance);
+
+      G_UNLOCK (class_hash);
     }
 }
 
@@ -77,6 +86,8 @@ gimp_debug_remove_instance (GObject *instance)
 
       type_name = g_type_name (G_OBJECT_TYPE (instance));
 
+      G_LOCK (class_hash);
+
       instance_hash = g_hash_table_lookup (class_hash, type_name);
 
       if (instance_hash)
@@ -86,6 +97,8 @@ gimp_debug_remove_instance (GObject *instance)
           if (g_hash_table_size (instance_hash) == 0)
             g_hash_table_remove (class_hash, type_name);
         }
+
+      G_UNLOCK (class_hash);
     }
 }
 
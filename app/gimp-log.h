@@ -39,7 +39,10 @@ typedef enum
   GIMP_LOG_AUTO_TAB_STYLE     = 1 << 15,
   GIMP_LOG_INSTANCES          = 1 << 16,
   GIMP_LOG_RECTANGLE_TOOL     = 1 << 17,
-  GIMP_LOG_BRUSH_CACHE        = 1 << 18
+  GIMP_LOG_BRUSH_CACHE        = 1 << 18,
+  GIMP_LOG_RENDER             = 1 << 19,
+  GIMP_LOG_UNDO               = 1 << 20,
+  GIMP_LOG_STARTUP            = 1 << 21
 } GimpLogFlags;
 
 
@@ -99,6 +102,9 @@ void   gimp_logv     (GimpLogFlags  flags,
 #define INSTANCES          GIMP_LOG_INSTANCES
 #define RECTANGLE_TOOL     GIMP_LOG_RECTANGLE_TOOL
 #define BRUSH_CACHE        GIMP_LOG_BRUSH_CACHE
+#define RENDER             GIMP_LOG_RENDER
+#define UNDO               GIMP_LOG_UNDO
+#define STARTUP            GIMP_LOG_STARTUP
 
 #if 0 /* last resort */
 #  define GIMP_LOG /* nothing => no varargs, no log */
@@ -0,0 +1,385 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "glib-object.h"
+
+#include "gimp-log.h"
+#include "gimp-trace.h"
+
+
+typedef struct
+{
+  gchar  *name;
+  gint64  start;
+  gint64  end;
+  gint    tid;
+  gint    depth;
+  guint   id;     /*  of an async phase, 0 otherwise  */
+} GimpTraceEvent;
+
+
+static gint     gimp_trace_add_event     (const gchar *format,
+                                          va_list      args,
+                                          gboolean     async);
+static void     gimp_trace_end_event     (guint        index);
+static void     gimp_trace_stack_free    (GArray      *stack);
+static GArray * gimp_trace_get_stack     (void);
+static gint     gimp_trace_get_tid       (void);
+static void     gimp_trace_append_string (GString     *string,
+                                          const gchar *str);
+
+
+static volatile gint  trace_enabled  = FALSE;
+static gchar         *trace_filename = NULL;
+static gint64         trace_start    = 0;
+static GArray        *trace_events   = NULL;
+static gint           trace_n_tids   = 0;
+static GMutex         trace_mutex;
+
+/*  per thread stack of indices into trace_events of the open phases  */
+static GPrivate       trace_stack    =
+  G_PRIVATE_INIT ((GDestroyNotify) gimp_trace_stack_free);
+static GPrivate       trace_tid      = G_PRIVATE_INIT (NULL);
+
+
+/*  public functions  */
+
+void
+gimp_trace_init (const gchar *filename)
+{
+  g_return_if_fail (trace_events == NULL);
+
+  if (! filename && ! (gimp_log_flags & GIMP_LOG_STARTUP))
+    return;
+
+  trace_filename = g_strdup (filename);
+  trace_start    = g_get_monotonic_time ();
+  trace_events   = g_array_new (FALSE, FALSE, sizeof (GimpTraceEvent));
+
+  /*  the calling thread is the main thread, give it tid 1  */
+  gimp_trace_get_tid ();
+
+  g_atomic_int_set (&trace_enabled, TRUE);
+}
+
+void
+gimp_trace_exit (void)
+{
+  GString *json;
+  gint64   now;
+  gint     i;
+
+  if (! g_atomic_int_get (&trace_enabled))
+    return;
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&trace_mutex);
+
+  g_atomic_int_set (&trace_enabled, FALSE);
+
+  json = g_string_new ("{\"traceEvents\":[\n");
+
+  g_string_append (json,
+                   "{\"name\":\"thread_name\",\"ph\":\"M\","
+                   "\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}}");
+
+  for (i = 0; i < trace_events->len; i++)
+    {
+      GimpTraceEvent *event = &g_array_index (trace_events,
+                                              GimpTraceEvent, i);
+
+      /*  phases still open at exit end now  */
+      if (! event->end)
+        event->end = now;
+
+      if (event->id)
+        {
+          /*  async phases are begin and end events with an id  */
+          g_string_append (json, ",\n{\"name\":");
+          gimp_trace_append_string (json, event->name);
+          g_string_append_printf (json,
+                                  ",\"cat\":\"startup\",\"ph\":\"b\","
+                                  "\"ts\":%" G_GINT64_FORMAT ","
+                                  "\"pid\":1,\"tid\":%d,\"id\":%u}",
+                                  event->start - trace_start,
+                                  event->tid, event->id);
+
+          g_string_append (json, ",\n{\"name\":");
+          gimp_trace_append_string (json, event->name);
+          g_string_append_printf (json,
+                                  ",\"cat\":\"startup\",\"ph\":\"e\","
+                                  "\"ts\":%" G_GINT64_FORMAT ","
+                                  "\"pid\":1,\"tid\":%d,\"id\":%u}",
+                                  event->end - trace_start,
+                                  event->tid, event->id);
+        }
+      else
+        {
+          g_string_append (json, ",\n{\"name\":");
+          gimp_trace_append_string (json, event->name);
+          g_string_append_printf (json,
+                                  ",\"cat\":\"startup\",\"ph\":\"X\","
+                                  "\"ts\":%" G_GINT64_FORMAT ","
+                                  "\"dur\":%" G_GINT64_FORMAT ","
+                                  "\"pid\":1,\"tid\":%d}",
+                                  event->start - trace_start,
+                                  event->end - event->start,
+                                  event->tid);
+        }
+
+      g_free (event->name);
+    }
+
+  g_string_append (json, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  g_array_free (trace_events, TRUE);
+  trace_events = NULL;
+
+  g_mutex_unlock (&trace_mutex);
+
+  if (trace_filename)
+    {
+      GError *error = NULL;
+
+      if (! g_file_set_contents (trace_filename, json->str, json->len,
+                                 &error))
+        {
+          g_printerr ("Could not write startup trace: %s\n", error->message);
+          g_clear_error (&error);
+        }
+
+      g_free (trace_filename);
+      trace_filename = NULL;
+    }
+
+  GIMP_LOG (STARTUP, "startup took %.3f ms",
+            (now - trace_start) / 1000.0);
+
+  g_string_free (json, TRUE);
+}
+
+void
+gimp_trace_begin (const gchar *format,
+                  ...)
+{
+  GArray  *stack;
+  gint     index;
+  guint    uindex;
+  va_list  args;
+
+  if (! g_atomic_int_get (&trace_enabled))
+    return;
+
+  va_start (args, format);
+  index = gimp_trace_add_event (format, args, FALSE);
+  va_end (args);
+
+  if (index < 0)
+    return;
+
+  stack  = gimp_trace_get_stack ();
+  uindex = index;
+
+  g_array_append_val (stack, uindex);
+}
+
+void
+gimp_trace_end (void)
+{
+  GArray *stack;
+  guint   index;
+
+  if (! g_atomic_int_get (&trace_enabled))
+    return;
+
+  stack = g_private_get (&trace_stack);
+
+  g_return_if_fail (stack != NULL && stack->len > 0);
+
+  index = g_array_index (stack, guint, stack->len - 1);
+  g_array_set_size (stack, stack->len - 1);
+
+  gimp_trace_end_event (index);
+}
+
+/**
+ * gimp_trace_begin_async:
+ * @format: printf() format of the phase's name
+ *
+ * Opens a phase which doesn't nest with the calling thread's other
+ * phases.
+ *
+ * Return value: the id to pass to gimp_trace_end_async(), 0 when
+ *               tracing is disabled.
+ */
+guint
+gimp_trace_begin_async (const gchar *format,
+                        ...)
+{
+  gint    index;
+  va_list args;
+
+  if (! g_atomic_int_get (&trace_enabled))
+    return 0;
+
+  va_start (args, format);
+  index = gimp_trace_add_event (format, args, TRUE);
+  va_end (args);
+
+  return index + 1;
+}
+
+void
+gimp_trace_end_async (guint id)
+{
+  if (id == 0 || ! g_atomic_int_get (&trace_enabled))
+    return;
+
+  gimp_trace_end_event (id - 1);
+}
+
+
+/*  private functions  */
+
+/*  returns the new event's index into trace_events, or -1 if
+ *  gimp_trace_exit() got here first
+ */
+static gint
+gimp_trace_add_event (const gchar *format,
+                      va_list      args,
+                      gboolean     async)
+{
+  GimpTraceEvent event;
+  gint           index;
+
+  event.name  = g_strdup_vprintf (format, args);
+  event.tid   = gimp_trace_get_tid ();
+  event.depth = gimp_trace_get_stack ()->len;
+  event.end   = 0;
+  event.start = g_get_monotonic_time ();
+
+  g_mutex_lock (&trace_mutex);
+
+  if (! trace_events)
+    {
+      g_mutex_unlock (&trace_mutex);
+      g_free (event.name);
+      return -1;
+    }
+
+  index    = trace_events->len;
+  event.id = async ? index + 1 : 0;
+
+  g_array_append_val (trace_events, event);
+
+  g_mutex_unlock (&trace_mutex);
+
+  return index;
+}
+
+static void
+gimp_trace_end_event (guint index)
+{
+  GimpTraceEvent *event;
+  gint64          end = g_get_monotonic_time ();
+
+  g_mutex_lock (&trace_mutex);
+
+  if (! trace_events)
+    {
+      g_mutex_unlock (&trace_mutex);
+      return;
+    }
+
+  event = &g_array_index (trace_events, GimpTraceEvent, index);
+
+  event->end = end;
+
+  GIMP_LOG (STARTUP, "%*s%s: %.3f ms",
+            2 * event->depth, "", event->name,
+            (event->end - event->start) / 1000.0);
+
+  g_mutex_unlock (&trace_mutex);
+}
+
+static void
+gimp_trace_stack_free (GArray *stack)
+{
+  g_array_free (stack, TRUE);
+}
+
+static GArray *
+gimp_trace_get_stack (void)
+{
+  GArray *stack = g_private_get (&trace_stack);
+
+  if (! stack)
+    {
+      stack = g_array_new (FALSE, FALSE, sizeof (guint));
+      g_private_set (&trace_stack, stack);
+    }
+
+  return stack;
+}
+
+static gint
+gimp_trace_get_tid (void)
+{
+  gint tid = GPOINTER_TO_INT (g_private_get (&trace_tid));
+
+  if (! tid)
+    {
+      tid = g_atomic_int_add (&trace_n_tids, 1) + 1;
+
+      g_private_set (&trace_tid, GINT_TO_POINTER (tid));
+    }
+
+  return tid;
+}
+
+static void
+gimp_trace_append_string (GString     *string,
+                          const gchar *str)
+{
+  g_string_append_c (string, '"');
+
+  for (; *str; str++)
+    {
+      switch (*str)
+        {
+        case '"':
+          g_string_append (string, "\\\"");
+          break;
+
+        case '\\':
+          g_string_append (string, "\\\\");
+          break;
+
+        default:
+          if ((guchar) *str < 0x20)
+            g_string_append_printf (string, "\\u%04x", (guchar) *str);
+          else
+            g_string_append_c (string, *str);
+          break;
+        }
+    }
+
+  g_string_append_c (string, '"');
+}
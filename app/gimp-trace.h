@@ -0,0 +1,47 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_TRACE_H__
+#define __GIMP_TRACE_H__
+
+
+/*  Startup tracing: phases are opened with gimp_trace_begin() and
+ *  closed with gimp_trace_end(), and may nest.  Tracing is enabled by
+ *  the --trace-startup command line option, which writes the phases
+ *  as a Chrome trace JSON file (load it in chrome://tracing), or by
+ *  the "startup" GIMP_LOG domain, which logs each phase's duration.
+ *  Both calls do nothing when tracing is disabled.
+ *
+ *  Phases that overlap other phases of the same thread, like the
+ *  queries of plug-ins that run at the same time, are opened with
+ *  gimp_trace_begin_async() instead, and closed by passing the
+ *  returned id to gimp_trace_end_async().
+ */
+
+void   gimp_trace_init        (const gchar *filename);
+void   gimp_trace_exit        (void);
+
+void   gimp_trace_begin       (const gchar *format,
+                               ...) G_GNUC_PRINTF (1, 2);
+void   gimp_trace_end         (void);
+
+guint  gimp_trace_begin_async (const gchar *format,
+                               ...) G_GNUC_PRINTF (1, 2);
+void   gimp_trace_end_async   (guint        id);
+
+
+#endif /* __GIMP_TRACE_H__ */
@@ -76,10 +76,13 @@
 #include "session.h"
 #include "splash.h"
 #include "themes.h"
+
 #ifdef GDK_WINDOWING_QUARTZ
 #include "ige-mac-menu.h"
 #endif /* GDK_WINDOWING_QUARTZ */
 
+#include "gimp-trace.h"
+
 #include "gimp-intl.h"
 
 
@@ -398,11 +401,15 @@ gui_restore_callback (Gimp               *gimp,
                     NULL);
     }
 
+  gimp_trace_begin ("actions and menus");
   actions_init (gimp);
   menus_init (gimp, global_action_factory);
+  gimp_trace_end ();
   gimp_render_init (gimp);
 
+  gimp_trace_begin ("dialogs");
   dialogs_init (gimp, global_menu_factory);
+  gimp_trace_end ();
 
   gimp_clipboard_init (gimp);
   gimp_clipboard_set_buffer (gimp, gimp->global_buffer);
@@ -411,18 +418,24 @@ gui_restore_callback (Gimp               *gimp,
                     G_CALLBACK (gui_global_buffer_changed),
                     NULL);
 
+  gimp_trace_begin ("devices and session");
   gimp_devices_init (gimp);
   gimp_controllers_init (gimp);
   session_init (gimp);
+  gimp_trace_end ();
 
   g_type_class_unref (g_type_class_ref (GIMP_TYPE_COLOR_SELECTOR_PALETTE));
 
   /*  initialize the document history  */
   status_callback (NULL, _("Documents"), 0.9);
+  gimp_trace_begin ("documents");
   gimp_recent_list_load (gimp);
+  gimp_trace_end ();
 
   status_callback (NULL, _("Tool Options"), 1.0);
+  gimp_trace_begin ("tool options");
   gimp_tools_restore (gimp);
+  gimp_trace_end ();
 }
 
 #ifdef GDK_WINDOWING_QUARTZ
@@ -454,7 +467,13 @@ gui_restore_after_callback (Gimp               *gimp,
   gimp->message_handler = GIMP_MESSAGE_BOX;
 
   if (gui_config->restore_accels)
-    menus_restore (gimp);
+    {
+      gimp_trace_begin ("menurc");
+      menus_restore (gimp);
+      gimp_trace_end ();
+    }
+
+  gimp_trace_begin ("image menus");
 
   ui_configurer = g_object_new (GIMP_TYPE_UI_CONFIGURER,
                                 "gimp", gimp,
@@ -466,6 +485,8 @@ gui_restore_after_callback (Gimp               *gimp,
                                                     gui_config->tearoff_menus);
   gimp_ui_manager_update (image_ui_manager, gimp);
 
+  gimp_trace_end ();
+
 #ifdef GDK_WINDOWING_QUARTZ
   {
     IgeMacMenuGroup *group;
@@ -537,6 +558,8 @@ gui_restore_after_callback (Gimp               *gimp,
     {
       GimpDisplayShell *shell;
 
+      gimp_trace_begin ("display and session");
+
       /*  create the empty display  */
       display = GIMP_DISPLAY (gimp_create_display (gimp,
                                                    NULL,
@@ -550,6 +573,8 @@ gui_restore_after_callback (Gimp               *gimp,
 
       /*  move keyboard focus to the display  */
       gtk_window_present (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (shell))));
+
+      gimp_trace_end ();
     }
 
   /*  indicate that the application has finished loading  */
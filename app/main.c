@@ -73,6 +73,7 @@
 #endif
 
 #include "gimp-log.h"
+#include "gimp-trace.h"
 #include "gimp-intl.h"
 
 
@@ -115,7 +116,11 @@ static const gchar        *user_gimprc       = NULL;
 static const gchar        *session_name      = NULL;
 static const gchar        *batch_interpreter = NULL;
 static const gchar       **batch_commands    = NULL;
+static const gchar        *batch_file        = NULL;
+static gint                batch_jobs        = 0;
+static gint                batch_timeout     = 0;
 static const gchar       **filenames         = NULL;
+static const gchar        *trace_filename    = NULL;
 static gboolean            as_new            = FALSE;
 static gboolean            no_interface      = FALSE;
 static gboolean            no_data           = FALSE;
@@ -222,6 +227,22 @@ static const GOptionEntry main_entries[] =
     G_OPTION_ARG_STRING, &batch_interpreter,
     N_("The procedure to process batch commands with"), "<proc>"
   },
+  {
+    "batch-file", 0, 0,
+    G_OPTION_ARG_FILENAME, &batch_file,
+    N_("Batch commands to run concurrently, one per line"), "<filename>"
+  },
+  {
+    "batch-jobs", 0, 0,
+    G_OPTION_ARG_INT, &batch_jobs,
+    N_("Number of batch commands from --batch-file to run at a time"), "<n>"
+  },
+  {
+    "batch-timeout", 0, 0,
+    G_OPTION_ARG_INT, &batch_timeout,
+    N_("Terminate batch commands from --batch-file running longer than this"),
+    "<seconds>"
+  },
   {
     "console-messages", 'c', 0,
     G_OPTION_ARG_NONE, &console_messages,
@@ -249,6 +270,11 @@ static const GOptionEntry main_entries[] =
     G_OPTION_ARG_CALLBACK, gimp_option_fatal_warnings,
     N_("Make all warnings fatal"), NULL
   },
+  {
+    "trace-startup", 0, 0,
+    G_OPTION_ARG_FILENAME, &trace_filename,
+    N_("Write a trace of the startup phases to a file"), "<filename>"
+  },
   {
     "dump-gimprc", 0, G_OPTION_FLAG_NO_ARG,
     G_OPTION_ARG_CALLBACK, gimp_option_dump_gimprc,
@@ -410,7 +436,8 @@ main (int    argc,
       app_exit (EXIT_FAILURE);
     }
 
-  if (no_interface || be_verbose || console_messages || batch_commands != NULL)
+  if (no_interface || be_verbose || console_messages ||
+      batch_commands != NULL || batch_file != NULL)
     gimp_open_console_window ();
 
   if (no_interface)
@@ -435,6 +462,8 @@ main (int    argc,
 
   gimp_init_signal_handlers (stack_trace_mode);
 
+  gimp_trace_init (trace_filename);
+
   app_run (argv[0],
            filenames,
            system_gimprc,
@@ -442,6 +471,9 @@ main (int    argc,
            session_name,
            batch_interpreter,
            batch_commands,
+           batch_file,
+           batch_jobs,
+           batch_timeout,
            as_new,
            no_interface,
            no_data,
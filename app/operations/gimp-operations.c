@@ -77,6 +77,7 @@
 #include "gimpoperationerasemode.h"
 #include "gimpoperationreplacemode.h"
 #include "gimpoperationantierasemode.h"
+#include "gimpoperationfusedlayers.h"
 
 
 void
@@ -132,4 +133,5 @@ gimp_operations_init (void)
   g_type_class_ref (GIMP_TYPE_OPERATION_ERASE_MODE);
   g_type_class_ref (GIMP_TYPE_OPERATION_REPLACE_MODE);
   g_type_class_ref (GIMP_TYPE_OPERATION_ANTI_ERASE_MODE);
+  g_type_class_ref (GIMP_TYPE_OPERATION_FUSED_LAYERS);
 }
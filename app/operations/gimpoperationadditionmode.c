@@ -59,6 +59,9 @@ gimp_operation_addition_mode_class_init (GimpOperationAdditionModeClass *klass)
                                  NULL);
 
   point_class->process     = gimp_operation_addition_mode_process;
+
+  gimp_operation_point_layer_mode_class_set_blend (GIMP_OPERATION_POINT_LAYER_MODE_CLASS (klass),
+                                                   GIMP_LAYER_BLEND_ADDITION);
   operation_class->prepare = gimp_operation_addition_mode_prepare;
 }
 
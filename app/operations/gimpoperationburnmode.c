@@ -60,6 +60,9 @@ gimp_operation_burn_mode_class_init (GimpOperationBurnModeClass *klass)
 
   point_class->process     = gimp_operation_burn_mode_process;
   operation_class->prepare = gimp_operation_burn_mode_prepare;
+
+  gimp_operation_point_layer_mode_class_set_blend (GIMP_OPERATION_POINT_LAYER_MODE_CLASS (klass),
+                                                   GIMP_LAYER_BLEND_BURN);
 }
 
 static void
@@ -60,6 +60,9 @@ gimp_operation_darken_only_mode_class_init (GimpOperationDarkenOnlyModeClass *kl
 
   operation_class->prepare = gimp_operation_darken_only_mode_prepare;
   point_class->process     = gimp_operation_darken_only_mode_process;
+
+  gimp_operation_point_layer_mode_class_set_blend (GIMP_OPERATION_POINT_LAYER_MODE_CLASS (klass),
+                                                   GIMP_LAYER_BLEND_DARKEN_ONLY);
 }
 
 static void
@@ -0,0 +1,583 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpoperationfusedlayers.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <cairo.h>
+#include <gegl-plugin.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "operations-types.h"
+
+#include "gimpoperationfusedlayers.h"
+#include "gimpoperationnormalmode.h"
+#include "gimpoperationpointlayermode.h"
+
+
+/*  The operation composites a run of layers onto its "input" in one
+ *  pass: each "auxN" pad gets the pixels of a layer, and "modeN" is
+ *  that layer's gimp:*-mode node, whose operation and opacity are
+ *  used as they are at process time.
+ *
+ *  The result is processed in bands of rows that fit into the cache,
+ *  and all layers are composited onto a band before the next one is
+ *  started, instead of every layer writing a whole intermediate
+ *  buffer that the layer above reads back.
+ *
+ *  Each step calls the same process function on the same pixels as
+ *  the chain of mode nodes would, including the pass-through of
+ *  gimp_operation_normal_parent_process(), so the result is
+ *  identical to the chain.
+ */
+
+#define BAND_SIZE 4096 /* pixels */
+
+
+enum
+{
+  PROP_0,
+  PROP_AUX,
+  PROP_MODE = PROP_AUX + GIMP_FUSED_LAYERS_MAX_LAYERS
+};
+
+typedef enum
+{
+  STEP_COMPOSITE,
+  STEP_KEEP_INPUT,
+  STEP_TAKE_LAYER
+} FusedStep;
+
+
+static void     gimp_operation_fused_layers_dispose      (GObject             *object);
+static void     gimp_operation_fused_layers_set_property (GObject             *object,
+                                                          guint                property_id,
+                                                          const GValue        *value,
+                                                          GParamSpec          *pspec);
+static void     gimp_operation_fused_layers_get_property (GObject             *object,
+                                                          guint                property_id,
+                                                          GValue              *value,
+                                                          GParamSpec          *pspec);
+
+static void     gimp_operation_fused_layers_attach       (GeglOperation       *operation);
+static void     gimp_operation_fused_layers_prepare      (GeglOperation       *operation);
+static GeglRectangle
+             gimp_operation_fused_layers_get_bounding_box (GeglOperation       *operation);
+static gboolean gimp_operation_fused_layers_process      (GeglOperation       *operation,
+                                                          GeglOperationContext *context,
+                                                          const gchar         *output_prop,
+                                                          const GeglRectangle *result,
+                                                          gint                 level);
+
+
+G_DEFINE_TYPE (GimpOperationFusedLayers, gimp_operation_fused_layers,
+               GEGL_TYPE_OPERATION_FILTER)
+
+#define parent_class gimp_operation_fused_layers_parent_class
+
+static gchar *aux_names[GIMP_FUSED_LAYERS_MAX_LAYERS];
+
+
+static void
+gimp_operation_fused_layers_class_init (GimpOperationFusedLayersClass *klass)
+{
+  GObjectClass       *object_class    = G_OBJECT_CLASS (klass);
+  GeglOperationClass *operation_class = GEGL_OPERATION_CLASS (klass);
+  gint                i;
+
+  object_class->dispose      = gimp_operation_fused_layers_dispose;
+  object_class->set_property = gimp_operation_fused_layers_set_property;
+  object_class->get_property = gimp_operation_fused_layers_get_property;
+
+  gegl_operation_class_set_keys (operation_class,
+                                 "name",        "gimp:fused-layers",
+                                 "categories",  "compositors",
+                                 "description", "GIMP fused layer modes operation",
+                                 NULL);
+
+  operation_class->attach           = gimp_operation_fused_layers_attach;
+  operation_class->prepare          = gimp_operation_fused_layers_prepare;
+  operation_class->get_bounding_box = gimp_operation_fused_layers_get_bounding_box;
+  operation_class->process          = gimp_operation_fused_layers_process;
+
+  for (i = 0; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+    {
+      gchar *mode_name;
+
+      aux_names[i] = g_strdup_printf ("aux%d", i + 1);
+      mode_name    = g_strdup_printf ("mode%d", i + 1);
+
+      g_object_class_install_property (object_class, PROP_AUX + i,
+                                       g_param_spec_object (aux_names[i],
+                                                            NULL, NULL,
+                                                            GEGL_TYPE_BUFFER,
+                                                            G_PARAM_READWRITE |
+                                                            GEGL_PARAM_PAD_INPUT));
+
+      g_object_class_install_property (object_class, PROP_MODE + i,
+                                       g_param_spec_object (mode_name,
+                                                            NULL, NULL,
+                                                            GEGL_TYPE_NODE,
+                                                            GIMP_PARAM_READWRITE));
+
+      g_free (mode_name);
+    }
+}
+
+static void
+gimp_operation_fused_layers_init (GimpOperationFusedLayers *self)
+{
+}
+
+static void
+gimp_operation_fused_layers_dispose (GObject *object)
+{
+  GimpOperationFusedLayers *self = GIMP_OPERATION_FUSED_LAYERS (object);
+  gint                      i;
+
+  for (i = 0; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+    {
+      if (self->modes[i])
+        {
+          g_object_unref (self->modes[i]);
+          self->modes[i] = NULL;
+        }
+    }
+
+  G_OBJECT_CLASS (parent_class)->dispose (object);
+}
+
+static void
+gimp_operation_fused_layers_set_property (GObject      *object,
+                                          guint         property_id,
+                                          const GValue *value,
+                                          GParamSpec   *pspec)
+{
+  GimpOperationFusedLayers *self = GIMP_OPERATION_FUSED_LAYERS (object);
+
+  if (property_id >= PROP_MODE &&
+      property_id <  PROP_MODE + GIMP_FUSED_LAYERS_MAX_LAYERS)
+    {
+      gint i = property_id - PROP_MODE;
+
+      if (self->modes[i])
+        g_object_unref (self->modes[i]);
+
+      self->modes[i] = g_value_dup_object (value);
+    }
+  else if (property_id <  PROP_AUX ||
+           property_id >= PROP_AUX + GIMP_FUSED_LAYERS_MAX_LAYERS)
+    {
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+gimp_operation_fused_layers_get_property (GObject    *object,
+                                          guint       property_id,
+                                          GValue     *value,
+                                          GParamSpec *pspec)
+{
+  GimpOperationFusedLayers *self = GIMP_OPERATION_FUSED_LAYERS (object);
+
+  if (property_id >= PROP_MODE &&
+      property_id <  PROP_MODE + GIMP_FUSED_LAYERS_MAX_LAYERS)
+    {
+      g_value_set_object (value, self->modes[property_id - PROP_MODE]);
+    }
+  else if (property_id <  PROP_AUX ||
+           property_id >= PROP_AUX + GIMP_FUSED_LAYERS_MAX_LAYERS)
+    {
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+gimp_operation_fused_layers_attach (GeglOperation *operation)
+{
+  GObjectClass *object_class = G_OBJECT_GET_CLASS (operation);
+  gint          i;
+
+  GEGL_OPERATION_CLASS (parent_class)->attach (operation);
+
+  for (i = 0; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+    gegl_operation_create_pad (operation,
+                               g_object_class_find_property (object_class,
+                                                             aux_names[i]));
+}
+
+static GeglOperation *
+gimp_operation_fused_layers_get_mode (GimpOperationFusedLayers *self,
+                                      gint                      i)
+{
+  GeglOperation *mode;
+
+  if (! self->modes[i])
+    return NULL;
+
+  mode = gegl_node_get_gegl_operation (self->modes[i]);
+
+  if (! GIMP_IS_OPERATION_POINT_LAYER_MODE (mode))
+    return NULL;
+
+  return mode;
+}
+
+static void
+gimp_operation_fused_layers_prepare (GeglOperation *operation)
+{
+  GimpOperationFusedLayers *self   = GIMP_OPERATION_FUSED_LAYERS (operation);
+  const Babl               *format = babl_format ("R'G'B'A float");
+  gint                      i;
+
+  /*  all modes of a run use the same format, see gimp_layer_get_node()  */
+  for (i = 0; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+    {
+      GeglOperation *mode = gimp_operation_fused_layers_get_mode (self, i);
+
+      if (mode)
+        {
+          if (GIMP_OPERATION_POINT_LAYER_MODE (mode)->linear)
+            format = babl_format ("RGBA float");
+
+          break;
+        }
+    }
+
+  gegl_operation_set_format (operation, "input",  format);
+  gegl_operation_set_format (operation, "output", format);
+
+  for (i = 0; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+    gegl_operation_set_format (operation, aux_names[i], format);
+}
+
+/*  like gegl_rectangle_bounding_box(), but ignores empty rectangles  */
+static void
+gimp_operation_fused_layers_add_rect (GeglRectangle       *dest,
+                                      const GeglRectangle *rect)
+{
+  if (! rect || rect->width < 1 || rect->height < 1)
+    return;
+
+  if (dest->width < 1 || dest->height < 1)
+    *dest = *rect;
+  else
+    gegl_rectangle_bounding_box (dest, dest, rect);
+}
+
+static GeglRectangle
+gimp_operation_fused_layers_get_bounding_box (GeglOperation *operation)
+{
+  GimpOperationFusedLayers *self = GIMP_OPERATION_FUSED_LAYERS (operation);
+  GeglRectangle             bbox = { 0, 0, 0, 0 };
+  gint                      i;
+
+  gimp_operation_fused_layers_add_rect (&bbox,
+                                        gegl_operation_source_get_bounding_box (operation,
+                                                                                "input"));
+
+  for (i = 0; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+    {
+      if (gimp_operation_fused_layers_get_mode (self, i))
+        gimp_operation_fused_layers_add_rect (&bbox,
+                                              gegl_operation_source_get_bounding_box (operation,
+                                                                                      aux_names[i]));
+    }
+
+  return bbox;
+}
+
+static void
+gimp_operation_fused_layers_read (GeglBuffer          *buffer,
+                                  const GeglRectangle *rect,
+                                  gint                 level,
+                                  const Babl          *format,
+                                  gfloat              *dest,
+                                  gint                 rowstride)
+{
+  GeglBufferIterator *iter;
+
+  /*  read like the chained composers do, with an iterator at @level  */
+  iter = gegl_buffer_iterator_new (buffer, rect, level, format,
+                                   GEGL_BUFFER_READ, GEGL_ABYSS_NONE);
+
+  while (gegl_buffer_iterator_next (iter))
+    {
+      const gfloat  *src = iter->data[0];
+      GeglRectangle *roi = &iter->roi[0];
+      gfloat        *d;
+      gint           y;
+
+      d = dest + (roi->y - rect->y) * rowstride + (roi->x - rect->x) * 4;
+
+      for (y = 0; y < roi->height; y++)
+        {
+          memcpy (d, src, roi->width * 4 * sizeof (gfloat));
+
+          src += roi->width * 4;
+          d   += rowstride;
+        }
+    }
+}
+
+static void
+gimp_operation_fused_layers_composite (GeglOperation       *mode,
+                                       GeglBuffer          *layer,
+                                       const GeglRectangle *band,
+                                       const GeglRectangle *rect,
+                                       gint                 level,
+                                       const Babl          *format,
+                                       gfloat              *in,
+                                       gfloat              *layer_data,
+                                       gfloat              *out)
+{
+  GeglOperationPointComposer3Class *point_class;
+  gint                              offset;
+  gint                              y;
+
+  point_class = GEGL_OPERATION_POINT_COMPOSER3_GET_CLASS (mode);
+
+  offset = ((rect->y - band->y) * band->width + (rect->x - band->x)) * 4;
+
+  if (layer)
+    gimp_operation_fused_layers_read (layer, rect, level, format,
+                                      layer_data, rect->width * 4);
+  else
+    memset (layer_data, 0, rect->width * rect->height * 4 * sizeof (gfloat));
+
+  if (rect->width == band->width)
+    {
+      point_class->process (mode,
+                            in + offset, layer_data, NULL, out + offset,
+                            rect->width * rect->height, rect, level);
+      return;
+    }
+
+  for (y = 0; y < rect->height; y++)
+    {
+      GeglRectangle row = { rect->x, rect->y + y, rect->width, 1 };
+
+      point_class->process (mode,
+                            in  + offset + y * band->width * 4,
+                            layer_data   + y * rect->width * 4,
+                            NULL,
+                            out + offset + y * band->width * 4,
+                            rect->width, &row, level);
+    }
+}
+
+static gboolean
+gimp_operation_fused_layers_process (GeglOperation        *operation,
+                                     GeglOperationContext *context,
+                                     const gchar          *output_prop,
+                                     const GeglRectangle  *result,
+                                     gint                  level)
+{
+  GimpOperationFusedLayers *self = GIMP_OPERATION_FUSED_LAYERS (operation);
+  GeglOperation            *modes[GIMP_FUSED_LAYERS_MAX_LAYERS];
+  GObject                  *layers[GIMP_FUSED_LAYERS_MAX_LAYERS];
+  GeglRectangle             rects[GIMP_FUSED_LAYERS_MAX_LAYERS];
+  FusedStep                 steps[GIMP_FUSED_LAYERS_MAX_LAYERS];
+  GeglRectangle             bbox     = { 0, 0, 0, 0 };
+  GeglRectangle             extent   = { 0, 0, 0, 0 };
+  gboolean                  computed = FALSE;
+  GObject                  *current;
+  GObject                  *source;
+  const Babl               *format;
+  GeglBuffer               *output;
+  gfloat                   *acc[2];
+  gfloat                   *layer_data;
+  gint                      band_height;
+  gint                      n_layers = 0;
+  gint                      first    = -1;
+  gint                      i;
+  gint                      y;
+
+  /*  first find out what each mode node of the chain would do for
+   *  @result, "current" is the buffer the chain would have passed
+   *  through so far, or NULL if it has composited pixels
+   */
+  current = gegl_operation_context_get_object (context, "input");
+
+  if (current)
+    {
+      extent = *gegl_buffer_get_abyss (GEGL_BUFFER (current));
+
+      gimp_operation_fused_layers_add_rect (&bbox,
+                                            gegl_operation_source_get_bounding_box (operation,
+                                                                                    "input"));
+    }
+
+  source = current;
+
+  for (i = 0; i < GIMP_FUSED_LAYERS_MAX_LAYERS; i++)
+    {
+      GeglOperation *mode = gimp_operation_fused_layers_get_mode (self, i);
+      GObject       *layer;
+
+      if (! mode)
+        continue;
+
+      layer = gegl_operation_context_get_object (context, aux_names[i]);
+
+      gimp_operation_fused_layers_add_rect (&bbox,
+                                            gegl_operation_source_get_bounding_box (operation,
+                                                                                    aux_names[i]));
+
+      /*  the chained node would only process what is inside the
+       *  bounding box of everything below and including it
+       */
+      gegl_rectangle_intersect (&rects[n_layers], result, &bbox);
+
+      modes[n_layers]  = mode;
+      layers[n_layers] = layer;
+
+      if (GIMP_IS_OPERATION_NORMAL_MODE (mode) &&
+          GIMP_OPERATION_POINT_LAYER_MODE (mode)->opacity == 1.0)
+        {
+          if ((! current && ! computed) ||
+              (layer && ! gegl_rectangle_intersect (NULL, &extent,
+                                                    &rects[n_layers])))
+            {
+              steps[n_layers++] = STEP_TAKE_LAYER;
+
+              current  = layer;
+              computed = FALSE;
+              source   = layer;
+              first    = -1;
+
+              if (layer)
+                extent = *gegl_buffer_get_abyss (GEGL_BUFFER (layer));
+
+              continue;
+            }
+
+          if (! layer ||
+              ! gegl_rectangle_intersect (NULL,
+                                          gegl_buffer_get_abyss (GEGL_BUFFER (layer)),
+                                          &rects[n_layers]))
+            {
+              steps[n_layers++] = STEP_KEEP_INPUT;
+
+              continue;
+            }
+        }
+
+      if (first < 0)
+        first = n_layers;
+
+      extent   = rects[n_layers];
+      current  = NULL;
+      computed = TRUE;
+
+      steps[n_layers++] = STEP_COMPOSITE;
+    }
+
+  if (! computed)
+    {
+      if (current)
+        gegl_operation_context_set_object (context, "output", current);
+
+      return TRUE;
+    }
+
+  if (extent.width < 1 || extent.height < 1)
+    return TRUE;
+
+  format = gegl_operation_get_format (operation, "output");
+  output = gegl_operation_context_get_target (context, "output");
+
+  band_height = CLAMP (BAND_SIZE / extent.width, 1, extent.height);
+
+  acc[0]     = g_new (gfloat, extent.width * band_height * 4);
+  acc[1]     = g_new (gfloat, extent.width * band_height * 4);
+  layer_data = g_new (gfloat, extent.width * band_height * 4);
+
+  for (y = extent.y; y < extent.y + extent.height; y += band_height)
+    {
+      GeglRectangle  band = { extent.x, y, extent.width,
+                              MIN (band_height, extent.y + extent.height - y) };
+      GeglRectangle  rect;
+      gfloat        *in  = acc[0];
+      gfloat        *out = acc[1];
+
+      /*  the chained nodes read zeros outside what the node below
+       *  them processed
+       */
+      memset (in,  0, band.width * band.height * 4 * sizeof (gfloat));
+      memset (out, 0, band.width * band.height * 4 * sizeof (gfloat));
+
+      if (source && gegl_rectangle_intersect (&rect, &rects[first], &band))
+        gimp_operation_fused_layers_read (GEGL_BUFFER (source), &rect,
+                                          level, format,
+                                          in + ((rect.y - band.y) * band.width +
+                                                (rect.x - band.x)) * 4,
+                                          band.width * 4);
+
+      for (i = first; i < n_layers; i++)
+        {
+          gfloat *tmp;
+
+          if (steps[i] != STEP_COMPOSITE)
+            continue;
+
+          if (gegl_rectangle_intersect (&rect, &rects[i], &band))
+            gimp_operation_fused_layers_composite (modes[i],
+                                                   GEGL_BUFFER (layers[i]),
+                                                   &band, &rect,
+                                                   level, format,
+                                                   in, layer_data, out);
+
+          tmp = in;
+          in  = out;
+          out = tmp;
+        }
+
+      gegl_buffer_set (output, &band, level, format, in, GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_free (acc[0]);
+  g_free (acc[1]);
+  g_free (layer_data);
+
+  return TRUE;
+}
+
+
+/*  public functions  */
+
+/**
+ * gimp_operation_fused_layers_can_fuse:
+ * @mode_node: a layer's mode node
+ *
+ * Layers whose mode node doesn't run a point layer mode can't be
+ * composited by a fused node and have to stay in the chain.
+ *
+ * Return value: whether the layer of @mode_node can be fused.
+ **/
+gboolean
+gimp_operation_fused_layers_can_fuse (GeglNode *mode_node)
+{
+  g_return_val_if_fail (GEGL_IS_NODE (mode_node), FALSE);
+
+  return GIMP_IS_OPERATION_POINT_LAYER_MODE (gegl_node_get_gegl_operation (mode_node));
+}
@@ -0,0 +1,63 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpoperationfusedlayers.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_OPERATION_FUSED_LAYERS_H__
+#define __GIMP_OPERATION_FUSED_LAYERS_H__
+
+
+#include <gegl-plugin.h>
+
+
+/*  the number of "auxN" / "modeN" pairs of one fused node, longer
+ *  runs of layers are split across several nodes
+ */
+#define GIMP_FUSED_LAYERS_MAX_LAYERS 16
+
+
+#define GIMP_TYPE_OPERATION_FUSED_LAYERS            (gimp_operation_fused_layers_get_type ())
+#define GIMP_OPERATION_FUSED_LAYERS(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_OPERATION_FUSED_LAYERS, GimpOperationFusedLayers))
+#define GIMP_OPERATION_FUSED_LAYERS_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  GIMP_TYPE_OPERATION_FUSED_LAYERS, GimpOperationFusedLayersClass))
+#define GIMP_IS_OPERATION_FUSED_LAYERS(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GIMP_TYPE_OPERATION_FUSED_LAYERS))
+#define GIMP_IS_OPERATION_FUSED_LAYERS_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  GIMP_TYPE_OPERATION_FUSED_LAYERS))
+#define GIMP_OPERATION_FUSED_LAYERS_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GIMP_TYPE_OPERATION_FUSED_LAYERS, GimpOperationFusedLayersClass))
+
+
+typedef struct _GimpOperationFusedLayers      GimpOperationFusedLayers;
+typedef struct _GimpOperationFusedLayersClass GimpOperationFusedLayersClass;
+
+struct _GimpOperationFusedLayers
+{
+  GeglOperationFilter  parent_instance;
+
+  /*  the layers' gimp:*-mode nodes, bottom to top  */
+  GeglNode            *modes[GIMP_FUSED_LAYERS_MAX_LAYERS];
+};
+
+struct _GimpOperationFusedLayersClass
+{
+  GeglOperationFilterClass  parent_class;
+};
+
+
+GType      gimp_operation_fused_layers_get_type     (void) G_GNUC_CONST;
+
+gboolean   gimp_operation_fused_layers_can_fuse     (GeglNode *mode_node);
+
+
+#endif /* __GIMP_OPERATION_FUSED_LAYERS_H__ */
@@ -60,6 +60,9 @@ gimp_operation_multiply_mode_class_init (GimpOperationMultiplyModeClass *klass)
 
   operation_class->prepare = gimp_operation_multiply_mode_prepare;
   point_class->process     = gimp_operation_multiply_mode_process;
+
+  gimp_operation_point_layer_mode_class_set_blend (GIMP_OPERATION_POINT_LAYER_MODE_CLASS (klass),
+                                                   GIMP_LAYER_BLEND_MULTIPLY);
 }
 
 static void
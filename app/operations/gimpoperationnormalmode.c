@@ -84,6 +84,9 @@ gimp_operation_normal_mode_class_init (GimpOperationNormalModeClass *klass)
   operation_class->process     = gimp_operation_normal_parent_process;
 
   point_class->process         = gimp_operation_normal_mode_process;
+
+  gimp_operation_point_layer_mode_class_set_blend (GIMP_OPERATION_POINT_LAYER_MODE_CLASS (klass),
+                                                   GIMP_LAYER_BLEND_NORMAL);
 }
 
 static void
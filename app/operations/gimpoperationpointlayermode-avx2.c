@@ -0,0 +1,70 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpoperationpointlayermode-avx2.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#if COMPILE_AVX2_INTRINSICS
+
+#include <string.h>
+
+/* AVX2 */
+#include <immintrin.h>
+
+#include <gegl-plugin.h>
+
+#include "operations-types.h"
+
+#include "gimpoperationpointlayermode.h"
+#include "gimpoperationpointlayermode-simd.h"
+
+
+/*  two pixels per vector, one in each 128 bit lane  */
+
+typedef __m256 vfloat;
+
+#define VF_PIXELS               2
+#define VF_LOADU(p)             _mm256_loadu_ps (p)
+#define VF_STOREU(p, v)         _mm256_storeu_ps (p, v)
+#define VF_SET1(f)              _mm256_set1_ps (f)
+#define VF_SET_RGBA(r, g, b, a) _mm256_set_ps (a, b, g, r, a, b, g, r)
+#define VF_LOAD_MASK(p)         _mm256_insertf128_ps (                      \
+                                  _mm256_castps128_ps256 (_mm_set1_ps ((p)[0])), \
+                                  _mm_set1_ps ((p)[1]), 1)
+#define VF_ALPHA_MASK           _mm256_castsi256_ps (                       \
+                                  _mm256_set_epi32 (-1, 0, 0, 0, -1, 0, 0, 0))
+
+#define VF_ADD(a, b)            _mm256_add_ps (a, b)
+#define VF_SUB(a, b)            _mm256_sub_ps (a, b)
+#define VF_MUL(a, b)            _mm256_mul_ps (a, b)
+#define VF_DIV(a, b)            _mm256_div_ps (a, b)
+#define VF_MIN(a, b)            _mm256_min_ps (a, b)
+#define VF_MAX(a, b)            _mm256_max_ps (a, b)
+
+#define VF_AND(a, b)            _mm256_and_ps (a, b)
+#define VF_CMPGT(a, b)          _mm256_cmp_ps (a, b, _CMP_GT_OQ)
+#define VF_CMPLE(a, b)          _mm256_cmp_ps (a, b, _CMP_LE_OQ)
+#define VF_CMPNEQ(a, b)         _mm256_cmp_ps (a, b, _CMP_NEQ_UQ)
+#define VF_SELECT(m, a, b)      _mm256_blendv_ps (b, a, m)
+#define VF_PERMUTE(v, imm)      _mm256_permute_ps (v, imm)
+
+#define GIMP_LAYER_MODE_PROCESS gimp_operation_point_layer_mode_process_avx2
+
+#include "gimpoperationpointlayermode-kernels.h"
+
+#endif /* COMPILE_AVX2_INTRINSICS */
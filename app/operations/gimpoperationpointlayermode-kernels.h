@@ -0,0 +1,613 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpoperationpointlayermode-kernels.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*  Vectorized layer mode kernels. This file is included by
+ *  gimpoperationpointlayermode-sse2.c and -avx2.c, which define the
+ *  vector type and primitives below before including it:
+ *
+ *  vfloat                        the vector type
+ *  VF_PIXELS                     number of RGBA pixels in a vfloat
+ *  VF_LOADU (p), VF_STOREU (p,v) unaligned load and store
+ *  VF_SET1 (f)                   broadcast a scalar to all lanes
+ *  VF_SET_RGBA (r,g,b,a)         the same pixel in every pixel slot
+ *  VF_LOAD_MASK (p)              VF_PIXELS mask values, each broadcast
+ *                                to its pixel
+ *  VF_ALPHA_MASK                 all bits set in the alpha lanes
+ *  VF_ADD, VF_SUB, VF_MUL, VF_DIV, VF_MIN, VF_MAX
+ *  VF_AND, VF_CMPGT, VF_CMPLE, VF_CMPNEQ
+ *  VF_SELECT (m,a,b)             a where m is set, b elsewhere
+ *  VF_PERMUTE (v,imm)            _MM_SHUFFLE() permutation within
+ *                                each pixel
+ *  GIMP_LAYER_MODE_PROCESS       name of the process function
+ *
+ *  Each pixel occupies its own four lanes, so the kernels below
+ *  follow the scalar process functions of the layer mode operations
+ *  step by step, except that they compute in single precision.
+ *  VF_MIN and VF_MAX must behave like MIN() and MAX(), i.e. return
+ *  their second argument if the comparison is unordered.
+ */
+
+
+#define VF_ALPHA(v)  VF_PERMUTE (v, _MM_SHUFFLE (3, 3, 3, 3))
+
+
+typedef void (* LayerModeLoop) (const gfloat *in,
+                                const gfloat *layer,
+                                const gfloat *mask,
+                                gfloat       *out,
+                                glong         samples,
+                                gfloat        opacity);
+
+
+/*  helpers  */
+
+static inline vfloat
+vf_max3 (vfloat v)
+{
+  vfloat a = VF_PERMUTE (v, _MM_SHUFFLE (3, 0, 2, 1));
+  vfloat b = VF_PERMUTE (v, _MM_SHUFFLE (3, 1, 0, 2));
+
+  return VF_MAX (v, VF_MAX (a, b));
+}
+
+static inline vfloat
+vf_min3 (vfloat v)
+{
+  vfloat a = VF_PERMUTE (v, _MM_SHUFFLE (3, 0, 2, 1));
+  vfloat b = VF_PERMUTE (v, _MM_SHUFFLE (3, 1, 0, 2));
+
+  return VF_MIN (v, VF_MIN (a, b));
+}
+
+static inline vfloat
+vf_clamp (vfloat v,
+          vfloat lo,
+          vfloat hi)
+{
+  return VF_MIN (VF_MAX (v, lo), hi);
+}
+
+/*  the compositing shared by all modes but normal, as in
+ *  gimp_operation_multiply_mode_process()
+ */
+static inline vfloat
+composite (vfloat in,
+           vfloat layer,
+           vfloat comp,
+           vfloat opacity,
+           vfloat mask)
+{
+  const vfloat zero = VF_SET1 (0.0f);
+  const vfloat one  = VF_SET1 (1.0f);
+  vfloat       in_alpha;
+  vfloat       comp_alpha;
+  vfloat       new_alpha;
+  vfloat       ratio;
+  vfloat       apply;
+  vfloat       out;
+
+  in_alpha   = VF_ALPHA (in);
+  comp_alpha = VF_MUL (VF_MUL (VF_MIN (in_alpha, VF_ALPHA (layer)), opacity),
+                       mask);
+  new_alpha  = VF_ADD (in_alpha, VF_MUL (VF_SUB (one, in_alpha), comp_alpha));
+
+  /*  ratio is garbage where apply is not set  */
+  apply = VF_AND (VF_CMPNEQ (comp_alpha, zero), VF_CMPNEQ (new_alpha, zero));
+  ratio = VF_DIV (comp_alpha, new_alpha);
+
+  out = VF_ADD (VF_MUL (comp, ratio), VF_MUL (in, VF_SUB (one, ratio)));
+  out = VF_SELECT (apply, out, in);
+
+  return VF_SELECT (VF_ALPHA_MASK, in, out);
+}
+
+
+/*  the modes  */
+
+static inline vfloat
+mode_normal (vfloat in,
+             vfloat layer,
+             vfloat opacity,
+             vfloat mask)
+{
+  const vfloat zero = VF_SET1 (0.0f);
+  const vfloat one  = VF_SET1 (1.0f);
+  vfloat       in_alpha;
+  vfloat       layer_alpha;
+  vfloat       out_alpha;
+  vfloat       out;
+
+  in_alpha    = VF_ALPHA (in);
+  layer_alpha = VF_MUL (VF_MUL (VF_ALPHA (layer), opacity), mask);
+  out_alpha   = VF_SUB (VF_ADD (layer_alpha, in_alpha),
+                        VF_MUL (layer_alpha, in_alpha));
+
+  out = VF_ADD (VF_MUL (layer, layer_alpha),
+                VF_MUL (VF_MUL (in, in_alpha), VF_SUB (one, layer_alpha)));
+  out = VF_DIV (out, out_alpha);
+  out = VF_SELECT (VF_CMPNEQ (out_alpha, zero), out, in);
+
+  return VF_SELECT (VF_ALPHA_MASK, out_alpha, out);
+}
+
+static inline vfloat
+mode_multiply (vfloat in,
+               vfloat layer,
+               vfloat opacity,
+               vfloat mask)
+{
+  vfloat comp = vf_clamp (VF_MUL (layer, in), VF_SET1 (0.0f), VF_SET1 (1.0f));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_screen (vfloat in,
+             vfloat layer,
+             vfloat opacity,
+             vfloat mask)
+{
+  const vfloat one = VF_SET1 (1.0f);
+  vfloat       comp;
+
+  comp = VF_SUB (one, VF_MUL (VF_SUB (one, in), VF_SUB (one, layer)));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_overlay (vfloat in,
+              vfloat layer,
+              vfloat opacity,
+              vfloat mask)
+{
+  const vfloat one = VF_SET1 (1.0f);
+  vfloat       comp;
+
+  comp = VF_MUL (VF_MUL (VF_SET1 (2.0f), layer), VF_SUB (one, in));
+  comp = VF_MUL (in, VF_ADD (in, comp));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_difference (vfloat in,
+                 vfloat layer,
+                 vfloat opacity,
+                 vfloat mask)
+{
+  vfloat diff = VF_SUB (in, layer);
+  vfloat comp = VF_MAX (diff, VF_SUB (VF_SET1 (0.0f), diff));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_addition (vfloat in,
+               vfloat layer,
+               vfloat opacity,
+               vfloat mask)
+{
+  vfloat comp = vf_clamp (VF_ADD (in, layer), VF_SET1 (0.0f), VF_SET1 (1.0f));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_subtract (vfloat in,
+               vfloat layer,
+               vfloat opacity,
+               vfloat mask)
+{
+  vfloat comp = VF_MAX (VF_SUB (in, layer), VF_SET1 (0.0f));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_darken_only (vfloat in,
+                  vfloat layer,
+                  vfloat opacity,
+                  vfloat mask)
+{
+  return composite (in, layer, VF_MIN (in, layer), opacity, mask);
+}
+
+static inline vfloat
+mode_lighten_only (vfloat in,
+                   vfloat layer,
+                   vfloat opacity,
+                   vfloat mask)
+{
+  return composite (in, layer, VF_MAX (layer, in), opacity, mask);
+}
+
+/*  The HSV modes don't convert to HSV and back. For a fixed hue,
+ *  every channel is V * (1 - S * k) with k = (max - channel) / delta,
+ *  so swapping H, S or V only needs k, V and S = delta / max of
+ *  whichever pixel provides them. Like gimp_rgb_to_hsv(), a delta
+ *  below 0.0001 counts as gray with hue 0.
+ */
+static inline vfloat
+mode_hue (vfloat in,
+          vfloat layer,
+          vfloat opacity,
+          vfloat mask)
+{
+  const vfloat eps = VF_SET1 (0.0001f);
+  vfloat       in_max      = vf_max3 (in);
+  vfloat       in_delta    = VF_SUB (in_max, vf_min3 (in));
+  vfloat       layer_max   = vf_max3 (layer);
+  vfloat       layer_delta = VF_SUB (layer_max, vf_min3 (layer));
+  vfloat       k;
+  vfloat       comp;
+
+  /*  keep the image's hue if the layer is gray, see bug #123296  */
+  k = VF_SELECT (VF_CMPGT (layer_delta, eps),
+                 VF_DIV (VF_SUB (layer_max, layer), layer_delta),
+                 VF_DIV (VF_SUB (in_max, in), in_delta));
+
+  comp = VF_SELECT (VF_CMPGT (in_delta, eps),
+                    VF_SUB (in_max, VF_MUL (in_delta, k)),
+                    in_max);
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_saturation (vfloat in,
+                 vfloat layer,
+                 vfloat opacity,
+                 vfloat mask)
+{
+  const vfloat eps = VF_SET1 (0.0001f);
+  vfloat       in_max      = vf_max3 (in);
+  vfloat       in_delta    = VF_SUB (in_max, vf_min3 (in));
+  vfloat       layer_max   = vf_max3 (layer);
+  vfloat       layer_delta = VF_SUB (layer_max, vf_min3 (layer));
+  vfloat       s;
+  vfloat       k;
+  vfloat       comp;
+
+  s = VF_SELECT (VF_CMPGT (layer_delta, eps),
+                 VF_DIV (layer_delta, layer_max),
+                 VF_SET1 (0.0f));
+
+  /*  a gray image pixel has hue 0, i.e. red  */
+  k = VF_SELECT (VF_CMPGT (in_delta, eps),
+                 VF_DIV (VF_SUB (in_max, in), in_delta),
+                 VF_SET_RGBA (0.0f, 1.0f, 1.0f, 0.0f));
+
+  comp = VF_SUB (in_max, VF_MUL (VF_MUL (in_max, s), k));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_value (vfloat in,
+            vfloat layer,
+            vfloat opacity,
+            vfloat mask)
+{
+  const vfloat eps = VF_SET1 (0.0001f);
+  vfloat       in_max    = vf_max3 (in);
+  vfloat       in_delta  = VF_SUB (in_max, vf_min3 (in));
+  vfloat       layer_max = vf_max3 (layer);
+  vfloat       comp;
+
+  /*  S * k reduces to (max - channel) / max  */
+  comp = VF_DIV (VF_MUL (layer_max, VF_SUB (in_max, in)), in_max);
+  comp = VF_SELECT (VF_CMPGT (in_delta, eps),
+                    VF_SUB (layer_max, comp),
+                    layer_max);
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+/*  The HSL equivalent: with the layer's hue and saturation, every
+ *  channel is m1 + (m2 - m1) * k with k = (channel - min) / delta of
+ *  the layer, and m1, m2 as in gimp_hsl_to_rgb().
+ */
+static inline vfloat
+mode_color (vfloat in,
+            vfloat layer,
+            vfloat opacity,
+            vfloat mask)
+{
+  const vfloat zero = VF_SET1 (0.0f);
+  const vfloat one  = VF_SET1 (1.0f);
+  const vfloat half = VF_SET1 (0.5f);
+  const vfloat two  = VF_SET1 (2.0f);
+  vfloat       in_l;
+  vfloat       layer_min;
+  vfloat       layer_sum;
+  vfloat       layer_delta;
+  vfloat       s;
+  vfloat       m1, m2;
+  vfloat       comp;
+
+  in_l        = VF_MUL (VF_ADD (vf_max3 (in), vf_min3 (in)), half);
+  layer_min   = vf_min3 (layer);
+  layer_sum   = VF_ADD (vf_max3 (layer), layer_min);
+  layer_delta = VF_SUB (vf_max3 (layer), layer_min);
+
+  s = VF_SELECT (VF_CMPLE (VF_MUL (layer_sum, half), half),
+                 VF_DIV (layer_delta, layer_sum),
+                 VF_DIV (layer_delta, VF_SUB (two, layer_sum)));
+
+  m2 = VF_SELECT (VF_CMPLE (in_l, half),
+                  VF_MUL (in_l, VF_ADD (one, s)),
+                  VF_SUB (VF_ADD (in_l, s), VF_MUL (in_l, s)));
+  m1 = VF_SUB (VF_MUL (two, in_l), m2);
+
+  comp = VF_DIV (VF_SUB (layer, layer_min), layer_delta);
+  comp = VF_ADD (m1, VF_MUL (VF_SUB (m2, m1), comp));
+  comp = VF_SELECT (VF_CMPNEQ (layer_delta, zero), comp, in_l);
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_divide (vfloat in,
+             vfloat layer,
+             vfloat opacity,
+             vfloat mask)
+{
+  vfloat comp;
+
+  comp = VF_DIV (VF_MUL (VF_SET1 (256.0f / 255.0f), in),
+                 VF_ADD (VF_SET1 (1.0f / 255.0f), layer));
+  comp = VF_MIN (comp, VF_SET1 (1.0f));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_dodge (vfloat in,
+            vfloat layer,
+            vfloat opacity,
+            vfloat mask)
+{
+  const vfloat one = VF_SET1 (1.0f);
+  vfloat       comp;
+
+  comp = VF_MIN (VF_DIV (in, VF_SUB (one, layer)), one);
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_burn (vfloat in,
+           vfloat layer,
+           vfloat opacity,
+           vfloat mask)
+{
+  const vfloat one = VF_SET1 (1.0f);
+  vfloat       comp;
+
+  comp = VF_DIV (VF_SUB (one, in), layer);
+  comp = vf_clamp (VF_SUB (one, comp), VF_SET1 (0.0f), one);
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_hardlight (vfloat in,
+                vfloat layer,
+                vfloat opacity,
+                vfloat mask)
+{
+  const vfloat one  = VF_SET1 (1.0f);
+  const vfloat half = VF_SET1 (0.5f);
+  const vfloat two  = VF_SET1 (2.0f);
+  vfloat       screen;
+  vfloat       multiply;
+
+  screen = VF_MUL (VF_SUB (one, in),
+                   VF_SUB (one, VF_MUL (VF_SUB (layer, half), two)));
+  screen = VF_MIN (VF_SUB (one, screen), one);
+
+  multiply = VF_MIN (VF_MUL (in, VF_MUL (layer, two)), one);
+
+  return composite (in, layer,
+                    VF_SELECT (VF_CMPGT (layer, half), screen, multiply),
+                    opacity, mask);
+}
+
+static inline vfloat
+mode_softlight (vfloat in,
+                vfloat layer,
+                vfloat opacity,
+                vfloat mask)
+{
+  const vfloat one = VF_SET1 (1.0f);
+  vfloat       multiply;
+  vfloat       screen;
+  vfloat       comp;
+
+  multiply = VF_MUL (in, layer);
+  screen   = VF_SUB (one, VF_MUL (VF_SUB (one, in), VF_SUB (one, layer)));
+  comp     = VF_ADD (VF_MUL (VF_SUB (one, in), multiply),
+                     VF_MUL (in, screen));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_grain_extract (vfloat in,
+                    vfloat layer,
+                    vfloat opacity,
+                    vfloat mask)
+{
+  vfloat comp = VF_ADD (VF_SUB (in, layer), VF_SET1 (0.5f));
+
+  comp = vf_clamp (comp, VF_SET1 (0.0f), VF_SET1 (1.0f));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+static inline vfloat
+mode_grain_merge (vfloat in,
+                  vfloat layer,
+                  vfloat opacity,
+                  vfloat mask)
+{
+  vfloat comp = VF_SUB (VF_ADD (in, layer), VF_SET1 (0.5f));
+
+  comp = vf_clamp (comp, VF_SET1 (0.0f), VF_SET1 (1.0f));
+
+  return composite (in, layer, comp, opacity, mask);
+}
+
+
+/*  the loops, one per mode so each gets its kernel inlined  */
+
+#define LAYER_MODE_LOOP(mode)                                           \
+static void                                                             \
+mode##_loop (const gfloat *in,                                          \
+             const gfloat *layer,                                       \
+             const gfloat *mask,                                        \
+             gfloat       *out,                                         \
+             glong         samples,                                     \
+             gfloat        opacity)                                     \
+{                                                                       \
+  const vfloat v_opacity = VF_SET1 (opacity);                           \
+  const vfloat v_one     = VF_SET1 (1.0f);                              \
+                                                                        \
+  for (; samples > 0; samples -= VF_PIXELS)                             \
+    {                                                                   \
+      vfloat v_mask = mask ? VF_LOAD_MASK (mask) : v_one;               \
+                                                                        \
+      VF_STOREU (out, mode (VF_LOADU (in), VF_LOADU (layer),            \
+                            v_opacity, v_mask));                        \
+                                                                        \
+      in    += 4 * VF_PIXELS;                                           \
+      layer += 4 * VF_PIXELS;                                           \
+      out   += 4 * VF_PIXELS;                                           \
+                                                                        \
+      if (mask)                                                         \
+        mask += VF_PIXELS;                                              \
+    }                                                                   \
+}
+
+LAYER_MODE_LOOP (mode_normal)
+LAYER_MODE_LOOP (mode_multiply)
+LAYER_MODE_LOOP (mode_screen)
+LAYER_MODE_LOOP (mode_overlay)
+LAYER_MODE_LOOP (mode_difference)
+LAYER_MODE_LOOP (mode_addition)
+LAYER_MODE_LOOP (mode_subtract)
+LAYER_MODE_LOOP (mode_darken_only)
+LAYER_MODE_LOOP (mode_lighten_only)
+LAYER_MODE_LOOP (mode_hue)
+LAYER_MODE_LOOP (mode_saturation)
+LAYER_MODE_LOOP (mode_color)
+LAYER_MODE_LOOP (mode_value)
+LAYER_MODE_LOOP (mode_divide)
+LAYER_MODE_LOOP (mode_dodge)
+LAYER_MODE_LOOP (mode_burn)
+LAYER_MODE_LOOP (mode_hardlight)
+LAYER_MODE_LOOP (mode_softlight)
+LAYER_MODE_LOOP (mode_grain_extract)
+LAYER_MODE_LOOP (mode_grain_merge)
+
+#undef LAYER_MODE_LOOP
+
+
+gboolean
+GIMP_LAYER_MODE_PROCESS (GeglOperation       *operation,
+                         void                *in_buf,
+                         void                *aux_buf,
+                         void                *aux2_buf,
+                         void                *out_buf,
+                         glong                samples,
+                         const GeglRectangle *roi,
+                         gint                 level)
+{
+  GimpOperationPointLayerModeClass *klass;
+  const gfloat                     *in      = in_buf;
+  const gfloat                     *layer   = aux_buf;
+  const gfloat                     *mask    = aux2_buf;
+  gfloat                           *out     = out_buf;
+  gfloat                            opacity;
+  LayerModeLoop                     loop;
+  glong                             tail;
+
+  klass   = GIMP_OPERATION_POINT_LAYER_MODE_GET_CLASS (operation);
+  opacity = GIMP_OPERATION_POINT_LAYER_MODE (operation)->opacity;
+
+  switch (klass->blend)
+    {
+    case GIMP_LAYER_BLEND_NORMAL:        loop = mode_normal_loop;        break;
+    case GIMP_LAYER_BLEND_MULTIPLY:      loop = mode_multiply_loop;      break;
+    case GIMP_LAYER_BLEND_SCREEN:        loop = mode_screen_loop;        break;
+    case GIMP_LAYER_BLEND_OVERLAY:       loop = mode_overlay_loop;       break;
+    case GIMP_LAYER_BLEND_DIFFERENCE:    loop = mode_difference_loop;    break;
+    case GIMP_LAYER_BLEND_ADDITION:      loop = mode_addition_loop;      break;
+    case GIMP_LAYER_BLEND_SUBTRACT:      loop = mode_subtract_loop;      break;
+    case GIMP_LAYER_BLEND_DARKEN_ONLY:   loop = mode_darken_only_loop;   break;
+    case GIMP_LAYER_BLEND_LIGHTEN_ONLY:  loop = mode_lighten_only_loop;  break;
+    case GIMP_LAYER_BLEND_HUE:           loop = mode_hue_loop;           break;
+    case GIMP_LAYER_BLEND_SATURATION:    loop = mode_saturation_loop;    break;
+    case GIMP_LAYER_BLEND_COLOR:         loop = mode_color_loop;         break;
+    case GIMP_LAYER_BLEND_VALUE:         loop = mode_value_loop;         break;
+    case GIMP_LAYER_BLEND_DIVIDE:        loop = mode_divide_loop;        break;
+    case GIMP_LAYER_BLEND_DODGE:         loop = mode_dodge_loop;         break;
+    case GIMP_LAYER_BLEND_BURN:          loop = mode_burn_loop;          break;
+    case GIMP_LAYER_BLEND_HARDLIGHT:     loop = mode_hardlight_loop;     break;
+    case GIMP_LAYER_BLEND_SOFTLIGHT:     loop = mode_softlight_loop;     break;
+    case GIMP_LAYER_BLEND_GRAIN_EXTRACT: loop = mode_grain_extract_loop; break;
+    case GIMP_LAYER_BLEND_GRAIN_MERGE:   loop = mode_grain_merge_loop;   break;
+
+    default:
+      return klass->process_scalar (operation,
+                                    in_buf, aux_buf, aux2_buf, out_buf,
+                                    samples, roi, level);
+    }
+
+  tail     = samples % VF_PIXELS;
+  samples -= tail;
+
+  if (samples)
+    loop (in, layer, mask, out, samples, opacity);
+
+  /*  the last pixels that don't fill a vector go through a zero
+   *  padded copy
+   */
+  if (tail)
+    {
+      gfloat in_tail[4 * VF_PIXELS]    = { 0.0f, };
+      gfloat layer_tail[4 * VF_PIXELS] = { 0.0f, };
+      gfloat mask_tail[VF_PIXELS]      = { 0.0f, };
+      gfloat out_tail[4 * VF_PIXELS];
+
+      memcpy (in_tail,    in    + 4 * samples, 4 * tail * sizeof (gfloat));
+      memcpy (layer_tail, layer + 4 * samples, 4 * tail * sizeof (gfloat));
+
+      if (mask)
+        memcpy (mask_tail, mask + samples, tail * sizeof (gfloat));
+
+      loop (in_tail, layer_tail, mask ? mask_tail : NULL, out_tail,
+            VF_PIXELS, opacity);
+
+      memcpy (out + 4 * samples, out_tail, 4 * tail * sizeof (gfloat));
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,68 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpoperationpointlayermode-sse2.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#if COMPILE_SSE2_INTRINSICS
+
+#include <string.h>
+
+/* SSE2 */
+#include <emmintrin.h>
+
+#include <gegl-plugin.h>
+
+#include "operations-types.h"
+
+#include "gimpoperationpointlayermode.h"
+#include "gimpoperationpointlayermode-simd.h"
+
+
+/*  one pixel per vector  */
+
+typedef __m128 vfloat;
+
+#define VF_PIXELS               1
+#define VF_LOADU(p)             _mm_loadu_ps (p)
+#define VF_STOREU(p, v)         _mm_storeu_ps (p, v)
+#define VF_SET1(f)              _mm_set1_ps (f)
+#define VF_SET_RGBA(r, g, b, a) _mm_set_ps (a, b, g, r)
+#define VF_LOAD_MASK(p)         _mm_set1_ps ((p)[0])
+#define VF_ALPHA_MASK           _mm_castsi128_ps (_mm_set_epi32 (-1, 0, 0, 0))
+
+#define VF_ADD(a, b)            _mm_add_ps (a, b)
+#define VF_SUB(a, b)            _mm_sub_ps (a, b)
+#define VF_MUL(a, b)            _mm_mul_ps (a, b)
+#define VF_DIV(a, b)            _mm_div_ps (a, b)
+#define VF_MIN(a, b)            _mm_min_ps (a, b)
+#define VF_MAX(a, b)            _mm_max_ps (a, b)
+
+#define VF_AND(a, b)            _mm_and_ps (a, b)
+#define VF_CMPGT(a, b)          _mm_cmpgt_ps (a, b)
+#define VF_CMPLE(a, b)          _mm_cmple_ps (a, b)
+#define VF_CMPNEQ(a, b)         _mm_cmpneq_ps (a, b)
+#define VF_SELECT(m, a, b)      _mm_or_ps (_mm_and_ps (m, a), \
+                                           _mm_andnot_ps (m, b))
+#define VF_PERMUTE(v, imm)      _mm_shuffle_ps (v, v, imm)
+
+#define GIMP_LAYER_MODE_PROCESS gimp_operation_point_layer_mode_process_sse2
+
+#include "gimpoperationpointlayermode-kernels.h"
+
+#endif /* COMPILE_SSE2_INTRINSICS */
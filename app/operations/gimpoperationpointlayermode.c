@@ -25,11 +25,13 @@
 #include <gegl-plugin.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
+#include "libgimpbase/gimpbase.h"
 #include "libgimpcolor/gimpcolor.h"
 
 #include "operations-types.h"
 
 #include "gimpoperationpointlayermode.h"
+#include "gimpoperationpointlayermode-simd.h"
 
 
 enum
@@ -157,3 +159,45 @@ gimp_operation_point_layer_mode_prepare (GeglOperation *operation)
   gegl_operation_set_format (operation, "aux",    format);
   gegl_operation_set_format (operation, "aux2",   babl_format ("Y float"));
 }
+
+
+/*  public functions  */
+
+/**
+ * gimp_operation_point_layer_mode_class_set_blend:
+ * @klass: a layer mode class, after its process function was set
+ * @blend: the blend function @klass implements
+ *
+ * Replaces the scalar process function of @klass with a vectorized
+ * kernel for @blend, if the CPU supports one. The scalar function
+ * stays available as @klass->process_scalar.
+ **/
+void
+gimp_operation_point_layer_mode_class_set_blend (GimpOperationPointLayerModeClass *klass,
+                                                 GimpLayerBlend                    blend)
+{
+  GeglOperationPointComposer3Class *point_class;
+
+  g_return_if_fail (GIMP_IS_OPERATION_POINT_LAYER_MODE_CLASS (klass));
+
+  point_class = GEGL_OPERATION_POINT_COMPOSER3_CLASS (klass);
+
+  klass->blend          = blend;
+  klass->process_scalar = point_class->process;
+
+#if COMPILE_AVX2_INTRINSICS
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_AVX2)
+    {
+      point_class->process = gimp_operation_point_layer_mode_process_avx2;
+      return;
+    }
+#endif
+
+#if COMPILE_SSE2_INTRINSICS
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_SSE2)
+    {
+      point_class->process = gimp_operation_point_layer_mode_process_sse2;
+      return;
+    }
+#endif
+}
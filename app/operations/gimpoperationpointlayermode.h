@@ -30,11 +30,56 @@
 #define GIMP_OPERATION_POINT_LAYER_MODE_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GIMP_TYPE_OPERATION_POINT_LAYER_MODE, GimpOperationPointLayerModeClass))
 
 
+/*  The blend functions that have vectorized kernels, see
+ *  gimpoperationpointlayermode-kernels.h
+ */
+typedef enum
+{
+  GIMP_LAYER_BLEND_NONE,
+  GIMP_LAYER_BLEND_NORMAL,
+  GIMP_LAYER_BLEND_MULTIPLY,
+  GIMP_LAYER_BLEND_SCREEN,
+  GIMP_LAYER_BLEND_OVERLAY,
+  GIMP_LAYER_BLEND_DIFFERENCE,
+  GIMP_LAYER_BLEND_ADDITION,
+  GIMP_LAYER_BLEND_SUBTRACT,
+  GIMP_LAYER_BLEND_DARKEN_ONLY,
+  GIMP_LAYER_BLEND_LIGHTEN_ONLY,
+  GIMP_LAYER_BLEND_HUE,
+  GIMP_LAYER_BLEND_SATURATION,
+  GIMP_LAYER_BLEND_COLOR,
+  GIMP_LAYER_BLEND_VALUE,
+  GIMP_LAYER_BLEND_DIVIDE,
+  GIMP_LAYER_BLEND_DODGE,
+  GIMP_LAYER_BLEND_BURN,
+  GIMP_LAYER_BLEND_HARDLIGHT,
+  GIMP_LAYER_BLEND_SOFTLIGHT,
+  GIMP_LAYER_BLEND_GRAIN_EXTRACT,
+  GIMP_LAYER_BLEND_GRAIN_MERGE
+} GimpLayerBlend;
+
+typedef gboolean (* GimpLayerModeFunc) (GeglOperation       *operation,
+                                        void                *in_buf,
+                                        void                *aux_buf,
+                                        void                *aux2_buf,
+                                        void                *out_buf,
+                                        glong                samples,
+                                        const GeglRectangle *roi,
+                                        gint                 level);
+
+
 typedef struct _GimpOperationPointLayerModeClass GimpOperationPointLayerModeClass;
 
 struct _GimpOperationPointLayerModeClass
 {
   GeglOperationPointComposer3Class  parent_class;
+
+  GimpLayerBlend                    blend;
+
+  /*  the plain C process function, also when a vectorized
+   *  kernel was selected for this CPU
+   */
+  GimpLayerModeFunc                 process_scalar;
 };
 
 struct _GimpOperationPointLayerMode
@@ -46,7 +91,10 @@ struct _GimpOperationPointLayerMode
 };
 
 
-GType   gimp_operation_point_layer_mode_get_type (void) G_GNUC_CONST;
+GType   gimp_operation_point_layer_mode_get_type        (void) G_GNUC_CONST;
+
+void    gimp_operation_point_layer_mode_class_set_blend (GimpOperationPointLayerModeClass *klass,
+                                                         GimpLayerBlend                    blend);
 
 
 #endif /* __GIMP_OPERATION_POINT_LAYER_MODE_H__ */
@@ -0,0 +1,252 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gegl-plugin.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "app/operations/operations-types.h"
+
+#include "app/operations/gimp-operations.h"
+#include "app/operations/gimpoperationfusedlayers.h"
+#include "app/operations/gimpoperationnormalmode.h"
+#include "app/operations/gimpoperationpointlayermode.h"
+
+
+/*  Renders a stack of random layers once as a chain of mode nodes,
+ *  the way GimpFilterStack links them, and once with the runs fused
+ *  into gimp:fused-layers nodes like GimpDrawableStack does, and
+ *  prints how long each takes. Every run builds a new graph, so no
+ *  run is served from the caches of the one before.
+ */
+
+#define WIDTH    1024
+#define HEIGHT   1024
+#define N_LAYERS 40
+#define N_RUNS   3
+
+
+typedef struct
+{
+  GeglBuffer  *buffer;
+  gint         offset_x;
+  gint         offset_y;
+  const gchar *operation;
+  gdouble      opacity;
+} Layer;
+
+
+static void
+create_layer (GRand *rand,
+              GType *types,
+              guint  n_types,
+              gint   index,
+              Layer *layer)
+{
+  GeglRectangle  rect;
+  GType          type;
+  guchar        *data;
+  gint           i;
+
+  rect.width  = g_rand_int_range (rand, WIDTH  / 4, WIDTH);
+  rect.height = g_rand_int_range (rand, HEIGHT / 4, HEIGHT);
+  rect.x      = g_rand_int_range (rand, -WIDTH  / 4, WIDTH  - rect.width  / 2);
+  rect.y      = g_rand_int_range (rand, -HEIGHT / 4, HEIGHT - rect.height / 2);
+
+  layer->buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0,
+                                                   rect.width, rect.height),
+                                   babl_format ("R'G'B'A u8"));
+
+  data = g_new (guchar, rect.width * rect.height * 4);
+
+  for (i = 0; i < rect.width * rect.height * 4; i++)
+    data[i] = g_rand_int_range (rand, 0, 256);
+
+  gegl_buffer_set (layer->buffer, NULL, 0, babl_format ("R'G'B'A u8"),
+                   data, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (data);
+
+  layer->offset_x = rect.x;
+  layer->offset_y = rect.y;
+
+  /*  the bottom layer is always normal, see gimp_layer_get_visible_mode()  */
+  if (index == 0)
+    type = GIMP_TYPE_OPERATION_NORMAL_MODE;
+  else
+    type = types[g_rand_int_range (rand, 0, n_types)];
+
+  layer->operation = gegl_operation_class_get_key (g_type_class_peek (type),
+                                                   "name");
+
+  /*  hit the normal mode's pass-through now and then  */
+  layer->opacity = g_rand_boolean (rand) ? 1.0 : g_rand_double (rand);
+}
+
+/*  returns the graph and its top node in @top  */
+static GeglNode *
+build_graph (const Layer  *layers,
+             gboolean      fuse,
+             GeglNode    **top)
+{
+  GeglNode *graph     = gegl_node_new ();
+  GeglNode *chain_top = NULL;
+  GeglNode *fused_top = NULL;
+  gint      n_fused   = 0;
+  gint      i;
+
+  for (i = 0; i < N_LAYERS; i++)
+    {
+      GeglNode *source;
+      GeglNode *offset;
+      GeglNode *mode;
+      gchar     aux_name[16];
+      gchar     mode_name[16];
+
+      source = gegl_node_new_child (graph,
+                                    "operation", "gegl:buffer-source",
+                                    "buffer",    layers[i].buffer,
+                                    NULL);
+      offset = gegl_node_new_child (graph,
+                                    "operation", "gegl:translate",
+                                    "x",         (gdouble) layers[i].offset_x,
+                                    "y",         (gdouble) layers[i].offset_y,
+                                    NULL);
+      gegl_node_connect_to (source, "output", offset, "input");
+
+      mode = gegl_node_new_child (graph,
+                                  "operation", layers[i].operation,
+                                  "opacity",   layers[i].opacity,
+                                  NULL);
+
+      if (! fuse)
+        {
+          if (chain_top)
+            gegl_node_connect_to (chain_top, "output", mode, "input");
+
+          gegl_node_connect_to (offset, "output", mode, "aux");
+
+          chain_top = mode;
+
+          continue;
+        }
+
+      if (! fused_top || n_fused == GIMP_FUSED_LAYERS_MAX_LAYERS)
+        {
+          GeglNode *node = gegl_node_new_child (graph,
+                                                "operation", "gimp:fused-layers",
+                                                NULL);
+
+          if (fused_top)
+            gegl_node_connect_to (fused_top, "output", node, "input");
+
+          fused_top = node;
+          n_fused   = 0;
+        }
+
+      n_fused++;
+
+      g_snprintf (aux_name,  sizeof (aux_name),  "aux%d",  n_fused);
+      g_snprintf (mode_name, sizeof (mode_name), "mode%d", n_fused);
+
+      gegl_node_connect_to (offset, "output", fused_top, aux_name);
+      gegl_node_set (fused_top, mode_name, mode, NULL);
+    }
+
+  *top = fuse ? fused_top : chain_top;
+
+  return graph;
+}
+
+static gdouble
+render (const Layer *layers,
+        gboolean     fuse,
+        gfloat      *dest)
+{
+  gdouble best = G_MAXDOUBLE;
+  gint    run;
+
+  for (run = 0; run < N_RUNS; run++)
+    {
+      GeglNode *graph;
+      GeglNode *top;
+      GTimer   *timer;
+
+      graph = build_graph (layers, fuse, &top);
+      timer = g_timer_new ();
+
+      gegl_node_blit (top, 1.0, GEGL_RECTANGLE (0, 0, WIDTH, HEIGHT),
+                      babl_format ("R'G'B'A float"), dest,
+                      GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+      best = MIN (best, g_timer_elapsed (timer, NULL));
+
+      g_timer_destroy (timer);
+      g_object_unref (graph);
+    }
+
+  return best;
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  Layer    layers[N_LAYERS];
+  GType   *types;
+  guint    n_types;
+  GRand   *rand;
+  gfloat  *pixels;
+  gdouble  chain_time;
+  gdouble  fused_time;
+  gint     i;
+
+  gegl_init (&argc, &argv);
+  gimp_operations_init ();
+
+  types = g_type_children (GIMP_TYPE_OPERATION_POINT_LAYER_MODE, &n_types);
+  rand  = g_rand_new_with_seed (1);
+
+  for (i = 0; i < N_LAYERS; i++)
+    create_layer (rand, types, n_types, i, &layers[i]);
+
+  pixels = g_new (gfloat, WIDTH * HEIGHT * 4);
+
+  chain_time = render (layers, FALSE, pixels);
+  fused_time = render (layers, TRUE,  pixels);
+
+  g_print ("%d layers, %dx%d\n", N_LAYERS, WIDTH, HEIGHT);
+  g_print ("  chained %8.1f ms\n", chain_time * 1000.0);
+  g_print ("  fused   %8.1f ms\n", fused_time * 1000.0);
+
+  g_free (pixels);
+
+  for (i = 0; i < N_LAYERS; i++)
+    g_object_unref (layers[i].buffer);
+
+  g_rand_free (rand);
+  g_free (types);
+
+  gegl_exit ();
+
+  return 0;
+}
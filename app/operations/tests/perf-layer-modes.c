@@ -0,0 +1,187 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gegl-plugin.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "app/operations/operations-types.h"
+
+#include "app/operations/gimp-operations.h"
+#include "app/operations/gimpoperationpointlayermode.h"
+#include "app/operations/gimpoperationpointlayermode-simd.h"
+
+
+/*  Runs every layer mode kernel that is available on this CPU over
+ *  random pixels and prints its throughput. test-layer-modes checks
+ *  that the kernels are correct.
+ */
+
+#define N_PIXELS (1024 * 1024)
+#define N_RUNS   5
+
+
+typedef struct
+{
+  const gchar       *name;
+  GimpLayerModeFunc  func;
+} Kernel;
+
+
+static gint
+get_kernels (GimpOperationPointLayerModeClass *klass,
+             Kernel                           *kernels)
+{
+  gint n_kernels = 0;
+
+  kernels[n_kernels].name   = "scalar";
+  kernels[n_kernels++].func = klass->process_scalar;
+
+#if COMPILE_SSE2_INTRINSICS
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_SSE2)
+    {
+      kernels[n_kernels].name   = "sse2";
+      kernels[n_kernels++].func = gimp_operation_point_layer_mode_process_sse2;
+    }
+#endif
+
+#if COMPILE_AVX2_INTRINSICS
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_AVX2)
+    {
+      kernels[n_kernels].name   = "avx2";
+      kernels[n_kernels++].func = gimp_operation_point_layer_mode_process_avx2;
+    }
+#endif
+
+  return n_kernels;
+}
+
+static gfloat
+random_value (GRand *rand)
+{
+  /*  make sure the edge cases of the blend functions get hit  */
+  switch (g_rand_int_range (rand, 0, 16))
+    {
+    case 0:  return 0.0;
+    case 1:  return 0.5;
+    case 2:  return 1.0;
+    default: return g_rand_double (rand);
+    }
+}
+
+static void
+perf_layer_mode (GType         type,
+                 const gfloat *in,
+                 const gfloat *layer,
+                 gfloat       *out)
+{
+  GimpOperationPointLayerModeClass *klass;
+  GeglOperation                    *operation;
+  Kernel                            kernels[3];
+  gint                              n_kernels;
+  gint                              i;
+
+  klass = g_type_class_ref (type);
+
+  if (klass->blend == GIMP_LAYER_BLEND_NONE)
+    {
+      g_type_class_unref (klass);
+      return;
+    }
+
+  operation = g_object_new (type, "opacity", 0.8, NULL);
+  n_kernels = get_kernels (klass, kernels);
+
+  g_print ("%s\n",
+           gegl_operation_class_get_key (GEGL_OPERATION_CLASS (klass), "name"));
+
+  for (i = 0; i < n_kernels; i++)
+    {
+      gdouble best = G_MAXDOUBLE;
+      gint    run;
+
+      for (run = 0; run < N_RUNS; run++)
+        {
+          GTimer *timer = g_timer_new ();
+
+          kernels[i].func (operation,
+                           (gpointer) in, (gpointer) layer, NULL,
+                           out, N_PIXELS, NULL, 0);
+
+          best = MIN (best, g_timer_elapsed (timer, NULL));
+
+          g_timer_destroy (timer);
+        }
+
+      g_print ("  %-8s %8.1f Mpixels/s\n",
+               kernels[i].name, N_PIXELS / best / 1000000.0);
+    }
+
+  g_object_unref (operation);
+  g_type_class_unref (klass);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GType  *types;
+  guint   n_types;
+  gfloat *in;
+  gfloat *layer;
+  gfloat *out;
+  GRand  *rand;
+  gint    i;
+
+  gegl_init (&argc, &argv);
+  gimp_operations_init ();
+
+  in    = g_new (gfloat, N_PIXELS * 4);
+  layer = g_new (gfloat, N_PIXELS * 4);
+  out   = g_new (gfloat, N_PIXELS * 4);
+
+  rand = g_rand_new_with_seed (1);
+
+  for (i = 0; i < N_PIXELS * 4; i++)
+    {
+      in[i]    = random_value (rand);
+      layer[i] = random_value (rand);
+    }
+
+  g_rand_free (rand);
+
+  types = g_type_children (GIMP_TYPE_OPERATION_POINT_LAYER_MODE, &n_types);
+
+  for (i = 0; i < n_types; i++)
+    perf_layer_mode (types[i], in, layer, out);
+
+  g_free (types);
+
+  g_free (in);
+  g_free (layer);
+  g_free (out);
+
+  gegl_exit ();
+
+  return 0;
+}
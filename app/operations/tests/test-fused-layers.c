@@ -0,0 +1,341 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gegl-plugin.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "app/operations/operations-types.h"
+
+#include "app/operations/gimp-operations.h"
+#include "app/operations/gimpoperationfusedlayers.h"
+#include "app/operations/gimpoperationnormalmode.h"
+#include "app/operations/gimpoperationpointlayermode.h"
+
+
+/*  Checks that stacks of random layers composite to the same bits
+ *  when they are fused into gimp:fused-layers nodes as when they are
+ *  chained, also after a layer's opacity or mode changed.
+ */
+
+#define WIDTH    200
+#define HEIGHT   150
+#define N_LAYERS 24     /* more than one fused node */
+#define N_STACKS 8
+
+#define ADD_TEST(function) \
+  g_test_add_func ("/gimp-fused-layers/" #function, function);
+
+
+typedef struct
+{
+  GeglNode *chain_top;
+  GeglNode *fused_top;
+  GeglNode *chain_modes[N_LAYERS];
+  GeglNode *fused_modes[N_LAYERS];
+  GeglNode *fused_nodes[N_LAYERS];
+} Stack;
+
+
+static GType *types   = NULL;
+static guint  n_types = 0;
+
+
+static GeglBuffer *
+create_layer (GRand *rand,
+              gint  *offset_x,
+              gint  *offset_y)
+{
+  GeglRectangle  rect;
+  GeglBuffer    *buffer;
+  guchar        *data;
+  gint           i;
+
+  rect.width  = g_rand_int_range (rand, WIDTH  / 4, WIDTH);
+  rect.height = g_rand_int_range (rand, HEIGHT / 4, HEIGHT);
+  rect.x      = g_rand_int_range (rand, -WIDTH  / 4, WIDTH  - rect.width  / 2);
+  rect.y      = g_rand_int_range (rand, -HEIGHT / 4, HEIGHT - rect.height / 2);
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, rect.width, rect.height),
+                            babl_format ("R'G'B'A u8"));
+
+  data = g_new (guchar, rect.width * rect.height * 4);
+
+  for (i = 0; i < rect.width * rect.height * 4; i++)
+    data[i] = g_rand_int_range (rand, 0, 256);
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("R'G'B'A u8"),
+                   data, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (data);
+
+  *offset_x = rect.x;
+  *offset_y = rect.y;
+
+  return buffer;
+}
+
+/*  builds the same random stack twice in @graph: as a chain of mode
+ *  nodes, and with separate mode nodes on gimp:fused-layers nodes
+ */
+static void
+create_stack (GeglNode *graph,
+              guint32   seed,
+              Stack    *stack)
+{
+  GRand    *rand      = g_rand_new_with_seed (seed);
+  GeglNode *fused_top = NULL;
+  gint      n_fused   = 0;
+  gint      i;
+
+  memset (stack, 0, sizeof (Stack));
+
+  for (i = 0; i < N_LAYERS; i++)
+    {
+      GeglBuffer  *buffer;
+      GeglNode    *source;
+      GeglNode    *offset;
+      GType        type;
+      const gchar *operation;
+      gdouble      opacity;
+      gchar        aux_name[16];
+      gchar        mode_name[16];
+      gint         offset_x;
+      gint         offset_y;
+
+      buffer = create_layer (rand, &offset_x, &offset_y);
+
+      source = gegl_node_new_child (graph,
+                                    "operation", "gegl:buffer-source",
+                                    "buffer",    buffer,
+                                    NULL);
+      offset = gegl_node_new_child (graph,
+                                    "operation", "gegl:translate",
+                                    "x",         (gdouble) offset_x,
+                                    "y",         (gdouble) offset_y,
+                                    NULL);
+      gegl_node_connect_to (source, "output", offset, "input");
+
+      g_object_unref (buffer);
+
+      /*  the bottom layer is always normal, see gimp_layer_get_visible_mode()  */
+      if (i == 0)
+        type = GIMP_TYPE_OPERATION_NORMAL_MODE;
+      else
+        type = types[g_rand_int_range (rand, 0, n_types)];
+
+      operation = gegl_operation_class_get_key (g_type_class_peek (type),
+                                                "name");
+
+      /*  hit the normal mode's pass-through now and then  */
+      opacity = g_rand_boolean (rand) ? 1.0 : g_rand_double (rand);
+
+      stack->chain_modes[i] = gegl_node_new_child (graph,
+                                                   "operation", operation,
+                                                   "opacity",   opacity,
+                                                   NULL);
+      stack->fused_modes[i] = gegl_node_new_child (graph,
+                                                   "operation", operation,
+                                                   "opacity",   opacity,
+                                                   NULL);
+
+      if (stack->chain_top)
+        gegl_node_connect_to (stack->chain_top,     "output",
+                              stack->chain_modes[i], "input");
+
+      gegl_node_connect_to (offset,                "output",
+                            stack->chain_modes[i], "aux");
+
+      stack->chain_top = stack->chain_modes[i];
+
+      if (! fused_top || n_fused == GIMP_FUSED_LAYERS_MAX_LAYERS)
+        {
+          GeglNode *node = gegl_node_new_child (graph,
+                                                "operation", "gimp:fused-layers",
+                                                NULL);
+
+          if (fused_top)
+            gegl_node_connect_to (fused_top, "output", node, "input");
+
+          fused_top = node;
+          n_fused   = 0;
+        }
+
+      n_fused++;
+
+      g_snprintf (aux_name,  sizeof (aux_name),  "aux%d",  n_fused);
+      g_snprintf (mode_name, sizeof (mode_name), "mode%d", n_fused);
+
+      gegl_node_connect_to (offset, "output", fused_top, aux_name);
+      gegl_node_set (fused_top, mode_name, stack->fused_modes[i], NULL);
+
+      stack->fused_nodes[i] = fused_top;
+    }
+
+  stack->fused_top = fused_top;
+
+  g_rand_free (rand);
+}
+
+static void
+assert_stack_equal (Stack *stack)
+{
+  gfloat *chain_pixels = g_new (gfloat, WIDTH * HEIGHT * 4);
+  gfloat *fused_pixels = g_new (gfloat, WIDTH * HEIGHT * 4);
+
+  gegl_node_blit (stack->chain_top, 1.0, GEGL_RECTANGLE (0, 0, WIDTH, HEIGHT),
+                  babl_format ("R'G'B'A float"), chain_pixels,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+  gegl_node_blit (stack->fused_top, 1.0, GEGL_RECTANGLE (0, 0, WIDTH, HEIGHT),
+                  babl_format ("R'G'B'A float"), fused_pixels,
+                  GEGL_AUTO_ROWSTRIDE, GEGL_BLIT_DEFAULT);
+
+  g_assert (memcmp (chain_pixels, fused_pixels,
+                    WIDTH * HEIGHT * 4 * sizeof (gfloat)) == 0);
+
+  g_free (chain_pixels);
+  g_free (fused_pixels);
+}
+
+/*  does what GimpLayer and GimpDrawableStack do when a fused layer's
+ *  mode node changes
+ */
+static void
+change_layer (Stack       *stack,
+              gint         layer,
+              const gchar *property,
+              ...)
+{
+  va_list var_args;
+
+  va_start (var_args, property);
+  gegl_node_set_valist (stack->chain_modes[layer], property, var_args);
+  va_end (var_args);
+
+  va_start (var_args, property);
+  gegl_node_set_valist (stack->fused_modes[layer], property, var_args);
+  va_end (var_args);
+
+  g_assert (gimp_operation_fused_layers_can_fuse (stack->fused_modes[layer]));
+
+  gegl_operation_invalidate (gegl_node_get_gegl_operation (stack->fused_nodes[layer]),
+                             NULL, TRUE);
+}
+
+static void
+fused_equals_chain (void)
+{
+  gint i;
+
+  for (i = 0; i < N_STACKS; i++)
+    {
+      GeglNode *graph = gegl_node_new ();
+      Stack     stack;
+
+      create_stack (graph, i + 1, &stack);
+      assert_stack_equal (&stack);
+
+      g_object_unref (graph);
+    }
+}
+
+static void
+opacity_changed (void)
+{
+  GeglNode *graph = gegl_node_new ();
+  Stack     stack;
+
+  create_stack (graph, 1, &stack);
+  assert_stack_equal (&stack);
+
+  change_layer (&stack, 3, "opacity", 0.25, NULL);
+  assert_stack_equal (&stack);
+
+  change_layer (&stack, N_LAYERS - 1, "opacity", 1.0, NULL);
+  assert_stack_equal (&stack);
+
+  g_object_unref (graph);
+}
+
+static void
+mode_changed (void)
+{
+  GeglNode *graph = gegl_node_new ();
+  Stack     stack;
+
+  create_stack (graph, 2, &stack);
+  assert_stack_equal (&stack);
+
+  change_layer (&stack, 5, "operation", "gimp:difference-mode", NULL);
+  assert_stack_equal (&stack);
+
+  change_layer (&stack, N_LAYERS - 2, "operation", "gimp:normal-mode", NULL);
+  assert_stack_equal (&stack);
+
+  g_object_unref (graph);
+}
+
+static void
+can_fuse (void)
+{
+  GeglNode *graph = gegl_node_new ();
+  GeglNode *mode;
+  GeglNode *other;
+
+  mode  = gegl_node_new_child (graph,
+                               "operation", "gimp:multiply-mode",
+                               NULL);
+  other = gegl_node_new_child (graph,
+                               "operation", "gegl:over",
+                               NULL);
+
+  g_assert (gimp_operation_fused_layers_can_fuse (mode));
+  g_assert (! gimp_operation_fused_layers_can_fuse (other));
+
+  g_object_unref (graph);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  gint result;
+
+  gegl_init (&argc, &argv);
+  gimp_operations_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  types = g_type_children (GIMP_TYPE_OPERATION_POINT_LAYER_MODE, &n_types);
+
+  ADD_TEST (fused_equals_chain);
+  ADD_TEST (opacity_changed);
+  ADD_TEST (mode_changed);
+  ADD_TEST (can_fuse);
+
+  result = g_test_run ();
+
+  g_free (types);
+
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,369 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gegl-plugin.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "app/operations/operations-types.h"
+
+#include "app/operations/gimp-operations.h"
+#include "app/operations/gimpoperationpointlayermode.h"
+#include "app/operations/gimpoperationpointlayermode-simd.h"
+
+
+/*  Checks that every vectorized layer mode kernel this CPU supports
+ *  gives the same result as the scalar code, and that the reference
+ *  compositions of app/operations/tests/data come out the same with
+ *  each kernel.
+ */
+
+#define DATA_DIR      "data"
+#define N_PIXELS      4099    /* odd, so the kernels' tails get used */
+#define MAX_ERROR     1e-4
+#define MAX_REF_ERROR 1
+
+
+typedef struct
+{
+  const gchar       *name;
+  GimpLayerModeFunc  func;
+} Kernel;
+
+
+static gint
+get_kernels (GimpOperationPointLayerModeClass *klass,
+             Kernel                           *kernels)
+{
+  gint n_kernels = 0;
+
+  kernels[n_kernels].name   = "scalar";
+  kernels[n_kernels++].func = klass->process_scalar;
+
+#if COMPILE_SSE2_INTRINSICS
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_SSE2)
+    {
+      kernels[n_kernels].name   = "sse2";
+      kernels[n_kernels++].func = gimp_operation_point_layer_mode_process_sse2;
+    }
+#endif
+
+#if COMPILE_AVX2_INTRINSICS
+  if (gimp_cpu_accel_get_support () & GIMP_CPU_ACCEL_X86_AVX2)
+    {
+      kernels[n_kernels].name   = "avx2";
+      kernels[n_kernels++].func = gimp_operation_point_layer_mode_process_avx2;
+    }
+#endif
+
+  return n_kernels;
+}
+
+static gfloat
+random_value (GRand *rand)
+{
+  /*  make sure the edge cases of the blend functions get hit  */
+  switch (g_rand_int_range (rand, 0, 16))
+    {
+    case 0:  return 0.0;
+    case 1:  return 0.5;
+    case 2:  return 1.0;
+    default: return g_rand_double (rand);
+    }
+}
+
+static gdouble
+max_error (const gfloat *reference,
+           const gfloat *result,
+           gint          n_values)
+{
+  gdouble error = 0.0;
+  gint    i;
+
+  for (i = 0; i < n_values; i++)
+    {
+      /*  the scalar code produces NaN for some 0 / 0 cases,
+       *  the kernels clamp them instead
+       */
+      if (isnan (reference[i]))
+        continue;
+
+      if (isnan (result[i]))
+        return G_MAXDOUBLE;
+
+      error = MAX (error, fabs (reference[i] - result[i]));
+    }
+
+  return error;
+}
+
+static GeglBuffer *
+load_buffer (const gchar *path)
+{
+  GeglNode   *graph  = gegl_node_new ();
+  GeglBuffer *buffer = NULL;
+  GeglNode   *load;
+  GeglNode   *sink;
+
+  load = gegl_node_new_child (graph,
+                              "operation", "gegl:load",
+                              "path",      path,
+                              NULL);
+  sink = gegl_node_new_child (graph,
+                              "operation", "gegl:buffer-sink",
+                              "buffer",    &buffer,
+                              NULL);
+
+  gegl_node_link (load, sink);
+  gegl_node_process (sink);
+
+  g_object_unref (graph);
+
+  return buffer;
+}
+
+static gint
+max_u8_error (GeglBuffer *buffer,
+              GeglBuffer *reference)
+{
+  const GeglRectangle *extent = gegl_buffer_get_extent (reference);
+  guchar              *a;
+  guchar              *b;
+  gint                 error  = 0;
+  gint                 i;
+
+  if (! gegl_rectangle_equal (extent, gegl_buffer_get_extent (buffer)))
+    return G_MAXINT;
+
+  a = g_new (guchar, extent->width * extent->height * 4);
+  b = g_new (guchar, extent->width * extent->height * 4);
+
+  gegl_buffer_get (buffer, extent, 1.0, babl_format ("R'G'B'A u8"),
+                   a, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gegl_buffer_get (reference, extent, 1.0, babl_format ("R'G'B'A u8"),
+                   b, GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  for (i = 0; i < extent->width * extent->height * 4; i++)
+    error = MAX (error, ABS (a[i] - b[i]));
+
+  g_free (a);
+  g_free (b);
+
+  return error;
+}
+
+/*  runs the operation's reference composition once with each kernel
+ *  swapped in as the process function
+ */
+static void
+check_reference (GimpOperationPointLayerModeClass *klass,
+                 const Kernel                     *kernels,
+                 gint                              n_kernels)
+{
+  GeglOperationClass               *operation_class;
+  GeglOperationPointComposer3Class *point_class;
+  GimpLayerModeFunc                 process;
+  const gchar                      *image;
+  const gchar                      *xml;
+  gchar                            *root;
+  gchar                            *xml_root;
+  gchar                            *image_path;
+  GeglBuffer                       *reference;
+  gint                              scalar_error = 0;
+  gint                              i;
+
+  operation_class = GEGL_OPERATION_CLASS (klass);
+  point_class     = GEGL_OPERATION_POINT_COMPOSER3_CLASS (klass);
+
+  image = gegl_operation_class_get_key (operation_class, "reference-image");
+  xml   = gegl_operation_class_get_key (operation_class, "reference-composition");
+
+  if (! image || ! xml)
+    return;
+
+  root       = g_get_current_dir ();
+  xml_root   = g_build_path (G_DIR_SEPARATOR_S, root, DATA_DIR, NULL);
+  image_path = g_build_path (G_DIR_SEPARATOR_S, root, DATA_DIR, image, NULL);
+
+  reference = load_buffer (image_path);
+  g_assert (reference != NULL);
+
+  process = point_class->process;
+
+  for (i = 0; i < n_kernels; i++)
+    {
+      GeglNode   *composition;
+      GeglNode   *sink;
+      GeglBuffer *buffer = NULL;
+      gint        error;
+
+      point_class->process = kernels[i].func;
+
+      composition = gegl_node_new_from_xml (xml, xml_root);
+      sink = gegl_node_new_child (composition,
+                                  "operation", "gegl:buffer-sink",
+                                  "buffer",    &buffer,
+                                  NULL);
+      gegl_node_connect_to (composition, "output", sink, "input");
+      gegl_node_process (sink);
+
+      g_assert (buffer != NULL);
+
+      error = max_u8_error (buffer, reference);
+
+      if (i == 0)
+        scalar_error = error;
+      else
+        g_assert_cmpint (error, <=, MAX (scalar_error, MAX_REF_ERROR));
+
+      g_object_unref (buffer);
+      g_object_unref (composition);
+    }
+
+  point_class->process = process;
+
+  g_object_unref (reference);
+
+  g_free (root);
+  g_free (xml_root);
+  g_free (image_path);
+}
+
+static void
+test_layer_mode (gconstpointer data)
+{
+  GType                             type = GPOINTER_TO_SIZE (data);
+  GimpOperationPointLayerModeClass *klass;
+  GeglOperation                    *operation;
+  Kernel                            kernels[3];
+  gint                              n_kernels;
+  gfloat                           *in;
+  gfloat                           *layer;
+  gfloat                           *mask;
+  gfloat                           *reference;
+  gfloat                           *out;
+  GRand                            *rand;
+  gint                              i;
+
+  klass     = g_type_class_ref (type);
+  operation = g_object_new (type, "opacity", 0.8, NULL);
+  n_kernels = get_kernels (klass, kernels);
+
+  in        = g_new (gfloat, N_PIXELS * 4);
+  layer     = g_new (gfloat, N_PIXELS * 4);
+  mask      = g_new (gfloat, N_PIXELS);
+  reference = g_new (gfloat, N_PIXELS * 4);
+  out       = g_new (gfloat, N_PIXELS * 4);
+
+  rand = g_rand_new_with_seed (1);
+
+  for (i = 0; i < N_PIXELS * 4; i++)
+    {
+      in[i]    = random_value (rand);
+      layer[i] = random_value (rand);
+    }
+
+  for (i = 0; i < N_PIXELS; i++)
+    mask[i] = random_value (rand);
+
+  /*  the HSV and HSL modes treat gray pixels specially  */
+  for (i = 0; i < N_PIXELS; i += 7)
+    in[i * 4 + 1] = in[i * 4 + 2] = in[i * 4];
+
+  for (i = 3; i < N_PIXELS; i += 11)
+    layer[i * 4 + 1] = layer[i * 4 + 2] = layer[i * 4];
+
+  g_rand_free (rand);
+
+  for (i = 1; i < n_kernels; i++)
+    {
+      kernels[0].func (operation,
+                       in, layer, NULL, reference, N_PIXELS, NULL, 0);
+      kernels[i].func (operation,
+                       in, layer, NULL, out, N_PIXELS, NULL, 0);
+
+      g_assert_cmpfloat (max_error (reference, out, N_PIXELS * 4),
+                         <=, MAX_ERROR);
+
+      kernels[0].func (operation,
+                       in, layer, mask, reference, N_PIXELS, NULL, 0);
+      kernels[i].func (operation,
+                       in, layer, mask, out, N_PIXELS, NULL, 0);
+
+      g_assert_cmpfloat (max_error (reference, out, N_PIXELS * 4),
+                         <=, MAX_ERROR);
+    }
+
+  check_reference (klass, kernels, n_kernels);
+
+  g_free (in);
+  g_free (layer);
+  g_free (mask);
+  g_free (reference);
+  g_free (out);
+
+  g_object_unref (operation);
+  g_type_class_unref (klass);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GType *types;
+  guint  n_types;
+  gint   result;
+  gint   i;
+
+  gegl_init (&argc, &argv);
+  gimp_operations_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  types = g_type_children (GIMP_TYPE_OPERATION_POINT_LAYER_MODE, &n_types);
+
+  for (i = 0; i < n_types; i++)
+    {
+      GimpOperationPointLayerModeClass *klass = g_type_class_ref (types[i]);
+
+      if (klass->blend != GIMP_LAYER_BLEND_NONE)
+        {
+          gchar *path;
+
+          path = g_strdup_printf ("/gimp-layer-modes/%s",
+                                  g_type_name (types[i]));
+          g_test_add_data_func (path, GSIZE_TO_POINTER (types[i]),
+                                test_layer_mode);
+          g_free (path);
+        }
+
+      g_type_class_unref (klass);
+    }
+
+  g_free (types);
+
+  result = g_test_run ();
+
+  gegl_exit ();
+
+  return result;
+}
@@ -0,0 +1,631 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpheal-laplace.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+
+#include "libgimpmath/gimpmath.h"
+
+#include "paint-types.h"
+
+#include "core/gimp.h"
+#include "core/gimp-parallel.h"
+
+#include "gimpheal-laplace.h"
+
+
+/*  gimp_heal_laplace_sor() is the original red/black Gauss-Seidel
+ *  solver with an over-relaxation factor of 1.8.  An iteration only
+ *  moves information by a pixel or two, so the number of iterations
+ *  needed grows with the square of the brush size, and large brushes
+ *  hit SOR_MAX_ITER long before the solution has settled.
+ *
+ *  gimp_heal_laplace_multigrid() runs V-cycles over a pyramid of
+ *  grids of half the size each.  Plain red/black Gauss-Seidel quickly
+ *  smooths out the part of the error that is high frequency on a
+ *  level, the remaining residual is passed down to the next coarser
+ *  level, and the correction found there is interpolated back up.
+ *  The number of cycles needed does not depend on the brush size.
+ *
+ *  Every second pixel of every second row of a level is a pixel of
+ *  the next coarser level, so the boundary stays roughly in place.
+ *  Residuals are restricted with full weighting, corrections are
+ *  interpolated bilinearly, and the coarse levels solve for the
+ *  correction with zero as their boundary condition.
+ *
+ *  Each half sweep of the smoother, and the transfers between the
+ *  levels, are split into bands of rows that run on the shared
+ *  worker pool, on levels large enough for that to pay off.
+ */
+
+
+#define SOR_EPSILON         1e-8
+#define SOR_MAX_ITER        500
+
+#define MG_EPSILON          1e-5   /*  largest change of the last sweep  */
+#define MG_MAX_CYCLES       50
+#define MG_PRE_SWEEPS       3
+#define MG_POST_SWEEPS      3
+#define MG_COARSE_SWEEPS    32
+#define MG_MIN_SIZE         8
+
+#define PARALLEL_MIN_PIXELS (128 * 128)
+
+
+typedef struct _Level   Level;
+typedef struct _Solver  Solver;
+typedef struct _RowTask RowTask;
+
+typedef gfloat (* RowFunc) (Solver *solver,
+                            Level  *level,
+                            gint    row,
+                            gint    color);
+
+struct _Level
+{
+  gint    width;
+  gint    height;
+  gfloat *u;     /*  the solution on level 0, a correction below  */
+  gfloat *f;     /*  the right hand side, NULL on level 0         */
+  gfloat *r;     /*  the residual, NULL on the coarsest level     */
+  guchar *mask;  /*  non-zero for unknowns                        */
+};
+
+struct _Solver
+{
+  Gimp   *gimp;
+  gint    depth;
+  gfloat *zero;  /*  @depth zeros, read for neighbours outside the grid  */
+  Level  *levels;
+  gint    n_levels;
+};
+
+struct _RowTask
+{
+  Solver  *solver;
+  Level   *level;
+  RowFunc  func;
+  gint     color;
+  gint     n_rows;
+  gint     n_jobs;
+  gfloat  *diffs;
+};
+
+
+/*  the original solver  */
+
+/* Perform one iteration of the laplace solver for matrix, in place,
+ * and return the square of the cummulative change of the solution.
+ */
+static gdouble
+gimp_heal_laplace_sor_iteration (gfloat       *matrix,
+                                 gint          width,
+                                 gint          height,
+                                 gint          depth,
+                                 const guchar *mask)
+{
+  const gint    rowstride = width * depth;
+  const gfloat  w         = 1.80 * 0.25; /* Over-relaxation = 1.8 */
+  gdouble       err       = 0.0;
+  gint          color, i, j, k;
+
+  /* we use a red/black checker model of the discretization grid.
+   * As we do the reds first, the blacks can use them right away to
+   * accelerate the convergence.  The border and the pixels outside
+   * of the mask are never touched.
+   */
+  for (color = 0; color < 2; color++)
+    {
+      for (i = 1; i < height - 1; i++)
+        {
+          for (j = ((i + color) % 2) ? 1 : 2; j < width - 1; j += 2)
+            {
+              gfloat *p = matrix + i * rowstride + j * depth;
+
+              if (! mask[i * width + j])
+                continue;
+
+              /* Use Gauss Siedel to get the correction factor then
+               * over-relax it
+               */
+              for (k = 0; k < depth; k++)
+                {
+                  gfloat diff = w * (p[k - depth] +     /* west  */
+                                     p[k + depth] +     /* east  */
+                                     p[k - rowstride] + /* north */
+                                     p[k + rowstride] - /* south */
+                                     4.0f * p[k]);
+
+                  p[k] += diff;
+                  err  += diff * diff;
+                }
+            }
+        }
+    }
+
+  return err;
+}
+
+gint
+gimp_heal_laplace_sor (gfloat       *matrix,
+                       gint          width,
+                       gint          height,
+                       gint          depth,
+                       const guchar *mask)
+{
+  gint i;
+
+  g_return_val_if_fail (matrix != NULL, 0);
+  g_return_val_if_fail (mask != NULL, 0);
+
+  /* repeat until convergence or max iterations */
+  for (i = 0; i < SOR_MAX_ITER; i++)
+    {
+      if (gimp_heal_laplace_sor_iteration (matrix, width, height, depth,
+                                           mask) < SOR_EPSILON)
+        return i + 1;
+    }
+
+  return SOR_MAX_ITER;
+}
+
+
+/*  the multigrid solver  */
+
+static void
+gimp_heal_laplace_run_rows_job (gint     job,
+                                RowTask *task)
+{
+  gint   first = task->n_rows * job       / task->n_jobs;
+  gint   last  = task->n_rows * (job + 1) / task->n_jobs;
+  gfloat diff  = 0.0;
+  gint   row;
+
+  for (row = first; row < last; row++)
+    {
+      gfloat row_diff = task->func (task->solver, task->level, row,
+                                    task->color);
+
+      diff = MAX (diff, row_diff);
+    }
+
+  task->diffs[job] = diff;
+}
+
+/*  calls @func for @n_rows rows, in parallel if @level is large
+ *  enough, and returns the largest value it returned
+ */
+static gfloat
+gimp_heal_laplace_run_rows (Solver  *solver,
+                            Level   *level,
+                            gint     n_rows,
+                            RowFunc  func,
+                            gint     color)
+{
+  RowTask task;
+  gfloat  diff = 0.0;
+  gint    i;
+
+  task.solver = solver;
+  task.level  = level;
+  task.func   = func;
+  task.color  = color;
+  task.n_rows = n_rows;
+  task.n_jobs = 1;
+
+  if (solver->gimp && level->width * level->height >= PARALLEL_MIN_PIXELS)
+    task.n_jobs = MIN (gimp_parallel_get_n_threads (solver->gimp), n_rows);
+
+  task.diffs = g_newa (gfloat, MAX (task.n_jobs, 1));
+
+  if (task.n_jobs > 1)
+    gimp_parallel_run (solver->gimp, task.n_jobs,
+                       (GimpParallelFunc) gimp_heal_laplace_run_rows_job,
+                       &task);
+  else
+    gimp_heal_laplace_run_rows_job (0, &task);
+
+  for (i = 0; i < task.n_jobs; i++)
+    diff = MAX (diff, task.diffs[i]);
+
+  return diff;
+}
+
+/*  one half sweep of red/black Gauss-Seidel over one row, only
+ *  pixels of @color are updated and only the other color is read
+ */
+static gfloat
+gimp_heal_laplace_smooth_row (Solver *solver,
+                              Level  *level,
+                              gint    y,
+                              gint    color)
+{
+  const gint    depth  = solver->depth;
+  const gint    stride = level->width * depth;
+  gfloat       *row    = level->u + y * stride;
+  const gfloat *north  = y > 0                 ? row - stride : NULL;
+  const gfloat *south  = y < level->height - 1 ? row + stride : NULL;
+  const gfloat *f      = level->f ? level->f + y * stride : NULL;
+  const guchar *mask   = level->mask + y * level->width;
+  gfloat        diff   = 0.0;
+  gint          x, k;
+
+  for (x = (y + color) & 1; x < level->width; x += 2)
+    {
+      gfloat       *p = row + x * depth;
+      const gfloat *n, *s, *w, *e;
+
+      if (! mask[x])
+        continue;
+
+      n = north                  ? north + x * depth : solver->zero;
+      s = south                  ? south + x * depth : solver->zero;
+      w = x > 0                  ? p - depth         : solver->zero;
+      e = x < level->width - 1   ? p + depth         : solver->zero;
+
+      for (k = 0; k < depth; k++)
+        {
+          gfloat value = n[k] + s[k] + w[k] + e[k];
+
+          if (f)
+            value += f[x * depth + k];
+
+          value *= 0.25f;
+
+          diff = MAX (diff, fabsf (value - p[k]));
+          p[k] = value;
+        }
+    }
+
+  return diff;
+}
+
+/*  stores the residual of row @y of @level in its @r  */
+static gfloat
+gimp_heal_laplace_residual_row (Solver *solver,
+                                Level  *level,
+                                gint    y,
+                                gint    color)
+{
+  const gint    depth  = solver->depth;
+  const gint    stride = level->width * depth;
+  const gfloat *row    = level->u + y * stride;
+  const gfloat *north  = y > 0                 ? row - stride : NULL;
+  const gfloat *south  = y < level->height - 1 ? row + stride : NULL;
+  const gfloat *f      = level->f ? level->f + y * stride : NULL;
+  const guchar *mask   = level->mask + y * level->width;
+  gfloat       *r      = level->r + y * stride;
+  gint          x, k;
+
+  for (x = 0; x < level->width; x++)
+    {
+      const gfloat *p = row + x * depth;
+      const gfloat *n, *s, *w, *e;
+
+      if (! mask[x])
+        {
+          for (k = 0; k < depth; k++)
+            r[x * depth + k] = 0.0;
+
+          continue;
+        }
+
+      n = north                ? north + x * depth : solver->zero;
+      s = south                ? south + x * depth : solver->zero;
+      w = x > 0                ? p - depth         : solver->zero;
+      e = x < level->width - 1 ? p + depth         : solver->zero;
+
+      for (k = 0; k < depth; k++)
+        {
+          gfloat value = n[k] + s[k] + w[k] + e[k] - 4.0f * p[k];
+
+          if (f)
+            value += f[x * depth + k];
+
+          r[x * depth + k] = value;
+        }
+    }
+
+  return 0.0;
+}
+
+/*  restricts @level's residual to row @y of the next coarser level's
+ *  right hand side, using full weighting, and clears the coarser
+ *  level's correction
+ */
+static gfloat
+gimp_heal_laplace_restrict_row (Solver *solver,
+                                Level  *level,
+                                gint    y,
+                                gint    color)
+{
+  static const gfloat  weights[3] = { 1.0, 2.0, 1.0 };
+  const gint           depth      = solver->depth;
+  const gint           stride     = level->width * depth;
+  Level               *coarse     = level + 1;
+  const guchar        *mask       = coarse->mask + y * coarse->width;
+  gfloat              *f          = coarse->f + y * coarse->width * depth;
+  gint                 x, k;
+
+  memset (coarse->u + y * coarse->width * depth, 0,
+          coarse->width * depth * sizeof (gfloat));
+
+  for (x = 0; x < coarse->width; x++)
+    {
+      gint dx, dy;
+
+      for (k = 0; k < depth; k++)
+        f[x * depth + k] = 0.0;
+
+      if (! mask[x])
+        continue;
+
+      for (dy = -1; dy <= 1; dy++)
+        {
+          gint fine_y = 2 * y + dy;
+
+          if (fine_y < 0 || fine_y >= level->height)
+            continue;
+
+          for (dx = -1; dx <= 1; dx++)
+            {
+              gint          fine_x = 2 * x + dx;
+              const gfloat *r;
+              gfloat        weight;
+
+              if (fine_x < 0 || fine_x >= level->width)
+                continue;
+
+              r      = level->r + fine_y * stride + fine_x * depth;
+              weight = weights[dx + 1] * weights[dy + 1] * 0.25f;
+
+              for (k = 0; k < depth; k++)
+                f[x * depth + k] += weight * r[k];
+            }
+        }
+    }
+
+  return 0.0;
+}
+
+/*  interpolates the next coarser level's correction bilinearly and
+ *  adds it to row @y of @level
+ */
+static gfloat
+gimp_heal_laplace_prolong_row (Solver *solver,
+                               Level  *level,
+                               gint    y,
+                               gint    color)
+{
+  const gint    depth   = solver->depth;
+  Level        *coarse  = level + 1;
+  const gint    cstride = coarse->width * depth;
+  gfloat       *row     = level->u + y * level->width * depth;
+  const guchar *mask    = level->mask + y * level->width;
+  const gfloat *row0;
+  const gfloat *row1    = NULL;
+  gint          y1;
+  gint          x, k;
+
+  /*  even pixels lie on a coarse pixel, odd ones between two  */
+  row0 = coarse->u + (y / 2) * cstride;
+
+  y1 = (y & 1) ? y / 2 + 1 : y / 2;
+
+  if (y1 < coarse->height)
+    row1 = coarse->u + y1 * cstride;
+
+  for (x = 0; x < level->width; x++)
+    {
+      gfloat       *p  = row + x * depth;
+      gint          x0 = x / 2;
+      gint          x1 = (x & 1) ? x / 2 + 1 : x / 2;
+      gboolean      inside;
+      const gfloat *a, *b, *c, *d;
+
+      if (! mask[x])
+        continue;
+
+      inside = x1 < coarse->width;
+
+      a = row0 + x0 * depth;
+      b = inside         ? row0 + x1 * depth : solver->zero;
+      c = row1           ? row1 + x0 * depth : solver->zero;
+      d = row1 && inside ? row1 + x1 * depth : solver->zero;
+
+      for (k = 0; k < depth; k++)
+        p[k] += (a[k] + b[k] + c[k] + d[k]) * 0.25f;
+    }
+
+  return 0.0;
+}
+
+/*  runs @n_sweeps red/black sweeps and returns the largest change of
+ *  the last one
+ */
+static gfloat
+gimp_heal_laplace_smooth (Solver *solver,
+                          Level  *level,
+                          gint    n_sweeps)
+{
+  gfloat red   = 0.0;
+  gfloat black = 0.0;
+  gint   i;
+
+  for (i = 0; i < n_sweeps; i++)
+    {
+      red   = gimp_heal_laplace_run_rows (solver, level, level->height,
+                                          gimp_heal_laplace_smooth_row, 0);
+      black = gimp_heal_laplace_run_rows (solver, level, level->height,
+                                          gimp_heal_laplace_smooth_row, 1);
+    }
+
+  return MAX (red, black);
+}
+
+static gfloat
+gimp_heal_laplace_v_cycle (Solver *solver)
+{
+  gfloat diff;
+  gint   i;
+
+  for (i = 0; i < solver->n_levels - 1; i++)
+    {
+      Level *level = &solver->levels[i];
+
+      gimp_heal_laplace_smooth (solver, level, MG_PRE_SWEEPS);
+
+      gimp_heal_laplace_run_rows (solver, level, level->height,
+                                  gimp_heal_laplace_residual_row, 0);
+      gimp_heal_laplace_run_rows (solver, level, (level + 1)->height,
+                                  gimp_heal_laplace_restrict_row, 0);
+    }
+
+  diff = gimp_heal_laplace_smooth (solver, &solver->levels[i],
+                                   MG_COARSE_SWEEPS);
+
+  for (i = solver->n_levels - 2; i >= 0; i--)
+    {
+      Level *level = &solver->levels[i];
+
+      gimp_heal_laplace_run_rows (solver, level, level->height,
+                                  gimp_heal_laplace_prolong_row, 0);
+
+      diff = gimp_heal_laplace_smooth (solver, level, MG_POST_SWEEPS);
+    }
+
+  return diff;
+}
+
+gint
+gimp_heal_laplace_multigrid (Gimp         *gimp,
+                             gfloat       *matrix,
+                             gint          width,
+                             gint          height,
+                             gint          depth,
+                             const guchar *mask)
+{
+  Solver    solver;
+  Level    *level;
+  gboolean  any   = FALSE;
+  gint      n_cycles;
+  gint      x, y, i;
+
+  g_return_val_if_fail (gimp == NULL || GIMP_IS_GIMP (gimp), 0);
+  g_return_val_if_fail (matrix != NULL, 0);
+  g_return_val_if_fail (mask != NULL, 0);
+
+  solver.gimp     = gimp;
+  solver.depth    = depth;
+  solver.zero     = g_new0 (gfloat, depth);
+  solver.n_levels = 1;
+
+  for (i = MIN (width, height); i > MG_MIN_SIZE; i = (i + 1) / 2)
+    solver.n_levels++;
+
+  solver.levels = g_new0 (Level, solver.n_levels);
+
+  /*  level 0 works on the matrix itself, its border and the pixels
+   *  outside of the mask are the boundary conditions
+   */
+  level = &solver.levels[0];
+
+  level->width  = width;
+  level->height = height;
+  level->u      = matrix;
+  level->mask   = g_new0 (guchar, width * height);
+
+  for (y = 1; y < height - 1; y++)
+    {
+      for (x = 1; x < width - 1; x++)
+        {
+          if (mask[y * width + x])
+            {
+              level->mask[y * width + x] = TRUE;
+              any = TRUE;
+            }
+        }
+    }
+
+  if (! any)
+    solver.n_levels = 1;
+
+  for (i = 1; i < solver.n_levels; i++)
+    {
+      Level *fine = &solver.levels[i - 1];
+
+      level = &solver.levels[i];
+
+      level->width  = (fine->width  + 1) / 2;
+      level->height = (fine->height + 1) / 2;
+      level->u      = g_new0 (gfloat, level->width * level->height * depth);
+      level->f      = g_new0 (gfloat, level->width * level->height * depth);
+      level->mask   = g_new0 (guchar, level->width * level->height);
+
+      fine->r = g_new (gfloat, fine->width * fine->height * depth);
+
+      /*  a coarse pixel is only an unknown if its four neighbours on
+       *  the finer level are unknowns too, otherwise the coarse level
+       *  would see the boundary further away than it is and
+       *  over-correct
+       */
+      for (y = 1; y < level->height - 1; y++)
+        {
+          for (x = 1; x < level->width - 1; x++)
+            {
+              const guchar *m = fine->mask + 2 * y * fine->width + 2 * x;
+
+              level->mask[y * level->width + x] =
+                m[0] && m[-1] && m[1] && m[-fine->width] && m[fine->width];
+            }
+        }
+    }
+
+  n_cycles = 0;
+
+  while (any && n_cycles < MG_MAX_CYCLES)
+    {
+      n_cycles++;
+
+      if (gimp_heal_laplace_v_cycle (&solver) < MG_EPSILON)
+        break;
+    }
+
+  for (i = 0; i < solver.n_levels; i++)
+    {
+      level = &solver.levels[i];
+
+      if (i > 0)
+        {
+          g_free (level->u);
+          g_free (level->f);
+        }
+
+      g_free (level->r);
+      g_free (level->mask);
+    }
+
+  g_free (solver.levels);
+  g_free (solver.zero);
+
+  return n_cycles;
+}
@@ -0,0 +1,45 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpheal-laplace.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_HEAL_LAPLACE_H__
+#define __GIMP_HEAL_LAPLACE_H__
+
+
+/*  Both solvers solve the laplace equation for @matrix in place.
+ *  @matrix holds @width x @height pixels of @depth floats, @mask
+ *  holds one byte per pixel.  Pixels outside of @mask and on the
+ *  border keep their values, they are the boundary conditions.
+ *  The return value is the number of iterations, or V-cycles, taken.
+ */
+
+gint   gimp_heal_laplace_sor       (gfloat       *matrix,
+                                    gint          width,
+                                    gint          height,
+                                    gint          depth,
+                                    const guchar *mask);
+
+gint   gimp_heal_laplace_multigrid (Gimp         *gimp,
+                                    gfloat       *matrix,
+                                    gint          width,
+                                    gint          height,
+                                    gint          depth,
+                                    const guchar *mask);
+
+
+#endif  /*  __GIMP_HEAL_LAPLACE_H__  */
@@ -19,6 +19,7 @@
 
 #include <string.h>
 
+#include <cairo.h>
 #include <gegl.h>
 
 #include "libgimpbase/gimpbase.h"
@@ -30,6 +31,7 @@
 #include "gegl/gimp-gegl-nodes.h"
 #include "gegl/gimp-gegl-utils.h"
 #include "gegl/gimpapplicator.h"
+#include "gegl/gimptilehandlersnapshot.h"
 
 #include "core/gimp.h"
 #include "core/gimp-utils.h"
@@ -106,6 +108,13 @@ static GimpUndo* gimp_paint_core_real_push_undo      (GimpPaintCore    *core,
                                                       GimpImage        *image,
                                                       const gchar      *undo_desc);
 
+static void      gimp_paint_core_capture_undo        (GimpPaintCore    *core,
+                                                      GimpDrawable     *drawable,
+                                                      gint              x,
+                                                      gint              y,
+                                                      gint              width,
+                                                      gint              height);
+
 
 G_DEFINE_TYPE (GimpPaintCore, gimp_paint_core, GIMP_TYPE_OBJECT)
 
@@ -278,6 +287,35 @@ gimp_paint_core_real_push_undo (GimpPaintCore *core,
                                NULL);
 }
 
+/*  copies the tiles of the drawable, and of the projection if it is
+ *  kept around, which are about to be painted to, unless the stroke
+ *  has painted there before
+ */
+static void
+gimp_paint_core_capture_undo (GimpPaintCore *core,
+                              GimpDrawable  *drawable,
+                              gint           x,
+                              gint           y,
+                              gint           width,
+                              gint           height)
+{
+  gimp_gegl_buffer_snapshot_capture (core->undo_buffer,
+                                     GEGL_RECTANGLE (x, y, width, height));
+
+  if (core->saved_proj_buffer)
+    {
+      gint offset_x;
+      gint offset_y;
+
+      gimp_item_get_offset (GIMP_ITEM (drawable), &offset_x, &offset_y);
+
+      gimp_gegl_buffer_snapshot_capture (core->saved_proj_buffer,
+                                         GEGL_RECTANGLE (x + offset_x,
+                                                         y + offset_y,
+                                                         width, height));
+    }
+}
+
 
 /*  public functions  */
 
@@ -360,11 +398,14 @@ gimp_paint_core_start (GimpPaintCore     *core,
       return FALSE;
     }
 
-  /*  Allocate the undo structure  */
+  /*  Allocate the undo structure, tiles are only copied from the
+   *  drawable when the stroke is about to touch them
+   */
   if (core->undo_buffer)
     g_object_unref (core->undo_buffer);
 
-  core->undo_buffer = gegl_buffer_dup (gimp_drawable_get_buffer (drawable));
+  core->undo_buffer =
+    gimp_gegl_buffer_snapshot_new (gimp_drawable_get_buffer (drawable));
 
   /*  Allocate the saved proj structure  */
   if (core->saved_proj_buffer)
@@ -378,7 +419,7 @@ gimp_paint_core_start (GimpPaintCore     *core,
       GimpPickable *pickable = GIMP_PICKABLE (gimp_image_get_projection (image));
       GeglBuffer   *buffer   = gimp_pickable_get_buffer (pickable);
 
-      core->saved_proj_buffer = gegl_buffer_dup (buffer);
+      core->saved_proj_buffer = gimp_gegl_buffer_snapshot_new (buffer);
     }
 
   /*  Allocate the canvas blocks structure  */
@@ -468,33 +509,20 @@ gimp_paint_core_finish (GimpPaintCore *core,
 
   if (push_undo)
     {
-      GeglBuffer *buffer;
-      gint        x, y, width, height;
-
-      gimp_rectangle_intersect (core->x1, core->y1,
-                                core->x2 - core->x1, core->y2 - core->y1,
-                                0, 0,
-                                gimp_item_get_width  (GIMP_ITEM (drawable)),
-                                gimp_item_get_height (GIMP_ITEM (drawable)),
-                                &x, &y, &width, &height);
-
       gimp_image_undo_group_start (image, GIMP_UNDO_GROUP_PAINT,
                                    core->undo_desc);
 
       GIMP_PAINT_CORE_GET_CLASS (core)->push_undo (core, image, NULL);
 
-      buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, width, height),
-                                gimp_drawable_get_format (drawable));
-
-      gegl_buffer_copy (core->undo_buffer,
-                        GEGL_RECTANGLE (x, y, width, height),
-                        buffer,
-                        GEGL_RECTANGLE (0, 0, 0, 0));
+      /*  the snapshot itself is the undo, once detached it holds
+       *  only the tiles the stroke has touched
+       */
+      gimp_gegl_buffer_snapshot_detach (core->undo_buffer);
 
       gimp_drawable_push_undo (drawable, NULL,
-                               buffer, x, y, width, height);
-
-      g_object_unref (buffer);
+                               core->undo_buffer, 0, 0,
+                               gimp_item_get_width  (GIMP_ITEM (drawable)),
+                               gimp_item_get_height (GIMP_ITEM (drawable)));
 
       gimp_image_undo_group_end (image);
     }
@@ -536,10 +564,32 @@ gimp_paint_core_cancel (GimpPaintCore *core,
                                 gimp_item_get_height (GIMP_ITEM (drawable)),
                                 &x, &y, &width, &height))
     {
-      gegl_buffer_copy (core->undo_buffer,
-                        GEGL_RECTANGLE (x, y, width, height),
-                        gimp_drawable_get_buffer (drawable),
-                        GEGL_RECTANGLE (x, y, width, height));
+      cairo_region_t *region;
+      gint            n_rects;
+      gint            i;
+
+      /*  only the captured tiles can have been modified  */
+      region  = gimp_gegl_buffer_snapshot_get_captured_region (core->undo_buffer);
+      n_rects = cairo_region_num_rectangles (region);
+
+      for (i = 0; i < n_rects; i++)
+        {
+          cairo_rectangle_int_t rect;
+          gint                  rx, ry, rwidth, rheight;
+
+          cairo_region_get_rectangle (region, i, &rect);
+
+          if (gimp_rectangle_intersect (rect.x, rect.y,
+                                        rect.width, rect.height,
+                                        x, y, width, height,
+                                        &rx, &ry, &rwidth, &rheight))
+            {
+              gegl_buffer_copy (core->undo_buffer,
+                                GEGL_RECTANGLE (rx, ry, rwidth, rheight),
+                                gimp_drawable_get_buffer (drawable),
+                                GEGL_RECTANGLE (rx, ry, rwidth, rheight));
+            }
+        }
     }
 
   g_object_unref (core->undo_buffer);
@@ -800,6 +850,11 @@ gimp_paint_core_paste (GimpPaintCore            *core,
   gimp_applicator_set_mode (core->applicator,
                             image_opacity, paint_mode);
 
+  gimp_paint_core_capture_undo (core, drawable,
+                                core->paint_buffer_x,
+                                core->paint_buffer_y,
+                                width, height);
+
   /*  apply the paint area to the image  */
   gimp_applicator_blit (core->applicator,
                         GEGL_RECTANGLE (core->paint_buffer_x,
@@ -880,6 +935,11 @@ gimp_paint_core_replace (GimpPaintCore            *core,
       mask_rect = *paint_mask_rect;
     }
 
+  gimp_paint_core_capture_undo (core, drawable,
+                                core->paint_buffer_x,
+                                core->paint_buffer_y,
+                                width, height);
+
   /*  apply the paint area to the image  */
   gimp_drawable_replace_buffer (drawable, core->paint_buffer,
                                 GEGL_RECTANGLE (0, 0, width, height),
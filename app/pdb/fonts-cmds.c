@@ -69,6 +69,8 @@ fonts_get_list_invoker (GimpProcedure         *procedure,
 
   if (success)
     {
+      gimp_fonts_wait (gimp);
+
       font_list = gimp_container_get_filtered_name_array (gimp->fonts,
                                                           filter, &num_fonts);
     }
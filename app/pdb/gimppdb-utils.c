@@ -31,6 +31,7 @@
 #include "core/gimpimage.h"
 #include "core/gimpitem.h"
 
+#include "text/gimp-fonts.h"
 #include "text/gimptextlayer.h"
 
 #include "vectors/gimpvectors.h"
@@ -267,6 +268,8 @@ gimp_pdb_get_font (Gimp         *gimp,
       return NULL;
     }
 
+  gimp_fonts_wait (gimp);
+
   font = (GimpFont *)
     gimp_container_get_child_by_name (gimp->fonts, name);
 
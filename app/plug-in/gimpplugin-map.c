@@ -0,0 +1,144 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpplugin-map.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*  Regions of drawables which are exported to a plug-in as one linear
+ *  block of shared memory. The plug-in reads and writes the pixels in
+ *  place, they are copied from the drawable's buffer once when the
+ *  region is mapped, and back once when it is unmapped.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "plug-in-types.h"
+
+#include "gimpplugin.h"
+#include "gimpplugin-map.h"
+#include "gimppluginshm.h"
+
+#include "gimp-log.h"
+
+
+GimpPlugInMap *
+gimp_plug_in_map_new (GimpPlugIn          *plug_in,
+                      GeglBuffer          *buffer,
+                      const GeglRectangle *rect,
+                      const Babl          *format,
+                      gboolean             writable)
+{
+  static gint    map_ID = 0;
+
+  GimpPlugInMap *map;
+  GimpPlugInShm *shm;
+  gint           rowstride;
+
+  g_return_val_if_fail (GIMP_IS_PLUG_IN (plug_in), NULL);
+  g_return_val_if_fail (GEGL_IS_BUFFER (buffer), NULL);
+  g_return_val_if_fail (rect != NULL, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+
+  rowstride = rect->width * babl_format_get_bytes_per_pixel (format);
+
+  /*  the size must be representable on the wire  */
+  if ((guint64) rowstride * rect->height > G_MAXINT32)
+    return NULL;
+
+  shm = gimp_plug_in_shm_new_sized ((gsize) rowstride * rect->height);
+
+  if (! shm)
+    return NULL;
+
+  map = g_slice_new0 (GimpPlugInMap);
+
+  map->ID        = ++map_ID;
+  map->buffer    = g_object_ref (buffer);
+  map->rect      = *rect;
+  map->format    = format;
+  map->rowstride = rowstride;
+  map->writable  = writable;
+  map->shm       = shm;
+
+  gegl_buffer_get (buffer, rect, 1.0, format,
+                   gimp_plug_in_shm_get_addr (shm),
+                   rowstride, GEGL_ABYSS_NONE);
+
+  plug_in->drawable_maps = g_list_prepend (plug_in->drawable_maps, map);
+
+  GIMP_LOG (SHM, "mapped %d x %d pixels at %d, %d as map ID = %d",
+            rect->width, rect->height, rect->x, rect->y, map->ID);
+
+  return map;
+}
+
+GimpPlugInMap *
+gimp_plug_in_map_lookup (GimpPlugIn *plug_in,
+                         gint        map_ID)
+{
+  GList *list;
+
+  g_return_val_if_fail (GIMP_IS_PLUG_IN (plug_in), NULL);
+
+  for (list = plug_in->drawable_maps; list; list = g_list_next (list))
+    {
+      GimpPlugInMap *map = list->data;
+
+      if (map->ID == map_ID)
+        return map;
+    }
+
+  return NULL;
+}
+
+void
+gimp_plug_in_map_commit (GimpPlugInMap *map)
+{
+  g_return_if_fail (map != NULL);
+
+  if (map->writable)
+    gegl_buffer_set (map->buffer, &map->rect, 0, map->format,
+                     gimp_plug_in_shm_get_addr (map->shm),
+                     map->rowstride);
+}
+
+void
+gimp_plug_in_map_free (GimpPlugIn    *plug_in,
+                       GimpPlugInMap *map)
+{
+  g_return_if_fail (GIMP_IS_PLUG_IN (plug_in));
+  g_return_if_fail (map != NULL);
+
+  plug_in->drawable_maps = g_list_remove (plug_in->drawable_maps, map);
+
+  GIMP_LOG (SHM, "unmapped map ID = %d", map->ID);
+
+  gimp_plug_in_shm_free (map->shm);
+  g_object_unref (map->buffer);
+
+  g_slice_free (GimpPlugInMap, map);
+}
+
+void
+gimp_plug_in_map_free_all (GimpPlugIn *plug_in)
+{
+  g_return_if_fail (GIMP_IS_PLUG_IN (plug_in));
+
+  while (plug_in->drawable_maps)
+    gimp_plug_in_map_free (plug_in, plug_in->drawable_maps->data);
+}
@@ -0,0 +1,51 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimpplugin-map.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_PLUG_IN_MAP_H__
+#define __GIMP_PLUG_IN_MAP_H__
+
+
+typedef struct _GimpPlugInMap GimpPlugInMap;
+
+struct _GimpPlugInMap
+{
+  gint           ID;
+  GeglBuffer    *buffer;
+  GeglRectangle  rect;
+  const Babl    *format;
+  gint           rowstride;
+  gboolean       writable;
+  GimpPlugInShm *shm;
+};
+
+
+GimpPlugInMap * gimp_plug_in_map_new      (GimpPlugIn          *plug_in,
+                                           GeglBuffer          *buffer,
+                                           const GeglRectangle *rect,
+                                           const Babl          *format,
+                                           gboolean             writable);
+GimpPlugInMap * gimp_plug_in_map_lookup   (GimpPlugIn          *plug_in,
+                                           gint                 map_ID);
+void            gimp_plug_in_map_commit   (GimpPlugInMap       *map);
+void            gimp_plug_in_map_free     (GimpPlugIn          *plug_in,
+                                           GimpPlugInMap       *map);
+void            gimp_plug_in_map_free_all (GimpPlugIn          *plug_in);
+
+
+#endif /* __GIMP_PLUG_IN_MAP_H__ */
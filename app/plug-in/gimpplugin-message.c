@@ -41,8 +41,11 @@
 #include "pdb/gimppdb.h"
 #include "pdb/gimppdberror.h"
 
+#include "text/gimptextlayer.h"
+
 #include "gimpplugin.h"
 #include "gimpplugin-cleanup.h"
+#include "gimpplugin-map.h"
 #include "gimpplugin-message.h"
 #include "gimppluginmanager.h"
 #include "gimpplugindef.h"
@@ -62,6 +65,14 @@ static void gimp_plug_in_handle_tile_put         (GimpPlugIn      *plug_in,
                                                   GPTileReq       *request);
 static void gimp_plug_in_handle_tile_get         (GimpPlugIn      *plug_in,
                                                   GPTileReq       *request);
+static void gimp_plug_in_handle_tile_batch_get   (GimpPlugIn      *plug_in,
+                                                  GPTileBatchReq  *request);
+static void gimp_plug_in_handle_tile_batch_put   (GimpPlugIn      *plug_in,
+                                                  GPTileBatchData *batch_data);
+static void gimp_plug_in_handle_drawable_map     (GimpPlugIn      *plug_in,
+                                                  GPDrawableMapReq *request);
+static void gimp_plug_in_handle_drawable_unmap   (GimpPlugIn      *plug_in,
+                                                  GPDrawableUnmap *unmap);
 static void gimp_plug_in_handle_proc_run         (GimpPlugIn      *plug_in,
                                                   GPProcRun       *proc_run);
 static void gimp_plug_in_handle_proc_return      (GimpPlugIn      *plug_in,
@@ -75,6 +86,11 @@ static void gimp_plug_in_handle_proc_uninstall   (GimpPlugIn      *plug_in,
 static void gimp_plug_in_handle_extension_ack    (GimpPlugIn      *plug_in);
 static void gimp_plug_in_handle_has_init         (GimpPlugIn      *plug_in);
 
+static GeglBuffer * gimp_plug_in_get_tile_buffer (GimpPlugIn      *plug_in,
+                                                  gint32           drawable_ID,
+                                                  gboolean         shadow,
+                                                  gboolean         write);
+
 
 /*  public functions  */
 
@@ -159,6 +175,31 @@ gimp_plug_in_handle_message (GimpPlugIn      *plug_in,
     case GP_HAS_INIT:
       gimp_plug_in_handle_has_init (plug_in);
       break;
+
+    case GP_TILE_BATCH_REQ:
+      gimp_plug_in_handle_tile_batch_get (plug_in, msg->data);
+      break;
+
+    case GP_TILE_BATCH_DATA:
+      gimp_plug_in_handle_tile_batch_put (plug_in, msg->data);
+      break;
+
+    case GP_DRAWABLE_MAP_REQ:
+      gimp_plug_in_handle_drawable_map (plug_in, msg->data);
+      break;
+
+    case GP_DRAWABLE_MAP:
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent a DRAWABLE_MAP message.  This should not happen.",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      break;
+
+    case GP_DRAWABLE_UNMAP:
+      gimp_plug_in_handle_drawable_unmap (plug_in, msg->data);
+      break;
     }
 }
 
@@ -257,6 +298,10 @@ gimp_plug_in_handle_tile_put (GimpPlugIn *plug_in,
       return;
     }
 
+  /*  the plug-in must see the text a text layer shows  */
+  if (GIMP_IS_TEXT_LAYER (drawable))
+    gimp_text_layer_flush (GIMP_TEXT_LAYER (drawable));
+
   if (tile_info->shadow)
     {
 
@@ -382,6 +427,10 @@ gimp_plug_in_handle_tile_get (GimpPlugIn *plug_in,
       return;
     }
 
+  /*  the plug-in must see the text a text layer shows  */
+  if (GIMP_IS_TEXT_LAYER (drawable))
+    gimp_text_layer_flush (GIMP_TEXT_LAYER (drawable));
+
   if (request->shadow)
     {
       buffer = gimp_drawable_get_shadow_buffer (drawable);
@@ -468,6 +517,435 @@ gimp_plug_in_handle_tile_get (GimpPlugIn *plug_in,
   gimp_wire_destroy (&msg);
 }
 
+/*  Batched tile transfers: the plug-in requests a list of tiles with a
+ *  single TILE_BATCH_REQ and gets all of them back in one TILE_BATCH_DATA
+ *  message, without any ack. For writing, the plug-in sends one
+ *  TILE_BATCH_DATA message which is answered with a single TILE_ACK.
+ */
+static void
+gimp_plug_in_handle_tile_batch_get (GimpPlugIn     *plug_in,
+                                    GPTileBatchReq *request)
+{
+  GPTileBatchData  batch_data;
+  GeglBuffer      *buffer;
+  const Babl      *format;
+  gint             bpp;
+  guint            n_tiles;
+  guchar          *dest;
+  gsize            size = 0;
+  guint            i;
+
+  if (! request)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent an invalid tile batch request (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  buffer = gimp_plug_in_get_tile_buffer (plug_in,
+                                         request->drawable_ID,
+                                         request->shadow,
+                                         FALSE);
+  if (! buffer)
+    return;
+
+  n_tiles = (gimp_gegl_buffer_get_n_tile_cols (buffer,
+                                               GIMP_PLUG_IN_TILE_WIDTH) *
+             gimp_gegl_buffer_get_n_tile_rows (buffer,
+                                               GIMP_PLUG_IN_TILE_HEIGHT));
+
+  /*  the batch's size only depends on the number of tiles requested,
+   *  the same tile may be requested more than once
+   */
+  if (request->ntiles > MIN (n_tiles, GP_TILE_BATCH_MAX_TILES))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "requested too many tiles (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  format = gegl_buffer_get_format (buffer);
+
+  if (! gimp_plug_in_precision_enabled (plug_in))
+    {
+      format = gimp_babl_compat_u8_format (format);
+    }
+
+  bpp = babl_format_get_bytes_per_pixel (format);
+
+  batch_data.drawable_ID = request->drawable_ID;
+  batch_data.shadow      = request->shadow;
+  batch_data.bpp         = bpp;
+  batch_data.ntiles      = request->ntiles;
+  batch_data.tile_nums   = request->tile_nums;
+  batch_data.widths      = g_new (guint32, request->ntiles);
+  batch_data.heights     = g_new (guint32, request->ntiles);
+
+  for (i = 0; i < request->ntiles; i++)
+    {
+      GeglRectangle tile_rect;
+
+      if (request->tile_nums[i] >= n_tiles ||
+          ! gimp_gegl_buffer_get_tile_rect (buffer,
+                                            GIMP_PLUG_IN_TILE_WIDTH,
+                                            GIMP_PLUG_IN_TILE_HEIGHT,
+                                            request->tile_nums[i],
+                                            &tile_rect))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "requested invalid tile (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_filename_to_utf8 (plug_in->prog));
+          g_free (batch_data.widths);
+          g_free (batch_data.heights);
+          gimp_plug_in_close (plug_in, TRUE);
+          return;
+        }
+
+      batch_data.widths[i]  = tile_rect.width;
+      batch_data.heights[i] = tile_rect.height;
+
+      size += (gsize) tile_rect.width * tile_rect.height * bpp;
+    }
+
+  batch_data.data = dest = g_try_malloc (size);
+
+  if (! dest)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "requested more tiles than fit into memory (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      g_free (batch_data.widths);
+      g_free (batch_data.heights);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  for (i = 0; i < request->ntiles; i++)
+    {
+      GeglRectangle tile_rect;
+
+      gimp_gegl_buffer_get_tile_rect (buffer,
+                                      GIMP_PLUG_IN_TILE_WIDTH,
+                                      GIMP_PLUG_IN_TILE_HEIGHT,
+                                      request->tile_nums[i],
+                                      &tile_rect);
+
+      gegl_buffer_get (buffer, &tile_rect, 1.0, format,
+                       dest,
+                       GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+      dest += (gsize) tile_rect.width * tile_rect.height * bpp;
+    }
+
+  if (! gp_tile_batch_data_write (plug_in->my_write, &batch_data, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+    }
+
+  g_free (batch_data.widths);
+  g_free (batch_data.heights);
+  g_free (batch_data.data);
+}
+
+static void
+gimp_plug_in_handle_tile_batch_put (GimpPlugIn      *plug_in,
+                                    GPTileBatchData *batch_data)
+{
+  GeglBuffer   *buffer;
+  const Babl   *format;
+  const guchar *src;
+  guint         n_tiles;
+  guint         i;
+
+  if (! batch_data)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent an invalid tile batch (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  buffer = gimp_plug_in_get_tile_buffer (plug_in,
+                                         batch_data->drawable_ID,
+                                         batch_data->shadow,
+                                         TRUE);
+  if (! buffer)
+    return;
+
+  format = gegl_buffer_get_format (buffer);
+
+  if (! gimp_plug_in_precision_enabled (plug_in))
+    {
+      format = gimp_babl_compat_u8_format (format);
+    }
+
+  if (batch_data->bpp != (guint32) babl_format_get_bytes_per_pixel (format))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "sent tiles with invalid pixel size (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  n_tiles = (gimp_gegl_buffer_get_n_tile_cols (buffer,
+                                               GIMP_PLUG_IN_TILE_WIDTH) *
+             gimp_gegl_buffer_get_n_tile_rows (buffer,
+                                               GIMP_PLUG_IN_TILE_HEIGHT));
+
+  src = batch_data->data;
+
+  for (i = 0; i < batch_data->ntiles; i++)
+    {
+      GeglRectangle tile_rect;
+
+      if (batch_data->tile_nums[i] >= n_tiles ||
+          ! gimp_gegl_buffer_get_tile_rect (buffer,
+                                            GIMP_PLUG_IN_TILE_WIDTH,
+                                            GIMP_PLUG_IN_TILE_HEIGHT,
+                                            batch_data->tile_nums[i],
+                                            &tile_rect) ||
+          tile_rect.width  != (gint) batch_data->widths[i] ||
+          tile_rect.height != (gint) batch_data->heights[i])
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "sent invalid tile (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_filename_to_utf8 (plug_in->prog));
+          gimp_plug_in_close (plug_in, TRUE);
+          return;
+        }
+
+      gegl_buffer_set (buffer, &tile_rect, 0, format,
+                       src,
+                       GEGL_AUTO_ROWSTRIDE);
+
+      src += (gsize) tile_rect.width * tile_rect.height * batch_data->bpp;
+    }
+
+  if (! gp_tile_ack_write (plug_in->my_write, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+/*  Exports a region of a drawable to the plug-in as a single block of
+ *  shared memory. If that's not possible, the reply has a map ID of -1
+ *  and the plug-in falls back to the tile protocol.
+ */
+static void
+gimp_plug_in_handle_drawable_map (GimpPlugIn       *plug_in,
+                                  GPDrawableMapReq *request)
+{
+  GPDrawableMap  reply;
+  GimpPlugInMap *map = NULL;
+  GeglBuffer    *buffer;
+  const Babl    *format;
+  GeglRectangle  rect;
+
+  g_return_if_fail (request != NULL);
+
+  buffer = gimp_plug_in_get_tile_buffer (plug_in,
+                                         request->drawable_ID,
+                                         request->shadow,
+                                         request->writable);
+  if (! buffer)
+    return;
+
+  rect.x      = request->x;
+  rect.y      = request->y;
+  rect.width  = request->width;
+  rect.height = request->height;
+
+  if (rect.width <= 0 || rect.height <= 0 ||
+      ! gegl_rectangle_contains (gegl_buffer_get_extent (buffer), &rect))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "requested invalid drawable region (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog));
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  format = gegl_buffer_get_format (buffer);
+
+  if (! gimp_plug_in_precision_enabled (plug_in))
+    {
+      format = gimp_babl_compat_u8_format (format);
+    }
+
+  if (plug_in->manager->shm)
+    map = gimp_plug_in_map_new (plug_in, buffer, &rect, format,
+                                request->writable);
+
+  if (map)
+    {
+      reply.map_ID    = map->ID;
+      reply.bpp       = babl_format_get_bytes_per_pixel (format);
+      reply.rowstride = map->rowstride;
+      reply.shm_ID    = gimp_plug_in_shm_get_ID (map->shm);
+      reply.shm_name  = (gchar *) gimp_plug_in_shm_get_name (map->shm);
+    }
+  else
+    {
+      reply.map_ID    = -1;
+      reply.bpp       = 0;
+      reply.rowstride = 0;
+      reply.shm_ID    = -1;
+      reply.shm_name  = "";
+    }
+
+  if (! gp_drawable_map_write (plug_in->my_write, &reply, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+static void
+gimp_plug_in_handle_drawable_unmap (GimpPlugIn      *plug_in,
+                                    GPDrawableUnmap *unmap)
+{
+  GimpPlugInMap *map;
+
+  g_return_if_fail (unmap != NULL);
+
+  map = gimp_plug_in_map_lookup (plug_in, unmap->map_ID);
+
+  if (! map)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried to unmap invalid drawable region %d (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog),
+                    unmap->map_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+
+  if (unmap->dirty)
+    gimp_plug_in_map_commit (map);
+
+  gimp_plug_in_map_free (plug_in, map);
+
+  if (! gp_tile_ack_write (plug_in->my_write, plug_in))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "%s: ERROR", G_STRFUNC);
+      gimp_plug_in_close (plug_in, TRUE);
+      return;
+    }
+}
+
+/*  Looks up the buffer a tile transfer refers to, doing the same
+ *  checks as the single-tile handlers. Closes the plug-in and returns
+ *  NULL if the drawable can't be accessed.
+ */
+static GeglBuffer *
+gimp_plug_in_get_tile_buffer (GimpPlugIn *plug_in,
+                              gint32      drawable_ID,
+                              gboolean    shadow,
+                              gboolean    write)
+{
+  GimpDrawable *drawable;
+
+  drawable = (GimpDrawable *) gimp_item_get_by_ID (plug_in->manager->gimp,
+                                                   drawable_ID);
+
+  if (! GIMP_IS_DRAWABLE (drawable))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried %s invalid drawable %d (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog),
+                    write ? "writing to" : "reading from",
+                    drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return NULL;
+    }
+  else if (gimp_item_is_removed (GIMP_ITEM (drawable)))
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                    "Plug-In \"%s\"\n(%s)\n\n"
+                    "tried %s drawable %d which was removed "
+                    "from the image (killing)",
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog),
+                    write ? "writing to" : "reading from",
+                    drawable_ID);
+      gimp_plug_in_close (plug_in, TRUE);
+      return NULL;
+    }
+
+  /*  the plug-in must see the text a text layer shows  */
+  if (GIMP_IS_TEXT_LAYER (drawable))
+    gimp_text_layer_flush (GIMP_TEXT_LAYER (drawable));
+
+  if (shadow)
+    {
+      gimp_plug_in_cleanup_add_shadow (plug_in, drawable);
+
+      return gimp_drawable_get_shadow_buffer (drawable);
+    }
+
+  if (write)
+    {
+      if (gimp_item_is_content_locked (GIMP_ITEM (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a locked drawable %d (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_filename_to_utf8 (plug_in->prog),
+                        drawable_ID);
+          gimp_plug_in_close (plug_in, TRUE);
+          return NULL;
+        }
+      else if (gimp_viewable_get_children (GIMP_VIEWABLE (drawable)))
+        {
+          gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_ERROR,
+                        "Plug-In \"%s\"\n(%s)\n\n"
+                        "tried writing to a group layer %d (killing)",
+                        gimp_object_get_name (plug_in),
+                        gimp_filename_to_utf8 (plug_in->prog),
+                        drawable_ID);
+          gimp_plug_in_close (plug_in, TRUE);
+          return NULL;
+        }
+    }
+
+  return gimp_drawable_get_buffer (drawable);
+}
+
 static void
 gimp_plug_in_handle_proc_error (GimpPlugIn          *plug_in,
                                 GimpPlugInProcFrame *proc_frame,
@@ -654,7 +1132,7 @@ gimp_plug_in_handle_proc_return (GimpPlugIn   *plug_in,
     {
       g_main_loop_quit (proc_frame->main_loop);
     }
-  else
+  else if (! proc_frame->keep_return_vals)
     {
       /*  the plug-in is run asynchronously, so display its error
        *  messages here because nobody else will do it
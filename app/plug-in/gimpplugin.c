@@ -86,6 +86,7 @@
 #include "gimpenvirontable.h"
 #include "gimpinterpreterdb.h"
 #include "gimpplugin.h"
+#include "gimpplugin-map.h"
 #include "gimpplugin-message.h"
 #include "gimpplugin-progress.h"
 #include "gimpplugindebug.h"
@@ -578,6 +579,9 @@ gimp_plug_in_close (GimpPlugIn *plug_in,
       g_main_loop_quit (plug_in->ext_main_loop);
     }
 
+  /* Release the shared memory of any regions left mapped. */
+  gimp_plug_in_map_free_all (plug_in);
+
   /* Unregister any temporary procedures. */
   while (plug_in->temp_procedures)
     gimp_plug_in_remove_temp_proc (plug_in, plug_in->temp_procedures->data);
@@ -68,6 +68,8 @@ struct _GimpPlugIn
 
   GList               *temp_proc_frames;
 
+  GList               *drawable_maps;   /*  Regions mapped to shared memory   */
+
   GimpPlugInDef       *plug_in_def;     /*  Valid during query() and init()   */
 };
 
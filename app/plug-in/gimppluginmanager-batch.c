@@ -0,0 +1,224 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimppluginmanager-batch.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "plug-in-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpcontext.h"
+
+#include "pdb/gimpprocedure.h"
+
+#include "gimpplugin.h"
+#include "gimppluginerror.h"
+#include "gimppluginmanager.h"
+#include "gimppluginmanager-batch.h"
+#define __YES_I_NEED_GIMP_PLUG_IN_MANAGER_CALL__
+#include "gimppluginmanager-call.h"
+#include "gimppluginprocedure.h"
+#include "gimppluginprocframe.h"
+
+#include "gimp-intl.h"
+
+
+typedef struct
+{
+  GimpPlugIn *plug_in;
+  gint        job;
+  gint64      start_time;
+  guint       timeout_id;
+  gboolean    timed_out;
+} GimpPlugInBatchSlot;
+
+
+static gboolean   gimp_plug_in_manager_batch_all_open (GimpPlugInBatchSlot **slots,
+                                                       gint                  n_slots);
+static gboolean   gimp_plug_in_manager_batch_timeout  (GimpPlugInBatchSlot  *slot);
+
+
+/*  public functions  */
+
+void
+gimp_plug_in_manager_batch_run (GimpPlugInManager    *manager,
+                                GimpContext          *context,
+                                GimpPlugInProcedure  *procedure,
+                                GimpValueArray      **args,
+                                gint                  n_jobs,
+                                gint                  max_running,
+                                gint                  timeout,
+                                GimpPlugInBatchFunc   func,
+                                gpointer              user_data)
+{
+  GimpPlugInBatchSlot **slots;
+  GimpValueArray      **results;
+  gdouble              *seconds;
+  gint                  n_running   = 0;
+  gint                  next_job    = 0;
+  gint                  next_report = 0;
+
+  g_return_if_fail (GIMP_IS_PLUG_IN_MANAGER (manager));
+  g_return_if_fail (GIMP_IS_CONTEXT (context));
+  g_return_if_fail (GIMP_IS_PLUG_IN_PROCEDURE (procedure));
+  g_return_if_fail (args != NULL || n_jobs == 0);
+  g_return_if_fail (max_running > 0);
+  g_return_if_fail (func != NULL);
+
+  slots   = g_new0 (GimpPlugInBatchSlot *, max_running);
+  results = g_new0 (GimpValueArray *, n_jobs);
+  seconds = g_new0 (gdouble, n_jobs);
+
+  while (next_report < n_jobs)
+    {
+      gint i;
+
+      while (next_job < n_jobs && n_running < max_running)
+        {
+          GimpPlugIn *plug_in;
+          gint64      now = g_get_monotonic_time ();
+
+          plug_in = gimp_plug_in_manager_call_start (manager, context, NULL,
+                                                     procedure, args[next_job],
+                                                     &results[next_job]);
+
+          if (plug_in)
+            {
+              GimpPlugInBatchSlot *slot = g_slice_new0 (GimpPlugInBatchSlot);
+
+              slot->plug_in    = plug_in;
+              slot->job        = next_job;
+              slot->start_time = now;
+
+              if (timeout > 0)
+                slot->timeout_id =
+                  g_timeout_add_seconds (timeout,
+                                         (GSourceFunc) gimp_plug_in_manager_batch_timeout,
+                                         slot);
+
+              slots[n_running++] = slot;
+            }
+
+          next_job++;
+        }
+
+      /*  wait for any of the plug-ins to finish  */
+      if (n_running > 0)
+        {
+          gimp_threads_leave (manager->gimp);
+
+          while (gimp_plug_in_manager_batch_all_open (slots, n_running))
+            g_main_context_iteration (NULL, TRUE);
+
+          gimp_threads_enter (manager->gimp);
+        }
+
+      for (i = 0; i < n_running; i++)
+        {
+          GimpPlugInBatchSlot *slot    = slots[i];
+          GimpPlugIn          *plug_in = slot->plug_in;
+
+          if (plug_in->open)
+            continue;
+
+          seconds[slot->job] = (g_get_monotonic_time () - slot->start_time) /
+                               (gdouble) G_USEC_PER_SEC;
+
+          if (slot->timed_out)
+            {
+              GError *error;
+
+              error = g_error_new (GIMP_PLUG_IN_ERROR,
+                                   GIMP_PLUG_IN_EXECUTION_FAILED,
+                                   _("Plug-in \"%s\" was terminated after "
+                                     "running for %d seconds"),
+                                   gimp_object_get_name (plug_in),
+                                   timeout);
+
+              results[slot->job] =
+                gimp_procedure_get_return_values (GIMP_PROCEDURE (procedure),
+                                                  FALSE, error);
+              g_error_free (error);
+            }
+          else
+            {
+              results[slot->job] =
+                gimp_plug_in_proc_frame_get_return_values (&plug_in->main_proc_frame);
+            }
+
+          if (slot->timeout_id)
+            g_source_remove (slot->timeout_id);
+
+          g_object_unref (plug_in);
+          g_slice_free (GimpPlugInBatchSlot, slot);
+
+          slots[i--] = slots[--n_running];
+        }
+
+      /*  report the jobs in order  */
+      while (next_report < n_jobs && results[next_report])
+        {
+          func (next_report, results[next_report], seconds[next_report],
+                user_data);
+
+          gimp_value_array_unref (results[next_report]);
+          results[next_report] = NULL;
+
+          next_report++;
+        }
+    }
+
+  g_free (seconds);
+  g_free (results);
+  g_free (slots);
+}
+
+
+/*  private functions  */
+
+static gboolean
+gimp_plug_in_manager_batch_all_open (GimpPlugInBatchSlot **slots,
+                                     gint                  n_slots)
+{
+  gint i;
+
+  for (i = 0; i < n_slots; i++)
+    if (! slots[i]->plug_in->open)
+      return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+gimp_plug_in_manager_batch_timeout (GimpPlugInBatchSlot *slot)
+{
+  slot->timeout_id = 0;
+
+  if (slot->plug_in->open)
+    {
+      slot->timed_out = TRUE;
+
+      gimp_plug_in_close (slot->plug_in, TRUE);
+    }
+
+  return FALSE;
+}
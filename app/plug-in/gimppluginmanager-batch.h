@@ -0,0 +1,48 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * gimppluginmanager-batch.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GIMP_PLUG_IN_MANAGER_BATCH_H__
+#define __GIMP_PLUG_IN_MANAGER_BATCH_H__
+
+
+typedef void (* GimpPlugInBatchFunc) (gint            job,
+                                      GimpValueArray *return_vals,
+                                      gdouble         seconds,
+                                      gpointer        user_data);
+
+
+/*  Runs @procedure once for each of the @n_jobs argument arrays in
+ *  @args, keeping up to @max_running instances of the plug-in busy at
+ *  the same time.  A job that runs longer than @timeout seconds (if
+ *  @timeout > 0) is killed.  Each job runs in its own context derived
+ *  from @context.  @func is called with each job's return values in
+ *  the order of @args, no matter in which order they finish.
+ */
+void   gimp_plug_in_manager_batch_run (GimpPlugInManager    *manager,
+                                       GimpContext          *context,
+                                       GimpPlugInProcedure  *procedure,
+                                       GimpValueArray      **args,
+                                       gint                  n_jobs,
+                                       gint                  max_running,
+                                       gint                  timeout,
+                                       GimpPlugInBatchFunc   func,
+                                       gpointer              user_data);
+
+
+#endif /* __GIMP_PLUG_IN_MANAGER_BATCH_H__ */
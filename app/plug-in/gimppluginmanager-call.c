@@ -48,6 +48,15 @@
 #include "gimp-intl.h"
 
 
+static GimpPlugIn * gimp_plug_in_manager_call_open (GimpPlugInManager    *manager,
+                                                    GimpContext          *context,
+                                                    GimpProgress         *progress,
+                                                    GimpPlugInProcedure  *procedure,
+                                                    GimpValueArray       *args,
+                                                    GimpObject           *display,
+                                                    GimpValueArray      **return_vals);
+
+
 /*  public functions  */
 
 void
@@ -139,7 +148,7 @@ gimp_plug_in_manager_call_run (GimpPlugInManager   *manager,
                                gboolean             synchronous,
                                GimpObject          *display)
 {
-  GimpValueArray *return_vals = NULL;
+  GimpValueArray *return_vals;
   GimpPlugIn     *plug_in;
 
   g_return_val_if_fail (GIMP_IS_PLUG_IN_MANAGER (manager), NULL);
@@ -149,94 +158,12 @@ gimp_plug_in_manager_call_run (GimpPlugInManager   *manager,
   g_return_val_if_fail (args != NULL, NULL);
   g_return_val_if_fail (display == NULL || GIMP_IS_OBJECT (display), NULL);
 
-  plug_in = gimp_plug_in_new (manager, context, progress, procedure, NULL);
+  plug_in = gimp_plug_in_manager_call_open (manager, context, progress,
+                                            procedure, args, display,
+                                            &return_vals);
 
   if (plug_in)
     {
-      GimpCoreConfig    *core_config    = manager->gimp->config;
-      GimpDisplayConfig *display_config = GIMP_DISPLAY_CONFIG (core_config);
-      GimpGuiConfig     *gui_config     = GIMP_GUI_CONFIG (core_config);
-      GPConfig           config;
-      GPProcRun          proc_run;
-      gint               display_ID;
-      gint               monitor;
-
-      if (! gimp_plug_in_open (plug_in, GIMP_PLUG_IN_CALL_RUN, FALSE))
-        {
-          const gchar *name  = gimp_object_get_name (plug_in);
-          GError      *error = g_error_new (GIMP_PLUG_IN_ERROR,
-                                            GIMP_PLUG_IN_EXECUTION_FAILED,
-                                            _("Failed to run plug-in \"%s\""),
-                                            name);
-
-          g_object_unref (plug_in);
-
-          return_vals = gimp_procedure_get_return_values (GIMP_PROCEDURE (procedure),
-                                                          FALSE, error);
-          g_error_free (error);
-
-          return return_vals;
-        }
-
-      display_ID = display ? gimp_get_display_ID (manager->gimp, display) : -1;
-
-      config.version          = GIMP_PROTOCOL_VERSION;
-      config.tile_width       = GIMP_PLUG_IN_TILE_WIDTH;
-      config.tile_height      = GIMP_PLUG_IN_TILE_HEIGHT;
-      config.shm_ID           = (manager->shm ?
-                                 gimp_plug_in_shm_get_ID (manager->shm) : -1);
-      config.check_size       = display_config->transparency_size;
-      config.check_type       = display_config->transparency_type;
-      config.show_help_button = (gui_config->use_help &&
-                                 gui_config->show_help_button);
-#ifdef __GNUC__
-#warning FIXME what to do with config.use_cpu_accel
-#endif
-      config.use_cpu_accel    = FALSE;
-      config.gimp_reserved_5  = 0;
-      config.gimp_reserved_6  = 0;
-      config.gimp_reserved_7  = 0;
-      config.gimp_reserved_8  = 0;
-      config.install_cmap     = FALSE;
-      config.show_tooltips    = gui_config->show_tooltips;
-      config.min_colors       = 144;
-      config.gdisp_ID         = display_ID;
-      config.app_name         = (gchar *) g_get_application_name ();
-      config.wm_class         = (gchar *) gimp_get_program_class (manager->gimp);
-      config.display_name     = gimp_get_display_name (manager->gimp,
-                                                       display_ID, &monitor);
-      config.monitor_number   = monitor;
-      config.timestamp        = gimp_get_user_time (manager->gimp);
-
-      proc_run.name    = GIMP_PROCEDURE (procedure)->original_name;
-      proc_run.nparams = gimp_value_array_length (args);
-      proc_run.params  = plug_in_args_to_params (args, FALSE);
-
-      if (! gp_config_write (plug_in->my_write, &config, plug_in)     ||
-          ! gp_proc_run_write (plug_in->my_write, &proc_run, plug_in) ||
-          ! gimp_wire_flush (plug_in->my_write, plug_in))
-        {
-          const gchar *name  = gimp_object_get_name (plug_in);
-          GError      *error = g_error_new (GIMP_PLUG_IN_ERROR,
-                                            GIMP_PLUG_IN_EXECUTION_FAILED,
-                                            _("Failed to run plug-in \"%s\""),
-                                            name);
-
-          g_free (config.display_name);
-          g_free (proc_run.params);
-
-          g_object_unref (plug_in);
-
-          return_vals = gimp_procedure_get_return_values (GIMP_PROCEDURE (procedure),
-                                                          FALSE, error);
-          g_error_free (error);
-
-          return return_vals;
-        }
-
-      g_free (config.display_name);
-      g_free (proc_run.params);
-
       /* If this is an extension,
        * wait for an installation-confirmation message
        */
@@ -281,6 +208,45 @@ gimp_plug_in_manager_call_run (GimpPlugInManager   *manager,
   return return_vals;
 }
 
+GimpPlugIn *
+gimp_plug_in_manager_call_start (GimpPlugInManager    *manager,
+                                 GimpContext          *context,
+                                 GimpProgress         *progress,
+                                 GimpPlugInProcedure  *procedure,
+                                 GimpValueArray       *args,
+                                 GimpValueArray      **return_vals)
+{
+  GimpPlugIn *plug_in;
+
+  g_return_val_if_fail (GIMP_IS_PLUG_IN_MANAGER (manager), NULL);
+  g_return_val_if_fail (GIMP_IS_CONTEXT (context), NULL);
+  g_return_val_if_fail (progress == NULL || GIMP_IS_PROGRESS (progress), NULL);
+  g_return_val_if_fail (GIMP_IS_PLUG_IN_PROCEDURE (procedure), NULL);
+  g_return_val_if_fail (GIMP_PROCEDURE (procedure)->proc_type == GIMP_PLUGIN,
+                        NULL);
+  g_return_val_if_fail (args != NULL, NULL);
+  g_return_val_if_fail (return_vals != NULL, NULL);
+
+  /*  plug-ins running side by side must not see each other's
+   *  context changes, the plug-in's proc frame keeps this one
+   */
+  context = gimp_pdb_context_new (manager->gimp, context, TRUE);
+
+  plug_in = gimp_plug_in_manager_call_open (manager, context, progress,
+                                            procedure, args, NULL,
+                                            return_vals);
+
+  g_object_unref (context);
+
+  /*  the caller collects the return values, don't handle them like
+   *  those of an asynchronous call
+   */
+  if (plug_in)
+    plug_in->main_proc_frame.keep_return_vals = TRUE;
+
+  return plug_in;
+}
+
 GimpValueArray *
 gimp_plug_in_manager_call_run_temp (GimpPlugInManager      *manager,
                                     GimpContext            *context,
@@ -349,3 +315,111 @@ gimp_plug_in_manager_call_run_temp (GimpPlugInManager      *manager,
 
   return return_vals;
 }
+
+
+/*  private functions  */
+
+static GimpPlugIn *
+gimp_plug_in_manager_call_open (GimpPlugInManager    *manager,
+                                GimpContext          *context,
+                                GimpProgress         *progress,
+                                GimpPlugInProcedure  *procedure,
+                                GimpValueArray       *args,
+                                GimpObject           *display,
+                                GimpValueArray      **return_vals)
+{
+  GimpPlugIn *plug_in;
+
+  *return_vals = NULL;
+
+  plug_in = gimp_plug_in_new (manager, context, progress, procedure, NULL);
+
+  if (plug_in)
+    {
+      GimpCoreConfig    *core_config    = manager->gimp->config;
+      GimpDisplayConfig *display_config = GIMP_DISPLAY_CONFIG (core_config);
+      GimpGuiConfig     *gui_config     = GIMP_GUI_CONFIG (core_config);
+      GPConfig           config;
+      GPProcRun          proc_run;
+      gint               display_ID;
+      gint               monitor;
+
+      if (! gimp_plug_in_open (plug_in, GIMP_PLUG_IN_CALL_RUN, FALSE))
+        {
+          const gchar *name  = gimp_object_get_name (plug_in);
+          GError      *error = g_error_new (GIMP_PLUG_IN_ERROR,
+                                            GIMP_PLUG_IN_EXECUTION_FAILED,
+                                            _("Failed to run plug-in \"%s\""),
+                                            name);
+
+          g_object_unref (plug_in);
+
+          *return_vals = gimp_procedure_get_return_values (GIMP_PROCEDURE (procedure),
+                                                           FALSE, error);
+          g_error_free (error);
+
+          return NULL;
+        }
+
+      display_ID = display ? gimp_get_display_ID (manager->gimp, display) : -1;
+
+      config.version          = GIMP_PROTOCOL_VERSION;
+      config.tile_width       = GIMP_PLUG_IN_TILE_WIDTH;
+      config.tile_height      = GIMP_PLUG_IN_TILE_HEIGHT;
+      config.shm_ID           = (manager->shm ?
+                                 gimp_plug_in_shm_get_ID (manager->shm) : -1);
+      config.check_size       = display_config->transparency_size;
+      config.check_type       = display_config->transparency_type;
+      config.show_help_button = (gui_config->use_help &&
+                                 gui_config->show_help_button);
+#ifdef __GNUC__
+#warning FIXME what to do with config.use_cpu_accel
+#endif
+      config.use_cpu_accel    = FALSE;
+      config.gimp_reserved_5  = 0;
+      config.gimp_reserved_6  = 0;
+      config.gimp_reserved_7  = 0;
+      config.gimp_reserved_8  = 0;
+      config.install_cmap     = FALSE;
+      config.show_tooltips    = gui_config->show_tooltips;
+      config.min_colors       = 144;
+      config.gdisp_ID         = display_ID;
+      config.app_name         = (gchar *) g_get_application_name ();
+      config.wm_class         = (gchar *) gimp_get_program_class (manager->gimp);
+      config.display_name     = gimp_get_display_name (manager->gimp,
+                                                       display_ID, &monitor);
+      config.monitor_number   = monitor;
+      config.timestamp        = gimp_get_user_time (manager->gimp);
+
+      proc_run.name    = GIMP_PROCEDURE (procedure)->original_name;
+      proc_run.nparams = gimp_value_array_length (args);
+      proc_run.params  = plug_in_args_to_params (args, FALSE);
+
+      if (! gp_config_write (plug_in->my_write, &config, plug_in)     ||
+          ! gp_proc_run_write (plug_in->my_write, &proc_run, plug_in) ||
+          ! gimp_wire_flush (plug_in->my_write, plug_in))
+        {
+          const gchar *name  = gimp_object_get_name (plug_in);
+          GError      *error = g_error_new (GIMP_PLUG_IN_ERROR,
+                                            GIMP_PLUG_IN_EXECUTION_FAILED,
+                                            _("Failed to run plug-in \"%s\""),
+                                            name);
+
+          g_free (config.display_name);
+          g_free (proc_run.params);
+
+          g_object_unref (plug_in);
+
+          *return_vals = gimp_procedure_get_return_values (GIMP_PROCEDURE (procedure),
+                                                           FALSE, error);
+          g_error_free (error);
+
+          return NULL;
+        }
+
+      g_free (config.display_name);
+      g_free (proc_run.params);
+    }
+
+  return plug_in;
+}
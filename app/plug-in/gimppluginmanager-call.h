@@ -47,6 +47,19 @@ GimpValueArray * gimp_plug_in_manager_call_run      (GimpPlugInManager      *man
                                                      gboolean                synchronous,
                                                      GimpObject             *display);
 
+/*  Start a plug-in without waiting for it, in its own context derived
+ *  from @context.  The plug-in is done when it isn't open any longer,
+ *  its return values can then be picked up with
+ *  gimp_plug_in_proc_frame_get_return_values().  If the plug-in can't
+ *  be started, NULL is returned and @return_vals is set
+ */
+GimpPlugIn     * gimp_plug_in_manager_call_start    (GimpPlugInManager      *manager,
+                                                     GimpContext            *context,
+                                                     GimpProgress           *progress,
+                                                     GimpPlugInProcedure    *procedure,
+                                                     GimpValueArray         *args,
+                                                     GimpValueArray        **return_vals);
+
 /*  Run a temp plug-in proc as if it were a procedure database procedure
  */
 GimpValueArray * gimp_plug_in_manager_call_run_temp (GimpPlugInManager      *manager,
@@ -24,6 +24,7 @@
 #include <gegl.h>
 
 #include "libgimpbase/gimpbase.h"
+#include "libgimpbase/gimpwire.h"
 #include "libgimpconfig/gimpconfig.h"
 
 #include "plug-in-types.h"
@@ -31,11 +32,14 @@
 #include "config/gimpcoreconfig.h"
 
 #include "core/gimp.h"
+#include "core/gimp-parallel.h"
 
 #include "pdb/gimppdb.h"
 #include "pdb/gimppdbcontext.h"
 
 #include "gimpinterpreterdb.h"
+#include "gimpplugin.h"
+#include "gimpplugin-message.h"
 #include "gimpplugindef.h"
 #include "gimppluginmanager.h"
 #define __YES_I_NEED_GIMP_PLUG_IN_MANAGER_CALL__
@@ -46,9 +50,26 @@
 #include "gimppluginprocedure.h"
 #include "plug-in-rc.h"
 
+#include "gimp-trace.h"
+
 #include "gimp-intl.h"
 
 
+/*  seconds a plug-in may take to answer its query before it is killed  */
+#define GIMP_PLUG_IN_QUERY_TIMEOUT 30
+
+
+typedef struct
+{
+  GimpPlugIn *plug_in;
+  GSource    *watch;
+  GSource    *timeout;
+  GByteArray *buffer;   /*  what the plug-in sent and wasn't handled yet  */
+  guint       pos;      /*  the read position in buffer                   */
+  guint       trace;
+} GimpPlugInQuery;
+
+
 static void    gimp_plug_in_manager_search            (GimpPlugInManager      *manager,
                                                        GimpInitStatusFunc      status_callback);
 static gchar * gimp_plug_in_manager_get_pluginrc      (GimpPlugInManager      *manager);
@@ -58,6 +79,20 @@ static void    gimp_plug_in_manager_read_pluginrc     (GimpPlugInManager      *m
 static void    gimp_plug_in_manager_query_new         (GimpPlugInManager      *manager,
                                                        GimpContext            *context,
                                                        GimpInitStatusFunc      status_callback);
+static GimpPlugInQuery *
+               gimp_plug_in_manager_query_start       (GimpPlugInManager      *manager,
+                                                       GimpContext            *context,
+                                                       GimpPlugInDef          *plug_in_def,
+                                                       GMainContext           *main_context);
+static void    gimp_plug_in_manager_query_finish      (GimpPlugInQuery        *query);
+static gboolean gimp_plug_in_manager_query_recv       (GIOChannel             *channel,
+                                                       GIOCondition            cond,
+                                                       GimpPlugInQuery        *query);
+static gboolean gimp_plug_in_manager_query_read       (GIOChannel             *channel,
+                                                       guint8                 *buf,
+                                                       gsize                   count,
+                                                       gpointer                user_data);
+static gboolean gimp_plug_in_manager_query_timeout    (GimpPlugIn             *plug_in);
 static void    gimp_plug_in_manager_init_plug_ins     (GimpPlugInManager      *manager,
                                                        GimpContext            *context,
                                                        GimpInitStatusFunc      status_callback);
@@ -98,18 +133,26 @@ gimp_plug_in_manager_restore (GimpPlugInManager  *manager,
   context = gimp_pdb_context_new (gimp, context, TRUE);
 
   /* search for binaries in the plug-in directory path */
+  gimp_trace_begin ("search");
   gimp_plug_in_manager_search (manager, status_callback);
+  gimp_trace_end ();
 
   /* read the pluginrc file for cached data */
   pluginrc = gimp_plug_in_manager_get_pluginrc (manager);
 
+  gimp_trace_begin ("read pluginrc");
   gimp_plug_in_manager_read_pluginrc (manager, pluginrc, status_callback);
+  gimp_trace_end ();
 
   /* query any plug-ins that changed since we last wrote out pluginrc */
+  gimp_trace_begin ("query");
   gimp_plug_in_manager_query_new (manager, context, status_callback);
+  gimp_trace_end ();
 
   /* initialize the plug-ins */
+  gimp_trace_begin ("init");
   gimp_plug_in_manager_init_plug_ins (manager, context, status_callback);
+  gimp_trace_end ();
 
   /* add the procedures to manager->plug_in_procedures */
   for (list = manager->plug_in_defs; list; list = list->next)
@@ -126,6 +169,8 @@ gimp_plug_in_manager_restore (GimpPlugInManager  *manager,
   /* write the pluginrc file if necessary */
   if (manager->write_pluginrc)
     {
+      gimp_trace_begin ("write pluginrc");
+
       if (gimp->be_verbose)
         g_print ("Writing '%s'\n", gimp_filename_to_utf8 (pluginrc));
 
@@ -137,6 +182,8 @@ gimp_plug_in_manager_restore (GimpPlugInManager  *manager,
         }
 
       manager->write_pluginrc = FALSE;
+
+      gimp_trace_end ();
     }
 
   g_free (pluginrc);
@@ -190,7 +237,9 @@ gimp_plug_in_manager_restore (GimpPlugInManager  *manager,
     g_slist_sort_with_data (manager->export_procs,
                             gimp_plug_in_manager_file_proc_compare, manager);
 
+  gimp_trace_begin ("extensions");
   gimp_plug_in_manager_run_extensions (manager, context, status_callback);
+  gimp_trace_end ();
 
   g_object_unref (context);
 }
@@ -329,35 +378,281 @@ gimp_plug_in_manager_query_new (GimpPlugInManager  *manager,
 
   if (n_plugins)
     {
-      gint nth;
+      GMainContext     *main_context;
+      GimpPlugInQuery **queries;
+      gint              max_queries;
+      gint              n_queries = 0;
+      gint              nth       = 0;
 
       manager->write_pluginrc = TRUE;
 
-      for (list = manager->plug_in_defs, nth = 0; list; list = list->next)
+      /*  The plug-ins are queried concurrently, their messages are
+       *  dispatched from a private main context so nothing else runs
+       *  in between.  Each plug-in registers its procedures with its
+       *  own GimpPlugInDef, and pluginrc is written in the order of
+       *  manager->plug_in_defs, so the result doesn't depend on the
+       *  order in which the plug-ins answer.
+       *
+       *  A plug-in running under a debugger is queried on its own and
+       *  without a timeout.
+       */
+      if (manager->debug)
+        max_queries = 1;
+      else
+        max_queries = MIN (gimp_parallel_get_n_threads (manager->gimp),
+                           n_plugins);
+
+      main_context = g_main_context_new ();
+      queries      = g_new0 (GimpPlugInQuery *, max_queries);
+
+      /*  messages are only read once they arrived completely, so a
+       *  plug-in that stops in the middle of one can still time out
+       */
+      gimp_wire_set_reader (gimp_plug_in_manager_query_read);
+
+      list = manager->plug_in_defs;
+
+      while (list || n_queries > 0)
         {
-          GimpPlugInDef *plug_in_def = list->data;
+          gint i;
 
-          if (plug_in_def->needs_query)
+          while (list && n_queries < max_queries)
             {
-              gchar *basename;
+              GimpPlugInDef *plug_in_def = list->data;
 
-              basename = g_filename_display_basename (plug_in_def->prog);
-              status_callback (NULL, basename,
-                               (gdouble) nth++ / (gdouble) n_plugins);
-              g_free (basename);
+              list = list->next;
 
-              if (manager->gimp->be_verbose)
-                g_print ("Querying plug-in: '%s'\n",
-                         gimp_filename_to_utf8 (plug_in_def->prog));
+              if (plug_in_def->needs_query)
+                {
+                  gchar *basename;
+
+                  basename = g_filename_display_basename (plug_in_def->prog);
+                  status_callback (NULL, basename,
+                                   (gdouble) nth++ / (gdouble) n_plugins);
+                  g_free (basename);
+
+                  if (manager->gimp->be_verbose)
+                    g_print ("Querying plug-in: '%s'\n",
+                             gimp_filename_to_utf8 (plug_in_def->prog));
+
+                  queries[n_queries] =
+                    gimp_plug_in_manager_query_start (manager, context,
+                                                      plug_in_def,
+                                                      main_context);
+
+                  if (queries[n_queries])
+                    n_queries++;
+                }
+            }
+
+          if (n_queries == 0)
+            continue;
 
-              gimp_plug_in_manager_call_query (manager, context, plug_in_def);
+          g_main_context_iteration (main_context, TRUE);
+
+          for (i = 0; i < n_queries; i++)
+            {
+              if (! queries[i]->plug_in->open)
+                {
+                  gimp_plug_in_manager_query_finish (queries[i]);
+
+                  queries[i--] = queries[--n_queries];
+                }
             }
         }
+
+      gimp_wire_set_reader (NULL);
+
+      g_free (queries);
+      g_main_context_unref (main_context);
     }
 
   status_callback (NULL, "", 1.0);
 }
 
+static GimpPlugInQuery *
+gimp_plug_in_manager_query_start (GimpPlugInManager *manager,
+                                  GimpContext       *context,
+                                  GimpPlugInDef     *plug_in_def,
+                                  GMainContext      *main_context)
+{
+  GimpPlugInQuery *query;
+  GimpPlugIn      *plug_in;
+  gchar           *basename;
+
+  plug_in = gimp_plug_in_new (manager, context, NULL,
+                              NULL, plug_in_def->prog);
+
+  if (! plug_in)
+    return NULL;
+
+  plug_in->plug_in_def = plug_in_def;
+
+  basename = g_filename_display_basename (plug_in_def->prog);
+
+  query = g_slice_new0 (GimpPlugInQuery);
+
+  query->plug_in = plug_in;
+  query->trace   = gimp_trace_begin_async ("%s", basename);
+
+  g_free (basename);
+
+  /*  open the plug-in synchronously, we add our own watch below  */
+  if (! gimp_plug_in_open (plug_in, GIMP_PLUG_IN_CALL_QUERY, TRUE))
+    {
+      gimp_trace_end_async (query->trace);
+      g_slice_free (GimpPlugInQuery, query);
+      g_object_unref (plug_in);
+      return NULL;
+    }
+
+  query->buffer = g_byte_array_new ();
+
+  query->watch = g_io_create_watch (plug_in->my_read,
+                                    G_IO_IN  | G_IO_PRI | G_IO_ERR | G_IO_HUP);
+  g_source_set_callback (query->watch,
+                         (GSourceFunc) gimp_plug_in_manager_query_recv,
+                         query, NULL);
+  g_source_attach (query->watch, main_context);
+
+  if (! manager->debug)
+    {
+      query->timeout = g_timeout_source_new_seconds (GIMP_PLUG_IN_QUERY_TIMEOUT);
+      g_source_set_callback (query->timeout,
+                             (GSourceFunc) gimp_plug_in_manager_query_timeout,
+                             plug_in, NULL);
+      g_source_attach (query->timeout, main_context);
+    }
+
+  return query;
+}
+
+static void
+gimp_plug_in_manager_query_finish (GimpPlugInQuery *query)
+{
+  g_source_destroy (query->watch);
+  g_source_unref (query->watch);
+
+  if (query->timeout)
+    {
+      g_source_destroy (query->timeout);
+      g_source_unref (query->timeout);
+    }
+
+  g_byte_array_free (query->buffer, TRUE);
+
+  gimp_trace_end_async (query->trace);
+
+  g_object_unref (query->plug_in);
+
+  g_slice_free (GimpPlugInQuery, query);
+}
+
+static gboolean
+gimp_plug_in_manager_query_recv (GIOChannel      *channel,
+                                 GIOCondition     cond,
+                                 GimpPlugInQuery *query)
+{
+  GimpPlugIn *plug_in = query->plug_in;
+
+  /*  read all pending messages before honoring a hangup, the
+   *  plug-in has usually exited by the time we get to them
+   */
+  if (cond & (G_IO_IN | G_IO_PRI))
+    {
+      gchar     buf[4096];
+      gsize     bytes = 0;
+      GIOStatus status;
+
+      /*  the channel is unbuffered, this is a single read() which
+       *  doesn't block after G_IO_IN
+       */
+      status = g_io_channel_read_chars (channel, buf, sizeof (buf),
+                                        &bytes, NULL);
+
+      if (status != G_IO_STATUS_NORMAL || bytes == 0)
+        {
+          if (status == G_IO_STATUS_EOF || (cond & G_IO_HUP))
+            plug_in->hup = TRUE;
+
+          gimp_plug_in_close (plug_in, TRUE);
+
+          return FALSE;
+        }
+
+      g_byte_array_append (query->buffer, (const guint8 *) buf, bytes);
+
+      /*  handle the messages that arrived completely  */
+      while (plug_in->open && query->buffer->len > 0)
+        {
+          GimpWireMessage msg;
+
+          memset (&msg, 0, sizeof (GimpWireMessage));
+
+          query->pos = 0;
+
+          if (! gimp_wire_read_msg (channel, &msg, query))
+            {
+              gimp_wire_clear_error ();
+              break;
+            }
+
+          g_byte_array_remove_range (query->buffer, 0, query->pos);
+
+          gimp_plug_in_handle_message (plug_in, &msg);
+          gimp_wire_destroy (&msg);
+        }
+    }
+  else if (cond & (G_IO_ERR | G_IO_HUP))
+    {
+      if (cond & G_IO_HUP)
+        plug_in->hup = TRUE;
+
+      gimp_plug_in_close (plug_in, TRUE);
+    }
+
+  return plug_in->open;
+}
+
+/*  the wire protocol's reader while plug-ins are queried, reads from
+ *  the query's buffer and fails if the message isn't complete yet
+ */
+static gboolean
+gimp_plug_in_manager_query_read (GIOChannel *channel,
+                                 guint8     *buf,
+                                 gsize       count,
+                                 gpointer    user_data)
+{
+  GimpPlugInQuery *query = user_data;
+
+  if (query->buffer->len - query->pos < count)
+    return FALSE;
+
+  memcpy (buf, query->buffer->data + query->pos, count);
+  query->pos += count;
+
+  return TRUE;
+}
+
+static gboolean
+gimp_plug_in_manager_query_timeout (GimpPlugIn *plug_in)
+{
+  if (plug_in->open)
+    {
+      gimp_message (plug_in->manager->gimp, NULL, GIMP_MESSAGE_WARNING,
+                    _("Plug-in \"%s\"\n(%s)\n\n"
+                      "did not answer the query within %d seconds "
+                      "and was terminated."),
+                    gimp_object_get_name (plug_in),
+                    gimp_filename_to_utf8 (plug_in->prog),
+                    GIMP_PLUG_IN_QUERY_TIMEOUT);
+
+      gimp_plug_in_close (plug_in, TRUE);
+    }
+
+  return FALSE;
+}
+
 /* initialize the plug-ins */
 static void
 gimp_plug_in_manager_init_plug_ins (GimpPlugInManager  *manager,
@@ -392,13 +687,16 @@ gimp_plug_in_manager_init_plug_ins (GimpPlugInManager  *manager,
               basename = g_filename_display_basename (plug_in_def->prog);
               status_callback (NULL, basename,
                                (gdouble) nth++ / (gdouble) n_plugins);
-              g_free (basename);
 
               if (manager->gimp->be_verbose)
                 g_print ("Initializing plug-in: '%s'\n",
                          gimp_filename_to_utf8 (plug_in_def->prog));
 
+              gimp_trace_begin ("%s", basename);
               gimp_plug_in_manager_call_init (manager, context, plug_in_def);
+              gimp_trace_end ();
+
+              g_free (basename);
             }
         }
     }
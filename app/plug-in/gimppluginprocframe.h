@@ -32,6 +32,7 @@ struct _GimpPlugInProcFrame
   GMainLoop           *main_loop;
 
   GimpValueArray      *return_vals;
+  gboolean             keep_return_vals;
 
   GimpProgress        *progress;
   gboolean             progress_created;
@@ -79,6 +79,8 @@ struct _GimpPlugInShm
 {
   gint    shm_ID;
   guchar *shm_addr;
+  gsize   shm_size;
+  gchar   shm_name[48];
 
 #if defined(USE_WIN32_SHM)
   HANDLE  shm_handle;
@@ -86,6 +88,11 @@ struct _GimpPlugInShm
 };
 
 
+static GimpPlugInShm * gimp_plug_in_shm_create (gsize        size,
+                                                gint         ID,
+                                                const gchar *name);
+
+
 GimpPlugInShm *
 gimp_plug_in_shm_new (void)
 {
@@ -94,15 +101,147 @@ gimp_plug_in_shm_new (void)
    *  we'll fall back on sending the data over the pipe.
    */
 
+  gint  pid = gimp_get_pid ();
+  gchar name[48];
+
+  /* Our shared memory id will be our process ID, and the
+   * file map name is derived from it
+   */
+#if defined(USE_WIN32_SHM)
+  g_snprintf (name, sizeof (name), "GIMP%d.SHM", pid);
+#else
+  g_snprintf (name, sizeof (name), "/gimp-shm-%d", pid);
+#endif
+
+  return gimp_plug_in_shm_create (TILE_MAP_SIZE, pid, name);
+}
+
+/**
+ * gimp_plug_in_shm_new_sized:
+ * @size: the size of the segment in bytes
+ *
+ * Allocates a piece of shared memory of arbitrary size, which is used
+ * for exporting whole drawable regions to plug-ins. Unlike the tile
+ * transport segment, a plug-in attaches to it using the name returned
+ * by gimp_plug_in_shm_get_name(), or the ID for SysV shared memory.
+ *
+ * Return value: the new segment, or %NULL if shared memory is not
+ *               available or the allocation failed.
+ **/
+GimpPlugInShm *
+gimp_plug_in_shm_new_sized (gsize size)
+{
+  static gint serial = 0;
+
+  gint  pid = gimp_get_pid ();
+  gchar name[48];
+
+  g_return_val_if_fail (size > 0, NULL);
+
+  serial++;
+
+#if defined(USE_WIN32_SHM)
+  g_snprintf (name, sizeof (name), "GIMP%d-%d.SHM", pid, serial);
+#else
+  g_snprintf (name, sizeof (name), "/gimp-shm-%d-%d", pid, serial);
+#endif
+
+  return gimp_plug_in_shm_create (size, serial, name);
+}
+
+void
+gimp_plug_in_shm_free (GimpPlugInShm *shm)
+{
+  g_return_if_fail (shm != NULL);
+
+  if (shm->shm_ID != -1)
+    {
+
+#if defined (USE_SYSV_SHM)
+
+      shmdt (shm->shm_addr);
+
+#ifndef IPC_RMID_DEFERRED_RELEASE
+      shmctl (shm->shm_ID, IPC_RMID, NULL);
+#endif
+
+#elif defined(USE_WIN32_SHM)
+
+      if (shm->shm_addr)
+        UnmapViewOfFile (shm->shm_addr);
+
+      if (shm->shm_handle)
+        CloseHandle (shm->shm_handle);
+
+#elif defined(USE_POSIX_SHM)
+
+      munmap (shm->shm_addr, shm->shm_size);
+
+      shm_unlink (shm->shm_name);
+
+#endif
+
+      GIMP_LOG (SHM, "detached shared memory segment ID = %d", shm->shm_ID);
+    }
+
+  g_slice_free (GimpPlugInShm, shm);
+}
+
+gint
+gimp_plug_in_shm_get_ID (GimpPlugInShm *shm)
+{
+  g_return_val_if_fail (shm != NULL, -1);
+
+  return shm->shm_ID;
+}
+
+guchar *
+gimp_plug_in_shm_get_addr (GimpPlugInShm *shm)
+{
+  g_return_val_if_fail (shm != NULL, NULL);
+
+  return shm->shm_addr;
+}
+
+const gchar *
+gimp_plug_in_shm_get_name (GimpPlugInShm *shm)
+{
+  g_return_val_if_fail (shm != NULL, NULL);
+
+  return shm->shm_name;
+}
+
+gsize
+gimp_plug_in_shm_get_size (GimpPlugInShm *shm)
+{
+  g_return_val_if_fail (shm != NULL, 0);
+
+  return shm->shm_size;
+}
+
+
+/*  private functions  */
+
+static GimpPlugInShm *
+gimp_plug_in_shm_create (gsize        size,
+                         gint         ID,
+                         const gchar *name)
+{
   GimpPlugInShm *shm = g_slice_new0 (GimpPlugInShm);
 
-  shm->shm_ID = -1;
+  shm->shm_ID   = -1;
+  shm->shm_size = size;
+
+  g_strlcpy (shm->shm_name, name, sizeof (shm->shm_name));
 
 #if defined(USE_SYSV_SHM)
 
   /* Use SysV shared memory mechanisms for transferring tile data. */
   {
-    shm->shm_ID = shmget (IPC_PRIVATE, TILE_MAP_SIZE, IPC_CREAT | 0600);
+    shm->shm_ID = shmget (IPC_PRIVATE, size, IPC_CREAT | 0600);
+
+    /* SysV segments are identified by their ID only */
+    shm->shm_name[0] = '\0';
 
     if (shm->shm_ID != -1)
       {
@@ -132,32 +271,24 @@ gimp_plug_in_shm_new (void)
 
   /* Use Win32 shared memory mechanisms for transferring tile data. */
   {
-    gint  pid;
-    gchar fileMapName[MAX_PATH];
-
-    /* Our shared memory id will be our process ID */
-    pid = GetCurrentProcessId ();
-
-    /* From the id, derive the file map name */
-    g_snprintf (fileMapName, sizeof (fileMapName), "GIMP%d.SHM", pid);
-
     /* Create the file mapping into paging space */
     shm->shm_handle = CreateFileMapping (INVALID_HANDLE_VALUE, NULL,
-                                         PAGE_READWRITE, 0,
-                                         TILE_MAP_SIZE,
-                                         fileMapName);
+                                         PAGE_READWRITE,
+                                         (DWORD) ((guint64) size >> 32),
+                                         (DWORD) (size & 0xffffffff),
+                                         name);
 
     if (shm->shm_handle)
       {
         /* Map the shared memory into our address space for use */
         shm->shm_addr = (guchar *) MapViewOfFile (shm->shm_handle,
                                                   FILE_MAP_ALL_ACCESS,
-                                                  0, 0, TILE_MAP_SIZE);
+                                                  0, 0, size);
 
         /* Verify that we mapped our view */
         if (shm->shm_addr)
           {
-            shm->shm_ID = pid;
+            shm->shm_ID = ID;
           }
         else
           {
@@ -176,39 +307,31 @@ gimp_plug_in_shm_new (void)
 
   /* Use POSIX shared memory mechanisms for transferring tile data. */
   {
-    gint  pid;
-    gchar shm_handle[32];
-    gint  shm_fd;
-
-    /* Our shared memory id will be our process ID */
-    pid = gimp_get_pid ();
-
-    /* From the id, derive the file map name */
-    g_snprintf (shm_handle, sizeof (shm_handle), "/gimp-shm-%d", pid);
+    gint shm_fd;
 
     /* Create the file mapping into paging space */
-    shm_fd = shm_open (shm_handle, O_RDWR | O_CREAT, 0600);
+    shm_fd = shm_open (name, O_RDWR | O_CREAT, 0600);
 
     if (shm_fd != -1)
       {
-        if (ftruncate (shm_fd, TILE_MAP_SIZE) != -1)
+        if (ftruncate (shm_fd, size) != -1)
           {
             /* Map the shared memory into our address space for use */
-            shm->shm_addr = (guchar *) mmap (NULL, TILE_MAP_SIZE,
+            shm->shm_addr = (guchar *) mmap (NULL, size,
                                              PROT_READ | PROT_WRITE, MAP_SHARED,
                                              shm_fd, 0);
 
             /* Verify that we mapped our view */
             if (shm->shm_addr != MAP_FAILED)
               {
-                shm->shm_ID = pid;
+                shm->shm_ID = ID;
               }
             else
               {
                 g_printerr ("mmap() failed: %s\n" ERRMSG_SHM_DISABLE,
                             g_strerror (errno));
 
-                shm_unlink (shm_handle);
+                shm_unlink (name);
               }
           }
         else
@@ -216,7 +339,7 @@ gimp_plug_in_shm_new (void)
             g_printerr ("ftruncate() failed: %s\n" ERRMSG_SHM_DISABLE,
                         g_strerror (errno));
 
-            shm_unlink (shm_handle);
+            shm_unlink (name);
           }
 
         close (shm_fd);
@@ -237,64 +360,9 @@ gimp_plug_in_shm_new (void)
     }
   else
     {
-      GIMP_LOG (SHM, "attached shared memory segment ID = %d", shm->shm_ID);
+      GIMP_LOG (SHM, "attached shared memory segment ID = %d (%" G_GSIZE_FORMAT " bytes)",
+                shm->shm_ID, shm->shm_size);
     }
 
   return shm;
 }
-
-void
-gimp_plug_in_shm_free (GimpPlugInShm *shm)
-{
-  g_return_if_fail (shm != NULL);
-
-  if (shm->shm_ID != -1)
-    {
-
-#if defined (USE_SYSV_SHM)
-
-      shmdt (shm->shm_addr);
-
-#ifndef IPC_RMID_DEFERRED_RELEASE
-      shmctl (shm->shm_ID, IPC_RMID, NULL);
-#endif
-
-#elif defined(USE_WIN32_SHM)
-
-      if (shm->shm_handle)
-        CloseHandle (shm->shm_handle);
-
-#elif defined(USE_POSIX_SHM)
-
-      gchar shm_handle[32];
-
-      munmap (shm->shm_addr, TILE_MAP_SIZE);
-
-      g_snprintf (shm_handle, sizeof (shm_handle), "/gimp-shm-%d",
-                  shm->shm_ID);
-
-      shm_unlink (shm_handle);
-
-#endif
-
-      GIMP_LOG (SHM, "detached shared memory segment ID = %d", shm->shm_ID);
-    }
-
-  g_slice_free (GimpPlugInShm, shm);
-}
-
-gint
-gimp_plug_in_shm_get_ID (GimpPlugInShm *shm)
-{
-  g_return_val_if_fail (shm != NULL, -1);
-
-  return shm->shm_ID;
-}
-
-guchar *
-gimp_plug_in_shm_get_addr (GimpPlugInShm *shm)
-{
-  g_return_val_if_fail (shm != NULL, NULL);
-
-  return shm->shm_addr;
-}
@@ -0,0 +1,192 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimp-parallel.h"
+#include "core/gimpimage.h"
+#include "core/gimpimage-convert-type.h"
+#include "core/gimpimage-duplicate.h"
+#include "core/gimplayer.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+/*  Converts a synthetic photo-like image to indexed with every
+ *  combination of palette and dither type, and prints the time
+ *  taken per megapixel.
+ */
+
+#define PERF_IMAGE_WIDTH  2048
+#define PERF_IMAGE_HEIGHT 2048
+#define PERF_N_RUNS       3
+
+
+static GimpImage *
+perf_create_image (Gimp *gimp)
+{
+  GimpImage  *image;
+  GimpLayer  *layer;
+  GeglBuffer *buffer;
+  guchar     *row;
+  GRand      *rand;
+  gint        x, y;
+
+  image = gimp_image_new (gimp,
+                          PERF_IMAGE_WIDTH, PERF_IMAGE_HEIGHT,
+                          GIMP_RGB, GIMP_PRECISION_U8);
+
+  layer = gimp_layer_new (image,
+                          PERF_IMAGE_WIDTH, PERF_IMAGE_HEIGHT,
+                          babl_format ("R'G'B'A u8"),
+                          "Benchmark Layer",
+                          GIMP_OPACITY_OPAQUE,
+                          GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  row    = g_new (guchar, PERF_IMAGE_WIDTH * 4);
+  rand   = g_rand_new_with_seed (1);
+
+  /*  smooth gradients with some noise, and a soft alpha edge  */
+  for (y = 0; y < PERF_IMAGE_HEIGHT; y++)
+    {
+      for (x = 0; x < PERF_IMAGE_WIDTH; x++)
+        {
+          gint noise = g_rand_int_range (rand, -8, 9);
+
+          row[x * 4 + 0] = CLAMP (x * 255 / PERF_IMAGE_WIDTH + noise, 0, 255);
+          row[x * 4 + 1] = CLAMP (y * 255 / PERF_IMAGE_HEIGHT + noise, 0, 255);
+          row[x * 4 + 2] = CLAMP (128 + 127 * sin (x * 0.01 + y * 0.013) +
+                                  noise, 0, 255);
+          row[x * 4 + 3] = MIN (x, 255);
+        }
+
+      gegl_buffer_set (buffer,
+                       GEGL_RECTANGLE (0, y, PERF_IMAGE_WIDTH, 1), 0,
+                       babl_format ("R'G'B'A u8"), row,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_rand_free (rand);
+  g_free (row);
+
+  return image;
+}
+
+static void
+perf_convert_indexed (GimpImage              *image,
+                      GimpConvertPaletteType  palette_type,
+                      GimpConvertDitherType   dither_type)
+{
+  const gchar *palette_nick;
+  const gchar *dither_nick;
+  gdouble      best = G_MAXDOUBLE;
+  gint         run;
+
+  for (run = 0; run < PERF_N_RUNS; run++)
+    {
+      GimpImage *copy = gimp_image_duplicate (image);
+      GTimer    *timer = g_timer_new ();
+      gdouble    elapsed;
+
+      gimp_image_convert_type (copy, GIMP_INDEXED,
+                               256, dither_type,
+                               FALSE, FALSE, FALSE,
+                               palette_type, NULL,
+                               NULL, NULL);
+
+      elapsed = g_timer_elapsed (timer, NULL);
+      best    = MIN (best, elapsed);
+
+      g_timer_destroy (timer);
+      g_object_unref (copy);
+    }
+
+  gimp_enum_get_value (GIMP_TYPE_CONVERT_PALETTE_TYPE, palette_type,
+                       NULL, &palette_nick, NULL, NULL);
+  gimp_enum_get_value (GIMP_TYPE_CONVERT_DITHER_TYPE, dither_type,
+                       NULL, &dither_nick, NULL, NULL);
+
+  g_print ("%-16s %-16s %8.1f ms/MP\n",
+           palette_nick, dither_nick,
+           1000.0 * best /
+           (PERF_IMAGE_WIDTH * PERF_IMAGE_HEIGHT / 1000000.0));
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  static const GimpConvertPaletteType palette_types[] =
+  {
+    GIMP_MAKE_PALETTE,
+    GIMP_WEB_PALETTE,
+    GIMP_MONO_PALETTE
+  };
+
+  static const GimpConvertDitherType dither_types[] =
+  {
+    GIMP_NO_DITHER,
+    GIMP_FS_DITHER,
+    GIMP_FSLOWBLEED_DITHER,
+    GIMP_FIXED_DITHER,
+    GIMP_BLUE_NOISE_DITHER
+  };
+
+  Gimp      *gimp;
+  GimpImage *image;
+  gint       i, j;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  image = perf_create_image (gimp);
+
+  g_print ("%d processor(s), %dx%d pixels, best of %d runs\n",
+           gimp_parallel_get_n_threads (gimp),
+           PERF_IMAGE_WIDTH, PERF_IMAGE_HEIGHT, PERF_N_RUNS);
+
+  for (i = 0; i < G_N_ELEMENTS (palette_types); i++)
+    for (j = 0; j < G_N_ELEMENTS (dither_types); j++)
+      perf_convert_indexed (image, palette_types[i], dither_types[j]);
+
+  g_object_unref (image);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  gimp_exit (gimp, TRUE);
+
+  return 0;
+}
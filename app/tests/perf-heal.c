@@ -0,0 +1,194 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimp-parallel.h"
+
+#include "paint/gimpheal-laplace.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+/*  Solves the heal tool's laplace equation for round brushes of
+ *  growing size, once with the original SOR solver and once with the
+ *  multigrid solver, and prints the iterations, the time taken and
+ *  the largest remaining residual of each.
+ */
+
+#define PERF_DEPTH 4
+
+
+static void
+perf_create_problem (gint     size,
+                     gfloat  *matrix,
+                     guchar  *mask)
+{
+  GRand   *rand   = g_rand_new_with_seed (size);
+  gdouble  radius = size / 2.0;
+  gint     x, y, k;
+
+  for (y = 0; y < size; y++)
+    {
+      for (x = 0; x < size; x++)
+        {
+          gdouble dx = x + 0.5 - radius;
+          gdouble dy = y + 0.5 - radius;
+
+          mask[y * size + x] = (dx * dx + dy * dy < radius * radius) ? 255 : 0;
+
+          /*  a smooth difference between image and pattern, with noise  */
+          for (k = 0; k < PERF_DEPTH; k++)
+            {
+              matrix[(y * size + x) * PERF_DEPTH + k] =
+                0.5 * sin (x * 0.02 * (k + 1)) * cos (y * 0.015) +
+                g_rand_double_range (rand, -0.05, 0.05);
+            }
+        }
+    }
+
+  g_rand_free (rand);
+}
+
+static gdouble
+perf_max_residual (const gfloat *matrix,
+                   const guchar *mask,
+                   gint          size)
+{
+  const gint stride   = size * PERF_DEPTH;
+  gdouble    residual = 0.0;
+  gint       x, y, k;
+
+  for (y = 1; y < size - 1; y++)
+    {
+      for (x = 1; x < size - 1; x++)
+        {
+          const gfloat *p = matrix + y * stride + x * PERF_DEPTH;
+
+          if (! mask[y * size + x])
+            continue;
+
+          for (k = 0; k < PERF_DEPTH; k++)
+            {
+              gdouble r = (p[k - PERF_DEPTH] + p[k + PERF_DEPTH] +
+                           p[k - stride]     + p[k + stride]     -
+                           4.0 * p[k]);
+
+              residual = MAX (residual, fabs (r));
+            }
+        }
+    }
+
+  return residual;
+}
+
+static void
+perf_heal (Gimp *gimp,
+           gint  size)
+{
+  gfloat  *original;
+  gfloat  *matrix;
+  guchar  *mask;
+  GTimer  *timer;
+  gdouble  sor_time;
+  gdouble  sor_residual;
+  gdouble  mg_time;
+  gdouble  mg_residual;
+  gint     sor_iterations;
+  gint     mg_cycles;
+
+  original = g_new (gfloat, size * size * PERF_DEPTH);
+  matrix   = g_new (gfloat, size * size * PERF_DEPTH);
+  mask     = g_new (guchar, size * size);
+
+  perf_create_problem (size, original, mask);
+
+  timer = g_timer_new ();
+
+  memcpy (matrix, original, size * size * PERF_DEPTH * sizeof (gfloat));
+
+  g_timer_start (timer);
+  sor_iterations = gimp_heal_laplace_sor (matrix, size, size, PERF_DEPTH,
+                                          mask);
+  sor_time = g_timer_elapsed (timer, NULL);
+
+  sor_residual = perf_max_residual (matrix, mask, size);
+
+  memcpy (matrix, original, size * size * PERF_DEPTH * sizeof (gfloat));
+
+  g_timer_start (timer);
+  mg_cycles = gimp_heal_laplace_multigrid (gimp, matrix, size, size,
+                                           PERF_DEPTH, mask);
+  mg_time = g_timer_elapsed (timer, NULL);
+
+  mg_residual = perf_max_residual (matrix, mask, size);
+
+  g_print ("%5d px  sor %4d iterations %9.1f ms  residual %.1e\n"
+           "          mg  %4d cycles     %9.1f ms  residual %.1e\n",
+           size,
+           sor_iterations, sor_time * 1000.0, sor_residual,
+           mg_cycles,      mg_time  * 1000.0, mg_residual);
+
+  g_timer_destroy (timer);
+
+  g_free (original);
+  g_free (matrix);
+  g_free (mask);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  static const gint sizes[] = { 50, 100, 200, 300, 500, 750, 1000 };
+
+  Gimp *gimp;
+  gint  i;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  g_print ("%d processor(s), %d channels\n",
+           gimp_parallel_get_n_threads (gimp), PERF_DEPTH);
+
+  for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+    perf_heal (gimp, sizes[i]);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  gimp_exit (gimp, TRUE);
+
+  return 0;
+}
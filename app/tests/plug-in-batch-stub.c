@@ -0,0 +1,119 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*  A batch interpreter for test-plug-in-batch.  Its commands are
+ *  "sleep <milliseconds>", after which it succeeds, and "fail".  It
+ *  returns the command it ran.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libgimp/gimp.h>
+
+
+#define PLUG_IN_PROC "test-plug-in-batch-stub"
+
+
+static void   query (void);
+static void   run   (const gchar      *name,
+                     gint              nparams,
+                     const GimpParam  *param,
+                     gint             *nreturn_vals,
+                     GimpParam       **return_vals);
+
+
+const GimpPlugInInfo PLUG_IN_INFO =
+{
+  NULL,  /* init_proc  */
+  NULL,  /* quit_proc  */
+  query, /* query_proc */
+  run,   /* run_proc   */
+};
+
+MAIN ()
+
+static void
+query (void)
+{
+  static const GimpParamDef args[] =
+  {
+    { GIMP_PDB_INT32,  "run-mode", "The run mode { RUN-NONINTERACTIVE (1) }" },
+    { GIMP_PDB_STRING, "command",  "The command to run"                      }
+  };
+
+  static const GimpParamDef return_vals[] =
+  {
+    { GIMP_PDB_STRING, "command",  "The command that was run"                }
+  };
+
+  gimp_install_procedure (PLUG_IN_PROC,
+                          "Batch interpreter for the batch runner test",
+                          "",
+                          "",
+                          "",
+                          "",
+                          NULL,
+                          NULL,
+                          GIMP_PLUGIN,
+                          G_N_ELEMENTS (args),
+                          G_N_ELEMENTS (return_vals),
+                          args, return_vals);
+}
+
+static void
+run (const gchar      *name,
+     gint              nparams,
+     const GimpParam  *param,
+     gint             *nreturn_vals,
+     GimpParam       **return_vals)
+{
+  static GimpParam   values[2];
+  GimpPDBStatusType  status  = GIMP_PDB_SUCCESS;
+  const gchar       *command = NULL;
+
+  if (nparams >= 2)
+    command = param[1].data.d_string;
+
+  if (! command)
+    {
+      status = GIMP_PDB_CALLING_ERROR;
+    }
+  else if (g_str_has_prefix (command, "sleep "))
+    {
+      g_usleep (atoi (command + strlen ("sleep ")) * 1000);
+    }
+  else if (! strcmp (command, "fail"))
+    {
+      status = GIMP_PDB_EXECUTION_ERROR;
+    }
+  else
+    {
+      status = GIMP_PDB_CALLING_ERROR;
+    }
+
+  *nreturn_vals = 2;
+  *return_vals  = values;
+
+  values[0].type          = GIMP_PDB_STATUS;
+  values[0].data.d_status = status;
+
+  values[1].type          = GIMP_PDB_STRING;
+  values[1].data.d_string = (gchar *) (command ? command : "");
+}
@@ -0,0 +1,283 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpbrush.h"
+#include "core/gimpbrushcache.h"
+#include "core/gimpbrushgenerated.h"
+#include "core/gimptempbuf.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define ADD_TEST(function) \
+  g_test_add ("/gimp-brush-cache/" #function, \
+              GimpTestFixture, \
+              NULL, \
+              gimp_test_brush_cache_setup, \
+              function, \
+              gimp_test_brush_cache_teardown);
+
+/*  the size of each test entry's data, large enough that the size
+ *  of the cache's own bookkeeping doesn't matter
+ */
+#define DATA_SIZE 10000
+
+
+typedef struct
+{
+  GimpBrushCache *a;
+  GimpBrushCache *b;
+  gint64          max_size;
+} GimpTestFixture;
+
+
+static gint n_destroyed = 0;
+
+
+static void
+gimp_test_data_destroy (gpointer data)
+{
+  n_destroyed++;
+
+  g_free (data);
+}
+
+static gint64
+gimp_test_data_get_memsize (gconstpointer data)
+{
+  return DATA_SIZE;
+}
+
+static void
+gimp_test_brush_cache_setup (GimpTestFixture *fixture,
+                             gconstpointer    data)
+{
+  fixture->a = gimp_brush_cache_new (gimp_test_data_destroy,
+                                     gimp_test_data_get_memsize, 'A', 'a');
+  fixture->b = gimp_brush_cache_new (gimp_test_data_destroy,
+                                     gimp_test_data_get_memsize, 'B', 'b');
+
+  fixture->max_size = gimp_brush_cache_get_max_size ();
+
+  n_destroyed = 0;
+}
+
+static void
+gimp_test_brush_cache_teardown (GimpTestFixture *fixture,
+                                gconstpointer    data)
+{
+  g_object_unref (fixture->a);
+  g_object_unref (fixture->b);
+
+  g_assert_cmpint (gimp_brush_cache_get_total_size (), ==, 0);
+
+  gimp_brush_cache_set_max_size (fixture->max_size);
+}
+
+/*  adds an entry for @scale to @cache and returns its data  */
+static gpointer
+gimp_test_add (GimpBrushCache *cache,
+               gdouble         scale)
+{
+  gpointer data = g_malloc (1);
+
+  gimp_brush_cache_add (cache, data, 10, 10, scale, 0.0, 0.0, 1.0);
+
+  return data;
+}
+
+static gconstpointer
+gimp_test_get (GimpBrushCache *cache,
+               gdouble         scale)
+{
+  return gimp_brush_cache_get (cache, 10, 10, scale, 0.0, 0.0, 1.0);
+}
+
+/**
+ * lru_eviction:
+ *
+ * Test that the caches of all brushes share one budget and that the
+ * least recently used entry of any of them is dropped first.
+ **/
+static void
+lru_eviction (GimpTestFixture *f,
+              gconstpointer    data)
+{
+  gpointer a1, a2, b1, b2;
+
+  gimp_brush_cache_set_max_size (3 * DATA_SIZE + DATA_SIZE / 2);
+
+  a1 = gimp_test_add (f->a, 1.0);
+  b1 = gimp_test_add (f->b, 1.0);
+  a2 = gimp_test_add (f->a, 2.0);
+
+  g_assert (gimp_test_get (f->a, 1.0) == a1);
+
+  /*  b1 is the least recently used entry now  */
+  b2 = gimp_test_add (f->b, 2.0);
+
+  g_assert_cmpint (n_destroyed, ==, 1);
+  g_assert (gimp_test_get (f->b, 1.0) == NULL);
+  g_assert (gimp_test_get (f->a, 1.0) == a1);
+  g_assert (gimp_test_get (f->a, 2.0) == a2);
+  g_assert (gimp_test_get (f->b, 2.0) == b2);
+
+  g_assert_cmpint (gimp_brush_cache_get_total_size (),
+                   <=, gimp_brush_cache_get_max_size ());
+}
+
+/**
+ * last_used_is_kept:
+ *
+ * Test that the entry each cache handed out last is never dropped,
+ * even if the budget is exceeded.
+ **/
+static void
+last_used_is_kept (GimpTestFixture *f,
+                   gconstpointer    data)
+{
+  gpointer a1, a2, b1;
+
+  gimp_brush_cache_set_max_size (0);
+
+  a1 = gimp_test_add (f->a, 1.0);
+  g_assert (gimp_test_get (f->a, 1.0) == a1);
+
+  a2 = gimp_test_add (f->a, 2.0);
+  g_assert_cmpint (n_destroyed, ==, 1);
+  g_assert (gimp_test_get (f->a, 2.0) == a2);
+
+  b1 = gimp_test_add (f->b, 1.0);
+  g_assert_cmpint (n_destroyed, ==, 1);
+  g_assert (gimp_test_get (f->a, 2.0) == a2);
+  g_assert (gimp_test_get (f->b, 1.0) == b1);
+}
+
+/**
+ * set_max_size_trims:
+ *
+ * Test that lowering the budget drops entries right away.
+ **/
+static void
+set_max_size_trims (GimpTestFixture *f,
+                    gconstpointer    data)
+{
+  gimp_brush_cache_set_max_size (10 * DATA_SIZE);
+
+  gimp_test_add (f->a, 1.0);
+  gimp_test_add (f->a, 2.0);
+  gimp_test_add (f->a, 3.0);
+  gimp_test_add (f->b, 1.0);
+  gimp_test_add (f->b, 2.0);
+
+  g_assert_cmpint (n_destroyed, ==, 0);
+
+  gimp_brush_cache_set_max_size (2 * DATA_SIZE);
+
+  /*  only the entries handed out last are left  */
+  g_assert_cmpint (n_destroyed, ==, 3);
+  g_assert (gimp_test_get (f->a, 3.0) != NULL);
+  g_assert (gimp_test_get (f->b, 2.0) != NULL);
+}
+
+/**
+ * transform_quantization:
+ *
+ * Test that brush transforms which differ by less than the
+ * quantization steps share a cache entry, that larger differences
+ * don't, and that the identity transform stays exact.
+ **/
+static void
+transform_quantization (GimpTestFixture *f,
+                        gconstpointer    data)
+{
+  GimpBrush         *brush;
+  const GimpTempBuf *mask;
+  gint               width;
+  gint               height;
+
+  brush = GIMP_BRUSH (gimp_brush_generated_new ("Test",
+                                                GIMP_BRUSH_GENERATED_CIRCLE,
+                                                20.0, 2, 0.5, 1.0, 0.0));
+
+  gimp_brush_begin_use (brush);
+
+  mask = gimp_brush_transform_mask (brush, 0.5, 0.0, 0.1, 0.8);
+
+  g_assert (mask != NULL);
+  g_assert (gimp_brush_transform_mask (brush,
+                                       0.5 * 1.0001, 0.001, 0.1 + 0.00001,
+                                       0.8 + 0.0001) == mask);
+
+  g_assert (gimp_brush_transform_mask (brush, 0.6, 0.0, 0.1, 0.8) != mask);
+  g_assert (gimp_brush_transform_mask (brush, 0.5, 0.0, 0.2, 0.8) != mask);
+  g_assert (gimp_brush_transform_mask (brush, 0.5, 0.0, 0.1, 0.5) != mask);
+
+  gimp_brush_transform_size (brush, 1.0 + 1e-6, 0.0, 1e-6, &width, &height);
+
+  g_assert_cmpint (width,  ==, gimp_temp_buf_get_width  (brush->mask));
+  g_assert_cmpint (height, ==, gimp_temp_buf_get_height (brush->mask));
+
+  gimp_brush_end_use (brush);
+
+  g_object_unref (brush);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (lru_eviction);
+  ADD_TEST (last_used_is_kept);
+  ADD_TEST (set_max_size_trims);
+  ADD_TEST (transform_quantization);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
@@ -0,0 +1,347 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpcolor/gimpcolor.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpdrawable.h"
+#include "core/gimpimage.h"
+#include "core/gimpimage-contiguous-region.h"
+#include "core/gimplayer.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define TEST_IMAGE_WIDTH  500
+#define TEST_IMAGE_HEIGHT 700
+#define TEST_N_PIXELS     (TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT)
+
+/*  a bit above the percolation threshold, so the white regions are
+ *  large and wind up and down across many tile rows
+ */
+#define TEST_WHITE_RATIO  0.62
+
+#define TEST_N_THREADS    4
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-contiguous-region/" #function, gimp, function);
+
+
+static const gint test_seeds[][2] =
+{
+  {   0,   0 },
+  { 250, 350 },
+  { 499, 699 },
+  {  17, 640 },
+  { 420,  33 }
+};
+
+
+static void
+gimp_test_set_n_threads (Gimp *gimp,
+                         gint  n_threads)
+{
+  g_object_set (gimp->config,
+                "num-processors", n_threads,
+                NULL);
+}
+
+/*  creates an image with a single layer of black and white noise, and
+ *  returns the layer's pixels, one gray value per pixel
+ */
+static GimpLayer *
+gimp_test_create_layer (Gimp    *gimp,
+                        guchar **pixels)
+{
+  GimpImage  *image;
+  GimpLayer  *layer;
+  guchar     *rgb;
+  GRand      *rand;
+  gint        i;
+
+  image = gimp_image_new (gimp,
+                          TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT,
+                          GIMP_RGB, GIMP_PRECISION_U8);
+
+  layer = gimp_layer_new (image,
+                          TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT,
+                          babl_format ("R'G'B' u8"),
+                          "Test Layer",
+                          GIMP_OPACITY_OPAQUE,
+                          GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  *pixels = g_new (guchar, TEST_N_PIXELS);
+  rgb     = g_new (guchar, TEST_N_PIXELS * 3);
+  rand    = g_rand_new_with_seed (1);
+
+  for (i = 0; i < TEST_N_PIXELS; i++)
+    {
+      guchar value;
+
+      value = (g_rand_double (rand) < TEST_WHITE_RATIO) ? 255 : 0;
+
+      (*pixels)[i] = value;
+
+      rgb[i * 3 + 0] = value;
+      rgb[i * 3 + 1] = value;
+      rgb[i * 3 + 2] = value;
+    }
+
+  gegl_buffer_set (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
+                   GEGL_RECTANGLE (0, 0, TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT),
+                   0, babl_format ("R'G'B' u8"), rgb,
+                   GEGL_AUTO_ROWSTRIDE);
+
+  g_rand_free (rand);
+  g_free (rgb);
+
+  return layer;
+}
+
+static gfloat *
+gimp_test_get_mask (GeglBuffer *mask_buffer)
+{
+  gfloat *mask = g_new (gfloat, TEST_N_PIXELS);
+
+  gegl_buffer_get (mask_buffer,
+                   GEGL_RECTANGLE (0, 0, TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT),
+                   1.0, babl_format ("Y float"), mask,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  g_object_unref (mask_buffer);
+
+  return mask;
+}
+
+/*  the mask the seed fill always gave with a zero threshold: the
+ *  pixels of the seed's value that are 4-connected to it
+ */
+static gfloat *
+gimp_test_flood_fill (const guchar *pixels,
+                      gint          x,
+                      gint          y)
+{
+  gfloat *mask  = g_new0 (gfloat, TEST_N_PIXELS);
+  gint   *stack = g_new (gint, TEST_N_PIXELS);
+  guchar  value = pixels[y * TEST_IMAGE_WIDTH + x];
+  gint    n     = 0;
+
+  stack[n++] = y * TEST_IMAGE_WIDTH + x;
+  mask[y * TEST_IMAGE_WIDTH + x] = 1.0;
+
+  while (n > 0)
+    {
+      gint i  = stack[--n];
+      gint px = i % TEST_IMAGE_WIDTH;
+      gint py = i / TEST_IMAGE_WIDTH;
+      gint neighbors[4];
+      gint j;
+
+      neighbors[0] = px > 0                     ? i - 1                : -1;
+      neighbors[1] = px < TEST_IMAGE_WIDTH - 1  ? i + 1                : -1;
+      neighbors[2] = py > 0                     ? i - TEST_IMAGE_WIDTH : -1;
+      neighbors[3] = py < TEST_IMAGE_HEIGHT - 1 ? i + TEST_IMAGE_WIDTH : -1;
+
+      for (j = 0; j < 4; j++)
+        {
+          gint k = neighbors[j];
+
+          if (k >= 0 && ! mask[k] && pixels[k] == value)
+            {
+              mask[k] = 1.0;
+              stack[n++] = k;
+            }
+        }
+    }
+
+  g_free (stack);
+
+  return mask;
+}
+
+static void
+gimp_test_assert_same_mask (const gfloat *mask,
+                            const gfloat *reference)
+{
+  gint i;
+
+  for (i = 0; i < TEST_N_PIXELS; i++)
+    {
+      if (mask[i] != reference[i])
+        g_error ("mask differs at %d, %d: %f instead of %f",
+                 i % TEST_IMAGE_WIDTH, i / TEST_IMAGE_WIDTH,
+                 mask[i], reference[i]);
+    }
+}
+
+/**
+ * by_seed_matches_flood_fill:
+ *
+ * Test that the fuzzy select mask, from the layer and from the image,
+ * is the region a plain flood fill finds, for seeds whose regions
+ * span the whole image.
+ **/
+static void
+by_seed_matches_flood_fill (gconstpointer data)
+{
+  Gimp      *gimp  = GIMP (data);
+  guchar    *pixels;
+  GimpLayer *layer = gimp_test_create_layer (gimp, &pixels);
+  GimpImage *image = gimp_item_get_image (GIMP_ITEM (layer));
+  gint       i;
+
+  for (i = 0; i < G_N_ELEMENTS (test_seeds); i++)
+    {
+      gint     x = test_seeds[i][0];
+      gint     y = test_seeds[i][1];
+      gfloat  *reference;
+      gboolean sample_merged;
+
+      reference = gimp_test_flood_fill (pixels, x, y);
+
+      for (sample_merged = FALSE; sample_merged <= TRUE; sample_merged++)
+        {
+          gfloat *mask;
+
+          mask = gimp_test_get_mask (
+            gimp_image_contiguous_region_by_seed (image,
+                                                  GIMP_DRAWABLE (layer),
+                                                  sample_merged,
+                                                  FALSE, 0.0, FALSE,
+                                                  GIMP_SELECT_CRITERION_COMPOSITE,
+                                                  x, y));
+
+          gimp_test_assert_same_mask (mask, reference);
+
+          g_free (mask);
+        }
+
+      g_free (reference);
+    }
+
+  g_free (pixels);
+  g_object_unref (image);
+}
+
+/**
+ * by_color_matches_pixels:
+ *
+ * Test that the select by color mask, from the layer and from the
+ * image, single-threaded and in parallel, selects exactly the pixels
+ * of the color.
+ **/
+static void
+by_color_matches_pixels (gconstpointer data)
+{
+  Gimp      *gimp  = GIMP (data);
+  guchar    *pixels;
+  GimpLayer *layer = gimp_test_create_layer (gimp, &pixels);
+  GimpImage *image = gimp_item_get_image (GIMP_ITEM (layer));
+  gfloat    *reference;
+  GimpRGB    white;
+  gint       n_processors;
+  gint       n_threads;
+  gint       i;
+
+  g_object_get (gimp->config,
+                "num-processors", &n_processors,
+                NULL);
+
+  gimp_rgba_set (&white, 1.0, 1.0, 1.0, GIMP_OPACITY_OPAQUE);
+
+  reference = g_new (gfloat, TEST_N_PIXELS);
+
+  for (i = 0; i < TEST_N_PIXELS; i++)
+    reference[i] = (pixels[i] == 255) ? 1.0 : 0.0;
+
+  for (n_threads = 1; n_threads <= TEST_N_THREADS; n_threads *= TEST_N_THREADS)
+    {
+      gboolean sample_merged;
+
+      gimp_test_set_n_threads (gimp, n_threads);
+
+      for (sample_merged = FALSE; sample_merged <= TRUE; sample_merged++)
+        {
+          gfloat *mask;
+
+          /*  start from a projection that still has to be rendered  */
+          gimp_drawable_update (GIMP_DRAWABLE (layer),
+                                0, 0, TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT);
+
+          mask = gimp_test_get_mask (
+            gimp_image_contiguous_region_by_color (image,
+                                                   GIMP_DRAWABLE (layer),
+                                                   sample_merged,
+                                                   FALSE, 0.0, FALSE,
+                                                   GIMP_SELECT_CRITERION_COMPOSITE,
+                                                   &white));
+
+          gimp_test_assert_same_mask (mask, reference);
+
+          g_free (mask);
+        }
+    }
+
+  gimp_test_set_n_threads (gimp, n_processors);
+
+  g_free (reference);
+  g_free (pixels);
+  g_object_unref (image);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (by_seed_matches_flood_fill);
+  ADD_TEST (by_color_matches_pixels);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
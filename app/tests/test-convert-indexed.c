@@ -0,0 +1,295 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpimage.h"
+#include "core/gimpimage-colormap.h"
+#include "core/gimpimage-convert-type.h"
+#include "core/gimpimage-duplicate.h"
+#include "core/gimplayer.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+/*  large enough that the histogram pass is split into several bands,
+ *  and not a multiple of the tile height
+ */
+#define TEST_IMAGE_WIDTH  1024
+#define TEST_IMAGE_HEIGHT 1030
+
+#define TEST_N_THREADS    4
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-convert-indexed/" #function, gimp, function);
+
+
+typedef struct
+{
+  guchar *pixels;
+  gsize   size;
+  guchar *colormap;
+  gint    n_colors;
+} ConvertResult;
+
+
+/*  smooth gradients with noise and a soft alpha edge, or only
+ *  @n_colors distinct colors if that is > 0
+ */
+static GimpImage *
+gimp_test_create_image (Gimp *gimp,
+                        gint  n_colors)
+{
+  GimpImage  *image;
+  GimpLayer  *layer;
+  GeglBuffer *buffer;
+  guchar     *row;
+  GRand      *rand;
+  gint        x, y;
+
+  image = gimp_image_new (gimp,
+                          TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT,
+                          GIMP_RGB, GIMP_PRECISION_U8);
+
+  layer = gimp_layer_new (image,
+                          TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT,
+                          babl_format ("R'G'B'A u8"),
+                          "Test Layer",
+                          GIMP_OPACITY_OPAQUE,
+                          GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  row    = g_new (guchar, TEST_IMAGE_WIDTH * 4);
+  rand   = g_rand_new_with_seed (1);
+
+  for (y = 0; y < TEST_IMAGE_HEIGHT; y++)
+    {
+      for (x = 0; x < TEST_IMAGE_WIDTH; x++)
+        {
+          if (n_colors > 0)
+            {
+              gint c = (x / 37 + y / 41) % n_colors;
+
+              row[x * 4 + 0] = c * 255 / n_colors;
+              row[x * 4 + 1] = 255 - c * 255 / n_colors;
+              row[x * 4 + 2] = (c * 97) & 0xff;
+              row[x * 4 + 3] = 255;
+            }
+          else
+            {
+              gint noise = g_rand_int_range (rand, -8, 9);
+
+              row[x * 4 + 0] = CLAMP (x * 255 / TEST_IMAGE_WIDTH + noise,
+                                      0, 255);
+              row[x * 4 + 1] = CLAMP (y * 255 / TEST_IMAGE_HEIGHT + noise,
+                                      0, 255);
+              row[x * 4 + 2] = CLAMP (128 + 127 * sin (x * 0.01 + y * 0.013) +
+                                      noise, 0, 255);
+              row[x * 4 + 3] = MIN (x, 255);
+            }
+        }
+
+      gegl_buffer_set (buffer,
+                       GEGL_RECTANGLE (0, y, TEST_IMAGE_WIDTH, 1), 0,
+                       babl_format ("R'G'B'A u8"), row,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_rand_free (rand);
+  g_free (row);
+
+  return image;
+}
+
+/*  converts a copy of @image with @n_threads processors configured
+ *  and returns the indices and colormap
+ */
+static void
+gimp_test_convert (GimpImage              *image,
+                   gint                    n_threads,
+                   GimpConvertPaletteType  palette_type,
+                   GimpConvertDitherType   dither_type,
+                   ConvertResult          *result)
+{
+  Gimp         *gimp = image->gimp;
+  GimpImage    *copy;
+  GimpDrawable *drawable;
+  GeglBuffer   *buffer;
+  const Babl   *format;
+
+  g_object_set (gimp->config,
+                "num-processors", n_threads,
+                NULL);
+
+  copy = gimp_image_duplicate (image);
+
+  gimp_image_convert_type (copy, GIMP_INDEXED,
+                           256, dither_type,
+                           FALSE, FALSE, FALSE,
+                           palette_type, NULL,
+                           NULL, NULL);
+
+  g_assert_cmpint (gimp_image_get_base_type (copy), ==, GIMP_INDEXED);
+
+  drawable = GIMP_DRAWABLE (gimp_image_get_active_layer (copy));
+  buffer   = gimp_drawable_get_buffer (drawable);
+  format   = gegl_buffer_get_format (buffer);
+
+  result->size   = (TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT *
+                    babl_format_get_bytes_per_pixel (format));
+  result->pixels = g_malloc (result->size);
+
+  gegl_buffer_get (buffer, NULL, 1.0, format, result->pixels,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  result->n_colors = gimp_image_get_colormap_size (copy);
+  result->colormap = g_memdup (gimp_image_get_colormap (copy),
+                               result->n_colors * 3);
+
+  g_object_unref (copy);
+}
+
+/*  the result with TEST_N_THREADS processors must be the same as the
+ *  result with only one
+ */
+static void
+gimp_test_convert_compare (Gimp                   *gimp,
+                           gint                    n_colors,
+                           GimpConvertPaletteType  palette_type,
+                           GimpConvertDitherType   dither_type)
+{
+  GimpImage     *image = gimp_test_create_image (gimp, n_colors);
+  ConvertResult  serial;
+  ConvertResult  parallel;
+  gint           n_processors;
+
+  g_object_get (gimp->config,
+                "num-processors", &n_processors,
+                NULL);
+
+  gimp_test_convert (image, 1, palette_type, dither_type, &serial);
+  gimp_test_convert (image, TEST_N_THREADS, palette_type, dither_type,
+                     &parallel);
+
+  g_object_set (gimp->config,
+                "num-processors", n_processors,
+                NULL);
+
+  g_assert_cmpint (serial.n_colors, ==, parallel.n_colors);
+  g_assert (memcmp (serial.colormap, parallel.colormap,
+                    serial.n_colors * 3) == 0);
+
+  g_assert_cmpuint (serial.size, ==, parallel.size);
+  g_assert (memcmp (serial.pixels, parallel.pixels, serial.size) == 0);
+
+  g_free (serial.pixels);
+  g_free (serial.colormap);
+  g_free (parallel.pixels);
+  g_free (parallel.colormap);
+
+  g_object_unref (image);
+}
+
+static void
+make_palette_no_dither (gconstpointer data)
+{
+  gimp_test_convert_compare (GIMP (data), 0,
+                             GIMP_MAKE_PALETTE, GIMP_NO_DITHER);
+}
+
+static void
+make_palette_fs_dither (gconstpointer data)
+{
+  gimp_test_convert_compare (GIMP (data), 0,
+                             GIMP_MAKE_PALETTE, GIMP_FS_DITHER);
+}
+
+static void
+make_palette_fixed_dither (gconstpointer data)
+{
+  gimp_test_convert_compare (GIMP (data), 0,
+                             GIMP_MAKE_PALETTE, GIMP_FIXED_DITHER);
+}
+
+static void
+make_palette_blue_noise_dither (gconstpointer data)
+{
+  gimp_test_convert_compare (GIMP (data), 0,
+                             GIMP_MAKE_PALETTE, GIMP_BLUE_NOISE_DITHER);
+}
+
+static void
+make_palette_few_colors (gconstpointer data)
+{
+  gimp_test_convert_compare (GIMP (data), 16,
+                             GIMP_MAKE_PALETTE, GIMP_NO_DITHER);
+}
+
+static void
+web_palette_fixed_dither (gconstpointer data)
+{
+  gimp_test_convert_compare (GIMP (data), 0,
+                             GIMP_WEB_PALETTE, GIMP_FIXED_DITHER);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (make_palette_no_dither);
+  ADD_TEST (make_palette_fs_dither);
+  ADD_TEST (make_palette_fixed_dither);
+  ADD_TEST (make_palette_blue_noise_dither);
+  ADD_TEST (make_palette_few_colors);
+  ADD_TEST (web_palette_fixed_dither);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
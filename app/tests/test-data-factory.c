@@ -0,0 +1,261 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpcontainer.h"
+#include "core/gimpdata.h"
+#include "core/gimpdatafactory.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define TEST_N_THREADS 4
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-data-factory/" #function, gimp, function);
+
+
+typedef struct
+{
+  gchar  *name;
+  gchar  *filename;
+  gint64  memsize;
+} DataEntry;
+
+
+static void
+gimp_test_set_n_threads (Gimp *gimp,
+                         gint  n_threads)
+{
+  g_object_set (gimp->config,
+                "num-processors", n_threads,
+                NULL);
+}
+
+static void
+gimp_test_data_entry_free (DataEntry *entry)
+{
+  g_free (entry->name);
+  g_free (entry->filename);
+  g_slice_free (DataEntry, entry);
+}
+
+/*  loads the data of @factory from @dirname in the source tree and
+ *  returns what was loaded, in the container's order
+ */
+static GPtrArray *
+gimp_test_load_data (Gimp            *gimp,
+                     GimpDataFactory *factory,
+                     const gchar     *path_property_name,
+                     const gchar     *dirname,
+                     gint             n_threads)
+{
+  GimpContainer *container = gimp_data_factory_get_container (factory);
+  GPtrArray     *entries;
+  gchar         *path;
+  gint           i;
+
+  path = g_build_filename (g_getenv ("GIMP_TESTING_ABS_TOP_SRCDIR"),
+                           "data", dirname, NULL);
+
+  g_object_set (gimp->config,
+                path_property_name, path,
+                NULL);
+
+  g_free (path);
+
+  gimp_test_set_n_threads (gimp, n_threads);
+
+  gimp_data_factory_data_init (factory, gimp_get_user_context (gimp), FALSE);
+
+  entries = g_ptr_array_new_with_free_func ((GDestroyNotify)
+                                            gimp_test_data_entry_free);
+
+  for (i = 0; i < gimp_container_get_n_children (container); i++)
+    {
+      GimpData  *data  = GIMP_DATA (gimp_container_get_child_by_index (container,
+                                                                       i));
+      DataEntry *entry = g_slice_new (DataEntry);
+
+      entry->name     = g_strdup (gimp_object_get_name (data));
+      entry->filename = g_strdup (gimp_data_get_filename (data));
+      entry->memsize  = gimp_object_get_memsize (GIMP_OBJECT (data), NULL);
+
+      g_ptr_array_add (entries, entry);
+    }
+
+  gimp_data_factory_data_free (factory);
+
+  return entries;
+}
+
+static void
+gimp_test_assert_same_data (GPtrArray *entries,
+                            GPtrArray *reference)
+{
+  gint i;
+
+  g_assert_cmpint (entries->len, ==, reference->len);
+
+  for (i = 0; i < reference->len; i++)
+    {
+      DataEntry *entry     = g_ptr_array_index (entries,   i);
+      DataEntry *ref_entry = g_ptr_array_index (reference, i);
+
+      g_assert_cmpstr (entry->name,     ==, ref_entry->name);
+      g_assert_cmpstr (entry->filename, ==, ref_entry->filename);
+      g_assert_cmpint (entry->memsize,  ==, ref_entry->memsize);
+    }
+}
+
+/*  loads a data directory single-threaded, then twice in parallel,
+ *  and checks that the same data is loaded in the same order each
+ *  time
+ */
+static void
+gimp_test_load_twice (Gimp            *gimp,
+                      GimpDataFactory *factory,
+                      const gchar     *path_property_name,
+                      const gchar     *dirname)
+{
+  GPtrArray *reference;
+  GPtrArray *entries;
+  gint       n_processors;
+  gint       i;
+
+  g_object_get (gimp->config,
+                "num-processors", &n_processors,
+                NULL);
+
+  reference = gimp_test_load_data (gimp, factory, path_property_name,
+                                   dirname, 1);
+
+  /*  something must have been loaded besides the standard data  */
+  g_assert_cmpint (reference->len, >, 1);
+
+  for (i = 0; i < 2; i++)
+    {
+      entries = gimp_test_load_data (gimp, factory, path_property_name,
+                                     dirname, TEST_N_THREADS);
+
+      gimp_test_assert_same_data (entries, reference);
+
+      g_ptr_array_free (entries, TRUE);
+    }
+
+  g_ptr_array_free (reference, TRUE);
+
+  gimp_test_set_n_threads (gimp, n_processors);
+}
+
+/**
+ * brushes_load_twice:
+ *
+ * Test that loading the brushes in parallel gives the same brushes
+ * in the same order as loading them single-threaded, each time.
+ **/
+static void
+brushes_load_twice (gconstpointer data)
+{
+  Gimp *gimp = GIMP (data);
+
+  gimp_test_load_twice (gimp, gimp->brush_factory, "brush-path", "brushes");
+}
+
+/**
+ * patterns_load_twice:
+ *
+ * Like brushes_load_twice(), for patterns.
+ **/
+static void
+patterns_load_twice (gconstpointer data)
+{
+  Gimp *gimp = GIMP (data);
+
+  gimp_test_load_twice (gimp, gimp->pattern_factory, "pattern-path", "patterns");
+}
+
+/**
+ * gradients_load_twice:
+ *
+ * Like brushes_load_twice(), for gradients.
+ **/
+static void
+gradients_load_twice (gconstpointer data)
+{
+  Gimp *gimp = GIMP (data);
+
+  gimp_test_load_twice (gimp, gimp->gradient_factory, "gradient-path", "gradients");
+}
+
+/**
+ * palettes_load_twice:
+ *
+ * Like brushes_load_twice(), for palettes, which are parsed in the
+ * main thread.
+ **/
+static void
+palettes_load_twice (gconstpointer data)
+{
+  Gimp *gimp = GIMP (data);
+
+  gimp_test_load_twice (gimp, gimp->palette_factory, "palette-path", "palettes");
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (brushes_load_twice);
+  ADD_TEST (patterns_load_twice);
+  ADD_TEST (gradients_load_twice);
+  ADD_TEST (palettes_load_twice);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
@@ -0,0 +1,274 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+
+#include "paint/gimpheal-laplace.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define TEST_DEPTH        4
+
+/*  small enough for the SOR solver to converge  */
+#define TEST_SMALL_WIDTH  37
+#define TEST_SMALL_HEIGHT 29
+
+/*  large enough for the multigrid solver to run in parallel  */
+#define TEST_LARGE_SIZE   300
+
+#define TEST_N_THREADS    4
+
+#define MAX_DIFFERENCE    1e-3
+#define MAX_RESIDUAL      1e-3
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-heal/" #function, gimp, function);
+
+
+/*  a masked elliptic patch with a hole, on a smooth difference
+ *  between image and pattern with some noise
+ */
+static void
+gimp_test_create_problem (gint     width,
+                          gint     height,
+                          gfloat  *matrix,
+                          guchar  *mask)
+{
+  GRand   *rand = g_rand_new_with_seed (width * height);
+  gdouble  rx   = width  / 2.0;
+  gdouble  ry   = height / 2.0;
+  gint     x, y, k;
+
+  for (y = 0; y < height; y++)
+    {
+      for (x = 0; x < width; x++)
+        {
+          gdouble dx = (x + 0.5 - rx) / rx;
+          gdouble dy = (y + 0.5 - ry) / ry;
+          gdouble d  = dx * dx + dy * dy;
+
+          mask[y * width + x] = (d < 1.0 && d > 0.04) ? 255 : 0;
+
+          for (k = 0; k < TEST_DEPTH; k++)
+            {
+              matrix[(y * width + x) * TEST_DEPTH + k] =
+                0.5 * sin (x * 0.1 * (k + 1)) * cos (y * 0.07) +
+                g_rand_double_range (rand, -0.05, 0.05);
+            }
+        }
+    }
+
+  g_rand_free (rand);
+}
+
+static gdouble
+gimp_test_max_residual (const gfloat *matrix,
+                        const guchar *mask,
+                        gint          width,
+                        gint          height)
+{
+  const gint stride   = width * TEST_DEPTH;
+  gdouble    residual = 0.0;
+  gint       x, y, k;
+
+  for (y = 1; y < height - 1; y++)
+    {
+      for (x = 1; x < width - 1; x++)
+        {
+          const gfloat *p = matrix + y * stride + x * TEST_DEPTH;
+
+          if (! mask[y * width + x])
+            continue;
+
+          for (k = 0; k < TEST_DEPTH; k++)
+            {
+              gdouble r = (p[k - TEST_DEPTH] + p[k + TEST_DEPTH] +
+                           p[k - stride]     + p[k + stride]     -
+                           4.0 * p[k]);
+
+              residual = MAX (residual, fabs (r));
+            }
+        }
+    }
+
+  return residual;
+}
+
+static void
+gimp_test_set_n_threads (Gimp *gimp,
+                         gint  n_threads)
+{
+  g_object_set (gimp->config,
+                "num-processors", n_threads,
+                NULL);
+}
+
+/**
+ * multigrid_matches_sor:
+ *
+ * Test that the multigrid solver converges to within tolerance of
+ * the converged SOR solution on a masked patch, and that it keeps
+ * the pixels outside of the mask.
+ **/
+static void
+multigrid_matches_sor (gconstpointer data)
+{
+  Gimp   *gimp = GIMP (data);
+  gsize   size = TEST_SMALL_WIDTH * TEST_SMALL_HEIGHT * TEST_DEPTH;
+  gfloat *original;
+  gfloat *sor;
+  gfloat *mg;
+  guchar *mask;
+  gdouble difference = 0.0;
+  gint    iterations;
+  gsize   i;
+
+  original = g_new (gfloat, size);
+  sor      = g_new (gfloat, size);
+  mg       = g_new (gfloat, size);
+  mask     = g_new (guchar, TEST_SMALL_WIDTH * TEST_SMALL_HEIGHT);
+
+  gimp_test_create_problem (TEST_SMALL_WIDTH, TEST_SMALL_HEIGHT,
+                            original, mask);
+
+  memcpy (sor, original, size * sizeof (gfloat));
+  memcpy (mg,  original, size * sizeof (gfloat));
+
+  iterations = gimp_heal_laplace_sor (sor,
+                                      TEST_SMALL_WIDTH, TEST_SMALL_HEIGHT,
+                                      TEST_DEPTH, mask);
+
+  /*  SOR gives up after 500 iterations, it must have converged  */
+  g_assert_cmpint (iterations, <, 500);
+
+  gimp_heal_laplace_multigrid (gimp, mg,
+                               TEST_SMALL_WIDTH, TEST_SMALL_HEIGHT,
+                               TEST_DEPTH, mask);
+
+  for (i = 0; i < size; i++)
+    {
+      if (! mask[i / TEST_DEPTH])
+        g_assert (mg[i] == original[i]);
+
+      difference = MAX (difference, fabs (mg[i] - sor[i]));
+    }
+
+  g_assert_cmpfloat (difference, <=, MAX_DIFFERENCE);
+
+  g_free (original);
+  g_free (sor);
+  g_free (mg);
+  g_free (mask);
+}
+
+/**
+ * multigrid_parallel:
+ *
+ * Test that the multigrid solver converges on a patch large enough
+ * to be solved in parallel, and that the number of threads doesn't
+ * change the result.
+ **/
+static void
+multigrid_parallel (gconstpointer data)
+{
+  Gimp   *gimp = GIMP (data);
+  gsize   size = TEST_LARGE_SIZE * TEST_LARGE_SIZE * TEST_DEPTH;
+  gfloat *serial;
+  gfloat *parallel;
+  guchar *mask;
+  gint    n_processors;
+
+  serial   = g_new (gfloat, size);
+  parallel = g_new (gfloat, size);
+  mask     = g_new (guchar, TEST_LARGE_SIZE * TEST_LARGE_SIZE);
+
+  gimp_test_create_problem (TEST_LARGE_SIZE, TEST_LARGE_SIZE, serial, mask);
+  memcpy (parallel, serial, size * sizeof (gfloat));
+
+  g_object_get (gimp->config,
+                "num-processors", &n_processors,
+                NULL);
+
+  gimp_test_set_n_threads (gimp, 1);
+  gimp_heal_laplace_multigrid (gimp, serial,
+                               TEST_LARGE_SIZE, TEST_LARGE_SIZE,
+                               TEST_DEPTH, mask);
+
+  gimp_test_set_n_threads (gimp, TEST_N_THREADS);
+  gimp_heal_laplace_multigrid (gimp, parallel,
+                               TEST_LARGE_SIZE, TEST_LARGE_SIZE,
+                               TEST_DEPTH, mask);
+
+  gimp_test_set_n_threads (gimp, n_processors);
+
+  g_assert_cmpfloat (gimp_test_max_residual (serial, mask,
+                                             TEST_LARGE_SIZE,
+                                             TEST_LARGE_SIZE),
+                     <=, MAX_RESIDUAL);
+
+  g_assert (memcmp (serial, parallel, size * sizeof (gfloat)) == 0);
+
+  g_free (serial);
+  g_free (parallel);
+  g_free (mask);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (multigrid_matches_sor);
+  ADD_TEST (multigrid_parallel);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
@@ -0,0 +1,435 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimphistogram.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+/*  large enough to be split into several blocks, and not a multiple
+ *  of the block size
+ */
+#define TEST_WIDTH      1000
+#define TEST_HEIGHT     900
+
+#define TEST_N_THREADS  4
+
+#define HIGH_PRECISION_BINS 1024
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-histogram/" #function, gimp, function);
+
+
+/*  the values of an R'G'B' histogram, counted directly from @bins,
+ *  which holds the bin of each component of each pixel
+ */
+static gdouble *
+gimp_test_count_bins (const gint *bins,
+                      gint        n_pixels,
+                      gint        n_bins)
+{
+  gdouble *values = g_new0 (gdouble, 4 * n_bins);
+  gint     i;
+
+  for (i = 0; i < n_pixels; i++)
+    {
+      const gint *pixel = bins + i * 3;
+
+      values[GIMP_HISTOGRAM_RED   * n_bins + pixel[0]] += 1.0;
+      values[GIMP_HISTOGRAM_GREEN * n_bins + pixel[1]] += 1.0;
+      values[GIMP_HISTOGRAM_BLUE  * n_bins + pixel[2]] += 1.0;
+      values[GIMP_HISTOGRAM_VALUE * n_bins +
+             MAX (pixel[0], MAX (pixel[1], pixel[2]))] += 1.0;
+    }
+
+  return values;
+}
+
+/*  an R'G'B' u8 noise buffer, returns the bins of its pixels  */
+static GeglBuffer *
+gimp_test_create_u8_buffer (gint **bins)
+{
+  GeglBuffer *buffer;
+  guchar     *pixels;
+  GRand      *rand = g_rand_new_with_seed (1);
+  gint        i;
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, TEST_WIDTH, TEST_HEIGHT),
+                            babl_format ("R'G'B' u8"));
+
+  pixels = g_new (guchar, TEST_WIDTH * TEST_HEIGHT * 3);
+  *bins  = g_new (gint, TEST_WIDTH * TEST_HEIGHT * 3);
+
+  for (i = 0; i < TEST_WIDTH * TEST_HEIGHT * 3; i++)
+    {
+      pixels[i] = g_rand_int_range (rand, 0, 256);
+      (*bins)[i] = pixels[i];
+    }
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("R'G'B' u8"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (pixels);
+  g_rand_free (rand);
+
+  return buffer;
+}
+
+/*  an R'G'B'A u8 noise buffer and a soft mask for it  */
+static void
+gimp_test_create_masked_buffer (GeglBuffer **buffer,
+                                GeglBuffer **mask)
+{
+  guchar *pixels;
+  gfloat *mask_pixels;
+  GRand  *rand = g_rand_new_with_seed (2);
+  gint    x, y;
+  gint    i;
+
+  *buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, TEST_WIDTH, TEST_HEIGHT),
+                             babl_format ("R'G'B'A u8"));
+  *mask   = gegl_buffer_new (GEGL_RECTANGLE (0, 0, TEST_WIDTH, TEST_HEIGHT),
+                             babl_format ("Y float"));
+
+  pixels      = g_new (guchar, TEST_WIDTH * TEST_HEIGHT * 4);
+  mask_pixels = g_new (gfloat, TEST_WIDTH * TEST_HEIGHT);
+
+  for (i = 0; i < TEST_WIDTH * TEST_HEIGHT * 4; i++)
+    pixels[i] = g_rand_int_range (rand, 0, 256);
+
+  for (y = 0; y < TEST_HEIGHT; y++)
+    for (x = 0; x < TEST_WIDTH; x++)
+      mask_pixels[y * TEST_WIDTH + x] = (gfloat) ((x + y) % 64) / 63.0;
+
+  gegl_buffer_set (*buffer, NULL, 0, babl_format ("R'G'B'A u8"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+  gegl_buffer_set (*mask, NULL, 0, babl_format ("Y float"),
+                   mask_pixels, GEGL_AUTO_ROWSTRIDE);
+
+  g_free (pixels);
+  g_free (mask_pixels);
+  g_rand_free (rand);
+}
+
+static void
+gimp_test_set_n_threads (Gimp *gimp,
+                         gint  n_threads)
+{
+  g_object_set (gimp->config,
+                "num-processors", n_threads,
+                NULL);
+}
+
+/*  a single-threaded, non-incremental calculation  */
+static GimpHistogram *
+gimp_test_calculate_full (GeglBuffer *buffer,
+                          GeglBuffer *mask,
+                          gboolean    high_precision)
+{
+  GimpHistogram *histogram = gimp_histogram_new_full (high_precision, FALSE);
+
+  gimp_histogram_calculate (histogram, NULL,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            mask, mask ? gegl_buffer_get_extent (mask) : NULL);
+
+  return histogram;
+}
+
+static void
+gimp_test_assert_equal (GimpHistogram *histogram,
+                        GimpHistogram *reference)
+{
+  gint n_channels = gimp_histogram_n_channels (reference);
+  gint n_bins     = gimp_histogram_n_bins (reference);
+  gint c, i;
+
+  g_assert_cmpint (gimp_histogram_n_channels (histogram), ==, n_channels);
+  g_assert_cmpint (gimp_histogram_n_bins (histogram),     ==, n_bins);
+
+  for (c = 0; c < n_channels; c++)
+    for (i = 0; i < n_bins; i++)
+      g_assert_cmpfloat (gimp_histogram_get_value (histogram, c, i), ==,
+                         gimp_histogram_get_value (reference, c, i));
+}
+
+static void
+gimp_test_assert_values (GimpHistogram *histogram,
+                         const gdouble *values,
+                         gint           n_bins)
+{
+  gint c, i;
+
+  g_assert_cmpint (gimp_histogram_n_bins (histogram), ==, n_bins);
+
+  for (c = GIMP_HISTOGRAM_VALUE; c <= GIMP_HISTOGRAM_BLUE; c++)
+    for (i = 0; i < n_bins; i++)
+      g_assert_cmpfloat (gimp_histogram_get_value (histogram, c, i), ==,
+                         values[c * n_bins + i]);
+}
+
+/**
+ * full_matches_count:
+ *
+ * Test that a single-threaded calculation counts exactly the pixels
+ * of the buffer.
+ **/
+static void
+full_matches_count (gconstpointer data)
+{
+  GeglBuffer    *buffer;
+  GimpHistogram *histogram;
+  gint          *bins;
+  gdouble       *values;
+
+  buffer = gimp_test_create_u8_buffer (&bins);
+  values = gimp_test_count_bins (bins, TEST_WIDTH * TEST_HEIGHT, 256);
+
+  histogram = gimp_test_calculate_full (buffer, NULL, FALSE);
+
+  gimp_test_assert_values (histogram, values, 256);
+
+  gimp_histogram_unref (histogram);
+  g_free (values);
+  g_free (bins);
+  g_object_unref (buffer);
+}
+
+/**
+ * parallel_matches_full:
+ *
+ * Test that calculating in parallel, with and without a mask, gives
+ * exactly the single-threaded result.
+ **/
+static void
+parallel_matches_full (gconstpointer data)
+{
+  Gimp          *gimp = GIMP (data);
+  GeglBuffer    *buffer;
+  GeglBuffer    *mask;
+  GimpHistogram *reference;
+  GimpHistogram *histogram;
+  gint           n_processors;
+
+  g_object_get (gimp->config,
+                "num-processors", &n_processors,
+                NULL);
+
+  gimp_test_set_n_threads (gimp, TEST_N_THREADS);
+
+  gimp_test_create_masked_buffer (&buffer, &mask);
+
+  /*  without a mask  */
+  reference = gimp_test_calculate_full (buffer, NULL, FALSE);
+  histogram = gimp_histogram_new ();
+
+  gimp_histogram_calculate (histogram, gimp,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            NULL, NULL);
+
+  gimp_test_assert_equal (histogram, reference);
+
+  gimp_histogram_unref (histogram);
+  gimp_histogram_unref (reference);
+
+  /*  with a mask  */
+  reference = gimp_test_calculate_full (buffer, mask, FALSE);
+  histogram = gimp_histogram_new ();
+
+  gimp_histogram_calculate (histogram, gimp,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            mask, gegl_buffer_get_extent (mask));
+
+  gimp_test_assert_equal (histogram, reference);
+
+  gimp_histogram_unref (histogram);
+  gimp_histogram_unref (reference);
+
+  gimp_test_set_n_threads (gimp, n_processors);
+
+  g_object_unref (buffer);
+  g_object_unref (mask);
+}
+
+/**
+ * incremental_matches_full:
+ *
+ * Test that an incremental histogram which is told about changed
+ * areas gives exactly the result of calculating everything again.
+ **/
+static void
+incremental_matches_full (gconstpointer data)
+{
+  Gimp          *gimp = GIMP (data);
+  GeglBuffer    *buffer;
+  GeglBuffer    *mask;
+  GimpHistogram *histogram;
+  GimpHistogram *reference;
+  const GeglRectangle changes[] =
+  {
+    { 10,  20,  30,  40 },   /*  inside one block             */
+    { 200, 200, 400, 300 },  /*  across several blocks        */
+    { 990, 890, 50,  50 }    /*  partly outside of the buffer */
+  };
+  GeglColor     *color;
+  gint           i;
+
+  gimp_test_create_masked_buffer (&buffer, &mask);
+
+  histogram = gimp_histogram_new_full (FALSE, TRUE);
+
+  gimp_histogram_calculate (histogram, gimp,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            mask, gegl_buffer_get_extent (mask));
+
+  color = gegl_color_new (NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (changes); i++)
+    {
+      gegl_color_set_rgba (color, 0.1 * i, 0.5, 1.0 - 0.2 * i, 0.7);
+      gegl_buffer_set_color (buffer, &changes[i], color);
+
+      gimp_histogram_invalidate (histogram, &changes[i]);
+
+      gimp_histogram_calculate (histogram, gimp,
+                                buffer, gegl_buffer_get_extent (buffer),
+                                mask, gegl_buffer_get_extent (mask));
+
+      reference = gimp_test_calculate_full (buffer, mask, FALSE);
+
+      gimp_test_assert_equal (histogram, reference);
+
+      gimp_histogram_unref (reference);
+    }
+
+  g_object_unref (color);
+
+  gimp_histogram_unref (histogram);
+
+  g_object_unref (buffer);
+  g_object_unref (mask);
+}
+
+/**
+ * high_precision_matches_count:
+ *
+ * Test that a high precision histogram of a float buffer counts
+ * exactly the pixels in its 1024 bins, single-threaded and in
+ * parallel.
+ **/
+static void
+high_precision_matches_count (gconstpointer data)
+{
+  Gimp          *gimp = GIMP (data);
+  GeglBuffer    *buffer;
+  GimpHistogram *histogram;
+  gfloat        *pixels;
+  gint          *bins;
+  gdouble       *values;
+  GRand         *rand = g_rand_new_with_seed (3);
+  gint           i;
+
+  buffer = gegl_buffer_new (GEGL_RECTANGLE (0, 0, TEST_WIDTH, TEST_HEIGHT),
+                            babl_format ("R'G'B' float"));
+
+  pixels = g_new (gfloat, TEST_WIDTH * TEST_HEIGHT * 3);
+  bins   = g_new (gint,   TEST_WIDTH * TEST_HEIGHT * 3);
+
+  for (i = 0; i < TEST_WIDTH * TEST_HEIGHT * 3; i++)
+    {
+      bins[i]   = g_rand_int_range (rand, 0, HIGH_PRECISION_BINS);
+      pixels[i] = (gfloat) bins[i] / (HIGH_PRECISION_BINS - 1);
+    }
+
+  gegl_buffer_set (buffer, NULL, 0, babl_format ("R'G'B' float"),
+                   pixels, GEGL_AUTO_ROWSTRIDE);
+
+  values = gimp_test_count_bins (bins, TEST_WIDTH * TEST_HEIGHT,
+                                 HIGH_PRECISION_BINS);
+
+  histogram = gimp_test_calculate_full (buffer, NULL, TRUE);
+  gimp_test_assert_values (histogram, values, HIGH_PRECISION_BINS);
+  gimp_histogram_unref (histogram);
+
+  histogram = gimp_histogram_new_full (TRUE, FALSE);
+  gimp_histogram_calculate (histogram, gimp,
+                            buffer, gegl_buffer_get_extent (buffer),
+                            NULL, NULL);
+  gimp_test_assert_values (histogram, values, HIGH_PRECISION_BINS);
+  gimp_histogram_unref (histogram);
+
+  /*  without high precision, the same buffer has 256 bins  */
+  histogram = gimp_test_calculate_full (buffer, NULL, FALSE);
+  g_assert_cmpint (gimp_histogram_n_bins (histogram), ==, 256);
+  g_assert_cmpfloat (gimp_histogram_get_count (histogram,
+                                               GIMP_HISTOGRAM_RED, 0, 255),
+                     ==, TEST_WIDTH * TEST_HEIGHT);
+  gimp_histogram_unref (histogram);
+
+  g_free (values);
+  g_free (bins);
+  g_free (pixels);
+  g_rand_free (rand);
+  g_object_unref (buffer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (full_matches_count);
+  ADD_TEST (parallel_matches_full);
+  ADD_TEST (incremental_matches_full);
+  ADD_TEST (high_precision_matches_count);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
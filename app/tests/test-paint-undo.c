@@ -0,0 +1,294 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+#include "libgimpmath/gimpmath.h"
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimpcontainer.h"
+#include "core/gimpcontext.h"
+#include "core/gimpdrawableundo.h"
+#include "core/gimpimage.h"
+#include "core/gimpimage-undo.h"
+#include "core/gimplayer.h"
+#include "core/gimppaintinfo.h"
+#include "core/gimpundostack.h"
+
+#include "paint/gimppaintcore.h"
+#include "paint/gimppaintcore-stroke.h"
+#include "paint/gimppaintoptions.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define TEST_IMAGE_SIZE  1000
+
+/*  a horizontal stroke across the middle of the image  */
+#define TEST_STROKE_X1   100
+#define TEST_STROKE_X2   900
+#define TEST_STROKE_Y    500
+#define TEST_BRUSH_SIZE  20
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-paint-undo/" #function, gimp, function);
+
+
+static GimpLayer *
+gimp_test_create_layer (Gimp *gimp)
+{
+  GimpImage  *image;
+  GimpLayer  *layer;
+  GeglBuffer *buffer;
+  guchar     *row;
+  GRand      *rand;
+  gint        x, y;
+
+  image = gimp_image_new (gimp,
+                          TEST_IMAGE_SIZE, TEST_IMAGE_SIZE,
+                          GIMP_RGB, GIMP_PRECISION_U8);
+
+  layer = gimp_layer_new (image,
+                          TEST_IMAGE_SIZE, TEST_IMAGE_SIZE,
+                          babl_format ("R'G'B'A u8"),
+                          "Test Layer",
+                          GIMP_OPACITY_OPAQUE,
+                          GIMP_NORMAL_MODE);
+
+  gimp_image_add_layer (image, layer, GIMP_IMAGE_ACTIVE_PARENT, 0, FALSE);
+
+  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  row    = g_new (guchar, TEST_IMAGE_SIZE * 4);
+  rand   = g_rand_new_with_seed (1);
+
+  for (y = 0; y < TEST_IMAGE_SIZE; y++)
+    {
+      for (x = 0; x < TEST_IMAGE_SIZE * 4; x++)
+        row[x] = g_rand_int_range (rand, 0, 256);
+
+      gegl_buffer_set (buffer,
+                       GEGL_RECTANGLE (0, y, TEST_IMAGE_SIZE, 1), 0,
+                       babl_format ("R'G'B'A u8"), row,
+                       GEGL_AUTO_ROWSTRIDE);
+    }
+
+  g_rand_free (rand);
+  g_free (row);
+
+  return layer;
+}
+
+static guchar *
+gimp_test_get_pixels (GimpLayer *layer)
+{
+  guchar *pixels = g_new (guchar, TEST_IMAGE_SIZE * TEST_IMAGE_SIZE * 4);
+
+  gegl_buffer_get (gimp_drawable_get_buffer (GIMP_DRAWABLE (layer)),
+                   GEGL_RECTANGLE (0, 0, TEST_IMAGE_SIZE, TEST_IMAGE_SIZE),
+                   1.0, babl_format ("R'G'B'A u8"), pixels,
+                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+  return pixels;
+}
+
+static void
+gimp_test_paint_stroke (Gimp      *gimp,
+                        GimpLayer *layer)
+{
+  GimpContext      *context = gimp_get_user_context (gimp);
+  GimpPaintInfo    *paint_info;
+  GimpPaintOptions *options;
+  GimpPaintCore    *core;
+  GimpCoords        coords[2] = { GIMP_COORDS_DEFAULT_VALUES,
+                                  GIMP_COORDS_DEFAULT_VALUES };
+  GError           *error     = NULL;
+
+  paint_info = (GimpPaintInfo *)
+    gimp_container_get_child_by_name (gimp->paint_info_list,
+                                      "gimp-paintbrush");
+  g_assert (paint_info != NULL);
+
+  options = gimp_paint_options_new (paint_info);
+
+  gimp_context_define_properties (GIMP_CONTEXT (options),
+                                  GIMP_CONTEXT_PAINT_PROPS_MASK,
+                                  FALSE);
+  gimp_context_set_parent (GIMP_CONTEXT (options), context);
+
+  g_object_set (options,
+                "brush-size", (gdouble) TEST_BRUSH_SIZE,
+                NULL);
+
+  core = g_object_new (paint_info->paint_type,
+                       "undo-desc", paint_info->blurb,
+                       NULL);
+
+  coords[0].x = TEST_STROKE_X1;
+  coords[0].y = TEST_STROKE_Y;
+  coords[1].x = TEST_STROKE_X2;
+  coords[1].y = TEST_STROKE_Y;
+
+  g_assert (gimp_paint_core_stroke (core, GIMP_DRAWABLE (layer), options,
+                                    coords, G_N_ELEMENTS (coords),
+                                    TRUE, &error));
+  g_assert_no_error (error);
+
+  g_object_unref (core);
+  g_object_unref (options);
+}
+
+/*  returns the drawable undo of the paint group on top of the stack  */
+static GimpUndo *
+gimp_test_get_drawable_undo (GimpImage *image)
+{
+  GimpUndo      *group;
+  GimpContainer *undos;
+  GimpUndo      *drawable_undo = NULL;
+  gint           i;
+
+  group = gimp_undo_stack_peek (gimp_image_get_undo_stack (image));
+
+  g_assert (GIMP_IS_UNDO_STACK (group));
+  g_assert_cmpint (group->undo_type, ==, GIMP_UNDO_GROUP_PAINT);
+
+  undos = GIMP_UNDO_STACK (group)->undos;
+
+  for (i = 0; i < gimp_container_get_n_children (undos); i++)
+    {
+      GimpObject *undo = gimp_container_get_child_by_index (undos, i);
+
+      if (GIMP_IS_DRAWABLE_UNDO (undo))
+        {
+          /*  the stroke is pushed as a single undo  */
+          g_assert (drawable_undo == NULL);
+
+          drawable_undo = GIMP_UNDO (undo);
+        }
+    }
+
+  g_assert (drawable_undo != NULL);
+
+  return drawable_undo;
+}
+
+/**
+ * stroke_undo_redo:
+ *
+ * Test that undoing a stroke restores the pixels, that redoing it
+ * brings the stroke back, and that its undo only holds the tiles the
+ * stroke has touched.
+ **/
+static void
+stroke_undo_redo (gconstpointer data)
+{
+  Gimp       *gimp  = GIMP (data);
+  GimpLayer  *layer = gimp_test_create_layer (gimp);
+  GimpImage  *image = gimp_item_get_image (GIMP_ITEM (layer));
+  GeglBuffer *buffer;
+  GimpUndo   *undo;
+  guchar     *original;
+  guchar     *painted;
+  guchar     *pixels;
+  gsize       size  = TEST_IMAGE_SIZE * TEST_IMAGE_SIZE * 4;
+  gint        tile_width;
+  gint        tile_height;
+  gint        n_tiles;
+  gint64      memsize;
+
+  original = gimp_test_get_pixels (layer);
+
+  gimp_test_paint_stroke (gimp, layer);
+
+  painted = gimp_test_get_pixels (layer);
+  g_assert (memcmp (original, painted, size) != 0);
+
+  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  g_object_get (buffer,
+                "tile-width",  &tile_width,
+                "tile-height", &tile_height,
+                NULL);
+
+  /*  the tiles the brush can have touched, with a tile of slack on
+   *  each side for the brush's extents
+   */
+  n_tiles = ((TEST_STROKE_X2 - TEST_STROKE_X1) / tile_width  + 3) *
+            (TEST_BRUSH_SIZE                    / tile_height + 3);
+
+  undo    = gimp_test_get_drawable_undo (image);
+  memsize = gimp_object_get_memsize (GIMP_OBJECT (undo), NULL);
+
+  g_assert_cmpint (memsize, <=, (gint64) n_tiles * tile_width * tile_height * 4 +
+                                16 * 1024);
+  g_assert_cmpint (memsize, <, size / 4);
+
+  g_assert (gimp_image_undo (image));
+
+  pixels = gimp_test_get_pixels (layer);
+  g_assert (memcmp (original, pixels, size) == 0);
+  g_free (pixels);
+
+  g_assert (gimp_image_redo (image));
+
+  pixels = gimp_test_get_pixels (layer);
+  g_assert (memcmp (painted, pixels, size) == 0);
+  g_free (pixels);
+
+  g_free (original);
+  g_free (painted);
+
+  g_object_unref (image);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (stroke_undo_redo);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
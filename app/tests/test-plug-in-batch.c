@@ -0,0 +1,285 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <gegl.h>
+#include <gtk/gtk.h>
+
+#include "libgimpbase/gimpbase.h"
+
+#include "core/core-types.h"
+#include "plug-in/plug-in-types.h"
+
+#include "core/gimp.h"
+
+#include "pdb/gimp-pdb-compat.h"
+#include "pdb/gimpprocedure.h"
+
+#include "plug-in/gimppluginmanager-batch.h"
+#include "plug-in/gimppluginprocedure.h"
+
+#include "tests.h"
+
+#include "gimp-app-test-utils.h"
+
+
+#define TEST_PROC_NAME "test-plug-in-batch-stub"
+
+#define ADD_TEST(function) \
+  g_test_add_data_func ("/gimp-plug-in-batch/" #function, gimp, function);
+
+
+typedef struct
+{
+  const gchar       **commands;
+  gint                n_reported;
+  GimpPDBStatusType  *statuses;
+  gdouble            *seconds;
+} BatchReport;
+
+
+/*  the procedure of plug-in-batch-stub, which is built next to the
+ *  tests
+ */
+static GimpPlugInProcedure *
+gimp_test_batch_procedure_new (Gimp *gimp)
+{
+  GimpProcedure *procedure;
+  gchar         *prog;
+
+  prog = g_build_filename (g_getenv ("GIMP_TESTING_ABS_TOP_BUILDDIR"),
+                           "app", "tests", "plug-in-batch-stub", NULL);
+
+  procedure = gimp_plug_in_procedure_new (GIMP_PLUGIN, prog);
+
+  g_free (prog);
+
+  gimp_object_set_name (GIMP_OBJECT (procedure), TEST_PROC_NAME);
+  gimp_procedure_set_strings (procedure, TEST_PROC_NAME,
+                              "", "", "", "", "", NULL);
+
+  gimp_procedure_add_argument (procedure,
+                               gimp_pdb_compat_param_spec (gimp,
+                                                           GIMP_PDB_INT32,
+                                                           "run-mode",
+                                                           "The run mode"));
+  gimp_procedure_add_argument (procedure,
+                               gimp_pdb_compat_param_spec (gimp,
+                                                           GIMP_PDB_STRING,
+                                                           "command",
+                                                           "The command to run"));
+  gimp_procedure_add_return_value (procedure,
+                                   gimp_pdb_compat_param_spec (gimp,
+                                                               GIMP_PDB_STRING,
+                                                               "command",
+                                                               "The command that was run"));
+
+  return GIMP_PLUG_IN_PROCEDURE (procedure);
+}
+
+static void
+gimp_test_batch_done (gint            job,
+                      GimpValueArray *return_vals,
+                      gdouble         seconds,
+                      BatchReport    *report)
+{
+  GimpPDBStatusType status;
+
+  /*  the jobs are reported in order, whatever order they finish in  */
+  g_assert_cmpint (job, ==, report->n_reported);
+
+  status = g_value_get_enum (gimp_value_array_index (return_vals, 0));
+
+  if (status == GIMP_PDB_SUCCESS)
+    {
+      const gchar *command;
+
+      command = g_value_get_string (gimp_value_array_index (return_vals, 1));
+
+      g_assert_cmpstr (command, ==, report->commands[job]);
+    }
+
+  report->statuses[job] = status;
+  report->seconds[job]  = seconds;
+
+  report->n_reported++;
+}
+
+/*  runs @commands through the stub interpreter, @max_running at a
+ *  time, and checks that each of them is reported once
+ */
+static BatchReport *
+gimp_test_batch_run (Gimp         *gimp,
+                     const gchar **commands,
+                     gint          max_running,
+                     gint          timeout)
+{
+  GimpPlugInProcedure  *procedure = gimp_test_batch_procedure_new (gimp);
+  BatchReport          *report    = g_slice_new0 (BatchReport);
+  GimpValueArray      **args;
+  gint                  n_jobs    = g_strv_length ((gchar **) commands);
+  gint                  i;
+
+  report->commands = commands;
+  report->statuses = g_new0 (GimpPDBStatusType, n_jobs);
+  report->seconds  = g_new0 (gdouble, n_jobs);
+
+  args = g_new (GimpValueArray *, n_jobs);
+
+  for (i = 0; i < n_jobs; i++)
+    {
+      args[i] = gimp_procedure_get_arguments (GIMP_PROCEDURE (procedure));
+
+      g_value_set_int (gimp_value_array_index (args[i], 0),
+                       GIMP_RUN_NONINTERACTIVE);
+      g_value_set_static_string (gimp_value_array_index (args[i], 1),
+                                 commands[i]);
+    }
+
+  gimp_plug_in_manager_batch_run (gimp->plug_in_manager,
+                                  gimp_get_user_context (gimp),
+                                  procedure,
+                                  args, n_jobs,
+                                  max_running, timeout,
+                                  (GimpPlugInBatchFunc) gimp_test_batch_done,
+                                  report);
+
+  g_assert_cmpint (report->n_reported, ==, n_jobs);
+
+  for (i = 0; i < n_jobs; i++)
+    gimp_value_array_unref (args[i]);
+
+  g_free (args);
+  g_object_unref (procedure);
+
+  return report;
+}
+
+static void
+gimp_test_batch_report_free (BatchReport *report)
+{
+  g_free (report->statuses);
+  g_free (report->seconds);
+  g_slice_free (BatchReport, report);
+}
+
+/**
+ * batch_reports_in_order:
+ *
+ * Test that jobs running side by side are reported in the order of
+ * the list even when the later ones finish first.
+ **/
+static void
+batch_reports_in_order (gconstpointer data)
+{
+  Gimp        *gimp       = GIMP (data);
+  const gchar *commands[] = { "sleep 800", "sleep 600", "sleep 400",
+                              "sleep 200", "sleep 0",   "sleep 0",
+                              NULL };
+  BatchReport *report;
+  gint         i;
+
+  report = gimp_test_batch_run (gimp, commands, 4, 0);
+
+  for (i = 0; commands[i]; i++)
+    g_assert_cmpint (report->statuses[i], ==, GIMP_PDB_SUCCESS);
+
+  /*  the short jobs didn't wait for the long ones  */
+  g_assert_cmpfloat (report->seconds[4], <, report->seconds[0]);
+
+  gimp_test_batch_report_free (report);
+}
+
+/**
+ * batch_reports_failure:
+ *
+ * Test that a failing job is reported as failed without affecting the
+ * jobs around it.
+ **/
+static void
+batch_reports_failure (gconstpointer data)
+{
+  Gimp        *gimp       = GIMP (data);
+  const gchar *commands[] = { "sleep 0", "fail", "sleep 100", "fail",
+                              NULL };
+  BatchReport *report;
+
+  report = gimp_test_batch_run (gimp, commands, 2, 0);
+
+  g_assert_cmpint (report->statuses[0], ==, GIMP_PDB_SUCCESS);
+  g_assert_cmpint (report->statuses[1], ==, GIMP_PDB_EXECUTION_ERROR);
+  g_assert_cmpint (report->statuses[2], ==, GIMP_PDB_SUCCESS);
+  g_assert_cmpint (report->statuses[3], ==, GIMP_PDB_EXECUTION_ERROR);
+
+  gimp_test_batch_report_free (report);
+}
+
+/**
+ * batch_kills_timed_out_job:
+ *
+ * Test that a job running past the timeout is killed and reported as
+ * failed, while the job next to it still succeeds.
+ **/
+static void
+batch_kills_timed_out_job (gconstpointer data)
+{
+  Gimp        *gimp       = GIMP (data);
+  const gchar *commands[] = { "sleep 60000", "sleep 0", NULL };
+  BatchReport *report;
+
+  report = gimp_test_batch_run (gimp, commands, 2, 1);
+
+  g_assert_cmpint (report->statuses[0], ==, GIMP_PDB_EXECUTION_ERROR);
+  g_assert_cmpfloat (report->seconds[0], <, 30.0);
+
+  g_assert_cmpint (report->statuses[1], ==, GIMP_PDB_SUCCESS);
+
+  gimp_test_batch_report_free (report);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  Gimp *gimp;
+  int   result;
+
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_SRCDIR",
+                                       "app/tests/gimpdir");
+
+  gimp = gimp_init_for_testing ();
+
+  /* Add tests */
+  ADD_TEST (batch_reports_in_order);
+  ADD_TEST (batch_reports_failure);
+  ADD_TEST (batch_kills_timed_out_job);
+
+  /* Don't write files to the source dir */
+  gimp_test_utils_set_gimp2_directory ("GIMP_TESTING_ABS_TOP_BUILDDIR",
+                                       "app/tests/gimpdir-output");
+
+  /* Run the tests */
+  result = g_test_run ();
+
+  gimp_exit (gimp, TRUE);
+
+  return result;
+}
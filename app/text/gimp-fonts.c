@@ -21,8 +21,10 @@
 #include "config.h"
 
 #include <glib-object.h>
+#include <glib/gstdio.h>
 
 #include <fontconfig/fontconfig.h>
+#include <pango/pangocairo.h>
 
 #include "libgimpbase/gimpbase.h"
 #include "libgimpconfig/gimpconfig.h"
@@ -35,15 +37,21 @@
 
 #include "gimp-fonts.h"
 #include "gimpfontlist.h"
+#include "gimptextlayer.h"
+#include "gimptextlayout.h"
 
 
-#define CONF_FNAME "fonts.conf"
+#define CONF_FNAME    "fonts.conf"
+#define CATALOG_FNAME "fontcatalog"
 
 
 static gboolean gimp_fonts_load_fonts_conf (FcConfig    *config,
                                             gchar       *fonts_conf);
 static void     gimp_fonts_add_directories (FcConfig    *config,
                                             const gchar *path_str);
+static gchar  * gimp_fonts_get_catalog_key (FcConfig    *config);
+static void     gimp_fonts_add_mtime       (GString     *string,
+                                            FcStrList   *files);
 
 
 void
@@ -64,6 +72,8 @@ gimp_fonts_load (Gimp *gimp)
   FcConfig *config;
   gchar    *fonts_conf;
   gchar    *path;
+  gchar    *catalog;
+  gchar    *catalog_key;
 
   g_return_if_fail (GIMP_IS_FONT_LIST (gimp->fonts));
 
@@ -72,6 +82,12 @@ gimp_fonts_load (Gimp *gimp)
   if (gimp->be_verbose)
     g_print ("Loading fonts\n");
 
+  /*  a pending load or text render still uses the current fontconfig
+   *  configuration
+   */
+  gimp_font_list_wait (GIMP_FONT_LIST (gimp->fonts));
+  gimp_text_layer_flush_all ();
+
   gimp_container_freeze (GIMP_CONTAINER (gimp->fonts));
 
   gimp_container_clear (GIMP_CONTAINER (gimp->fonts));
@@ -101,13 +117,40 @@ gimp_fonts_load (Gimp *gimp)
 
   FcConfigSetCurrent (config);
 
-  gimp_font_list_restore (GIMP_FONT_LIST (gimp->fonts));
+  /*  cached layouts may use fonts that are gone now  */
+  gimp_text_layout_cache_clear ();
+
+  catalog     = gimp_personal_rc_file (CATALOG_FNAME);
+  catalog_key = gimp_fonts_get_catalog_key (config);
+
+  /*  with a GUI, the fonts can trickle in after startup  */
+  gimp_font_list_restore (GIMP_FONT_LIST (gimp->fonts),
+                          catalog, catalog_key, ! gimp->no_interface);
+
+  g_free (catalog);
+  g_free (catalog_key);
 
  cleanup:
   gimp_container_thaw (GIMP_CONTAINER (gimp->fonts));
   gimp_unset_busy (gimp);
 }
 
+/**
+ * gimp_fonts_wait:
+ * @gimp: a #Gimp
+ *
+ * Makes sure the fonts are in @gimp's font list, they may still be
+ * listed in the background after gimp_fonts_load().
+ */
+void
+gimp_fonts_wait (Gimp *gimp)
+{
+  g_return_if_fail (GIMP_IS_GIMP (gimp));
+
+  if (gimp->fonts)
+    gimp_font_list_wait (GIMP_FONT_LIST (gimp->fonts));
+}
+
 void
 gimp_fonts_reset (Gimp *gimp)
 {
@@ -116,6 +159,11 @@ gimp_fonts_reset (Gimp *gimp)
   if (gimp->no_fonts)
     return;
 
+  gimp_fonts_wait (gimp);
+  gimp_text_layer_flush_all ();
+
+  gimp_text_layout_cache_clear ();
+
   /* Reinit the library with defaults. */
   FcInitReinitialize ();
 }
@@ -154,3 +202,51 @@ gimp_fonts_add_directories (FcConfig    *config,
 
   gimp_path_free (path);
 }
+
+/*  The font catalog is valid as long as fontconfig's configuration
+ *  files and font directories are unchanged, these are what
+ *  fontconfig checks its own caches against.
+ */
+static gchar *
+gimp_fonts_get_catalog_key (FcConfig *config)
+{
+  GString *string = g_string_new (NULL);
+  gchar   *key;
+
+  g_string_append_printf (string, "fontconfig %d\n", FcGetVersion ());
+
+  gimp_fonts_add_mtime (string, FcConfigGetConfigFiles (config));
+  gimp_fonts_add_mtime (string, FcConfigGetFontDirs (config));
+
+  key = g_compute_checksum_for_string (G_CHECKSUM_MD5, string->str, -1);
+
+  g_string_free (string, TRUE);
+
+  return key;
+}
+
+/*  appends each file's name and modification time to @string, and
+ *  frees @files
+ */
+static void
+gimp_fonts_add_mtime (GString   *string,
+                      FcStrList *files)
+{
+  FcChar8 *file;
+
+  if (! files)
+    return;
+
+  while ((file = FcStrListNext (files)))
+    {
+      GStatBuf st;
+
+      if (g_stat ((const gchar *) file, &st) == 0)
+        g_string_append_printf (string, "%s %" G_GINT64_FORMAT "\n",
+                                file, (gint64) st.st_mtime);
+      else
+        g_string_append_printf (string, "%s -\n", file);
+    }
+
+  FcStrListDone (files);
+}
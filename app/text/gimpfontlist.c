@@ -46,13 +46,45 @@
 #endif
 
 
-static void   gimp_font_list_add_font   (GimpFontList         *list,
-                                         PangoContext         *context,
-                                         PangoFontDescription *desc);
+#if defined (USE_FONTCONFIG_DIRECTLY) && FC_VERSION >= 21091
+/*  fontconfig is thread-safe, fonts can be listed in the background  */
+#define GIMP_FONT_LIST_ASYNC
+#endif
+
+#define CATALOG_HEADER "# GIMP font catalog\n"
+
+
+typedef struct _GimpFontListLoad GimpFontListLoad;
 
-static void   gimp_font_list_load_names (GimpFontList         *list,
-                                         PangoFontMap         *fontmap,
-                                         PangoContext         *context);
+struct _GimpFontListLoad
+{
+  GimpFontList *list;
+  gchar        *catalog;
+  gchar        *catalog_key;
+  GThread      *thread;
+  GPtrArray    *names;   /*  set by the thread  */
+};
+
+
+static PangoContext * gimp_font_list_create_context (GimpFontList  *list);
+static void           gimp_font_list_add_names      (GimpFontList  *list,
+                                                     GPtrArray     *names);
+static void           gimp_font_list_add_name       (GPtrArray     *names,
+                                                     PangoFontDescription *desc);
+static GPtrArray    * gimp_font_list_load_names     (void);
+
+static gboolean       gimp_font_list_load_catalog   (GimpFontList  *list,
+                                                     const gchar   *catalog,
+                                                     const gchar   *catalog_key);
+static void           gimp_font_list_save_catalog   (GimpFontList  *list,
+                                                     const gchar   *catalog,
+                                                     const gchar   *catalog_key);
+
+#ifdef GIMP_FONT_LIST_ASYNC
+static gpointer       gimp_font_list_load_thread    (GimpFontListLoad *load);
+static gboolean       gimp_font_list_load_done      (GimpFontListLoad *load);
+static void           gimp_font_list_load_finish    (GimpFontListLoad *load);
+#endif
 
 
 G_DEFINE_TYPE (GimpFontList, gimp_font_list, GIMP_TYPE_LIST)
@@ -88,14 +120,90 @@ gimp_font_list_new (gdouble xresolution,
   return GIMP_CONTAINER (list);
 }
 
+/**
+ * gimp_font_list_restore:
+ * @list:        a #GimpFontList
+ * @catalog:     the file to keep the font names in, or %NULL
+ * @catalog_key: a string that changes whenever the installed fonts do
+ * @async:       whether the fonts may be listed in the background
+ *
+ * Fills @list with the fonts fontconfig knows about.  Listing the
+ * fonts takes seconds on systems with many fonts, so the names are
+ * also written to @catalog, and read from there if it was written
+ * with the same @catalog_key.
+ *
+ * If @catalog can't be used and @async is %TRUE, the fonts are listed
+ * in a separate thread and added to @list from an idle handler, use
+ * gimp_font_list_wait() to make sure they are there.
+ **/
 void
-gimp_font_list_restore (GimpFontList *list)
+gimp_font_list_restore (GimpFontList *list,
+                        const gchar  *catalog,
+                        const gchar  *catalog_key,
+                        gboolean      async)
 {
-  PangoFontMap *fontmap;
-  PangoContext *context;
+  GPtrArray *names;
+
+  g_return_if_fail (GIMP_IS_FONT_LIST (list));
+  g_return_if_fail (catalog == NULL || catalog_key != NULL);
+
+  gimp_font_list_wait (list);
+
+  if (catalog && gimp_font_list_load_catalog (list, catalog, catalog_key))
+    return;
 
+#ifdef GIMP_FONT_LIST_ASYNC
+  if (async)
+    {
+      GimpFontListLoad *load = g_slice_new0 (GimpFontListLoad);
+
+      load->list        = g_object_ref (list);
+      load->catalog     = g_strdup (catalog);
+      load->catalog_key = g_strdup (catalog_key);
+
+      list->load = load;
+
+      load->thread = g_thread_new ("font-list",
+                                   (GThreadFunc) gimp_font_list_load_thread,
+                                   load);
+      return;
+    }
+#endif
+
+  names = gimp_font_list_load_names ();
+
+  gimp_font_list_add_names (list, names);
+
+  g_ptr_array_unref (names);
+
+  if (catalog)
+    gimp_font_list_save_catalog (list, catalog, catalog_key);
+}
+
+/**
+ * gimp_font_list_wait:
+ * @list: a #GimpFontList
+ *
+ * Waits for the fonts gimp_font_list_restore() lists in the
+ * background, and adds them to @list.
+ **/
+void
+gimp_font_list_wait (GimpFontList *list)
+{
   g_return_if_fail (GIMP_IS_FONT_LIST (list));
 
+#ifdef GIMP_FONT_LIST_ASYNC
+  if (list->load)
+    gimp_font_list_load_finish (list->load);
+#endif
+}
+
+static PangoContext *
+gimp_font_list_create_context (GimpFontList *list)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+
   fontmap = pango_cairo_font_map_new_for_font_type (CAIRO_FONT_TYPE_FT);
   if (! fontmap)
     g_error ("You are using a Pango that has been built against a cairo "
@@ -106,9 +214,31 @@ gimp_font_list_restore (GimpFontList *list)
   context = pango_font_map_create_context (fontmap);
   g_object_unref (fontmap);
 
+  return context;
+}
+
+static void
+gimp_font_list_add_names (GimpFontList *list,
+                          GPtrArray    *names)
+{
+  PangoContext *context = gimp_font_list_create_context (list);
+  gint          i;
+
   gimp_container_freeze (GIMP_CONTAINER (list));
 
-  gimp_font_list_load_names (list, PANGO_FONT_MAP (fontmap), context);
+  for (i = 0; i < names->len; i++)
+    {
+      GimpFont *font;
+
+      font = g_object_new (GIMP_TYPE_FONT,
+                           "name",          g_ptr_array_index (names, i),
+                           "pango-context", context,
+                           NULL);
+
+      gimp_container_add (GIMP_CONTAINER (list), GIMP_OBJECT (font));
+      g_object_unref (font);
+    }
+
   g_object_unref (context);
 
   gimp_list_sort_by_name (GIMP_LIST (list));
@@ -117,8 +247,7 @@ gimp_font_list_restore (GimpFontList *list)
 }
 
 static void
-gimp_font_list_add_font (GimpFontList         *list,
-                         PangoContext         *context,
+gimp_font_list_add_name (GPtrArray            *names,
                          PangoFontDescription *desc)
 {
   gchar *name;
@@ -129,33 +258,175 @@ gimp_font_list_add_font (GimpFontList         *list,
   name = pango_font_description_to_string (desc);
 
   if (g_utf8_validate (name, -1, NULL))
+    g_ptr_array_add (names, name);
+  else
+    g_free (name);
+}
+
+/*  The catalog is a header line, the catalog key and then one font
+ *  name per line, in the order of the sorted list, so it can be read
+ *  straight from the mapped file.
+ */
+static gboolean
+gimp_font_list_load_catalog (GimpFontList *list,
+                             const gchar  *catalog,
+                             const gchar  *catalog_key)
+{
+  GMappedFile  *file;
+  PangoContext *context;
+  const gchar  *data;
+  const gchar  *end;
+  const gchar  *line;
+  gsize         key_len = strlen (catalog_key);
+
+  file = g_mapped_file_new (catalog, FALSE, NULL);
+
+  if (! file)
+    return FALSE;
+
+  data = g_mapped_file_get_contents (file);
+  end  = data + g_mapped_file_get_length (file);
+
+  if ((gsize) (end - data) < strlen (CATALOG_HEADER) + key_len + 1 ||
+      memcmp (data, CATALOG_HEADER, strlen (CATALOG_HEADER))      ||
+      memcmp (data + strlen (CATALOG_HEADER), catalog_key, key_len) ||
+      data[strlen (CATALOG_HEADER) + key_len] != '\n')
     {
-      GimpFont *font;
+      g_mapped_file_unref (file);
+      return FALSE;
+    }
 
-      font = g_object_new (GIMP_TYPE_FONT,
-                           "name",          name,
-                           "pango-context", context,
-                           NULL);
+  context = gimp_font_list_create_context (list);
 
-      gimp_container_add (GIMP_CONTAINER (list), GIMP_OBJECT (font));
-      g_object_unref (font);
+  gimp_container_freeze (GIMP_CONTAINER (list));
+
+  for (line = data + strlen (CATALOG_HEADER) + key_len + 1;
+       line < end;
+       line++)
+    {
+      const gchar *eol = memchr (line, '\n', end - line);
+      GimpFont    *font;
+      gchar       *name;
+
+      if (! eol)
+        eol = end;
+
+      if (eol > line && g_utf8_validate (line, eol - line, NULL))
+        {
+          name = g_strndup (line, eol - line);
+
+          font = g_object_new (GIMP_TYPE_FONT,
+                               "name",          name,
+                               "pango-context", context,
+                               NULL);
+
+          gimp_container_add (GIMP_CONTAINER (list), GIMP_OBJECT (font));
+          g_object_unref (font);
+
+          g_free (name);
+        }
+
+      line = eol;
+    }
+
+  gimp_container_thaw (GIMP_CONTAINER (list));
+
+  g_object_unref (context);
+  g_mapped_file_unref (file);
+
+  return TRUE;
+}
+
+static void
+gimp_font_list_save_catalog (GimpFontList *list,
+                             const gchar  *catalog,
+                             const gchar  *catalog_key)
+{
+  GString *string = g_string_new (CATALOG_HEADER);
+  GList   *iter;
+  GError  *error  = NULL;
+
+  g_string_append (string, catalog_key);
+  g_string_append_c (string, '\n');
+
+  for (iter = GIMP_LIST (list)->list; iter; iter = g_list_next (iter))
+    {
+      g_string_append (string, gimp_object_get_name (iter->data));
+      g_string_append_c (string, '\n');
     }
 
-  g_free (name);
+  if (! g_file_set_contents (catalog, string->str, string->len, &error))
+    {
+      g_printerr ("Error while saving font catalog: %s\n", error->message);
+      g_clear_error (&error);
+    }
+
+  g_string_free (string, TRUE);
+}
+
+#ifdef GIMP_FONT_LIST_ASYNC
+
+/*  runs in the font list thread  */
+static gpointer
+gimp_font_list_load_thread (GimpFontListLoad *load)
+{
+  load->names = gimp_font_list_load_names ();
+
+  g_idle_add ((GSourceFunc) gimp_font_list_load_done, load);
+
+  return NULL;
+}
+
+static gboolean
+gimp_font_list_load_done (GimpFontListLoad *load)
+{
+  if (load->list->load == load)
+    gimp_font_list_load_finish (load);
+
+  g_object_unref (load->list);
+
+  g_free (load->catalog);
+  g_free (load->catalog_key);
+
+  g_slice_free (GimpFontListLoad, load);
+
+  return FALSE;
 }
 
+/*  called from gimp_font_list_wait() or the idle handler, whatever
+ *  comes first, the idle handler frees @load
+ */
+static void
+gimp_font_list_load_finish (GimpFontListLoad *load)
+{
+  GimpFontList *list = load->list;
+
+  g_thread_join (load->thread);
+
+  list->load = NULL;
+
+  gimp_font_list_add_names (list, load->names);
+
+  g_ptr_array_unref (load->names);
+  load->names = NULL;
+
+  if (load->catalog)
+    gimp_font_list_save_catalog (list, load->catalog, load->catalog_key);
+}
+
+#endif /* GIMP_FONT_LIST_ASYNC */
+
 #ifdef USE_FONTCONFIG_DIRECTLY
 /* We're really chummy here with the implementation. Oh well. */
 
 /* This is copied straight from make_alias_description in pango, plus
- * the gimp_font_list_add_font bits.
+ * the gimp_font_list_add_name bits.
  */
 static void
-gimp_font_list_make_alias (GimpFontList *list,
-                           PangoContext *context,
-                           const gchar  *family,
-                           gboolean      bold,
-                           gboolean      italic)
+gimp_font_list_make_alias (GPtrArray   *names,
+                           const gchar *family,
+                           gboolean     bold,
+                           gboolean     italic)
 {
   PangoFontDescription *desc = pango_font_description_new ();
 
@@ -169,32 +440,30 @@ gimp_font_list_make_alias (GimpFontList *list,
                                      PANGO_WEIGHT_BOLD : PANGO_WEIGHT_NORMAL);
   pango_font_description_set_stretch (desc, PANGO_STRETCH_NORMAL);
 
-  gimp_font_list_add_font (list, context, desc);
+  gimp_font_list_add_name (names, desc);
 
   pango_font_description_free (desc);
 }
 
 static void
-gimp_font_list_load_aliases (GimpFontList *list,
-                             PangoContext *context)
+gimp_font_list_load_aliases (GPtrArray *names)
 {
   const gchar *families[] = { "Sans", "Serif", "Monospace" };
   gint         i;
 
   for (i = 0; i < 3; i++)
     {
-      gimp_font_list_make_alias (list, context, families[i], FALSE, FALSE);
-      gimp_font_list_make_alias (list, context, families[i], TRUE,  FALSE);
-      gimp_font_list_make_alias (list, context, families[i], FALSE, TRUE);
-      gimp_font_list_make_alias (list, context, families[i], TRUE,  TRUE);
+      gimp_font_list_make_alias (names, families[i], FALSE, FALSE);
+      gimp_font_list_make_alias (names, families[i], TRUE,  FALSE);
+      gimp_font_list_make_alias (names, families[i], FALSE, TRUE);
+      gimp_font_list_make_alias (names, families[i], TRUE,  TRUE);
     }
 }
 
-static void
-gimp_font_list_load_names (GimpFontList *list,
-                           PangoFontMap *fontmap,
-                           PangoContext *context)
+static GPtrArray *
+gimp_font_list_load_names (void)
 {
+  GPtrArray   *names = g_ptr_array_new_with_free_func (g_free);
   FcObjectSet *os;
   FcPattern   *pat;
   FcFontSet   *fontset;
@@ -216,24 +485,26 @@ gimp_font_list_load_names (GimpFontList *list,
       PangoFontDescription *desc;
 
       desc = pango_fc_font_description_from_pattern (fontset->fonts[i], FALSE);
-      gimp_font_list_add_font (list, context, desc);
+      gimp_font_list_add_name (names, desc);
       pango_font_description_free (desc);
     }
 
   /*  only create aliases if there is at least one font available  */
   if (fontset->nfont > 0)
-    gimp_font_list_load_aliases (list, context);
+    gimp_font_list_load_aliases (names);
 
   FcFontSetDestroy (fontset);
+
+  return names;
 }
 
 #else  /* ! USE_FONTCONFIG_DIRECTLY */
 
-static void
-gimp_font_list_load_names (GimpFontList *list,
-                           PangoFontMap *fontmap,
-                           PangoContext *context)
+static GPtrArray *
+gimp_font_list_load_names (void)
 {
+  GPtrArray        *names   = g_ptr_array_new_with_free_func (g_free);
+  PangoFontMap     *fontmap = pango_cairo_font_map_get_default ();
   PangoFontFamily **families;
   PangoFontFace   **faces;
   gint              n_families;
@@ -251,12 +522,14 @@ gimp_font_list_load_names (GimpFontList *list,
           PangoFontDescription *desc;
 
           desc = pango_font_face_describe (faces[j]);
-          gimp_font_list_add_font (list, context, desc);
+          gimp_font_list_add_name (names, desc);
           pango_font_description_free (desc);
         }
     }
 
   g_free (families);
+
+  return names;
 }
 
 #endif /* USE_FONTCONFIG_DIRECTLY */
@@ -42,6 +42,8 @@ struct _GimpFontList
 
   gdouble   xresolution;
   gdouble   yresolution;
+
+  gpointer  load;  /*  the pending background enumeration  */
 };
 
 struct _GimpFontListClass
@@ -54,7 +56,11 @@ GType           gimp_font_list_get_type (void) G_GNUC_CONST;
 
 GimpContainer * gimp_font_list_new      (gdouble       xresolution,
                                          gdouble       yresolution);
-void            gimp_font_list_restore  (GimpFontList *list);
+void            gimp_font_list_restore  (GimpFontList *list,
+                                         const gchar  *catalog,
+                                         const gchar  *catalog_key,
+                                         gboolean      async);
+void            gimp_font_list_wait     (GimpFontList *list);
 
 
 #endif  /*  __GIMP_FONT_LIST_H__  */
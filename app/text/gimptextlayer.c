@@ -25,6 +25,7 @@
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#include <fontconfig/fontconfig.h>
 #include <pango/pangocairo.h>
 
 #include "libgimpbase/gimpbase.h"
@@ -46,6 +47,7 @@
 #include "core/gimpitemtree.h"
 #include "core/gimpparasitelist.h"
 
+#include "gimp-fonts.h"
 #include "gimptext.h"
 #include "gimptextlayer.h"
 #include "gimptextlayer-transform.h"
@@ -63,6 +65,51 @@ enum
   PROP_MODIFIED
 };
 
+/*  halfway between G_PRIORITY_HIGH_IDLE and G_PRIORITY_DEFAULT_IDLE,
+ *  like the projection's chunks
+ */
+#define GIMP_TEXT_LAYER_IDLE_PRIORITY \
+        ((G_PRIORITY_HIGH_IDLE + G_PRIORITY_DEFAULT_IDLE) / 2)
+
+/*  the first fontconfig and pango versions which are thread-safe, so
+ *  text can be laid out in the background
+ */
+#define GIMP_TEXT_LAYER_ASYNC_FC_VERSION    21091
+#define GIMP_TEXT_LAYER_ASYNC_PANGO_VERSION PANGO_VERSION_ENCODE (1, 32, 6)
+
+
+typedef struct _GimpTextLayerPiece  GimpTextLayerPiece;
+typedef struct _GimpTextLayerRender GimpTextLayerRender;
+
+struct _GimpTextLayerPiece
+{
+  cairo_rectangle_int_t  rect;     /*  in layer coordinates             */
+  cairo_surface_t       *surface;  /*  the pixels of rect               */
+};
+
+struct _GimpTextLayerRender
+{
+  GimpTextLayer  *layer;
+  GimpText       *text;       /*  a copy the layer's text had when the
+                               *  render was started
+                               */
+  gdouble         xres;
+  gdouble         yres;
+
+  gint            width;      /*  the layer's size and lines when the   */
+  gint            height;     /*  render was started                    */
+  GArray         *old_lines;
+  guint           old_key;
+
+  GimpTextLayout *layout;     /*  the results                           */
+  GArray         *lines;
+  guint           key;
+  GList          *pieces;
+  gboolean        full;       /*  the pieces cover the whole layer      */
+
+  volatile gint   cancelled;  /*  set by the main thread                */
+};
+
 
 static void       gimp_text_layer_finalize       (GObject           *object);
 static void       gimp_text_layer_get_property   (GObject           *object,
@@ -108,14 +155,39 @@ static void       gimp_text_layer_push_undo      (GimpDrawable      *drawable,
 
 static void       gimp_text_layer_text_changed   (GimpTextLayer     *layer);
 static gboolean   gimp_text_layer_render         (GimpTextLayer     *layer);
-static void       gimp_text_layer_render_layout  (GimpTextLayer     *layer,
-                                                  GimpTextLayout    *layout);
+static void       gimp_text_layer_render_async   (GimpTextLayer     *layer);
+static void       gimp_text_layer_render_cancel  (GimpTextLayer     *layer);
+static gboolean   gimp_text_layer_can_render_async
+                                                 (void);
+static void       gimp_text_layer_render_thread  (gpointer           data,
+                                                  gpointer           user_data);
+static gboolean   gimp_text_layer_render_done    (gpointer           data);
+
+static GimpTextLayerRender *
+                  gimp_text_layer_render_new     (GimpTextLayer     *layer);
+static void       gimp_text_layer_render_free    (GimpTextLayerRender *render);
+static void       gimp_text_layer_render_piece_free
+                                                 (GimpTextLayerPiece *piece);
+static guint      gimp_text_layer_render_key     (GimpText          *text);
+static void       gimp_text_layer_render_process (GimpTextLayerRender *render);
+static gboolean   gimp_text_layer_render_finish  (GimpTextLayerRender *render);
+static void       gimp_text_layer_set_lines      (GimpTextLayer     *layer,
+                                                  GArray            *lines,
+                                                  guint              key);
 
 
 G_DEFINE_TYPE (GimpTextLayer, gimp_text_layer, GIMP_TYPE_LAYER)
 
 #define parent_class gimp_text_layer_parent_class
 
+/*  the layers with a pending background render  */
+static GList       *text_render_layers   = NULL;
+
+static GThreadPool *text_render_pool     = NULL;
+static GMutex       text_render_mutex;
+static GCond        text_render_cond;
+static gint         text_render_n_queued = 0;
+
 
 static void
 gimp_text_layer_class_init (GimpTextLayerClass *klass)
@@ -178,6 +250,8 @@ gimp_text_layer_init (GimpTextLayer *layer)
 {
   layer->text          = NULL;
   layer->text_parasite = NULL;
+  layer->render        = NULL;
+  layer->lines         = NULL;
 }
 
 static void
@@ -191,6 +265,8 @@ gimp_text_layer_finalize (GObject *object)
       layer->text = NULL;
     }
 
+  gimp_text_layer_set_lines (layer, NULL, 0);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -238,6 +314,10 @@ gimp_text_layer_set_property (GObject      *object,
       break;
     case PROP_MODIFIED:
       text_layer->modified = g_value_get_boolean (value);
+
+      /*  the pixels aren't the rendered lines any longer  */
+      if (text_layer->modified)
+        gimp_text_layer_set_lines (text_layer, NULL, 0);
       break;
 
     default:
@@ -366,6 +446,8 @@ gimp_text_layer_set_buffer (GimpDrawable *drawable,
                                                   buffer,
                                                   offset_x, offset_y);
 
+  gimp_text_layer_set_lines (layer, NULL, 0);
+
   if (push_undo && ! layer->modified)
     {
       gimp_image_undo_push_text_layer_modified (image, NULL, layer);
@@ -564,6 +646,73 @@ gimp_text_layer_discard (GimpTextLayer *layer)
   gimp_text_layer_set_text (layer, NULL);
 }
 
+/**
+ * gimp_text_layer_set_async_render:
+ * @layer:        a #GimpTextLayer
+ * @async_render: whether to render text changes in the background
+ *
+ * While @async_render is %TRUE, changes of the layer's text are laid
+ * out and rendered in a worker thread, and the layer's pixels are
+ * updated from an idle handler once that is done.  Only the latest
+ * change is rendered when changes come in faster than that.  This is
+ * meant for interactive editing, everything else wants the layer's
+ * pixels to be up to date right away.  If fontconfig or Pango aren't
+ * thread-safe, the text is always rendered right away.
+ *
+ * Turning @async_render off finishes a pending render, see
+ * gimp_text_layer_flush().
+ */
+void
+gimp_text_layer_set_async_render (GimpTextLayer *layer,
+                                  gboolean       async_render)
+{
+  g_return_if_fail (GIMP_IS_TEXT_LAYER (layer));
+
+  layer->async_render = async_render ? TRUE : FALSE;
+
+  if (! async_render)
+    gimp_text_layer_flush (layer);
+}
+
+/**
+ * gimp_text_layer_flush:
+ * @layer: a #GimpTextLayer
+ *
+ * If a background render of @layer is pending, renders the layer's
+ * text right away instead.
+ */
+void
+gimp_text_layer_flush (GimpTextLayer *layer)
+{
+  g_return_if_fail (GIMP_IS_TEXT_LAYER (layer));
+
+  if (layer->render)
+    gimp_text_layer_render (layer);
+}
+
+/**
+ * gimp_text_layer_flush_all:
+ *
+ * Finishes the pending background renders of all text layers, see
+ * gimp_text_layer_flush(), and waits until no text is laid out in
+ * the background any longer.  Call this before the layers' pixels
+ * are saved or handed out, and before the font configuration is
+ * changed.
+ */
+void
+gimp_text_layer_flush_all (void)
+{
+  while (text_render_layers)
+    gimp_text_layer_flush (text_render_layers->data);
+
+  g_mutex_lock (&text_render_mutex);
+
+  while (text_render_n_queued > 0)
+    g_cond_wait (&text_render_cond, &text_render_mutex);
+
+  g_mutex_unlock (&text_render_mutex);
+}
+
 gboolean
 gimp_item_is_text_layer (GimpItem *item)
 {
@@ -600,27 +749,30 @@ gimp_text_layer_text_changed (GimpTextLayer *layer)
       layer->text_parasite = NULL;
     }
 
-  gimp_text_layer_render (layer);
+  if (layer->async_render)
+    gimp_text_layer_render_async (layer);
+  else
+    gimp_text_layer_render (layer);
 }
 
 static gboolean
 gimp_text_layer_render (GimpTextLayer *layer)
 {
-  GimpDrawable   *drawable;
-  GimpItem       *item;
-  GimpImage      *image;
-  GimpTextLayout *layout;
-  gdouble         xres;
-  gdouble         yres;
-  gint            width;
-  gint            height;
+  GimpImage           *image;
+  GimpTextLayerRender *render;
+  gdouble              xres;
+  gdouble              yres;
+  gboolean             success;
+
+  /*  a pending background render would only overwrite this one  */
+  gimp_text_layer_render_cancel (layer);
 
   if (! layer->text)
     return FALSE;
 
-  drawable = GIMP_DRAWABLE (layer);
-  item     = GIMP_ITEM (layer);
-  image    = gimp_item_get_image (item);
+  image = gimp_item_get_image (GIMP_ITEM (layer));
+
+  gimp_fonts_wait (image->gimp);
 
   if (gimp_container_is_empty (image->gimp->fonts))
     {
@@ -632,11 +784,324 @@ gimp_text_layer_render (GimpTextLayer *layer)
 
   gimp_image_get_resolution (image, &xres, &yres);
 
-  layout = gimp_text_layout_new (layer->text, xres, yres);
+  render = gimp_text_layer_render_new (layer);
+
+  render->layout = gimp_text_layout_get_cached (layer->text, xres, yres);
+  render->text   = g_object_ref (gimp_text_layout_get_text (render->layout));
+
+  gimp_text_layer_render_process (render);
+
+  success = gimp_text_layer_render_finish (render);
+
+  gimp_text_layer_render_free (render);
+
+  return success;
+}
+
+static void
+gimp_text_layer_render_async (GimpTextLayer *layer)
+{
+  GimpImage           *image;
+  GimpTextLayerRender *render;
+
+  if (! gimp_text_layer_can_render_async ())
+    {
+      gimp_text_layer_render (layer);
+      return;
+    }
+
+  if (! layer->text)
+    return;
+
+  image = gimp_item_get_image (GIMP_ITEM (layer));
+
+  gimp_fonts_wait (image->gimp);
+
+  if (gimp_container_is_empty (image->gimp->fonts))
+    {
+      gimp_text_layer_render (layer);
+      return;
+    }
+
+  gimp_text_layer_render_cancel (layer);
+
+  render = gimp_text_layer_render_new (layer);
+
+  render->text = gimp_config_duplicate (GIMP_CONFIG (layer->text));
+  gimp_image_get_resolution (image, &render->xres, &render->yres);
+
+  layer->render = render;
+
+  text_render_layers = g_list_prepend (text_render_layers, layer);
+
+  /*  one thread is enough, the jobs of a layer supersede each other  */
+  if (! text_render_pool)
+    text_render_pool = g_thread_pool_new (gimp_text_layer_render_thread,
+                                          NULL, 1, FALSE, NULL);
+
+  g_mutex_lock (&text_render_mutex);
+  text_render_n_queued++;
+  g_mutex_unlock (&text_render_mutex);
+
+  g_thread_pool_push (text_render_pool, render, NULL);
+}
+
+static void
+gimp_text_layer_render_cancel (GimpTextLayer *layer)
+{
+  GimpTextLayerRender *render = layer->render;
+
+  if (render)
+    {
+      g_atomic_int_set (&render->cancelled, TRUE);
+
+      layer->render = NULL;
+
+      text_render_layers = g_list_remove (text_render_layers, layer);
+    }
+}
+
+/*  checks the libraries GIMP runs with, not the ones it was built
+ *  against
+ */
+static gboolean
+gimp_text_layer_can_render_async (void)
+{
+  static gint can_render_async = -1;
+
+  if (can_render_async < 0)
+    can_render_async =
+      (FcGetVersion () >= GIMP_TEXT_LAYER_ASYNC_FC_VERSION &&
+       pango_version () >= GIMP_TEXT_LAYER_ASYNC_PANGO_VERSION);
+
+  return can_render_async;
+}
+
+/*  runs in the text render thread  */
+static void
+gimp_text_layer_render_thread (gpointer data,
+                               gpointer user_data)
+{
+  GimpTextLayerRender *render = data;
+
+  if (! g_atomic_int_get (&render->cancelled))
+    {
+      render->layout = gimp_text_layout_new (render->text,
+                                             render->xres, render->yres);
+
+      gimp_text_layer_render_process (render);
+    }
+
+  g_idle_add_full (GIMP_TEXT_LAYER_IDLE_PRIORITY,
+                   gimp_text_layer_render_done, render, NULL);
+
+  g_mutex_lock (&text_render_mutex);
+
+  if (--text_render_n_queued == 0)
+    g_cond_broadcast (&text_render_cond);
+
+  g_mutex_unlock (&text_render_mutex);
+}
+
+static gboolean
+gimp_text_layer_render_done (gpointer data)
+{
+  GimpTextLayerRender *render = data;
+  GimpTextLayer       *layer  = render->layer;
+
+  if (layer->render == render)
+    {
+      layer->render = NULL;
+
+      text_render_layers = g_list_remove (text_render_layers, layer);
+
+      if (gimp_text_layer_render_finish (render))
+        gimp_text_layout_cache_insert (render->layout);
+    }
+
+  gimp_text_layer_render_free (render);
+
+  return FALSE;
+}
+
+/*  called from the main thread, takes a snapshot of what the layer
+ *  looks like now
+ */
+static GimpTextLayerRender *
+gimp_text_layer_render_new (GimpTextLayer *layer)
+{
+  GimpTextLayerRender *render = g_slice_new0 (GimpTextLayerRender);
+
+  render->layer  = g_object_ref (layer);
+  render->width  = gimp_item_get_width  (GIMP_ITEM (layer));
+  render->height = gimp_item_get_height (GIMP_ITEM (layer));
+
+  if (layer->lines &&
+      gimp_text_layer_get_format (layer) ==
+      gimp_drawable_get_format (GIMP_DRAWABLE (layer)))
+    {
+      render->old_lines = g_array_ref (layer->lines);
+      render->old_key   = layer->lines_key;
+    }
+
+  return render;
+}
+
+static void
+gimp_text_layer_render_free (GimpTextLayerRender *render)
+{
+  g_list_free_full (render->pieces,
+                    (GDestroyNotify) gimp_text_layer_render_piece_free);
+
+  if (render->old_lines)
+    g_array_unref (render->old_lines);
+
+  if (render->lines)
+    g_array_unref (render->lines);
+
+  if (render->layout)
+    g_object_unref (render->layout);
+
+  if (render->text)
+    g_object_unref (render->text);
+
+  g_object_unref (render->layer);
+
+  g_slice_free (GimpTextLayerRender, render);
+}
+
+static void
+gimp_text_layer_render_piece_free (GimpTextLayerPiece *piece)
+{
+  cairo_surface_destroy (piece->surface);
+
+  g_slice_free (GimpTextLayerPiece, piece);
+}
+
+/*  a hash of the text properties that change how all lines are
+ *  drawn, without changing their glyphs or positions
+ */
+static guint
+gimp_text_layer_render_key (GimpText *text)
+{
+  guint key = text->antialias ? 1 : 0;
+  gint  i, j;
+
+  key = key * 31 + text->hint_style;
+
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < 2; j++)
+      key = key * 31 + (gint) (text->transformation.coeff[i][j] * 65536.0);
+
+  return key;
+}
+
+/*  may run in any thread, only uses the render's own objects  */
+static void
+gimp_text_layer_render_process (GimpTextLayerRender *render)
+{
+  cairo_region_t        *region;
+  cairo_rectangle_int_t  all;
+  gint                   n_rects;
+  gint                   i;
+
+  g_list_free_full (render->pieces,
+                    (GDestroyNotify) gimp_text_layer_render_piece_free);
+  render->pieces = NULL;
+
+  if (render->lines)
+    g_array_unref (render->lines);
+
+  all.x = 0;
+  all.y = 0;
+  gimp_text_layout_get_size (render->layout, &all.width, &all.height);
+
+  render->lines = gimp_text_layout_get_lines (render->layout);
+  render->key   = gimp_text_layer_render_key (render->text);
+
+  /*  if the size and the look of the text stay the same, only the
+   *  lines that changed are drawn, the layer's pixels are used for
+   *  the rest
+   */
+  if (render->old_lines                &&
+      render->old_key == render->key    &&
+      render->width   == all.width      &&
+      render->height  == all.height)
+    {
+      region = gimp_text_layout_diff_lines (render->old_lines, render->lines);
+
+      cairo_region_intersect_rectangle (region, &all);
+    }
+  else
+    {
+      region = cairo_region_create_rectangle (&all);
+
+      render->full = TRUE;
+    }
+
+  n_rects = cairo_region_num_rectangles (region);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      GimpTextLayerPiece *piece = g_slice_new (GimpTextLayerPiece);
+      cairo_t            *cr;
+
+      cairo_region_get_rectangle (region, i, &piece->rect);
+
+      piece->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                                   piece->rect.width,
+                                                   piece->rect.height);
+
+      cr = cairo_create (piece->surface);
+      cairo_translate (cr, -piece->rect.x, -piece->rect.y);
+      gimp_text_layout_render (render->layout, cr,
+                               render->text->base_dir, FALSE);
+      cairo_destroy (cr);
+
+      cairo_surface_flush (piece->surface);
+
+      render->pieces = g_list_prepend (render->pieces, piece);
+    }
+
+  cairo_region_destroy (region);
+}
+
+/*  called from the main thread, puts the rendered pixels into the
+ *  layer
+ */
+static gboolean
+gimp_text_layer_render_finish (GimpTextLayerRender *render)
+{
+  GimpTextLayer *layer    = render->layer;
+  GimpDrawable  *drawable = GIMP_DRAWABLE (layer);
+  GimpItem      *item     = GIMP_ITEM (layer);
+  GimpImage     *image    = gimp_item_get_image (item);
+  GList         *list;
+  gint           width;
+  gint           height;
+
+  if (! layer->text)
+    return FALSE;
+
+  /*  if the layer's pixels changed since the render was started,
+   *  the unchanged lines can't be taken from them
+   */
+  if (! render->full &&
+      (layer->lines != render->old_lines                       ||
+       gimp_item_get_width  (item) != render->width             ||
+       gimp_item_get_height (item) != render->height            ||
+       gimp_text_layer_get_format (layer) !=
+       gimp_drawable_get_format (drawable)))
+    {
+      g_array_unref (render->old_lines);
+      render->old_lines = NULL;
+
+      gimp_text_layer_render_process (render);
+    }
 
   g_object_freeze_notify (G_OBJECT (drawable));
 
-  if (gimp_text_layout_get_size (layout, &width, &height) &&
+  if (gimp_text_layout_get_size (render->layout, &width, &height) &&
       (width  != gimp_item_get_width  (item) ||
        height != gimp_item_get_height (item) ||
        gimp_text_layer_get_format (layer) !=
@@ -693,47 +1158,45 @@ gimp_text_layer_render (GimpTextLayer *layer)
         }
     }
 
-  gimp_text_layer_render_layout (layer, layout);
-
-  g_object_unref (layout);
+  g_return_val_if_fail (gimp_drawable_has_alpha (drawable), FALSE);
 
-  g_object_thaw_notify (G_OBJECT (drawable));
-
-  return (width > 0 && height > 0);
-}
+  for (list = render->pieces; list; list = g_list_next (list))
+    {
+      GimpTextLayerPiece *piece = list->data;
+      GeglBuffer         *buffer;
 
-static void
-gimp_text_layer_render_layout (GimpTextLayer  *layer,
-                               GimpTextLayout *layout)
-{
-  GimpDrawable    *drawable = GIMP_DRAWABLE (layer);
-  GimpItem        *item     = GIMP_ITEM (layer);
-  GeglBuffer      *buffer;
-  cairo_t         *cr;
-  cairo_surface_t *surface;
-  gint             width;
-  gint             height;
+      buffer = gimp_cairo_surface_create_buffer (piece->surface);
 
-  g_return_if_fail (gimp_drawable_has_alpha (drawable));
+      gegl_buffer_copy (buffer, NULL,
+                        gimp_drawable_get_buffer (drawable),
+                        GEGL_RECTANGLE (piece->rect.x,     piece->rect.y,
+                                        piece->rect.width, piece->rect.height));
 
-  width  = gimp_item_get_width  (item);
-  height = gimp_item_get_height (item);
+      g_object_unref (buffer);
 
-  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+      gimp_drawable_update (drawable,
+                            piece->rect.x,     piece->rect.y,
+                            piece->rect.width, piece->rect.height);
+    }
 
-  cr = cairo_create (surface);
-  gimp_text_layout_render (layout, cr, layer->text->base_dir, FALSE);
-  cairo_destroy (cr);
+  gimp_text_layer_set_lines (layer, render->lines, render->key);
 
-  cairo_surface_flush (surface);
+  g_object_thaw_notify (G_OBJECT (drawable));
 
-  buffer = gimp_cairo_surface_create_buffer (surface);
+  return (width > 0 && height > 0);
+}
 
-  gegl_buffer_copy (buffer, NULL,
-                    gimp_drawable_get_buffer (drawable), NULL);
+static void
+gimp_text_layer_set_lines (GimpTextLayer *layer,
+                           GArray        *lines,
+                           guint          key)
+{
+  if (lines)
+    g_array_ref (lines);
 
-  g_object_unref (buffer);
-  cairo_surface_destroy (surface);
+  if (layer->lines)
+    g_array_unref (layer->lines);
 
-  gimp_drawable_update (drawable, 0, 0, width, height);
+  layer->lines     = lines;
+  layer->lines_key = key;
 }
@@ -48,6 +48,11 @@ struct _GimpTextLayer
   gboolean      modified;
 
   const Babl   *convert_format;
+
+  gboolean      async_render;
+  gpointer      render;         /*  the pending background render       */
+  GArray       *lines;          /*  the GimpTextLayoutLines the pixels  */
+  guint         lines_key;      /*  show, and how they were drawn       */
 };
 
 struct _GimpTextLayerClass
@@ -64,6 +69,11 @@ GimpText  * gimp_text_layer_get_text    (GimpTextLayer *layer);
 void        gimp_text_layer_set_text    (GimpTextLayer *layer,
                                          GimpText      *text);
 void        gimp_text_layer_discard     (GimpTextLayer *layer);
+void        gimp_text_layer_set_async_render
+                                        (GimpTextLayer *layer,
+                                         gboolean       async_render);
+void        gimp_text_layer_flush       (GimpTextLayer *layer);
+void        gimp_text_layer_flush_all   (void);
 void        gimp_text_layer_set         (GimpTextLayer *layer,
                                          const gchar   *undo_desc,
                                          const gchar   *first_property_name,
@@ -22,6 +22,8 @@
 
 #include <pango/pangocairo.h>
 
+#include "libgimpmath/gimpmath.h"
+
 #include "text-types.h"
 
 #include "gimptextlayout.h"
@@ -55,3 +57,228 @@ gimp_text_layout_render (GimpTextLayout    *layout,
   else
     pango_cairo_show_layout (cr, pango_layout);
 }
+
+
+#define HASH_ADD(hash, value) ((hash) = ((hash) << 5) - (hash) + (guint) (value))
+
+static guint
+gimp_text_layout_hash_attribute (guint           hash,
+                                 PangoAttribute *attr)
+{
+  HASH_ADD (hash, attr->klass->type);
+
+  switch (attr->klass->type)
+    {
+    case PANGO_ATTR_FOREGROUND:
+    case PANGO_ATTR_BACKGROUND:
+    case PANGO_ATTR_UNDERLINE_COLOR:
+    case PANGO_ATTR_STRIKETHROUGH_COLOR:
+      {
+        PangoColor *color = &((PangoAttrColor *) attr)->color;
+
+        HASH_ADD (hash, color->red);
+        HASH_ADD (hash, color->green);
+        HASH_ADD (hash, color->blue);
+      }
+      break;
+
+    case PANGO_ATTR_UNDERLINE:
+    case PANGO_ATTR_STRIKETHROUGH:
+    case PANGO_ATTR_RISE:
+    case PANGO_ATTR_LETTER_SPACING:
+      HASH_ADD (hash, ((PangoAttrInt *) attr)->value);
+      break;
+
+    case PANGO_ATTR_SCALE:
+      HASH_ADD (hash, ((PangoAttrFloat *) attr)->value * 1000.0);
+      break;
+
+    default:
+      /*  anything we don't know how to hash makes the line unique  */
+      HASH_ADD (hash, GPOINTER_TO_UINT (attr));
+      break;
+    }
+
+  return hash;
+}
+
+static guint
+gimp_text_layout_hash_run (guint           hash,
+                           PangoGlyphItem *run)
+{
+  PangoGlyphString     *glyphs = run->glyphs;
+  PangoFontDescription *desc;
+  GSList               *list;
+  gchar                *font;
+  gint                  i;
+
+  desc = pango_font_describe_with_absolute_size (run->item->analysis.font);
+  font = pango_font_description_to_string (desc);
+
+  HASH_ADD (hash, g_str_hash (font));
+
+  g_free (font);
+  pango_font_description_free (desc);
+
+  for (i = 0; i < glyphs->num_glyphs; i++)
+    {
+      PangoGlyphInfo *info = &glyphs->glyphs[i];
+
+      HASH_ADD (hash, info->glyph);
+      HASH_ADD (hash, info->geometry.width);
+      HASH_ADD (hash, info->geometry.x_offset);
+      HASH_ADD (hash, info->geometry.y_offset);
+    }
+
+  for (list = run->item->analysis.extra_attrs; list; list = g_slist_next (list))
+    hash = gimp_text_layout_hash_attribute (hash, list->data);
+
+  return hash;
+}
+
+/*  Returns a GimpTextLayoutLine for each line of @layout.  Two lines
+ *  with the same hash and rectangle draw the same pixels, the lines
+ *  of two layouts can be compared with gimp_text_layout_diff_lines()
+ *  to find out what needs to be redrawn.
+ */
+GArray *
+gimp_text_layout_get_lines (GimpTextLayout *layout)
+{
+  PangoLayoutIter *iter;
+  GArray          *lines;
+  cairo_matrix_t   trafo;
+  gint             x, y;
+
+  g_return_val_if_fail (GIMP_IS_TEXT_LAYOUT (layout), NULL);
+
+  lines = g_array_new (FALSE, FALSE, sizeof (GimpTextLayoutLine));
+
+  gimp_text_layout_get_offsets (layout, &x, &y);
+  gimp_text_layout_get_transform (layout, &trafo);
+
+  iter = pango_layout_get_iter (gimp_text_layout_get_pango_layout (layout));
+
+  do
+    {
+      PangoLayoutLine    *pango_line = pango_layout_iter_get_line_readonly (iter);
+      GimpTextLayoutLine  line;
+      PangoRectangle      ink;
+      PangoRectangle      logical;
+      GSList             *list;
+      gdouble             x1 = G_MAXDOUBLE;
+      gdouble             y1 = G_MAXDOUBLE;
+      gdouble             x2 = -G_MAXDOUBLE;
+      gdouble             y2 = -G_MAXDOUBLE;
+      gint                i;
+
+      pango_layout_iter_get_line_extents (iter, &ink, &logical);
+
+      line.hash = 0;
+
+      HASH_ADD (line.hash, logical.x);
+      HASH_ADD (line.hash, logical.y);
+      HASH_ADD (line.hash, pango_layout_iter_get_baseline (iter));
+
+      for (list = pango_line->runs; list; list = g_slist_next (list))
+        line.hash = gimp_text_layout_hash_run (line.hash, list->data);
+
+      /*  the line's ink rectangle, transformed like in
+       *  gimp_text_layout_render() and padded for the antialiasing
+       */
+      pango_extents_to_pixels (&ink, NULL);
+
+      for (i = 0; i < 4; i++)
+        {
+          gdouble cx = ink.x + ((i & 1) ? ink.width  : 0);
+          gdouble cy = ink.y + ((i & 2) ? ink.height : 0);
+
+          cairo_matrix_transform_point (&trafo, &cx, &cy);
+
+          x1 = MIN (x1, cx);
+          y1 = MIN (y1, cy);
+          x2 = MAX (x2, cx);
+          y2 = MAX (y2, cy);
+        }
+
+      line.rect.x      = x + (gint) floor (x1) - 2;
+      line.rect.y      = y + (gint) floor (y1) - 2;
+      line.rect.width  = x + (gint) ceil (x2) + 2 - line.rect.x;
+      line.rect.height = y + (gint) ceil (y2) + 2 - line.rect.y;
+
+      g_array_append_val (lines, line);
+    }
+  while (pango_layout_iter_next_line (iter));
+
+  pango_layout_iter_free (iter);
+
+  return lines;
+}
+
+static inline gboolean
+gimp_text_layout_line_equal (const GimpTextLayoutLine *a,
+                             const GimpTextLayoutLine *b)
+{
+  return (a->hash        == b->hash       &&
+          a->rect.x      == b->rect.x     &&
+          a->rect.y      == b->rect.y     &&
+          a->rect.width  == b->rect.width &&
+          a->rect.height == b->rect.height);
+}
+
+/*  Returns the area that needs to be redrawn when the pixels of a
+ *  layout with @old_lines are changed to show @new_lines.  Editing
+ *  usually changes a run of lines somewhere in the middle of the
+ *  text, so the lines that match at the start and at the end are
+ *  skipped, and the old and new positions of all lines in between
+ *  are redrawn.
+ */
+cairo_region_t *
+gimp_text_layout_diff_lines (GArray *old_lines,
+                             GArray *new_lines)
+{
+  cairo_region_t *region;
+  guint           head = 0;
+  guint           tail = 0;
+  guint           i;
+
+  g_return_val_if_fail (old_lines != NULL, NULL);
+  g_return_val_if_fail (new_lines != NULL, NULL);
+
+  while (head < old_lines->len &&
+         head < new_lines->len &&
+         gimp_text_layout_line_equal (&g_array_index (old_lines,
+                                                      GimpTextLayoutLine,
+                                                      head),
+                                      &g_array_index (new_lines,
+                                                      GimpTextLayoutLine,
+                                                      head)))
+    {
+      head++;
+    }
+
+  while (tail < old_lines->len - head &&
+         tail < new_lines->len - head &&
+         gimp_text_layout_line_equal (&g_array_index (old_lines,
+                                                      GimpTextLayoutLine,
+                                                      old_lines->len - 1 - tail),
+                                      &g_array_index (new_lines,
+                                                      GimpTextLayoutLine,
+                                                      new_lines->len - 1 - tail)))
+    {
+      tail++;
+    }
+
+  region = cairo_region_create ();
+
+  for (i = head; i < old_lines->len - tail; i++)
+    cairo_region_union_rectangle (region,
+                                  &g_array_index (old_lines,
+                                                  GimpTextLayoutLine, i).rect);
+
+  for (i = head; i < new_lines->len - tail; i++)
+    cairo_region_union_rectangle (region,
+                                  &g_array_index (new_lines,
+                                                  GimpTextLayoutLine, i).rect);
+
+  return region;
+}
@@ -22,10 +22,23 @@
 #define __GIMP_TEXT_LAYOUT_RENDER_H__
 
 
-void  gimp_text_layout_render (GimpTextLayout    *layout,
-                               cairo_t           *cr,
-                               GimpTextDirection  base_dir,
-                               gboolean           path);
+typedef struct _GimpTextLayoutLine GimpTextLayoutLine;
+
+struct _GimpTextLayoutLine
+{
+  guint                 hash;  /*  of the glyphs, fonts and attributes  */
+  cairo_rectangle_int_t rect;  /*  the pixels the line is drawn to      */
+};
+
+
+void             gimp_text_layout_render     (GimpTextLayout    *layout,
+                                              cairo_t           *cr,
+                                              GimpTextDirection  base_dir,
+                                              gboolean           path);
+
+GArray         * gimp_text_layout_get_lines  (GimpTextLayout    *layout);
+cairo_region_t * gimp_text_layout_diff_lines (GArray            *old_lines,
+                                              GArray            *new_lines);
 
 
 #endif /* __GIMP_TEXT_LAYOUT_RENDER_H__ */
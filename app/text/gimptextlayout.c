@@ -28,6 +28,7 @@
 
 #include "libgimpbase/gimpbase.h"
 #include "libgimpcolor/gimpcolor.h"
+#include "libgimpconfig/gimpconfig.h"
 #include "libgimpmath/gimpmath.h"
 
 #include "text-types.h"
@@ -36,6 +37,12 @@
 #include "gimptextlayout.h"
 
 
+/*  the number of layouts gimp_text_layout_get_cached() keeps around  */
+#define GIMP_TEXT_LAYOUT_CACHE_SIZE 16
+
+
+typedef struct _GimpTextLayoutCacheEntry GimpTextLayoutCacheEntry;
+
 struct _GimpTextLayout
 {
   GObject         object;
@@ -47,6 +54,12 @@ struct _GimpTextLayout
   PangoRectangle  extents;
 };
 
+struct _GimpTextLayoutCacheEntry
+{
+  gchar          *key;
+  GimpTextLayout *layout;
+};
+
 
 static void           gimp_text_layout_finalize   (GObject        *object);
 
@@ -57,12 +70,26 @@ static PangoContext * gimp_text_get_pango_context (GimpText       *text,
                                                    gdouble         xres,
                                                    gdouble         yres);
 
+static gchar        * gimp_text_layout_cache_key  (GimpText       *text,
+                                                   gdouble         xres,
+                                                   gdouble         yres);
+static void           gimp_text_layout_cache_add  (gchar          *key,
+                                                   GimpTextLayout *layout);
+static void           gimp_text_layout_cache_free (GimpTextLayoutCacheEntry *entry);
+
 
 G_DEFINE_TYPE (GimpTextLayout, gimp_text_layout, G_TYPE_OBJECT)
 
 #define parent_class gimp_text_layout_parent_class
 
 
+/*  maps keys to the links of layout_cache_lru, which holds the
+ *  entries, most recently used first
+ */
+static GHashTable *layout_cache     = NULL;
+static GQueue      layout_cache_lru = G_QUEUE_INIT;
+
+
 static void
 gimp_text_layout_class_init (GimpTextLayoutClass *klass)
 {
@@ -207,6 +234,106 @@ gimp_text_layout_new (GimpText  *text,
   return layout;
 }
 
+/**
+ * gimp_text_layout_get_cached:
+ * @text: a #GimpText
+ * @xres: the horizontal resolution
+ * @yres: the vertical resolution
+ *
+ * Like gimp_text_layout_new(), but returns a layout from a small cache
+ * of recently used layouts if one was made for a text with the same
+ * properties and the same resolution.  New layouts are made from a
+ * private copy of @text, so they don't change when @text does.
+ *
+ * Unlike gimp_text_layout_new(), this function may only be called
+ * from the main thread.
+ *
+ * Return value: a reference to a #GimpTextLayout
+ **/
+GimpTextLayout *
+gimp_text_layout_get_cached (GimpText *text,
+                             gdouble   xres,
+                             gdouble   yres)
+{
+  GimpTextLayout *layout;
+  GimpText       *copy;
+  GList          *link = NULL;
+  gchar          *key;
+
+  g_return_val_if_fail (GIMP_IS_TEXT (text), NULL);
+
+  key = gimp_text_layout_cache_key (text, xres, yres);
+
+  if (layout_cache)
+    link = g_hash_table_lookup (layout_cache, key);
+
+  if (link)
+    {
+      g_queue_unlink (&layout_cache_lru, link);
+      g_queue_push_head_link (&layout_cache_lru, link);
+
+      g_free (key);
+
+      return g_object_ref (((GimpTextLayoutCacheEntry *) link->data)->layout);
+    }
+
+  copy   = gimp_config_duplicate (GIMP_CONFIG (text));
+  layout = gimp_text_layout_new (copy, xres, yres);
+  g_object_unref (copy);
+
+  if (layout)
+    gimp_text_layout_cache_add (key, layout);
+  else
+    g_free (key);
+
+  return layout;
+}
+
+/**
+ * gimp_text_layout_cache_insert:
+ * @layout: a #GimpTextLayout
+ *
+ * Adds @layout, which was made by gimp_text_layout_new() for example
+ * in a worker thread, to the cache used by
+ * gimp_text_layout_get_cached().  The layout's #GimpText must not be
+ * changed afterwards.  May only be called from the main thread.
+ **/
+void
+gimp_text_layout_cache_insert (GimpTextLayout *layout)
+{
+  gchar *key;
+
+  g_return_if_fail (GIMP_IS_TEXT_LAYOUT (layout));
+
+  key = gimp_text_layout_cache_key (layout->text, layout->xres, layout->yres);
+
+  if (layout_cache && g_hash_table_lookup (layout_cache, key))
+    {
+      g_free (key);
+      return;
+    }
+
+  gimp_text_layout_cache_add (key, layout);
+}
+
+/**
+ * gimp_text_layout_cache_clear:
+ *
+ * Drops all cached layouts, for example because the available fonts
+ * changed.
+ **/
+void
+gimp_text_layout_cache_clear (void)
+{
+  GimpTextLayoutCacheEntry *entry;
+
+  if (layout_cache)
+    g_hash_table_remove_all (layout_cache);
+
+  while ((entry = g_queue_pop_head (&layout_cache_lru)))
+    gimp_text_layout_cache_free (entry);
+}
+
 gboolean
 gimp_text_layout_get_size (GimpTextLayout *layout,
                            gint           *width,
@@ -634,6 +761,57 @@ gimp_text_layout_position (GimpTextLayout *layout)
 #endif
 }
 
+static gchar *
+gimp_text_layout_cache_key (GimpText *text,
+                            gdouble   xres,
+                            gdouble   yres)
+{
+  gchar *config = gimp_config_serialize_to_string (GIMP_CONFIG (text), NULL);
+  gchar *key;
+
+  key = g_strdup_printf ("%s(resolution %f %f)", config, xres, yres);
+
+  g_free (config);
+
+  return key;
+}
+
+/*  takes ownership of @key  */
+static void
+gimp_text_layout_cache_add (gchar          *key,
+                            GimpTextLayout *layout)
+{
+  GimpTextLayoutCacheEntry *entry;
+
+  if (! layout_cache)
+    layout_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+  entry = g_slice_new (GimpTextLayoutCacheEntry);
+
+  entry->key    = key;
+  entry->layout = g_object_ref (layout);
+
+  g_queue_push_head (&layout_cache_lru, entry);
+  g_hash_table_insert (layout_cache, entry->key, layout_cache_lru.head);
+
+  while (layout_cache_lru.length > GIMP_TEXT_LAYOUT_CACHE_SIZE)
+    {
+      entry = g_queue_pop_tail (&layout_cache_lru);
+
+      g_hash_table_remove (layout_cache, entry->key);
+      gimp_text_layout_cache_free (entry);
+    }
+}
+
+static void
+gimp_text_layout_cache_free (GimpTextLayoutCacheEntry *entry)
+{
+  g_object_unref (entry->layout);
+  g_free (entry->key);
+
+  g_slice_free (GimpTextLayoutCacheEntry, entry);
+}
+
 static cairo_font_options_t *
 gimp_text_get_font_options (GimpText *text)
 {
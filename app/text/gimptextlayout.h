@@ -40,6 +40,12 @@ GType            gimp_text_layout_get_type             (void) G_GNUC_CONST;
 GimpTextLayout * gimp_text_layout_new                  (GimpText       *text,
                                                         gdouble         xres,
                                                         gdouble         yres);
+GimpTextLayout * gimp_text_layout_get_cached           (GimpText       *text,
+                                                        gdouble         xres,
+                                                        gdouble         yres);
+void             gimp_text_layout_cache_insert         (GimpTextLayout *layout);
+void             gimp_text_layout_cache_clear          (void);
+
 gboolean         gimp_text_layout_get_size             (GimpTextLayout *layout,
                                                         gint           *width,
                                                         gint           *heigth);
@@ -1063,16 +1063,25 @@ gimp_text_tool_connect (GimpTextTool  *text_tool,
   if (text_tool->layer != layer)
     {
       if (text_tool->layer)
-        g_signal_handlers_disconnect_by_func (text_tool->layer,
-                                              gimp_text_tool_layer_notify,
-                                              text_tool);
+        {
+          g_signal_handlers_disconnect_by_func (text_tool->layer,
+                                                gimp_text_tool_layer_notify,
+                                                text_tool);
+
+          gimp_text_layer_set_async_render (text_tool->layer, FALSE);
+        }
 
       text_tool->layer = layer;
 
       if (layer)
-        g_signal_connect_object (text_tool->layer, "notify",
-                                 G_CALLBACK (gimp_text_tool_layer_notify),
-                                 text_tool, 0);
+        {
+          g_signal_connect_object (text_tool->layer, "notify",
+                                   G_CALLBACK (gimp_text_tool_layer_notify),
+                                   text_tool, 0);
+
+          /*  keep typing responsive, render the layer in the background  */
+          gimp_text_layer_set_async_render (text_tool->layer, TRUE);
+        }
     }
 }
 
@@ -1767,8 +1776,8 @@ gimp_text_tool_ensure_layout (GimpTextTool *text_tool)
 
       gimp_image_get_resolution (image, &xres, &yres);
 
-      text_tool->layout = gimp_text_layout_new (text_tool->layer->text,
-                                                xres, yres);
+      text_tool->layout = gimp_text_layout_get_cached (text_tool->layer->text,
+                                                       xres, yres);
     }
 
   return text_tool->layout != NULL;
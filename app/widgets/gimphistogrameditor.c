@@ -54,6 +54,13 @@ static void     gimp_histogram_editor_layer_changed (GimpImage           *image,
 static void     gimp_histogram_editor_frozen_update (GimpHistogramEditor *editor,
                                                      const GParamSpec    *pspec);
 static void     gimp_histogram_editor_update        (GimpHistogramEditor *editor);
+static void     gimp_histogram_editor_area_update   (GimpDrawable        *drawable,
+                                                     gint                 x,
+                                                     gint                 y,
+                                                     gint                 width,
+                                                     gint                 height,
+                                                     GimpHistogramEditor *editor);
+static void     gimp_histogram_editor_queue_update  (GimpHistogramEditor *editor);
 
 static gboolean gimp_histogram_editor_idle_update   (GimpHistogramEditor *editor);
 static gboolean gimp_histogram_menu_sensitivity     (gint                 value,
@@ -280,7 +287,10 @@ gimp_histogram_editor_set_image (GimpImageEditor *image_editor,
 
   if (image)
     {
-      editor->histogram = gimp_histogram_new ();
+      /*  the histogram is recalculated while painting, let it only
+       *  re-bin what was painted on
+       */
+      editor->histogram = gimp_histogram_new_full (TRUE, TRUE);
 
       gimp_histogram_view_set_histogram (view, editor->histogram);
 
@@ -327,7 +337,7 @@ gimp_histogram_editor_layer_changed (GimpImage           *image,
                                             gimp_histogram_editor_menu_update,
                                             editor);
       g_signal_handlers_disconnect_by_func (editor->drawable,
-                                            gimp_histogram_editor_update,
+                                            gimp_histogram_editor_area_update,
                                             editor);
       g_signal_handlers_disconnect_by_func (editor->drawable,
                                             gimp_histogram_editor_frozen_update,
@@ -346,8 +356,8 @@ gimp_histogram_editor_layer_changed (GimpImage           *image,
                                G_CALLBACK (gimp_histogram_editor_frozen_update),
                                editor, G_CONNECT_SWAPPED);
       g_signal_connect_object (editor->drawable, "update",
-                               G_CALLBACK (gimp_histogram_editor_update),
-                               editor, G_CONNECT_SWAPPED);
+                               G_CALLBACK (gimp_histogram_editor_area_update),
+                               editor, 0);
       g_signal_connect_object (editor->drawable, "alpha-changed",
                                G_CALLBACK (gimp_histogram_editor_menu_update),
                                editor, G_CONNECT_SWAPPED);
@@ -420,15 +430,40 @@ gimp_histogram_editor_frozen_update (GimpHistogramEditor *editor,
 static void
 gimp_histogram_editor_update (GimpHistogramEditor *editor)
 {
-  if (editor->idle_id)
-    g_source_remove (editor->idle_id);
-
-  editor->idle_id =
-    g_timeout_add_full (G_PRIORITY_LOW,
-                        200,
-                        (GSourceFunc) gimp_histogram_editor_idle_update,
-                        editor,
-                        NULL);
+  if (editor->histogram)
+    gimp_histogram_invalidate (editor->histogram, NULL);
+
+  gimp_histogram_editor_queue_update (editor);
+}
+
+static void
+gimp_histogram_editor_area_update (GimpDrawable        *drawable,
+                                   gint                 x,
+                                   gint                 y,
+                                   gint                 width,
+                                   gint                 height,
+                                   GimpHistogramEditor *editor)
+{
+  if (editor->histogram)
+    gimp_histogram_invalidate (editor->histogram,
+                               GEGL_RECTANGLE (x, y, width, height));
+
+  gimp_histogram_editor_queue_update (editor);
+}
+
+static void
+gimp_histogram_editor_queue_update (GimpHistogramEditor *editor)
+{
+  /*  don't restart a pending update, so that the histogram keeps
+   *  following while painting, re-binning only what changed
+   */
+  if (! editor->idle_id)
+    editor->idle_id =
+      g_timeout_add_full (G_PRIORITY_LOW,
+                          200,
+                          (GSourceFunc) gimp_histogram_editor_idle_update,
+                          editor,
+                          NULL);
 }
 
 static gboolean
@@ -516,28 +551,40 @@ gimp_histogram_editor_info_update (GimpHistogramEditor *editor)
 
   if (hist)
     {
+      gint    n_bins;
+      gint    start;
+      gint    end;
+      gint    median;
+      gdouble scale;
       gdouble pixels;
       gdouble count;
       gchar   text[12];
 
-      pixels = gimp_histogram_get_count (hist, view->channel, 0, 255);
-      count  = gimp_histogram_get_count (hist, view->channel,
-                                         view->start, view->end);
+      /*  the view's range is in 0..255, map it to the histogram's bins
+       *  and the results back
+       */
+      n_bins = gimp_histogram_n_bins (hist);
+      start  = view->start * n_bins / 256;
+      end    = (view->end + 1) * n_bins / 256 - 1;
+      scale  = 255.0 / (n_bins - 1);
+
+      pixels = gimp_histogram_get_count (hist, view->channel, 0, n_bins - 1);
+      count  = gimp_histogram_get_count (hist, view->channel, start, end);
 
       g_snprintf (text, sizeof (text), "%.1f",
-                  gimp_histogram_get_mean (hist, view->channel,
-                                           view->start, view->end));
+                  scale * gimp_histogram_get_mean (hist, view->channel,
+                                                   start, end));
       gtk_label_set_text (GTK_LABEL (editor->labels[0]), text);
 
       g_snprintf (text, sizeof (text), "%.1f",
-                  gimp_histogram_get_std_dev (hist, view->channel,
-                                              view->start, view->end));
+                  scale * gimp_histogram_get_std_dev (hist, view->channel,
+                                                      start, end));
       gtk_label_set_text (GTK_LABEL (editor->labels[1]), text);
 
+      median = gimp_histogram_get_median (hist, view->channel, start, end);
+
       g_snprintf (text, sizeof (text), "%.1f",
-                  (gdouble) gimp_histogram_get_median  (hist, view->channel,
-                                                        view->start,
-                                                        view->end));
+                  median >= 0 ? scale * median : (gdouble) median);
       gtk_label_set_text (GTK_LABEL (editor->labels[2]), text);
 
       g_snprintf (text, sizeof (text), "%d", (gint) pixels);
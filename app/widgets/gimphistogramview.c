@@ -286,6 +286,7 @@ gimp_histogram_view_expose (GtkWidget      *widget,
   cairo_t           *cr;
   gint               x;
   gint               x1, x2;
+  gint               n_bins;
   gint               border;
   gint               width, height;
   gdouble            max    = 0.0;
@@ -331,6 +332,12 @@ gimp_histogram_view_expose (GtkWidget      *widget,
   x1 = CLAMP (MIN (view->start, view->end), 0, 255);
   x2 = CLAMP (MAX (view->start, view->end), 0, 255);
 
+  /*  the range is always in 0..255, the histogram can have more bins  */
+  if (view->histogram)
+    n_bins = gimp_histogram_n_bins (view->histogram);
+  else
+    n_bins = gimp_histogram_n_bins (view->bg_histogram);
+
   if (view->histogram)
     max = gimp_histogram_view_get_maximum (view, view->histogram,
                                            view->channel);
@@ -360,16 +367,17 @@ gimp_histogram_view_expose (GtkWidget      *widget,
     {
       gboolean  in_selection = FALSE;
 
-      gint  i = (x * 256) / width;
-      gint  j = ((x + 1) * 256) / width;
+      gint  i = (x * n_bins) / width;
+      gint  j = ((x + 1) * n_bins) / width;
 
       if (! (x1 == 0 && x2 == 255))
         {
-          gint k = i;
+          gint k = (x * 256) / width;
+          gint l = ((x + 1) * 256) / width;
 
           do
             in_selection |= (x1 <= k && k <= x2);
-          while (++k < j);
+          while (++k < l);
         }
 
       if (view->subdivisions > 1 && x >= (xstop * width / view->subdivisions))
@@ -406,6 +406,9 @@ gimp_undo_editor_undo_event (GimpImage      *image,
     case GIMP_UNDO_EVENT_UNDO_THAW:
       gimp_undo_editor_fill (editor);
       break;
+
+    case GIMP_UNDO_EVENT_UNDO_STORED:
+      break;
     }
 }
 
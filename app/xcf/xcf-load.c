@@ -23,6 +23,9 @@
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "libgimpbase/gimpbase.h"
 #include "libgimpcolor/gimpcolor.h"
@@ -64,12 +67,29 @@
 
 #include "xcf-private.h"
 #include "xcf-load.h"
+#include "xcf-parallel.h"
 #include "xcf-read.h"
 #include "xcf-seek.h"
+#include "xcf-tile-handler.h"
 
 #include "gimp-intl.h"
 
 
+typedef struct _XcfLoadTileJob XcfLoadTileJob;
+
+struct _XcfLoadTileJob
+{
+  GeglRectangle       rect;
+  gint                bpp;
+  XcfCompressionType  compression;
+  guchar             *data;        /* the compressed tile      */
+  gint                length;
+  gboolean            skip;        /* no data, leave the tile  */
+  guchar             *tile_data;   /* the uncompressed pixels */
+  gboolean            success;
+};
+
+
 #define MAX_XCF_PARASITE_DATA_LEN (256L * 1024 * 1024)
 
 /* #define GIMP_XCF_PATH_DEBUG */
@@ -101,18 +121,23 @@ static GimpChannel   * xcf_load_channel       (XcfInfo       *info,
 static GimpLayerMask * xcf_load_layer_mask    (XcfInfo       *info,
                                                GimpImage     *image);
 static gboolean        xcf_load_buffer        (XcfInfo       *info,
-                                               GeglBuffer    *buffer);
+                                               GimpDrawable  *drawable);
 static gboolean        xcf_load_level         (XcfInfo       *info,
                                                GeglBuffer    *buffer);
-static gboolean        xcf_load_tile          (XcfInfo       *info,
+static gboolean        xcf_load_level_mapped  (XcfInfo       *info,
+                                               GimpDrawable  *drawable);
+static void            xcf_load_tile_data     (XcfInfo       *info,
+                                               XcfLoadTileJob *job,
+                                               gint           data_length,
+                                               gint           max_data_length);
+static gboolean        xcf_load_tiles         (XcfInfo       *info,
                                                GeglBuffer    *buffer,
-                                               GeglRectangle *tile_rect,
-                                               const Babl    *format);
-static gboolean        xcf_load_tile_rle      (XcfInfo       *info,
-                                               GeglBuffer    *buffer,
-                                               GeglRectangle *tile_rect,
                                                const Babl    *format,
-                                               gint           data_length);
+                                               XcfLoadTileJob *jobs,
+                                               gint           n_jobs);
+static void            xcf_load_tile_job      (XcfLoadTileJob *job,
+                                               gpointer       user_data);
+static void            xcf_load_update_throughput (XcfInfo   *info);
 static GimpParasite  * xcf_load_parasite      (XcfInfo       *info);
 static gboolean        xcf_load_old_paths     (XcfInfo       *info,
                                                GimpImage     *image);
@@ -130,7 +155,10 @@ static gboolean        xcf_skip_unknown_prop  (XcfInfo       *info,
 #define xcf_progress_update(info) G_STMT_START  \
   {                                             \
     if (info->progress)                         \
-      gimp_progress_pulse (info->progress);     \
+      {                                         \
+        gimp_progress_pulse (info->progress);   \
+        xcf_load_update_throughput (info);      \
+      }                                         \
   } G_STMT_END
 
 
@@ -492,6 +520,18 @@ xcf_load_image_props (XcfInfo   *info,
                 return FALSE;
               }
 
+#ifndef HAVE_ZLIB
+            if (compression == COMPRESS_ZLIB)
+              {
+                gimp_message_literal (info->gimp, G_OBJECT (info->progress),
+                                      GIMP_MESSAGE_ERROR,
+                                      _("This XCF file is compressed with "
+                                        "zlib, but GIMP was built without "
+                                        "zlib support."));
+                return FALSE;
+              }
+#endif
+
             info->compression = compression;
           }
           break;
@@ -1231,8 +1271,7 @@ xcf_load_layer (XcfInfo    *info,
       if (! xcf_seek_pos (info, hierarchy_offset, NULL))
         goto error;
 
-      if (! xcf_load_buffer (info,
-                             gimp_drawable_get_buffer (GIMP_DRAWABLE (layer))))
+      if (! xcf_load_buffer (info, GIMP_DRAWABLE (layer)))
         goto error;
 
       xcf_progress_update (info);
@@ -1323,8 +1362,7 @@ xcf_load_channel (XcfInfo   *info,
   if (!xcf_seek_pos (info, hierarchy_offset, NULL))
     goto error;
 
-  if (!xcf_load_buffer (info,
-                        gimp_drawable_get_buffer (GIMP_DRAWABLE (channel))))
+  if (!xcf_load_buffer (info, GIMP_DRAWABLE (channel)))
     goto error;
 
   xcf_progress_update (info);
@@ -1382,8 +1420,7 @@ xcf_load_layer_mask (XcfInfo   *info,
   if (! xcf_seek_pos (info, hierarchy_offset, NULL))
     goto error;
 
-  if (!xcf_load_buffer (info,
-                        gimp_drawable_get_buffer (GIMP_DRAWABLE (layer_mask))))
+  if (!xcf_load_buffer (info, GIMP_DRAWABLE (layer_mask)))
     goto error;
 
   xcf_progress_update (info);
@@ -1400,9 +1437,10 @@ xcf_load_layer_mask (XcfInfo   *info,
 }
 
 static gboolean
-xcf_load_buffer (XcfInfo    *info,
-                 GeglBuffer *buffer)
+xcf_load_buffer (XcfInfo      *info,
+                 GimpDrawable *drawable)
 {
+  GeglBuffer *buffer = gimp_drawable_get_buffer (drawable);
   const Babl *format;
   guint32     saved_pos;
   guint32     offset;
@@ -1449,9 +1487,17 @@ xcf_load_buffer (XcfInfo    *info,
   if (!xcf_seek_pos (info, offset, NULL))
     return FALSE;
 
-  /* read in the level */
-  if (!xcf_load_level (info, buffer))
-    return FALSE;
+  /* read in the level, or only where its tiles are */
+  if (info->mapped_file)
+    {
+      if (!xcf_load_level_mapped (info, drawable))
+        return FALSE;
+    }
+  else
+    {
+      if (!xcf_load_level (info, buffer))
+        return FALSE;
+    }
 
   /* restore the saved position so we'll be ready to
    *  read the next offset.
@@ -1467,17 +1513,24 @@ static gboolean
 xcf_load_level (XcfInfo    *info,
                 GeglBuffer *buffer)
 {
-  const Babl *format;
-  gint        bpp;
-  guint32     saved_pos;
-  guint32     offset, offset2;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        width;
-  gint        height;
-  gint        i;
-  gint        fail;
+  const Babl     *format;
+  gint            bpp;
+  guint32         saved_pos;
+  guint32         offset, offset2;
+  gint            n_tile_rows;
+  gint            n_tile_cols;
+  guint           ntiles;
+  gint            width;
+  gint            height;
+  gint            batch_size;
+  gint            tile_size;
+  gint            max_data_length;
+  XcfLoadTileJob *jobs;
+  guchar         *tile_data;
+  guchar         *xcfdata;
+  gint            n_jobs = 0;
+  gint            i;
+  gboolean        fail   = FALSE;
 
   format = gegl_buffer_get_format (buffer);
   bpp    = babl_format_get_bytes_per_pixel (format);
@@ -1501,18 +1554,43 @@ xcf_load_level (XcfInfo    *info,
   n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
   ntiles = n_tile_rows * n_tile_cols;
-  for (i = 0; i < ntiles; i++)
+
+  /* tiles are read a batch at a time, in file order, and the batch
+   * is then decompressed on all processors
+   */
+  batch_size = MIN (ntiles,
+                    XCF_TILE_BATCH_SIZE * xcf_parallel_get_n_threads (info));
+
+  tile_size = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp;
+
+  /* no compressed tile is larger than this, 1.5 is probably more
+   * than we need to allow for negative compression
+   */
+  max_data_length = tile_size * 1.5;
+
+  jobs      = g_new0 (XcfLoadTileJob, batch_size);
+  tile_data = g_malloc (batch_size * tile_size);
+  xcfdata   = g_malloc (batch_size * max_data_length);
+
+  for (i = 0; i < batch_size; i++)
     {
-      GeglRectangle rect;
+      jobs[i].bpp         = bpp;
+      jobs[i].compression = info->compression;
+      jobs[i].tile_data   = tile_data + i * tile_size;
+      jobs[i].data        = xcfdata   + i * max_data_length;
+    }
 
-      fail = FALSE;
+  for (i = 0; i < ntiles && ! fail; i++)
+    {
+      XcfLoadTileJob *job = &jobs[n_jobs++];
 
       if (offset == 0)
         {
           gimp_message_literal (info->gimp, G_OBJECT (info->progress),
 				GIMP_MESSAGE_ERROR,
 				"not enough tiles found in level");
-          return FALSE;
+          fail = TRUE;
+          break;
         }
 
       /* save the current position as it is where the
@@ -1527,34 +1605,33 @@ xcf_load_level (XcfInfo    *info,
       /* if the offset is 0 then we need to read in the maximum possible
          allowing for negative compression */
       if (offset2 == 0)
-        offset2 = offset + XCF_TILE_WIDTH * XCF_TILE_WIDTH * bpp * 1.5;
-                                        /* 1.5 is probably more
-                                           than we need to allow */
+        offset2 = offset + max_data_length;
 
       /* seek to the tile offset */
       if (! xcf_seek_pos (info, offset, NULL))
-        return FALSE;
+        {
+          fail = TRUE;
+          break;
+        }
 
       /* get the tile from the tile manager */
       gimp_gegl_buffer_get_tile_rect (buffer,
                                       XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
-                                      i, &rect);
+                                      i, &job->rect);
 
       /* read in the tile */
       switch (info->compression)
         {
         case COMPRESS_NONE:
-          if (!xcf_load_tile (info, buffer, &rect, format))
-            fail = TRUE;
+          info->cp += xcf_read_int8 (info->fp, job->tile_data,
+                                     job->rect.width * job->rect.height *
+                                     bpp);
+          job->skip = FALSE;
           break;
         case COMPRESS_RLE:
-          if (!xcf_load_tile_rle (info, buffer, &rect, format,
-                                  offset2 - offset))
-            fail = TRUE;
-          break;
         case COMPRESS_ZLIB:
-          g_error ("xcf: zlib compression unimplemented");
-          fail = TRUE;
+          xcf_load_tile_data (info, job, (gint) (offset2 - offset),
+                              max_data_length);
           break;
         case COMPRESS_FRACTAL:
           g_error ("xcf: fractal compression unimplemented");
@@ -1562,19 +1639,34 @@ xcf_load_level (XcfInfo    *info,
           break;
         }
 
-      if (fail)
-        return FALSE;
-
       /* restore the saved position so we'll be ready to
        *  read the next offset.
        */
       if (!xcf_seek_pos (info, saved_pos, NULL))
-        return FALSE;
+        {
+          fail = TRUE;
+          break;
+        }
 
       /* read in the offset of the next tile */
       info->cp += xcf_read_int32 (info->fp, &offset, 1);
+
+      if (n_jobs == batch_size || i == ntiles - 1)
+        {
+          if (! xcf_load_tiles (info, buffer, format, jobs, n_jobs))
+            fail = TRUE;
+
+          n_jobs = 0;
+        }
     }
 
+  g_free (xcfdata);
+  g_free (tile_data);
+  g_free (jobs);
+
+  if (fail)
+    return FALSE;
+
   if (offset != 0)
     {
       gimp_message (info->gimp, G_OBJECT (info->progress), GIMP_MESSAGE_ERROR,
@@ -1585,64 +1677,199 @@ xcf_load_level (XcfInfo    *info,
   return TRUE;
 }
 
+/*  Instead of reading the tiles, only reads their offsets and gives
+ *  @drawable a buffer that decodes them from the mapped file when
+ *  they are first needed.
+ */
 static gboolean
-xcf_load_tile (XcfInfo       *info,
-               GeglBuffer    *buffer,
-               GeglRectangle *tile_rect,
-               const Babl    *format)
+xcf_load_level_mapped (XcfInfo      *info,
+                       GimpDrawable *drawable)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
+  GeglBuffer *buffer = gimp_drawable_get_buffer (drawable);
+  GeglBuffer *mapped_buffer;
+  guint32    *offsets;
+  gint        n_tile_rows;
+  gint        n_tile_cols;
+  guint       ntiles;
+  gint        width;
+  gint        height;
+  gsize       file_size;
+  gint        i;
+
+  info->cp += xcf_read_int32 (info->fp, (guint32 *) &width, 1);
+  info->cp += xcf_read_int32 (info->fp, (guint32 *) &height, 1);
+
+  if (width  != gegl_buffer_get_width (buffer) ||
+      height != gegl_buffer_get_height (buffer))
+    return FALSE;
+
+  n_tile_rows = gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT);
+  n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
-  info->cp += xcf_read_int8 (info->fp, tile_data, tile_size);
+  ntiles = n_tile_rows * n_tile_cols;
+
+  file_size = g_mapped_file_get_length (info->mapped_file);
+
+  /* the offsets of all tiles plus the terminating '0', an empty
+   * level has just the '0'
+   */
+  offsets = g_new0 (guint32, ntiles + 1);
+
+  info->cp += xcf_read_int32 (info->fp, &offsets[0], 1);
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
+  if (offsets[0] != 0)
+    {
+      info->cp += xcf_read_int32 (info->fp, &offsets[1], ntiles);
+
+      for (i = 0; i < ntiles; i++)
+        {
+          if (offsets[i] == 0 || offsets[i] >= file_size)
+            {
+              gimp_message_literal (info->gimp, G_OBJECT (info->progress),
+                                    GIMP_MESSAGE_ERROR,
+                                    "not enough tiles found in level");
+              g_free (offsets);
+              return FALSE;
+            }
+        }
+
+      if (offsets[ntiles] != 0)
+        {
+          gimp_message (info->gimp, G_OBJECT (info->progress),
+                        GIMP_MESSAGE_ERROR,
+                        "encountered garbage after reading level: %d",
+                        offsets[ntiles]);
+          g_free (offsets);
+          return FALSE;
+        }
+    }
+
+  mapped_buffer = gimp_tile_handler_xcf_buffer_new (info->mapped_file,
+                                                    info->filename,
+                                                    gegl_buffer_get_format (buffer),
+                                                    width, height,
+                                                    info->compression,
+                                                    offsets);
+  g_free (offsets);
+
+  gimp_drawable_set_buffer (drawable, FALSE, NULL, mapped_buffer);
+  g_object_unref (mapped_buffer);
 
   return TRUE;
 }
 
-static gboolean
-xcf_load_tile_rle (XcfInfo       *info,
-                   GeglBuffer    *buffer,
-                   GeglRectangle *tile_rect,
-                   const Babl    *format,
-                   gint           data_length)
+static void
+xcf_load_tile_data (XcfInfo        *info,
+                    XcfLoadTileJob *job,
+                    gint            data_length,
+                    gint            max_data_length)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  gint    i;
-  gint    nmemb_read_successfully;
-  guchar *xcfdata;
-  guchar *xcfodata;
-  guchar *xcfdatalimit;
-
   /* Workaround for bug #357809: avoid crashing on g_malloc() and skip
-   * this tile (return TRUE without storing data) as if it did not
-   * contain any data.  It is better than returning FALSE, which would
-   * skip the whole hierarchy while there may still be some valid
-   * tiles in the file.
+   * this tile (without storing data) as if it did not contain any
+   * data.  It is better than failing, which would skip the whole
+   * hierarchy while there may still be some valid tiles in the file.
    */
   if (data_length <= 0)
-    return TRUE;
+    {
+      job->skip   = TRUE;
+      job->length = 0;
+      return;
+    }
 
-  xcfdata = xcfodata = g_alloca (data_length);
+  job->skip = FALSE;
 
   /* we have to use fread instead of xcf_read_* because we may be
    * reading past the end of the file here
    */
-  nmemb_read_successfully = fread ((gchar *) xcfdata, sizeof (gchar),
-                                   data_length, info->fp);
-  info->cp += nmemb_read_successfully;
+  job->length = fread ((gchar *) job->data, sizeof (gchar),
+                       MIN (data_length, max_data_length), info->fp);
+  info->cp += job->length;
+}
 
-  xcfdatalimit = &xcfodata[nmemb_read_successfully - 1];
+static gboolean
+xcf_load_tiles (XcfInfo        *info,
+                GeglBuffer     *buffer,
+                const Babl     *format,
+                XcfLoadTileJob *jobs,
+                gint            n_jobs)
+{
+  gint i;
+
+  if (info->compression == COMPRESS_NONE)
+    {
+      for (i = 0; i < n_jobs; i++)
+        jobs[i].success = TRUE;
+    }
+  else
+    {
+      xcf_parallel_run (info,
+                        (XcfParallelFunc) xcf_load_tile_job,
+                        jobs, sizeof (XcfLoadTileJob), n_jobs,
+                        NULL);
+    }
+
+  for (i = 0; i < n_jobs; i++)
+    {
+      XcfLoadTileJob *job = &jobs[i];
+
+      if (! job->success)
+        return FALSE;
+
+      if (! job->skip)
+        gegl_buffer_set (buffer, &job->rect, 0, format, job->tile_data,
+                         GEGL_AUTO_ROWSTRIDE);
+    }
+
+  return TRUE;
+}
+
+/*  runs in worker threads, must not touch anything but the job  */
+static void
+xcf_load_tile_job (XcfLoadTileJob *job,
+                   gpointer        user_data)
+{
+  gint n_pixels = job->rect.width * job->rect.height;
+
+  if (job->skip)
+    {
+      job->success = TRUE;
+      return;
+    }
+
+  switch (job->compression)
+    {
+    case COMPRESS_RLE:
+      job->success = xcf_load_decode_rle (job->data, job->length,
+                                          job->tile_data, n_pixels, job->bpp);
+      break;
+
+    case COMPRESS_ZLIB:
+      job->success = xcf_load_decode_zlib (job->data, job->length,
+                                           job->tile_data,
+                                           n_pixels * job->bpp);
+      break;
+
+    default:
+      job->success = FALSE;
+      break;
+    }
+}
+
+gboolean
+xcf_load_decode_rle (const guchar *xcfodata,
+                     gint          data_length,
+                     guchar       *tile_data,
+                     gint          n_pixels,
+                     gint          bpp)
+{
+  const guchar *xcfdata      = xcfodata;
+  const guchar *xcfdatalimit = &xcfodata[data_length - 1];
+  gint          i;
 
   for (i = 0; i < bpp; i++)
     {
       guchar *data  = tile_data + i;
-      gint    size  = tile_rect->width * tile_rect->height;
+      gint    size  = n_pixels;
       gint    count = 0;
       guchar  val;
       gint    length;
@@ -1729,15 +1956,66 @@ xcf_load_tile_rle (XcfInfo       *info,
         }
     }
 
-  gegl_buffer_set (buffer, tile_rect, 0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE);
-
   return TRUE;
 
  bogus_rle:
   return FALSE;
 }
 
+gboolean
+xcf_load_decode_zlib (const guchar *xcfdata,
+                      gint          data_length,
+                      guchar       *tile_data,
+                      gint          tile_size)
+{
+#ifdef HAVE_ZLIB
+  z_stream strm;
+  gint     status;
+
+  strm.next_in   = (guchar *) xcfdata;
+  strm.avail_in  = data_length;
+  strm.next_out  = tile_data;
+  strm.avail_out = tile_size;
+  strm.zalloc    = Z_NULL;
+  strm.zfree     = Z_NULL;
+  strm.opaque    = Z_NULL;
+
+  if (inflateInit (&strm) != Z_OK)
+    return FALSE;
+
+  status = inflate (&strm, Z_FINISH);
+
+  inflateEnd (&strm);
+
+  /* the stream must decode to exactly one tile */
+  return (status == Z_STREAM_END && strm.avail_out == 0);
+#else
+  return FALSE;
+#endif
+}
+
+/*  shows how fast we are reading, in the progress text  */
+static void
+xcf_load_update_throughput (XcfInfo *info)
+{
+  gdouble elapsed;
+
+  elapsed = (gdouble) (g_get_monotonic_time () - info->start_time) /
+            G_USEC_PER_SEC;
+
+  if (elapsed > 0.0)
+    {
+      gchar *name = g_filename_display_name (info->filename);
+      gchar *msg  = g_strdup_printf (_("Opening '%s' (%.1f MB/s)"), name,
+                                     info->cp / elapsed / (1024.0 * 1024.0));
+
+      gimp_progress_set_text (info->progress, msg);
+
+      g_free (msg);
+      g_free (name);
+    }
+}
+
 static GimpParasite *
 xcf_load_parasite (XcfInfo *info)
 {
@@ -19,9 +19,19 @@
 #define __XCF_LOAD_H__
 
 
-GimpImage * xcf_load_image (Gimp     *gimp,
-                            XcfInfo  *info,
-                            GError  **error);
+GimpImage * xcf_load_image       (Gimp         *gimp,
+                                  XcfInfo      *info,
+                                  GError      **error);
+
+gboolean    xcf_load_decode_rle  (const guchar *xcfodata,
+                                  gint          data_length,
+                                  guchar       *tile_data,
+                                  gint          n_pixels,
+                                  gint          bpp);
+gboolean    xcf_load_decode_zlib (const guchar *xcfdata,
+                                  gint          data_length,
+                                  guchar       *tile_data,
+                                  gint          tile_size);
 
 
 #endif  /* __XCF_LOAD_H__ */
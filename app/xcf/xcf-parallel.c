@@ -0,0 +1,93 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#include <cairo.h>
+#include <gegl.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "core/core-types.h"
+
+#include "core/gimp.h"
+#include "core/gimp-parallel.h"
+
+#include "xcf-private.h"
+#include "xcf-parallel.h"
+
+
+/*  Tile payloads are independent of each other, so while the file
+ *  itself is written and read strictly in order, the encoding and
+ *  decoding of a batch of tiles is spread over gimp_parallel_run().
+ */
+
+typedef struct _XcfParallelTask XcfParallelTask;
+
+struct _XcfParallelTask
+{
+  XcfParallelFunc  func;
+  guchar          *jobs;
+  gsize            job_size;
+  gpointer         user_data;
+};
+
+
+static void   xcf_parallel_job (gint             job,
+                                XcfParallelTask *task);
+
+
+gint
+xcf_parallel_get_n_threads (XcfInfo *info)
+{
+  g_return_val_if_fail (info != NULL, 1);
+
+  return gimp_parallel_get_n_threads (info->gimp);
+}
+
+void
+xcf_parallel_run (XcfInfo         *info,
+                  XcfParallelFunc  func,
+                  gpointer         jobs,
+                  gsize            job_size,
+                  gint             n_jobs,
+                  gpointer         user_data)
+{
+  XcfParallelTask task;
+
+  g_return_if_fail (info != NULL);
+  g_return_if_fail (func != NULL);
+
+  task.func      = func;
+  task.jobs      = jobs;
+  task.job_size  = job_size;
+  task.user_data = user_data;
+
+  gimp_parallel_run (info->gimp, n_jobs,
+                     (GimpParallelFunc) xcf_parallel_job, &task);
+}
+
+
+/*  private functions  */
+
+static void
+xcf_parallel_job (gint             job,
+                  XcfParallelTask *task)
+{
+  task->func (task->jobs + job * task->job_size, task->user_data);
+}
@@ -22,6 +22,11 @@
 #define XCF_TILE_WIDTH  64
 #define XCF_TILE_HEIGHT 64
 
+/* the number of tiles per worker thread that are compressed or
+ * decompressed in one go
+ */
+#define XCF_TILE_BATCH_SIZE 16
+
 typedef enum
 {
   PROP_END                =  0,
@@ -63,7 +68,7 @@ typedef enum
 {
   COMPRESS_NONE              =  0,
   COMPRESS_RLE               =  1,
-  COMPRESS_ZLIB              =  2,  /* unused */
+  COMPRESS_ZLIB              =  2,
   COMPRESS_FRACTAL           =  3   /* unused */
 } XcfCompressionType;
 
@@ -103,6 +108,8 @@ struct _XcfInfo
   gint               *ref_count;
   XcfCompressionType  compression;
   gint                file_version;
+  gint64              start_time;
+  GMappedFile        *mapped_file;
 };
 
 
@@ -23,12 +23,17 @@
 #include <cairo.h>
 #include <gegl.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "libgimpbase/gimpbase.h"
 #include "libgimpcolor/gimpcolor.h"
 
 #include "core/core-types.h"
 
+#include "config/gimpcoreconfig.h"
+
 #include "gegl/gimp-babl-compat.h"
 #include "gegl/gimp-gegl-tile-compat.h"
 
@@ -60,6 +65,7 @@
 #include "vectors/gimpvectors-compat.h"
 
 #include "xcf-private.h"
+#include "xcf-parallel.h"
 #include "xcf-read.h"
 #include "xcf-save.h"
 #include "xcf-seek.h"
@@ -68,6 +74,21 @@
 #include "gimp-intl.h"
 
 
+typedef struct _XcfSaveTileJob XcfSaveTileJob;
+
+struct _XcfSaveTileJob
+{
+  GeglRectangle       rect;
+  gint                bpp;
+  XcfCompressionType  compression;
+  guchar             *tile_data;   /* the uncompressed pixels */
+  guchar             *data;        /* the compressed tile      */
+  gint                data_size;
+  gint                length;      /* -1 if compression failed */
+};
+
+
+static void     xcf_save_update_throughput (XcfInfo       *info);
 static gboolean xcf_save_image_props   (XcfInfo           *info,
                                         GimpImage         *image,
                                         GError           **error);
@@ -98,17 +119,21 @@ static gboolean xcf_save_buffer        (XcfInfo           *info,
 static gboolean xcf_save_level         (XcfInfo           *info,
                                         GeglBuffer        *buffer,
                                         GError           **error);
-static gboolean xcf_save_tile          (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
-                                        GeglRectangle     *tile_rect,
-                                        const Babl        *format,
-                                        GError           **error);
-static gboolean xcf_save_tile_rle      (XcfInfo           *info,
-                                        GeglBuffer        *buffer,
-                                        GeglRectangle     *tile_rect,
-                                        const Babl        *format,
-                                        guchar            *rlebuf,
+static gboolean xcf_save_tiles         (XcfInfo           *info,
+                                        XcfSaveTileJob    *jobs,
+                                        gint               n_jobs,
+                                        guint32           *saved_pos,
                                         GError           **error);
+static void     xcf_save_tile_job      (XcfSaveTileJob    *job,
+                                        gpointer           user_data);
+static gint     xcf_save_encode_rle    (const guchar      *tile_data,
+                                        gint               n_pixels,
+                                        gint               bpp,
+                                        guchar            *rlebuf);
+static gint     xcf_save_encode_zlib   (const guchar      *tile_data,
+                                        gint               tile_size,
+                                        guchar            *zlibbuf,
+                                        gint               zlibbuf_size);
 static gboolean xcf_save_parasite      (XcfInfo           *info,
                                         GimpParasite      *parasite,
                                         GError           **error);
@@ -174,8 +199,11 @@ static gboolean xcf_save_vectors       (XcfInfo           *info,
   {                                             \
     progress++;                                 \
     if (info->progress)                         \
-      gimp_progress_set_value (info->progress,  \
-                               (gdouble) progress / (gdouble) max_progress); \
+      {                                         \
+        gimp_progress_set_value (info->progress,  \
+                                 (gdouble) progress / (gdouble) max_progress); \
+        xcf_save_update_throughput (info);      \
+      }                                         \
   } G_STMT_END
 
 
@@ -218,6 +246,18 @@ xcf_save_choose_format (XcfInfo   *info,
   if (gimp_image_get_precision (image) != GIMP_PRECISION_U8)
     save_version = MAX (4, save_version);
 
+#ifdef HAVE_ZLIB
+  /* need version 5 for zlib compression, which we use for higher bit
+   * depths unless disabled, since readers of those are new anyway, and
+   * byte-oriented RLE does poorly on multi-byte channels
+   */
+  if (save_version >= 4 && info->gimp->config->xcf_zlib_compression)
+    {
+      info->compression = COMPRESS_ZLIB;
+      save_version = MAX (5, save_version);
+    }
+#endif
+
   info->file_version = save_version;
 }
 
@@ -240,6 +280,9 @@ xcf_save_image (XcfInfo    *info,
   gchar    version_tag[16];
   GError  *tmp_error = NULL;
 
+  /* finish rendering the text layers, xcf_save() may be called directly */
+  gimp_text_layer_flush_all ();
+
   /* write out the tag information for the image */
   if (info->file_version > 0)
     {
@@ -1415,18 +1458,25 @@ xcf_save_level (XcfInfo     *info,
                 GeglBuffer  *buffer,
                 GError     **error)
 {
-  const Babl *format;
-  guint32     saved_pos;
-  guint32     offset;
-  guint32     width;
-  guint32     height;
-  gint        bpp;
-  gint        n_tile_rows;
-  gint        n_tile_cols;
-  guint       ntiles;
-  gint        i;
-  guchar     *rlebuf;
-  GError     *tmp_error = NULL;
+  const Babl      *format;
+  guint32          saved_pos;
+  guint32          offset;
+  guint32          width;
+  guint32          height;
+  gint             bpp;
+  gint             n_tile_rows;
+  gint             n_tile_cols;
+  guint            ntiles;
+  gint             batch_size;
+  gint             tile_size;
+  gint             compressbuf_size;
+  XcfSaveTileJob  *jobs;
+  guchar          *tile_data;
+  guchar          *compressbuf;
+  gint             first;
+  gint             i;
+  gboolean         success   = TRUE;
+  GError          *tmp_error = NULL;
 
   format = gegl_buffer_get_format (buffer);
 
@@ -1439,43 +1489,115 @@ xcf_save_level (XcfInfo     *info,
 
   saved_pos = info->cp;
 
-  /* allocate a temporary buffer to store the rle data before it is
-   * written to disk
-   */
-  rlebuf = g_alloca (XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp * 1.5);
-
   n_tile_rows = gimp_gegl_buffer_get_n_tile_rows (buffer, XCF_TILE_HEIGHT);
   n_tile_cols = gimp_gegl_buffer_get_n_tile_cols (buffer, XCF_TILE_WIDTH);
 
   ntiles = n_tile_rows * n_tile_cols;
   xcf_check_error (xcf_seek_pos (info, info->cp + (ntiles + 1) * 4, error));
 
-  for (i = 0; i < ntiles; i++)
+  /* tiles are fetched, compressed and written a batch at a time; the
+   * compression of a batch is spread over all processors, while
+   * xcf_save_tiles() writes the tiles and their offsets in order
+   */
+  batch_size = MIN (ntiles,
+                    XCF_TILE_BATCH_SIZE * xcf_parallel_get_n_threads (info));
+
+  tile_size        = XCF_TILE_WIDTH * XCF_TILE_HEIGHT * bpp;
+  compressbuf_size = tile_size * 1.5;
+
+  jobs        = g_new0 (XcfSaveTileJob, batch_size);
+  tile_data   = g_malloc (batch_size * tile_size);
+  compressbuf = g_malloc (batch_size * compressbuf_size);
+
+  for (i = 0; i < batch_size; i++)
     {
-      GeglRectangle rect;
+      jobs[i].tile_data   = tile_data   + i * tile_size;
+      jobs[i].bpp         = bpp;
+      jobs[i].compression = info->compression;
+      jobs[i].data_size   = compressbuf_size;
+      jobs[i].data        = compressbuf + i * compressbuf_size;
+    }
+
+  for (first = 0; success && first < ntiles; first += batch_size)
+    {
+      gint n_jobs = MIN (batch_size, ntiles - first);
+
+      for (i = 0; i < n_jobs; i++)
+        {
+          gimp_gegl_buffer_get_tile_rect (buffer,
+                                          XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
+                                          first + i, &jobs[i].rect);
+
+          gegl_buffer_get (buffer, &jobs[i].rect, 1.0, format,
+                           jobs[i].tile_data,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+        }
+
+      if (info->compression != COMPRESS_NONE)
+        xcf_parallel_run (info,
+                          (XcfParallelFunc) xcf_save_tile_job,
+                          jobs, sizeof (XcfSaveTileJob), n_jobs,
+                          NULL);
+
+      success = xcf_save_tiles (info, jobs, n_jobs, &saved_pos, error);
+    }
+
+  g_free (compressbuf);
+  g_free (tile_data);
+  g_free (jobs);
+
+  if (! success)
+    return FALSE;
+
+  /* write out a '0' offset position to indicate the end
+   *  of the level offsets.
+   */
+  offset = 0;
+  xcf_check_error (xcf_seek_pos (info, saved_pos, error));
+  xcf_write_int32_check_error (info, &offset, 1);
+
+  return TRUE;
+
+}
+
+static gboolean
+xcf_save_tiles (XcfInfo         *info,
+                XcfSaveTileJob  *jobs,
+                gint             n_jobs,
+                guint32         *saved_pos,
+                GError         **error)
+{
+  gint    i;
+  GError *tmp_error = NULL;
+
+  for (i = 0; i < n_jobs; i++)
+    {
+      XcfSaveTileJob *job = &jobs[i];
+      guint32         offset;
 
       /* save the start offset of where we are writing
        *  out the next tile.
        */
       offset = info->cp;
 
-      gimp_gegl_buffer_get_tile_rect (buffer,
-                                      XCF_TILE_WIDTH, XCF_TILE_HEIGHT,
-                                      i, &rect);
-
       /* write out the tile. */
       switch (info->compression)
         {
         case COMPRESS_NONE:
-          xcf_check_error (xcf_save_tile (info, buffer, &rect, format,
-                                          error));
+          xcf_write_int8_check_error (info, job->tile_data,
+                                      job->rect.width * job->rect.height *
+                                      job->bpp);
           break;
         case COMPRESS_RLE:
-          xcf_check_error (xcf_save_tile_rle (info, buffer, &rect, format,
-                                              rlebuf, error));
-          break;
         case COMPRESS_ZLIB:
-          g_error ("xcf: zlib compression unimplemented");
+          if (job->length < 0)
+            {
+              g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                           _("Error compressing tile data"));
+              return FALSE;
+            }
+
+          xcf_write_int8_check_error (info, job->data, job->length);
           break;
         case COMPRESS_FRACTAL:
           g_error ("xcf: fractal compression unimplemented");
@@ -1485,13 +1607,13 @@ xcf_save_level (XcfInfo     *info,
       /* seek back to where we are to write out the next
        *  tile offset and write it out.
        */
-      xcf_check_error (xcf_seek_pos (info, saved_pos, error));
+      xcf_check_error (xcf_seek_pos (info, *saved_pos, error));
       xcf_write_int32_check_error (info, &offset, 1);
 
       /* increment the location we are to write out the
        *  next offset.
        */
-      saved_pos = info->cp;
+      *saved_pos = info->cp;
 
       /* seek to the end of the file which is where
        *  we will write out the next tile.
@@ -1499,54 +1621,42 @@ xcf_save_level (XcfInfo     *info,
       xcf_check_error (xcf_seek_end (info, error));
     }
 
-  /* write out a '0' offset position to indicate the end
-   *  of the level offsets.
-   */
-  offset = 0;
-  xcf_check_error (xcf_seek_pos (info, saved_pos, error));
-  xcf_write_int32_check_error (info, &offset, 1);
-
   return TRUE;
-
 }
 
-static gboolean
-xcf_save_tile (XcfInfo        *info,
-               GeglBuffer     *buffer,
-               GeglRectangle  *tile_rect,
-               const Babl     *format,
-               GError        **error)
+/*  runs in worker threads, must not touch anything but the job  */
+static void
+xcf_save_tile_job (XcfSaveTileJob *job,
+                   gpointer        user_data)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  GError *tmp_error = NULL;
+  gint n_pixels = job->rect.width * job->rect.height;
 
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  switch (job->compression)
+    {
+    case COMPRESS_RLE:
+      job->length = xcf_save_encode_rle (job->tile_data, n_pixels, job->bpp,
+                                         job->data);
+      break;
 
-  xcf_write_int8_check_error (info, tile_data, tile_size);
+    case COMPRESS_ZLIB:
+      job->length = xcf_save_encode_zlib (job->tile_data, n_pixels * job->bpp,
+                                          job->data, job->data_size);
+      break;
 
-  return TRUE;
+    default:
+      job->length = -1;
+      break;
+    }
 }
 
-static gboolean
-xcf_save_tile_rle (XcfInfo        *info,
-                   GeglBuffer     *buffer,
-                   GeglRectangle  *tile_rect,
-                   const Babl     *format,
-                   guchar         *rlebuf,
-                   GError        **error)
+static gint
+xcf_save_encode_rle (const guchar *tile_data,
+                     gint          n_pixels,
+                     gint          bpp,
+                     guchar       *rlebuf)
 {
-  gint    bpp       = babl_format_get_bytes_per_pixel (format);
-  gint    tile_size = bpp * tile_rect->width * tile_rect->height;
-  guchar *tile_data = g_alloca (tile_size);
-  gint    len       = 0;
-  gint    i, j;
-  GError *tmp_error  = NULL;
-
-  gegl_buffer_get (buffer, tile_rect, 1.0, format, tile_data,
-                   GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+  gint len = 0;
+  gint i, j;
 
   for (i = 0; i < bpp; i++)
     {
@@ -1554,7 +1664,7 @@ xcf_save_tile_rle (XcfInfo        *info,
       gint          state  = 0;
       gint          length = 0;
       gint          count  = 0;
-      gint          size   = tile_rect->width * tile_rect->height;
+      gint          size   = n_pixels;
       guint         last   = -1;
 
       while (size > 0)
@@ -1640,13 +1750,68 @@ xcf_save_tile_rle (XcfInfo        *info,
             }
         }
 
-      if (count != (tile_rect->width * tile_rect->height))
-        g_message ("xcf: uh oh! xcf rle tile saving error: %d", count);
+      if (count != n_pixels)
+        return -1;
     }
 
-  xcf_write_int8_check_error (info, rlebuf, len);
+  return len;
+}
 
-  return TRUE;
+static gint
+xcf_save_encode_zlib (const guchar *tile_data,
+                      gint          tile_size,
+                      guchar       *zlibbuf,
+                      gint          zlibbuf_size)
+{
+#ifdef HAVE_ZLIB
+  z_stream strm;
+  gint     status;
+
+  strm.zalloc = Z_NULL;
+  strm.zfree  = Z_NULL;
+  strm.opaque = Z_NULL;
+
+  if (deflateInit (&strm, Z_DEFAULT_COMPRESSION) != Z_OK)
+    return -1;
+
+  strm.next_in   = (guchar *) tile_data;
+  strm.avail_in  = tile_size;
+  strm.next_out  = zlibbuf;
+  strm.avail_out = zlibbuf_size;
+
+  status = deflate (&strm, Z_FINISH);
+
+  deflateEnd (&strm);
+
+  if (status != Z_STREAM_END)
+    return -1;
+
+  return zlibbuf_size - strm.avail_out;
+#else
+  return -1;
+#endif
+}
+
+/*  shows how fast we are writing, in the progress text  */
+static void
+xcf_save_update_throughput (XcfInfo *info)
+{
+  gdouble elapsed;
+
+  elapsed = (gdouble) (g_get_monotonic_time () - info->start_time) /
+            G_USEC_PER_SEC;
+
+  if (elapsed > 0.0)
+    {
+      gchar *name = g_filename_display_name (info->filename);
+      gchar *msg  = g_strdup_printf (_("Saving '%s' (%.1f MB/s)"), name,
+                                     info->cp / elapsed / (1024.0 * 1024.0));
+
+      gimp_progress_set_text (info->progress, msg);
+
+      g_free (msg);
+      g_free (name);
+    }
 }
 
 static gboolean
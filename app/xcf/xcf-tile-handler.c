@@ -0,0 +1,486 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cairo.h>
+#include <gegl.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glib/gstdio.h>
+
+#include "core/core-types.h"
+
+#include "xcf-private.h"
+#include "xcf-load.h"
+#include "xcf-tile-handler.h"
+
+
+static void       gimp_tile_handler_xcf_finalize    (GObject            *object);
+
+static gpointer   gimp_tile_handler_xcf_command     (GeglTileSource     *source,
+                                                     GeglTileCommand     command,
+                                                     gint                x,
+                                                     gint                y,
+                                                     gint                z,
+                                                     gpointer            data);
+
+static GeglTile * gimp_tile_handler_xcf_materialize (GimpTileHandlerXcf *handler,
+                                                     gint                x,
+                                                     gint                y);
+static void       gimp_tile_handler_xcf_decode      (GimpTileHandlerXcf *handler,
+                                                     gint                index,
+                                                     guchar             *dest);
+
+
+G_DEFINE_TYPE (GimpTileHandlerXcf, gimp_tile_handler_xcf,
+               GEGL_TYPE_TILE_HANDLER)
+
+#define parent_class gimp_tile_handler_xcf_parent_class
+
+
+/*  all handlers that still map a file, so they can let go of it
+ *  before the file gets overwritten
+ */
+static GList  *handlers = NULL;
+static GMutex  handlers_mutex;
+
+
+static void
+gimp_tile_handler_xcf_class_init (GimpTileHandlerXcfClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gimp_tile_handler_xcf_finalize;
+}
+
+static void
+gimp_tile_handler_xcf_init (GimpTileHandlerXcf *handler)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (handler);
+
+  source->command = gimp_tile_handler_xcf_command;
+
+  g_rec_mutex_init (&handler->mutex);
+}
+
+static void
+gimp_tile_handler_xcf_finalize (GObject *object)
+{
+  GimpTileHandlerXcf *handler = GIMP_TILE_HANDLER_XCF (object);
+
+  g_mutex_lock (&handlers_mutex);
+  handlers = g_list_remove (handlers, handler);
+  g_mutex_unlock (&handlers_mutex);
+
+  if (handler->file)
+    {
+      g_mapped_file_unref (handler->file);
+      handler->file = NULL;
+    }
+
+  if (handler->gfile)
+    {
+      g_object_unref (handler->gfile);
+      handler->gfile = NULL;
+    }
+
+  g_free (handler->offsets);
+  g_free (handler->touched);
+
+  g_rec_mutex_clear (&handler->mutex);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/*  whether tile @x, @y still has to come from the file, must be
+ *  called with the handler's mutex held
+ */
+static gboolean
+gimp_tile_handler_xcf_in_file (GimpTileHandlerXcf *handler,
+                               gint                x,
+                               gint                y)
+{
+  gint index;
+
+  if (! handler->file                   ||
+      x < 0 || x >= handler->n_tile_cols ||
+      y < 0 || y >= handler->n_tile_rows)
+    return FALSE;
+
+  index = y * handler->n_tile_cols + x;
+
+  return ! handler->touched[index] && handler->offsets[index] != 0;
+}
+
+static void
+gimp_tile_handler_xcf_touch (GimpTileHandlerXcf *handler,
+                             gint                x,
+                             gint                y)
+{
+  if (x >= 0 && x < handler->n_tile_cols &&
+      y >= 0 && y < handler->n_tile_rows)
+    {
+      handler->touched[y * handler->n_tile_cols + x] = TRUE;
+    }
+}
+
+static gpointer
+gimp_tile_handler_xcf_command (GeglTileSource  *source,
+                               GeglTileCommand  command,
+                               gint             x,
+                               gint             y,
+                               gint             z,
+                               gpointer         data)
+{
+  GimpTileHandlerXcf *handler = GIMP_TILE_HANDLER_XCF (source);
+  gpointer            retval  = NULL;
+
+  g_rec_mutex_lock (&handler->mutex);
+
+  switch (command)
+    {
+    case GEGL_TILE_GET:
+      if (z == 0)
+        {
+          if (gimp_tile_handler_xcf_in_file (handler, x, y))
+            {
+              retval = gimp_tile_handler_xcf_materialize (handler, x, y);
+              break;
+            }
+        }
+      else
+        {
+          /*  the zoom levels are built from the level 0 tiles below
+           *  us, so those have to be there first
+           */
+          gint x0 = x << z;
+          gint y0 = y << z;
+          gint n  = 1 << z;
+          gint i, j;
+
+          for (j = y0; j < y0 + n; j++)
+            for (i = x0; i < x0 + n; i++)
+              if (gimp_tile_handler_xcf_in_file (handler, i, j))
+                gegl_tile_unref (gimp_tile_handler_xcf_materialize (handler,
+                                                                    i, j));
+        }
+
+      retval = gegl_tile_handler_source_command (source, command,
+                                                 x, y, z, data);
+      break;
+
+    case GEGL_TILE_SET:
+    case GEGL_TILE_VOID:
+      /*  from now on, the tile's contents are whatever is below us  */
+      if (z == 0)
+        gimp_tile_handler_xcf_touch (handler, x, y);
+
+      retval = gegl_tile_handler_source_command (source, command,
+                                                 x, y, z, data);
+      break;
+
+    case GEGL_TILE_EXIST:
+      if (z == 0 && gimp_tile_handler_xcf_in_file (handler, x, y))
+        retval = GINT_TO_POINTER (TRUE);
+      else
+        retval = gegl_tile_handler_source_command (source, command,
+                                                   x, y, z, data);
+      break;
+
+    default:
+      retval = gegl_tile_handler_source_command (source, command,
+                                                 x, y, z, data);
+      break;
+    }
+
+  g_rec_mutex_unlock (&handler->mutex);
+
+  return retval;
+}
+
+/*  decodes tile @x, @y from the file and stores it below us, so it is
+ *  cached and swapped like any other tile, must be called with the
+ *  handler's mutex held
+ */
+static GeglTile *
+gimp_tile_handler_xcf_materialize (GimpTileHandlerXcf *handler,
+                                   gint                x,
+                                   gint                y)
+{
+  GeglTileSource *source = GEGL_TILE_SOURCE (handler);
+  GeglTile       *tile;
+
+  tile = gegl_tile_handler_create_tile (GEGL_TILE_HANDLER (handler), x, y, 0);
+
+  gegl_tile_lock (tile);
+
+  gimp_tile_handler_xcf_decode (handler, y * handler->n_tile_cols + x,
+                                gegl_tile_get_data (tile));
+
+  gegl_tile_unlock (tile);
+
+  gimp_tile_handler_xcf_touch (handler, x, y);
+
+  gegl_tile_handler_source_command (source, GEGL_TILE_SET, x, y, 0, tile);
+
+  return tile;
+}
+
+/*  decodes tile @index from the mapped file into the (full size) tile
+ *  data @dest, must be called with the handler's mutex held
+ */
+static void
+gimp_tile_handler_xcf_decode (GimpTileHandlerXcf *handler,
+                              gint                index,
+                              guchar             *dest)
+{
+  GeglRectangle  rect;
+  const guchar  *file_data;
+  gsize          file_size;
+  guint32        offset;
+  guint32        next;
+  gint           tile_stride = XCF_TILE_WIDTH * handler->bpp;
+  gint           tile_size   = tile_stride * XCF_TILE_HEIGHT;
+  gint           data_length;
+  guchar        *pixels;
+  gboolean       success     = FALSE;
+  gint           row;
+
+  memset (dest, 0, tile_size);
+
+  if (! handler->file)
+    return;
+
+  file_data = (const guchar *) g_mapped_file_get_contents (handler->file);
+  file_size = g_mapped_file_get_length (handler->file);
+
+  offset = handler->offsets[index];
+  next   = handler->offsets[index + 1];
+
+  if (offset == 0 || offset >= file_size)
+    return;
+
+  rect.x      = (index % handler->n_tile_cols) * XCF_TILE_WIDTH;
+  rect.y      = (index / handler->n_tile_cols) * XCF_TILE_HEIGHT;
+  rect.width  = MIN (XCF_TILE_WIDTH,  handler->width  - rect.x);
+  rect.height = MIN (XCF_TILE_HEIGHT, handler->height - rect.y);
+
+  /* see xcf_load_level() */
+  data_length = tile_size * 1.5;
+
+  if (next > offset)
+    data_length = MIN (data_length, next - offset);
+
+  data_length = MIN (data_length, file_size - offset);
+
+  pixels = g_alloca (rect.width * rect.height * handler->bpp);
+
+  switch (handler->compression)
+    {
+    case COMPRESS_NONE:
+      if (data_length >= rect.width * rect.height * handler->bpp)
+        {
+          memcpy (pixels, file_data + offset,
+                  rect.width * rect.height * handler->bpp);
+          success = TRUE;
+        }
+      break;
+
+    case COMPRESS_RLE:
+      success = xcf_load_decode_rle (file_data + offset, data_length,
+                                     pixels, rect.width * rect.height,
+                                     handler->bpp);
+      break;
+
+    case COMPRESS_ZLIB:
+      success = xcf_load_decode_zlib (file_data + offset, data_length,
+                                      pixels,
+                                      rect.width * rect.height *
+                                      handler->bpp);
+      break;
+
+    case COMPRESS_FRACTAL:
+      break;
+    }
+
+  if (! success)
+    {
+      gchar *name = g_file_get_parse_name (handler->gfile);
+
+      g_printerr ("xcf: could not decode tile %d of '%s'\n", index, name);
+      g_free (name);
+      return;
+    }
+
+  for (row = 0; row < rect.height; row++)
+    memcpy (dest + row * tile_stride,
+            pixels + row * rect.width * handler->bpp,
+            rect.width * handler->bpp);
+}
+
+/*  whether @handler maps the file @file with the status @st, comparing
+ *  device and inode so other names of the same file match too
+ */
+static gboolean
+gimp_tile_handler_xcf_maps (GimpTileHandlerXcf *handler,
+                            GFile              *file,
+                            const GStatBuf     *st)
+{
+  if (! handler->file)
+    return FALSE;
+
+  if (st && st->st_ino != 0)
+    return (handler->device == (guint64) st->st_dev &&
+            handler->inode  == (guint64) st->st_ino);
+
+  return g_file_equal (handler->gfile, file);
+}
+
+
+/*  public functions  */
+
+/**
+ * gimp_tile_handler_xcf_buffer_new:
+ * @file:        the mapped XCF file
+ * @filename:    the file's name
+ * @format:      the pixel format of the level
+ * @width:       the width of the level
+ * @height:      the height of the level
+ * @compression: the compression of the level's tiles
+ * @offsets:     the file offsets of all tiles, followed by a 0
+ *
+ * Creates a buffer whose tiles are decoded from @file when they are
+ * first accessed. The file stays mapped until the buffer is destroyed
+ * or gimp_tile_handler_xcf_detach_file() is called.
+ *
+ * Return value: the new buffer.
+ **/
+GeglBuffer *
+gimp_tile_handler_xcf_buffer_new (GMappedFile        *file,
+                                  const gchar        *filename,
+                                  const Babl         *format,
+                                  gint                width,
+                                  gint                height,
+                                  XcfCompressionType  compression,
+                                  const guint32      *offsets)
+{
+  GimpTileHandlerXcf *handler;
+  GeglBuffer         *buffer;
+  GStatBuf            st;
+  gint                n_tiles;
+
+  g_return_val_if_fail (file != NULL, NULL);
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (format != NULL, NULL);
+  g_return_val_if_fail (offsets != NULL, NULL);
+
+  /*  one buffer tile per XCF tile  */
+  buffer = g_object_new (GEGL_TYPE_BUFFER,
+                         "x",           0,
+                         "y",           0,
+                         "width",       width,
+                         "height",      height,
+                         "format",      format,
+                         "tile-width",  XCF_TILE_WIDTH,
+                         "tile-height", XCF_TILE_HEIGHT,
+                         NULL);
+
+  handler = g_object_new (GIMP_TYPE_TILE_HANDLER_XCF, NULL);
+
+  handler->file        = g_mapped_file_ref (file);
+  handler->gfile       = g_file_new_for_path (filename);
+  handler->compression = compression;
+  handler->format      = format;
+  handler->bpp         = babl_format_get_bytes_per_pixel (format);
+  handler->width       = width;
+  handler->height      = height;
+  handler->n_tile_cols = (width  + XCF_TILE_WIDTH  - 1) / XCF_TILE_WIDTH;
+  handler->n_tile_rows = (height + XCF_TILE_HEIGHT - 1) / XCF_TILE_HEIGHT;
+
+  if (g_stat (filename, &st) == 0)
+    {
+      handler->device = st.st_dev;
+      handler->inode  = st.st_ino;
+    }
+
+  n_tiles = handler->n_tile_cols * handler->n_tile_rows;
+
+  handler->offsets = g_memdup (offsets, (n_tiles + 1) * sizeof (guint32));
+  handler->touched = g_new0 (guchar, n_tiles);
+
+  gegl_buffer_add_handler (buffer, handler);
+
+  g_object_set_data_full (G_OBJECT (buffer), "gimp-xcf-tile-handler",
+                          handler,
+                          (GDestroyNotify) g_object_unref);
+
+  g_mutex_lock (&handlers_mutex);
+  handlers = g_list_prepend (handlers, handler);
+  g_mutex_unlock (&handlers_mutex);
+
+  return buffer;
+}
+
+/*  Makes all buffers that map @filename, under whatever name, move
+ *  their remaining tiles into their own cache and swap and let go of
+ *  the file, which must be done before the file is overwritten.
+ */
+void
+gimp_tile_handler_xcf_detach_file (const gchar *filename)
+{
+  GFile    *file;
+  GStatBuf  st;
+  gboolean  have_stat;
+  GList    *list;
+
+  g_return_if_fail (filename != NULL);
+
+  file      = g_file_new_for_path (filename);
+  have_stat = (g_stat (filename, &st) == 0);
+
+  g_mutex_lock (&handlers_mutex);
+
+  for (list = handlers; list; list = g_list_next (list))
+    {
+      GimpTileHandlerXcf *handler = list->data;
+      gint                x, y;
+
+      g_rec_mutex_lock (&handler->mutex);
+
+      if (gimp_tile_handler_xcf_maps (handler, file,
+                                      have_stat ? &st : NULL))
+        {
+          for (y = 0; y < handler->n_tile_rows; y++)
+            for (x = 0; x < handler->n_tile_cols; x++)
+              if (gimp_tile_handler_xcf_in_file (handler, x, y))
+                gegl_tile_unref (gimp_tile_handler_xcf_materialize (handler,
+                                                                    x, y));
+
+          g_mapped_file_unref (handler->file);
+          handler->file = NULL;
+        }
+
+      g_rec_mutex_unlock (&handler->mutex);
+    }
+
+  g_mutex_unlock (&handlers_mutex);
+
+  g_object_unref (file);
+}
@@ -0,0 +1,85 @@
+/* GIMP - The GNU Image Manipulation Program
+ * Copyright (C) 1995 Spencer Kimball and Peter Mattis
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __XCF_TILE_HANDLER_H__
+#define __XCF_TILE_HANDLER_H__
+
+#include <gegl-buffer-backend.h>
+
+/***
+ * GimpTileHandlerXcf is a GeglTileHandler that decodes the tiles of
+ * a level in a memory-mapped XCF file the first time they are
+ * accessed. Decoded, written and voided tiles are handed to the
+ * buffer's own cache and swap, the file is only read for tiles that
+ * were never touched.
+ */
+
+G_BEGIN_DECLS
+
+#define GIMP_TYPE_TILE_HANDLER_XCF            (gimp_tile_handler_xcf_get_type ())
+#define GIMP_TILE_HANDLER_XCF(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GIMP_TYPE_TILE_HANDLER_XCF, GimpTileHandlerXcf))
+#define GIMP_TILE_HANDLER_XCF_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  GIMP_TYPE_TILE_HANDLER_XCF, GimpTileHandlerXcfClass))
+#define GIMP_IS_TILE_HANDLER_XCF(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GIMP_TYPE_TILE_HANDLER_XCF))
+#define GIMP_IS_TILE_HANDLER_XCF_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  GIMP_TYPE_TILE_HANDLER_XCF))
+#define GIMP_TILE_HANDLER_XCF_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  GIMP_TYPE_TILE_HANDLER_XCF, GimpTileHandlerXcfClass))
+
+
+typedef struct _GimpTileHandlerXcf      GimpTileHandlerXcf;
+typedef struct _GimpTileHandlerXcfClass GimpTileHandlerXcfClass;
+
+struct _GimpTileHandlerXcf
+{
+  GeglTileHandler     parent_instance;
+
+  GRecMutex           mutex;
+  GMappedFile        *file;          /* NULL once detached          */
+  GFile              *gfile;
+  guint64             device;        /* identify the file even when */
+  guint64             inode;         /* it is named differently     */
+  XcfCompressionType  compression;
+  const Babl         *format;
+  gint                bpp;
+  gint                width;
+  gint                height;
+  gint                n_tile_cols;
+  gint                n_tile_rows;
+  guint32            *offsets;       /* one per tile, plus the end  */
+  guchar             *touched;       /* tiles no longer in the file */
+};
+
+struct _GimpTileHandlerXcfClass
+{
+  GeglTileHandlerClass  parent_class;
+};
+
+
+GType        gimp_tile_handler_xcf_get_type    (void) G_GNUC_CONST;
+
+GeglBuffer * gimp_tile_handler_xcf_buffer_new  (GMappedFile        *file,
+                                                const gchar        *filename,
+                                                const Babl         *format,
+                                                gint                width,
+                                                gint                height,
+                                                XcfCompressionType  compression,
+                                                const guint32      *offsets);
+
+void         gimp_tile_handler_xcf_detach_file (const gchar        *filename);
+
+
+G_END_DECLS
+
+#endif /* __XCF_TILE_HANDLER_H__ */
@@ -41,6 +41,7 @@
 #include "xcf-load.h"
 #include "xcf-read.h"
 #include "xcf-save.h"
+#include "xcf-tile-handler.h"
 
 #include "gimp-intl.h"
 
@@ -56,6 +57,19 @@ static GimpValueArray * xcf_load_invoker (GimpProcedure         *procedure,
                                           GimpProgress          *progress,
                                           const GimpValueArray  *args,
                                           GError               **error);
+static GimpValueArray * xcf_load_mapped_invoker
+                                         (GimpProcedure         *procedure,
+                                          Gimp                  *gimp,
+                                          GimpContext           *context,
+                                          GimpProgress          *progress,
+                                          const GimpValueArray  *args,
+                                          GError               **error);
+static GimpValueArray * xcf_load_file    (GimpProcedure         *procedure,
+                                          Gimp                  *gimp,
+                                          GimpProgress          *progress,
+                                          const GimpValueArray  *args,
+                                          gboolean               mapped,
+                                          GError               **error);
 static GimpValueArray * xcf_save_invoker (GimpProcedure         *procedure,
                                           Gimp                  *gimp,
                                           GimpContext           *context,
@@ -70,7 +84,8 @@ static GimpXcfLoaderFunc * const xcf_loaders[] =
   xcf_load_image,   /* version 1 */
   xcf_load_image,   /* version 2 */
   xcf_load_image,   /* version 3 */
-  xcf_load_image    /* version 4 */
+  xcf_load_image,   /* version 4 */
+  xcf_load_image    /* version 5 */
 };
 
 
@@ -221,6 +236,67 @@ xcf_init (Gimp *gimp)
                                                              GIMP_PARAM_READWRITE));
   gimp_plug_in_manager_add_procedure (gimp->plug_in_manager, proc);
   g_object_unref (procedure);
+
+  /*  gimp-xcf-load-mapped  */
+  procedure = gimp_plug_in_procedure_new (GIMP_PLUGIN, "gimp-xcf-load-mapped");
+  procedure->proc_type    = GIMP_INTERNAL;
+  procedure->marshal_func = xcf_load_mapped_invoker;
+
+  proc = GIMP_PLUG_IN_PROCEDURE (procedure);
+
+  gimp_object_set_static_name (GIMP_OBJECT (procedure),
+                               "gimp-xcf-load-mapped");
+  gimp_procedure_set_static_strings (procedure,
+                                     "gimp-xcf-load-mapped",
+                                     "Loads an .xcf file without reading "
+                                     "its pixels up front",
+                                     "Like gimp-xcf-load, but the file is "
+                                     "mapped into memory and the pixels of "
+                                     "each layer and channel are only "
+                                     "decoded when they are first used. "
+                                     "Opening a file costs little more than "
+                                     "reading its metadata, which makes this "
+                                     "procedure suitable for inspecting a few "
+                                     "layers of large files, or creating "
+                                     "thumbnails.",
+                                     "Spencer Kimball & Peter Mattis",
+                                     "Spencer Kimball & Peter Mattis",
+                                     "1995-1996",
+                                     NULL);
+
+  gimp_procedure_add_argument (procedure,
+                               gimp_param_spec_int32 ("dummy-param",
+                                                      "Dummy Param",
+                                                      "Dummy parameter",
+                                                      G_MININT32, G_MAXINT32, 0,
+                                                      GIMP_PARAM_READWRITE));
+  gimp_procedure_add_argument (procedure,
+                               gimp_param_spec_string ("filename",
+                                                       "Filename",
+                                                       "The name of the file "
+                                                       "to load, in the "
+                                                       "on-disk character "
+                                                       "set and encoding",
+                                                       TRUE, FALSE, TRUE,
+                                                       NULL,
+                                                       GIMP_PARAM_READWRITE));
+  gimp_procedure_add_argument (procedure,
+                               gimp_param_spec_string ("raw-filename",
+                                                       "Raw filename",
+                                                       "The basename of the "
+                                                       "file, in UTF-8",
+                                                       FALSE, FALSE, TRUE,
+                                                       NULL,
+                                                       GIMP_PARAM_READWRITE));
+
+  gimp_procedure_add_return_value (procedure,
+                                   gimp_param_spec_image_id ("image",
+                                                             "Image",
+                                                             "Output image",
+                                                             gimp, FALSE,
+                                                             GIMP_PARAM_READWRITE));
+  gimp_plug_in_manager_add_procedure (gimp->plug_in_manager, proc);
+  g_object_unref (procedure);
 }
 
 void
@@ -236,6 +312,28 @@ xcf_load_invoker (GimpProcedure         *procedure,
                   GimpProgress          *progress,
                   const GimpValueArray  *args,
                   GError               **error)
+{
+  return xcf_load_file (procedure, gimp, progress, args, FALSE, error);
+}
+
+static GimpValueArray *
+xcf_load_mapped_invoker (GimpProcedure         *procedure,
+                         Gimp                  *gimp,
+                         GimpContext           *context,
+                         GimpProgress          *progress,
+                         const GimpValueArray  *args,
+                         GError               **error)
+{
+  return xcf_load_file (procedure, gimp, progress, args, TRUE, error);
+}
+
+static GimpValueArray *
+xcf_load_file (GimpProcedure         *procedure,
+               Gimp                  *gimp,
+               GimpProgress          *progress,
+               const GimpValueArray  *args,
+               gboolean               mapped,
+               GError               **error)
 {
   XcfInfo         info;
   GimpValueArray *return_vals;
@@ -265,6 +363,8 @@ xcf_load_invoker (GimpProcedure         *procedure,
       info.swap_num              = 0;
       info.ref_count             = NULL;
       info.compression           = COMPRESS_NONE;
+      info.start_time            = g_get_monotonic_time ();
+      info.mapped_file           = NULL;
 
       if (progress)
         {
@@ -298,6 +398,14 @@ xcf_load_invoker (GimpProcedure         *procedure,
           success = FALSE;
         }
 
+      if (success && mapped)
+        {
+          info.mapped_file = g_mapped_file_new (filename, FALSE, error);
+
+          if (! info.mapped_file)
+            success = FALSE;
+        }
+
       if (success)
         {
           if (info.file_version >= 0 &&
@@ -319,6 +427,10 @@ xcf_load_invoker (GimpProcedure         *procedure,
 
       fclose (info.fp);
 
+      /* the layers' buffers keep their own reference */
+      if (info.mapped_file)
+        g_mapped_file_unref (info.mapped_file);
+
       if (progress)
         gimp_progress_end (progress);
     }
@@ -361,6 +473,11 @@ xcf_save_invoker (GimpProcedure         *procedure,
   image    = gimp_value_get_image (gimp_value_array_index (args, 1), gimp);
   filename = g_value_get_string (gimp_value_array_index (args, 3));
 
+  /* images loaded with gimp-xcf-load-mapped may still read from the
+   * file we are about to truncate
+   */
+  gimp_tile_handler_xcf_detach_file (filename);
+
   info.fp = g_fopen (filename, "wb");
 
   if (info.fp)
@@ -377,6 +494,8 @@ xcf_save_invoker (GimpProcedure         *procedure,
       info.swap_num              = 0;
       info.ref_count             = NULL;
       info.compression           = COMPRESS_RLE;
+      info.start_time            = g_get_monotonic_time ();
+      info.mapped_file           = NULL;
 
       if (progress)
         {
@@ -1010,6 +1010,8 @@ gimp_run_procedure2 (const gchar     *name,
   proc_run.nparams = n_params;
   proc_run.params  = (GPParam *) params;
 
+  _gimp_tile_prefetch_finish ();
+
   if (! gp_proc_run_write (_writechannel, &proc_run, NULL))
     gimp_quit ();
 
@@ -1907,6 +1909,14 @@ gimp_loop (void)
         case GP_HAS_INIT:
           g_warning ("unexpected has init message received (should not happen)");
           break;
+
+        case GP_TILE_BATCH_REQ:
+        case GP_TILE_BATCH_DATA:
+        case GP_DRAWABLE_MAP_REQ:
+        case GP_DRAWABLE_MAP:
+        case GP_DRAWABLE_UNMAP:
+          g_warning ("unexpected tile message received (should not happen)");
+          break;
         }
 
       gimp_wire_destroy (&msg);
@@ -2058,6 +2068,8 @@ gimp_proc_run (GPProcRun *proc_run)
       proc_return.nparams = n_return_vals;
       proc_return.params  = (GPParam *) return_vals;
 
+      _gimp_tile_prefetch_finish ();
+
       if (! gp_proc_return_write (_writechannel, &proc_return, NULL))
         gimp_quit ();
     }
@@ -2091,6 +2103,8 @@ gimp_temp_proc_run (GPProcRun *proc_run)
       proc_return.nparams = n_return_vals;
       proc_return.params  = (GPParam *) return_vals;
 
+      _gimp_tile_prefetch_finish ();
+
       if (! gp_temp_proc_return_write (_writechannel, &proc_return, NULL))
         gimp_quit ();
     }
@@ -2130,6 +2144,13 @@ gimp_process_message (GimpWireMessage *msg)
     case GP_HAS_INIT:
       g_warning ("unexpected has init message received (should not happen)");
       break;
+    case GP_TILE_BATCH_REQ:
+    case GP_TILE_BATCH_DATA:
+    case GP_DRAWABLE_MAP_REQ:
+    case GP_DRAWABLE_MAP:
+    case GP_DRAWABLE_UNMAP:
+      g_warning ("unexpected tile message received (should not happen)");
+      break;
     }
 }
 
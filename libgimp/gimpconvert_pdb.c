@@ -121,7 +121,8 @@ gimp_image_convert_grayscale (gint32 image_ID)
  * dithering to use. '0' means no dithering, '1' means standard
  * Floyd-Steinberg error diffusion, '2' means Floyd-Steinberg error
  * diffusion with reduced bleeding, '3' means dithering based on pixel
- * location ('Fixed' dithering).
+ * location ('Fixed' dithering), '5' means dithering based on pixel
+ * location with a blue noise threshold matrix.
  *
  * Returns: TRUE on success.
  **/
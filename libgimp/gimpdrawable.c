@@ -20,8 +20,41 @@
 
 #include "config.h"
 
+#include <errno.h>
+
+#include <glib.h>
+
+#if defined(G_OS_WIN32) || defined(G_WITH_CYGWIN)
+#  define STRICT
+#  include <windows.h>
+#  undef RGB
+#  define USE_WIN32_SHM 1
+#elif defined(USE_SYSV_SHM)
+
+#ifdef HAVE_IPC_H
+#include <sys/ipc.h>
+#endif
+
+#ifdef HAVE_SHM_H
+#include <sys/shm.h>
+#endif
+
+#elif defined(USE_POSIX_SHM)
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#endif
+
 #define GIMP_DISABLE_DEPRECATION_WARNINGS
 
+#include "libgimpbase/gimpprotocol.h"
+#include "libgimpbase/gimpwire.h"
+
 #include "gimp.h"
 
 #include "gimptilebackendplugin.h"
@@ -31,6 +64,43 @@
 #define TILE_HEIGHT gimp_tile_height()
 
 
+typedef struct _GimpDrawableMap    GimpDrawableMap;
+typedef struct _GimpMappedBuffer   GimpMappedBuffer;
+
+struct _GimpDrawableMap
+{
+  gint     map_ID;
+  guchar  *data;
+  gsize    size;
+#ifdef USE_WIN32_SHM
+  HANDLE   handle;
+#endif
+};
+
+struct _GimpMappedBuffer
+{
+  guchar   *data;
+  gboolean  dirty;
+};
+
+
+void                gimp_read_expect_msg         (GimpWireMessage     *msg,
+                                                  gint                 type);
+
+static guchar     * gimp_drawable_map_attach     (GimpDrawableMap     *map,
+                                                  gint                 shm_ID,
+                                                  const gchar         *shm_name);
+static void         gimp_drawable_map_detach     (GimpDrawableMap     *map);
+static const Babl * gimp_drawable_get_map_format (gint32               drawable_ID);
+static void         gimp_drawable_buffer_changed (GeglBuffer          *buffer,
+                                                  const GeglRectangle *rect,
+                                                  GimpMappedBuffer    *mapped);
+static void         gimp_drawable_buffer_unmap   (GimpMappedBuffer    *mapped);
+
+
+static GHashTable *drawable_maps = NULL;
+
+
 /**
  * gimp_drawable_get:
  * @drawable_ID: the ID of the drawable
@@ -117,32 +187,37 @@ gimp_drawable_detach (GimpDrawable *drawable)
 void
 gimp_drawable_flush (GimpDrawable *drawable)
 {
-  GimpTile *tiles;
-  gint      n_tiles;
-  gint      i;
+  GimpTile **dirty;
+  gint       n_tiles;
+  gint       n_dirty = 0;
+  gint       i;
 
   g_return_if_fail (drawable != NULL);
 
+  n_tiles = drawable->ntile_rows * drawable->ntile_cols;
+
+  dirty = g_new (GimpTile *, 2 * n_tiles);
+
   if (drawable->tiles)
     {
-      tiles   = drawable->tiles;
-      n_tiles = drawable->ntile_rows * drawable->ntile_cols;
-
       for (i = 0; i < n_tiles; i++)
-        if ((tiles[i].ref_count > 0) && tiles[i].dirty)
-          gimp_tile_flush (&tiles[i]);
+        if ((drawable->tiles[i].ref_count > 0) && drawable->tiles[i].dirty)
+          dirty[n_dirty++] = &drawable->tiles[i];
     }
 
   if (drawable->shadow_tiles)
     {
-      tiles   = drawable->shadow_tiles;
-      n_tiles = drawable->ntile_rows * drawable->ntile_cols;
-
       for (i = 0; i < n_tiles; i++)
-        if ((tiles[i].ref_count > 0) && tiles[i].dirty)
-          gimp_tile_flush (&tiles[i]);
+        if ((drawable->shadow_tiles[i].ref_count > 0) &&
+            drawable->shadow_tiles[i].dirty)
+          dirty[n_dirty++] = &drawable->shadow_tiles[i];
     }
 
+  /*  transfer all dirty tiles in as few exchanges as possible  */
+  _gimp_tile_flush_batch (dirty, n_dirty);
+
+  g_free (dirty);
+
   /*  nuke all references to this drawable from the cache  */
   _gimp_tile_cache_flush_drawable (drawable);
 }
@@ -730,6 +805,218 @@ gimp_drawable_get_shadow_buffer (gint32 drawable_ID)
   return NULL;
 }
 
+/**
+ * gimp_drawable_map:
+ * @drawable_ID: the ID of the drawable
+ * @rect:        the region of the drawable to map
+ * @shadow:      whether to map the drawable's shadow tiles
+ * @writable:    whether changes to the mapped data are to be kept
+ * @rowstride:   return location for the rowstride of the mapped data
+ *
+ * Maps a region of a drawable into the plug-in's address space as a
+ * single block of memory shared with the core, bypassing the tile
+ * protocol. The pixels are laid out row by row in the drawable's
+ * format (see gimp_drawable_get_format()), or in its 8 bit
+ * equivalent if the plug-in has not enabled high precision.
+ *
+ * The mapping is a snapshot of the drawable; use gimp_drawable_flush()
+ * before mapping a drawable that has dirty tiles, and
+ * gimp_drawable_unmap() to release it.
+ *
+ * Return value: a pointer to the mapped pixels, or %NULL if the region
+ *               could not be mapped, in which case the tile based API
+ *               has to be used instead.
+ *
+ * Since: 2.10
+ **/
+guchar *
+gimp_drawable_map (gint32               drawable_ID,
+                   const GeglRectangle *rect,
+                   gboolean             shadow,
+                   gboolean             writable,
+                   gint                *rowstride)
+{
+  extern GIOChannel *_writechannel;
+
+  GPDrawableMapReq  request;
+  GPDrawableMap    *reply;
+  GimpWireMessage   msg;
+  GimpDrawableMap  *map;
+  guchar           *data = NULL;
+
+  g_return_val_if_fail (rect != NULL, NULL);
+  g_return_val_if_fail (rowstride != NULL, NULL);
+
+  /*  nothing else may go over the wire while a prefetch is pending  */
+  _gimp_tile_prefetch_finish ();
+
+  request.drawable_ID = drawable_ID;
+  request.shadow      = shadow;
+  request.writable    = writable;
+  request.x           = rect->x;
+  request.y           = rect->y;
+  request.width       = rect->width;
+  request.height      = rect->height;
+
+  if (! gp_drawable_map_req_write (_writechannel, &request, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_DRAWABLE_MAP);
+
+  reply = msg.data;
+
+  if (reply->map_ID == -1)
+    {
+      gimp_wire_destroy (&msg);
+      return NULL;
+    }
+
+  map = g_slice_new0 (GimpDrawableMap);
+
+  map->map_ID = reply->map_ID;
+  map->size   = (gsize) reply->rowstride * rect->height;
+
+  data = gimp_drawable_map_attach (map, reply->shm_ID, reply->shm_name);
+
+  if (data)
+    {
+      if (! drawable_maps)
+        drawable_maps = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+      g_hash_table_insert (drawable_maps, data, map);
+
+      *rowstride = reply->rowstride;
+    }
+  else
+    {
+      GPDrawableUnmap unmap;
+
+      /*  let the core release the region again  */
+      unmap.map_ID = map->map_ID;
+      unmap.dirty  = FALSE;
+
+      g_slice_free (GimpDrawableMap, map);
+
+      gimp_wire_destroy (&msg);
+
+      if (! gp_drawable_unmap_write (_writechannel, &unmap, NULL))
+        gimp_quit ();
+
+      gimp_read_expect_msg (&msg, GP_TILE_ACK);
+    }
+
+  gimp_wire_destroy (&msg);
+
+  return data;
+}
+
+/**
+ * gimp_drawable_unmap:
+ * @data:  the pointer returned by gimp_drawable_map()
+ * @dirty: whether the mapped pixels were changed
+ *
+ * Releases a region mapped by gimp_drawable_map(). If the region was
+ * mapped writable and @dirty is %TRUE, the mapped pixels are written
+ * back to the drawable.
+ *
+ * Since: 2.10
+ **/
+void
+gimp_drawable_unmap (guchar   *data,
+                     gboolean  dirty)
+{
+  extern GIOChannel *_writechannel;
+
+  GimpDrawableMap *map;
+  GPDrawableUnmap  unmap;
+  GimpWireMessage  msg;
+
+  g_return_if_fail (data != NULL);
+
+  map = drawable_maps ? g_hash_table_lookup (drawable_maps, data) : NULL;
+
+  g_return_if_fail (map != NULL);
+
+  g_hash_table_remove (drawable_maps, data);
+
+  unmap.map_ID = map->map_ID;
+  unmap.dirty  = dirty;
+
+  gimp_drawable_map_detach (map);
+  g_slice_free (GimpDrawableMap, map);
+
+  _gimp_tile_prefetch_finish ();
+
+  if (! gp_drawable_unmap_write (_writechannel, &unmap, NULL))
+    gimp_quit ();
+
+  gimp_read_expect_msg (&msg, GP_TILE_ACK);
+  gimp_wire_destroy (&msg);
+}
+
+/**
+ * gimp_drawable_get_mapped_buffer:
+ * @drawable_ID: the ID of the drawable
+ * @rect:        the region of the drawable to map
+ * @shadow:      whether to map the drawable's shadow tiles
+ * @writable:    whether changes to the buffer are to be kept
+ *
+ * Returns a linear #GeglBuffer backed by a region of the drawable
+ * mapped with gimp_drawable_map(). Unlike the buffer returned by
+ * gimp_drawable_get_buffer(), no pixels are transferred tile by tile.
+ * If @writable is %TRUE and the buffer was changed, the region is
+ * written back to the drawable when the buffer gets destroyed.
+ *
+ * The buffer's format is the layout of the mapping: the drawable's
+ * format if the plug-in has enabled high precision, its 8 bit
+ * equivalent otherwise. Indexed drawables give their color indices.
+ *
+ * Return value: The #GeglBuffer, or %NULL if the region could not be
+ *               mapped.
+ *
+ * Since: 2.10
+ **/
+GeglBuffer *
+gimp_drawable_get_mapped_buffer (gint32               drawable_ID,
+                                 const GeglRectangle *rect,
+                                 gboolean             shadow,
+                                 gboolean             writable)
+{
+  GimpMappedBuffer *mapped;
+  GeglBuffer       *buffer;
+  const Babl       *format;
+  guchar           *data;
+  gint              rowstride;
+
+  g_return_val_if_fail (rect != NULL, NULL);
+
+  format = gimp_drawable_get_map_format (drawable_ID);
+
+  if (! format)
+    return NULL;
+
+  data = gimp_drawable_map (drawable_ID, rect, shadow, writable, &rowstride);
+
+  if (! data)
+    return NULL;
+
+  mapped = g_slice_new0 (GimpMappedBuffer);
+
+  mapped->data = data;
+
+  buffer = gegl_buffer_linear_new_from_data (data, format, rect, rowstride,
+                                             (GDestroyNotify)
+                                             gimp_drawable_buffer_unmap,
+                                             mapped);
+
+  if (writable)
+    gegl_buffer_signal_connect (buffer, "changed",
+                                G_CALLBACK (gimp_drawable_buffer_changed),
+                                mapped);
+
+  return buffer;
+}
+
 /**
  * gimp_drawable_get_format:
  * @drawable_ID: the ID of the #GimpDrawable to get the format for.
@@ -799,3 +1086,139 @@ gimp_drawable_get_format (gint32 drawable_ID)
 
   return format;
 }
+
+
+/*  private functions  */
+
+static guchar *
+gimp_drawable_map_attach (GimpDrawableMap *map,
+                          gint             shm_ID,
+                          const gchar     *shm_name)
+{
+#if defined(USE_SYSV_SHM)
+
+  map->data = (guchar *) shmat (shm_ID, NULL, 0);
+
+  if (map->data == (guchar *) -1)
+    {
+      g_printerr ("shmat() failed: %s\n", g_strerror (errno));
+      map->data = NULL;
+    }
+
+#elif defined(USE_WIN32_SHM)
+
+  map->handle = OpenFileMapping (FILE_MAP_ALL_ACCESS, 0, shm_name);
+
+  if (map->handle)
+    {
+      map->data = (guchar *) MapViewOfFile (map->handle, FILE_MAP_ALL_ACCESS,
+                                            0, 0, map->size);
+
+      if (! map->data)
+        {
+          g_printerr ("MapViewOfFile error: %d\n", (gint) GetLastError ());
+          CloseHandle (map->handle);
+        }
+    }
+  else
+    {
+      g_printerr ("OpenFileMapping error: %d\n", (gint) GetLastError ());
+    }
+
+#elif defined(USE_POSIX_SHM)
+
+  gint shm_fd = shm_open (shm_name, O_RDWR, 0600);
+
+  if (shm_fd != -1)
+    {
+      map->data = (guchar *) mmap (NULL, map->size,
+                                   PROT_READ | PROT_WRITE, MAP_SHARED,
+                                   shm_fd, 0);
+
+      if (map->data == MAP_FAILED)
+        {
+          g_printerr ("mmap() failed: %s\n", g_strerror (errno));
+          map->data = NULL;
+        }
+
+      close (shm_fd);
+    }
+  else
+    {
+      g_printerr ("shm_open() failed: %s\n", g_strerror (errno));
+    }
+
+#endif
+
+  return map->data;
+}
+
+static void
+gimp_drawable_map_detach (GimpDrawableMap *map)
+{
+#if defined(USE_SYSV_SHM)
+
+  shmdt ((char *) map->data);
+
+#elif defined(USE_WIN32_SHM)
+
+  UnmapViewOfFile (map->data);
+  CloseHandle (map->handle);
+
+#elif defined(USE_POSIX_SHM)
+
+  munmap (map->data, map->size);
+
+#endif
+
+  map->data = NULL;
+}
+
+/*  The layout gimp_drawable_map() uses, see gimp_babl_compat_u8_format()
+ *  in the core. gimp_drawable_get_format() can't be used without high
+ *  precision, it enables it.
+ */
+static const Babl *
+gimp_drawable_get_map_format (gint32 drawable_ID)
+{
+  gboolean has_alpha;
+
+  if (gimp_plugin_precision_enabled ())
+    return gimp_drawable_get_format (drawable_ID);
+
+  has_alpha = gimp_drawable_has_alpha (drawable_ID);
+
+  switch (gimp_drawable_type (drawable_ID))
+    {
+    case GIMP_RGB_IMAGE:
+    case GIMP_RGBA_IMAGE:
+      return babl_format (has_alpha ? "R'G'B'A u8" : "R'G'B' u8");
+
+    case GIMP_GRAY_IMAGE:
+    case GIMP_GRAYA_IMAGE:
+      return babl_format (has_alpha ? "Y'A u8" : "Y' u8");
+
+    case GIMP_INDEXED_IMAGE:
+    case GIMP_INDEXEDA_IMAGE:
+      return babl_format_n (babl_type ("u8"),
+                            gimp_drawable_bpp (drawable_ID));
+    }
+
+  return NULL;
+}
+
+static void
+gimp_drawable_buffer_changed (GeglBuffer          *buffer,
+                              const GeglRectangle *rect,
+                              GimpMappedBuffer    *mapped)
+{
+  mapped->dirty = TRUE;
+}
+
+static void
+gimp_drawable_buffer_unmap (GimpMappedBuffer *mapped)
+{
+  gimp_drawable_unmap (mapped->data, mapped->dirty);
+
+  g_slice_free (GimpMappedBuffer, mapped);
+}
@@ -44,6 +44,18 @@ struct _GimpDrawable
 
 GeglBuffer   * gimp_drawable_get_buffer             (gint32         drawable_ID);
 GeglBuffer   * gimp_drawable_get_shadow_buffer      (gint32         drawable_ID);
+GeglBuffer   * gimp_drawable_get_mapped_buffer      (gint32         drawable_ID,
+                                                     const GeglRectangle *rect,
+                                                     gboolean       shadow,
+                                                     gboolean       writable);
+
+guchar       * gimp_drawable_map                    (gint32         drawable_ID,
+                                                     const GeglRectangle *rect,
+                                                     gboolean       shadow,
+                                                     gboolean       writable,
+                                                     gint          *rowstride);
+void           gimp_drawable_unmap                  (guchar        *data,
+                                                     gboolean       dirty);
 
 const Babl   * gimp_drawable_get_format             (gint32         drawable_ID);
 
@@ -0,0 +1,282 @@
+/* LIBGIMP - The GIMP Library
+ * Copyright (C) 1995-1997 Peter Mattis and Spencer Kimball
+ *
+ * gimpdrawableprocess.c
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#define GIMP_DISABLE_DEPRECATION_WARNINGS
+
+#include "gimp.h"
+#include "gimpdrawableprocess.h"
+
+
+/**
+ * SECTION: gimpdrawableprocess
+ * @title: gimpdrawableprocess
+ * @short_description: Process a drawable's pixels on several threads.
+ *
+ * gimp_drawable_process_parallel() runs a function over the selected
+ * area of a drawable in tiles, on as many threads as GIMP is
+ * configured to use.
+ **/
+
+
+#define MAX_THREADS    64
+#define ROWS_PER_TILE   2     /* in tile rows */
+
+
+typedef struct
+{
+  GimpDrawableProcessFunc  func;
+  gpointer                 data;
+  GAsyncQueue             *done;
+} GimpProcessContext;
+
+
+static gint   gimp_drawable_process_get_n_threads (void);
+static void   gimp_drawable_process_tile          (GimpProcessTile    *tile,
+                                                   GimpProcessContext *context);
+
+
+/**
+ * gimp_drawable_process_parallel:
+ * @drawable_ID: the ID of the drawable
+ * @halo:        the number of pixels around a tile @func reads
+ * @func:        the function processing a tile
+ * @data:        user data passed to @func
+ *
+ * Processes the intersection of the drawable and the selection tile
+ * by tile, calling @func for the tiles on a pool of threads. Tiles
+ * are bands of a fixed number of whole tile rows, so how the area is
+ * split, and the result of a @func which depends on where its tile
+ * starts, doesn't depend on the number of threads. Each call gets the
+ * tile's source pixels, extended by @halo pixels on each side as far
+ * as the processed area reaches, and the destination for the tile's
+ * result.
+ * The results go to the drawable's shadow tiles, which are merged
+ * and updated when all tiles are done.
+ *
+ * The pixels are laid out as by gimp_drawable_map(), which is used
+ * to share them with the core, so @func runs without any tile
+ * traffic. If the drawable cannot be mapped, the area is transferred
+ * before and after processing instead.
+ *
+ * @func is called from several threads at once and must not call
+ * libgimp functions. Progress is reported with gimp_progress_update()
+ * as tiles complete; call gimp_progress_init() before.
+ *
+ * Since: 2.10
+ **/
+void
+gimp_drawable_process_parallel (gint32                   drawable_ID,
+                                gint                     halo,
+                                GimpDrawableProcessFunc  func,
+                                gpointer                 data)
+{
+  GimpDrawable    *drawable = NULL;
+  GimpProcessTile *tiles;
+  GeglRectangle    area;
+  guchar          *src;
+  guchar          *dest     = NULL;
+  gint             src_rowstride;
+  gint             dest_rowstride;
+  gint             bpp;
+  gint             n_threads;
+  gint             tile_height;
+  gint             n_tiles;
+  gint             i;
+
+  g_return_if_fail (halo >= 0);
+  g_return_if_fail (func != NULL);
+
+  if (! gimp_drawable_mask_intersect (drawable_ID,
+                                      &area.x, &area.y,
+                                      &area.width, &area.height))
+    return;
+
+  bpp = gimp_drawable_bpp (drawable_ID);
+
+  src = gimp_drawable_map (drawable_ID, &area, FALSE, FALSE, &src_rowstride);
+
+  if (src)
+    {
+      dest = gimp_drawable_map (drawable_ID, &area, TRUE, TRUE,
+                                &dest_rowstride);
+
+      if (! dest)
+        {
+          gimp_drawable_unmap (src, FALSE);
+          src = NULL;
+        }
+    }
+
+  if (! src)
+    {
+      GimpPixelRgn src_rgn;
+
+      drawable = gimp_drawable_get (drawable_ID);
+
+      src_rowstride  = area.width * bpp;
+      dest_rowstride = area.width * bpp;
+
+      src  = g_malloc ((gsize) src_rowstride  * area.height);
+      dest = g_malloc ((gsize) dest_rowstride * area.height);
+
+      gimp_pixel_rgn_init (&src_rgn, drawable,
+                           area.x, area.y, area.width, area.height,
+                           FALSE, FALSE);
+      gimp_pixel_rgn_get_rect (&src_rgn, src,
+                               area.x, area.y, area.width, area.height);
+    }
+
+  n_threads = gimp_drawable_process_get_n_threads ();
+
+  /*  whole tile rows keep the halo overhead down, a fixed height
+   *  keeps the partition the same for any number of threads
+   */
+  tile_height = ROWS_PER_TILE * gimp_tile_height ();
+
+  n_tiles = (area.height + tile_height - 1) / tile_height;
+
+  tiles = g_new (GimpProcessTile, n_tiles);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GimpProcessTile *tile = &tiles[i];
+      gint             y1   = area.y + i * tile_height;
+      gint             y2   = MIN (y1 + tile_height, area.y + area.height);
+      gint             src_y1;
+      gint             src_y2;
+
+      src_y1 = MAX (y1 - halo, area.y);
+      src_y2 = MIN (y2 + halo, area.y + area.height);
+
+      tile->src           = src + (gsize) (src_y1 - area.y) * src_rowstride;
+      tile->src_rowstride = src_rowstride;
+      tile->src_x         = area.x;
+      tile->src_y         = src_y1;
+      tile->src_width     = area.width;
+      tile->src_height    = src_y2 - src_y1;
+
+      tile->dest           = dest + (gsize) (y1 - area.y) * dest_rowstride;
+      tile->dest_rowstride = dest_rowstride;
+      tile->x              = area.x;
+      tile->y              = y1;
+      tile->width          = area.width;
+      tile->height         = y2 - y1;
+
+      tile->bpp = bpp;
+    }
+
+  if (n_threads == 1 || n_tiles == 1)
+    {
+      for (i = 0; i < n_tiles; i++)
+        {
+          func (&tiles[i], data);
+
+          gimp_progress_update ((gdouble) (i + 1) / (gdouble) n_tiles);
+        }
+    }
+  else
+    {
+      GimpProcessContext  context;
+      GThreadPool        *pool;
+
+      context.func = func;
+      context.data = data;
+      context.done = g_async_queue_new ();
+
+      pool = g_thread_pool_new ((GFunc) gimp_drawable_process_tile, &context,
+                                MIN (n_threads, n_tiles), FALSE, NULL);
+
+      for (i = 0; i < n_tiles; i++)
+        g_thread_pool_push (pool, &tiles[i], NULL);
+
+      /*  report progress from this thread, as the tiles come in  */
+      for (i = 0; i < n_tiles; i++)
+        {
+          g_async_queue_pop (context.done);
+
+          gimp_progress_update ((gdouble) (i + 1) / (gdouble) n_tiles);
+        }
+
+      g_thread_pool_free (pool, FALSE, TRUE);
+      g_async_queue_unref (context.done);
+    }
+
+  g_free (tiles);
+
+  if (drawable)
+    {
+      GimpPixelRgn dest_rgn;
+
+      gimp_pixel_rgn_init (&dest_rgn, drawable,
+                           area.x, area.y, area.width, area.height,
+                           TRUE, TRUE);
+      gimp_pixel_rgn_set_rect (&dest_rgn, dest,
+                               area.x, area.y, area.width, area.height);
+
+      gimp_drawable_flush (drawable);
+      gimp_drawable_detach (drawable);
+
+      g_free (dest);
+      g_free (src);
+    }
+  else
+    {
+      gimp_drawable_unmap (dest, TRUE);
+      gimp_drawable_unmap (src, FALSE);
+    }
+
+  gimp_drawable_merge_shadow (drawable_ID, TRUE);
+  gimp_drawable_update (drawable_ID,
+                        area.x, area.y, area.width, area.height);
+}
+
+
+/*  private functions  */
+
+static gint
+gimp_drawable_process_get_n_threads (void)
+{
+  static gint n_threads = 0;
+
+  if (! n_threads)
+    {
+      gchar *value = gimp_gimprc_query ("num-processors");
+
+      n_threads = value ? atoi (value) : 1;
+      n_threads = CLAMP (n_threads, 1, MAX_THREADS);
+
+      g_free (value);
+    }
+
+  return n_threads;
+}
+
+static void
+gimp_drawable_process_tile (GimpProcessTile    *tile,
+                            GimpProcessContext *context)
+{
+  context->func (tile, context->data);
+
+  g_async_queue_push (context->done, tile);
+}
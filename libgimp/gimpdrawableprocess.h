@@ -0,0 +1,67 @@
+/* LIBGIMP - The GIMP Library
+ * Copyright (C) 1995-1997 Peter Mattis and Spencer Kimball
+ *
+ * gimpdrawableprocess.h
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined (__GIMP_H_INSIDE__) && !defined (GIMP_COMPILATION)
+#error "Only <libgimp/gimp.h> can be included directly."
+#endif
+
+#ifndef __GIMP_DRAWABLE_PROCESS_H__
+#define __GIMP_DRAWABLE_PROCESS_H__
+
+G_BEGIN_DECLS
+
+/* For information look into the C source or the html documentation */
+
+
+typedef struct _GimpProcessTile GimpProcessTile;
+
+struct _GimpProcessTile
+{
+  const guchar *src;             /*  the source pixels at src_x, src_y  */
+  gint          src_rowstride;
+  gint          src_x;           /*  the part of the drawable in src,   */
+  gint          src_y;           /*  the tile extended by the halo      */
+  gint          src_width;
+  gint          src_height;
+
+  guchar       *dest;            /*  the result pixels at x, y          */
+  gint          dest_rowstride;
+  gint          x;               /*  the part of the drawable to        */
+  gint          y;               /*  process                            */
+  gint          width;
+  gint          height;
+
+  gint          bpp;
+};
+
+
+typedef void (* GimpDrawableProcessFunc) (const GimpProcessTile *tile,
+                                          gpointer               data);
+
+
+void   gimp_drawable_process_parallel (gint32                   drawable_ID,
+                                       gint                     halo,
+                                       GimpDrawableProcessFunc  func,
+                                       gpointer                 data);
+
+
+G_END_DECLS
+
+#endif /* __GIMP_DRAWABLE_PROCESS_H__ */
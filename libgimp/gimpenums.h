@@ -53,10 +53,11 @@ GType gimp_convert_dither_type_get_type (void) G_GNUC_CONST;
 
 typedef enum
 {
-  GIMP_NO_DITHER,
-  GIMP_FS_DITHER,
-  GIMP_FSLOWBLEED_DITHER,
-  GIMP_FIXED_DITHER
+  GIMP_NO_DITHER = 0,
+  GIMP_FS_DITHER = 1,
+  GIMP_FSLOWBLEED_DITHER = 2,
+  GIMP_FIXED_DITHER = 3,
+  GIMP_BLUE_NOISE_DITHER = 5
 } GimpConvertDitherType;
 
 
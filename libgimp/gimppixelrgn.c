@@ -65,11 +65,18 @@ struct _GimpPixelRgnIterator
 };
 
 
-static gint     gimp_get_portion_width    (GimpPixelRgnIterator *pri);
-static gint     gimp_get_portion_height   (GimpPixelRgnIterator *pri);
-static gpointer gimp_pixel_rgns_configure (GimpPixelRgnIterator *pri);
-static void     gimp_pixel_rgn_configure  (GimpPixelRgnHolder   *prh,
-                                           GimpPixelRgnIterator *pri);
+static gint     gimp_get_portion_width       (GimpPixelRgnIterator *pri);
+static gint     gimp_get_portion_height      (GimpPixelRgnIterator *pri);
+static gpointer gimp_pixel_rgns_configure    (GimpPixelRgnIterator *pri);
+static void     gimp_pixel_rgn_configure     (GimpPixelRgnHolder   *prh,
+                                              GimpPixelRgnIterator *pri);
+static gint     gimp_pixel_rgn_get_row_tiles (GimpPixelRgn         *pr,
+                                              gint                  x,
+                                              gint                  y,
+                                              gint                  width,
+                                              GimpTile            **tiles);
+static void     gimp_pixel_rgn_prefetch_rows (GimpPixelRgnHolder   *prh,
+                                              GimpPixelRgnIterator *pri);
 
 /**
  * gimp_pixel_rgn_init:
@@ -352,13 +359,15 @@ gimp_pixel_rgn_get_rect (GimpPixelRgn *pr,
                          gint          width,
                          gint          height)
 {
-  gulong  bufstride;
-  gint    xstart, ystart;
-  gint    xend, yend;
-  gint    xboundary;
-  gint    yboundary;
-  gint    xstep, ystep;
-  gint    ty, bpp;
+  GimpTile **tiles;
+  GimpTile **next_tiles;
+  gulong     bufstride;
+  gint       xstart, ystart;
+  gint       xend, yend;
+  gint       xboundary;
+  gint       yboundary;
+  gint       xstep, ystep;
+  gint       ty, bpp;
 
   g_return_if_fail (pr != NULL && pr->drawable != NULL);
   g_return_if_fail (buf != NULL);
@@ -367,6 +376,9 @@ gimp_pixel_rgn_get_rect (GimpPixelRgn *pr,
   g_return_if_fail (width >= 0);
   g_return_if_fail (height >= 0);
 
+  if (width == 0 || height == 0)
+    return;
+
   bpp = pr->bpp;
   bufstride = bpp * width;
 
@@ -374,25 +386,39 @@ gimp_pixel_rgn_get_rect (GimpPixelRgn *pr,
   ystart = y;
   xend = x + width;
   yend = y + height;
-  ystep = 0;
+
+  tiles      = g_new (GimpTile *, pr->drawable->ntile_cols);
+  next_tiles = g_new (GimpTile *, pr->drawable->ntile_cols);
 
   while (y < yend)
     {
-      x = xstart;
+      gint n_tiles;
+      gint i;
+
+      /*  fetch a whole row of tiles at once  */
+      n_tiles = gimp_pixel_rgn_get_row_tiles (pr, xstart, y, width, tiles);
+      _gimp_tile_ref_batch (tiles, n_tiles);
 
-      while (x < xend)
+      ystep = tiles[0]->eheight - (y % TILE_HEIGHT);
+      yboundary = MIN (y + ystep, yend);
+
+      /*  and request the next one while this one is copied  */
+      if (yboundary < yend)
         {
-          GimpTile *tile;
+          gint n_next = gimp_pixel_rgn_get_row_tiles (pr, xstart, yboundary,
+                                                      width, next_tiles);
 
-          tile = gimp_drawable_get_tile2 (pr->drawable, pr->shadow, x, y);
-          gimp_tile_ref (tile);
+          _gimp_tile_prefetch (next_tiles, n_next);
+        }
+
+      x = xstart;
+
+      for (i = 0; i < n_tiles; i++)
+        {
+          GimpTile *tile = tiles[i];
 
           xstep = tile->ewidth - (x % TILE_WIDTH);
-          ystep = tile->eheight - (y % TILE_HEIGHT);
-          xboundary = x + xstep;
-          yboundary = y + ystep;
-          xboundary = MIN (xboundary, xend);
-          yboundary = MIN (yboundary, yend);
+          xboundary = MIN (x + xstep, xend);
 
           for (ty = y; ty < yboundary; ty++)
             {
@@ -406,12 +432,16 @@ gimp_pixel_rgn_get_rect (GimpPixelRgn *pr,
               memcpy (dest, src, (xboundary - x) * bpp);
             }
 
-          gimp_tile_unref (tile, FALSE);
           x += xstep;
         }
 
+      _gimp_tile_unref_batch (tiles, n_tiles, FALSE);
+
       y += ystep;
     }
+
+  g_free (tiles);
+  g_free (next_tiles);
 }
 
 /**
@@ -586,13 +616,15 @@ gimp_pixel_rgn_set_rect (GimpPixelRgn *pr,
                          gint          width,
                          gint          height)
 {
-  gulong  bufstride;
-  gint    xstart, ystart;
-  gint    xend, yend;
-  gint    xboundary;
-  gint    yboundary;
-  gint    xstep, ystep;
-  gint    ty, bpp;
+  GimpTile **tiles;
+  GimpTile **fetch;
+  gulong     bufstride;
+  gint       xstart, ystart;
+  gint       xend, yend;
+  gint       xboundary;
+  gint       yboundary;
+  gint       xstep, ystep;
+  gint       ty, bpp;
 
   g_return_if_fail (pr != NULL && pr->drawable != NULL);
   g_return_if_fail (buf != NULL);
@@ -601,6 +633,9 @@ gimp_pixel_rgn_set_rect (GimpPixelRgn *pr,
   g_return_if_fail (width >= 0);
   g_return_if_fail (height >= 0);
 
+  if (width == 0 || height == 0)
+    return;
+
   bpp = pr->bpp;
   bufstride = bpp * width;
 
@@ -608,25 +643,53 @@ gimp_pixel_rgn_set_rect (GimpPixelRgn *pr,
   ystart = y;
   xend = x + width;
   yend = y + height;
-  ystep = 0;
+
+  tiles = g_new (GimpTile *, pr->drawable->ntile_cols);
+  fetch = g_new (GimpTile *, pr->drawable->ntile_cols);
 
   while (y < yend)
     {
+      gint n_tiles;
+      gint n_fetch = 0;
+      gint i;
+
+      n_tiles = gimp_pixel_rgn_get_row_tiles (pr, xstart, y, width, tiles);
+
+      ystep = tiles[0]->eheight - (y % TILE_HEIGHT);
+      yboundary = MIN (y + ystep, yend);
+
+      /*  tiles which get completely overwritten don't need to be
+       *  fetched from the core, fetch all others at once
+       */
       x = xstart;
 
-      while (x < xend)
+      for (i = 0; i < n_tiles; i++)
         {
-          GimpTile *tile;
+          GimpTile *tile = tiles[i];
 
-          tile = gimp_drawable_get_tile2 (pr->drawable, pr->shadow, x, y);
-          gimp_tile_ref (tile);
+          if (x % TILE_WIDTH == 0 && x + tile->ewidth <= xend &&
+              y % TILE_HEIGHT == 0 && y + tile->eheight <= yend)
+            {
+              gimp_tile_ref_zero (tile);
+            }
+          else
+            {
+              fetch[n_fetch++] = tile;
+            }
+
+          x += tile->ewidth - (x % TILE_WIDTH);
+        }
+
+      _gimp_tile_ref_batch (fetch, n_fetch);
+
+      x = xstart;
+
+      for (i = 0; i < n_tiles; i++)
+        {
+          GimpTile *tile = tiles[i];
 
           xstep = tile->ewidth - (x % TILE_WIDTH);
-          ystep = tile->eheight - (y % TILE_HEIGHT);
-          xboundary = x + xstep;
-          yboundary = y + ystep;
-          xboundary = MIN (xboundary, xend);
-          yboundary = MIN (yboundary, yend);
+          xboundary = MIN (x + xstep, xend);
 
           for (ty = y; ty < yboundary; ty++)
             {
@@ -640,12 +703,16 @@ gimp_pixel_rgn_set_rect (GimpPixelRgn *pr,
               memcpy (dest, src, (xboundary - x) * bpp);
             }
 
-          gimp_tile_unref (tile, TRUE);
           x += xstep;
         }
 
+      _gimp_tile_unref_batch (tiles, n_tiles, TRUE);
+
       y += ystep;
     }
+
+  g_free (tiles);
+  g_free (fetch);
 }
 
 /**
@@ -940,6 +1007,9 @@ gimp_pixel_rgn_configure (GimpPixelRgnHolder   *prh,
       gint      offx;
       gint      offy;
 
+      if (prh->pr->x == prh->startx)
+        gimp_pixel_rgn_prefetch_rows (prh, pri);
+
       tile = gimp_drawable_get_tile2 (prh->pr->drawable,
                                       prh->pr->shadow,
                                       prh->pr->x,
@@ -963,3 +1033,54 @@ gimp_pixel_rgn_configure (GimpPixelRgnHolder   *prh,
   prh->pr->w = pri->portion_width;
   prh->pr->h = pri->portion_height;
 }
+
+/*  Collects the tiles of the tile row containing @y which intersect
+ *  the span from @x to @x + @width, returns the number of tiles.
+ */
+static gint
+gimp_pixel_rgn_get_row_tiles (GimpPixelRgn  *pr,
+                              gint           x,
+                              gint           y,
+                              gint           width,
+                              GimpTile     **tiles)
+{
+  gint end     = x + width;
+  gint n_tiles = 0;
+
+  for (x -= x % TILE_WIDTH; x < end; x += TILE_WIDTH)
+    tiles[n_tiles++] = gimp_drawable_get_tile2 (pr->drawable, pr->shadow, x, y);
+
+  return n_tiles;
+}
+
+/*  Called when the iterator starts a new row of portions: transfers all
+ *  tiles of the current row that haven't been prefetched in one exchange,
+ *  and requests the next row so it arrives while the plug-in processes
+ *  this one. Each region of the iterator has its own prefetch pending.
+ */
+static void
+gimp_pixel_rgn_prefetch_rows (GimpPixelRgnHolder   *prh,
+                              GimpPixelRgnIterator *pri)
+{
+  GimpPixelRgn  *pr = prh->pr;
+  GimpTile     **tiles;
+  gint           n_tiles;
+  gint           next_y;
+
+  tiles = g_new (GimpTile *, pr->drawable->ntile_cols);
+
+  n_tiles = gimp_pixel_rgn_get_row_tiles (pr, prh->startx, pr->y,
+                                          pri->region_width, tiles);
+  _gimp_tile_fetch (tiles, n_tiles);
+
+  next_y = pr->y + TILE_HEIGHT - (pr->y % TILE_HEIGHT);
+
+  if (next_y < prh->starty + pri->region_height)
+    {
+      n_tiles = gimp_pixel_rgn_get_row_tiles (pr, prh->startx, next_y,
+                                              pri->region_width, tiles);
+      _gimp_tile_prefetch (tiles, n_tiles);
+    }
+
+  g_free (tiles);
+}
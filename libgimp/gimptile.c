@@ -48,14 +48,58 @@
  */
 #define FREE_QUANTUM 0.1
 
+/*  The maximum number of bytes transferred in a single batch message,
+ *  and the number of prefetched batches that are kept around until
+ *  they are used.
+ */
+#define BATCH_SIZE        (4 * 1024 * 1024)
+#define PREFETCH_MAX_HELD 6
+
+/*  The core writes a prefetched batch while the plug-in is busy with
+ *  other things, so the batches on their way must fit into what the
+ *  pipe buffers, or the core blocks until the plug-in reads them. One
+ *  pending batch per region covers the usual pixel region iterators.
+ */
+#define PREFETCH_MAX_SIZE    (64 * 1024)
+#define PREFETCH_MAX_PENDING 4
 
-void         gimp_read_expect_msg   (GimpWireMessage *msg,
-                                     gint             type);
+#define TILE_DATA_SIZE(tile) ((gsize) (tile)->ewidth * (tile)->eheight * \
+                              (tile)->bpp)
 
-static void  gimp_tile_get          (GimpTile        *tile);
-static void  gimp_tile_put          (GimpTile        *tile);
-static void  gimp_tile_cache_insert (GimpTile        *tile);
-static void  gimp_tile_cache_flush  (GimpTile        *tile);
+
+typedef struct _GimpTileBatch GimpTileBatch;
+
+struct _GimpTileBatch
+{
+  GimpTile **tiles;
+  gint       n_tiles;
+};
+
+
+void             gimp_read_expect_msg       (GimpWireMessage *msg,
+                                             gint             type);
+
+static void      gimp_tile_get              (GimpTile        *tile);
+static void      gimp_tile_put              (GimpTile        *tile);
+static gint      gimp_tile_batch_next       (GimpTile       **tiles,
+                                             gint             n_tiles,
+                                             gint             start);
+static void      gimp_tile_batch_get        (GimpTile       **tiles,
+                                             gint             n_tiles);
+static void      gimp_tile_batch_request    (GimpTile       **tiles,
+                                             gint             n_tiles);
+static void      gimp_tile_batch_receive    (GimpTile       **tiles,
+                                             gint             n_tiles);
+static void      gimp_tile_batch_put        (GimpTile       **tiles,
+                                             gint             n_tiles);
+static void      gimp_tile_batch_free       (GimpTileBatch   *batch);
+static gboolean  gimp_tile_prefetch_pending (GimpTile        *tile);
+static void      gimp_tile_prefetch_wait    (GimpTile        *tile);
+static void      gimp_tile_prefetch_hold    (GimpTileBatch   *batch);
+static void      gimp_tile_prefetch_release (GimpDrawable    *drawable);
+static void      gimp_tile_cache_insert     (GimpTile        *tile);
+static gboolean  gimp_tile_cache_remove     (GimpTile        *tile);
+static void      gimp_tile_cache_flush      (GimpTile        *tile);
 
 
 /*  private variables  */
@@ -67,6 +111,10 @@ static gulong       max_tile_size   = 0;
 static gulong       cur_cache_size  = 0;
 static gulong       max_cache_size  = 0;
 
+static GQueue          prefetch_pending      = G_QUEUE_INIT;
+static gsize           prefetch_pending_size = 0;
+static GQueue          prefetch_held         = G_QUEUE_INIT;
+
 
 /*  public functions  */
 
@@ -75,6 +123,10 @@ gimp_tile_ref (GimpTile *tile)
 {
   g_return_if_fail (tile != NULL);
 
+  /*  the tile might be part of a prefetch that is still on its way  */
+  if (tile->ref_count == 0)
+    gimp_tile_prefetch_wait (tile);
+
   tile->ref_count++;
 
   if (tile->ref_count == 1)
@@ -91,6 +143,9 @@ gimp_tile_ref_zero (GimpTile *tile)
 {
   g_return_if_fail (tile != NULL);
 
+  if (tile->ref_count == 0)
+    gimp_tile_prefetch_wait (tile);
+
   tile->ref_count++;
 
   if (tile->ref_count == 1)
@@ -172,6 +227,8 @@ _gimp_tile_cache_flush_drawable (GimpDrawable *drawable)
 
   g_return_if_fail (drawable != NULL);
 
+  gimp_tile_prefetch_release (drawable);
+
   list = tile_list_head;
   while (list)
     {
@@ -184,6 +241,264 @@ _gimp_tile_cache_flush_drawable (GimpDrawable *drawable)
     }
 }
 
+/*  Batched tile transfers: instead of doing one round trip per tile,
+ *  a list of tiles of the same drawable is requested or written back
+ *  with a single message exchange. The functions below take arbitrary
+ *  lists of tiles and split them into batches as needed.
+ */
+
+void
+_gimp_tile_ref_batch (GimpTile **tiles,
+                      gint       n_tiles)
+{
+  GimpTile **fetch;
+  gint       n_fetch = 0;
+  gint       i;
+
+  g_return_if_fail (tiles != NULL || n_tiles == 0);
+
+  _gimp_tile_prefetch_finish ();
+
+  fetch = g_new (GimpTile *, n_tiles);
+
+  /*  reference all tiles before touching the cache, so inserting them
+   *  can't evict one of them
+   */
+  for (i = 0; i < n_tiles; i++)
+    {
+      GimpTile *tile = tiles[i];
+
+      tile->ref_count++;
+
+      if (tile->ref_count == 1)
+        {
+          tile->dirty = FALSE;
+          fetch[n_fetch++] = tile;
+        }
+    }
+
+  gimp_tile_batch_get (fetch, n_fetch);
+
+  g_free (fetch);
+
+  for (i = 0; i < n_tiles; i++)
+    gimp_tile_cache_insert (tiles[i]);
+}
+
+void
+_gimp_tile_unref_batch (GimpTile **tiles,
+                        gint       n_tiles,
+                        gboolean   dirty)
+{
+  GimpTile **release;
+  gint       n_release = 0;
+  gint       i;
+
+  g_return_if_fail (tiles != NULL || n_tiles == 0);
+
+  for (i = 0; i < n_tiles; i++)
+    g_return_if_fail (tiles[i]->ref_count > 0);
+
+  _gimp_tile_prefetch_finish ();
+
+  release = g_new (GimpTile *, n_tiles);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GimpTile *tile = tiles[i];
+
+      tile->ref_count--;
+      tile->dirty |= dirty;
+
+      if (tile->ref_count == 0)
+        release[n_release++] = tile;
+    }
+
+  _gimp_tile_flush_batch (release, n_release);
+
+  for (i = 0; i < n_release; i++)
+    {
+      g_free (release[i]->data);
+      release[i]->data = NULL;
+    }
+
+  g_free (release);
+}
+
+void
+_gimp_tile_flush_batch (GimpTile **tiles,
+                        gint       n_tiles)
+{
+  GimpTile **dirty;
+  gint       n_dirty = 0;
+  gint       start;
+  gint       i;
+
+  g_return_if_fail (tiles != NULL || n_tiles == 0);
+
+  _gimp_tile_prefetch_finish ();
+
+  dirty = g_new (GimpTile *, n_tiles);
+
+  for (i = 0; i < n_tiles; i++)
+    if (tiles[i]->data && tiles[i]->dirty)
+      {
+        /*  the same tile might be in the list more than once  */
+        tiles[i]->dirty = FALSE;
+        dirty[n_dirty++] = tiles[i];
+      }
+
+  for (start = 0; start < n_dirty; )
+    {
+      gint end = gimp_tile_batch_next (dirty, n_dirty, start);
+
+      if (end - start == 1)
+        gimp_tile_put (dirty[start]);
+      else
+        gimp_tile_batch_put (dirty + start, end - start);
+
+      start = end;
+    }
+
+  g_free (dirty);
+}
+
+/*  Requests the data of those of @tiles that are not loaded yet without
+ *  waiting for the answer. The answer is picked up as soon as one of the
+ *  tiles is needed, or before the next message is sent to the core, so
+ *  the transfer overlaps with whatever the plug-in does in between.
+ *  Several prefetches can be on their way, as long as they fit into
+ *  PREFETCH_MAX_SIZE; what doesn't fit is simply not prefetched.
+ */
+void
+_gimp_tile_prefetch (GimpTile **tiles,
+                     gint       n_tiles)
+{
+  GimpTileBatch *batch;
+  GimpTile     **fetch;
+  gsize          size    = 0;
+  gint           n_fetch = 0;
+  gint           i;
+
+  g_return_if_fail (tiles != NULL || n_tiles == 0);
+
+  if (g_queue_get_length (&prefetch_pending) >= PREFETCH_MAX_PENDING)
+    return;
+
+  fetch = g_new (GimpTile *, n_tiles);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GimpTile *tile = tiles[i];
+
+      if (tile->ref_count > 0 || tile->data ||
+          gimp_tile_prefetch_pending (tile))
+        continue;
+
+      if (n_fetch > 0 &&
+          (tile->drawable != fetch[0]->drawable ||
+           tile->shadow   != fetch[0]->shadow))
+        break;
+
+      if (prefetch_pending_size + size + TILE_DATA_SIZE (tile) >
+          PREFETCH_MAX_SIZE ||
+          n_fetch == GP_TILE_BATCH_MAX_TILES)
+        break;
+
+      size += TILE_DATA_SIZE (tile);
+      fetch[n_fetch++] = tile;
+    }
+
+  if (n_fetch < 2)
+    {
+      g_free (fetch);
+      return;
+    }
+
+  gimp_tile_batch_request (fetch, n_fetch);
+
+  batch = g_slice_new (GimpTileBatch);
+
+  batch->tiles   = fetch;
+  batch->n_tiles = n_fetch;
+
+  g_queue_push_tail (&prefetch_pending, batch);
+  prefetch_pending_size += size;
+}
+
+/*  Fetches those of @tiles that are not loaded yet in as few exchanges
+ *  as possible, and keeps them around like prefetched tiles until they
+ *  are used.
+ */
+void
+_gimp_tile_fetch (GimpTile **tiles,
+                  gint       n_tiles)
+{
+  GimpTile **fetch;
+  gint       n_fetch = 0;
+  gint       start;
+  gint       i;
+
+  g_return_if_fail (tiles != NULL || n_tiles == 0);
+
+  /*  tiles on their way arrive with the prefetches  */
+  for (i = 0; i < n_tiles; i++)
+    if (tiles[i]->ref_count == 0 && ! tiles[i]->data)
+      gimp_tile_prefetch_wait (tiles[i]);
+
+  fetch = g_new (GimpTile *, n_tiles);
+
+  for (i = 0; i < n_tiles; i++)
+    if (tiles[i]->ref_count == 0 && ! tiles[i]->data)
+      fetch[n_fetch++] = tiles[i];
+
+  if (n_fetch < 2)
+    {
+      g_free (fetch);
+      return;
+    }
+
+  _gimp_tile_prefetch_finish ();
+
+  for (start = 0; start < n_fetch; )
+    {
+      GimpTileBatch *batch = g_slice_new (GimpTileBatch);
+      gint           end   = gimp_tile_batch_next (fetch, n_fetch, start);
+
+      batch->n_tiles = end - start;
+      batch->tiles   = g_memdup (fetch + start,
+                                 batch->n_tiles * sizeof (GimpTile *));
+
+      gimp_tile_batch_request (batch->tiles, batch->n_tiles);
+      gimp_tile_batch_receive (batch->tiles, batch->n_tiles);
+
+      gimp_tile_prefetch_hold (batch);
+
+      start = end;
+    }
+
+  g_free (fetch);
+}
+
+/*  Picks up all prefetches that are still on their way  */
+void
+_gimp_tile_prefetch_finish (void)
+{
+  GimpTileBatch *batch;
+
+  while ((batch = g_queue_pop_head (&prefetch_pending)))
+    {
+      gint i;
+
+      for (i = 0; i < batch->n_tiles; i++)
+        prefetch_pending_size -= TILE_DATA_SIZE (batch->tiles[i]);
+
+      gimp_tile_batch_receive (batch->tiles, batch->n_tiles);
+
+      gimp_tile_prefetch_hold (batch);
+    }
+}
+
 
 /*  private functions  */
 
@@ -196,6 +511,8 @@ gimp_tile_get (GimpTile *tile)
   GPTileData      *tile_data;
   GimpWireMessage  msg;
 
+  _gimp_tile_prefetch_finish ();
+
   tile_req.drawable_ID = tile->drawable->drawable_id;
   tile_req.tile_num    = tile->tile_num;
   tile_req.shadow      = tile->shadow;
@@ -244,6 +561,8 @@ gimp_tile_put (GimpTile *tile)
   GPTileData      *tile_info;
   GimpWireMessage  msg;
 
+  _gimp_tile_prefetch_finish ();
+
   tile_req.drawable_ID = -1;
   tile_req.tile_num    = 0;
   tile_req.shadow      = 0;
@@ -283,6 +602,285 @@ gimp_tile_put (GimpTile *tile)
   gimp_wire_destroy (&msg);
 }
 
+/*  Returns the end of the batch starting at @start: all tiles in a
+ *  batch belong to the same drawable and the batch doesn't exceed
+ *  BATCH_SIZE bytes or GP_TILE_BATCH_MAX_TILES tiles, but contains at
+ *  least one tile.
+ */
+static gint
+gimp_tile_batch_next (GimpTile **tiles,
+                      gint       n_tiles,
+                      gint       start)
+{
+  gsize size = 0;
+  gint  end;
+
+  for (end = start; end < n_tiles; end++)
+    {
+      GimpTile *tile = tiles[end];
+
+      if (end > start)
+        {
+          if (tile->drawable != tiles[start]->drawable ||
+              tile->shadow   != tiles[start]->shadow   ||
+              size + TILE_DATA_SIZE (tile) > BATCH_SIZE ||
+              end - start == GP_TILE_BATCH_MAX_TILES)
+            break;
+        }
+
+      size += TILE_DATA_SIZE (tile);
+    }
+
+  return end;
+}
+
+static void
+gimp_tile_batch_get (GimpTile **tiles,
+                     gint       n_tiles)
+{
+  gint start;
+
+  for (start = 0; start < n_tiles; )
+    {
+      gint end = gimp_tile_batch_next (tiles, n_tiles, start);
+
+      /*  a single tile is faster through shared memory  */
+      if (end - start == 1)
+        {
+          gimp_tile_get (tiles[start]);
+        }
+      else
+        {
+          gimp_tile_batch_request (tiles + start, end - start);
+          gimp_tile_batch_receive (tiles + start, end - start);
+        }
+
+      start = end;
+    }
+}
+
+static void
+gimp_tile_batch_request (GimpTile **tiles,
+                         gint       n_tiles)
+{
+  extern GIOChannel *_writechannel;
+
+  GPTileBatchReq batch_req;
+  gint           i;
+
+  batch_req.drawable_ID = tiles[0]->drawable->drawable_id;
+  batch_req.shadow      = tiles[0]->shadow;
+  batch_req.ntiles      = n_tiles;
+  batch_req.tile_nums   = g_new (guint32, n_tiles);
+
+  for (i = 0; i < n_tiles; i++)
+    batch_req.tile_nums[i] = tiles[i]->tile_num;
+
+  if (! gp_tile_batch_req_write (_writechannel, &batch_req, NULL))
+    gimp_quit ();
+
+  g_free (batch_req.tile_nums);
+}
+
+static void
+gimp_tile_batch_receive (GimpTile **tiles,
+                         gint       n_tiles)
+{
+  GPTileBatchData *batch_data;
+  GimpWireMessage  msg;
+  const guchar    *src;
+  gint             i;
+
+  gimp_read_expect_msg (&msg, GP_TILE_BATCH_DATA);
+
+  batch_data = msg.data;
+  if (batch_data->drawable_ID != tiles[0]->drawable->drawable_id ||
+      batch_data->shadow      != tiles[0]->shadow                ||
+      batch_data->bpp         != tiles[0]->bpp                   ||
+      batch_data->ntiles      != (guint32) n_tiles)
+    {
+      g_message ("received tile batch did not match the requested tiles");
+      gimp_quit ();
+    }
+
+  src = batch_data->data;
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      GimpTile *tile = tiles[i];
+
+      if (batch_data->tile_nums[i] != tile->tile_num ||
+          batch_data->widths[i]    != tile->ewidth   ||
+          batch_data->heights[i]   != tile->eheight)
+        {
+          g_message ("received tile info did not match computed tile info");
+          gimp_quit ();
+        }
+
+      if (! tile->data)
+        tile->data = g_memdup (src, TILE_DATA_SIZE (tile));
+
+      src += TILE_DATA_SIZE (tile);
+    }
+
+  gimp_wire_destroy (&msg);
+}
+
+static void
+gimp_tile_batch_put (GimpTile **tiles,
+                     gint       n_tiles)
+{
+  extern GIOChannel *_writechannel;
+
+  GPTileBatchData  batch_data;
+  GimpWireMessage  msg;
+  guchar          *dest;
+  gint             i;
+
+  batch_data.drawable_ID = tiles[0]->drawable->drawable_id;
+  batch_data.shadow      = tiles[0]->shadow;
+  batch_data.bpp         = tiles[0]->bpp;
+  batch_data.ntiles      = n_tiles;
+  batch_data.tile_nums   = g_new (guint32, n_tiles);
+  batch_data.widths      = g_new (guint32, n_tiles);
+  batch_data.heights     = g_new (guint32, n_tiles);
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      batch_data.tile_nums[i] = tiles[i]->tile_num;
+      batch_data.widths[i]    = tiles[i]->ewidth;
+      batch_data.heights[i]   = tiles[i]->eheight;
+    }
+
+  batch_data.data = dest = g_malloc (gp_tile_batch_data_size (&batch_data));
+
+  for (i = 0; i < n_tiles; i++)
+    {
+      memcpy (dest, tiles[i]->data, TILE_DATA_SIZE (tiles[i]));
+      dest += TILE_DATA_SIZE (tiles[i]);
+    }
+
+  if (! gp_tile_batch_data_write (_writechannel, &batch_data, NULL))
+    gimp_quit ();
+
+  g_free (batch_data.tile_nums);
+  g_free (batch_data.widths);
+  g_free (batch_data.heights);
+  g_free (batch_data.data);
+
+  gimp_read_expect_msg (&msg, GP_TILE_ACK);
+  gimp_wire_destroy (&msg);
+}
+
+static void
+gimp_tile_batch_free (GimpTileBatch *batch)
+{
+  g_free (batch->tiles);
+  g_slice_free (GimpTileBatch, batch);
+}
+
+static gboolean
+gimp_tile_prefetch_pending (GimpTile *tile)
+{
+  GList *list;
+
+  for (list = prefetch_pending.head; list; list = list->next)
+    {
+      GimpTileBatch *batch = list->data;
+      gint           i;
+
+      for (i = 0; i < batch->n_tiles; i++)
+        if (batch->tiles[i] == tile)
+          return TRUE;
+    }
+
+  return FALSE;
+}
+
+/*  Picks up the prefetches up to the one containing @tile, if any. The
+ *  answers arrive in the order of the requests.
+ */
+static void
+gimp_tile_prefetch_wait (GimpTile *tile)
+{
+  if (! gimp_tile_prefetch_pending (tile))
+    return;
+
+  while (! tile->data)
+    {
+      GimpTileBatch *batch = g_queue_pop_head (&prefetch_pending);
+      gint           i;
+
+      for (i = 0; i < batch->n_tiles; i++)
+        prefetch_pending_size -= TILE_DATA_SIZE (batch->tiles[i]);
+
+      gimp_tile_batch_receive (batch->tiles, batch->n_tiles);
+
+      gimp_tile_prefetch_hold (batch);
+    }
+}
+
+/*  Keeps a reference on the received tiles of @batch until they are
+ *  used, skipping the ones which got referenced in the meantime.
+ */
+static void
+gimp_tile_prefetch_hold (GimpTileBatch *batch)
+{
+  gint n_held = 0;
+  gint i;
+
+  for (i = 0; i < batch->n_tiles; i++)
+    {
+      GimpTile *tile = batch->tiles[i];
+
+      if (tile->ref_count == 0 && tile->data)
+        {
+          tile->ref_count = 1;
+          tile->dirty     = FALSE;
+
+          batch->tiles[n_held++] = tile;
+        }
+    }
+
+  batch->n_tiles = n_held;
+
+  g_queue_push_tail (&prefetch_held, batch);
+
+  while (g_queue_get_length (&prefetch_held) > PREFETCH_MAX_HELD)
+    {
+      batch = g_queue_pop_head (&prefetch_held);
+
+      _gimp_tile_unref_batch (batch->tiles, batch->n_tiles, FALSE);
+      gimp_tile_batch_free (batch);
+    }
+}
+
+/*  Drops the references held on prefetched tiles of @drawable  */
+static void
+gimp_tile_prefetch_release (GimpDrawable *drawable)
+{
+  GList *list;
+
+  _gimp_tile_prefetch_finish ();
+
+  list = prefetch_held.head;
+  while (list)
+    {
+      GimpTileBatch *batch = list->data;
+      GList         *next  = list->next;
+
+      if (batch->n_tiles == 0 || batch->tiles[0]->drawable == drawable)
+        {
+          g_queue_delete_link (&prefetch_held, list);
+
+          _gimp_tile_unref_batch (batch->tiles, batch->n_tiles, FALSE);
+          gimp_tile_batch_free (batch);
+        }
+
+      list = next;
+    }
+}
+
 /* This function is nearly identical to the function 'tile_cache_insert'
  *  in the file 'tile_cache.c' which is part of the main gimp application.
  */
@@ -332,13 +930,23 @@ gimp_tile_cache_insert (GimpTile *tile)
 
       if ((cur_cache_size + max_tile_size) > max_cache_size)
         {
+          GPtrArray *evicted = g_ptr_array_new ();
+
           while (tile_list_head &&
                  (cur_cache_size +
                   max_cache_size * FREE_QUANTUM) > max_cache_size)
             {
-              gimp_tile_cache_flush ((GimpTile *) tile_list_head->data);
+              GimpTile *evict = tile_list_head->data;
+
+              gimp_tile_cache_remove (evict);
+              g_ptr_array_add (evicted, evict);
             }
 
+          /*  write the evicted tiles back in as few exchanges as possible  */
+          _gimp_tile_unref_batch ((GimpTile **) evicted->pdata, evicted->len,
+                                  FALSE);
+          g_ptr_array_free (evicted, TRUE);
+
           if ((cur_cache_size + max_tile_size) > max_cache_size)
             return;
         }
@@ -370,11 +978,25 @@ gimp_tile_cache_insert (GimpTile *tile)
 
 static void
 gimp_tile_cache_flush (GimpTile *tile)
+{
+  if (gimp_tile_cache_remove (tile))
+    {
+      /* Unreference the tile.
+       */
+      gimp_tile_unref (tile, FALSE);
+    }
+}
+
+/*  Removes @tile from the cache without dropping the cache's reference,
+ *  returns whether the tile was in the cache.
+ */
+static gboolean
+gimp_tile_cache_remove (GimpTile *tile)
 {
   GList *list;
 
   if (! tile_hash_table)
-    return;
+    return FALSE;
 
   /* Find where the tile is in the cache.
    */
@@ -403,8 +1025,8 @@ gimp_tile_cache_flush (GimpTile *tile)
        */
       cur_cache_size -= max_tile_size;
 
-      /* Unreference the tile.
-       */
-      gimp_tile_unref (tile, FALSE);
+      return TRUE;
     }
+
+  return FALSE;
 }
@@ -62,7 +62,20 @@ void    gimp_tile_cache_ntiles (gulong     ntiles);
 
 /*  private function  */
 
-G_GNUC_INTERNAL void _gimp_tile_cache_flush_drawable (GimpDrawable *drawable);
+G_GNUC_INTERNAL void _gimp_tile_cache_flush_drawable (GimpDrawable  *drawable);
+
+G_GNUC_INTERNAL void _gimp_tile_ref_batch            (GimpTile     **tiles,
+                                                      gint           n_tiles);
+G_GNUC_INTERNAL void _gimp_tile_unref_batch          (GimpTile     **tiles,
+                                                      gint           n_tiles,
+                                                      gboolean       dirty);
+G_GNUC_INTERNAL void _gimp_tile_flush_batch          (GimpTile     **tiles,
+                                                      gint           n_tiles);
+G_GNUC_INTERNAL void _gimp_tile_prefetch             (GimpTile     **tiles,
+                                                      gint           n_tiles);
+G_GNUC_INTERNAL void _gimp_tile_fetch                (GimpTile     **tiles,
+                                                      gint           n_tiles);
+G_GNUC_INTERNAL void _gimp_tile_prefetch_finish      (void);
 
 
 G_END_DECLS
@@ -123,7 +123,14 @@ enum
 
 enum
 {
-  ARCH_X86_INTEL_FEATURE_PNI      = 1 << 0
+  ARCH_X86_INTEL_FEATURE_PNI      = 1 << 0,
+  ARCH_X86_INTEL_FEATURE_OSXSAVE  = 1 << 27,
+  ARCH_X86_INTEL_FEATURE_AVX      = 1 << 28
+};
+
+enum
+{
+  ARCH_X86_INTEL_FEATURE_AVX2     = 1 << 5
 };
 
 #if !defined(ARCH_X86_64) && (defined(PIC) || defined(__PIC__))
@@ -146,6 +153,35 @@ enum
            : "0" (op))
 #endif
 
+#if !defined(ARCH_X86_64) && (defined(PIC) || defined(__PIC__))
+#define cpuid_count(op,count,eax,ebx,ecx,edx)  \
+  __asm__ ("movl %%ebx, %%esi\n\t"             \
+           "cpuid\n\t"                         \
+           "xchgl %%ebx,%%esi"                 \
+           : "=a" (eax),                       \
+             "=S" (ebx),                       \
+             "=c" (ecx),                       \
+             "=d" (edx)                        \
+           : "0" (op),                         \
+             "2" (count))
+#else
+#define cpuid_count(op,count,eax,ebx,ecx,edx)  \
+  __asm__ ("cpuid"                             \
+           : "=a" (eax),                       \
+             "=b" (ebx),                       \
+             "=c" (ecx),                       \
+             "=d" (edx)                        \
+           : "0" (op),                         \
+             "2" (count))
+#endif
+
+/* xgetbv, spelled out so we don't need -mxsave */
+#define xgetbv(index,eax,edx)                  \
+  __asm__ (".byte 0x0f, 0x01, 0xd0"            \
+           : "=a" (eax),                       \
+             "=d" (edx)                        \
+           : "c" (index))
+
 
 static X86Vendor
 arch_get_vendor (void)
@@ -227,8 +263,11 @@ arch_accel_intel (void)
 
 #ifdef USE_MMX
   {
+    guint32 max_op;
     guint32 eax, ebx, ecx, edx;
 
+    cpuid (0, max_op, ebx, ecx, edx);
+
     cpuid (1, eax, ebx, ecx, edx);
 
     if ((edx & ARCH_X86_INTEL_FEATURE_MMX) == 0)
@@ -245,6 +284,28 @@ arch_accel_intel (void)
 
     if (ecx & ARCH_X86_INTEL_FEATURE_PNI)
       caps |= GIMP_CPU_ACCEL_X86_SSE3;
+
+    /*  AVX needs the OS to save the ymm registers on context switch  */
+    if ((ecx & ARCH_X86_INTEL_FEATURE_OSXSAVE) &&
+        (ecx & ARCH_X86_INTEL_FEATURE_AVX))
+      {
+        guint32 xcr0_lo, xcr0_hi;
+
+        xgetbv (0, xcr0_lo, xcr0_hi);
+
+        if ((xcr0_lo & 0x6) == 0x6)
+          {
+            caps |= GIMP_CPU_ACCEL_X86_AVX;
+
+            if (max_op >= 7)
+              {
+                cpuid_count (7, 0, eax, ebx, ecx, edx);
+
+                if (ebx & ARCH_X86_INTEL_FEATURE_AVX2)
+                  caps |= GIMP_CPU_ACCEL_X86_AVX2;
+              }
+          }
+      }
 #endif /* USE_SSE */
   }
 #endif /* USE_MMX */
@@ -410,7 +471,10 @@ arch_accel (void)
 
 #ifdef USE_SSE
   if ((caps & GIMP_CPU_ACCEL_X86_SSE) && !arch_accel_sse_os_support ())
-    caps &= ~(GIMP_CPU_ACCEL_X86_SSE | GIMP_CPU_ACCEL_X86_SSE2);
+    caps &= ~(GIMP_CPU_ACCEL_X86_SSE  |
+              GIMP_CPU_ACCEL_X86_SSE2 |
+              GIMP_CPU_ACCEL_X86_AVX  |
+              GIMP_CPU_ACCEL_X86_AVX2);
 #endif
 
   return caps;
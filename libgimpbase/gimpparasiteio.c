@@ -77,19 +77,23 @@ void
 gimp_pixpipe_params_parse (const gchar       *string,
                            GimpPixPipeParams *params)
 {
-  gchar *copy;
-  gchar *p, *q, *r;
-  gint   i;
+  gchar **tokens;
+  gchar  *p, *r;
+  gint    i, t;
 
   g_return_if_fail (string != NULL);
   g_return_if_fail (params != NULL);
 
-  copy = g_strdup (string);
+  /*  not strtok(), brush pipes are loaded from several threads  */
+  tokens = g_strsplit_set (string, " \r\n", -1);
 
-  q = copy;
-  while ((p = strtok (q, " \r\n")) != NULL)
+  for (t = 0; tokens[t]; t++)
     {
-      q = NULL;
+      p = tokens[t];
+
+      if (! *p)
+        continue;
+
       r = strchr (p, ':');
       if (r)
         *r = 0;
@@ -165,7 +169,7 @@ gimp_pixpipe_params_parse (const gchar       *string,
         *r = ':';
     }
 
-  g_free (copy);
+  g_strfreev (tokens);
 }
 
 gchar *
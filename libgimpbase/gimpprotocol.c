@@ -140,6 +140,46 @@ static void _gp_has_init_write           (GIOChannel       *channel,
                                           gpointer          user_data);
 static void _gp_has_init_destroy         (GimpWireMessage  *msg);
 
+static void _gp_tile_batch_req_read      (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_batch_req_write     (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_batch_req_destroy   (GimpWireMessage  *msg);
+
+static void _gp_tile_batch_data_read     (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_batch_data_write    (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_tile_batch_data_destroy  (GimpWireMessage  *msg);
+
+static void _gp_drawable_map_req_read    (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_drawable_map_req_write   (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_drawable_map_req_destroy (GimpWireMessage  *msg);
+
+static void _gp_drawable_map_read        (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_drawable_map_write       (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_drawable_map_destroy     (GimpWireMessage  *msg);
+
+static void _gp_drawable_unmap_read      (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_drawable_unmap_write     (GIOChannel       *channel,
+                                          GimpWireMessage  *msg,
+                                          gpointer          user_data);
+static void _gp_drawable_unmap_destroy   (GimpWireMessage  *msg);
+
 
 
 void
@@ -197,6 +237,26 @@ gp_init (void)
                       _gp_has_init_read,
                       _gp_has_init_write,
                       _gp_has_init_destroy);
+  gimp_wire_register (GP_TILE_BATCH_REQ,
+                      _gp_tile_batch_req_read,
+                      _gp_tile_batch_req_write,
+                      _gp_tile_batch_req_destroy);
+  gimp_wire_register (GP_TILE_BATCH_DATA,
+                      _gp_tile_batch_data_read,
+                      _gp_tile_batch_data_write,
+                      _gp_tile_batch_data_destroy);
+  gimp_wire_register (GP_DRAWABLE_MAP_REQ,
+                      _gp_drawable_map_req_read,
+                      _gp_drawable_map_req_write,
+                      _gp_drawable_map_req_destroy);
+  gimp_wire_register (GP_DRAWABLE_MAP,
+                      _gp_drawable_map_read,
+                      _gp_drawable_map_write,
+                      _gp_drawable_map_destroy);
+  gimp_wire_register (GP_DRAWABLE_UNMAP,
+                      _gp_drawable_unmap_read,
+                      _gp_drawable_unmap_write,
+                      _gp_drawable_unmap_destroy);
 }
 
 gboolean
@@ -292,6 +352,124 @@ gp_tile_data_write (GIOChannel *channel,
   return TRUE;
 }
 
+gboolean
+gp_tile_batch_req_write (GIOChannel     *channel,
+                         GPTileBatchReq *batch_req,
+                         gpointer        user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_BATCH_REQ;
+  msg.data = batch_req;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_tile_batch_data_write (GIOChannel      *channel,
+                          GPTileBatchData *batch_data,
+                          gpointer         user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_TILE_BATCH_DATA;
+  msg.data = batch_data;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_drawable_map_req_write (GIOChannel       *channel,
+                           GPDrawableMapReq *map_req,
+                           gpointer          user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_DRAWABLE_MAP_REQ;
+  msg.data = map_req;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_drawable_map_write (GIOChannel    *channel,
+                       GPDrawableMap *map,
+                       gpointer       user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_DRAWABLE_MAP;
+  msg.data = map;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+gp_drawable_unmap_write (GIOChannel      *channel,
+                         GPDrawableUnmap *unmap,
+                         gpointer         user_data)
+{
+  GimpWireMessage msg;
+
+  msg.type = GP_DRAWABLE_UNMAP;
+  msg.data = unmap;
+
+  if (! gimp_wire_write_msg (channel, &msg, user_data))
+    return FALSE;
+
+  if (! gimp_wire_flush (channel, user_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * gp_tile_batch_data_size:
+ * @batch_data: a #GPTileBatchData
+ *
+ * Returns: the number of bytes needed to hold the pixels of all tiles
+ *          in @batch_data.
+ **/
+gsize
+gp_tile_batch_data_size (GPTileBatchData *batch_data)
+{
+  gsize size = 0;
+  guint i;
+
+  g_return_val_if_fail (batch_data != NULL, 0);
+
+  for (i = 0; i < batch_data->ntiles; i++)
+    size += ((gsize) batch_data->widths[i] *
+             (gsize) batch_data->heights[i] *
+             (gsize) batch_data->bpp);
+
+  return size;
+}
+
 gboolean
 gp_proc_run_write (GIOChannel *channel,
                    GPProcRun  *proc_run,
@@ -843,6 +1021,428 @@ _gp_tile_data_destroy (GimpWireMessage *msg)
     }
 }
 
+/*  tile_batch_req  */
+
+static void
+_gp_tile_batch_req_read (GIOChannel      *channel,
+                         GimpWireMessage *msg,
+                         gpointer         user_data)
+{
+  GPTileBatchReq *batch_req = g_slice_new0 (GPTileBatchReq);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &batch_req->drawable_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &batch_req->shadow, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &batch_req->ntiles, 1, user_data))
+    goto cleanup;
+
+  if (batch_req->ntiles > GP_TILE_BATCH_MAX_TILES)
+    goto cleanup;
+
+  if (batch_req->ntiles > 0)
+    {
+      batch_req->tile_nums = g_new (guint32, batch_req->ntiles);
+
+      if (! _gimp_wire_read_int32 (channel,
+                                   batch_req->tile_nums, batch_req->ntiles,
+                                   user_data))
+        goto cleanup;
+    }
+
+  msg->data = batch_req;
+  return;
+
+ cleanup:
+  g_free (batch_req->tile_nums);
+  g_slice_free (GPTileBatchReq, batch_req);
+  msg->data = NULL;
+}
+
+static void
+_gp_tile_batch_req_write (GIOChannel      *channel,
+                          GimpWireMessage *msg,
+                          gpointer         user_data)
+{
+  GPTileBatchReq *batch_req = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &batch_req->drawable_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &batch_req->shadow, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &batch_req->ntiles, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                batch_req->tile_nums, batch_req->ntiles,
+                                user_data))
+    return;
+}
+
+static void
+_gp_tile_batch_req_destroy (GimpWireMessage *msg)
+{
+  GPTileBatchReq *batch_req = msg->data;
+
+  if (batch_req)
+    {
+      g_free (batch_req->tile_nums);
+      g_slice_free (GPTileBatchReq, batch_req);
+    }
+}
+
+/*  tile_batch_data  */
+
+static void
+_gp_tile_batch_data_read (GIOChannel      *channel,
+                          GimpWireMessage *msg,
+                          gpointer         user_data)
+{
+  GPTileBatchData *batch_data = g_slice_new0 (GPTileBatchData);
+  gsize            length;
+  guint            i;
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &batch_data->drawable_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &batch_data->shadow, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &batch_data->bpp, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &batch_data->ntiles, 1, user_data))
+    goto cleanup;
+
+  if (batch_data->ntiles > GP_TILE_BATCH_MAX_TILES)
+    goto cleanup;
+
+  if (batch_data->ntiles > 0)
+    {
+      batch_data->tile_nums = g_new (guint32, batch_data->ntiles);
+      batch_data->widths    = g_new (guint32, batch_data->ntiles);
+      batch_data->heights   = g_new (guint32, batch_data->ntiles);
+
+      if (! _gimp_wire_read_int32 (channel,
+                                   batch_data->tile_nums, batch_data->ntiles,
+                                   user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   batch_data->widths, batch_data->ntiles,
+                                   user_data))
+        goto cleanup;
+      if (! _gimp_wire_read_int32 (channel,
+                                   batch_data->heights, batch_data->ntiles,
+                                   user_data))
+        goto cleanup;
+    }
+
+  /*  keep the size of the tiles from overflowing, a tile is never
+   *  anywhere near as big
+   */
+  if (batch_data->bpp > G_MAXUINT16)
+    goto cleanup;
+
+  for (i = 0; i < batch_data->ntiles; i++)
+    {
+      if (batch_data->widths[i]  > G_MAXUINT16 ||
+          batch_data->heights[i] > G_MAXUINT16)
+        goto cleanup;
+    }
+
+  length = gp_tile_batch_data_size (batch_data);
+
+  if (length > 0)
+    {
+      batch_data->data = g_try_malloc (length);
+
+      if (! batch_data->data)
+        goto cleanup;
+
+      if (! _gimp_wire_read_int8 (channel,
+                                  (guint8 *) batch_data->data, length,
+                                  user_data))
+        goto cleanup;
+    }
+
+  msg->data = batch_data;
+  return;
+
+ cleanup:
+  g_free (batch_data->tile_nums);
+  g_free (batch_data->widths);
+  g_free (batch_data->heights);
+  g_free (batch_data->data);
+  g_slice_free (GPTileBatchData, batch_data);
+  msg->data = NULL;
+}
+
+static void
+_gp_tile_batch_data_write (GIOChannel      *channel,
+                           GimpWireMessage *msg,
+                           gpointer         user_data)
+{
+  GPTileBatchData *batch_data = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &batch_data->drawable_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &batch_data->shadow, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &batch_data->bpp, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &batch_data->ntiles, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                batch_data->tile_nums, batch_data->ntiles,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                batch_data->widths, batch_data->ntiles,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                batch_data->heights, batch_data->ntiles,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int8 (channel,
+                               (const guint8 *) batch_data->data,
+                               gp_tile_batch_data_size (batch_data),
+                               user_data))
+    return;
+}
+
+static void
+_gp_tile_batch_data_destroy (GimpWireMessage *msg)
+{
+  GPTileBatchData *batch_data = msg->data;
+
+  if (batch_data)
+    {
+      g_free (batch_data->tile_nums);
+      g_free (batch_data->widths);
+      g_free (batch_data->heights);
+      g_free (batch_data->data);
+      g_slice_free (GPTileBatchData, batch_data);
+    }
+}
+
+/*  drawable_map_req  */
+
+static void
+_gp_drawable_map_req_read (GIOChannel      *channel,
+                           GimpWireMessage *msg,
+                           gpointer         user_data)
+{
+  GPDrawableMapReq *map_req = g_slice_new0 (GPDrawableMapReq);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &map_req->drawable_ID, 1,
+                               user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &map_req->shadow, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &map_req->writable, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &map_req->x, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &map_req->y, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &map_req->width, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &map_req->height, 1, user_data))
+    goto cleanup;
+
+  msg->data = map_req;
+  return;
+
+ cleanup:
+  g_slice_free (GPDrawableMapReq, map_req);
+  msg->data = NULL;
+}
+
+static void
+_gp_drawable_map_req_write (GIOChannel      *channel,
+                            GimpWireMessage *msg,
+                            gpointer         user_data)
+{
+  GPDrawableMapReq *map_req = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &map_req->drawable_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &map_req->shadow, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &map_req->writable, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &map_req->x, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &map_req->y, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &map_req->width, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &map_req->height, 1,
+                                user_data))
+    return;
+}
+
+static void
+_gp_drawable_map_req_destroy (GimpWireMessage *msg)
+{
+  GPDrawableMapReq *map_req = msg->data;
+
+  if (map_req)
+    g_slice_free (GPDrawableMapReq, map_req);
+}
+
+/*  drawable_map  */
+
+static void
+_gp_drawable_map_read (GIOChannel      *channel,
+                       GimpWireMessage *msg,
+                       gpointer         user_data)
+{
+  GPDrawableMap *map = g_slice_new0 (GPDrawableMap);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &map->map_ID, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &map->bpp, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &map->rowstride, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &map->shm_ID, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_string (channel,
+                                &map->shm_name, 1, user_data))
+    goto cleanup;
+
+  msg->data = map;
+  return;
+
+ cleanup:
+  g_free (map->shm_name);
+  g_slice_free (GPDrawableMap, map);
+  msg->data = NULL;
+}
+
+static void
+_gp_drawable_map_write (GIOChannel      *channel,
+                        GimpWireMessage *msg,
+                        gpointer         user_data)
+{
+  GPDrawableMap *map = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &map->map_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &map->bpp, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &map->rowstride, 1, user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &map->shm_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_string (channel,
+                                 &map->shm_name, 1, user_data))
+    return;
+}
+
+static void
+_gp_drawable_map_destroy (GimpWireMessage *msg)
+{
+  GPDrawableMap *map = msg->data;
+
+  if (map)
+    {
+      g_free (map->shm_name);
+      g_slice_free (GPDrawableMap, map);
+    }
+}
+
+/*  drawable_unmap  */
+
+static void
+_gp_drawable_unmap_read (GIOChannel      *channel,
+                         GimpWireMessage *msg,
+                         gpointer         user_data)
+{
+  GPDrawableUnmap *unmap = g_slice_new0 (GPDrawableUnmap);
+
+  if (! _gimp_wire_read_int32 (channel,
+                               (guint32 *) &unmap->map_ID, 1, user_data))
+    goto cleanup;
+  if (! _gimp_wire_read_int32 (channel,
+                               &unmap->dirty, 1, user_data))
+    goto cleanup;
+
+  msg->data = unmap;
+  return;
+
+ cleanup:
+  g_slice_free (GPDrawableUnmap, unmap);
+  msg->data = NULL;
+}
+
+static void
+_gp_drawable_unmap_write (GIOChannel      *channel,
+                          GimpWireMessage *msg,
+                          gpointer         user_data)
+{
+  GPDrawableUnmap *unmap = msg->data;
+
+  if (! _gimp_wire_write_int32 (channel,
+                                (const guint32 *) &unmap->map_ID, 1,
+                                user_data))
+    return;
+  if (! _gimp_wire_write_int32 (channel,
+                                &unmap->dirty, 1, user_data))
+    return;
+}
+
+static void
+_gp_drawable_unmap_destroy (GimpWireMessage *msg)
+{
+  GPDrawableUnmap *unmap = msg->data;
+
+  if (unmap)
+    g_slice_free (GPDrawableUnmap, unmap);
+}
+
 /*  proc_run  */
 
 static void
@@ -26,7 +26,13 @@ G_BEGIN_DECLS
 
 /* Increment every time the protocol changes
  */
-#define GIMP_PROTOCOL_VERSION  0x0014
+#define GIMP_PROTOCOL_VERSION  0x0016
+
+
+/*  The largest number of tiles in a single TILE_BATCH_REQ or
+ *  TILE_BATCH_DATA message, bigger batches are a protocol error.
+ */
+#define GP_TILE_BATCH_MAX_TILES 1024
 
 
 enum
@@ -43,7 +49,12 @@ enum
   GP_PROC_INSTALL,
   GP_PROC_UNINSTALL,
   GP_EXTENSION_ACK,
-  GP_HAS_INIT
+  GP_HAS_INIT,
+  GP_TILE_BATCH_REQ,
+  GP_TILE_BATCH_DATA,
+  GP_DRAWABLE_MAP_REQ,
+  GP_DRAWABLE_MAP,
+  GP_DRAWABLE_UNMAP
 };
 
 
@@ -58,6 +69,12 @@ typedef struct _GPProcReturn    GPProcReturn;
 typedef struct _GPProcInstall   GPProcInstall;
 typedef struct _GPProcUninstall GPProcUninstall;
 
+typedef struct _GPTileBatchReq   GPTileBatchReq;
+typedef struct _GPTileBatchData  GPTileBatchData;
+typedef struct _GPDrawableMapReq GPDrawableMapReq;
+typedef struct _GPDrawableMap    GPDrawableMap;
+typedef struct _GPDrawableUnmap  GPDrawableUnmap;
+
 
 struct _GPConfig
 {
@@ -103,6 +120,52 @@ struct _GPTileData
   guchar  *data;
 };
 
+struct _GPTileBatchReq
+{
+  gint32   drawable_ID;
+  guint32  shadow;
+  guint32  ntiles;
+  guint32 *tile_nums;
+};
+
+struct _GPTileBatchData
+{
+  gint32   drawable_ID;
+  guint32  shadow;
+  guint32  bpp;
+  guint32  ntiles;
+  guint32 *tile_nums;
+  guint32 *widths;
+  guint32 *heights;
+  guchar  *data;       /* the pixels of all tiles, one after the other */
+};
+
+struct _GPDrawableMapReq
+{
+  gint32   drawable_ID;
+  guint32  shadow;
+  guint32  writable;
+  gint32   x;
+  gint32   y;
+  gint32   width;
+  gint32   height;
+};
+
+struct _GPDrawableMap
+{
+  gint32   map_ID;     /* -1 if the region could not be mapped */
+  guint32  bpp;
+  guint32  rowstride;
+  gint32   shm_ID;
+  gchar   *shm_name;   /* empty for SysV shared memory */
+};
+
+struct _GPDrawableUnmap
+{
+  gint32   map_ID;
+  guint32  dirty;
+};
+
 struct _GPParam
 {
   guint32 type;
@@ -228,6 +291,24 @@ gboolean  gp_has_init_write         (GIOChannel      *channel,
 void      gp_params_destroy         (GPParam         *params,
                                      gint             nparams);
 
+gboolean  gp_tile_batch_req_write   (GIOChannel       *channel,
+                                     GPTileBatchReq   *batch_req,
+                                     gpointer          user_data);
+gboolean  gp_tile_batch_data_write  (GIOChannel       *channel,
+                                     GPTileBatchData  *batch_data,
+                                     gpointer          user_data);
+gsize     gp_tile_batch_data_size   (GPTileBatchData  *batch_data);
+
+gboolean  gp_drawable_map_req_write (GIOChannel       *channel,
+                                     GPDrawableMapReq *map_req,
+                                     gpointer          user_data);
+gboolean  gp_drawable_map_write     (GIOChannel       *channel,
+                                     GPDrawableMap    *map,
+                                     gpointer          user_data);
+gboolean  gp_drawable_unmap_write   (GIOChannel       *channel,
+                                     GPDrawableUnmap  *unmap,
+                                     gpointer          user_data);
+
 
 G_END_DECLS
 
@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <libgimp/gimp.h>
 #include <libgimp/gimpui.h>
@@ -50,32 +51,74 @@
 #define black_level      (despeckle_vals[2])    /* Black level */
 #define white_level      (despeckle_vals[3])    /* White level */
 
-/* List that stores pixels falling in to the same luma bucket */
-#define MAX_LIST_ELEMS SQR(2 * MAX_RADIUS + 1)
-
+#define HIST_COARSE      16                     /* 16 bins of 16 values */
+#define NO_SLOT          0xffff                 /* End of a row list */
+#define MASK_BITS        32                     /* Columns per mask word */
+
+/* Adds n pixels of luma value to a column or window histogram */
+#define HISTOGRAM_ADD(hist, value, n)                   \
+  G_STMT_START                                          \
+    {                                                   \
+      (hist)->fine[value]          += (n);              \
+      (hist)->coarse[(value) >> 4] += (n);              \
+                                                        \
+      if ((value) <= black_level)                       \
+        (hist)->n_black += (n);                         \
+                                                        \
+      if ((value) >= white_level)                       \
+        (hist)->n_white += (n);                         \
+    }                                                   \
+  G_STMT_END
+
+/* Histogram of the rows top to bottom of one source column, and for
+ * each value, a list of the rows having it
+ */
 typedef struct
 {
-  const guchar *elems[MAX_LIST_ELEMS];
-  gint          start;
-  gint          count;
-} PixelsList;
-
+  guint16  fine[256];
+  guint16  coarse[HIST_COARSE];
+  guint16  n_black;  /* Pixels at or below the black level */
+  guint16  n_white;  /* Pixels at or above the white level */
+  guint16  first[256];  /* Slot of the first row of each value */
+  gint     top;
+  gint     bottom;   /* Empty if bottom < top */
+} DespeckleColumn;
+
+/* Histogram of the filter box, the sum of the columns x1 to x2, which
+ * all count the rows y1 to y2
+ */
 typedef struct
 {
-  gint       elems[256]; /* Number of pixels that fall into each luma bucket */
-  PixelsList origs[256]; /* Original pixels */
-  gint       xmin;
-  gint       ymin;
-  gint       xmax;
-  gint       ymax; /* Source rect */
-} DespeckleHistogram;
-
-/* Number of pixels in actual histogram falling into each category */
-static gint                hist0;    /* Less than min treshold */
-static gint                hist255;  /* More than max treshold */
-static gint                histrest; /* From min to max        */
-
-static DespeckleHistogram  histogram;
+  gint     fine[256];
+  gint     coarse[HIST_COARSE];
+  gint     n_black;
+  gint     n_white;
+  gint     x1;
+  gint     y1;
+  gint     x2;       /* Empty if x2 < x1 */
+  gint     y2;
+} DespeckleWindow;
+
+/* The rows of a column and the columns of the box span fewer than
+ * n_slots positions, so position % n_slots is their slot in the row
+ * lists and the column masks
+ */
+typedef struct
+{
+  guchar          *src;
+  gint             rowstride;
+  gint             bpp;
+  gint             width;
+  gint             height;
+  guchar          *luma;      /* Luminance of the source, width x height */
+  DespeckleColumn *columns;
+  DespeckleWindow  window;
+  gint             n_slots;
+  guint16         *row_next;  /* Row lists, n_slots per column */
+  guint16         *row_prev;
+  gint             n_words;
+  guint32         *col_mask;  /* Box columns having each value, 256 per word */
+} DespeckleMedian;
 
 
 /*
@@ -90,13 +133,19 @@ static void      run   (const gchar      *name,
                         GimpParam       **return_vals);
 
 static void      despeckle                 (void);
-static void      despeckle_median          (guchar        *src,
-                                            guchar        *dst,
-                                            gint           width,
-                                            gint           height,
-                                            gint           bpp,
-                                            gint           radius,
-                                            gboolean       preview);
+static void      despeckle_tile            (const GimpProcessTile *tile,
+                                            gpointer               data);
+static void      despeckle_tile_init       (GimpProcessTile       *tile,
+                                            guchar                *src,
+                                            guchar                *dst,
+                                            gint                   x,
+                                            gint                   y,
+                                            gint                   width,
+                                            gint                   height,
+                                            gint                   bpp);
+static void      despeckle_median          (const GimpProcessTile *tile,
+                                            gint                   radius,
+                                            gboolean               show_progress);
 
 static gboolean  despeckle_dialog          (void);
 
@@ -373,31 +422,53 @@ pixel_copy (guchar       *dest,
  * 'despeckle()' - Despeckle an image using a median filter.
  *
  * A median filter basically collects pixel values in a region around the
- * target pixel, sorts them, and uses the median value. This code uses a
- * circular row buffer to improve performance.
+ * target pixel, sorts them, and uses the median value. This code keeps
+ * histograms of the source columns, so the time it takes per pixel does
+ * not grow with the radius.
  *
  * The adaptive filter is based on the median filter but analizes the histogram
  * of the region around the target pixel and adjusts the despeckle diameter
- * accordingly.
+ * accordingly, starting over at the full diameter on each row.
  */
 
 static void
 despeckle (void)
 {
-  GimpPixelRgn  src_rgn;        /* Source image region */
-  GimpPixelRgn  dst_rgn;
-  guchar       *src;
-  guchar       *dst;
-  gint          img_bpp;
-  gint          x, y;
-  gint          width, height;
-
-  img_bpp = gimp_drawable_bpp (drawable->drawable_id);
+  GimpPixelRgn     src_rgn;     /* Source image region */
+  GimpPixelRgn     dst_rgn;
+  GimpProcessTile  tile;
+  guchar          *src;
+  guchar          *dst;
+  gint             img_bpp;
+  gint             x, y;
+  gint             width, height;
 
   if (! gimp_drawable_mask_intersect (drawable->drawable_id,
                                       &x, &y, &width, &height))
     return;
 
+  gimp_progress_init (_("Despeckle"));
+
+  if (! (filter_type & FILTER_RECURSIVE))
+    {
+      /*
+       * Each pixel only depends on the source, and the adaptive radius
+       * starts over on each row, filter the image in tiles on all
+       * processors...
+       */
+
+      gimp_drawable_process_parallel (drawable->drawable_id, despeckle_radius,
+                                      despeckle_tile, NULL);
+      return;
+    }
+
+  /*
+   * The recursive filter feeds its results back into the source, so it
+   * has to run over the whole region in order...
+   */
+
+  img_bpp = gimp_drawable_bpp (drawable->drawable_id);
+
   gimp_pixel_rgn_init (&src_rgn, drawable, x, y, width, height, FALSE, FALSE);
   gimp_pixel_rgn_init (&dst_rgn, drawable, x, y, width, height, TRUE, TRUE);
 
@@ -406,7 +477,8 @@ despeckle (void)
 
   gimp_pixel_rgn_get_rect (&src_rgn, src, x, y, width, height);
 
-  despeckle_median (src, dst, width, height, img_bpp, despeckle_radius, FALSE);
+  despeckle_tile_init (&tile, src, dst, x, y, width, height, img_bpp);
+  despeckle_median (&tile, despeckle_radius, TRUE);
 
   gimp_pixel_rgn_set_rect (&dst_rgn, dst, x, y, width, height);
 
@@ -418,6 +490,44 @@ despeckle (void)
   g_free (src);
 }
 
+static void
+despeckle_tile (const GimpProcessTile *tile,
+                gpointer               data)
+{
+  despeckle_median (tile, despeckle_radius, FALSE);
+}
+
+/*
+ * 'despeckle_tile_init()' - Describe a whole buffer as a single tile.
+ */
+
+static void
+despeckle_tile_init (GimpProcessTile *tile,
+                     guchar          *src,
+                     guchar          *dst,
+                     gint             x,
+                     gint             y,
+                     gint             width,
+                     gint             height,
+                     gint             bpp)
+{
+  tile->src            = src;
+  tile->src_rowstride  = width * bpp;
+  tile->src_x          = x;
+  tile->src_y          = y;
+  tile->src_width      = width;
+  tile->src_height     = height;
+
+  tile->dest           = dst;
+  tile->dest_rowstride = width * bpp;
+  tile->x              = x;
+  tile->y              = y;
+  tile->width          = width;
+  tile->height         = height;
+
+  tile->bpp            = bpp;
+}
+
 
 
 /*
@@ -574,13 +684,14 @@ despeckle_dialog (void)
 static void
 preview_update (GtkWidget *widget)
 {
-  GimpPixelRgn  src_rgn;        /* Source image region */
-  guchar       *dst;            /* Output image */
-  GimpPreview  *preview;        /* The preview widget */
-  guchar       *src;            /* Source pixel rows */
-  gint          img_bpp;
-  gint          x1,y1;
-  gint          width, height;
+  GimpPixelRgn     src_rgn;     /* Source image region */
+  GimpProcessTile  tile;
+  guchar          *dst;         /* Output image */
+  GimpPreview     *preview;     /* The preview widget */
+  guchar          *src;         /* Source pixel rows */
+  gint             img_bpp;
+  gint             x1,y1;
+  gint             width, height;
 
   preview = GIMP_PREVIEW (widget);
 
@@ -598,7 +709,8 @@ preview_update (GtkWidget *widget)
 
   gimp_pixel_rgn_get_rect (&src_rgn, src, x1, y1, width, height);
 
-  despeckle_median (src, dst, width, height, img_bpp, despeckle_radius, TRUE);
+  despeckle_tile_init (&tile, src, dst, x1, y1, width, height, img_bpp);
+  despeckle_median (&tile, despeckle_radius, FALSE);
 
   gimp_preview_draw_buffer (preview, dst, width * img_bpp);
 
@@ -633,294 +745,452 @@ dialog_recursive_callback (GtkWidget *widget,
 
 
 
+/*
+ * The median engine is the constant time median filter of Perreault and
+ * Hebert: each source column keeps a histogram of the rows around the
+ * current row, and the box histogram slides along a row by adding the
+ * column entering it and subtracting the one leaving it. The columns
+ * follow the box down lazily, when it reaches them on the next row, so
+ * moving the box costs a fixed number of histogram bins, whatever its
+ * radius. A change of the adaptive filter's radius only adds or removes
+ * the pixels of the rows and columns at the box's edges.
+ *
+ * Next to the histograms, the box keeps a mask of the columns having
+ * each value, and each column a list of its rows having it, so a pixel
+ * with the median value is found without searching.
+ */
+
 static inline void
-list_add_elem (PixelsList   *list,
-               const guchar *elem)
+slot_list_add (guint16 *first,
+                 guint16 *next,
+                 guint16 *prev,
+                 guint16  slot)
 {
-  const gint pos = list->start + list->count++;
+  next[slot] = *first;
+  prev[slot] = NO_SLOT;
 
-  list->elems[pos >= MAX_LIST_ELEMS ? pos - MAX_LIST_ELEMS : pos] = elem;
+  if (*first != NO_SLOT)
+    prev[*first] = slot;
+
+  *first = slot;
 }
 
 static inline void
-list_del_elem (PixelsList* list)
+slot_list_remove (guint16 *first,
+                  guint16 *next,
+                  guint16 *prev,
+                  guint16  slot)
 {
-  list->count--;
-  list->start++;
+  if (prev[slot] != NO_SLOT)
+    next[prev[slot]] = next[slot];
+  else
+    *first = next[slot];
 
-  if (list->start >= MAX_LIST_ELEMS)
-    list->start = 0;
+  if (next[slot] != NO_SLOT)
+    prev[next[slot]] = prev[slot];
 }
 
-static inline const guchar *
-list_get_random_elem (PixelsList *list)
+/* The position in start ... start + n_slots - 1 having slot */
+static inline gint
+slot_position (const DespeckleMedian *median,
+               gint                   start,
+               guint16                slot)
 {
-  const gint pos = list->start + rand () % list->count;
+  gint offset = slot - start % median->n_slots;
 
-  if (pos >= MAX_LIST_ELEMS)
-    return list->elems[pos - MAX_LIST_ELEMS];
+  if (offset < 0)
+    offset += median->n_slots;
 
-  return list->elems[pos];
+  return start + offset;
 }
 
 static inline void
-histogram_add (DespeckleHistogram *hist,
-               guchar              val,
-               const guchar       *orig)
+window_mask_column (DespeckleMedian *median,
+                    gint             x,
+                    gint             value,
+                    gint             n)
 {
-  hist->elems[val]++;
-  list_add_elem (&hist->origs[val], orig);
-}
+  const gint  slot = x % median->n_slots;
+  guint32    *mask = median->col_mask + (slot / MASK_BITS) * 256 + value;
 
-static inline void
-histogram_remove (DespeckleHistogram *hist,
-                  guchar              val)
-{
-  hist->elems[val]--;
-  list_del_elem (&hist->origs[val]);
+  if (n > 0)
+    *mask |= 1U << (slot % MASK_BITS);
+  else
+    *mask &= ~(1U << (slot % MASK_BITS));
 }
 
 static inline void
-histogram_clean (DespeckleHistogram *hist)
+column_add (DespeckleMedian *median,
+            DespeckleColumn *column,
+            gint             x,
+            gint             y,
+            gint             n)
 {
-  gint i;
+  const gint  value = median->luma[y * median->width + x];
+  guint16    *next  = median->row_next + x * median->n_slots;
+  guint16    *prev  = median->row_prev + x * median->n_slots;
 
-  for (i = 0; i < 256; i++)
+  if (n > 0)
+    slot_list_add (&column->first[value], next, prev, y % median->n_slots);
+  else
+    slot_list_remove (&column->first[value], next, prev, y % median->n_slots);
+
+  HISTOGRAM_ADD (column, value, n);
+
+  /* Columns inside the box change the box too */
+  if (x >= median->window.x1 && x <= median->window.x2)
     {
-      hist->elems[i] = 0;
-      hist->origs[i].count = 0;
+      HISTOGRAM_ADD (&median->window, value, n);
+
+      /* The column gained or lost the value */
+      if (column->fine[value] == (n > 0 ? 1 : 0))
+        window_mask_column (median, x, value, n);
     }
 }
 
-static inline const guchar *
-histogram_get_median (DespeckleHistogram *hist,
-                      const guchar       *_default)
+static void
+column_set_rows (DespeckleMedian *median,
+                 gint             x,
+                 gint             top,
+                 gint             bottom)
 {
-  gint count = histrest;
-  gint i;
-  gint sum = 0;
+  DespeckleColumn *column = &median->columns[x];
 
-  if (! count)
-    return _default;
+  if (top > column->bottom || bottom < column->top)
+    {
+      /* Nothing to keep, this only happens outside the box */
+      memset (column, 0, G_STRUCT_OFFSET (DespeckleColumn, first));
+      memset (column->first, 0xff, sizeof (column->first));
 
-  count = (count + 1) / 2;
+      column->top    = top;
+      column->bottom = top - 1;
+    }
 
-  i = 0;
-  while ((sum += hist->elems[i]) < count)
-    i++;
+  while (column->top < top)
+    column_add (median, column, x, column->top++, -1);
+
+  while (column->bottom > bottom)
+    column_add (median, column, x, column->bottom--, -1);
 
-  return list_get_random_elem (&hist->origs[i]);
+  while (column->top > top)
+    column_add (median, column, x, --column->top, 1);
+
+  while (column->bottom < bottom)
+    column_add (median, column, x, ++column->bottom, 1);
 }
 
 static inline void
-add_val (DespeckleHistogram *hist,
-         const guchar       *src,
-         gint                width,
-         gint                bpp,
-         gint                x,
-         gint                y)
+window_add_column (DespeckleMedian *median,
+                   gint             x,
+                   gint             n)
 {
-  const gint pos   = (x + (y * width)) * bpp;
-  const gint value = pixel_luminance (src + pos, bpp);
+  DespeckleWindow       *window = &median->window;
+  const DespeckleColumn *column = &median->columns[x];
+  const gint             slot   = x % median->n_slots;
+  guint32               *mask;
+  guint32                bit;
+  gint                   i;
 
-  if (value > black_level && value < white_level)
-  {
-    histogram_add (hist, value, src + pos);
-    histrest++;
-  }
+  mask = median->col_mask + (slot / MASK_BITS) * 256;
+  bit  = 1U << (slot % MASK_BITS);
+
+  for (i = 0; i < 256; i++)
+    window->fine[i] += n * column->fine[i];
+
+  if (n > 0)
+    {
+      /* Without a branch, so it vectorizes */
+      for (i = 0; i < 256; i++)
+        mask[i] |= bit & (0U - (column->fine[i] != 0));
+    }
   else
-  {
-    if (value <= black_level)
-      hist0++;
+    {
+      for (i = 0; i < 256; i++)
+        mask[i] &= ~bit;
+    }
 
-    if (value >= white_level)
-      hist255++;
-  }
+  for (i = 0; i < HIST_COARSE; i++)
+    window->coarse[i] += n * column->coarse[i];
+
+  window->n_black += n * column->n_black;
+  window->n_white += n * column->n_white;
 }
 
-static inline void
-del_val (DespeckleHistogram *hist,
-         const guchar       *src,
-         gint                width,
-         gint                bpp,
-         gint                x,
-         gint                y)
+/*
+ * Add or remove row y of the box's columns, which are all at the box's
+ * rows.
+ */
+
+static void
+window_add_row (DespeckleMedian *median,
+                gint             y,
+                gint             n)
 {
-  const gint pos   = (x + (y * width)) * bpp;
-  const gint value = pixel_luminance (src + pos, bpp);
+  DespeckleWindow *window = &median->window;
+  gint             x;
 
-  if (value > black_level && value < white_level)
-  {
-    histogram_remove (hist, value);
-    histrest--;
-  }
-  else
-  {
-    if (value <= black_level)
-      hist0--;
+  for (x = window->x1; x <= window->x2; x++)
+    {
+      DespeckleColumn *column = &median->columns[x];
 
-    if (value >= white_level)
-      hist255--;
-  }
+      column_add (median, column, x, y, n);
+
+      if (y < column->top)
+        column->top = y;
+      else if (y > column->bottom)
+        column->bottom = y;
+      else if (y == column->top)
+        column->top = y + 1;
+      else
+        column->bottom = y - 1;
+    }
 }
 
-static inline void
-add_vals (DespeckleHistogram *hist,
-          const guchar       *src,
-          gint                width,
-          gint                bpp,
-          gint                xmin,
-          gint                ymin,
-          gint                xmax,
-          gint                ymax)
+static void
+window_clear (DespeckleMedian *median)
 {
-  gint x;
-  gint y;
+  DespeckleWindow *window = &median->window;
 
-  if (xmin > xmax)
-    return;
+  memset (window, 0, sizeof (DespeckleWindow));
+  memset (median->col_mask, 0, 256 * median->n_words * sizeof (guint32));
 
-  for (y = ymin; y <= ymax; y++)
-    {
-      for (x = xmin; x <= xmax; x++)
-        {
-          add_val (hist, src, width, bpp, x, y);
-        }
-    }
+  window->x2 = window->x1 - 1;
 }
 
-static inline void
-del_vals (DespeckleHistogram *hist,
-          const guchar       *src,
-          gint                width,
-          gint                bpp,
-          gint                xmin,
-          gint                ymin,
-          gint                xmax,
-          gint                ymax)
+/*
+ * Move the box to xmin, ymin - xmax, ymax. Its radius can change by no
+ * more than one pixel in each call, and it moves right along a row.
+ */
+
+static void
+window_move (DespeckleMedian *median,
+             gint             xmin,
+             gint             ymin,
+             gint             xmax,
+             gint             ymax)
 {
-  gint x;
-  gint y;
+  DespeckleWindow *window = &median->window;
+  gint             x;
 
-  if (xmin > xmax)
-    return;
+  /* Drop the columns that left the box */
+  while (window->x1 < xmin && window->x1 <= window->x2)
+    window_add_column (median, window->x1++, -1);
+
+  while (window->x2 > xmax && window->x2 >= window->x1)
+    window_add_column (median, window->x2--, -1);
 
-  for (y = ymin; y <= ymax; y++)
+  if (window->x2 < window->x1)
     {
-      for (x = xmin; x <= xmax; x++)
-        {
-          del_val (hist, src, width, bpp, x, y);
-        }
+      window->x1 = xmin;
+      window->x2 = xmin - 1;
     }
+
+  /* Grow or shrink the remaining columns by the edge rows, the box
+   * is only empty at the start of a row
+   */
+  if (window->x2 < window->x1)
+    {
+      window->y1 = ymin;
+      window->y2 = ymax;
+    }
+
+  while (window->y1 < ymin)
+    window_add_row (median, window->y1++, -1);
+
+  while (window->y2 > ymax)
+    window_add_row (median, window->y2--, -1);
+
+  while (window->y1 > ymin)
+    window_add_row (median, --window->y1, 1);
+
+  while (window->y2 < ymax)
+    window_add_row (median, ++window->y2, 1);
+
+  /* Bring in the columns that entered the box, updating them before
+   * they count as inside
+   */
+  while (window->x1 > xmin)
+    {
+      x = window->x1 - 1;
+
+      column_set_rows (median, x, ymin, ymax);
+      window_add_column (median, x, 1);
+
+      window->x1 = x;
+    }
+
+  while (window->x2 < xmax)
+    {
+      x = window->x2 + 1;
+
+      column_set_rows (median, x, ymin, ymax);
+      window_add_column (median, x, 1);
+
+      window->x2 = x;
+    }
+}
+
+/*
+ * Return the median of the box pixels between the black and white
+ * levels, one of the pixels having the median luminance, or _default if
+ * there are none.
+ */
+
+static const guchar *
+window_get_median (DespeckleMedian *median,
+                   const guchar    *_default)
+{
+  const DespeckleWindow *window = &median->window;
+  const DespeckleColumn *column;
+  const guint32         *mask;
+  gint                   count;
+  gint                   value;
+  gint                   x, y;
+  gint                   i;
+
+  count = ((window->x2 - window->x1 + 1) * (window->y2 - window->y1 + 1) -
+           window->n_black - window->n_white);
+
+  if (count <= 0)
+    return _default;
+
+  /* Pixels at or below the black level come first */
+  count = window->n_black + (count + 1) / 2;
+
+  i = 0;
+  while (count > window->coarse[i])
+    count -= window->coarse[i++];
+
+  value = i * 16;
+  while (count > window->fine[value])
+    count -= window->fine[value++];
+
+  /* A column having the value, and the first of its rows having it */
+  mask = median->col_mask + value;
+
+  for (i = 0; ! *mask; i++)
+    mask += 256;
+
+  x      = slot_position (median, window->x1,
+                          i * MASK_BITS + g_bit_nth_lsf (*mask, -1));
+  column = &median->columns[x];
+  y      = slot_position (median, column->top, column->first[value]);
+
+  return median->src + y * median->rowstride + x * median->bpp;
 }
 
+/*
+ * Replace the source pixel at x, y, for the recursive filter.
+ */
+
 static inline void
-update_histogram (DespeckleHistogram *hist,
-                  const guchar       *src,
-                  gint                width,
-                  gint                bpp,
-                  gint                xmin,
-                  gint                ymin,
-                  gint                xmax,
-                  gint                ymax)
+median_set_pixel (DespeckleMedian *median,
+                  gint             x,
+                  gint             y,
+                  const guchar    *pixel)
 {
-  /* assuming that radious of the box can change no more than one
-     pixel in each call */
-  /* assuming that box is moving either right or down */
-
-  del_vals (hist,
-            src, width, bpp, hist->xmin, hist->ymin, xmin - 1, hist->ymax);
-  del_vals (hist, src, width, bpp, xmin, hist->ymin, xmax, ymin - 1);
-  del_vals (hist, src, width, bpp, xmin, ymax + 1, xmax, hist->ymax);
-
-  add_vals (hist, src, width, bpp, hist->xmax + 1, ymin, xmax, ymax);
-  add_vals (hist, src, width, bpp, xmin, ymin, hist->xmax, hist->ymin - 1);
-  add_vals (hist,
-            src, width, bpp, hist->xmin, hist->ymax + 1, hist->xmax, ymax);
-
-  hist->xmin = xmin;
-  hist->ymin = ymin;
-  hist->xmax = xmax;
-  hist->ymax = ymax;
+  DespeckleColumn *column = &median->columns[x];
+  guchar          *dest;
+
+  dest = median->src + y * median->rowstride + x * median->bpp;
+
+  column_add (median, column, x, y, -1);
+
+  pixel_copy (dest, pixel, median->bpp);
+  median->luma[y * median->width + x] = pixel_luminance (dest, median->bpp);
+
+  column_add (median, column, x, y, 1);
 }
 
 
 static void
-despeckle_median (guchar   *src,
-                  guchar   *dst,
-                  gint      width,
-                  gint      height,
-                  gint      bpp,
-                  gint      radius,
-                  gboolean  preview)
+despeckle_median (const GimpProcessTile *tile,
+                  gint                   radius,
+                  gboolean               show_progress)
 {
-  guint  progress;
-  guint  max_progress;
-  gint   x, y;
-  gint   adapt_radius;
-  gint   pos;
-  gint   ymin;
-  gint   ymax;
-  gint   xmin;
-  gint   xmax;
-
-  memset (&histogram, 0, sizeof(histogram));
-  progress     = 0;
-  max_progress = width * height;
-
-  if (! preview)
-    gimp_progress_init(_("Despeckle"));
-
-  adapt_radius = radius;
-  for (y = 0; y < height; y++)
+  DespeckleMedian  median;
+  gint             x0, y0;
+  gint             x, y;
+  gint             adapt_radius;
+  gint             ymin;
+  gint             ymax;
+  gint             xmin;
+  gint             xmax;
+
+  /* Only the recursive filter writes to the source, and it is never run
+   * on shared tiles, see despeckle()
+   */
+  median.src       = (guchar *) tile->src;
+  median.rowstride = tile->src_rowstride;
+  median.bpp       = tile->bpp;
+  median.width     = tile->src_width;
+  median.height    = tile->src_height;
+
+  median.luma = g_new (guchar, median.width * median.height);
+
+  for (y = 0; y < median.height; y++)
     {
-      x = 0;
-      ymin = MAX (0, y - adapt_radius);
-      ymax = MIN (height - 1, y + adapt_radius);
-      xmin = MAX (0, x - adapt_radius);
-      xmax = MIN (width - 1, x + adapt_radius);
-      hist0   = 0;
-      histrest = 0;
-      hist255 = 0;
-      histogram_clean (&histogram);
-      histogram.xmin = xmin;
-      histogram.ymin = ymin;
-      histogram.xmax = xmax;
-      histogram.ymax = ymax;
-      add_vals (&histogram,
-                src, width, bpp,
-                histogram.xmin, histogram.ymin, histogram.xmax, histogram.ymax);
-
-      for (x = 0; x < width; x++)
+      const guchar *src  = median.src + y * median.rowstride;
+      guchar       *luma = median.luma + y * median.width;
+
+      for (x = 0; x < median.width; x++, src += median.bpp)
+        luma[x] = pixel_luminance (src, median.bpp);
+    }
+
+  median.columns = g_new (DespeckleColumn, median.width);
+
+  for (x = 0; x < median.width; x++)
+    {
+      median.columns[x].top    = 0;
+      median.columns[x].bottom = -1;
+    }
+
+  /* The box and the columns span at most 2 * radius + 1 positions */
+  median.n_slots  = 2 * radius + 2;
+  median.row_next = g_new (guint16, median.width * median.n_slots);
+  median.row_prev = g_new (guint16, median.width * median.n_slots);
+  median.n_words  = (median.n_slots + MASK_BITS - 1) / MASK_BITS;
+  median.col_mask = g_new (guint32, 256 * median.n_words);
+
+  /* The position of the destination rect in the source */
+  x0 = tile->x - tile->src_x;
+  y0 = tile->y - tile->src_y;
+
+  for (y = y0; y < y0 + tile->height; y++)
+    {
+      guchar *dest = tile->dest + (y - y0) * tile->dest_rowstride;
+
+      adapt_radius = radius;
+
+      window_clear (&median);
+
+      for (x = x0; x < x0 + tile->width; x++, dest += median.bpp)
         {
           const guchar *pixel;
 
-          ymin = MAX (0, y - adapt_radius); /* update ymin, ymax when adapt_radius changed (FILTER_ADAPTIVE) */
-          ymax = MIN (height - 1, y + adapt_radius);
+          ymin = MAX (0, y - adapt_radius);
+          ymax = MIN (median.height - 1, y + adapt_radius);
           xmin = MAX (0, x - adapt_radius);
-          xmax = MIN (width - 1, x + adapt_radius);
+          xmax = MIN (median.width - 1, x + adapt_radius);
 
-          update_histogram (&histogram,
-                            src, width, bpp, xmin, ymin, xmax, ymax);
+          window_move (&median, xmin, ymin, xmax, ymax);
 
-          pos = (x + (y * width)) * bpp;
-          pixel = histogram_get_median (&histogram, src + pos);
+          pixel = window_get_median (&median,
+                                     median.src +
+                                     y * median.rowstride + x * median.bpp);
 
-          if (filter_type & FILTER_RECURSIVE)
-            {
-              del_val (&histogram, src, width, bpp, x, y);
-              pixel_copy (src + pos, pixel, bpp);
-              add_val (&histogram, src, width, bpp, x, y);
-            }
+          pixel_copy (dest, pixel, median.bpp);
 
-          pixel_copy (dst + pos, pixel, bpp);
+          if (filter_type & FILTER_RECURSIVE)
+            median_set_pixel (&median, x, y, dest);
 
           /*
            * Check the histogram and adjust the diameter accordingly...
            */
           if (filter_type & FILTER_ADAPTIVE)
             {
-              if (hist0 >= adapt_radius || hist255 >= adapt_radius)
+              if (median.window.n_black >= adapt_radius ||
+                  median.window.n_white >= adapt_radius)
                 {
                   if (adapt_radius < radius)
                     adapt_radius++;
@@ -932,12 +1202,16 @@ despeckle_median (guchar   *src,
             }
         }
 
-      progress += width;
-
-      if (! preview && y % 32 == 0)
-        gimp_progress_update ((gdouble) progress / (gdouble) max_progress);
+      if (show_progress && (y - y0) % 32 == 0)
+        gimp_progress_update ((gdouble) (y - y0 + 1) / (gdouble) tile->height);
     }
 
-  if (! preview)
+  if (show_progress)
     gimp_progress_update (1.0);
+
+  g_free (median.col_mask);
+  g_free (median.row_prev);
+  g_free (median.row_next);
+  g_free (median.columns);
+  g_free (median.luma);
 }
@@ -53,6 +53,20 @@ typedef struct
   gint     mode;
 } OilifyVals;
 
+typedef struct
+{
+  gboolean  use_inten;
+  gint     *sqr_lut;
+  gint      x;                  /*  origin of the map buffers  */
+  gint      y;
+  guchar   *msmap_buf;          /*  NULL unless using a mask-size map  */
+  gint      msmap_bpp;
+  gint      msmap_rowstride;
+  guchar   *emap_buf;           /*  NULL unless using an exponent map  */
+  gint      emap_bpp;
+  gint      emap_rowstride;
+} OilifyContext;
+
 
 /* Declare local functions.
  */
@@ -65,6 +79,14 @@ static void      run            (const gchar      *name,
 
 static void      oilify         (GimpDrawable     *drawable,
                                  GimpPreview      *preview);
+static void      oilify_tile    (const GimpProcessTile *tile,
+                                 gpointer          data);
+static guchar  * oilify_get_map (gint32            drawable_ID,
+                                 gint              x,
+                                 gint              y,
+                                 gint              width,
+                                 gint              height,
+                                 gint             *bpp);
 
 static gboolean  oilify_dialog  (GimpDrawable     *drawable);
 
@@ -436,31 +458,11 @@ static void
 oilify (GimpDrawable *drawable,
         GimpPreview  *preview)
 {
-  gboolean      use_inten;
-  gboolean      use_msmap = FALSE;
-  gboolean      use_emap = FALSE;
-  GimpDrawable *mask_size_map_drawable = NULL;
-  GimpDrawable *exponent_map_drawable = NULL;
-  GimpPixelRgn  mask_size_map_rgn;
-  GimpPixelRgn  exponent_map_rgn;
-  gint          msmap_bpp = 0;
-  gint          emap_bpp = 0;
-  GimpPixelRgn  dest_rgn;
-  GimpPixelRgn *regions[3];
-  gint          n_regions;
-  gint          bpp;
-  gint         *sqr_lut;
-  gint          x1, y1, x2, y2;
-  gint          width, height;
-  gint          Hist[HISTSIZE];
-  gint          Hist_rgb[4][HISTSIZE];
-  gpointer      pr;
-  gint          progress, max_progress;
-  guchar       *src_buf;
-  guchar       *src_inten_buf = NULL;
-  gint          i;
-
-  use_inten = (ovals.mode == MODE_INTEN);
+  OilifyContext  context = { 0, };
+  gint           halo;
+  gint           x1, y1, x2, y2;
+  gint           width, height;
+  gint           i;
 
   /*  Get the selection bounds  */
   if (preview)
@@ -478,265 +480,273 @@ oilify (GimpDrawable *drawable,
       height = y2 - y1;
     }
 
-  progress = 0;
-  max_progress = width * height;
+  context.use_inten = (ovals.mode == MODE_INTEN);
+  context.x         = x1;
+  context.y         = y1;
 
-  bpp = drawable->bpp;
+  /*  The largest radius, with a mask-size map too  */
+  halo = ROUND (0.5 * ovals.mask_size);
 
   /*
    * Look-up-table implementation of the square function, for use in the
    * VERY TIGHT inner loops
    */
-  {
-    gint lut_size = (gint) ovals.mask_size / 2 + 1;
-
-    sqr_lut = g_new (gint, lut_size);
+  context.sqr_lut = g_new (gint, halo + 1);
 
-    for (i = 0; i < lut_size; i++)
-      sqr_lut[i] = SQR (i);
-  }
+  for (i = 0; i <= halo; i++)
+    context.sqr_lut[i] = SQR (i);
 
   /*  Get the map drawables, if applicable  */
 
   if (ovals.use_mask_size_map && ovals.mask_size_map >= 0)
     {
-      use_msmap = TRUE;
-
-      mask_size_map_drawable = gimp_drawable_get (ovals.mask_size_map);
-      gimp_pixel_rgn_init (&mask_size_map_rgn, mask_size_map_drawable,
-                           x1, y1, width, height, FALSE, FALSE);
-
-      msmap_bpp = mask_size_map_drawable->bpp;
+      context.msmap_buf = oilify_get_map (ovals.mask_size_map,
+                                          x1, y1, width, height,
+                                          &context.msmap_bpp);
+      context.msmap_rowstride = width * context.msmap_bpp;
     }
 
   if (ovals.use_exponent_map && ovals.exponent_map >= 0)
     {
-      use_emap = TRUE;
+      context.emap_buf = oilify_get_map (ovals.exponent_map,
+                                         x1, y1, width, height,
+                                         &context.emap_bpp);
+      context.emap_rowstride = width * context.emap_bpp;
+    }
 
-      exponent_map_drawable = gimp_drawable_get (ovals.exponent_map);
-      gimp_pixel_rgn_init (&exponent_map_rgn, exponent_map_drawable,
+  if (preview)
+    {
+      GimpPixelRgn     src_rgn;
+      GimpProcessTile  tile;
+      gint             bpp = drawable->bpp;
+
+      tile.src_rowstride  = width * bpp;
+      tile.src_x          = x1;
+      tile.src_y          = y1;
+      tile.src_width      = width;
+      tile.src_height     = height;
+      tile.dest_rowstride = width * bpp;
+      tile.x              = x1;
+      tile.y              = y1;
+      tile.width          = width;
+      tile.height         = height;
+      tile.bpp            = bpp;
+
+      tile.src  = g_new (guchar, width * height * bpp);
+      tile.dest = g_new (guchar, width * height * bpp);
+
+      gimp_pixel_rgn_init (&src_rgn, drawable,
                            x1, y1, width, height, FALSE, FALSE);
+      gimp_pixel_rgn_get_rect (&src_rgn, (guchar *) tile.src,
+                               x1, y1, width, height);
 
-      emap_bpp = exponent_map_drawable->bpp;
-    }
+      oilify_tile (&tile, &context);
 
-  gimp_pixel_rgn_init (&dest_rgn, drawable,
-                       x1, y1, width, height, (preview == NULL), TRUE);
+      gimp_preview_draw_buffer (preview, tile.dest, tile.dest_rowstride);
 
-  {
-    GimpPixelRgn src_rgn;
+      g_free (tile.dest);
+      g_free ((guchar *) tile.src);
+    }
+  else
+    {
+      /*  Oil-paint the region on all processors  */
+      gimp_drawable_process_parallel (drawable->drawable_id, halo,
+                                      oilify_tile, &context);
+    }
+
+  g_free (context.emap_buf);
+  g_free (context.msmap_buf);
+  g_free (context.sqr_lut);
+}
 
-    gimp_pixel_rgn_init (&src_rgn, drawable,
-                         x1, y1, width, height, FALSE, FALSE);
-    src_buf = g_new (guchar, width * height * bpp);
-    gimp_pixel_rgn_get_rect (&src_rgn, src_buf, x1, y1, width, height);
-  }
+/*
+ * Oil-paint one tile. This runs on several threads at once, so it only
+ * reads the context and the globals.
+ */
+static void
+oilify_tile (const GimpProcessTile *tile,
+             gpointer               data)
+{
+  OilifyContext *context   = data;
+  gint           bpp       = tile->bpp;
+  gint           src_x2    = tile->src_x + tile->src_width;
+  gint           src_y2    = tile->src_y + tile->src_height;
+  gint          *sqr_lut   = context->sqr_lut;
+  gboolean       use_inten = context->use_inten;
+  guchar        *src_inten_buf = NULL;
+  gint           Hist[HISTSIZE];
+  gint           Hist_rgb[4][HISTSIZE];
+  gint           x, y;
 
   /*
    * If we're working in intensity mode, then generate a separate intensity
-   * map of the source image. This way, we can avoid calculating the
+   * map of the source tile. This way, we can avoid calculating the
    * intensity of any given source pixel more than once.
    */
   if (use_inten)
     {
-      guchar *src;
-      guchar *dest;
-
-      src_inten_buf = g_new (guchar, width * height);
-
-      for (i = 0,
-           src = src_buf,
-           dest = src_inten_buf
-           ;
-           i < (width * height)
-           ;
-           i++,
-           src += bpp,
-           dest++)
+      src_inten_buf = g_new (guchar, tile->src_width * tile->src_height);
+
+      for (y = 0; y < tile->src_height; y++)
         {
-          *dest = (guchar) GIMP_RGB_LUMINANCE (src[0], src[1], src[2]);
+          const guchar *src  = tile->src + y * tile->src_rowstride;
+          guchar       *dest = src_inten_buf + y * tile->src_width;
+
+          for (x = 0; x < tile->src_width; x++, src += bpp)
+            dest[x] = (guchar) GIMP_RGB_LUMINANCE (src[0], src[1], src[2]);
         }
     }
 
-  n_regions = 0;
-  regions[n_regions++] = &dest_rgn;
-  if (use_msmap)
-    regions[n_regions++] = &mask_size_map_rgn;
-  if (use_emap)
-    regions[n_regions++] = &exponent_map_rgn;
-
-  for (pr = gimp_pixel_rgns_register2 (n_regions, regions);
-       pr != NULL;
-       pr = gimp_pixel_rgns_process (pr))
+  for (y = tile->y; y < tile->y + tile->height; y++)
     {
-      gint    y;
-      guchar *dest_row;
-      guchar *src_msmap_row = NULL;
-      guchar *src_emap_row = NULL;
-
-      for (y = dest_rgn.y,
-           dest_row = dest_rgn.data,
-           src_msmap_row = mask_size_map_rgn.data,  /* valid iff use_msmap */
-           src_emap_row = exponent_map_rgn.data     /* valid iff use_emap */
-           ;
-           y < (gint) (dest_rgn.y + dest_rgn.h)
-           ;
-           y++,
-           dest_row += dest_rgn.rowstride,
-           src_msmap_row += mask_size_map_rgn.rowstride,  /* valid iff use_msmap */
-           src_emap_row += exponent_map_rgn.rowstride)    /* valid iff use_emap */
+      guchar       *dest;
+      const guchar *src_msmap = NULL;
+      const guchar *src_emap  = NULL;
+
+      dest = tile->dest + (y - tile->y) * tile->dest_rowstride;
+
+      if (context->msmap_buf)
+        src_msmap = (context->msmap_buf +
+                     (y - context->y) * context->msmap_rowstride +
+                     (tile->x - context->x) * context->msmap_bpp);
+
+      if (context->emap_buf)
+        src_emap = (context->emap_buf +
+                    (y - context->y) * context->emap_rowstride +
+                    (tile->x - context->x) * context->emap_bpp);
+
+      for (x = tile->x; x < tile->x + tile->width; x++, dest += bpp)
         {
-          gint    x;
-          guchar *dest;
-          guchar *src_msmap = NULL;
-          guchar *src_emap = NULL;
-
-          for (x = dest_rgn.x,
-               dest = dest_row,
-               src_msmap = src_msmap_row,  /* valid iff use_msmap */
-               src_emap = src_emap_row     /* valid iff use_emap */
-               ;
-               x < (gint) (dest_rgn.x + dest_rgn.w)
-               ;
-               x++,
-               dest += bpp,
-               src_msmap += msmap_bpp,  /* valid iff use_msmap */
-               src_emap += emap_bpp)    /* valid iff use_emap */
+          gint          radius, radius_squared;
+          gfloat        exponent;
+          gint          mask_x1, mask_y1;
+          gint          mask_x2, mask_y2;
+          gint          mask_y;
+          const guchar *src_row;
+          const guchar *src_inten_row = NULL;
+
+          if (src_msmap)
             {
-              gint    radius, radius_squared;
-              gfloat  exponent;
-              gint    mask_x1, mask_y1;
-              gint    mask_x2, mask_y2;
-              gint    mask_y;
-              gint    src_offset;
-              guchar *src_row;
-              guchar *src_inten_row = NULL;
-
-              if (use_msmap)
-                {
-                  gfloat factor = get_map_value (src_msmap, msmap_bpp);
+              gfloat factor = get_map_value (src_msmap, context->msmap_bpp);
 
-                  radius = ROUND (factor * (0.5 * ovals.mask_size));
-                }
-              else
-                {
-                  radius = (gint) ovals.mask_size / 2;
-                }
+              radius = ROUND (factor * (0.5 * ovals.mask_size));
+
+              src_msmap += context->msmap_bpp;
+            }
+          else
+            {
+              radius = (gint) ovals.mask_size / 2;
+            }
 
-              radius_squared = SQR (radius);
+          radius_squared = SQR (radius);
 
-              exponent = ovals.exponent;
-              if (use_emap)
-                exponent *= get_map_value (src_emap, emap_bpp);
+          exponent = ovals.exponent;
+          if (src_emap)
+            {
+              exponent *= get_map_value (src_emap, context->emap_bpp);
 
-              if (use_inten)
-                memset (Hist, 0, sizeof (Hist));
-
-              memset (Hist_rgb, 0, sizeof (Hist_rgb));
-
-              mask_x1 = CLAMP ((x - radius), x1, x2);
-              mask_y1 = CLAMP ((y - radius), y1, y2);
-              mask_x2 = CLAMP ((x + radius + 1), x1, x2);
-              mask_y2 = CLAMP ((y + radius + 1), y1, y2);
-
-              src_offset = (mask_y1 - y1) * width + (mask_x1 - x1);
-
-              for (mask_y = mask_y1,
-                   src_row = src_buf + src_offset * bpp,
-                   src_inten_row = src_inten_buf + src_offset  /* valid iff use_inten */
-                   ;
-                   mask_y < mask_y2
-                   ;
-                   mask_y++,
-                   src_row += width * bpp,
-                   src_inten_row += width)  /* valid iff use_inten */
+              src_emap += context->emap_bpp;
+            }
+
+          if (use_inten)
+            memset (Hist, 0, sizeof (Hist));
+
+          memset (Hist_rgb, 0, sizeof (Hist_rgb));
+
+          mask_x1 = CLAMP ((x - radius), tile->src_x, src_x2);
+          mask_y1 = CLAMP ((y - radius), tile->src_y, src_y2);
+          mask_x2 = CLAMP ((x + radius + 1), tile->src_x, src_x2);
+          mask_y2 = CLAMP ((y + radius + 1), tile->src_y, src_y2);
+
+          src_row = (tile->src +
+                     (mask_y1 - tile->src_y) * tile->src_rowstride +
+                     (mask_x1 - tile->src_x) * bpp);
+
+          if (use_inten)
+            src_inten_row = (src_inten_buf +
+                             (mask_y1 - tile->src_y) * tile->src_width +
+                             (mask_x1 - tile->src_x));
+
+          for (mask_y = mask_y1;
+               mask_y < mask_y2;
+               mask_y++, src_row += tile->src_rowstride)
+            {
+              const guchar *src        = src_row;
+              const guchar *src_inten  = src_inten_row;
+              gint          dy_squared = sqr_lut[ABS (mask_y - y)];
+              gint          mask_x;
+
+              for (mask_x = mask_x1; mask_x < mask_x2; mask_x++, src += bpp)
                 {
-                  guchar *src;
-                  guchar *src_inten = NULL;
-                  gint    dy_squared = sqr_lut[ABS (mask_y - y)];
-                  gint    mask_x;
-
-                  for (mask_x = mask_x1,
-                       src = src_row,
-                       src_inten = src_inten_row  /* valid iff use_inten */
-                       ;
-                       mask_x < mask_x2
-                       ;
-                       mask_x++,
-                       src += bpp,
-                       src_inten++)  /* valid iff use_inten */
+                  gint dx_squared = sqr_lut[ABS (mask_x - x)];
+                  gint b;
+
+                  /*  Stay inside a circular mask area  */
+                  if ((dx_squared + dy_squared) > radius_squared)
+                    continue;
+
+                  if (use_inten)
                     {
-                      gint dx_squared = sqr_lut[ABS (mask_x - x)];
-                      gint b;
-
-                      /*  Stay inside a circular mask area  */
-                      if ((dx_squared + dy_squared) > radius_squared)
-                        continue;
-
-                      if (use_inten)
-                        {
-                          gint inten = *src_inten;
-                          ++Hist[inten];
-                          for (b = 0; b < bpp; b++)
-                            Hist_rgb[b][inten] += src[b];
-                        }
-                      else
-                        {
-                          for (b = 0; b < bpp; b++)
-                            ++Hist_rgb[b][src[b]];
-                        }
-
-                    } /* for mask_x */
-                } /* for mask_y */
+                      gint inten = src_inten[mask_x - mask_x1];
+                      ++Hist[inten];
+                      for (b = 0; b < bpp; b++)
+                        Hist_rgb[b][inten] += src[b];
+                    }
+                  else
+                    {
+                      for (b = 0; b < bpp; b++)
+                        ++Hist_rgb[b][src[b]];
+                    }
+                } /* for mask_x */
 
               if (use_inten)
-                {
-                  weighted_average_color (Hist, Hist_rgb, exponent, dest, bpp);
-                }
-              else
-                {
-                  gint b;
+                src_inten_row += tile->src_width;
+            } /* for mask_y */
 
-                  for (b = 0; b < bpp; b++)
-                    dest[b] = weighted_average_value (Hist_rgb[b], exponent);
-                }
+          if (use_inten)
+            {
+              weighted_average_color (Hist, Hist_rgb, exponent, dest, bpp);
+            }
+          else
+            {
+              gint b;
 
-            } /* for x */
-        } /* for y */
+              for (b = 0; b < bpp; b++)
+                dest[b] = weighted_average_value (Hist_rgb[b], exponent);
+            }
+        } /* for x */
+    } /* for y */
 
-      if (preview)
-        {
-          gimp_drawable_preview_draw_region (GIMP_DRAWABLE_PREVIEW (preview),
-                                             &dest_rgn);
-        }
-      else
-        {
-          progress += dest_rgn.w * dest_rgn.h;
-          gimp_progress_update ((gdouble) progress / (gdouble) max_progress);
-        }
-    } /* for pr */
+  g_free (src_inten_buf);
+}
 
-  /*  Detach from the map drawables  */
-  if (mask_size_map_drawable)
-    gimp_drawable_detach (mask_size_map_drawable);
+/*
+ * Read a region of a mask-size / exponent map, the worker threads
+ * can't use the drawable themselves.
+ */
+static guchar *
+oilify_get_map (gint32  drawable_ID,
+                gint    x,
+                gint    y,
+                gint    width,
+                gint    height,
+                gint   *bpp)
+{
+  GimpDrawable *map;
+  GimpPixelRgn  map_rgn;
+  guchar       *buf;
 
-  if (exponent_map_drawable)
-    gimp_drawable_detach (exponent_map_drawable);
+  map  = gimp_drawable_get (drawable_ID);
+  *bpp = map->bpp;
 
-  if (src_inten_buf)
-    g_free (src_inten_buf);
+  buf = g_new (guchar, width * height * map->bpp);
 
-  g_free (src_buf);
-  g_free (sqr_lut);
+  gimp_pixel_rgn_init (&map_rgn, map, x, y, width, height, FALSE, FALSE);
+  gimp_pixel_rgn_get_rect (&map_rgn, buf, x, y, width, height);
 
-  if (!preview)
-    {
-      gimp_progress_update (1.0);
-      /*  Update the oil-painted region  */
-      gimp_drawable_flush (drawable);
-      gimp_drawable_merge_shadow (drawable->drawable_id, TRUE);
-      gimp_drawable_update (drawable->drawable_id, x1, y1, width, height);
-    }
+  gimp_drawable_detach (map);
+
+  return buf;
 }
 
 /*
@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+
+#   Despeckle Benchmark
+#
+#   Runs the Despeckle filter with growing radii on a noisy test image
+#   and prints the time each run takes. The median is computed from
+#   sliding histograms, so the time should stay about the same for all
+#   radii.
+#
+#   This program is free software: you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 3 of the License, or
+#   (at your option) any later version.
+#
+#   This program is distributed in the hope that it will be useful,
+#   but WITHOUT ANY WARRANTY; without even the implied warranty of
+#   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#   GNU General Public License for more details.
+#
+#   You should have received a copy of the GNU General Public License
+#   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+import sys, time
+
+from gimpfu import *
+
+
+radii = [ 1, 2, 4, 8, 12, 16, 20, 25, 30 ]
+
+# Radii for the heavily speckled image, where recursive adaptive
+# despeckle keeps changing the box size
+large_radii = [ 16, 20, 25, 30 ]
+
+filter_types = [ ("median", 0),
+                 ("adaptive", 1),
+                 ("recursive", 2),
+                 ("recursive adaptive", 3) ]
+
+
+def print_header (radii):
+    sys.stderr.write ("%-20s" % "radius")
+    for radius in radii:
+        sys.stderr.write ("%8d" % radius)
+    sys.stderr.write ("\n")
+
+
+def print_row (image, layer, name, filter_type, radii, repeat):
+    sys.stderr.write ("%-20s" % name)
+
+    for radius in radii:
+        best = None
+
+        for i in range (repeat):
+            copy = pdb.gimp_layer_copy (layer, False)
+            image.insert_layer (copy)
+
+            start = time.time ()
+            pdb.plug_in_despeckle (image, copy, radius, filter_type,
+                                   7, 248)
+            end = time.time ()
+
+            image.remove_layer (copy)
+
+            if best is None or end - start < best:
+                best = end - start
+
+        sys.stderr.write ("%7.3fs" % best)
+
+    sys.stderr.write ("\n")
+
+
+def benchmark (width, height, repeat):
+    image = gimp.Image (width, height, RGB)
+    layer = gimp.Layer (image, "Noise", width, height, RGB_IMAGE,
+                        100, NORMAL_MODE)
+    image.insert_layer (layer)
+
+    # A smooth gradient with speckles, roughly what despeckle is for
+    pdb.gimp_context_push ()
+    pdb.gimp_context_set_foreground ((40, 80, 120))
+    pdb.gimp_context_set_background ((220, 180, 140))
+    pdb.gimp_edit_blend (layer, FG_BG_RGB_MODE, NORMAL_MODE,
+                         GRADIENT_LINEAR, 100, 0, REPEAT_NONE, False,
+                         False, 1, 0, True, 0, 0, width, height)
+    pdb.gimp_context_pop ()
+
+    pdb.plug_in_randomize_hurl (image, layer, 10, 1, False, 1)
+
+    speckled = pdb.gimp_layer_copy (layer, False)
+    image.insert_layer (speckled)
+    pdb.plug_in_randomize_hurl (image, speckled, 60, 1, False, 2)
+
+    sys.stderr.write ("Despeckle %dx%d, best of %d runs\n" %
+                      (width, height, repeat))
+    print_header (radii)
+
+    for (name, filter_type) in filter_types:
+        print_row (image, layer, name, filter_type, radii, repeat)
+
+    sys.stderr.write ("\nHeavily speckled\n")
+    print_header (large_radii)
+    print_row (image, speckled, "recursive adaptive", 3, large_radii, repeat)
+
+    gimp.delete (image)
+
+
+register (
+    "python-fu-benchmark-despeckle",
+    "Benchmark the Despeckle filter for growing radii",
+    "",
+    "The GIMP Team",
+    "The GIMP Team",
+    "2016",
+    "Despeckle",
+    "",
+    [ (PF_INT32, "width",  "Image width",  3000),
+      (PF_INT32, "height", "Image height", 2000),
+      (PF_INT32, "repeat", "Runs per measurement", 3) ],
+    [],
+    benchmark, menu="<Image>/Filters/Extensions/Benchmark")
+
+main ()
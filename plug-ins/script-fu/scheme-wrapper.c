@@ -1625,9 +1625,9 @@ script_fu_marshal_procedure_call (scheme  *sc,
   g_free (params);
   g_free (return_vals);
 
-  /*  if we're in server mode, listen for additional commands for 10 ms  */
+  /*  if we're in server mode, queue the commands that came in  */
   if (script_fu_server_get_mode ())
-    script_fu_server_listen (10);
+    script_fu_server_poll ();
 
 #ifdef GDK_WINDOWING_WIN32
   /* This seems to help a lot on Windoze. */
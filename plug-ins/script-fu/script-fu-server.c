@@ -82,9 +82,9 @@ typedef short sa_family_t;	/* Not defined by winsock */
 #define RESPONSE_HEADER 4
 #define MAGIC           'G'
 
-#ifndef HAVE_DIFFTIME
-#define difftime(a,b) (((gdouble)(a)) - ((gdouble)(b)))
-#endif
+#define FRAME_HEADER    10
+#define FRAME_MAGIC     'P'
+#define FRAME_MAX_LEN   (16 * 1024 * 1024)
 
 #ifndef NO_FD_SET
 #  define SELECT_MASK fd_set
@@ -121,15 +121,58 @@ typedef short sa_family_t;	/* Not defined by winsock */
 #define RSP_LEN_H_BYTE  2
 #define RSP_LEN_L_BYTE  3
 
+/*  Header format for pipelined requests and responses...
+ *    bytes: 1          2          3-6          7-10
+ *           'P'        TYPE       REQUEST_ID   PAYLOAD_LEN
+ *
+ *  Integers are big-endian.  The request id is chosen by the client
+ *  and echoed in every frame sent back for the request, so a client
+ *  may send any number of 'E' (evaluate) requests without waiting for
+ *  the responses.  While a request runs, the server streams 'P'
+ *  (progress, 4 bytes in millionths) and 'M' (progress text) frames
+ *  for it, and finishes it with an 'R' (result) or 'E' (error) frame
+ *  whose payload starts with the milliseconds the request spent in
+ *  the queue and running (4 bytes each), followed by the response
+ *  text.  An 'S' (status) request is answered right away, even while
+ *  another request is running.  Requests from different clients take
+ *  turns, so one client queueing long requests does not hold up the
+ *  others by more than the request currently running.
+ */
+
+#define FRAME_TYPE_BYTE 1
+#define FRAME_ID_BYTE   2
+#define FRAME_LEN_BYTE  6
+
+#define REQUEST_EVAL      'E'
+#define REQUEST_STATUS    'S'
+
+#define RESPONSE_RESULT   'R'
+#define RESPONSE_ERROR    'E'
+#define RESPONSE_PROGRESS 'P'
+#define RESPONSE_MESSAGE  'M'
+#define RESPONSE_STATUS   'S'
+
 /*
  *  Local Types
  */
 
 typedef struct
 {
-  gchar *command;
-  gint   filedes;
-  gint   request_no;
+  gint        filedes;
+  gchar      *address;
+  GByteArray *input;     /*  received bytes of incomplete requests  */
+  GQueue     *commands;  /*  the client's queued requests, in order  */
+} SFClient;
+
+typedef struct
+{
+  gchar    *command;
+  SFClient *client;
+  gint      request_no;
+  gboolean  pipelined;
+  guint32   request_id;
+  gint64    receive_time;
+  gint      progress;
 } SFCommand;
 
 typedef struct
@@ -156,10 +199,31 @@ typedef union
  *  Local Functions
  */
 
-static void      server_start       (gint         port,
-                                     const gchar *logfile);
-static gboolean  execute_command    (SFCommand   *cmd);
-static gint      read_from_client   (gint         filedes);
+static void         server_start        (gint            port,
+                                         const gchar    *logfile);
+static void         server_listen       (struct timeval *tvp);
+static gboolean     execute_command     (SFCommand      *cmd);
+static gint         read_from_client    (SFClient       *client);
+static void         queue_command       (SFClient       *client,
+                                         gboolean        pipelined,
+                                         guint32         request_id,
+                                         const gchar    *command,
+                                         gsize           command_len);
+static void         send_status         (SFClient       *client,
+                                         guint32         request_id);
+static SFClient   * client_new          (gint            filedes,
+                                         const gchar    *address);
+static void         client_free         (SFClient       *client);
+static gboolean     client_send         (SFClient       *client,
+                                         const guchar   *data,
+                                         gsize           len);
+static GByteArray * frame_new           (guchar          type,
+                                         guint32         request_id);
+static void         frame_append_uint32 (GByteArray     *frame,
+                                         guint32         value);
+static guint32      frame_get_uint32    (const guchar   *data);
+static gboolean     frame_send          (SFClient       *client,
+                                         GByteArray     *frame);
 static gint      make_socket        (const struct addrinfo
                                                  *ai);
 static void      server_log         (const gchar *format,
@@ -179,9 +243,13 @@ static gint         server_socks[2],
                     server_socks_used = 0;
 static const gint   server_socks_len = sizeof (server_socks) /
                                        sizeof (server_socks[0]);
-static GList       *command_queue   = NULL;
+static GQueue      *ready_clients   = NULL;
 static gint         queue_length    = 0;
 static gint         request_no      = 0;
+static SFCommand   *running_command = NULL;
+static gint         n_served        = 0;
+static gdouble      total_queued    = 0.0;
+static gdouble      total_run       = 0.0;
 static FILE        *server_log_file = NULL;
 static GHashTable  *clients         = NULL;
 static gboolean     script_fu_done  = FALSE;
@@ -278,27 +346,23 @@ script_fu_server_read_fd (gpointer key,
                           gpointer value,
                           gpointer data)
 {
-  gint fd = GPOINTER_TO_INT (key);
+  SFClient *client = value;
 
-  if (FD_ISSET (fd, (SELECT_MASK *) data))
+  if (FD_ISSET (client->filedes, (SELECT_MASK *) data))
     {
-      if (read_from_client (fd) < 0)
+      if (read_from_client (client) < 0)
         {
-          GList *list;
+          server_log ("Server: disconnect from host %s.\n", client->address);
 
-          server_log ("Server: disconnect from host %s.\n", (gchar *) value);
+          CLOSESOCKET (client->filedes);
 
-          CLOSESOCKET (fd);
+          /*  Invalidate the file descriptor, pending commands from the
+              disconnected client still run.  */
+          client->filedes = -1;
 
-          /*  Invalidate the file descriptor for pending commands
-              from the disconnected client.  */
-          for (list = command_queue; list; list = list->next)
-            {
-              SFCommand *cmd = (SFCommand *) command_queue->data;
-
-              if (cmd->filedes == fd)
-                cmd->filedes = -1;
-            }
+          if (g_queue_is_empty (client->commands) &&
+              ! (running_command && running_command->client == client))
+            client_free (client);
 
           return TRUE;  /*  remove this client from the hash table  */
         }
@@ -310,18 +374,27 @@ script_fu_server_read_fd (gpointer key,
 void
 script_fu_server_listen (gint timeout)
 {
-  struct timeval  tv;
-  struct timeval *tvp = NULL;
-  SELECT_MASK     fds;
-  gint            sockno;
+  struct timeval tv;
 
   /*  Set time struct  */
   if (timeout)
     {
       tv.tv_sec  = timeout / 1000;
-      tv.tv_usec = timeout % 1000;
-      tvp = &tv;
+      tv.tv_usec = (timeout % 1000) * 1000;
+
+      server_listen (&tv);
     }
+  else
+    {
+      server_listen (NULL);
+    }
+}
+
+static void
+server_listen (struct timeval *tvp)
+{
+  SELECT_MASK     fds;
+  gint            sockno;
 
   FD_ZERO (&fds);
   for (sockno = 0; sockno < server_socks_used; sockno++)
@@ -373,7 +446,7 @@ script_fu_server_listen (gint timeout)
                           NULL, 0, NI_NUMERICHOST);
 
       g_hash_table_insert (clients, GINT_TO_POINTER (new),
-                           g_strdup (clientname));
+                           client_new (new, clientname));
 
       /* Determine port number */
       switch (client.family)
@@ -396,37 +469,77 @@ script_fu_server_listen (gint timeout)
   g_hash_table_foreach_remove (clients, script_fu_server_read_fd, &fds);
 }
 
+/*
+ * Take in requests arriving while a command runs, without blocking.
+ * This only queues them, the interpreter is busy.
+ */
+void
+script_fu_server_poll (void)
+{
+  struct timeval tv = { 0, 0 };
+
+  server_listen (&tv);
+}
+
 static void
-server_progress_start (const gchar *message,
-                       gboolean     cancelable,
-                       gpointer     user_data)
+server_progress_set_text (const gchar *message,
+                          gpointer     user_data)
 {
-  /* do nothing */
+  SFCommand *cmd = running_command;
+
+  if (cmd && cmd->pipelined && message && *message)
+    {
+      GByteArray *frame = frame_new (RESPONSE_MESSAGE, cmd->request_id);
+
+      g_byte_array_append (frame, (const guchar *) message, strlen (message));
+
+      frame_send (cmd->client, frame);
+    }
+
+  script_fu_server_poll ();
 }
 
 static void
-server_progress_end (gpointer user_data)
+server_progress_start (const gchar *message,
+                       gboolean     cancelable,
+                       gpointer     user_data)
 {
-  /* do nothing */
+  server_progress_set_text (message, user_data);
 }
 
 static void
-server_progress_set_text (const gchar *message,
-                          gpointer     user_data)
+server_progress_end (gpointer user_data)
 {
-  /* do nothing */
+  script_fu_server_poll ();
 }
 
 static void
 server_progress_set_value (gdouble   percentage,
                            gpointer  user_data)
 {
-  /* do nothing */
+  SFCommand *cmd = running_command;
+
+  /*  stream whole percents only, a filter may update much more often  */
+  if (cmd && cmd->pipelined && (gint) (percentage * 100) != cmd->progress)
+    {
+      GByteArray *frame = frame_new (RESPONSE_PROGRESS, cmd->request_id);
+
+      percentage = CLAMP (percentage, 0.0, 1.0);
+
+      frame_append_uint32 (frame, (guint32) (percentage * 1000000));
+      frame_send (cmd->client, frame);
+
+      cmd->progress = (gint) (percentage * 100);
+    }
+
+  script_fu_server_poll ();
 }
 
 
 /*
- * Suppress progress popups by installing progress handlers that do nothing.
+ * Suppress progress popups by installing progress handlers that forward
+ * the progress to pipelined clients instead, and keep taking in
+ * requests while a command runs.
  */
 static const gchar *
 server_progress_install (void)
@@ -500,9 +613,11 @@ server_start (gint         port,
   if (! server_log_file)
     server_log_file = stdout;
 
-  /*  Set up the clientname hash table  */
-  clients = g_hash_table_new_full (g_direct_hash, NULL,
-                                   NULL, (GDestroyNotify) g_free);
+  /*  Set up the client hash table and the queue of clients
+   *  with pending requests
+   */
+  clients       = g_hash_table_new (g_direct_hash, NULL);
+  ready_clients = g_queue_new ();
 
   progress = server_progress_install ();
 
@@ -511,23 +626,38 @@ server_start (gint         port,
   /*  Loop until the server is finished  */
   while (! script_fu_done)
     {
-      script_fu_server_listen (0);
+      SFClient  *client;
+      SFCommand *cmd;
 
-      while (command_queue)
-        {
-          SFCommand *cmd = (SFCommand *) command_queue->data;
+      /*  Only block when there is nothing to do  */
+      if (g_queue_is_empty (ready_clients))
+        server_listen (NULL);
+      else
+        script_fu_server_poll ();
 
-          /*  Process the command  */
-          execute_command (cmd);
+      client = g_queue_pop_head (ready_clients);
 
-          /*  Remove the command from the list  */
-          command_queue = g_list_remove (command_queue, cmd);
-          queue_length--;
+      if (! client)
+        continue;
 
-          /*  Free the request  */
-          g_free (cmd->command);
-          g_free (cmd);
-      }
+      cmd = g_queue_pop_head (client->commands);
+      queue_length--;
+
+      /*  Clients take turns, one request at a time  */
+      if (! g_queue_is_empty (client->commands))
+        g_queue_push_tail (ready_clients, client);
+
+      /*  Process the command  */
+      running_command = cmd;
+      execute_command (cmd);
+      running_command = NULL;
+
+      if (client->filedes < 0 && g_queue_is_empty (client->commands))
+        client_free (client);
+
+      /*  Free the request  */
+      g_free (cmd->command);
+      g_free (cmd);
     }
 
   server_progress_uninstall (progress);
@@ -538,15 +668,16 @@ server_start (gint         port,
 static gboolean
 execute_command (SFCommand *cmd)
 {
-  guchar    buffer[RESPONSE_HEADER];
   GString  *response;
-  time_t    clock1;
-  time_t    clock2;
+  time_t    clock;
+  gint64    start_time;
+  gdouble   queued;
+  gdouble   run;
   gboolean  error;
-  gint      i;
+  gboolean  success;
 
   server_log ("Processing request #%d\n", cmd->request_no);
-  time (&clock1);
+  start_time = g_get_monotonic_time ();
 
   response = g_string_new (NULL);
   ts_register_output_func (ts_gstring_output_func, response);
@@ -564,120 +695,357 @@ execute_command (SFCommand *cmd)
 
       if (response->len == 0)
         g_string_assign (response, ts_get_success_msg ());
+    }
+
+  queued = (start_time - cmd->receive_time) / (gdouble) G_USEC_PER_SEC;
+  run    = (g_get_monotonic_time () - start_time) / (gdouble) G_USEC_PER_SEC;
+
+  n_served++;
+  total_queued += queued;
+  total_run    += run;
+
+  time (&clock);
+  server_log ("Request #%d processed in %f seconds after %f seconds "
+              "in the queue, finishing on %s",
+              cmd->request_no, run, queued, ctime (&clock));
+
+  if (cmd->pipelined)
+    {
+      GByteArray *frame;
 
-      time (&clock2);
-      server_log ("Request #%d processed in %f seconds, finishing on %s",
-                  cmd->request_no, difftime (clock2, clock1), ctime (&clock2));
+      frame = frame_new (error ? RESPONSE_ERROR : RESPONSE_RESULT,
+                         cmd->request_id);
+
+      frame_append_uint32 (frame, (guint32) (queued * 1000));
+      frame_append_uint32 (frame, (guint32) (run * 1000));
+      g_byte_array_append (frame,
+                           (const guchar *) response->str, response->len);
+
+      success = frame_send (cmd->client, frame);
     }
+  else
+    {
+      guchar buffer[RESPONSE_HEADER];
+
+      buffer[MAGIC_BYTE]     = MAGIC;
+      buffer[ERROR_BYTE]     = error ? TRUE : FALSE;
+      buffer[RSP_LEN_H_BYTE] = (guchar) (response->len >> 8);
+      buffer[RSP_LEN_L_BYTE] = (guchar) (response->len & 0xFF);
 
-  buffer[MAGIC_BYTE]     = MAGIC;
-  buffer[ERROR_BYTE]     = error ? TRUE : FALSE;
-  buffer[RSP_LEN_H_BYTE] = (guchar) (response->len >> 8);
-  buffer[RSP_LEN_L_BYTE] = (guchar) (response->len & 0xFF);
-
-  /*  Write the response to the client  */
-  for (i = 0; i < RESPONSE_HEADER; i++)
-    if (cmd->filedes > 0 && send (cmd->filedes, buffer + i, 1, 0) < 0)
-      {
-        /*  Write error  */
-        print_socket_api_error ("send");
-        return FALSE;
-      }
-
-  for (i = 0; i < response->len; i++)
-    if (cmd->filedes > 0 && send (cmd->filedes, response->str + i, 1, 0) < 0)
-      {
-        /*  Write error  */
-        print_socket_api_error ("send");
-        return FALSE;
-      }
+      /*  Write the response to the client  */
+      success = (client_send (cmd->client, buffer, RESPONSE_HEADER) &&
+                 client_send (cmd->client,
+                              (const guchar *) response->str, response->len));
+    }
 
   g_string_free (response, TRUE);
 
-  return FALSE;
+  return success;
 }
 
 static gint
-read_from_client (gint filedes)
+read_from_client (SFClient *client)
 {
-  SFCommand *cmd;
-  guchar     buffer[COMMAND_HEADER];
-  gchar     *command;
-  gchar     *clientaddr;
-  time_t     clock;
-  gint       command_len;
-  gint       nbytes;
-  gint       i;
+  guchar buffer[4096];
+  gint   nbytes;
 
-  for (i = 0; i < COMMAND_HEADER;)
+  while (TRUE)
     {
-      nbytes = recv (filedes, buffer + i, COMMAND_HEADER - i, 0);
+      nbytes = recv (client->filedes, buffer, sizeof (buffer), 0);
 
-      if (nbytes < 0)
-        {
 #ifndef G_OS_WIN32
-          if (errno == EINTR)
-            continue;
+      if (nbytes < 0 && errno == EINTR)
+        continue;
 #endif
-          server_log ("Error reading command header.\n");
-          return -1;
+
+      break;
+    }
+
+  if (nbytes < 0)
+    {
+      server_log ("Error reading command.\n");
+      return -1;
+    }
+
+  if (nbytes == 0)
+    return -1;  /* EOF */
+
+  g_byte_array_append (client->input, buffer, nbytes);
+
+  /*  Queue all complete requests, keep the rest for the next read  */
+  while (client->input->len > 0)
+    {
+      const guchar *data = client->input->data;
+      gsize         len;
+
+      if (data[MAGIC_BYTE] == MAGIC)
+        {
+          gsize command_len;
+
+          if (client->input->len < COMMAND_HEADER)
+            break;
+
+          command_len = (data[CMD_LEN_H_BYTE] << 8) | data[CMD_LEN_L_BYTE];
+          len         = COMMAND_HEADER + command_len;
+
+          if (client->input->len < len)
+            break;
+
+          queue_command (client, FALSE, 0,
+                         (const gchar *) data + COMMAND_HEADER, command_len);
         }
+      else if (data[MAGIC_BYTE] == FRAME_MAGIC)
+        {
+          guint32 request_id;
+          guint32 payload_len;
 
-      if (nbytes == 0)
-        return -1;  /* EOF */
+          if (client->input->len < FRAME_HEADER)
+            break;
 
-      i += nbytes;
+          request_id  = frame_get_uint32 (data + FRAME_ID_BYTE);
+          payload_len = frame_get_uint32 (data + FRAME_LEN_BYTE);
+
+          if (payload_len > FRAME_MAX_LEN)
+            {
+              server_log ("Request of %u bytes is too long.\n", payload_len);
+              return -1;
+            }
+
+          len = FRAME_HEADER + payload_len;
+
+          if (client->input->len < len)
+            break;
+
+          switch (data[FRAME_TYPE_BYTE])
+            {
+            case REQUEST_EVAL:
+              queue_command (client, TRUE, request_id,
+                             (const gchar *) data + FRAME_HEADER, payload_len);
+              break;
+
+            case REQUEST_STATUS:
+              send_status (client, request_id);
+              break;
+
+            default:
+              {
+                GByteArray  *frame = frame_new (RESPONSE_ERROR, request_id);
+                const gchar *msg   = "Unknown request type";
+
+                frame_append_uint32 (frame, 0);
+                frame_append_uint32 (frame, 0);
+                g_byte_array_append (frame, (const guchar *) msg, strlen (msg));
+
+                frame_send (client, frame);
+              }
+              break;
+            }
+        }
+      else
+        {
+          server_log ("Error in script-fu command transmission.\n");
+          return -1;
+        }
+
+      g_byte_array_remove_range (client->input, 0, len);
     }
 
-  if (buffer[MAGIC_BYTE] != MAGIC)
+  return 0;
+}
+
+static void
+queue_command (SFClient    *client,
+               gboolean     pipelined,
+               guint32      request_id,
+               const gchar *command,
+               gsize        command_len)
+{
+  SFCommand *cmd;
+  time_t     clock;
+
+  cmd = g_new0 (SFCommand, 1);
+
+  cmd->command      = g_strndup (command, command_len);
+  cmd->client       = client;
+  cmd->request_no   = request_no ++;
+  cmd->pipelined    = pipelined;
+  cmd->request_id   = request_id;
+  cmd->receive_time = g_get_monotonic_time ();
+  cmd->progress     = -1;
+
+  /*  Add the command to the client's queue, and the client to the
+   *  clients waiting for their turn
+   */
+  if (g_queue_is_empty (client->commands))
+    g_queue_push_tail (ready_clients, client);
+
+  g_queue_push_tail (client->commands, cmd);
+  queue_length ++;
+
+  time (&clock);
+  server_log ("Received request #%d from IP address %s: %s on %s,"
+              "[Request queue length: %d]",
+              cmd->request_no, client->address,
+              cmd->command, ctime (&clock), queue_length);
+}
+
+static void
+send_status (SFClient *client,
+             guint32   request_id)
+{
+  GByteArray *frame = frame_new (RESPONSE_STATUS, request_id);
+  GString    *status = g_string_new (NULL);
+
+  if (running_command)
+    g_string_append_printf (status, "running: #%d for %f seconds\n",
+                            running_command->request_no,
+                            (g_get_monotonic_time () -
+                             running_command->receive_time) /
+                            (gdouble) G_USEC_PER_SEC);
+  else
+    g_string_append (status, "running: none\n");
+
+  g_string_append_printf (status, "queued: %d\n", queue_length);
+  g_string_append_printf (status, "clients: %d\n",
+                          g_hash_table_size (clients));
+  g_string_append_printf (status, "served: %d\n", n_served);
+
+  if (n_served > 0)
+    g_string_append_printf (status,
+                            "mean queued: %f seconds\n"
+                            "mean run: %f seconds\n",
+                            total_queued / n_served,
+                            total_run / n_served);
+
+  g_byte_array_append (frame, (const guchar *) status->str, status->len);
+  g_string_free (status, TRUE);
+
+  frame_send (client, frame);
+}
+
+static SFClient *
+client_new (gint         filedes,
+            const gchar *address)
+{
+  SFClient *client = g_new0 (SFClient, 1);
+
+  client->filedes  = filedes;
+  client->address  = g_strdup (address);
+  client->input    = g_byte_array_new ();
+  client->commands = g_queue_new ();
+
+  return client;
+}
+
+static void
+client_free (SFClient *client)
+{
+  SFCommand *cmd;
+
+  while ((cmd = g_queue_pop_head (client->commands)))
     {
-      server_log ("Error in script-fu command transmission.\n");
-      return -1;
+      g_free (cmd->command);
+      g_free (cmd);
+
+      queue_length--;
     }
 
-  command_len = (buffer [CMD_LEN_H_BYTE] << 8) | buffer [CMD_LEN_L_BYTE];
-  command = g_new (gchar, command_len + 1);
+  g_queue_free (client->commands);
+  g_byte_array_free (client->input, TRUE);
+  g_free (client->address);
+  g_free (client);
+}
+
+static gboolean
+client_send (SFClient     *client,
+             const guchar *data,
+             gsize         len)
+{
+  gsize i;
+
+  /*  The client is gone, drop the response  */
+  if (client->filedes < 0)
+    return TRUE;
 
-  for (i = 0; i < command_len;)
+  for (i = 0; i < len;)
     {
-      nbytes = recv (filedes, command + i, command_len - i, 0);
+      gint nbytes = send (client->filedes, (const gchar *) data + i,
+                          len - i, 0);
 
-      if (nbytes <= 0)
+      if (nbytes < 0)
         {
 #ifndef G_OS_WIN32
-          if (nbytes < 0 && errno == EINTR)
+          if (errno == EINTR)
             continue;
 #endif
-           server_log ("Error reading command.  Read %d out of %d bytes.\n",
-                       i, command_len);
-           g_free (command);
-           return -1;
+          /*  Write error  */
+          print_socket_api_error ("send");
+          return FALSE;
         }
 
       i += nbytes;
     }
 
-  command[command_len] = '\0';
-  cmd = g_new (SFCommand, 1);
+  return TRUE;
+}
 
-  cmd->filedes    = filedes;
-  cmd->command    = command;
-  cmd->request_no = request_no ++;
+static GByteArray *
+frame_new (guchar  type,
+           guint32 request_id)
+{
+  GByteArray *frame = g_byte_array_sized_new (FRAME_HEADER);
+  guchar      header[2];
 
-  /*  Add the command to the queue  */
-  command_queue = g_list_append (command_queue, cmd);
-  queue_length ++;
+  header[MAGIC_BYTE]      = FRAME_MAGIC;
+  header[FRAME_TYPE_BYTE] = type;
 
-  /*  Get the client address from the address/socket table  */
-  clientaddr = g_hash_table_lookup (clients, GINT_TO_POINTER (cmd->filedes));
-  time (&clock);
-  server_log ("Received request #%d from IP address %s: %s on %s,"
-              "[Request queue length: %d]",
-              cmd->request_no,
-                  clientaddr ? clientaddr : "<invalid>",
-                      cmd->command, ctime (&clock), queue_length);
+  g_byte_array_append (frame, header, 2);
+  frame_append_uint32 (frame, request_id);
+  frame_append_uint32 (frame, 0);  /*  payload length, set by frame_send()  */
 
-  return 0;
+  return frame;
+}
+
+static void
+frame_append_uint32 (GByteArray *frame,
+                     guint32     value)
+{
+  guchar bytes[4];
+
+  bytes[0] = (guchar) (value >> 24);
+  bytes[1] = (guchar) (value >> 16);
+  bytes[2] = (guchar) (value >> 8);
+  bytes[3] = (guchar) (value & 0xFF);
+
+  g_byte_array_append (frame, bytes, 4);
+}
+
+static guint32
+frame_get_uint32 (const guchar *data)
+{
+  return (((guint32) data[0] << 24) |
+          ((guint32) data[1] << 16) |
+          ((guint32) data[2] << 8)  |
+          ((guint32) data[3]));
+}
+
+static gboolean
+frame_send (SFClient   *client,
+            GByteArray *frame)
+{
+  guint32  len = frame->len - FRAME_HEADER;
+  gboolean success;
+
+  frame->data[FRAME_LEN_BYTE]     = (guchar) (len >> 24);
+  frame->data[FRAME_LEN_BYTE + 1] = (guchar) (len >> 16);
+  frame->data[FRAME_LEN_BYTE + 2] = (guchar) (len >> 8);
+  frame->data[FRAME_LEN_BYTE + 3] = (guchar) (len & 0xFF);
+
+  success = client_send (client, frame->data, frame->len);
+
+  g_byte_array_free (frame, TRUE);
+
+  return success;
 }
 
 static gint
@@ -763,6 +1131,8 @@ script_fu_server_shutdown_fd (gpointer key,
                               gpointer data)
 {
   shutdown (GPOINTER_TO_INT (key), 2);
+
+  client_free (value);
 }
 
 static void
@@ -775,6 +1145,19 @@ server_quit (void)
       CLOSESOCKET (server_socks[sockno]);
     }
 
+  if (ready_clients)
+    {
+      SFClient *client;
+
+      /*  Disconnected clients are only referenced from here  */
+      while ((client = g_queue_pop_head (ready_clients)))
+        if (client->filedes < 0)
+          client_free (client);
+
+      g_queue_free (ready_clients);
+      ready_clients = NULL;
+    }
+
   if (clients)
     {
       g_hash_table_foreach (clients, script_fu_server_shutdown_fd, NULL);
@@ -782,17 +1165,7 @@ server_quit (void)
       clients = NULL;
     }
 
-  while (command_queue)
-    {
-      SFCommand *cmd = command_queue->data;
-
-      g_free (cmd->command);
-      g_free (cmd);
-    }
-
-  g_list_free (command_queue);
-  command_queue = NULL;
-  queue_length  = 0;
+  queue_length = 0;
 
   /*  Close the server log file  */
   if (server_log_file != stdout)
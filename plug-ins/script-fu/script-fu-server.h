@@ -25,6 +25,7 @@ void  script_fu_server_run      (const gchar      *name,
 				 gint             *nreturn_vals,
 				 GimpParam       **return_vals);
 void  script_fu_server_listen   (gint              timeout);
+void  script_fu_server_poll     (void);
 gint  script_fu_server_get_mode (void);
 void  script_fu_server_quit     (void);
 
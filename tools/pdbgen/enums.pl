@@ -414,14 +414,16 @@ package Gimp::CodeGen::enums;
 	  mapping => { GIMP_VECTORS_STROKE_TYPE_BEZIER => '0' }
 	},
     GimpConvertDitherType =>
-	{ contig => 1,
+	{ contig => 0,
 	  header => 'core/core-enums.h',
 	  symbols => [ qw(GIMP_NO_DITHER GIMP_FS_DITHER
-			  GIMP_FSLOWBLEED_DITHER GIMP_FIXED_DITHER) ],
+			  GIMP_FSLOWBLEED_DITHER GIMP_FIXED_DITHER
+			  GIMP_BLUE_NOISE_DITHER) ],
 	  mapping => { GIMP_NO_DITHER => '0',
 		       GIMP_FS_DITHER => '1',
 		       GIMP_FSLOWBLEED_DITHER => '2',
-		       GIMP_FIXED_DITHER => '3' }
+		       GIMP_FIXED_DITHER => '3',
+		       GIMP_BLUE_NOISE_DITHER => '5' }
 	},
     GimpConvertPaletteType =>
 	{ contig => 1,